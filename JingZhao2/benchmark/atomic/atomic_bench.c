@@ -0,0 +1,417 @@
+/*
+ * Remote atomics under contention.
+ *
+ * Every client QP targets the same 8-byte counter through its own
+ * RC connection, with -d atomics outstanding per QP, posted as each
+ * one completes. The datapath is libhgrnic's, set up through hgshim,
+ * so the same program runs against hgmodel (atomic_bench) and against
+ * the RTL co-simulation (atomic_bench_cosim, built with
+ * ATOMIC_BENCH_COSIM).
+ *
+ *   fa  fetch-and-add 1: every fetched value must be a distinct value
+ *       below the number of ops, and the counter must end at that
+ *       number.
+ *   cs  compare-and-swap from the last value a QP saw to that value
+ *       plus one. A CAS that another QP beat fails. The counter must
+ *       end at the number of successful CASes.
+ *
+ * Prints one JSON object. The time is simulated time under the
+ * co-simulation. Against hgmodel it is wall-clock time of a functional
+ * model, so it tracks the software path, not the HCA.
+ *
+ * The RTL does not execute atomics yet and leaves DEV_LIM_FLAG_ATOMIC
+ * clear, so libhgrnic refuses the first WR. atomic_bench then exits
+ * ATOMIC_EXIT_UNCHECKED (3) instead of reporting a rate.
+ *
+ * usage: atomic_bench [-t fa|cs] [-q qps] [-n ops] [-d depth]
+ *   -t  operation, default fa
+ *   -q  client QPs, default 16
+ *   -n  atomics per QP, default 1000
+ *   -d  atomics outstanding per QP, default 4
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hgshim.h"
+#ifdef ATOMIC_BENCH_COSIM
+#include "hgcosim.h"
+#endif
+
+#define ATOMIC_MAX_QPS          64
+#define ATOMIC_MAX_DEPTH        16
+#define ATOMIC_POLL_TIMEOUT     60          /* s, simulated time is slow */
+#define ATOMIC_EXIT_UNCHECKED   3
+
+/* hgrnic_cmd.h */
+#define DEV_LIM_FLAG_ATOMIC     (1U << 18)
+
+struct atomic_bench {
+    int             cas;
+    int             num_qps;
+    int             ops;                /* per QP */
+    int             depth;
+
+    struct hgm_dev     *dev;
+    struct ibv_context *ctx;
+    struct ibv_pd      *pd;
+    struct ibv_cq      *cq;             /* client send completions */
+    struct ibv_cq      *rcq;            /* server QPs, stays empty */
+    struct ibv_qp      *cli[ATOMIC_MAX_QPS];
+    struct ibv_qp      *srv[ATOMIC_MAX_QPS];
+    struct ibv_mr      *counter_mr;
+    struct ibv_mr      *result_mr;
+    uint64_t           *counter;
+    uint64_t           *result;         /* one per outstanding WR */
+    uint64_t           *compare;        /* cs: what each WR compared */
+
+    int                 posted[ATOMIC_MAX_QPS];
+    uint64_t            seen[ATOMIC_MAX_QPS];   /* cs: last value seen */
+    uint8_t            *fetched;        /* fa: values handed out */
+    uint64_t            done;
+    uint64_t            successes;
+};
+
+static uint64_t now_ns(struct atomic_bench *b)
+{
+#ifdef ATOMIC_BENCH_COSIM
+    return hgcosim_time_ns(b->dev);
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static void connect_qp(struct ibv_qp *qp, uint32_t dest_qpn)
+{
+    struct ibv_qp_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.qp_state        = IBV_QPS_INIT;
+    attr.port_num        = 1;
+    attr.qp_access_flags = IBV_ACCESS_REMOTE_ATOMIC;
+    if (hgshim_modify_qp(qp, &attr, IBV_QP_STATE | IBV_QP_PORT |
+                         IBV_QP_ACCESS_FLAGS))
+        goto err;
+
+    attr.qp_state           = IBV_QPS_RTR;
+    attr.path_mtu           = IBV_MTU_1024;
+    attr.dest_qp_num        = dest_qpn;
+    attr.max_dest_rd_atomic = ATOMIC_MAX_DEPTH;
+    if (hgshim_modify_qp(qp, &attr, IBV_QP_STATE | IBV_QP_PATH_MTU |
+                         IBV_QP_DEST_QPN | IBV_QP_RQ_PSN |
+                         IBV_QP_MAX_DEST_RD_ATOMIC))
+        goto err;
+
+    attr.qp_state      = IBV_QPS_RTS;
+    attr.max_rd_atomic = ATOMIC_MAX_DEPTH;
+    if (hgshim_modify_qp(qp, &attr, IBV_QP_STATE | IBV_QP_SQ_PSN |
+                         IBV_QP_MAX_QP_RD_ATOMIC))
+        goto err;
+    return;
+
+err:
+    fprintf(stderr, "atomic_bench: can't connect QP 0x%x\n", qp->qp_num);
+    exit(1);
+}
+
+static struct ibv_qp *create_qp(struct atomic_bench *b, struct ibv_cq *cq)
+{
+    struct ibv_qp_init_attr attr;
+    struct ibv_qp *qp;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.send_cq          = cq;
+    attr.recv_cq          = b->rcq;
+    attr.qp_type          = IBV_QPT_RC;
+    attr.cap.max_send_wr  = b->depth;
+    attr.cap.max_recv_wr  = 1;
+    attr.cap.max_send_sge = 1;
+    attr.cap.max_recv_sge = 1;
+
+    qp = hgshim_create_qp(b->pd, &attr);
+    if (!qp) {
+        perror("atomic_bench: hgshim_create_qp");
+        exit(1);
+    }
+    return qp;
+}
+
+static void setup(struct atomic_bench *b)
+{
+    size_t slots = (size_t) b->num_qps * b->depth;
+    size_t result_size = (slots * 8 + 4095) & ~(size_t) 4095;
+    int i;
+
+#ifdef ATOMIC_BENCH_COSIM
+    b->dev = hgm_create(NULL, NULL);
+#else
+    {
+        struct hgm_config cfg;
+
+        hgm_default_config(&cfg);
+        cfg.dev_cap_flags |= DEV_LIM_FLAG_ATOMIC;
+        b->dev = hgm_create(&cfg, NULL);
+    }
+#endif
+    if (!b->dev) {
+        fprintf(stderr, "atomic_bench: no device\n");
+        exit(1);
+    }
+    b->ctx = hgshim_open(b->dev);
+    if (!b->ctx) {
+        perror("atomic_bench: hgshim_open");
+        exit(1);
+    }
+    b->pd  = hgshim_alloc_pd(b->ctx);
+    b->cq  = hgshim_create_cq(b->ctx, slots);
+    b->rcq = hgshim_create_cq(b->ctx, 1);
+    if (!b->pd || !b->cq || !b->rcq) {
+        perror("atomic_bench: PD/CQ");
+        exit(1);
+    }
+
+    for (i = 0; i < b->num_qps; ++i) {
+        b->cli[i] = create_qp(b, b->cq);
+        b->srv[i] = create_qp(b, b->rcq);
+        connect_qp(b->cli[i], b->srv[i]->qp_num);
+        connect_qp(b->srv[i], b->cli[i]->qp_num);
+    }
+
+    b->counter = aligned_alloc(4096, 4096);
+    b->result  = aligned_alloc(4096, result_size);
+    b->compare = calloc(slots, sizeof(*b->compare));
+    b->fetched = calloc((size_t) b->num_qps * b->ops, 1);
+    if (!b->counter || !b->result || !b->compare || !b->fetched) {
+        fprintf(stderr, "atomic_bench: out of memory\n");
+        exit(1);
+    }
+    *b->counter = 0;
+    b->counter_mr = hgshim_reg_mr(b->pd, b->counter, 4096,
+                                  IBV_ACCESS_LOCAL_WRITE |
+                                  IBV_ACCESS_REMOTE_ATOMIC);
+    b->result_mr  = hgshim_reg_mr(b->pd, b->result, result_size,
+                                  IBV_ACCESS_LOCAL_WRITE);
+    if (!b->counter_mr || !b->result_mr) {
+        perror("atomic_bench: hgshim_reg_mr");
+        exit(1);
+    }
+}
+
+static void teardown(struct atomic_bench *b)
+{
+    int i;
+
+    for (i = 0; i < b->num_qps; ++i) {
+        hgshim_destroy_qp(b->cli[i]);
+        hgshim_destroy_qp(b->srv[i]);
+    }
+    hgshim_dereg_mr(b->counter_mr);
+    hgshim_dereg_mr(b->result_mr);
+    hgshim_destroy_cq(b->cq);
+    hgshim_destroy_cq(b->rcq);
+    hgshim_dealloc_pd(b->pd);
+    hgshim_close(b->ctx);
+    hgm_destroy(b->dev);
+
+    free(b->counter);
+    free(b->result);
+    free(b->compare);
+    free(b->fetched);
+}
+
+/* Post the next atomic of QP q into result slot s. */
+static int post_atomic(struct atomic_bench *b, int q, int s)
+{
+    struct ibv_sge sge = {
+        .addr   = (uintptr_t) &b->result[s],
+        .length = 8,
+        .lkey   = b->result_mr->lkey
+    };
+    struct ibv_send_wr wr, *bad;
+
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id                 = s;
+    wr.sg_list               = &sge;
+    wr.num_sge               = 1;
+    wr.send_flags            = IBV_SEND_SIGNALED;
+    wr.wr.atomic.remote_addr = (uintptr_t) b->counter;
+    wr.wr.atomic.rkey        = b->counter_mr->rkey;
+    if (b->cas) {
+        wr.opcode                = IBV_WR_ATOMIC_CMP_AND_SWP;
+        wr.wr.atomic.compare_add = b->seen[q];
+        wr.wr.atomic.swap        = b->seen[q] + 1;
+        b->compare[s]            = b->seen[q];
+    } else {
+        wr.opcode                = IBV_WR_ATOMIC_FETCH_AND_ADD;
+        wr.wr.atomic.compare_add = 1;
+    }
+
+    if (ibv_post_send(b->cli[q], &wr, &bad))
+        return -1;
+    b->posted[q]++;
+    return 0;
+}
+
+/* Check one completion and post the QP's next atomic into its slot. */
+static int complete(struct atomic_bench *b, const struct ibv_wc *wc)
+{
+    int s = wc->wr_id;
+    int q = s / b->depth;
+    uint64_t v = b->result[s];
+    uint64_t total = (uint64_t) b->num_qps * b->ops;
+
+    if (wc->status != IBV_WC_SUCCESS || wc->byte_len != 8) {
+        fprintf(stderr, "atomic_bench: QP %d: status %d, byte_len %u\n",
+                q, wc->status, wc->byte_len);
+        return -1;
+    }
+
+    if (b->cas) {
+        if (v == b->compare[s]) {
+            b->successes++;
+            v++;
+        }
+        if (v > b->seen[q])
+            b->seen[q] = v;
+    } else {
+        if (v >= total || b->fetched[v]) {
+            fprintf(stderr, "atomic_bench: fetch-and-add returned %llu "
+                    "twice or out of range\n", (unsigned long long) v);
+            return -1;
+        }
+        b->fetched[v] = 1;
+        b->successes++;
+    }
+    b->done++;
+
+    if (b->posted[q] < b->ops && post_atomic(b, q, s)) {
+        fprintf(stderr, "atomic_bench: post on QP %d failed\n", q);
+        return -1;
+    }
+    return 0;
+}
+
+static int run(struct atomic_bench *b, uint64_t *ns)
+{
+    uint64_t total = (uint64_t) b->num_qps * b->ops;
+    struct ibv_wc wc[ATOMIC_MAX_QPS];
+    time_t deadline;
+    uint64_t t0;
+    int q, k, n, i;
+
+    t0 = now_ns(b);
+    for (k = 0; k < b->depth; ++k)
+        for (q = 0; q < b->num_qps; ++q) {
+            if (b->posted[q] >= b->ops)
+                continue;
+            if (post_atomic(b, q, q * b->depth + k)) {
+                if (!b->done && !q && !k)
+                    return ATOMIC_EXIT_UNCHECKED;
+                fprintf(stderr, "atomic_bench: post on QP %d failed\n", q);
+                return 1;
+            }
+        }
+
+    deadline = time(NULL) + ATOMIC_POLL_TIMEOUT;
+    while (b->done < total) {
+        n = ibv_poll_cq(b->cq, ATOMIC_MAX_QPS, wc);
+        if (n < 0) {
+            fprintf(stderr, "atomic_bench: poll failed\n");
+            return 1;
+        }
+        if (!n && time(NULL) > deadline) {
+            fprintf(stderr, "atomic_bench: %llu of %llu atomics completed\n",
+                    (unsigned long long) b->done,
+                    (unsigned long long) total);
+            return 1;
+        }
+        for (i = 0; i < n; ++i)
+            if (complete(b, &wc[i]))
+                return 1;
+        if (n)
+            deadline = time(NULL) + ATOMIC_POLL_TIMEOUT;
+    }
+    *ns = now_ns(b) - t0;
+
+    if (*b->counter != b->successes) {
+        fprintf(stderr, "atomic_bench: counter %llu, expected %llu\n",
+                (unsigned long long) *b->counter,
+                (unsigned long long) b->successes);
+        return 1;
+    }
+    return 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: atomic_bench [-t fa|cs] [-q qps] [-n ops] "
+            "[-d depth]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    struct atomic_bench b;
+    uint64_t ns = 0, total;
+    int c, ret;
+
+    memset(&b, 0, sizeof(b));
+    b.num_qps = 16;
+    b.ops     = 1000;
+    b.depth   = 4;
+
+    while ((c = getopt(argc, argv, "t:q:n:d:")) != -1) {
+        switch (c) {
+        case 't':
+            if (!strcmp(optarg, "cs"))
+                b.cas = 1;
+            else if (strcmp(optarg, "fa"))
+                usage();
+            break;
+        case 'q':
+            b.num_qps = atoi(optarg);
+            break;
+        case 'n':
+            b.ops = atoi(optarg);
+            break;
+        case 'd':
+            b.depth = atoi(optarg);
+            break;
+        default:
+            usage();
+        }
+    }
+    if (b.num_qps < 1 || b.num_qps > ATOMIC_MAX_QPS || b.ops < 1 ||
+        b.depth < 1 || b.depth > ATOMIC_MAX_DEPTH)
+        usage();
+
+    setup(&b);
+    ret = run(&b, &ns);
+    if (ret == ATOMIC_EXIT_UNCHECKED)
+        fprintf(stderr, "atomic_bench: the HCA reports no atomics "
+                "(DEV_LIM_FLAG_ATOMIC clear), UNCHECKED\n");
+    teardown(&b);
+    if (ret)
+        return ret;
+
+    total = (uint64_t) b.num_qps * b.ops;
+    printf("{\"op\": \"%s\", \"qps\": %d, \"depth\": %d, \"ops\": %llu, "
+           "\"successes\": %llu, \"time\": \"%s\", \"ns\": %llu, "
+           "\"mops\": %.3f}\n",
+           b.cas ? "cs" : "fa", b.num_qps, b.depth,
+           (unsigned long long) total, (unsigned long long) b.successes,
+#ifdef ATOMIC_BENCH_COSIM
+           "simulated",
+#else
+           "wall",
+#endif
+           (unsigned long long) ns, ns ? total * 1e3 / ns : 0.0);
+    return 0;
+}
@@ -0,0 +1,877 @@
+/*
+ * CPU cost of the libhgrnic datapath without an HCA.
+ *
+ * hgrnic_post_send, hgrnic_post_recv and hgrnic_poll_cq are linked in
+ * from libhgrnic and run against a fake context: rings are plain
+ * memory from hgrnic_alloc_qp_buf/hgrnic_alloc_cq_buf and the UAR is a
+ * scratch page. Post cases retire the WQ after every call (head ==
+ * tail), so they never see a full queue. Poll cases get their CQEs
+ * from a producer thread that plays the HCA: it fills every slot
+ * software hands back, and the consumer drains a full ring per round.
+ * Only the drains are timed, so the numbers do not depend on how the
+ * two threads are scheduled, but the CQE lines are still written by
+ * another thread, as they would be by DMA.
+ *
+ * Instructions, cycles and cache misses are counted in user space for
+ * the calling thread only (perf_event_open); the producer thread is not
+ * counted. Values that cannot be counted are reported as null.
+ *
+ * Hosts without perf counters can count instructions with -s instead:
+ * the benchmark runs in a child whose measuring thread is single-stepped
+ * with ptrace while its counters would be enabled. That is about 1000x
+ * slower, so use a small -n, and the ns figures are meaningless.
+ *
+ * usage: dp_bench [-n iters] [-r case] [-c thresholds] [-s] [-l]
+ *   -n  WRs (post cases) or CQEs (poll cases) per case, default 1000000
+ *   -r  run only the named case
+ *   -c  compare against a thresholds file; exit 1 on any count regression,
+ *       only warn when a case is slower than its ns limit, exit
+ *       DP_EXIT_UNCHECKED (3) if a count with a limit could not be measured
+ *   -s  count instructions by single-stepping
+ *   -l  list the cases
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <linux/perf_event.h>
+
+#include <infiniband/opcode.h>
+
+#include "hgrnic.h"
+#include "wqe.h"
+#include "cqe.h"
+
+#define DP_QPN          0x11
+#define DP_NUM_QPS      (1 << 16)
+#define DP_WQ_DEPTH     256
+#define DP_CQ_DEPTH     4096
+#define DP_MAX_BATCH    64
+#define DP_MAX_SGE      4
+#define DP_BUF_SIZE     (64 << 10)
+#define DP_LKEY         0x1234
+
+/* -c: no regression, but some limit could not be checked */
+#define DP_EXIT_UNCHECKED   3
+
+enum dp_kind {
+    DP_SEND,
+    DP_RECV,
+    DP_POLL
+};
+
+struct dp_case {
+    const char          *name;
+    enum dp_kind        kind;
+    enum ibv_qp_type    qp_type;
+    enum ibv_wr_opcode  opcode;
+    int                 num_sge;
+    int                 inline_size;    /* > 0: IBV_SEND_INLINE payload */
+    int                 batch;          /* WRs per post, wc per poll */
+    int                 is_send;        /* poll: send or receive CQEs */
+};
+
+static const struct dp_case dp_cases[] = {
+    { "send_rc_1sge",      DP_SEND, IBV_QPT_RC, IBV_WR_SEND,                  1,  0,  1, 1 },
+    { "send_rc_inline64",  DP_SEND, IBV_QPT_RC, IBV_WR_SEND,                  1, 64,  1, 1 },
+    { "write_rc_1sge_b16", DP_SEND, IBV_QPT_RC, IBV_WR_RDMA_WRITE,            1,  0, 16, 1 },
+    { "read_rc_4sge",      DP_SEND, IBV_QPT_RC, IBV_WR_RDMA_READ,             4,  0,  1, 1 },
+    { "fadd_rc",           DP_SEND, IBV_QPT_RC, IBV_WR_ATOMIC_FETCH_AND_ADD,  1,  0,  1, 1 },
+    { "send_ud_1sge",      DP_SEND, IBV_QPT_UD, IBV_WR_SEND,                  1,  0,  1, 1 },
+    { "recv_rc_1sge",      DP_RECV, IBV_QPT_RC, IBV_WR_SEND,                  1,  0,  1, 0 },
+    { "recv_rc_4sge_b16",  DP_RECV, IBV_QPT_RC, IBV_WR_SEND,                  4,  0, 16, 0 },
+    { "poll_send_b1",      DP_POLL, IBV_QPT_RC, IBV_WR_SEND,                  1,  0,  1, 1 },
+    { "poll_send_b16",     DP_POLL, IBV_QPT_RC, IBV_WR_SEND,                  1,  0, 16, 1 },
+    { "poll_recv_b16",     DP_POLL, IBV_QPT_RC, IBV_WR_SEND,                  1,  0, 16, 0 },
+};
+
+#define DP_NUM_CASES    (sizeof(dp_cases) / sizeof(dp_cases[0]))
+
+enum {
+    DP_CNT_INSNS,
+    DP_CNT_CYCLES,
+    DP_CNT_MISSES,
+    DP_NUM_CNT
+};
+
+static const char *dp_cnt_name[DP_NUM_CNT] = {
+    "insns_per_op", "cycles_per_op", "cache_misses_per_op"
+};
+
+struct dp_result {
+    uint64_t    ops;
+    uint64_t    ns;
+    uint64_t    cnt[DP_NUM_CNT];
+    int         have_cnt[DP_NUM_CNT];
+};
+
+struct dp_ctx {
+    struct hgrnic_device    dev;
+    struct hgrnic_context   ctx;
+    struct hgrnic_pd        pd;
+    struct hgrnic_av        av;
+    struct hgrnic_ah        ah;
+    void                    *buf;
+    int                     perf_fd[DP_NUM_CNT];
+    int                     step;   /* -s: the tracer counts instructions */
+};
+
+/* Instructions stepped so far, added by the tracer at every disable. It
+ * is at the same address in the tracer, which forked the child. */
+static volatile uint64_t dp_step_insns;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ------------------------------------------------------------------ */
+/* Counters                                                           */
+/* ------------------------------------------------------------------ */
+
+static int perf_open(uint64_t config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.size           = sizeof(attr);
+    attr.config         = config;
+    attr.disabled       = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void perf_init(struct dp_ctx *dc)
+{
+    static const uint64_t config[DP_NUM_CNT] = {
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_CACHE_MISSES
+    };
+    int i;
+
+    for (i = 0; i < DP_NUM_CNT; ++i)
+        dc->perf_fd[i] = dc->step ? -1 : perf_open(config[i]);
+}
+
+/* With -s, enable and disable stop the thread in the tracer. */
+static void perf_ioctl(struct dp_ctx *dc, unsigned long req)
+{
+    int i;
+
+    if (dc->step) {
+        if (req == PERF_EVENT_IOC_RESET)
+            dp_step_insns = 0;
+        else
+            raise(req == PERF_EVENT_IOC_ENABLE ? SIGUSR1 : SIGUSR2);
+        return;
+    }
+
+    for (i = 0; i < DP_NUM_CNT; ++i)
+        if (dc->perf_fd[i] >= 0)
+            ioctl(dc->perf_fd[i], req, 0);
+}
+
+static void perf_read(struct dp_ctx *dc, struct dp_result *res)
+{
+    int i;
+
+    for (i = 0; i < DP_NUM_CNT; ++i) {
+        res->have_cnt[i] = 0;
+        if (dc->step && i == DP_CNT_INSNS) {
+            res->cnt[i]      = dp_step_insns;
+            res->have_cnt[i] = 1;
+            continue;
+        }
+        if (dc->perf_fd[i] < 0)
+            continue;
+        if (read(dc->perf_fd[i], &res->cnt[i], sizeof(res->cnt[i])) ==
+            sizeof(res->cnt[i]))
+            res->have_cnt[i] = 1;
+    }
+}
+
+/*
+ * -s: fork, and single-step the child between SIGUSR1 (enable) and
+ * SIGUSR2 (disable). Only the thread that called PTRACE_TRACEME is
+ * traced, so the producer thread runs at full speed. Returns 0 in the
+ * child, which goes on to run the benchmark, and never returns in the
+ * tracer.
+ */
+static int step_fork(void)
+{
+    uint64_t count = 0, total;
+    int stepping = 0, status, sig;
+    pid_t pid;
+
+    fflush(stdout);
+    pid = fork();
+    if (pid < 0) {
+        perror("dp_bench: fork");
+        exit(1);
+    }
+    if (!pid) {
+        if (ptrace(PTRACE_TRACEME, 0, NULL, NULL)) {
+            perror("dp_bench: PTRACE_TRACEME");
+            exit(1);
+        }
+        raise(SIGSTOP);
+        return 0;
+    }
+
+    while (waitpid(pid, &status, 0) == pid) {
+        if (WIFEXITED(status))
+            exit(WEXITSTATUS(status));
+        if (WIFSIGNALED(status)) {
+            fprintf(stderr, "dp_bench: child killed by signal %d\n",
+                    WTERMSIG(status));
+            exit(1);
+        }
+
+        sig = WSTOPSIG(status);
+        if (sig == SIGTRAP && stepping) {
+            ++count;
+            sig = 0;
+        } else if (sig == SIGUSR1) {
+            stepping = 1;
+            count    = 0;
+            sig      = 0;
+        } else if (sig == SIGUSR2) {
+            stepping = 0;
+            errno    = 0;
+            total    = ptrace(PTRACE_PEEKDATA, pid, &dp_step_insns, NULL);
+            if (errno ||
+                ptrace(PTRACE_POKEDATA, pid, &dp_step_insns,
+                       (void *) (uintptr_t) (total + count))) {
+                perror("dp_bench: PTRACE_POKEDATA");
+                kill(pid, SIGKILL);
+                exit(1);
+            }
+            sig = 0;
+        } else if (sig == SIGSTOP) {
+            sig = 0;
+        }
+
+        if (ptrace(stepping ? PTRACE_SINGLESTEP : PTRACE_CONT, pid, NULL,
+                   (void *) (uintptr_t) sig)) {
+            perror("dp_bench: ptrace");
+            kill(pid, SIGKILL);
+            exit(1);
+        }
+    }
+
+    perror("dp_bench: waitpid");
+    exit(1);
+}
+
+/* ------------------------------------------------------------------ */
+/* Fake context, CQ and QP                                            */
+/* ------------------------------------------------------------------ */
+
+static int dp_ctx_init(struct dp_ctx *dc, int step)
+{
+    int i;
+
+    memset(dc, 0, sizeof(*dc));
+    dc->step = step;
+    dc->dev.page_size = sysconf(_SC_PAGESIZE);
+
+    dc->ctx.ibv_ctx.device  = &dc->dev.ibv_dev;
+    dc->ctx.num_qps         = DP_NUM_QPS;
+    dc->ctx.qp_table_shift  = ffs(dc->ctx.num_qps) - 1 - HGRNIC_QP_TABLE_BITS;
+    dc->ctx.qp_table_mask   = (1 << dc->ctx.qp_table_shift) - 1;
+    dc->ctx.numa_node       = -1;
+    dc->ctx.atomic_cap      = 1;
+    pthread_mutex_init(&dc->ctx.qp_table_mutex, NULL);
+    pthread_spin_init(&dc->ctx.uar_lock, PTHREAD_PROCESS_PRIVATE);
+    for (i = 0; i < HGRNIC_QP_TABLE_SIZE; ++i)
+        dc->ctx.qp_table[i].refcnt = 0;
+
+    /* Doorbells land here instead of in the UAR page. */
+    dc->ctx.uar = mmap(NULL, dc->dev.page_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (dc->ctx.uar == MAP_FAILED)
+        return -1;
+
+    dc->pd.ibv_pd.context = &dc->ctx.ibv_ctx;
+    dc->ah.ibv_ah.context = &dc->ctx.ibv_ctx;
+    dc->ah.av = &dc->av;
+
+    dc->buf = calloc(1, DP_BUF_SIZE);
+    if (!dc->buf)
+        return -1;
+
+    perf_init(dc);
+    return 0;
+}
+
+static void dp_ctx_cleanup(struct dp_ctx *dc)
+{
+    int i;
+
+    for (i = 0; i < DP_NUM_CNT; ++i)
+        if (dc->perf_fd[i] >= 0)
+            close(dc->perf_fd[i]);
+    free(dc->buf);
+    munmap(dc->ctx.uar, dc->dev.page_size);
+}
+
+static int dp_cq_create(struct dp_ctx *dc, struct hgrnic_cq *cq)
+{
+    memset(cq, 0, sizeof(*cq));
+    if (hgrnic_alloc_cq_buf(&dc->dev, &cq->buf, DP_CQ_DEPTH, -1))
+        return -1;
+    cq->ibv_cq.context = &dc->ctx.ibv_ctx;
+    cq->ibv_cq.cqe     = DP_CQ_DEPTH - 1;
+    cq->cqe_mask       = DP_CQ_DEPTH - 1;
+    cq->cons_index     = 0;
+    pthread_spin_init(&cq->lock, PTHREAD_PROCESS_PRIVATE);
+    return 0;
+}
+
+static void dp_cq_destroy(struct hgrnic_cq *cq)
+{
+    pthread_spin_destroy(&cq->lock);
+    hgrnic_free_buf(&cq->buf);
+}
+
+/* The parts of hgrnic_create_qp that do not talk to the kernel. */
+static int dp_qp_create(struct dp_ctx *dc, const struct dp_case *c,
+                        struct hgrnic_cq *cq, struct hgrnic_qp *qp)
+{
+    struct ibv_qp_cap cap;
+
+    memset(qp, 0, sizeof(*qp));
+    memset(&cap, 0, sizeof(cap));
+    cap.max_send_wr     = DP_WQ_DEPTH;
+    cap.max_recv_wr     = DP_WQ_DEPTH;
+    cap.max_send_sge    = DP_MAX_SGE;
+    cap.max_recv_sge    = DP_MAX_SGE;
+    cap.max_inline_data = c->inline_size;
+
+    qp->sq.max = DP_WQ_DEPTH;
+    qp->rq.max = DP_WQ_DEPTH;
+    if (hgrnic_alloc_qp_buf(&dc->pd.ibv_pd, &cap, c->qp_type, qp))
+        return -1;
+
+    pthread_spin_init(&qp->sq.lock, PTHREAD_PROCESS_PRIVATE);
+    pthread_spin_init(&qp->rq.lock, PTHREAD_PROCESS_PRIVATE);
+    qp->ibv_qp.context  = &dc->ctx.ibv_ctx;
+    qp->ibv_qp.pd       = &dc->pd.ibv_pd;
+    qp->ibv_qp.send_cq  = &cq->ibv_cq;
+    qp->ibv_qp.recv_cq  = &cq->ibv_cq;
+    qp->ibv_qp.qp_num   = DP_QPN;
+    qp->ibv_qp.qp_type  = c->qp_type;
+    qp->max_inline_data = cap.max_inline_data;
+
+    if (hgrnic_store_qp(&dc->ctx, DP_QPN, qp)) {
+        hgrnic_free_buf(&qp->sq.buf);
+        hgrnic_free_buf(&qp->rq.buf);
+        free(qp->sq.wrid);
+        free(qp->rq.wrid);
+        return -1;
+    }
+    return 0;
+}
+
+static void dp_qp_destroy(struct dp_ctx *dc, struct hgrnic_qp *qp)
+{
+    hgrnic_clear_qp(&dc->ctx, DP_QPN);
+    pthread_spin_destroy(&qp->sq.lock);
+    pthread_spin_destroy(&qp->rq.lock);
+    hgrnic_free_buf(&qp->sq.buf);
+    hgrnic_free_buf(&qp->rq.buf);
+    free(qp->sq.wrid);
+    free(qp->rq.wrid);
+}
+
+/* ------------------------------------------------------------------ */
+/* Post cases                                                         */
+/* ------------------------------------------------------------------ */
+
+/* One chain of c->batch WRs, signaled on the last one, reused for
+ * every call. */
+static void build_send_wrs(struct dp_ctx *dc, const struct dp_case *c,
+                           struct ibv_send_wr *wr, struct ibv_sge *sge)
+{
+    uint64_t base = (uintptr_t) dc->buf;
+    int i, j;
+
+    memset(wr, 0, c->batch * sizeof(*wr));
+    for (i = 0; i < c->batch; ++i) {
+        for (j = 0; j < c->num_sge; ++j) {
+            sge[i * DP_MAX_SGE + j].addr   = base + j * 1024;
+            sge[i * DP_MAX_SGE + j].length = c->inline_size ? c->inline_size : 1024;
+            sge[i * DP_MAX_SGE + j].lkey   = DP_LKEY;
+        }
+        wr[i].wr_id   = i;
+        wr[i].next    = i + 1 < c->batch ? &wr[i + 1] : NULL;
+        wr[i].sg_list = &sge[i * DP_MAX_SGE];
+        wr[i].num_sge = c->num_sge;
+        wr[i].opcode  = c->opcode;
+        if (i + 1 == c->batch)
+            wr[i].send_flags |= IBV_SEND_SIGNALED;
+        if (c->inline_size)
+            wr[i].send_flags |= IBV_SEND_INLINE;
+
+        switch (c->opcode) {
+        case IBV_WR_ATOMIC_FETCH_AND_ADD:
+        case IBV_WR_ATOMIC_CMP_AND_SWP:
+            sge[i * DP_MAX_SGE].length = sizeof(uint64_t);
+            wr[i].wr.atomic.remote_addr = base + DP_BUF_SIZE / 2;
+            wr[i].wr.atomic.rkey        = DP_LKEY;
+            wr[i].wr.atomic.compare_add = 1;
+            break;
+        case IBV_WR_RDMA_WRITE:
+        case IBV_WR_RDMA_WRITE_WITH_IMM:
+        case IBV_WR_RDMA_READ:
+            wr[i].wr.rdma.remote_addr = base + DP_BUF_SIZE / 2;
+            wr[i].wr.rdma.rkey        = DP_LKEY;
+            break;
+        default:
+            if (c->qp_type == IBV_QPT_UD) {
+                wr[i].wr.ud.ah          = &dc->ah.ibv_ah;
+                wr[i].wr.ud.remote_qpn  = DP_QPN + 1;
+                wr[i].wr.ud.remote_qkey = 0x11111111;
+            }
+            break;
+        }
+    }
+}
+
+static int run_send(struct dp_ctx *dc, const struct dp_case *c,
+                    struct hgrnic_qp *qp, uint64_t iters,
+                    struct dp_result *res)
+{
+    struct ibv_send_wr wr[DP_MAX_BATCH], *bad;
+    struct ibv_sge sge[DP_MAX_BATCH * DP_MAX_SGE];
+    uint64_t n, calls = iters / c->batch;
+    uint64_t t;
+
+    build_send_wrs(dc, c, wr, sge);
+
+    for (n = 0; n < calls / 10 + 1; ++n) {
+        if (hgrnic_post_send(&qp->ibv_qp, wr, &bad))
+            return -1;
+        qp->sq.tail = qp->sq.head;
+    }
+
+    perf_ioctl(dc, PERF_EVENT_IOC_RESET);
+    perf_ioctl(dc, PERF_EVENT_IOC_ENABLE);
+    t = now_ns();
+    for (n = 0; n < calls; ++n) {
+        hgrnic_post_send(&qp->ibv_qp, wr, &bad);
+        qp->sq.tail = qp->sq.head;
+    }
+    res->ns = now_ns() - t;
+    perf_ioctl(dc, PERF_EVENT_IOC_DISABLE);
+    perf_read(dc, res);
+    res->ops = calls * c->batch;
+    return 0;
+}
+
+static int run_recv(struct dp_ctx *dc, const struct dp_case *c,
+                    struct hgrnic_qp *qp, uint64_t iters,
+                    struct dp_result *res)
+{
+    struct ibv_recv_wr wr[DP_MAX_BATCH], *bad;
+    struct ibv_sge sge[DP_MAX_BATCH * DP_MAX_SGE];
+    uint64_t n, calls = iters / c->batch;
+    uint64_t t;
+    int i, j;
+
+    memset(wr, 0, sizeof(wr));
+    for (i = 0; i < c->batch; ++i) {
+        for (j = 0; j < c->num_sge; ++j) {
+            sge[i * DP_MAX_SGE + j].addr   = (uintptr_t) dc->buf + j * 1024;
+            sge[i * DP_MAX_SGE + j].length = 1024;
+            sge[i * DP_MAX_SGE + j].lkey   = DP_LKEY;
+        }
+        wr[i].wr_id   = i;
+        wr[i].next    = i + 1 < c->batch ? &wr[i + 1] : NULL;
+        wr[i].sg_list = &sge[i * DP_MAX_SGE];
+        wr[i].num_sge = c->num_sge;
+    }
+
+    for (n = 0; n < calls / 10 + 1; ++n) {
+        if (hgrnic_post_recv(&qp->ibv_qp, wr, &bad))
+            return -1;
+        qp->rq.tail = qp->rq.head;
+    }
+
+    perf_ioctl(dc, PERF_EVENT_IOC_RESET);
+    perf_ioctl(dc, PERF_EVENT_IOC_ENABLE);
+    t = now_ns();
+    for (n = 0; n < calls; ++n) {
+        hgrnic_post_recv(&qp->ibv_qp, wr, &bad);
+        qp->rq.tail = qp->rq.head;
+    }
+    res->ns = now_ns() - t;
+    perf_ioctl(dc, PERF_EVENT_IOC_DISABLE);
+    perf_read(dc, res);
+    res->ops = calls * c->batch;
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Poll cases                                                         */
+/* ------------------------------------------------------------------ */
+
+struct dp_producer {
+    struct hgrnic_cq    *cq;
+    struct hgrnic_wq    *wq;
+    int                 is_send;
+    uint64_t            produced;
+    int                 stop;
+};
+
+/* Write one CQE per WQE, in WQE order, into every slot software has
+ * handed back (owner bit set). */
+static void *producer(void *arg)
+{
+    struct dp_producer *p = arg;
+    struct hgrnic_cqe *ring = p->cq->buf.buf;
+    uint32_t mask = p->cq->cqe_mask;
+    uint64_t pi = 0;
+
+    while (!__atomic_load_n(&p->stop, __ATOMIC_RELAXED)) {
+        struct hgrnic_cqe *cqe = &ring[pi & mask];
+
+        if (!(__atomic_load_n(&cqe->owner, __ATOMIC_ACQUIRE) &
+              HGRNIC_CQ_ENTRY_OWNER_HW)) {
+            sched_yield();
+            continue;
+        }
+
+        cqe->my_qpn   = DP_QPN;
+        cqe->rqpn     = DP_QPN + 1;
+        cqe->byte_cnt = 64;
+        cqe->imm      = 0;
+        cqe->wqe      = (pi & (p->wq->max - 1)) << p->wq->wqe_shift;
+        cqe->opcode   = p->is_send ? HGRNIC_OPCODE_SEND :
+                        IBV_OPCODE_SEND_ONLY;
+        cqe->is_send  = p->is_send ? 0x80 : 0;
+        __atomic_store_n(&cqe->owner, 0, __ATOMIC_RELEASE);
+        __atomic_store_n(&p->produced, ++pi, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+static void wait_ring(struct dp_producer *p, uint64_t done, uint64_t count)
+{
+    while (__atomic_load_n(&p->produced, __ATOMIC_ACQUIRE) - done < count)
+        sched_yield();
+}
+
+/* Poll count CQEs that are already in the ring. Returns the nanoseconds
+ * spent, or 0 on a poll error. */
+static uint64_t drain(struct hgrnic_cq *cq, int batch, uint64_t count)
+{
+    struct ibv_wc wc[DP_MAX_BATCH];
+    uint64_t got, t;
+    int n;
+
+    t = now_ns();
+    for (got = 0; got < count; got += n) {
+        n = hgrnic_poll_cq(&cq->ibv_cq, batch, wc);
+        if (n < 0 || (n && wc[n - 1].status != IBV_WC_SUCCESS))
+            return 0;
+    }
+    return now_ns() - t;
+}
+
+static int run_poll(struct dp_ctx *dc, const struct dp_case *c,
+                    struct hgrnic_cq *cq, struct hgrnic_qp *qp,
+                    uint64_t iters, struct dp_result *res)
+{
+    struct dp_producer p;
+    pthread_t thread;
+    uint64_t done, count, ns;
+    int ret = 0;
+
+    memset(&p, 0, sizeof(p));
+    p.cq      = cq;
+    p.wq      = c->is_send ? &qp->sq : &qp->rq;
+    p.is_send = c->is_send;
+    if (pthread_create(&thread, NULL, producer, &p))
+        return -1;
+
+    /* Round sizes are multiples of every batch size in dp_cases. */
+    iters = (iters + DP_CQ_DEPTH - 1) & ~(uint64_t) (DP_CQ_DEPTH - 1);
+
+    wait_ring(&p, 0, DP_CQ_DEPTH);
+    if (!drain(cq, c->batch, DP_CQ_DEPTH)) {
+        ret = -1;
+        goto out;
+    }
+
+    res->ns = 0;
+    perf_ioctl(dc, PERF_EVENT_IOC_RESET);
+    for (done = DP_CQ_DEPTH; done < iters + DP_CQ_DEPTH; done += count) {
+        count = DP_CQ_DEPTH;
+        wait_ring(&p, done, count);
+        perf_ioctl(dc, PERF_EVENT_IOC_ENABLE);
+        ns = drain(cq, c->batch, count);
+        perf_ioctl(dc, PERF_EVENT_IOC_DISABLE);
+        if (!ns) {
+            ret = -1;
+            goto out;
+        }
+        res->ns += ns;
+    }
+    perf_read(dc, res);
+    res->ops = iters;
+
+out:
+    __atomic_store_n(&p.stop, 1, __ATOMIC_RELAXED);
+    pthread_join(thread, NULL);
+    return ret;
+}
+
+/* ------------------------------------------------------------------ */
+/* Report and thresholds                                              */
+/* ------------------------------------------------------------------ */
+
+static double per_op(const struct dp_result *res, uint64_t v)
+{
+    return res->ops ? (double) v / res->ops : 0;
+}
+
+static void report_result(FILE *f, const struct dp_case *c,
+                          const struct dp_result *res, int first, int step)
+{
+    int i;
+
+    fprintf(f, "%s\n    { \"case\": \"%s\", \"ops\": %llu, \"batch\": %d, ",
+            first ? "" : ",", c->name, (unsigned long long) res->ops,
+            c->batch);
+    if (step) /* single-stepped, the time says nothing */
+        fprintf(f, "\"ns_per_op\": null");
+    else
+        fprintf(f, "\"ns_per_op\": %.2f", per_op(res, res->ns));
+    for (i = 0; i < DP_NUM_CNT; ++i) {
+        if (res->have_cnt[i])
+            fprintf(f, ", \"%s\": %.2f", dp_cnt_name[i],
+                    per_op(res, res->cnt[i]));
+        else
+            fprintf(f, ", \"%s\": null", dp_cnt_name[i]);
+    }
+    fprintf(f, " }");
+    fflush(f);
+}
+
+/*
+ * Thresholds file: one line per case,
+ *
+ *   <case> <max ns/op> <max insns/op> <max cache misses/op>
+ *
+ * '-' leaves a column unchecked; '#' starts a comment. Time depends on
+ * the host, so the ns limit is advisory: going over it is reported but
+ * does not fail the check, and it is skipped when single-stepping. A
+ * count that has a limit but could not be measured is reported as
+ * UNCHECKED.
+ */
+static int check_one(const char *name, const char *what, const char *limit,
+                     double v, int advisory)
+{
+    if (!strcmp(limit, "-") || v <= atof(limit))
+        return 0;
+    fprintf(stderr, "dp_bench: %s%s: %s %.2f exceeds %s\n",
+            advisory ? "warning: " : "", name, what, v, limit);
+    return !advisory;
+}
+
+static int check_unchecked(const char *name, const char *what,
+                           const char *limit, const struct dp_result *res,
+                           int cnt)
+{
+    if (res->have_cnt[cnt] || !strcmp(limit, "-"))
+        return 0;
+    fprintf(stderr, "dp_bench: %s: %s UNCHECKED, limit %s\n", name, what,
+            limit);
+    return 1;
+}
+
+/* Returns 1 on a regression, DP_EXIT_UNCHECKED if none was found but a
+ * limit could not be checked, -1 if the file cannot be read. */
+static int check_thresholds(const char *path, const struct dp_result *res,
+                            const int *ran, int step)
+{
+    char line[256], name[64], ns[32], cnt[2][32];
+    FILE *f;
+    size_t i;
+    int bad = 0, unchecked = 0;
+
+    f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        char *hash = strchr(line, '#');
+
+        if (hash)
+            *hash = '\0';
+        if (sscanf(line, "%63s %31s %31s %31s", name, ns, cnt[0], cnt[1]) != 4)
+            continue;
+
+        for (i = 0; i < DP_NUM_CASES; ++i)
+            if (!strcmp(dp_cases[i].name, name))
+                break;
+        if (i == DP_NUM_CASES) {
+            fprintf(stderr, "dp_bench: %s: unknown case %s\n", path, name);
+            bad = 1;
+            continue;
+        }
+        if (!ran[i])
+            continue;
+
+        if (!step)
+            bad |= check_one(name, "ns_per_op", ns,
+                             per_op(&res[i], res[i].ns), 1);
+        if (res[i].have_cnt[DP_CNT_INSNS])
+            bad |= check_one(name, "insns_per_op", cnt[0],
+                             per_op(&res[i], res[i].cnt[DP_CNT_INSNS]), 0);
+        if (res[i].have_cnt[DP_CNT_MISSES])
+            bad |= check_one(name, "cache_misses_per_op", cnt[1],
+                             per_op(&res[i], res[i].cnt[DP_CNT_MISSES]), 0);
+        unchecked += check_unchecked(name, "insns_per_op", cnt[0], &res[i],
+                                     DP_CNT_INSNS);
+        unchecked += check_unchecked(name, "cache_misses_per_op", cnt[1],
+                                     &res[i], DP_CNT_MISSES);
+    }
+
+    fclose(f);
+    if (bad)
+        return 1;
+    if (unchecked) {
+        fprintf(stderr, "dp_bench: UNCHECKED: %d limits could not be "
+                "measured\n", unchecked);
+        return DP_EXIT_UNCHECKED;
+    }
+    return 0;
+}
+
+static int run_case(struct dp_ctx *dc, const struct dp_case *c,
+                    uint64_t iters, struct dp_result *res)
+{
+    struct hgrnic_cq cq;
+    struct hgrnic_qp qp;
+    int ret;
+
+    if (iters < (uint64_t) c->batch)
+        iters = c->batch;
+
+    if (dp_cq_create(dc, &cq))
+        return -1;
+    if (dp_qp_create(dc, c, &cq, &qp)) {
+        dp_cq_destroy(&cq);
+        return -1;
+    }
+
+    switch (c->kind) {
+    case DP_SEND:
+        ret = run_send(dc, c, &qp, iters, res);
+        break;
+    case DP_RECV:
+        ret = run_recv(dc, c, &qp, iters, res);
+        break;
+    default:
+        ret = run_poll(dc, c, &cq, &qp, iters, res);
+        break;
+    }
+
+    dp_qp_destroy(dc, &qp);
+    dp_cq_destroy(&cq);
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    struct dp_result res[DP_NUM_CASES];
+    int ran[DP_NUM_CASES];
+    struct dp_ctx dc;
+    const char *only = NULL, *thresholds = NULL;
+    uint64_t iters = 1000000;
+    size_t i;
+    int opt, first = 1, ret = 0, step = 0;
+
+    while ((opt = getopt(argc, argv, "n:r:c:sl")) != -1) {
+        switch (opt) {
+        case 'n': iters      = strtoull(optarg, NULL, 0); break;
+        case 'r': only       = optarg;                    break;
+        case 'c': thresholds = optarg;                    break;
+        case 's': step       = 1;                         break;
+        case 'l':
+            for (i = 0; i < DP_NUM_CASES; ++i)
+                printf("%s\n", dp_cases[i].name);
+            return 0;
+        default:
+            fprintf(stderr, "usage: %s [-n iters] [-r case] "
+                    "[-c thresholds] [-s] [-l]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (step)
+        step_fork();
+
+    if (dp_ctx_init(&dc, step)) {
+        perror("dp_bench");
+        return 1;
+    }
+    if (!step && dc.perf_fd[DP_CNT_INSNS] < 0)
+        fprintf(stderr, "dp_bench: perf_event_open failed, no counts; "
+                "-s counts instructions by single-stepping\n");
+
+    memset(res, 0, sizeof(res));
+    memset(ran, 0, sizeof(ran));
+
+    printf("{\n");
+    printf("  \"benchmark\": \"libhgrnic_datapath\",\n");
+    printf("  \"iters\": %llu,\n", (unsigned long long) iters);
+    printf("  \"wq_depth\": %d,\n", DP_WQ_DEPTH);
+    printf("  \"cq_depth\": %d,\n", DP_CQ_DEPTH);
+    printf("  \"results\": [");
+
+    for (i = 0; i < DP_NUM_CASES; ++i) {
+        if (only && strcmp(only, dp_cases[i].name))
+            continue;
+        if (run_case(&dc, &dp_cases[i], iters, &res[i])) {
+            fprintf(stderr, "dp_bench: %s failed\n", dp_cases[i].name);
+            ret = 1;
+            continue;
+        }
+        ran[i] = 1;
+        report_result(stdout, &dp_cases[i], &res[i], first, step);
+        first = 0;
+    }
+    printf("\n  ]\n}\n");
+
+    if (thresholds && !ret) {
+        ret = check_thresholds(thresholds, res, ran, step);
+        if (ret < 0)
+            ret = 1;
+    }
+
+    dp_ctx_cleanup(&dc);
+    return ret;
+}
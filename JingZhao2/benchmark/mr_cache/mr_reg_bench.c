@@ -0,0 +1,150 @@
+/*
+ * Repeated ibv_reg_mr/ibv_dereg_mr of one buffer per size, as done
+ * by MPI for every large message. Run it once plain and once with
+ * HGRNIC_MR_CACHE=1 to see the effect of the libhgrnic registration
+ * cache.
+ *
+ * usage: mr_reg_bench [-d device] [-n iters] [-t]
+ *   -t  touch (munmap and mmap again) the buffer between iterations,
+ *       which defeats any registration cache.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include <infiniband/verbs.h>
+
+#define MIN_SIZE    (4UL << 10)
+#define MAX_SIZE    (64UL << 20)
+
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void *map_buf(size_t size)
+{
+    void *buf;
+
+    buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED)
+        return NULL;
+    memset(buf, 0, size);
+    return buf;
+}
+
+int main(int argc, char *argv[])
+{
+    struct ibv_device **list, *dev = NULL;
+    struct ibv_context *ctx;
+    struct ibv_pd *pd;
+    struct ibv_mr *mr;
+    const char *name = NULL;
+    int iters = 1000, remap = 0;
+    double t, reg, dereg, first;
+    size_t size;
+    void *buf;
+    int i, n, opt;
+
+    while ((opt = getopt(argc, argv, "d:n:t")) != -1) {
+        switch (opt) {
+        case 'd': name  = optarg;       break;
+        case 'n': iters = atoi(optarg); break;
+        case 't': remap = 1;            break;
+        default:
+            fprintf(stderr, "usage: %s [-d device] [-n iters] [-t]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    list = ibv_get_device_list(&n);
+    if (!list) {
+        perror("ibv_get_device_list");
+        return 1;
+    }
+    for (i = 0; i < n; ++i)
+        if (!name || !strcmp(ibv_get_device_name(list[i]), name)) {
+            dev = list[i];
+            break;
+        }
+    if (!dev) {
+        fprintf(stderr, "no RDMA device found\n");
+        return 1;
+    }
+
+    ctx = ibv_open_device(dev);
+    if (!ctx) {
+        fprintf(stderr, "couldn't open %s\n", ibv_get_device_name(dev));
+        return 1;
+    }
+    pd = ibv_alloc_pd(ctx);
+    if (!pd) {
+        fprintf(stderr, "couldn't allocate PD\n");
+        return 1;
+    }
+
+    printf("# device %s, %d iterations, HGRNIC_MR_CACHE=%s%s\n",
+           ibv_get_device_name(dev), iters,
+           getenv("HGRNIC_MR_CACHE") ? getenv("HGRNIC_MR_CACHE") : "0",
+           remap ? ", remap between iterations" : "");
+    printf("%10s %12s %12s %12s\n", "bytes", "first(us)", "reg(us)", "dereg(us)");
+
+    for (size = MIN_SIZE; size <= MAX_SIZE; size <<= 1) {
+        buf = map_buf(size);
+        if (!buf) {
+            perror("mmap");
+            return 1;
+        }
+
+        /* The first registration always pins and writes MTTs. */
+        t  = now_us();
+        mr = ibv_reg_mr(pd, buf, size, IBV_ACCESS_LOCAL_WRITE);
+        first = now_us() - t;
+        if (!mr) {
+            fprintf(stderr, "ibv_reg_mr failed for %zu bytes\n", size);
+            return 1;
+        }
+        ibv_dereg_mr(mr);
+
+        reg = dereg = 0;
+        for (i = 0; i < iters; ++i) {
+            if (remap) {
+                munmap(buf, size);
+                buf = map_buf(size);
+                if (!buf) {
+                    perror("mmap");
+                    return 1;
+                }
+            }
+
+            t  = now_us();
+            mr = ibv_reg_mr(pd, buf, size, IBV_ACCESS_LOCAL_WRITE);
+            reg += now_us() - t;
+            if (!mr) {
+                fprintf(stderr, "ibv_reg_mr failed for %zu bytes\n", size);
+                return 1;
+            }
+
+            t = now_us();
+            ibv_dereg_mr(mr);
+            dereg += now_us() - t;
+        }
+
+        printf("%10zu %12.2f %12.2f %12.2f\n",
+               size, first, reg / iters, dereg / iters);
+        munmap(buf, size);
+    }
+
+    ibv_dealloc_pd(pd);
+    ibv_close_device(ctx);
+    ibv_free_device_list(list);
+    return 0;
+}
@@ -0,0 +1,268 @@
+/*
+ * Bandwidth: the client keeps up to tx_depth WRs outstanding on each
+ * QP and asks for a completion every signal_every WRs. QPs that can
+ * take more work wait in a FIFO, so scheduling costs O(1) per WR even
+ * with 64K QPs. The total number of outstanding WRs is bounded by the
+ * send CQ size.
+ *
+ * The server reposts receives for the send test and otherwise idles.
+ *
+ * Scale mode runs the same loop over the first n QPs only, posting one
+ * WR per QP visit so consecutive WRs go to different QPs. Each step
+ * starts with one unmeasured WR per QP to bring the QPs' contexts into
+ * whatever the device caches.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hgperf.h"
+
+#define BW_POLL_BATCH   16
+
+/* A signaled WR in flight; wr_id is its index in bw_state.slot. */
+struct bw_slot {
+    uint64_t t_post;
+    uint32_t q;
+    uint32_t covered;   /* WRs completed by this CQE */
+};
+
+struct bw_state {
+    uint32_t       *target;     /* WRs to post per QP */
+    uint32_t       *posted;
+    uint32_t       *outstanding;
+    uint32_t       *unsignaled;
+    uint8_t        *queued;
+    uint32_t       *fifo;       /* QPs that may post, num_qps entries */
+    uint32_t        head, count;
+    struct bw_slot *slot;
+    uint32_t       *free_slot;  /* stack of free slot indices */
+    uint32_t        nfree;
+};
+
+static void bw_free(struct bw_state *s)
+{
+    free(s->target);
+    free(s->posted);
+    free(s->outstanding);
+    free(s->unsignaled);
+    free(s->queued);
+    free(s->fifo);
+    free(s->slot);
+    free(s->free_slot);
+}
+
+static int bw_alloc(struct bw_state *s, uint32_t num_qps, uint32_t nslots)
+{
+    uint32_t i;
+
+    memset(s, 0, sizeof(*s));
+    s->target      = calloc(num_qps, sizeof(*s->target));
+    s->posted      = calloc(num_qps, sizeof(*s->posted));
+    s->outstanding = calloc(num_qps, sizeof(*s->outstanding));
+    s->unsignaled  = calloc(num_qps, sizeof(*s->unsignaled));
+    s->queued      = calloc(num_qps, sizeof(*s->queued));
+    s->fifo        = calloc(num_qps, sizeof(*s->fifo));
+    s->slot        = calloc(nslots, sizeof(*s->slot));
+    s->free_slot   = calloc(nslots, sizeof(*s->free_slot));
+    if (!s->target || !s->posted || !s->outstanding || !s->unsignaled ||
+        !s->queued || !s->fifo || !s->slot || !s->free_slot) {
+        bw_free(s);
+        return -1;
+    }
+
+    for (i = 0; i < nslots; ++i)
+        s->free_slot[i] = nslots - 1 - i;
+    s->nfree = nslots;
+    return 0;
+}
+
+static void fifo_push(struct bw_state *s, uint32_t num_qps, uint32_t q)
+{
+    s->fifo[(s->head + s->count++) % num_qps] = q;
+    s->queued[q] = 1;
+}
+
+static uint32_t fifo_pop(struct bw_state *s, uint32_t num_qps)
+{
+    uint32_t q = s->fifo[s->head];
+
+    s->head = (s->head + 1) % num_qps;
+    s->count--;
+    return q;
+}
+
+/* Post iters WRs over num_qps QPs, at most burst_max per QP visit. */
+static int bw_client(struct hgperf_ctx *hc, uint64_t size, uint32_t num_qps,
+                     uint32_t iters, uint32_t burst_max,
+                     struct hgperf_result *res)
+{
+    struct hgperf_cfg *c = &hc->cfg;
+    uint32_t max_out = hc->send_cqe;
+    struct ibv_wc wc[BW_POLL_BATCH];
+    struct bw_state s;
+    struct bw_slot *sl;
+    uint64_t t_start, completed = 0, out = 0;
+    uint32_t q, idx = 0, burst;
+    int i, ne, signaled;
+
+    if (bw_alloc(&s, num_qps, max_out)) {
+        fprintf(stderr, "out of memory\n");
+        return -1;
+    }
+
+    for (q = 0; q < num_qps; ++q) {
+        s.target[q] = iters / num_qps + (q < iters % num_qps);
+        if (s.target[q])
+            fifo_push(&s, num_qps, q);
+    }
+
+    res->nsamples = 0;
+    t_start = hgperf_now_ns();
+
+    while (completed < iters) {
+        /* Post up to one signal group per QP visit to interleave the QPs. */
+        while (s.count && out < max_out) {
+            q = fifo_pop(&s, num_qps);
+            burst = 0;
+
+            while (s.posted[q] < s.target[q] && s.outstanding[q] < c->tx_depth &&
+                   out < max_out && burst < burst_max) {
+                signaled = s.unsignaled[q] + 1 == c->signal_every ||
+                           s.posted[q] + 1 == s.target[q] ||
+                           s.outstanding[q] + 1 == c->tx_depth ||
+                           out + 1 == max_out;
+                if (signaled) {
+                    idx = s.free_slot[--s.nfree];
+                    sl  = &s.slot[idx];
+                    sl->q       = q;
+                    sl->covered = s.unsignaled[q] + 1;
+                    sl->t_post  = hgperf_now_ns();
+                }
+
+                if (hgperf_post_send(hc, q, size, signaled, signaled ? idx : ~0ULL)) {
+                    fprintf(stderr, "ibv_post_send failed on QP %u\n", q);
+                    goto err;
+                }
+
+                s.posted[q]++;
+                s.outstanding[q]++;
+                out++;
+                burst++;
+                s.unsignaled[q] = signaled ? 0 : s.unsignaled[q] + 1;
+                if (signaled)
+                    break;
+            }
+
+            if (s.posted[q] < s.target[q] && s.outstanding[q] < c->tx_depth)
+                fifo_push(&s, num_qps, q);
+            else
+                s.queued[q] = 0;
+        }
+
+        ne = hgperf_poll(hc->send_cq, wc, BW_POLL_BATCH, 0);
+        if (ne < 0)
+            goto err;
+
+        for (i = 0; i < ne; ++i) {
+            sl = &s.slot[wc[i].wr_id];
+            res->samples[res->nsamples++] = hgperf_now_ns() - sl->t_post;
+
+            q = sl->q;
+            s.outstanding[q] -= sl->covered;
+            out              -= sl->covered;
+            completed        += sl->covered;
+            s.free_slot[s.nfree++] = wc[i].wr_id;
+
+            if (!s.queued[q] && s.posted[q] < s.target[q])
+                fifo_push(&s, num_qps, q);
+        }
+    }
+
+    res->total_ns = hgperf_now_ns() - t_start;
+    bw_free(&s);
+    return 0;
+
+err:
+    bw_free(&s);
+    return -1;
+}
+
+static int bw_server(struct hgperf_ctx *hc, uint32_t iters)
+{
+    struct ibv_wc wc[BW_POLL_BATCH];
+    uint64_t received = 0;
+    int i, ne;
+
+    if (hc->cfg.test != TEST_SEND)
+        return 0;
+
+    while (received < iters) {
+        ne = hgperf_poll(hc->recv_cq, wc, BW_POLL_BATCH, 1);
+        if (ne < 0)
+            return -1;
+        for (i = 0; i < ne; ++i)
+            if (hgperf_post_recv(hc, wc[i].wr_id)) {
+                fprintf(stderr, "ibv_post_recv failed\n");
+                return -1;
+            }
+        received += ne;
+    }
+    return 0;
+}
+
+int hgperf_run_bw(struct hgperf_ctx *hc, uint64_t size,
+                  struct hgperf_result *res)
+{
+    struct hgperf_cfg *c = &hc->cfg;
+    int err;
+
+    if (hgperf_sync(hc))
+        return -1;
+
+    err = hc->server ? bw_client(hc, size, c->num_qps, c->iters,
+                                 c->signal_every, res) :
+                       bw_server(hc, c->iters);
+    if (err)
+        return -1;
+
+    res->qps   = c->num_qps;
+    res->size  = size;
+    res->iters = c->iters;
+
+    return hgperf_sync(hc);
+}
+
+/* Enough WRs that every QP gets HGPERF_SCALE_PASSES of them. */
+uint32_t hgperf_scale_iters(const struct hgperf_cfg *c, uint32_t num_qps)
+{
+    uint64_t min = (uint64_t) num_qps * HGPERF_SCALE_PASSES;
+
+    return c->iters > min ? c->iters : (uint32_t) min;
+}
+
+int hgperf_run_scale(struct hgperf_ctx *hc, uint64_t size, uint32_t num_qps,
+                     struct hgperf_result *res)
+{
+    uint32_t iters = hgperf_scale_iters(&hc->cfg, num_qps);
+    int err;
+
+    /* warm-up: one WR per QP */
+    if (hgperf_sync(hc))
+        return -1;
+    err = hc->server ? bw_client(hc, size, num_qps, num_qps, 1, res) :
+                       bw_server(hc, num_qps);
+    if (err || hgperf_sync(hc))
+        return -1;
+
+    err = hc->server ? bw_client(hc, size, num_qps, iters, 1, res) :
+                       bw_server(hc, iters);
+    if (err)
+        return -1;
+
+    res->qps   = num_qps;
+    res->size  = size;
+    res->iters = iters;
+
+    return hgperf_sync(hc);
+}
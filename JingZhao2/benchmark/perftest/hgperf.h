@@ -0,0 +1,142 @@
+/*
+ * hgperf: latency and bandwidth of RC send, RDMA write, RDMA read and
+ * fetch-and-add between two hosts. Only plain libibverbs 1.1.2 verbs
+ * are used, so any verbs device (hgrnic, rxe, siw, ...) can be
+ * measured with it.
+ */
+
+#ifndef HGPERF_H
+#define HGPERF_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+
+#include <infiniband/verbs.h>
+
+#define HGPERF_PORT         18515
+#define HGPERF_MIN_SIZE     2UL
+#define HGPERF_MAX_SIZE     (8UL << 20)
+#define HGPERF_MAX_QPS      65536
+#define HGPERF_ATOMIC_SIZE  8
+#define HGPERF_SCALE_SIZE   64UL
+#define HGPERF_SCALE_PASSES 16      /* scale mode: WRs per QP per step, at least */
+
+enum hgperf_test {
+    TEST_SEND,
+    TEST_WRITE,
+    TEST_READ,
+    TEST_ATOMIC
+};
+
+enum hgperf_mode {
+    MODE_LAT,
+    MODE_BW,
+    MODE_SCALE      /* bandwidth of one size over 1, f, f^2, ... num_qps QPs */
+};
+
+/*
+ * Test parameters. The client parses them from the command line and
+ * sends them to the server, so the server only needs -d/-i/-g/-p.
+ */
+struct hgperf_cfg {
+    uint32_t test;          /* enum hgperf_test */
+    uint32_t mode;          /* enum hgperf_mode */
+    uint64_t min_size;
+    uint64_t max_size;
+    uint32_t iters;         /* per message size, over all QPs */
+    uint32_t num_qps;
+    uint32_t tx_depth;      /* outstanding send WRs per QP */
+    uint32_t rx_depth;      /* posted receives per QP (send test) */
+    uint32_t inline_size;   /* send/write up to this size inline */
+    uint32_t signal_every;  /* request a CQE every N send WRs */
+    uint32_t scale_factor;  /* scale mode: QP count multiplier per step */
+};
+
+struct hgperf_dest {
+    uint32_t qpn;
+    uint32_t psn;
+};
+
+/* What each side tells the other about itself. */
+struct hgperf_peer {
+    uint16_t            lid;
+    uint8_t             gid[16];
+    uint32_t            rkey;
+    uint64_t            addr;
+    struct hgperf_dest *qp;     /* num_qps entries */
+};
+
+struct hgperf_ctx {
+    const char             *dev_arg;    /* -d, NULL: first device */
+    char                   *dev_name;   /* the device opened */
+    const char             *server;     /* NULL on the server side */
+    int                     tcp_port;
+    int                     ib_port;
+    int                     gid_idx;    /* -1: no GRH (IB LID routing) */
+    const char             *out;        /* JSON output file, NULL: stdout */
+
+    struct hgperf_cfg       cfg;
+    int                     sock;
+
+    struct ibv_context     *ctx;
+    struct ibv_device_attr  dev_attr;
+    struct ibv_port_attr    port_attr;
+    struct ibv_pd          *pd;
+    struct ibv_mr          *mr;
+    struct ibv_cq          *send_cq;
+    struct ibv_cq          *recv_cq;
+    struct ibv_qp         **qp;
+    int                     send_cqe;
+    int                     recv_cqe;
+    void                   *buf;        /* source half, then target half */
+    size_t                  buf_size;
+
+    struct hgperf_peer      local;
+    struct hgperf_peer      remote;
+};
+
+/* One message size worth of results. samples are in ns. */
+struct hgperf_result {
+    uint32_t  qps;          /* QPs the WRs were spread over */
+    uint64_t  size;
+    uint64_t  iters;
+    uint64_t  total_ns;     /* wall time of the bandwidth phase */
+    uint64_t *samples;
+    size_t    nsamples;
+};
+
+/* setup.c */
+int  hgperf_open(struct hgperf_ctx *hc);
+int  hgperf_exchange_cfg(struct hgperf_ctx *hc);
+int  hgperf_create_resources(struct hgperf_ctx *hc);
+int  hgperf_connect(struct hgperf_ctx *hc);
+int  hgperf_sync(struct hgperf_ctx *hc);
+void hgperf_destroy(struct hgperf_ctx *hc);
+const char *hgperf_test_name(uint32_t test);
+
+/* ops.c */
+int  hgperf_post_send(struct hgperf_ctx *hc, uint32_t q, uint64_t size,
+                      int signaled, uint64_t wr_id);
+int  hgperf_post_recv(struct hgperf_ctx *hc, uint32_t q);
+int  hgperf_poll(struct ibv_cq *cq, struct ibv_wc *wc, int n, int wait);
+
+/* lat.c, bw.c: run one message size; results are filled on the client. */
+int  hgperf_run_lat(struct hgperf_ctx *hc, uint64_t size,
+                    struct hgperf_result *res);
+int  hgperf_run_bw(struct hgperf_ctx *hc, uint64_t size,
+                   struct hgperf_result *res);
+
+/* bw.c, scale mode: one step over the first num_qps QPs. */
+uint32_t hgperf_scale_iters(const struct hgperf_cfg *c, uint32_t num_qps);
+int  hgperf_run_scale(struct hgperf_ctx *hc, uint64_t size, uint32_t num_qps,
+                      struct hgperf_result *res);
+
+/* report.c */
+uint64_t hgperf_now_ns(void);
+void hgperf_report_begin(FILE *f, const struct hgperf_ctx *hc);
+void hgperf_report_result(FILE *f, const struct hgperf_ctx *hc,
+                          struct hgperf_result *res, int first);
+void hgperf_report_end(FILE *f);
+
+#endif /* HGPERF_H */
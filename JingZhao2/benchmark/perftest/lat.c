@@ -0,0 +1,183 @@
+/*
+ * Latency: one operation in flight at a time, QPs used round robin.
+ *
+ * send and write are ping-pong tests and report half the round trip.
+ * For write, each side spins on the last byte of its target half,
+ * which the peer's write sets to the iteration number.
+ * read and atomic are timed from post to completion on the client;
+ * the server just waits.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hgperf.h"
+
+/* Reap the send completion of a signaled ping-pong WR. */
+static int reap_send(struct hgperf_ctx *hc)
+{
+    struct ibv_wc wc;
+
+    return hgperf_poll(hc->send_cq, &wc, 1, 1) < 0 ? -1 : 0;
+}
+
+/*
+ * Whether iteration i on QP q asks for a completion. As in bw.c the
+ * count of unsignaled WRs is kept per QP, since a completion only
+ * retires the WRs of its own QP. The last WR of every QP is signaled,
+ * so no QP carries unsignaled WRs into the next size.
+ */
+static int lat_signaled(struct hgperf_cfg *c, uint32_t *unsignaled,
+                        uint32_t q, uint32_t i)
+{
+    int signaled = unsignaled[q] + 1 >= c->signal_every ||
+                   unsignaled[q] + 1 >= c->tx_depth ||
+                   i + c->num_qps >= c->iters;
+
+    unsignaled[q] = signaled ? 0 : unsignaled[q] + 1;
+    return signaled;
+}
+
+static int lat_write(struct hgperf_ctx *hc, uint64_t size, uint64_t *samples,
+                     uint32_t *unsignaled)
+{
+    struct hgperf_cfg *c = &hc->cfg;
+    volatile uint8_t *src  = (uint8_t *) hc->buf + size - 1;
+    volatile uint8_t *poll = (uint8_t *) hc->buf + c->max_size + size - 1;
+    int client = hc->server != NULL;
+    uint64_t t0;
+    uint32_t i, q;
+    uint8_t val;
+    int signaled;
+
+    for (i = 0; i < c->iters; ++i) {
+        val = i + 1;
+        q   = i % c->num_qps;
+        signaled = lat_signaled(c, unsignaled, q, i);
+
+        if (!client)
+            while (*poll != val)
+                ; /* spin */
+
+        t0   = hgperf_now_ns();
+        *src = val;
+        if (hgperf_post_send(hc, q, size, signaled, i)) {
+            fprintf(stderr, "ibv_post_send failed\n");
+            return -1;
+        }
+
+        if (client) {
+            while (*poll != val)
+                ; /* spin */
+            samples[i] = (hgperf_now_ns() - t0) / 2;
+        }
+
+        if (signaled && reap_send(hc))
+            return -1;
+    }
+    return 0;
+}
+
+static int lat_send(struct hgperf_ctx *hc, uint64_t size, uint64_t *samples,
+                    uint32_t *unsignaled)
+{
+    struct hgperf_cfg *c = &hc->cfg;
+    int client = hc->server != NULL;
+    struct ibv_wc wc;
+    uint64_t t0;
+    uint32_t i, q;
+    int signaled;
+
+    for (i = 0; i < c->iters; ++i) {
+        q = i % c->num_qps;
+
+        if (!client) {
+            if (hgperf_poll(hc->recv_cq, &wc, 1, 1) < 0 ||
+                hgperf_post_recv(hc, wc.wr_id))
+                return -1;
+            q = wc.wr_id;
+        }
+        signaled = lat_signaled(c, unsignaled, q, i);
+
+        t0 = hgperf_now_ns();
+        if (hgperf_post_send(hc, q, size, signaled, i)) {
+            fprintf(stderr, "ibv_post_send failed\n");
+            return -1;
+        }
+
+        if (client) {
+            if (hgperf_poll(hc->recv_cq, &wc, 1, 1) < 0)
+                return -1;
+            samples[i] = (hgperf_now_ns() - t0) / 2;
+            if (hgperf_post_recv(hc, wc.wr_id))
+                return -1;
+        }
+
+        if (signaled && reap_send(hc))
+            return -1;
+    }
+    return 0;
+}
+
+static int lat_one_sided(struct hgperf_ctx *hc, uint64_t size, uint64_t *samples)
+{
+    struct hgperf_cfg *c = &hc->cfg;
+    uint64_t t0;
+    uint32_t i;
+
+    if (!hc->server)
+        return 0;
+
+    for (i = 0; i < c->iters; ++i) {
+        t0 = hgperf_now_ns();
+        if (hgperf_post_send(hc, i % c->num_qps, size, 1, i)) {
+            fprintf(stderr, "ibv_post_send failed\n");
+            return -1;
+        }
+        if (reap_send(hc))
+            return -1;
+        samples[i] = hgperf_now_ns() - t0;
+    }
+    return 0;
+}
+
+int hgperf_run_lat(struct hgperf_ctx *hc, uint64_t size,
+                   struct hgperf_result *res)
+{
+    uint32_t *unsignaled;
+    int err;
+
+    unsignaled = calloc(hc->cfg.num_qps, sizeof(*unsignaled));
+    if (!unsignaled) {
+        fprintf(stderr, "out of memory\n");
+        return -1;
+    }
+
+    memset(hc->buf, 0, hc->buf_size);
+    if (hgperf_sync(hc)) {
+        free(unsignaled);
+        return -1;
+    }
+
+    switch (hc->cfg.test) {
+    case TEST_WRITE:
+        err = lat_write(hc, size, res->samples, unsignaled);
+        break;
+    case TEST_SEND:
+        err = lat_send(hc, size, res->samples, unsignaled);
+        break;
+    default:
+        err = lat_one_sided(hc, size, res->samples);
+        break;
+    }
+    free(unsignaled);
+    if (err)
+        return -1;
+
+    res->size     = size;
+    res->iters    = hc->cfg.iters;
+    res->total_ns = 0;
+    res->nsamples = hc->server ? hc->cfg.iters : 0;
+
+    return hgperf_sync(hc);
+}
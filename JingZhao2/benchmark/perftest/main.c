@@ -0,0 +1,248 @@
+/*
+ * hgperf: perftest-style latency and bandwidth tests over RC QPs.
+ *
+ * server: hgperf [-d device] [-i ib_port] [-g gid_index] [-p tcp_port]
+ * client: hgperf [same options] [test options] <server>
+ *
+ * The client sends its test options to the server and prints one JSON
+ * object with the results (see report.c).
+ *
+ * Scale mode (-m scale) measures how the device copes with many active
+ * connections: small RDMA writes (or the -t test) round robin over 1,
+ * f, f^2, ... QPs up to -q, with throughput and loaded latency per step.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hgperf.h"
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [options] [server]\n"
+            "  -d <dev>       RDMA device (default: first one)\n"
+            "  -i <port>      device port (default 1)\n"
+            "  -g <index>     GID index, needed for RoCE (default: no GRH)\n"
+            "  -p <port>      TCP port for the side channel (default %d)\n"
+            "client only:\n"
+            "  -t <test>      send, write, read or atomic (default write)\n"
+            "  -m <mode>      lat, bw or scale (default lat)\n"
+            "  -s <bytes>     message size (default 2 for lat, 65536 for bw, %lu for scale)\n"
+            "  -a             all sizes from %lu B to %lu MiB\n"
+            "  -n <iters>     operations per size over all QPs (default 1000)\n"
+            "  -q <qps>       number of QPs, 1 to %d (default 1; for scale the\n"
+            "                 device's max_qp, and at most that)\n"
+            "  -S <factor>    scale: QP count multiplier per step (default 4)\n"
+            "  -T <depth>     outstanding WRs per QP (default 128, less with many QPs;\n"
+            "                 16 for scale)\n"
+            "  -R <depth>     receives posted per QP for send (default 128)\n"
+            "  -I <bytes>     post send/write of up to this size inline (default 0)\n"
+            "  -N <n>         signal every n-th WR (default 1 for lat, 16 for bw, 8 for scale)\n"
+            "  -o <file>      write JSON there instead of stdout\n",
+            argv0, HGPERF_PORT, HGPERF_SCALE_SIZE, HGPERF_MIN_SIZE,
+            HGPERF_MAX_SIZE >> 20, HGPERF_MAX_QPS);
+}
+
+static int parse_test(const char *s, uint32_t *test)
+{
+    static const char *names[] = { "send", "write", "read", "atomic" };
+    uint32_t i;
+
+    for (i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+        if (!strcmp(s, names[i])) {
+            *test = i;
+            return 0;
+        }
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    struct hgperf_ctx hc;
+    struct hgperf_cfg *c = &hc.cfg;
+    struct hgperf_result res;
+    uint64_t size = 0;
+    long tx_depth = -1, signal_every = -1, num_qps = -1, iters = -1;
+    uint32_t n, nsamples;
+    int all = 0, first = 1, ret = 1, max_qps;
+    FILE *out = stdout;
+    int opt;
+
+    memset(&hc, 0, sizeof(hc));
+    memset(&res, 0, sizeof(res));
+    hc.sock      = -1;
+    hc.tcp_port  = HGPERF_PORT;
+    hc.ib_port   = 1;
+    hc.gid_idx   = -1;
+    c->test      = TEST_WRITE;
+    c->mode      = MODE_LAT;
+    c->rx_depth  = 128;
+    c->scale_factor = 4;
+
+    while ((opt = getopt(argc, argv, "d:i:g:p:t:m:s:an:q:S:T:R:I:N:o:h")) != -1) {
+        switch (opt) {
+        case 'd': hc.dev_arg  = optarg;             break;
+        case 'i': hc.ib_port  = atoi(optarg);       break;
+        case 'g': hc.gid_idx  = atoi(optarg);       break;
+        case 'p': hc.tcp_port = atoi(optarg);       break;
+        case 's': size        = strtoull(optarg, NULL, 0); break;
+        case 'a': all         = 1;                  break;
+        case 'n': iters       = strtol(optarg, NULL, 0);  break;
+        case 'q': num_qps     = strtol(optarg, NULL, 0);  break;
+        case 'S': c->scale_factor = strtoul(optarg, NULL, 0); break;
+        case 'T': tx_depth    = strtol(optarg, NULL, 0);  break;
+        case 'R': c->rx_depth = strtoul(optarg, NULL, 0); break;
+        case 'I': c->inline_size = strtoul(optarg, NULL, 0); break;
+        case 'N': signal_every   = strtol(optarg, NULL, 0);  break;
+        case 'o': hc.out      = optarg;             break;
+        case 't':
+            if (parse_test(optarg, &c->test)) {
+                fprintf(stderr, "unknown test %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'm':
+            if (!strcmp(optarg, "lat"))
+                c->mode = MODE_LAT;
+            else if (!strcmp(optarg, "bw"))
+                c->mode = MODE_BW;
+            else if (!strcmp(optarg, "scale"))
+                c->mode = MODE_SCALE;
+            else {
+                fprintf(stderr, "unknown mode %s\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc)
+        hc.server = argv[optind];
+
+    if (hc.server) {
+        if (c->mode == MODE_SCALE)
+            all = 0;
+        if (c->test == TEST_ATOMIC)
+            size = HGPERF_ATOMIC_SIZE, all = 0;
+        else if (!size)
+            size = c->mode == MODE_LAT ? HGPERF_MIN_SIZE :
+                   c->mode == MODE_BW  ? 65536 : HGPERF_SCALE_SIZE;
+        /* 0: as many QPs as the device has, resolved once it is open */
+        if (num_qps < 0)
+            num_qps = c->mode == MODE_SCALE ? 0 : 1;
+        if (iters < 0)
+            iters = c->mode == MODE_SCALE ? 100000 : 1000;
+        c->num_qps = num_qps;
+        c->iters   = iters;
+
+        c->min_size = all ? HGPERF_MIN_SIZE : size;
+        c->max_size = all ? HGPERF_MAX_SIZE : size;
+        if (c->min_size < 1 || c->max_size > HGPERF_MAX_SIZE) {
+            fprintf(stderr, "message size must be 1 to %lu bytes\n", HGPERF_MAX_SIZE);
+            return 1;
+        }
+        if (iters < 1 || num_qps < (c->mode == MODE_SCALE ? 0 : 1) ||
+            num_qps > HGPERF_MAX_QPS ||
+            c->scale_factor < 2) {
+            usage(argv[0]);
+            return 1;
+        }
+
+        /* Keep the total number of outstanding WRs reasonable. Scale
+         * mode creates every QP up front, so its depth doesn't follow
+         * the QP count: one step must not differ from another in it. */
+        if (tx_depth < 0 && c->mode == MODE_SCALE) {
+            tx_depth = 16;
+        } else if (tx_depth < 0) {
+            tx_depth = 65536 / c->num_qps;
+            tx_depth = tx_depth > 128 ? 128 : tx_depth < 1 ? 1 : tx_depth;
+        }
+        if (signal_every < 0)
+            signal_every = c->mode == MODE_LAT ? 1 : c->mode == MODE_BW ? 16 : 8;
+        if (tx_depth < 1 || signal_every < 1) {
+            usage(argv[0]);
+            return 1;
+        }
+        c->tx_depth     = tx_depth;
+        c->signal_every = signal_every;
+    }
+
+    if (hgperf_open(&hc))
+        goto out;
+
+    /* Scale mode sweeps up to what the device can create. hgrnic
+     * reports max_qp = num_qps - reserved_qps, less than 64K. */
+    if (hc.server && c->mode == MODE_SCALE) {
+        max_qps = hc.dev_attr.max_qp < HGPERF_MAX_QPS ?
+                  hc.dev_attr.max_qp : HGPERF_MAX_QPS;
+        if (max_qps < 1) {
+            fprintf(stderr, "%s reports no QPs\n", hc.dev_name);
+            goto out;
+        }
+        if (!c->num_qps || c->num_qps > (uint32_t) max_qps)
+            c->num_qps = max_qps;
+    }
+
+    if (hgperf_exchange_cfg(&hc) || hgperf_create_resources(&hc) ||
+        hgperf_connect(&hc))
+        goto out;
+
+    if (hc.server) {
+        nsamples = c->mode == MODE_SCALE ? hgperf_scale_iters(c, c->num_qps) :
+                                           c->iters;
+        res.samples = calloc(nsamples, sizeof(*res.samples));
+        if (!res.samples) {
+            fprintf(stderr, "out of memory\n");
+            goto out;
+        }
+        if (hc.out) {
+            out = fopen(hc.out, "w");
+            if (!out) {
+                perror(hc.out);
+                goto out;
+            }
+        }
+        hgperf_report_begin(out, &hc);
+    }
+
+    if (c->mode == MODE_SCALE) {
+        for (n = 1; ; n = n > c->num_qps / c->scale_factor ?
+                          c->num_qps : n * c->scale_factor) {
+            if (hgperf_run_scale(&hc, c->min_size, n, &res))
+                goto out;
+            if (hc.server) {
+                hgperf_report_result(out, &hc, &res, first);
+                first = 0;
+            }
+            if (n == c->num_qps)
+                break;
+        }
+    }
+
+    for (size = c->min_size; c->mode != MODE_SCALE && size <= c->max_size;
+         size *= 2) {
+        if (c->mode == MODE_LAT ? hgperf_run_lat(&hc, size, &res) :
+                                  hgperf_run_bw(&hc, size, &res))
+            goto out;
+        if (hc.server) {
+            hgperf_report_result(out, &hc, &res, first);
+            first = 0;
+        }
+    }
+
+    if (hc.server)
+        hgperf_report_end(out);
+    ret = 0;
+
+out:
+    if (out != stdout)
+        fclose(out);
+    free(res.samples);
+    hgperf_destroy(&hc);
+    return ret;
+}
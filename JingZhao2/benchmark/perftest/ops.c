@@ -0,0 +1,99 @@
+/*
+ * Posting and polling shared by the latency and bandwidth tests.
+ */
+
+#include <string.h>
+
+#include "hgperf.h"
+
+int hgperf_post_send(struct hgperf_ctx *hc, uint32_t q, uint64_t size,
+                     int signaled, uint64_t wr_id)
+{
+    struct hgperf_cfg *c = &hc->cfg;
+    struct ibv_send_wr wr, *bad_wr;
+    struct ibv_sge sge;
+    uint64_t raddr = hc->remote.addr + c->max_size;
+
+    sge.addr   = (uintptr_t) hc->buf;
+    sge.length = size;
+    sge.lkey   = hc->mr->lkey;
+
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id      = wr_id;
+    wr.sg_list    = &sge;
+    wr.num_sge    = 1;
+    wr.send_flags = signaled ? IBV_SEND_SIGNALED : 0;
+
+    switch (c->test) {
+    case TEST_SEND:
+        wr.opcode = IBV_WR_SEND;
+        break;
+    case TEST_WRITE:
+        wr.opcode = IBV_WR_RDMA_WRITE;
+        wr.wr.rdma.remote_addr = raddr;
+        wr.wr.rdma.rkey        = hc->remote.rkey;
+        break;
+    case TEST_READ:
+        wr.opcode = IBV_WR_RDMA_READ;
+        wr.wr.rdma.remote_addr = raddr;
+        wr.wr.rdma.rkey        = hc->remote.rkey;
+        break;
+    case TEST_ATOMIC:
+        wr.opcode = IBV_WR_ATOMIC_FETCH_AND_ADD;
+        wr.wr.atomic.remote_addr = raddr;
+        wr.wr.atomic.rkey        = hc->remote.rkey;
+        wr.wr.atomic.compare_add = 1;
+        sge.length = HGPERF_ATOMIC_SIZE;
+        break;
+    }
+
+    if ((c->test == TEST_SEND || c->test == TEST_WRITE) &&
+        size <= c->inline_size)
+        wr.send_flags |= IBV_SEND_INLINE;
+
+    return ibv_post_send(hc->qp[q], &wr, &bad_wr);
+}
+
+/* Receives land in the target half; wr_id is the QP index. */
+int hgperf_post_recv(struct hgperf_ctx *hc, uint32_t q)
+{
+    struct ibv_recv_wr wr, *bad_wr;
+    struct ibv_sge sge;
+
+    sge.addr   = (uintptr_t) hc->buf + hc->cfg.max_size;
+    sge.length = hc->cfg.max_size;
+    sge.lkey   = hc->mr->lkey;
+
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id   = q;
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+
+    return ibv_post_recv(hc->qp[q], &wr, &bad_wr);
+}
+
+/*
+ * Poll up to n completions, busy waiting for at least one if wait is
+ * set. Returns the number polled, or -1 on a failed completion.
+ */
+int hgperf_poll(struct ibv_cq *cq, struct ibv_wc *wc, int n, int wait)
+{
+    int i, ne;
+
+    do {
+        ne = ibv_poll_cq(cq, n, wc);
+    } while (wait && !ne);
+
+    if (ne < 0) {
+        fprintf(stderr, "ibv_poll_cq failed\n");
+        return -1;
+    }
+    for (i = 0; i < ne; ++i)
+        if (wc[i].status != IBV_WC_SUCCESS) {
+            fprintf(stderr, "completion with status %s (%d), vendor error 0x%x, wr_id 0x%llx\n",
+                    ibv_wc_status_str(wc[i].status), wc[i].status,
+                    wc[i].vendor_err, (unsigned long long) wc[i].wr_id);
+            return -1;
+        }
+    return ne;
+}
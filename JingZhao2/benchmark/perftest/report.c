@@ -0,0 +1,103 @@
+/*
+ * JSON output. One object per run:
+ *
+ * { "test": "write", "mode": "lat", "device": "hgrnic_0", ...,
+ *   "results": [ { "size": 2, "iters": 1000, "lat_ns": { ... } }, ... ] }
+ *
+ * Latency samples are post-to-completion times of single operations;
+ * for send and write latency they are half a ping-pong round trip.
+ * Bandwidth results add bw_gbps and mpps, and their lat_ns are the
+ * post-to-completion times of the signaled WRs under load. Scale mode
+ * reports like bandwidth mode, one result per QP count.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "hgperf.h"
+
+uint64_t hgperf_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Nearest-rank percentile of sorted samples, p in per mille. */
+static uint64_t percentile(const uint64_t *s, size_t n, unsigned int p)
+{
+    size_t rank = (n * p + 999) / 1000;
+
+    return s[rank ? rank - 1 : 0];
+}
+
+void hgperf_report_begin(FILE *f, const struct hgperf_ctx *hc)
+{
+    const struct hgperf_cfg *c = &hc->cfg;
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"test\": \"%s\",\n", hgperf_test_name(c->test));
+    fprintf(f, "  \"mode\": \"%s\",\n", c->mode == MODE_LAT ? "lat" :
+                                        c->mode == MODE_BW  ? "bw" : "scale");
+    fprintf(f, "  \"device\": \"%s\",\n", hc->dev_name);
+    fprintf(f, "  \"transport\": \"RC\",\n");
+    fprintf(f, "  \"mtu\": %d,\n", 128 << hc->port_attr.active_mtu);
+    fprintf(f, "  \"qps\": %u,\n", c->num_qps);
+    fprintf(f, "  \"tx_depth\": %u,\n", c->tx_depth);
+    fprintf(f, "  \"inline_size\": %u,\n", c->inline_size);
+    fprintf(f, "  \"signal_every\": %u,\n", c->signal_every);
+    if (c->mode == MODE_SCALE)
+        fprintf(f, "  \"scale_factor\": %u,\n", c->scale_factor);
+    fprintf(f, "  \"results\": [");
+}
+
+void hgperf_report_result(FILE *f, const struct hgperf_ctx *hc,
+                          struct hgperf_result *res, int first)
+{
+    uint64_t *s = res->samples;
+    size_t n = res->nsamples;
+    double sum = 0;
+    size_t i;
+
+    fprintf(f, "%s\n    { ", first ? "" : ",");
+    if (hc->cfg.mode == MODE_SCALE)
+        fprintf(f, "\"qps\": %u, ", res->qps);
+    fprintf(f, "\"size\": %llu, \"iters\": %llu",
+            (unsigned long long) res->size, (unsigned long long) res->iters);
+
+    if (hc->cfg.mode != MODE_LAT && res->total_ns) {
+        fprintf(f, ", \"bw_gbps\": %.3f, \"mpps\": %.4f",
+                (double) res->size * res->iters * 8 / res->total_ns,
+                (double) res->iters * 1e3 / res->total_ns);
+    }
+
+    if (n) {
+        qsort(s, n, sizeof(*s), cmp_u64);
+        for (i = 0; i < n; ++i)
+            sum += s[i];
+        fprintf(f, ",\n      \"lat_ns\": { \"min\": %llu, \"p50\": %llu, "
+                "\"p90\": %llu, \"p99\": %llu, \"p99.9\": %llu, "
+                "\"max\": %llu, \"avg\": %.1f }",
+                (unsigned long long) s[0],
+                (unsigned long long) percentile(s, n, 500),
+                (unsigned long long) percentile(s, n, 900),
+                (unsigned long long) percentile(s, n, 990),
+                (unsigned long long) percentile(s, n, 999),
+                (unsigned long long) s[n - 1], sum / n);
+    }
+    fprintf(f, " }");
+    fflush(f);
+}
+
+void hgperf_report_end(FILE *f)
+{
+    fprintf(f, "\n  ]\n}\n");
+}
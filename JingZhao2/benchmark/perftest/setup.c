@@ -0,0 +1,519 @@
+/*
+ * Device and QP setup, and the TCP side channel used to exchange
+ * test parameters, QP numbers and memory keys.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <endian.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "hgperf.h"
+
+static const char *test_names[] = {
+    [TEST_SEND]   = "send",
+    [TEST_WRITE]  = "write",
+    [TEST_READ]   = "read",
+    [TEST_ATOMIC] = "atomic",
+};
+
+const char *hgperf_test_name(uint32_t test)
+{
+    return test < sizeof(test_names) / sizeof(test_names[0]) ?
+           test_names[test] : "unknown";
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    ssize_t n;
+
+    while (len) {
+        n = write(fd, p, len);
+        if (n <= 0)
+            return -1;
+        p   += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+    ssize_t n;
+
+    while (len) {
+        n = read(fd, p, len);
+        if (n <= 0)
+            return -1;
+        p   += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int tcp_connect(const char *host, int port)
+{
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res, *t;
+    char service[8];
+    int fd = -1;
+
+    snprintf(service, sizeof(service), "%d", port);
+    if (getaddrinfo(host, service, &hints, &res)) {
+        fprintf(stderr, "couldn't resolve %s\n", host);
+        return -1;
+    }
+
+    for (t = res; t; t = t->ai_next) {
+        fd = socket(t->ai_family, t->ai_socktype, t->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (!connect(fd, t->ai_addr, t->ai_addrlen))
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if (fd < 0)
+        fprintf(stderr, "couldn't connect to %s:%d\n", host, port);
+    return fd;
+}
+
+static int tcp_accept(int port)
+{
+    struct sockaddr_in6 addr = {
+        .sin6_family = AF_INET6,
+        .sin6_port   = htons(port),
+        .sin6_addr   = IN6ADDR_ANY_INIT,
+    };
+    int one = 1;
+    int lfd, fd;
+
+    lfd = socket(AF_INET6, SOCK_STREAM, 0);
+    if (lfd < 0) {
+        perror("socket");
+        return -1;
+    }
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    if (bind(lfd, (struct sockaddr *) &addr, sizeof(addr)) || listen(lfd, 1)) {
+        perror("bind/listen");
+        close(lfd);
+        return -1;
+    }
+
+    fprintf(stderr, "# waiting for client on port %d\n", port);
+    fd = accept(lfd, NULL, NULL);
+    if (fd < 0)
+        perror("accept");
+    close(lfd);
+    return fd;
+}
+
+/*
+ * The parameter block travels as big endian 32-bit words, 64-bit
+ * fields high word first: 11 32-bit fields and 2 64-bit ones. This is
+ * the wire format, not sizeof(struct hgperf_cfg), which has padding.
+ */
+#define CFG_WORDS   13
+
+int hgperf_exchange_cfg(struct hgperf_ctx *hc)
+{
+    struct hgperf_cfg *c = &hc->cfg;
+    uint32_t wire[CFG_WORDS];
+    uint32_t *w = wire;
+
+    hc->sock = hc->server ? tcp_connect(hc->server, hc->tcp_port) :
+                            tcp_accept(hc->tcp_port);
+    if (hc->sock < 0)
+        return -1;
+
+    if (hc->server) {
+        *w++ = htonl(c->test);
+        *w++ = htonl(c->mode);
+        *w++ = htonl(c->min_size >> 32);
+        *w++ = htonl(c->min_size);
+        *w++ = htonl(c->max_size >> 32);
+        *w++ = htonl(c->max_size);
+        *w++ = htonl(c->iters);
+        *w++ = htonl(c->num_qps);
+        *w++ = htonl(c->tx_depth);
+        *w++ = htonl(c->rx_depth);
+        *w++ = htonl(c->inline_size);
+        *w++ = htonl(c->signal_every);
+        *w++ = htonl(c->scale_factor);
+        return write_all(hc->sock, wire, sizeof(wire));
+    }
+
+    if (read_all(hc->sock, wire, sizeof(wire)))
+        return -1;
+    c->test         = ntohl(*w++);
+    c->mode         = ntohl(*w++);
+    c->min_size     = (uint64_t) ntohl(w[0]) << 32 | ntohl(w[1]);
+    w += 2;
+    c->max_size     = (uint64_t) ntohl(w[0]) << 32 | ntohl(w[1]);
+    w += 2;
+    c->iters        = ntohl(*w++);
+    c->num_qps      = ntohl(*w++);
+    c->tx_depth     = ntohl(*w++);
+    c->rx_depth     = ntohl(*w++);
+    c->inline_size  = ntohl(*w++);
+    c->signal_every = ntohl(*w++);
+    c->scale_factor = ntohl(*w++);
+    return 0;
+}
+
+int hgperf_sync(struct hgperf_ctx *hc)
+{
+    char c = 0;
+
+    if (write_all(hc->sock, &c, 1) || read_all(hc->sock, &c, 1)) {
+        fprintf(stderr, "lost connection to peer\n");
+        return -1;
+    }
+    return 0;
+}
+
+int hgperf_open(struct hgperf_ctx *hc)
+{
+    struct ibv_device **list, *dev = NULL;
+    union ibv_gid gid;
+    int i, n;
+
+    list = ibv_get_device_list(&n);
+    if (!list) {
+        perror("ibv_get_device_list");
+        return -1;
+    }
+    for (i = 0; i < n; ++i)
+        if (!hc->dev_arg || !strcmp(ibv_get_device_name(list[i]), hc->dev_arg)) {
+            dev = list[i];
+            break;
+        }
+    if (!dev) {
+        if (hc->dev_arg)
+            fprintf(stderr, "no RDMA device %s\n", hc->dev_arg);
+        else
+            fprintf(stderr, "no RDMA device found\n");
+        ibv_free_device_list(list);
+        return -1;
+    }
+
+    hc->ctx = ibv_open_device(dev);
+    if (!hc->ctx) {
+        fprintf(stderr, "couldn't open %s\n", ibv_get_device_name(dev));
+        ibv_free_device_list(list);
+        return -1;
+    }
+    hc->dev_name = strdup(ibv_get_device_name(dev));
+    ibv_free_device_list(list);
+    if (!hc->dev_name) {
+        fprintf(stderr, "out of memory\n");
+        return -1;
+    }
+
+    if (ibv_query_device(hc->ctx, &hc->dev_attr) ||
+        ibv_query_port(hc->ctx, hc->ib_port, &hc->port_attr)) {
+        fprintf(stderr, "couldn't query %s port %d\n", hc->dev_name, hc->ib_port);
+        return -1;
+    }
+
+    memset(hc->local.gid, 0, sizeof(hc->local.gid));
+    if (hc->gid_idx >= 0) {
+        if (ibv_query_gid(hc->ctx, hc->ib_port, hc->gid_idx, &gid)) {
+            fprintf(stderr, "couldn't read GID index %d\n", hc->gid_idx);
+            return -1;
+        }
+        memcpy(hc->local.gid, gid.raw, sizeof(hc->local.gid));
+    }
+    hc->local.lid = hc->port_attr.lid;
+    return 0;
+}
+
+static int min_int(int a, int b)
+{
+    return a < b ? a : b;
+}
+
+/*
+ * Check the parameters against the device and clamp queue depths so
+ * that the shared CQs can't overflow.
+ */
+static int check_cfg(struct hgperf_ctx *hc)
+{
+    struct hgperf_cfg *c = &hc->cfg;
+    int max_cqe = hc->dev_attr.max_cqe;
+
+    if (c->num_qps < 1 || c->num_qps > HGPERF_MAX_QPS ||
+        (int) c->num_qps > hc->dev_attr.max_qp) {
+        fprintf(stderr, "%u QPs requested, %s supports %d\n",
+                c->num_qps, hc->dev_name, hc->dev_attr.max_qp);
+        return -1;
+    }
+    if (c->test == TEST_ATOMIC && hc->dev_attr.atomic_cap == IBV_ATOMIC_NONE) {
+        fprintf(stderr, "%s doesn't support atomics\n", hc->dev_name);
+        return -1;
+    }
+
+    c->tx_depth = min_int(c->tx_depth, hc->dev_attr.max_qp_wr);
+    c->rx_depth = min_int(c->rx_depth, hc->dev_attr.max_qp_wr);
+    if ((uint64_t) c->num_qps * c->rx_depth > (uint64_t) max_cqe)
+        c->rx_depth = max_cqe / c->num_qps;
+    if (!c->tx_depth || !c->rx_depth) {
+        fprintf(stderr, "%s can't hold a WR per QP for %u QPs\n",
+                hc->dev_name, c->num_qps);
+        return -1;
+    }
+    if (c->signal_every > c->tx_depth)
+        c->signal_every = c->tx_depth;
+
+    /* Outstanding send WRs over all QPs are bounded by the CQ size,
+     * see hgperf_run_bw(). */
+    hc->send_cqe = (uint64_t) c->num_qps * c->tx_depth > (uint64_t) max_cqe ?
+                   max_cqe : (int) (c->num_qps * c->tx_depth);
+    hc->recv_cqe = c->test == TEST_SEND ? c->num_qps * c->rx_depth : 1;
+    return 0;
+}
+
+int hgperf_create_resources(struct hgperf_ctx *hc)
+{
+    struct hgperf_cfg *c = &hc->cfg;
+    struct ibv_qp_init_attr attr;
+    int access = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE |
+                 IBV_ACCESS_REMOTE_READ;
+    uint32_t i;
+
+    if (check_cfg(hc))
+        return -1;
+
+    if (c->test == TEST_ATOMIC)
+        access |= IBV_ACCESS_REMOTE_ATOMIC;
+
+    /* The first max_size bytes are the source of sends, writes and
+     * atomics, the second are what the peer writes and reads. */
+    hc->buf_size = 2 * c->max_size;
+    if (posix_memalign(&hc->buf, sysconf(_SC_PAGESIZE), hc->buf_size)) {
+        fprintf(stderr, "couldn't allocate %zu bytes\n", hc->buf_size);
+        return -1;
+    }
+    memset(hc->buf, 0, hc->buf_size);
+
+    hc->pd = ibv_alloc_pd(hc->ctx);
+    if (!hc->pd) {
+        fprintf(stderr, "couldn't allocate PD\n");
+        return -1;
+    }
+    hc->mr = ibv_reg_mr(hc->pd, hc->buf, hc->buf_size, access);
+    if (!hc->mr) {
+        fprintf(stderr, "couldn't register %zu bytes\n", hc->buf_size);
+        return -1;
+    }
+
+    hc->send_cq = ibv_create_cq(hc->ctx, hc->send_cqe, NULL, NULL, 0);
+    hc->recv_cq = ibv_create_cq(hc->ctx, hc->recv_cqe, NULL, NULL, 0);
+    if (!hc->send_cq || !hc->recv_cq) {
+        fprintf(stderr, "couldn't create CQs\n");
+        return -1;
+    }
+
+    hc->qp = calloc(c->num_qps, sizeof(*hc->qp));
+    hc->local.qp = calloc(c->num_qps, sizeof(*hc->local.qp));
+    hc->remote.qp = calloc(c->num_qps, sizeof(*hc->remote.qp));
+    if (!hc->qp || !hc->local.qp || !hc->remote.qp)
+        return -1;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.send_cq          = hc->send_cq;
+    attr.recv_cq          = hc->recv_cq;
+    attr.qp_type          = IBV_QPT_RC;
+    attr.cap.max_send_wr  = c->tx_depth;
+    attr.cap.max_recv_wr  = c->test == TEST_SEND ? c->rx_depth : 1;
+    attr.cap.max_send_sge = 1;
+    attr.cap.max_recv_sge = 1;
+    attr.cap.max_inline_data = c->inline_size;
+
+    srand48(getpid() * hgperf_now_ns());
+    for (i = 0; i < c->num_qps; ++i) {
+        hc->qp[i] = ibv_create_qp(hc->pd, &attr);
+        if (!hc->qp[i]) {
+            fprintf(stderr, "couldn't create QP %u of %u\n", i, c->num_qps);
+            return -1;
+        }
+        hc->local.qp[i].qpn = hc->qp[i]->qp_num;
+        hc->local.qp[i].psn = lrand48() & 0xffffff;
+    }
+
+    hc->local.rkey = hc->mr->rkey;
+    hc->local.addr = (uintptr_t) hc->buf;
+    return 0;
+}
+
+/* Peer information on the wire: lid, gid, rkey, addr, then qpn/psn pairs. */
+static int exchange_peer(struct hgperf_ctx *hc)
+{
+    uint32_t n = hc->cfg.num_qps;
+    size_t len = 4 + 16 + 4 + 8 + n * 8;
+    uint8_t *out, *in, *p;
+    uint32_t v32, i;
+    uint64_t v64;
+    int err = -1;
+
+    out = malloc(len);
+    in  = malloc(len);
+    if (!out || !in)
+        goto out;
+
+    p = out;
+    v32 = htonl(hc->local.lid);  memcpy(p, &v32, 4); p += 4;
+    memcpy(p, hc->local.gid, 16);                    p += 16;
+    v32 = htonl(hc->local.rkey); memcpy(p, &v32, 4); p += 4;
+    v64 = htobe64(hc->local.addr); memcpy(p, &v64, 8); p += 8;
+    for (i = 0; i < n; ++i) {
+        v32 = htonl(hc->local.qp[i].qpn); memcpy(p, &v32, 4); p += 4;
+        v32 = htonl(hc->local.qp[i].psn); memcpy(p, &v32, 4); p += 4;
+    }
+
+    /* The client writes first, so the two sides can't deadlock on
+     * full socket buffers with many QPs. */
+    if (hc->server) {
+        if (write_all(hc->sock, out, len) || read_all(hc->sock, in, len))
+            goto out;
+    } else {
+        if (read_all(hc->sock, in, len) || write_all(hc->sock, out, len))
+            goto out;
+    }
+
+    p = in;
+    memcpy(&v32, p, 4); hc->remote.lid  = ntohl(v32);  p += 4;
+    memcpy(hc->remote.gid, p, 16);                     p += 16;
+    memcpy(&v32, p, 4); hc->remote.rkey = ntohl(v32);  p += 4;
+    memcpy(&v64, p, 8); hc->remote.addr = be64toh(v64); p += 8;
+    for (i = 0; i < n; ++i) {
+        memcpy(&v32, p, 4); hc->remote.qp[i].qpn = ntohl(v32); p += 4;
+        memcpy(&v32, p, 4); hc->remote.qp[i].psn = ntohl(v32); p += 4;
+    }
+    err = 0;
+
+out:
+    if (err)
+        fprintf(stderr, "couldn't exchange QP information\n");
+    free(out);
+    free(in);
+    return err;
+}
+
+static int connect_qp(struct hgperf_ctx *hc, uint32_t i, int rd_atom)
+{
+    struct ibv_qp_attr attr;
+    int access = IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ;
+
+    if (hc->cfg.test == TEST_ATOMIC)
+        access |= IBV_ACCESS_REMOTE_ATOMIC;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.qp_state        = IBV_QPS_INIT;
+    attr.pkey_index      = 0;
+    attr.port_num        = hc->ib_port;
+    attr.qp_access_flags = access;
+    if (ibv_modify_qp(hc->qp[i], &attr, IBV_QP_STATE | IBV_QP_PKEY_INDEX |
+                      IBV_QP_PORT | IBV_QP_ACCESS_FLAGS))
+        return -1;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.qp_state           = IBV_QPS_RTR;
+    attr.path_mtu           = hc->port_attr.active_mtu;
+    attr.dest_qp_num        = hc->remote.qp[i].qpn;
+    attr.rq_psn             = hc->remote.qp[i].psn;
+    attr.max_dest_rd_atomic = rd_atom;
+    attr.min_rnr_timer      = 12;
+    attr.ah_attr.dlid       = hc->remote.lid;
+    attr.ah_attr.port_num   = hc->ib_port;
+    if (hc->gid_idx >= 0) {
+        attr.ah_attr.is_global      = 1;
+        attr.ah_attr.grh.hop_limit  = 1;
+        attr.ah_attr.grh.sgid_index = hc->gid_idx;
+        memcpy(attr.ah_attr.grh.dgid.raw, hc->remote.gid, 16);
+    }
+    if (ibv_modify_qp(hc->qp[i], &attr, IBV_QP_STATE | IBV_QP_AV |
+                      IBV_QP_PATH_MTU | IBV_QP_DEST_QPN | IBV_QP_RQ_PSN |
+                      IBV_QP_MAX_DEST_RD_ATOMIC | IBV_QP_MIN_RNR_TIMER))
+        return -1;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.qp_state      = IBV_QPS_RTS;
+    attr.sq_psn        = hc->local.qp[i].psn;
+    attr.timeout       = 14;
+    attr.retry_cnt     = 7;
+    attr.rnr_retry     = 7;     /* infinite, the send test can outrun receives */
+    attr.max_rd_atomic = rd_atom;
+    return ibv_modify_qp(hc->qp[i], &attr, IBV_QP_STATE | IBV_QP_SQ_PSN |
+                         IBV_QP_TIMEOUT | IBV_QP_RETRY_CNT |
+                         IBV_QP_RNR_RETRY | IBV_QP_MAX_QP_RD_ATOMIC);
+}
+
+int hgperf_connect(struct hgperf_ctx *hc)
+{
+    int rd_atom = min_int(hc->dev_attr.max_qp_rd_atom, 16);
+    uint32_t i, j;
+
+    if (exchange_peer(hc))
+        return -1;
+
+    /* Some devices report no limit; reads and atomics need at least one. */
+    if (!rd_atom && (hc->cfg.test == TEST_READ || hc->cfg.test == TEST_ATOMIC))
+        rd_atom = 1;
+
+    for (i = 0; i < hc->cfg.num_qps; ++i)
+        if (connect_qp(hc, i, rd_atom)) {
+            fprintf(stderr, "couldn't connect QP %u (0x%x -> 0x%x)\n",
+                    i, hc->local.qp[i].qpn, hc->remote.qp[i].qpn);
+            return -1;
+        }
+
+    /* Every receive completion is reposted at once, so each QP keeps
+     * rx_depth receives posted for the whole run. */
+    if (hc->cfg.test == TEST_SEND)
+        for (i = 0; i < hc->cfg.num_qps; ++i)
+            for (j = 0; j < hc->cfg.rx_depth; ++j)
+                if (hgperf_post_recv(hc, i)) {
+                    fprintf(stderr, "couldn't post receives on QP %u\n", i);
+                    return -1;
+                }
+
+    return hgperf_sync(hc);
+}
+
+void hgperf_destroy(struct hgperf_ctx *hc)
+{
+    uint32_t i;
+
+    if (hc->qp)
+        for (i = 0; i < hc->cfg.num_qps; ++i)
+            if (hc->qp[i])
+                ibv_destroy_qp(hc->qp[i]);
+    if (hc->send_cq)
+        ibv_destroy_cq(hc->send_cq);
+    if (hc->recv_cq)
+        ibv_destroy_cq(hc->recv_cq);
+    if (hc->mr)
+        ibv_dereg_mr(hc->mr);
+    if (hc->pd)
+        ibv_dealloc_pd(hc->pd);
+    if (hc->ctx)
+        ibv_close_device(hc->ctx);
+    if (hc->sock >= 0)
+        close(hc->sock);
+    free(hc->buf);
+    free(hc->qp);
+    free(hc->local.qp);
+    free(hc->remote.qp);
+    free(hc->dev_name);
+}
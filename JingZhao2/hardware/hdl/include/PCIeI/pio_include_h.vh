@@ -42,6 +42,10 @@
 
 `define CMD_RST_OFFSET      20'h0_0F10
 `define INIT_DONE_OFFSET    20'h0_0F20
+// The HCA clock has a 4 KB page of its own, so that it can be mapped to
+// user space without the HCR. Unused BAR0 addresses go to the HCR channel.
+`define HCA_CLOCK_LO_OFFSET 20'h0_6000
+`define HCA_CLOCK_HI_OFFSET 20'h0_6004 // not latched, read hi, lo, hi
 /* --------BAR space BASE & LEN{end}-------- */
 
 /* --------Debug param{begin}-------- */
@@ -19,6 +19,7 @@
 // with req data
 `define CMD_SW2HW_CQ      12'h016 // in_param -- inbox, no out_param, in_modifier -- cqn
 `define CMD_RESIZE_CQ     12'h02c // in_param -- inbox, no out_param, in_modifier -- cqn
+`define CMD_MODIFY_CQ     12'h02e // in_param -- inbox, no out_param, in_modifier -- cqn; not realized, CQ event moderation
 `define CMD_SW2HW_EQ      12'h013 // in_param -- inbox, no out_param, in_modifier -- eqn
 `define CMD_MAP_EQ        12'h012 // in_param -- event_mask, no out_param, in_modifier -- eqn
 
@@ -182,6 +183,8 @@
 `define MAX_SG_RQ          8'h10                 /* num of sg in rq is 16      */
 `define MAX_DESC_SZ_RQ     16'h0200              /* desc size is 512 bytes(RQ) */
 `define MAX_ICM_SZ         64'h12345678_87650000 /* maximum supported ICM size */
+`define DEV_CAP_FLAGS      32'h0000_0007         /* RC, UC, UD; no atomics     */
+`define HCA_CLOCK_KHZ      32'd50000             /* user_clk, CQE stamp rate   */
 //--------------{Query device limit}end--------------//
 
 //--------------{Query adapter}begin--------------//
@@ -11,6 +11,9 @@
 `define 	CQ_NUM 								256
 `define 	CQ_NUM_LOG							8
 
+`define 	EQ_NUM 								32		//Matches HGRNIC_NUM_EQS in driver ICM profile
+`define 	EQ_NUM_LOG							5
+
 `define 	MAX_QUEUE_DEPTH 					8
 `define 	MAX_QUEUE_DEPTH_LOG 				8
 
@@ -50,6 +53,14 @@
 `define 	CACHE_TYPE_MPT 							4
 `define 	CACHE_TYPE_MTT 							5
 
+//ICMBuffer associativity and replacement, shared by every ICM cache. They only apply to ICMBufferAssoc,
+//the default ICMBuffer is the 2-way LRU buffer. ICMBufferAssoc is not yet simulated.
+//`define 	ICM_BUFFER_ASSOC
+`define 	CACHE_REPLACE_PLRU						0			//Tree pseudo-LRU, true LRU at 2 ways
+`define 	CACHE_REPLACE_RRIP						1			//Static RRIP, 2-bit RRPV per way
+`define 	CACHE_WAY_NUM							2
+`define 	CACHE_REPLACE_POLICY					`CACHE_REPLACE_PLRU
+
 //Actual cache entry width stored in NIC-SRAM
 `define 	CACHE_ENTRY_WIDTH_QPC 				416
 `define 	CACHE_ENTRY_WIDTH_CQC 				128
@@ -379,6 +390,9 @@
 `define     VERBS_RDMA_READ            5'b10000 
 `define     VERBS_CMP_AND_SWAP         5'b10001 
 `define     VERBS_FETCH_AND_ADD        5'b10010 
+`define     VERBS_SEND_WITH_INV        5'b01100 	//Not realized in WQEParser yet
+`define     VERBS_FAST_REG             5'b11001 	//Not realized, MPT/MTT update by MRMgt
+`define     VERBS_LOCAL_INV            5'b11010 	//Not realized, MPT invalidate by MRMgt
 `define 	OPCODE_INVALID 			   8'hFF	
 
 //Completion Code Definition
@@ -550,6 +564,8 @@
 /*---------------------------------------------------------- Hardware Context Offset Definition : End ----------------------------------------*/
 
 `define 	SQ_PREFETCH_LENGTH				(`SQ_CACHE_SLOT_NUM * 16)	//Aligned to Cache Cell Slot Num
+`define 	SQ_PREFETCH_SHIFT_WIDTH			4 							//Per-QP prefetch window is SQ_PREFETCH_LENGTH >> shift, shift <= SQ_CACHE_SLOT_NUM_LOG
+//`define 	SQ_ADAPTIVE_PREFETCH 										//Adaptive per-QP window instead of SQ_PREFETCH_LENGTH, not yet simulated
 `define 	RQ_PREFETCH_LENGTH				(`SQ_CACHE_SLOT_NUM * 16)	//TODO
 
 `define 	CQ_REQ_HEAD_WIDTH 				64
@@ -90,6 +90,10 @@ module  PCIe_Interface #(
     output wire                         cmd_rst,
     /* -------Reset signal{end}------- */
 
+    /* -------HCA clock, in user_clk domain{begin}------- */
+    input  wire [63:0]                  hca_clock,
+    /* -------HCA clock, in user_clk domain{end}------- */
+
     /* --------SQ Doorbell{begin}-------- */
     output wire           pio_uar_db_valid, // o, 1
     output wire [63:0]    pio_uar_db_data , // o, 64
@@ -549,6 +553,10 @@ STD_PIO #(
     .cmd_rst              ( cmd_rst    ), // o, 1
     /* -------Reset signal{end}------- */
 
+    /* -------HCA clock{begin}------- */
+    .hca_clock            ( hca_clock  ), // i, 64
+    /* -------HCA clock{end}------- */
+
     /* --------Interact with Ethernet BAR{begin}------- */
     .m_axil_awaddr  ( m_axi_awaddr  ) , // o, AXIL_ADDR_WIDTH
     .m_axil_awvalid ( m_axi_awvalid ) , // o, 1
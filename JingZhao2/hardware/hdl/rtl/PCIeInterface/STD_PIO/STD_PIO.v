@@ -110,6 +110,10 @@ module STD_PIO #(
     output wire                         cmd_rst,
     /* -------Reset signal{end}------- */
 
+    /* -------HCA clock, in user_clk domain{begin}------- */
+    input  wire [63:0]                  hca_clock,
+    /* -------HCA clock, in user_clk domain{end}------- */
+
     /* --------Interact with Ethernet BAR{begin}------- */
     output wire [AXIL_ADDR_WIDTH-1:0]    m_axil_awaddr ,
     output wire                          m_axil_awvalid,
@@ -716,9 +720,13 @@ rdma_hcr #(
 
     /* -------Reset signal{begin}------- */
     .cmd_rst              ( cmd_rst       ), // o, 1
-    .init_done            ( init_done     )  // i, 1
+    .init_done            ( init_done     ), // i, 1
     /* -------Reset signal{end}------- */
 
+    /* -------HCA clock{begin}------- */
+    .hca_clock            ( hca_clock     )  // i, 64
+    /* -------HCA clock{end}------- */
+
 `ifdef PCIEI_APB_DBG
     /* -------APB reated signal{begin}------- */
     ,.dbg_sel ( dbg_sel_rdma_hcr ) // i, 32; debug bus select
@@ -53,9 +53,13 @@ module rdma_hcr #(
 
     /* -------Reset signal{begin}------- */
     output wire                         cmd_rst  ,
-    input  wire                         init_done 
+    input  wire                         init_done,
     /* -------Reset signal{end}------- */
 
+    /* -------HCA clock{begin}------- */
+    input  wire [63:0]                  hca_clock
+    /* -------HCA clock{end}------- */
+
 `ifdef PCIEI_APB_DBG
     /* -------APB reated signal{begin}------- */
     ,input  wire [31:0] dbg_sel  // debug bus select
@@ -207,6 +211,10 @@ rdma_hcr_space #(
     .init_done            ( init_done ), // i, 1
     /* -------Reset signal{end}------- */
 
+    /* -------HCA clock{begin}------- */
+    .hca_clock            ( hca_clock ), // i, 64
+    /* -------HCA clock{end}------- */
+
     /* -------Access BAR space Interface{begin}------- */
     .req_vld       ( req_vld ), // i, 1
     .req_wen       ( req_wen   ), // i, 8
@@ -10,6 +10,9 @@
 // >           V1.2 -- Put async fifo behind the module. HCR register can interact
 // >           with CEU directly.
 // >           V1.3 -- Remove BAR 2-3 related logic
+// >           V1.4 -- Read back the free-running HCA clock
+// >           V1.5 -- Move the HCA clock to its own page, stop latching
+// >           the high word
 //*************************************************************************
 
 module rdma_hcr_space #(
@@ -38,6 +41,10 @@ module rdma_hcr_space #(
     input  wire                         init_done,
     /* -------Reset signal{end}------- */
 
+    /* -------HCA clock (in clk domain){begin}------- */
+    input  wire [63:0]                  hca_clock,
+    /* -------HCA clock (in clk domain){end}------- */
+
     /* -------Access BAR space Interface{begin}------- */
     input  wire        req_vld  , // i, 1
     input  wire [7 :0] req_wen  , // i, 8
@@ -69,6 +76,8 @@ wire bar0_5_hit   ;
 wire bar0_6_hit   ;
 wire bar0_init_done_hit;
 wire bar0_rst_hit ;
+wire bar0_clock_lo_hit;
+wire bar0_clock_hi_hit;
 /* ------- BAR irrelevant{end}------- */
 
 /* -------BAR0 variable{begin}------- */
@@ -119,6 +128,8 @@ assign bar0_6_hit = req_addr[19:0] == 20'h18 + `HCR_BASE;
 
 assign bar0_init_done_hit = req_addr[19:0] == `INIT_DONE_OFFSET;
 assign bar0_rst_hit       = req_addr[19:0] == `CMD_RST_OFFSET; // BAR0-1 has 1MB space, which is 20 bits
+assign bar0_clock_lo_hit  = req_addr[19:0] == `HCA_CLOCK_LO_OFFSET;
+assign bar0_clock_hi_hit  = req_addr[19:0] == `HCA_CLOCK_HI_OFFSET;
 /* -------BAR irrelevant{end}------- */
 
 
@@ -234,6 +245,12 @@ always @(posedge clk, negedge rst_n) begin
         else if (bar0_init_done_hit) begin
             rsp_rdata <= `TD init_done;
         end
+        else if (bar0_clock_lo_hit) begin
+            rsp_rdata <= `TD hca_clock[31:0];
+        end
+        else if (bar0_clock_hi_hit) begin
+            rsp_rdata <= `TD hca_clock[63:32];
+        end
         else begin
             rsp_rdata <= `TD 32'd0;
         end
@@ -2,6 +2,7 @@
 Name:       CQMgt
 Author:     YangFan
 Function:   1.Manage CQ.
+            2.Own the free-running HCA clock, which the CQE generators stamp into completions.
 --------------------------------------------- Module Decription : End -----------------------------------------------*/
 
 /*------------------------------------------- Timescale Definition : Begin ------------------------------------------*/
@@ -43,7 +44,10 @@ module CQMgt
      
     output  wire                                                            RX_RESP_cq_resp_valid,
     output  wire    [`CQ_RESP_HEAD_WIDTH - 1 : 0]                           RX_RESP_cq_resp_head,
-    input   wire                                                            RX_RESP_cq_resp_ready
+    input   wire                                                            RX_RESP_cq_resp_ready,
+
+//HCA clock, counts clk cycles since reset
+    output  wire    [63:0]                                                  hca_clock
 );
 
 /*------------------------------------------- Input/Output Definition : End -----------------------------------------*/
@@ -69,6 +73,8 @@ reg             [2:0]                                                       last
 
 reg             [`CQ_NUM_LOG - 1 : 0]                                       cqn;
 reg             [31:0]                                                      cq_length;
+
+reg             [63:0]                                                      clock_counter;
 /*------------------------------------------- Local Variables Definition : End --------------------------------------*/
 
 /*------------------------------------------- Submodules Instatiation : Begin ---------------------------------------*/
@@ -204,6 +210,18 @@ always @(posedge clk or posedge rst) begin
     end
 end
 
+//-- clock_counter --
+always @(posedge clk or posedge rst) begin
+    if (rst) begin
+        clock_counter <= 'd0;
+    end
+    else begin
+        clock_counter <= clock_counter + 'd1;
+    end
+end
+
+assign hca_clock = clock_counter;
+
 //-- last_sch --
 always @(posedge clk or posedge rst) begin
     if (rst) begin
@@ -274,4 +292,4 @@ assign RX_RESP_cq_resp_head = (cur_state == RX_RESP_s) ? {cq_offset_record_doutb
 
 /*------------------------------------------- Local Macros Undef : End ----------------------------------------------*/
 
-endmodule
\ No newline at end of file
+endmodule
\ No newline at end of file
@@ -50,7 +50,14 @@ module WQECache
     input   wire                                                            cache_offset_web,
     input   wire    [`QP_NUM_LOG - 1 : 0]                                   cache_offset_addrb,
     input   wire    [CACHE_SLOT_NUM_LOG - 1:0]                          cache_offset_dinb,
-    output  wire    [CACHE_SLOT_NUM_LOG - 1:0]                          cache_offset_doutb
+    output  wire    [CACHE_SLOT_NUM_LOG - 1:0]                          cache_offset_doutb,
+
+    input   wire                                                            cache_fill_wea,
+    input   wire    [CACHE_CELL_NUM_LOG - 1 : 0]                        cache_fill_addra,
+    input   wire    [CACHE_SLOT_NUM_LOG : 0]                            cache_fill_dina,
+
+    input   wire    [CACHE_CELL_NUM_LOG - 1 : 0]                        cache_fill_addrb,
+    output  wire    [CACHE_SLOT_NUM_LOG : 0]                            cache_fill_doutb
 
 );
 /*------------------------------------------- Input/Output Definition : End -----------------------------------------*/
@@ -102,6 +109,23 @@ CacheOffsetTable
     .doutb          (   cache_offset_doutb                      )
 );
 
+SRAM_SDP_Template #(
+    .RAM_WIDTH      (   CACHE_SLOT_NUM_LOG + 1                  ),      //Record how many slots the last fill of each cell wrote
+    .RAM_DEPTH      (   CACHE_CELL_NUM                          )
+)
+CacheFillTable
+(
+    .clk            (   clk                                     ),
+    .rst            (   rst                                     ),
+
+    .wea            (   cache_fill_wea                          ),
+    .addra          (   cache_fill_addra                        ),
+    .dina           (   cache_fill_dina                         ),
+
+    .addrb          (   cache_fill_addrb                        ),
+    .doutb          (   cache_fill_doutb                        )
+);
+
 SRAM_SDP_Template #(
     .RAM_WIDTH      (   `WQE_SEG_WIDTH                          ),
     .RAM_DEPTH      (   CACHE_CELL_NUM * CACHE_SLOT_NUM         )
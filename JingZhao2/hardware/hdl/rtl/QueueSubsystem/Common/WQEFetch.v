@@ -45,6 +45,11 @@ module WQEFetch
     output  reg    	[`QP_NUM_LOG - CACHE_CELL_NUM_LOG + 1 - 1 : 0]          cache_owned_din,
     input   wire    [`QP_NUM_LOG - CACHE_CELL_NUM_LOG + 1 - 1 : 0]          cache_owned_dout,
 
+    //Interface with Cache Fill Table
+    output  reg                                                            	cache_fill_wen,
+    output  reg    	[CACHE_CELL_NUM_LOG - 1 : 0]                        	cache_fill_addr,
+    output  reg    	[CACHE_SLOT_NUM_LOG : 0]                          	cache_fill_din,
+
 //Interface with DMA Read Channel
     output  wire                                                            dma_rd_req_valid,
     output  wire    [`DMA_HEAD_WIDTH - 1 : 0]                               dma_rd_req_head,
@@ -514,6 +519,27 @@ always @(*) begin
 	end
 end
 
+//-- cache_fill_wen --
+//-- cache_fill_addr --
+//-- cache_fill_din -- Block length is chosen by SQMetaProc, WQEParser only trusts the slots written here
+always @(*) begin
+	if(rst) begin
+		cache_fill_wen = 'd0;
+		cache_fill_addr = 'd0;
+		cache_fill_din = 'd0;
+	end
+	else if(cur_state == DMA_RSP_s && cache_slot_wr_count == cache_slot_wr_total && wqe_seg_valid) begin
+		cache_fill_wen = 'd1;
+		cache_fill_addr = cell_index;
+		cache_fill_din = cache_slot_wr_total;
+	end
+	else begin
+		cache_fill_wen = 'd0;
+		cache_fill_addr = cell_index;
+		cache_fill_din = 'd0;
+	end
+end
+
 //-- cache_offset_wen --
 //-- cache_offset_addr --
 //-- cache_offset_din --
@@ -1,7 +1,9 @@
 /*------------------------------------------- Module Description : Begin ----------------------------------------------
-Name:       CQMgt
+Name:       EQMgt
 Author:     YangFan
-Function:   1.Manage CQ.
+Function:   1.Manage EQ.
+            2.Each request carries the comp_eqn taken from CQ context, producer offset is kept per EQN,
+              so CQs bound to different completion vectors report to different EQs.
 --------------------------------------------- Module Decription : End -----------------------------------------------*/
 
 /*------------------------------------------- Timescale Definition : Begin ------------------------------------------*/
@@ -49,45 +51,225 @@ module EQMgt
 /*------------------------------------------- Input/Output Definition : End -----------------------------------------*/
 
 /*------------------------------------------- Local Macros Definition : Begin ---------------------------------------*/
+`define         EQN_OFFSET              23:0
+`define         EQ_LENGTH_OFFSET        63:32
+
+`define         CHNL_TX_REQ             0
+`define         CHNL_RX_REQ             1
+`define         CHNL_RX_RESP            2
 /*------------------------------------------- Local Macros Definition : End -----------------------------------------*/
 
 /*------------------------------------------- Local Variables Definition : Begin ------------------------------------*/
+wire            [0:0]                                                       eq_offset_record_wea;
+wire            [`EQ_NUM_LOG - 1 : 0]                                       eq_offset_record_addra;
+wire            [23:0]                                                      eq_offset_record_dina;
+
+wire            [`EQ_NUM_LOG - 1 : 0]                                       eq_offset_record_addrb;
+wire            [23:0]                                                      eq_offset_record_doutb;
+
+reg             [2:0]                                                       last_sch;
+
+reg             [`EQ_NUM_LOG - 1 : 0]                                       eqn;
+reg             [31:0]                                                      eq_length;
 /*------------------------------------------- Local Variables Definition : End --------------------------------------*/
 
 /*------------------------------------------- Submodules Instatiation : Begin ---------------------------------------*/
+SRAM_SDP_Template #(
+    .RAM_WIDTH      (   24                                      ),
+    .RAM_DEPTH      (   `EQ_NUM                                 )
+)
+EQOffsetRecordTable
+(
+    .clk            (   clk                                     ),
+    .rst            (   rst                                     ),
+
+    .wea            (   eq_offset_record_wea                    ),
+    .addra          (   eq_offset_record_addra                  ),
+    .dina           (   eq_offset_record_dina                   ),
+
+    .addrb          (   eq_offset_record_addrb                  ),
+    .doutb          (   eq_offset_record_doutb                  )
+);
 /*------------------------------------------- Submodules Instatiation : End -----------------------------------------*/
 
 /*------------------------------------------- State Machine Definition : Begin --------------------------------------*/
+reg             [2:0]                   cur_state;
+reg             [2:0]                   next_state;
+
+parameter       IDLE_s      =   3'd1,
+                TX_REQ_s    =   3'd2,
+                RX_REQ_s    =   3'd3,
+                RX_RESP_s   =   3'd4;
+
+always @(posedge clk or posedge rst) begin
+    if (rst) begin
+        cur_state <= IDLE_s;        
+    end
+    else begin
+        cur_state <= next_state;
+    end
+end
+
+always @(*) begin
+    case(cur_state)
+        IDLE_s:             if(last_sch == `CHNL_TX_REQ) begin
+                                if(RX_REQ_eq_req_valid) begin
+                                    next_state = RX_REQ_s;
+                                end
+                                else if(RX_RESP_eq_req_valid) begin
+                                    next_state = RX_RESP_s;
+                                end
+                                else if(TX_REQ_eq_req_valid) begin
+                                    next_state = TX_REQ_s;
+                                end
+                                else begin
+                                    next_state = IDLE_s;
+                                end
+                            end
+                            else if(last_sch == `CHNL_RX_REQ) begin
+                                if(RX_RESP_eq_req_valid) begin
+                                    next_state = RX_RESP_s;
+                                end
+                                else if(TX_REQ_eq_req_valid) begin
+                                    next_state = TX_REQ_s;
+                                end
+                                else if(RX_REQ_eq_req_valid) begin
+                                    next_state = RX_REQ_s;
+                                end
+                                else begin
+                                    next_state = IDLE_s;
+                                end
+                            end
+                            else if(last_sch == `CHNL_RX_RESP) begin
+                                if(TX_REQ_eq_req_valid) begin
+                                    next_state = TX_REQ_s;
+                                end
+                                else if(RX_REQ_eq_req_valid) begin
+                                    next_state = RX_REQ_s;
+                                end
+                                else if(RX_RESP_eq_req_valid) begin
+                                    next_state = RX_RESP_s;
+                                end
+                                else begin
+                                    next_state = IDLE_s;
+                                end
+                            end
+                            else begin
+                                next_state = IDLE_s;
+                            end
+        TX_REQ_s:           if(TX_REQ_eq_resp_ready) begin
+                                next_state = IDLE_s;
+                            end
+                            else begin
+                                next_state = TX_REQ_s;
+                            end
+        RX_REQ_s:           if(RX_REQ_eq_resp_ready) begin
+                                next_state = IDLE_s;
+                            end
+                            else begin
+                                next_state = RX_REQ_s;
+                            end
+        RX_RESP_s:          if(RX_RESP_eq_resp_ready) begin
+                                next_state = IDLE_s;
+                            end
+                            else begin
+                                next_state = RX_RESP_s;
+                            end
+        default:            next_state = IDLE_s;
+    endcase
+end
 /*------------------------------------------- State Machine Definition : End ----------------------------------------*/
 
 /*------------------------------------------- Variables Decode : Begin ----------------------------------------------*/
-reg     counter;
+//-- eqn --
+//-- eq_length --
+always @(posedge clk or posedge rst) begin
+    if (rst) begin
+        eqn <= 'd0; 
+        eq_length <= 'd0;       
+    end
+    else if (cur_state == IDLE_s && next_state == TX_REQ_s) begin
+        eqn <= TX_REQ_eq_req_head[`EQN_OFFSET];
+        eq_length <= TX_REQ_eq_req_head[`EQ_LENGTH_OFFSET];
+    end
+    else if (cur_state == IDLE_s && next_state == RX_REQ_s) begin
+        eqn <= RX_REQ_eq_req_head[`EQN_OFFSET];
+        eq_length <= RX_REQ_eq_req_head[`EQ_LENGTH_OFFSET];
+    end
+    else if (cur_state == IDLE_s && next_state == RX_RESP_s) begin
+        eqn <= RX_RESP_eq_req_head[`EQN_OFFSET];
+        eq_length <= RX_RESP_eq_req_head[`EQ_LENGTH_OFFSET];
+    end
+    else begin
+        eqn <= eqn;
+        eq_length <= eq_length;
+    end
+end
 
+//-- last_sch --
 always @(posedge clk or posedge rst) begin
     if (rst) begin
-        counter <= 'd1;        
+        last_sch <= 'd0;        
+    end
+    else if (cur_state == TX_REQ_s && TX_REQ_eq_resp_ready) begin
+        last_sch <= `CHNL_TX_REQ;
+    end
+    else if (cur_state == RX_REQ_s && RX_REQ_eq_resp_ready) begin
+        last_sch <= `CHNL_RX_REQ;
+    end
+    else if (cur_state == RX_RESP_s && RX_RESP_eq_resp_ready) begin
+        last_sch <= `CHNL_RX_RESP;
     end
     else begin
-        counter <= counter;
+        last_sch <= last_sch;
     end
 end
 
-assign TX_REQ_eq_req_ready = 'd1;
+//-- eq_offset_record_wea --
+//-- eq_offset_record_addra --
+//-- eq_offset_record_dina --
+assign eq_offset_record_wea =   (cur_state == TX_REQ_s && TX_REQ_eq_resp_ready) ? 'd1 : 
+                                (cur_state == RX_REQ_s && RX_REQ_eq_resp_ready) ? 'd1 : 
+                                (cur_state == RX_RESP_s && RX_RESP_eq_resp_ready) ? 'd1 : 'd0;
+assign eq_offset_record_addra = (cur_state == TX_REQ_s && TX_REQ_eq_resp_ready) ? eqn :
+                                (cur_state == RX_REQ_s && RX_REQ_eq_resp_ready) ? eqn : 
+                                (cur_state == RX_RESP_s && RX_RESP_eq_resp_ready) ? eqn : 'd0;
+assign eq_offset_record_dina =  (cur_state == TX_REQ_s && TX_REQ_eq_resp_ready)? (eq_offset_record_doutb + `EVENT_LENGTH == eq_length ? 'd0 : eq_offset_record_doutb + `EVENT_LENGTH) :
+                                (cur_state == RX_REQ_s && RX_REQ_eq_resp_ready) ? (eq_offset_record_doutb + `EVENT_LENGTH == eq_length ? 'd0 : eq_offset_record_doutb + `EVENT_LENGTH) :
+                                (cur_state == RX_RESP_s && RX_RESP_eq_resp_ready) ? (eq_offset_record_doutb + `EVENT_LENGTH == eq_length ? 'd0 : eq_offset_record_doutb + `EVENT_LENGTH) : 'd0;
+
+//-- eq_offset_record_addrb --
+assign eq_offset_record_addrb = (cur_state == IDLE_s && next_state == TX_REQ_s) ? TX_REQ_eq_req_head[`EQN_OFFSET] :
+                                (cur_state == IDLE_s && next_state == RX_REQ_s) ? RX_REQ_eq_req_head[`EQN_OFFSET] :
+                                (cur_state == IDLE_s && next_state == RX_RESP_s) ? RX_RESP_eq_req_head[`EQN_OFFSET] : eqn;
+
 
-assign TX_REQ_eq_resp_valid = 'd1;
-assign TX_REQ_eq_resp_head = 'd1;
+//-- TX_REQ_eq_req_ready --
+assign TX_REQ_eq_req_ready = (cur_state == TX_REQ_s) ? 'd1 : 'd0;
 
-assign RX_REQ_eq_req_ready = 'd1;
+wire    [31:0]              eqn_resp;
+assign eqn_resp = {'d0, eqn};
 
-assign RX_REQ_eq_resp_valid = 'd1;
-assign RX_REQ_eq_resp_head = 'd1;
+//-- TX_REQ_eq_resp_valid --
+//-- TX_REQ_eq_resp_head --
+assign TX_REQ_eq_resp_valid = (cur_state == TX_REQ_s) ? 'd1 : 'd0;
+assign TX_REQ_eq_resp_head = (cur_state == TX_REQ_s) ? {eq_offset_record_doutb, eqn_resp}: 'd0;
 
-assign RX_RESP_eq_req_ready = 'd1;
+//-- RX_REQ_eq_req_ready --
+assign RX_REQ_eq_req_ready = (cur_state == RX_REQ_s) ? 'd1 : 'd0;
 
-assign RX_RESP_eq_resp_valid = 'd1;
-assign RX_RESP_eq_resp_head = 'd1;
+//-- RX_REQ_eq_resp_valid --
+//-- RX_REQ_eq_resp_head --
+assign RX_REQ_eq_resp_valid = (cur_state == RX_REQ_s) ? 'd1 : 'd0;
+assign RX_REQ_eq_resp_head = (cur_state == RX_REQ_s) ? {eq_offset_record_doutb, eqn_resp}: 'd0;
 
+//-- RX_RESP_eq_req_ready --
+assign RX_RESP_eq_req_ready = (cur_state == RX_RESP_s) ? 'd1 : 'd0;
 
+//-- RX_RESP_eq_resp_valid --
+//-- RX_RESP_eq_resp_head --
+assign RX_RESP_eq_resp_valid = (cur_state == RX_RESP_s) ? 'd1 : 'd0;
+assign RX_RESP_eq_resp_head = (cur_state == RX_RESP_s) ? {eq_offset_record_doutb, eqn_resp}: 'd0;
 /*------------------------------------------- Variables Decode : End ----------------------------------------------*/
 
 /*------------------------------------------- Local Macros Undef : Begin --------------------------------------------*/
@@ -204,7 +204,10 @@ module QueueSubsystem
      
     output  wire                                                            RX_RESP_eq_resp_valid,
     output  wire    [`EQ_RESP_HEAD_WIDTH - 1 : 0]                           RX_RESP_eq_resp_head,
-    input   wire                                                            RX_RESP_eq_resp_ready
+    input   wire                                                            RX_RESP_eq_resp_ready,
+
+//HCA clock, for CQE timestamps and the BAR0 clock registers
+    output  wire    [63:0]                                                  hca_clock
 );
 
 /*------------------------------------------- Input/Output Definition : End -----------------------------------------*/
@@ -394,7 +397,9 @@ CQMgt CQMgt_Inst(
 
     .RX_RESP_cq_resp_valid               (           RX_RESP_cq_resp_valid            ),
     .RX_RESP_cq_resp_head                (           RX_RESP_cq_resp_head             ),
-    .RX_RESP_cq_resp_ready               (           RX_RESP_cq_resp_ready            )
+    .RX_RESP_cq_resp_ready               (           RX_RESP_cq_resp_ready            ),
+
+    .hca_clock                           (           hca_clock                        )
 );
 
 EQMgt EQMgt_Inst(
@@ -437,4 +442,4 @@ EQMgt EQMgt_Inst(
 
 /*------------------------------------------- Local Macros Undef : End ----------------------------------------------*/
 
-endmodule
\ No newline at end of file
+endmodule
\ No newline at end of file
@@ -113,6 +113,10 @@ wire            [`QP_NUM_LOG - 1 : 0]                                       cach
 wire            [`SQ_CACHE_SLOT_NUM_LOG - 1:0]                              cache_offset_dina;
 wire            [`SQ_CACHE_SLOT_NUM_LOG - 1:0]                              cache_offset_douta;
 
+wire                                                                        cache_fill_wea;
+wire            [CACHE_CELL_NUM_LOG - 1 : 0]                                cache_fill_addra;
+wire            [`SQ_CACHE_SLOT_NUM_LOG : 0]                                cache_fill_dina;
+
 wire                                                                        cache_buffer_wea;
 wire            [log2b(`RQ_CACHE_SLOT_NUM * `RQ_CACHE_CELL_NUM - 1) - 1 : 0]                            cache_buffer_addra;
 wire            [`WQE_SEG_WIDTH - 1 : 0]                                    cache_buffer_dina;
@@ -219,7 +223,15 @@ RQCache_Inst
     .cache_offset_web                   (       RQ_cache_offset_wen         ),
     .cache_offset_addrb                 (       RQ_cache_offset_addr        ),
     .cache_offset_dinb                  (       RQ_cache_offset_din         ),
-    .cache_offset_doutb                 (       RQ_cache_offset_dout        )
+    .cache_offset_doutb                 (       RQ_cache_offset_dout        ),
+
+    //RQ blocks keep the fixed RQ_PREFETCH_LENGTH, RDMACore does not read the fill length
+    .cache_fill_wea                     (       cache_fill_wea              ),
+    .cache_fill_addra                   (       cache_fill_addra            ),
+    .cache_fill_dina                    (       cache_fill_dina             ),
+
+    .cache_fill_addrb                   (       'd0                         ),
+    .cache_fill_doutb                   (                                   )
 );
 
 WQEFetch
@@ -251,6 +263,10 @@ WQEFetch_Inst
     .cache_owned_din                    (       cache_owned_dina            ),
     .cache_owned_dout                   (       cache_owned_douta           ),
 
+    .cache_fill_wen                     (       cache_fill_wea              ),
+    .cache_fill_addr                    (       cache_fill_addra            ),
+    .cache_fill_din                     (       cache_fill_dina             ),
+
     .dma_rd_req_valid                   (       RQ_dma_rd_req_valid         ),
     .dma_rd_req_head                    (       RQ_dma_rd_req_head          ),
     .dma_rd_req_data                    (       RQ_dma_rd_req_data          ),
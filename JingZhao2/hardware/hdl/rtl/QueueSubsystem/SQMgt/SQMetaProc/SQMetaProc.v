@@ -58,6 +58,10 @@ module SQMetaProc
     output  wire    [`QP_NUM_LOG - 1 : 0]                                   sq_offset_addr,
     output  wire    [23:0]                                                  sq_offset_din,
     input   wire    [23:0]                                                  sq_offset_dout,
+
+//Interface with SQPrefetchRecord
+    output  wire    [`QP_NUM_LOG - 1 : 0]                                   sq_prefetch_addr,
+    input   wire    [`SQ_PREFETCH_SHIFT_WIDTH - 1 : 0]                      sq_prefetch_dout,
     
 //Interface with WQEFetch
     output  wire                                                            sq_meta_valid,
@@ -107,6 +111,9 @@ SQMetaProc_Thread_2 SQMetaProc_Thread_2_Inst
     .sq_offset_addr                                 (       sq_offset_addr              ),
     .sq_offset_din                                  (       sq_offset_din               ),
     .sq_offset_dout                                 (       sq_offset_dout              ),
+
+    .sq_prefetch_addr                               (       sq_prefetch_addr            ),
+    .sq_prefetch_dout                               (       sq_prefetch_dout            ),
  
     .fetch_mr_ingress_valid                         (       fetch_mr_ingress_valid      ),
     .fetch_mr_ingress_head                          (       fetch_mr_ingress_head       ), 
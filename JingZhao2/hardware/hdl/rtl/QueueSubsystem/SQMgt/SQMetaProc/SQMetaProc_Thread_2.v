@@ -32,6 +32,10 @@ module SQMetaProc_Thread_2
     output  wire    [23:0]                                                  sq_offset_din,
     input   wire    [23:0]                                                  sq_offset_dout,
 
+//Interface with SQPrefetchRecord
+    output  wire    [`QP_NUM_LOG - 1 : 0]                                   sq_prefetch_addr,
+    input   wire    [`SQ_PREFETCH_SHIFT_WIDTH - 1 : 0]                      sq_prefetch_dout,
+
 //Interface with MRMgt    
     output  wire                                                            fetch_mr_ingress_valid,
     output  wire    [`SQ_OOO_MR_INGRESS_HEAD_WIDTH - 1 : 0]                 fetch_mr_ingress_head, 
@@ -101,6 +105,10 @@ wire            [63:0]                                          mr_laddr;
 wire            [31:0]                                          mr_lkey;
 wire            [31:0]                                          mr_pd;
 
+wire            [31:0]                                          prefetch_window;
+wire            [31:0]                                          prefetch_stride;
+wire            [31:0]                                          prefetch_length;
+
 wire            [`CACHE_ENTRY_WIDTH_QPC - 1 : 0]                qp_cxt;
 /*------------------------------------------- Local Variables Definition : End --------------------------------------*/
 
@@ -195,12 +203,23 @@ assign sq_lkey = qp_cxt[`QP_CXT_SQ_LKEY_OFFSET];
 assign ingress_slot_count = (cur_state == FETCH_MR_s) ? 'd1 : 'd0;
 assign ingress_common_head = (cur_state == FETCH_MR_s) ? {`NO_BYPASS, ingress_slot_count, local_qpn[`MAX_QP_NUM_LOG - 1 : 0]} : 'd0;
 
+//-- prefetch_window -- Fixed unless SQ_ADAPTIVE_PREFETCH, then WQEParser halves it when a block is mostly unused and doubles it when a WQE chain runs past it
+//-- prefetch_stride --
+//-- prefetch_length -- At least one SQ entry, so the WQE at sq_offset is always whole in the block
+`ifdef SQ_ADAPTIVE_PREFETCH
+assign prefetch_window = `SQ_PREFETCH_LENGTH >> sq_prefetch_dout;
+`else
+assign prefetch_window = `SQ_PREFETCH_LENGTH;
+`endif
+assign prefetch_stride = ((32'd1 << sq_entry_sz_log) > `SQ_PREFETCH_LENGTH) ? `SQ_PREFETCH_LENGTH : (32'd1 << sq_entry_sz_log);
+assign prefetch_length = (prefetch_window < prefetch_stride) ? prefetch_stride : prefetch_window;
+
 //-- mr_length --
 //-- mr_laddr --
 //-- mr_lkey --
 //-- mr_pd --
-assign mr_length = (cur_state == FETCH_MR_s && (sq_offset_dout * 16) + `SQ_PREFETCH_LENGTH > sq_length) ? (sq_length - (sq_offset_dout * 16)) :
-                    (cur_state == FETCH_MR_s && (sq_offset_dout * 16) + `SQ_PREFETCH_LENGTH <= sq_length) ? `SQ_PREFETCH_LENGTH : 'd0;
+assign mr_length = (cur_state == FETCH_MR_s && (sq_offset_dout * 16) + prefetch_length > sq_length) ? (sq_length - (sq_offset_dout * 16)) :
+                    (cur_state == FETCH_MR_s && (sq_offset_dout * 16) + prefetch_length <= sq_length) ? prefetch_length : 'd0;
 assign mr_laddr = (cur_state == FETCH_MR_s) ? (sq_offset_dout * 16) : 'd0;
 assign mr_lkey = sq_lkey;
 assign mr_pd = qp_pd;
@@ -308,6 +327,9 @@ assign sq_offset_wen = 'd0;
 //-- sq_offset_din --
 assign sq_offset_din = 'd0;
 
+//-- sq_prefetch_addr --
+assign sq_prefetch_addr = local_qpn;
+
 //-- fetch_mr_ingress_valid --
 //-- fetch_mr_ingress_head --
 //-- fetch_mr_ingress_data --
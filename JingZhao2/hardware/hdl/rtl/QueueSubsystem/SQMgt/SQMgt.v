@@ -148,6 +148,12 @@ wire            [0:0]                                                       sq_o
 wire            [`QP_NUM_LOG - 1 : 0]                                       sq_offset_record_addrb;
 wire            [23:0]                                                      sq_offset_record_dinb;
 wire            [23:0]                                                      sq_offset_record_doutb;
+wire            [0:0]                                                       sq_prefetch_record_wea;
+wire            [`QP_NUM_LOG - 1 : 0]                                       sq_prefetch_record_addra;
+wire            [`SQ_PREFETCH_SHIFT_WIDTH - 1 : 0]                          sq_prefetch_record_dina;
+wire            [`SQ_PREFETCH_SHIFT_WIDTH - 1 : 0]                          sq_prefetch_record_douta;
+wire            [`QP_NUM_LOG - 1 : 0]                                       sq_prefetch_record_addrb;
+wire            [`SQ_PREFETCH_SHIFT_WIDTH - 1 : 0]                          sq_prefetch_record_doutb;
 
 wire                                                                        cache_owned_wea;
 wire            [CACHE_CELL_NUM_LOG - 1 : 0]                                cache_owned_addra;
@@ -168,6 +174,11 @@ wire                                                                        cach
 wire            [`QP_NUM_LOG - 1 : 0]                                       cache_offset_addrb;
 wire            [`SQ_CACHE_SLOT_NUM_LOG - 1:0]                              cache_offset_dinb;
 wire            [`SQ_CACHE_SLOT_NUM_LOG - 1:0]                              cache_offset_doutb;
+wire                                                                        cache_fill_wea;
+wire            [CACHE_CELL_NUM_LOG - 1 : 0]                                cache_fill_addra;
+wire            [`SQ_CACHE_SLOT_NUM_LOG : 0]                                cache_fill_dina;
+wire            [CACHE_CELL_NUM_LOG - 1 : 0]                                cache_fill_addrb;
+wire            [`SQ_CACHE_SLOT_NUM_LOG : 0]                                cache_fill_doutb;
 
 wire                                                                                                        cache_buffer_wea;
 wire            [log2b(`SQ_CACHE_SLOT_NUM * `SQ_CACHE_CELL_NUM - 1) - 1 : 0]                            cache_buffer_addra;
@@ -250,6 +261,8 @@ SQMetaProc SQMetaProc_Inst(
     .sq_offset_addr                     (       sq_offset_record_addra      ),
     .sq_offset_din                      (       sq_offset_record_dina       ),
     .sq_offset_dout                     (       sq_offset_record_douta      ),
+    .sq_prefetch_addr                   (       sq_prefetch_record_addrb    ),
+    .sq_prefetch_dout                   (       sq_prefetch_record_doutb    ),
 
     .sq_meta_valid                      (       sq_meta_valid               ),
     .sq_meta_data                       (       sq_meta_data                ),
@@ -294,7 +307,12 @@ SQCache_Inst
     .cache_offset_web                   (       cache_offset_web            ),
     .cache_offset_addrb                 (       cache_offset_addrb          ),
     .cache_offset_dinb                  (       cache_offset_dinb           ),
-    .cache_offset_doutb                 (       cache_offset_doutb          )
+    .cache_offset_doutb                 (       cache_offset_doutb          ),
+    .cache_fill_wea                     (       cache_fill_wea              ),
+    .cache_fill_addra                   (       cache_fill_addra            ),
+    .cache_fill_dina                    (       cache_fill_dina             ),
+    .cache_fill_addrb                   (       cache_fill_addrb            ),
+    .cache_fill_doutb                   (       cache_fill_doutb            )
 );
 
 WQEFetch
@@ -326,6 +344,10 @@ WQEFetch_Inst
     .cache_owned_din                    (       cache_owned_dina            ),
     .cache_owned_dout                   (       cache_owned_douta           ),
 
+    .cache_fill_wen                     (       cache_fill_wea              ),
+    .cache_fill_addr                    (       cache_fill_addra            ),
+    .cache_fill_din                     (       cache_fill_dina             ),
+
     .dma_rd_req_valid                   (       SQ_dma_rd_req_valid         ),
     .dma_rd_req_head                    (       SQ_dma_rd_req_head          ),
     .dma_rd_req_data                    (       SQ_dma_rd_req_data          ),
@@ -395,6 +417,14 @@ WQEParser_Inst
     .cache_owned_din                    (       cache_owned_dinb             ),
     .cache_owned_dout                   (       cache_owned_doutb            ),
 
+    .cache_fill_addr                    (       cache_fill_addrb            ),
+    .cache_fill_dout                    (       cache_fill_doutb            ),
+
+    .sq_prefetch_wen                    (       sq_prefetch_record_wea      ),
+    .sq_prefetch_addr                   (       sq_prefetch_record_addra    ),
+    .sq_prefetch_din                    (       sq_prefetch_record_dina     ),
+    .sq_prefetch_dout                   (       sq_prefetch_record_douta    ),
+
     .sub_wqe_valid                      (       sub_wqe_valid               ),
     .sub_wqe_meta                       (       sub_wqe_meta                ),
     .sub_wqe_ready                      (       sub_wqe_ready               ),
@@ -456,6 +486,26 @@ SQHeadRecordTable
     .doutb          (   sq_head_record_doutb                    )
 );
 
+SRAM_TDP_Template #(
+    .RAM_WIDTH      (   `SQ_PREFETCH_SHIFT_WIDTH                ),      //WQE prefetch window of each QP, SQ_PREFETCH_LENGTH >> shift
+    .RAM_DEPTH      (   `QP_NUM                             	)
+)
+SQPrefetchRecordTable
+(
+    .clk            (   clk                                     ),
+    .rst            (   rst                                     ),
+
+    .wea            (   sq_prefetch_record_wea                  ),
+    .addra          (   sq_prefetch_record_addra                ),
+    .dina           (   sq_prefetch_record_dina                 ),
+    .douta          (   sq_prefetch_record_douta                ),
+
+    .web            (   'd0                                     ),
+    .addrb          (   sq_prefetch_record_addrb                ),
+    .dinb           (   'd0                                     ),
+    .doutb          (   sq_prefetch_record_doutb                )
+);
+
 SRAM_SDP_Template #(
     .RAM_WIDTH      (   1                                      	),
     .RAM_DEPTH      (   `QP_NUM                             	)
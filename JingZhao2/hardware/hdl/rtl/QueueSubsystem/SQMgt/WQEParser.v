@@ -65,6 +65,16 @@ module WQEParser
     output  reg            [`QP_NUM_LOG - 1 : 0]                            cache_owned_din,
     input   wire           [`QP_NUM_LOG - 1 : 0]                            cache_owned_dout,
 
+//Interface with CacheFillTable
+    output  wire           [CACHE_CELL_NUM_LOG - 1 : 0]                     cache_fill_addr,
+    input   wire           [CACHE_SLOT_NUM_LOG : 0]                         cache_fill_dout,
+
+//Interface with SQPrefetchRecord
+    output  reg                                                             sq_prefetch_wen,
+    output  reg     [`QP_NUM_LOG - 1 : 0]                                   sq_prefetch_addr,
+    output  reg     [`SQ_PREFETCH_SHIFT_WIDTH - 1 : 0]                      sq_prefetch_din,
+    input   wire    [`SQ_PREFETCH_SHIFT_WIDTH - 1 : 0]                      sq_prefetch_dout,
+
 //Interface with QPNArbiter
     output  wire                                                            qpn_fifo_valid,
     output  wire            [23:0]                                          qpn_fifo_data,
@@ -188,6 +198,8 @@ wire            [31:0]                          msg_offset_doutb;
 reg             [31:0]                          inline_payload_start_addr;
 
 reg             [31:0]                          parsed_msg_length;
+
+wire            [CACHE_SLOT_NUM_LOG : 0]        cache_block_len;
 reg                                             data_unit_parse_finish;
 
 reg             [15:0]                          insert_count;
@@ -614,7 +626,7 @@ always @(*) begin
             cache_offset_addr = meta_local_qpn;
             cache_offset_din = 'd0;
         end
-        else if(cache_offset_dout + (NextUnit_next_wqe_addr - sq_offset_dout) + NextUnit_next_wqe_size > CACHE_SLOT_NUM) begin     //Next WQE cross Cache Block boundary
+        else if(cache_offset_dout + (NextUnit_next_wqe_addr - sq_offset_dout) + NextUnit_next_wqe_size > cache_block_len) begin     //Next WQE cross Cache Block boundary
             cache_offset_wen = 'd1;
             cache_offset_addr = meta_local_qpn;
             cache_offset_din = 'd0;
@@ -636,7 +648,7 @@ always @(*) begin
             cache_offset_addr = meta_local_qpn;
             cache_offset_din = 'd0;
         end
-        else if(cache_offset_dout + (NextUnit_next_wqe_addr - sq_offset_dout) + NextUnit_next_wqe_size > CACHE_SLOT_NUM) begin     //Next WQE cross Cache Block boundary
+        else if(cache_offset_dout + (NextUnit_next_wqe_addr - sq_offset_dout) + NextUnit_next_wqe_size > cache_block_len) begin     //Next WQE cross Cache Block boundary
             cache_offset_wen = 'd1;
             cache_offset_addr = meta_local_qpn;
             cache_offset_din = 'd0;
@@ -889,6 +901,35 @@ always @(*) begin
         cache_owned_addr = meta_local_qpn;
         cache_owned_din = 'd0;
     end
+`ifdef SQ_ADAPTIVE_PREFETCH
+    else if(cur_state == INLINE_UNIT_s && wqe_valid) begin  //Inline WQE has been finished, the cell may end before the next WQE as well
+        if(cache_owned_dout[`QP_NUM_LOG - CACHE_CELL_NUM_LOG - 1 : 0] != meta_local_qpn[`QP_NUM_LOG - 1 : 4]) begin //Curretn cell is already been replaced by another QP, do not touch it
+            cache_owned_wen = 'd0;
+            cache_owned_addr = meta_local_qpn;
+            cache_owned_din = 'd0;           
+        end
+        else if(!NextUnit_next_wqe_valid) begin //No valid WQE in current DB ringing, clear cache cell state
+            cache_owned_wen = 'd1;
+            cache_owned_addr = meta_local_qpn;
+            cache_owned_din = 'd0;              
+        end
+        else if(NextUnit_next_wqe_valid && NextUnit_next_wqe_addr == 0) begin    //Wrap back to SQ head, clear cache cell state
+            cache_owned_wen = 'd1;
+            cache_owned_addr = meta_local_qpn;
+            cache_owned_din = 'd0;     
+        end
+        else if(NextUnit_next_wqe_valid && (cache_offset_dout + NextUnit_cur_wqe_size_aligned + NextUnit_next_wqe_size_aligned > cache_block_len)) begin     //Cross Cache cell boundary
+            cache_owned_wen = 'd1;
+            cache_owned_addr = meta_local_qpn;
+            cache_owned_din = 'd0;              
+        end
+        else begin
+	        cache_owned_wen = 'd0;
+	        cache_owned_addr = meta_local_qpn;
+	        cache_owned_din = 'd0;
+        end
+    end
+`endif
     else if(cur_state == DATA_UNIT_s && wqe_last && (parsed_msg_length + DataUnit_byte_cnt - msg_offset_doutb <= meta_pmtu) && !data_unit_parse_finish) begin //Current WQE has been finished
         if(cache_owned_dout[`QP_NUM_LOG - CACHE_CELL_NUM_LOG - 1 : 0] != meta_local_qpn[`QP_NUM_LOG - 1 : 4]) begin //Curretn cell is already been replaced by another QP, do not touch it
             cache_owned_wen = 'd0;
@@ -905,7 +946,7 @@ always @(*) begin
             cache_owned_addr = meta_local_qpn;
             cache_owned_din = 'd0;     
         end
-        else if(NextUnit_next_wqe_valid && (cache_offset_dout + NextUnit_cur_wqe_size_aligned + NextUnit_next_wqe_size_aligned > CACHE_SLOT_NUM)) begin     //Cross Cache cell boundary
+        else if(NextUnit_next_wqe_valid && (cache_offset_dout + NextUnit_cur_wqe_size_aligned + NextUnit_next_wqe_size_aligned > cache_block_len)) begin     //Cross Cache cell boundary
             cache_owned_wen = 'd1;
             cache_owned_addr = meta_local_qpn;
             cache_owned_din = 'd0;              
@@ -1474,6 +1515,52 @@ assign sub_wqe_meta = (cur_state == INJECT_s) ? {inline_payload_start_addr, 16'd
                                                 SubWQE_wqe_tail, SubWQE_wqe_head, 1'b0, SubWQE_fence, SubWQE_service_type,
                                                 SubWQE_net_opcode, SubWQE_remote_qpn, 3'd0, SubWQE_verbs_opcode, SubWQE_local_qpn} : 'd0;
 
+//-- cache_fill_addr --
+//-- cache_block_len -- Slots of the current block, the adaptive window may fill less than a whole cell
+assign cache_fill_addr = meta_local_qpn[CACHE_CELL_NUM_LOG - 1 : 0];
+`ifdef SQ_ADAPTIVE_PREFETCH
+assign cache_block_len = cache_fill_dout;
+`else
+assign cache_block_len = CACHE_SLOT_NUM;
+`endif
+
+//-- sq_prefetch_wen --
+//-- sq_prefetch_addr --
+//-- sq_prefetch_din -- Each time a WQE is finished, adapt the prefetch window SQMetaProc uses for the next block of this QP (SQ_ADAPTIVE_PREFETCH only)
+always @(*) begin
+    if(rst) begin
+        sq_prefetch_wen = 'd0;
+        sq_prefetch_addr = 'd0;
+        sq_prefetch_din = 'd0;
+    end
+`ifdef SQ_ADAPTIVE_PREFETCH
+    else if((cur_state == INLINE_UNIT_s && wqe_valid) ||
+            (cur_state == DATA_UNIT_s && wqe_valid && wqe_last && (parsed_msg_length + DataUnit_byte_cnt - msg_offset_doutb <= meta_pmtu) && !data_unit_parse_finish)) begin
+        if(NextUnit_next_wqe_valid && NextUnit_next_wqe_addr >= sq_offset_dout && cache_fill_dout < CACHE_SLOT_NUM &&
+            cache_offset_dout + (NextUnit_next_wqe_addr - sq_offset_dout) + NextUnit_next_wqe_size > cache_fill_dout && sq_prefetch_dout != 'd0) begin     //Chain runs past a short block, double the window
+            sq_prefetch_wen = 'd1;
+            sq_prefetch_addr = meta_local_qpn;
+            sq_prefetch_din = sq_prefetch_dout - 'd1;
+        end
+        else if(!NextUnit_next_wqe_valid && cache_offset_dout + NextUnit_cur_wqe_size_aligned <= (cache_fill_dout >> 1) && (`SQ_PREFETCH_LENGTH >> sq_prefetch_dout) > (32'd1 << meta_sq_entry_sz_log)) begin     //Chain ends in the first half of the block, halve the window down to one SQ entry
+            sq_prefetch_wen = 'd1;
+            sq_prefetch_addr = meta_local_qpn;
+            sq_prefetch_din = sq_prefetch_dout + 'd1;
+        end
+        else begin
+            sq_prefetch_wen = 'd0;
+            sq_prefetch_addr = meta_local_qpn;
+            sq_prefetch_din = 'd0;
+        end
+    end
+`endif
+    else begin
+        sq_prefetch_wen = 'd0;
+        sq_prefetch_addr = meta_local_qpn;
+        sq_prefetch_din = 'd0;
+    end
+end
+
 //-- qpn_fifo_valid --
 //-- qpn_fifo_data --
 assign qpn_fifo_valid = (cur_state == RESCHEDULE_s) ? 'd1 : 'd0;
@@ -283,7 +283,10 @@ module RDMACore
     input   wire                                                            RX_delete_resp_start,
     input   wire                                                            RX_delete_resp_last,
     input   wire    [`PACKET_BUFFER_SLOT_WIDTH - 1 : 0]                     RX_delete_resp_data,
-    output  wire                                                            RX_delete_resp_ready
+    output  wire                                                            RX_delete_resp_ready,
+
+//HCA clock, stamped into CQEs
+    input   wire    [63:0]                                                  hca_clock
 
 );
 
@@ -551,7 +554,9 @@ RequesterCore_Inst
     .RX_RESP_delete_resp_start              (           RX_RESP_delete_resp_start                   ),
     .RX_RESP_delete_resp_last               (           RX_RESP_delete_resp_last                    ),
     .RX_RESP_delete_resp_data               (           RX_RESP_delete_resp_data                    ),
-    .RX_RESP_delete_resp_ready              (           RX_RESP_delete_resp_ready                   )
+    .RX_RESP_delete_resp_ready              (           RX_RESP_delete_resp_ready                   ),
+
+    .hca_clock                              (           hca_clock                                   )
 );
 
 ResponderCore
@@ -685,7 +690,9 @@ ResponderCore_Inst
 
     .TX_RESP_egress_pkt_valid               (           TX_RESP_egress_pkt_valid                    ),
     .TX_RESP_egress_pkt_head                (           TX_RESP_egress_pkt_head                     ),
-    .TX_RESP_egress_pkt_ready               (           TX_RESP_egress_pkt_ready                    )
+    .TX_RESP_egress_pkt_ready               (           TX_RESP_egress_pkt_ready                    ),
+
+    .hca_clock                              (           hca_clock                                   )
 );
 
 GatherData TX_GatherData_Inst(
@@ -124,7 +124,10 @@ module ReqTransCore
 //Interface with TransportSubsystem
     output  wire                                                            egress_pkt_valid,
     output  wire    [`PKT_META_BUS_WIDTH - 1 : 0]                           egress_pkt_head,
-    input   wire                                                            egress_pkt_ready
+    input   wire                                                            egress_pkt_ready,
+
+//HCA clock, stamped into CQEs
+    input   wire    [63:0]                                                  hca_clock
 );
 
 /*------------------------------------------- Input/Output Definition : End -----------------------------------------*/
@@ -272,7 +275,9 @@ ReqTransCore_Thread_4 ReqTransCore_Thread_4_Inst(
 
     .egress_pkt_valid                       (   egress_pkt_valid            ),
     .egress_pkt_head                        (   egress_pkt_head             ),
-    .egress_pkt_ready                       (   egress_pkt_ready            )
+    .egress_pkt_ready                       (   egress_pkt_ready            ),
+
+    .hca_clock                              (   hca_clock                   )
 );
 
 SyncFIFO_Template #(
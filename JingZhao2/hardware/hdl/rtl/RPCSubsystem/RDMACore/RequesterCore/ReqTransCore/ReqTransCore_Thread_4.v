@@ -59,7 +59,10 @@ module ReqTransCore_Thread_4
 //Interface with TransportSubsystem
 	output 	wire 															egress_pkt_valid,
 	output 	wire 	[`PKT_META_BUS_WIDTH - 1 : 0]							egress_pkt_head,
-	input 	wire 															egress_pkt_ready
+	input 	wire 															egress_pkt_ready,
+
+//HCA clock, stamped into CQEs
+	input  wire    [63:0]      hca_clock
 );
 /*------------------------------------------- Input/Output Definition : End -----------------------------------------*/
 
@@ -126,6 +129,7 @@ reg 				[31:0]							payload_piece_total;
 wire 				[255:0]							cqe_data;
 reg 				[31:0]							cqe_my_qpn;
 reg 				[31:0]							cqe_my_ee;
+reg 				[7:0]							cqe_ts_hi;
 reg 				[31:0]							cqe_rqpn;
 reg 				[7:0]							cqe_sl_ipok;
 reg 				[7:0]							cqe_g_mlpath;
@@ -423,6 +427,7 @@ assign egress_pkt_head = (cur_state == INJECT_s) ? {	'd0, NetReq_packet_length,
 /********************************************** CQE Field Gen : Begin ******************************************************/
 //-- cqe_my_qpn --
 //-- cqe_my_ee --
+//-- cqe_ts_hi --  With cqe_my_ee, bits 39:0 of hca_clock when the CQE is generated
 //-- cqe_rqpn --
 //-- cqe_sl_ipok --
 //-- cqe_g_mlpath --
@@ -437,6 +442,7 @@ always @(posedge clk or posedge rst) begin
 	if(rst) begin
 		cqe_my_qpn <= 'd0;
 		cqe_my_ee <= 'd0;
+		cqe_ts_hi <= 'd0;
 		cqe_rqpn <= 'd0;
 		cqe_sl_ipok <= 'd0;
 		cqe_g_mlpath <= 'd0;
@@ -450,7 +456,8 @@ always @(posedge clk or posedge rst) begin
 	end
 	else if(cur_state == JUDGE_s && next_state == GEN_CQE_s) begin
 		cqe_my_qpn <= net_req_bus[`NET_REQ_LOCAL_QPN_OFFSET];
-		cqe_my_ee <= 'd0;
+		cqe_my_ee <= hca_clock[31:0];
+		cqe_ts_hi <= hca_clock[39:32];
 		cqe_rqpn <= net_req_bus[`NET_REQ_REMOTE_QPN_OFFSET];
 		cqe_sl_ipok <= 'd0;
 		cqe_g_mlpath <= 'd0;
@@ -465,6 +472,7 @@ always @(posedge clk or posedge rst) begin
 	else begin
 		cqe_my_qpn <= cqe_my_qpn;
 		cqe_my_ee <= cqe_my_ee;
+		cqe_ts_hi <= cqe_ts_hi;
 		cqe_rqpn <= cqe_rqpn;
 		cqe_sl_ipok <= cqe_sl_ipok;
 		cqe_g_mlpath <= cqe_g_mlpath;
@@ -479,7 +487,7 @@ always @(posedge clk or posedge rst) begin
 end
 
 //-- cqe_data --
-assign cqe_data = (cur_state == GEN_CQE_s) ? { 	cqe_owner, 8'd0, cqe_is_send, cqe_opcode, cqe_wqe, cqe_byte_cnt, cqe_imm_etype_pkey_eec,
+assign cqe_data = (cur_state == GEN_CQE_s) ? { 	cqe_owner, cqe_ts_hi, cqe_is_send, cqe_opcode, cqe_wqe, cqe_byte_cnt, cqe_imm_etype_pkey_eec,
 												cqe_rlid, cqe_g_mlpath, cqe_sl_ipok, cqe_rqpn, cqe_my_ee, cqe_my_qpn} : 'd0;
 
 /********************************************** CQE Field Gen : End ********************************************************/
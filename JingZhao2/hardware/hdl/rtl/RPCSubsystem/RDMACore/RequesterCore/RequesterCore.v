@@ -189,7 +189,10 @@ module RequesterCore
     input   wire                                                            RX_RESP_delete_resp_start,
     input   wire                                                            RX_RESP_delete_resp_last,
     input   wire    [`RECV_BUFFER_SLOT_WIDTH - 1 : 0]                       RX_RESP_delete_resp_data,
-    output  wire                                                            RX_RESP_delete_resp_ready
+    output  wire                                                            RX_RESP_delete_resp_ready,
+
+//HCA clock, stamped into CQEs
+    input   wire    [63:0]                                                  hca_clock
 );
 
 /*------------------------------------------- Input/Output Definition : End -----------------------------------------*/
@@ -319,7 +322,9 @@ ReqTransCore_Inst
 
     .egress_pkt_valid                       (   TX_REQ_egress_pkt_valid            ),
     .egress_pkt_head                        (   TX_REQ_egress_pkt_head             ),
-    .egress_pkt_ready                       (   TX_REQ_egress_pkt_ready            )
+    .egress_pkt_ready                       (   TX_REQ_egress_pkt_ready            ),
+
+    .hca_clock                              (   hca_clock                          )
 );
 
 RespRecvCore
@@ -414,7 +419,9 @@ RespRecvCore_Inst
     .delete_resp_start                      (   RX_RESP_delete_resp_start           ),
     .delete_resp_last                       (   RX_RESP_delete_resp_last            ),
     .delete_resp_data                       (   RX_RESP_delete_resp_data            ),
-    .delete_resp_ready                      (   RX_RESP_delete_resp_ready           )
+    .delete_resp_ready                      (   RX_RESP_delete_resp_ready           ),
+
+    .hca_clock                              (   hca_clock                           )
 );
 
 DynamicMultiQueue #(
@@ -112,7 +112,10 @@ module RespRecvCore
     input   wire                                                        delete_resp_start,
     input   wire                                                        delete_resp_last,
     input   wire    [`RECV_BUFFER_SLOT_WIDTH - 1 : 0]                   delete_resp_data,
-    output  wire                                                        delete_resp_ready
+    output  wire                                                        delete_resp_ready,
+
+//HCA clock, stamped into CQEs
+    input   wire    [63:0]                                              hca_clock
 );
 /*------------------------------------------- Input/Output Definition : End -----------------------------------------*/
 
@@ -229,7 +232,9 @@ RespRecvCore_Thread_3_Inst
     .delete_resp_start              (       delete_resp_start           ),
     .delete_resp_last               (       delete_resp_last            ),
     .delete_resp_data               (       delete_resp_data            ),
-    .delete_resp_ready              (       delete_resp_ready           )
+    .delete_resp_ready              (       delete_resp_ready           ),
+
+    .hca_clock                      (       hca_clock                   )
 );
 /*------------------------------------------- Submodules Instatiation : End -----------------------------------------*/
 
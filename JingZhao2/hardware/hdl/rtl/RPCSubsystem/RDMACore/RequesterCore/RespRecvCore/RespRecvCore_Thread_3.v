@@ -50,7 +50,10 @@ module RespRecvCore_Thread_3
     input   wire                                                            delete_resp_start,
     input   wire                                                            delete_resp_last,
     input   wire    [`PACKET_BUFFER_SLOT_WIDTH - 1 : 0]                     delete_resp_data,
-    output  wire                                                            delete_resp_ready
+    output  wire                                                            delete_resp_ready,
+
+//HCA clock, stamped into CQEs
+    input   wire    [63:0]                                                  hca_clock
 );
 /*------------------------------------------- Input/Output Definition : End -----------------------------------------*/
 
@@ -92,6 +95,7 @@ wire                [63:0]                                          mr_resp_phy_
 wire 				[255:0]											cqe_data;
 reg 				[31:0]											cqe_my_qpn;
 reg 				[31:0]											cqe_my_ee;
+reg 				[7:0]											cqe_ts_hi;
 reg 				[31:0]											cqe_rqpn;
 reg 				[7:0]											cqe_sl_ipok;
 reg 				[7:0]											cqe_g_mlpath;
@@ -335,6 +339,7 @@ assign delete_resp_ready = (cur_state == DMA_PAYLOAD_DATA_s && !scatter_data_pro
 /********************************************** CQE Field Gen : Begin ******************************************************/
 //-- cqe_my_qpn --
 //-- cqe_my_ee --
+//-- cqe_ts_hi --  With cqe_my_ee, bits 39:0 of hca_clock when the CQE is generated
 //-- cqe_rqpn --
 //-- cqe_sl_ipok --
 //-- cqe_g_mlpath --
@@ -349,6 +354,7 @@ always @(posedge clk or posedge rst) begin
 	if(rst) begin
 		cqe_my_qpn <= 'd0;
 		cqe_my_ee <= 'd0;
+		cqe_ts_hi <= 'd0;
 		cqe_rqpn <= 'd0;
 		cqe_sl_ipok <= 'd0;
 		cqe_g_mlpath <= 'd0;
@@ -362,7 +368,8 @@ always @(posedge clk or posedge rst) begin
 	end
 	else if(cur_state == JUDGE_s && next_state == DMA_CQE_s) begin
 		cqe_my_qpn <= meta_local_qpn;
-		cqe_my_ee <= 'd0;
+		cqe_my_ee <= hca_clock[31:0];
+		cqe_ts_hi <= hca_clock[39:32];
 		cqe_rqpn <= meta_remote_qpn;
 		cqe_sl_ipok <= 'd0;
 		cqe_g_mlpath <= 'd0;
@@ -377,6 +384,7 @@ always @(posedge clk or posedge rst) begin
 	else begin
 		cqe_my_qpn <= cqe_my_qpn;
 		cqe_my_ee <= cqe_my_ee;
+		cqe_ts_hi <= cqe_ts_hi;
 		cqe_rqpn <= cqe_rqpn;
 		cqe_sl_ipok <= cqe_sl_ipok;
 		cqe_g_mlpath <= cqe_g_mlpath;
@@ -391,7 +399,7 @@ always @(posedge clk or posedge rst) begin
 end
 
 //-- cqe_data --
-assign cqe_data = (cur_state == DMA_CQE_s) ? { 	cqe_owner, 8'd0, cqe_is_send, cqe_opcode, cqe_wqe, cqe_byte_cnt, cqe_imm_etype_pkey_eec,
+assign cqe_data = (cur_state == DMA_CQE_s) ? { 	cqe_owner, cqe_ts_hi, cqe_is_send, cqe_opcode, cqe_wqe, cqe_byte_cnt, cqe_imm_etype_pkey_eec,
 												cqe_rlid, cqe_g_mlpath, cqe_sl_ipok, cqe_rqpn, cqe_my_ee, cqe_my_qpn} : 'd0;
 /********************************************** CQE Field Gen : End ********************************************************/
 
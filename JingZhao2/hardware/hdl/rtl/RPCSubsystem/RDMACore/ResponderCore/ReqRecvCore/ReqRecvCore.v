@@ -141,7 +141,10 @@ module ReqRecvCore
 //Interface with RespTransCore
     output  wire                                                            net_resp_wen,
     output  wire    [`NET_REQ_META_WIDTH - 1 : 0]                           net_resp_din,
-    input   wire                                                            net_resp_prog_full
+    input   wire                                                            net_resp_prog_full,
+
+//HCA clock, stamped into CQEs
+    input   wire    [63:0]                                                  hca_clock
 );
 /*------------------------------------------- Input/Output Definition : End -----------------------------------------*/
 
@@ -285,7 +288,9 @@ ReqRecvCore_Thread_3_Inst
     
     .net_resp_wen                           (       net_resp_wen                    ),
     .net_resp_din                           (       net_resp_din                    ),
-    .net_resp_prog_full                     (       net_resp_prog_full              )
+    .net_resp_prog_full                     (       net_resp_prog_full              ),
+
+    .hca_clock                              (       hca_clock                       )
 );
 /*------------------------------------------- Submodules Instatiation : End -----------------------------------------*/
 
@@ -59,7 +59,10 @@ module ReqRecvCore_Thread_3
 //Interface with RespTransCore
     output  reg                                                             net_resp_wen,
     output  reg    [`NET_REQ_META_WIDTH - 1 : 0]                            net_resp_din,
-    input   wire                                                            net_resp_prog_full
+    input   wire                                                            net_resp_prog_full,
+
+//HCA clock, stamped into CQEs
+    input   wire    [63:0]                                                  hca_clock
 );
 /*------------------------------------------- Input/Output Definition : End -----------------------------------------*/
 
@@ -151,6 +154,7 @@ wire                [`MCB_SLOT_WIDTH - 1 : 0]                       mcb_dequeue_
 wire                [255:0]                                         cqe_data;
 reg                 [31:0]                                          cqe_my_qpn;
 reg                 [31:0]                                          cqe_my_ee;
+reg                 [7:0]                                          cqe_ts_hi;
 reg                 [31:0]                                          cqe_rqpn;
 reg                 [7:0]                                           cqe_sl_ipok;
 reg                 [7:0]                                           cqe_g_mlpath;
@@ -657,6 +661,7 @@ end
 
 //-- cqe_my_qpn --
 //-- cqe_my_ee --
+//-- cqe_ts_hi --  With cqe_my_ee, bits 39:0 of hca_clock when the CQE is generated
 //-- cqe_rqpn --
 //-- cqe_sl_ipok --
 //-- cqe_g_mlpath --
@@ -671,6 +676,7 @@ always @(posedge clk or posedge rst) begin
     if (rst) begin
         cqe_my_qpn <= 'd0;
         cqe_my_ee <= 'd0;
+        cqe_ts_hi <= 'd0;
         cqe_rqpn <= 'd0;
         cqe_sl_ipok <= 'd0;
         cqe_g_mlpath <= 'd0;
@@ -684,7 +690,8 @@ always @(posedge clk or posedge rst) begin
     end
     else if (cur_state == JUDGE_s && PktHeader_net_opcode == `GEN_CQE) begin
         cqe_my_qpn <= PktHeader_local_qpn;
-        cqe_my_ee <= 'd0;
+        cqe_my_ee <= hca_clock[31:0];
+        cqe_ts_hi <= hca_clock[39:32];
         cqe_rqpn <= PktHeader_remote_qpn;
         cqe_sl_ipok <= 'd0;
         cqe_g_mlpath <= 'd0;
@@ -699,6 +706,7 @@ always @(posedge clk or posedge rst) begin
     else begin
         cqe_my_qpn <= cqe_my_qpn;
         cqe_my_ee <= cqe_my_ee;
+        cqe_ts_hi <= cqe_ts_hi;
         cqe_rqpn <= cqe_rqpn;
         cqe_sl_ipok <= cqe_sl_ipok;
         cqe_g_mlpath <= cqe_g_mlpath;
@@ -713,7 +721,7 @@ always @(posedge clk or posedge rst) begin
 end
 
 //-- cqe_data --
-assign cqe_data = (cur_state == DMA_CQE_s) ? {  cqe_owner, 8'd0, cqe_is_send, cqe_opcode, cqe_wqe, cqe_byte_cnt, cqe_imm_etype_pkey_eec,
+assign cqe_data = (cur_state == DMA_CQE_s) ? {  cqe_owner, cqe_ts_hi, cqe_is_send, cqe_opcode, cqe_wqe, cqe_byte_cnt, cqe_imm_etype_pkey_eec,
                                                 cqe_rlid, cqe_g_mlpath, cqe_sl_ipok, cqe_rqpn, cqe_my_ee, cqe_my_qpn} : 'd0;
 
 //-- byte_cnt_buffer_wea --
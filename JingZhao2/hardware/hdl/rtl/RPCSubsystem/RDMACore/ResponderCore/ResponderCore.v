@@ -157,7 +157,10 @@ module ResponderCore
 //Interface with TransportSubsystem
     output  wire                                                            TX_RESP_egress_pkt_valid,
     output  wire    [`PKT_META_BUS_WIDTH - 1 : 0]                           TX_RESP_egress_pkt_head,
-    input   wire                                                            TX_RESP_egress_pkt_ready
+    input   wire                                                            TX_RESP_egress_pkt_ready,
+
+//HCA clock, stamped into CQEs
+    input   wire    [63:0]                                                  hca_clock
 );
 /*------------------------------------------- Input/Output Definition : End -----------------------------------------*/
 
@@ -291,7 +294,9 @@ ReqRecvCore_Inst
     
     .net_resp_wen                       (       TX_RESP_net_resp_wen                ),
     .net_resp_din                       (       TX_RESP_net_resp_din                ),
-    .net_resp_prog_full                 (       TX_RESP_net_resp_prog_full          )
+    .net_resp_prog_full                 (       TX_RESP_net_resp_prog_full          ),
+
+    .hca_clock                          (       hca_clock                           )
 );
 
 RespTransCore RespTransCore_Inst(
@@ -283,7 +283,10 @@ module RPCSubsystem
     input   wire                                                            RX_delete_resp_start,
     input   wire                                                            RX_delete_resp_last,
     input   wire    [`PACKET_BUFFER_SLOT_WIDTH - 1 : 0]                       RX_delete_resp_data,
-    output  wire                                                            RX_delete_resp_ready
+    output  wire                                                            RX_delete_resp_ready,
+
+//HCA clock, stamped into CQEs
+    input   wire    [63:0]                                                  hca_clock
 
 );
 
@@ -532,7 +535,9 @@ RDMACore RDMACore_Inst(
     .RX_delete_resp_start               (           RX_delete_resp_start                ),
     .RX_delete_resp_last                (           RX_delete_resp_last                 ),
     .RX_delete_resp_data                (           RX_delete_resp_data                 ),
-    .RX_delete_resp_ready               (           RX_delete_resp_ready                )
+    .RX_delete_resp_ready               (           RX_delete_resp_ready                ),
+
+    .hca_clock                          (           hca_clock                           )
 );
 /*------------------------------------------- Submodules Instatiation : End -----------------------------------------*/
 
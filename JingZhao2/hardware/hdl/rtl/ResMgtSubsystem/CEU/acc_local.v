@@ -94,8 +94,8 @@ always @(posedge clk or negedge rst_n) begin
             8'd0, `MAX_SG, `MAX_DESC_SZ,
             8'd0, `MAX_SG_RQ, `MAX_DESC_SZ_RQ,
             `MAX_ICM_SZ,
-            32'd0,
-            32'd0
+            `DEV_CAP_FLAGS,
+            `HCA_CLOCK_KHZ
         };
         adapter_info    <= `TD {
             32'd0, 
@@ -266,8 +266,8 @@ assign init_dev_lim_info_w1 = {
     8'd0, `MAX_SG, `MAX_DESC_SZ,
     8'd0, `MAX_SG_RQ, `MAX_DESC_SZ_RQ,
     `MAX_ICM_SZ,
-    32'd0,
-    32'd0
+    `DEV_CAP_FLAGS,
+    `HCA_CLOCK_KHZ
 };
 assign init_adapter_info_w = {
     32'd0, 
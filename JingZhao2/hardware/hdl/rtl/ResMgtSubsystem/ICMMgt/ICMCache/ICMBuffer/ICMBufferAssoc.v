@@ -0,0 +1,270 @@
+/*------------------------------------------- Module Description : Begin ----------------------------------------------
+Name:       ICMBufferAssoc
+Author:     YangFan
+Function:   CACHE_WAY_NUM-Way-Associate Cache Buffer, provide generalized Get/Set/Del Interface.
+            Replacement follows CACHE_REPLACE_POLICY, see ICMBufferAssoc_Replace. Same ports as ICMBuffer,
+            ICMCache uses it instead of ICMBuffer when ICM_BUFFER_ASSOC is defined. Not yet simulated.
+--------------------------------------------- Module Decription : End -----------------------------------------------*/
+
+/*------------------------------------------- Timescale Definition : Begin ------------------------------------------*/
+`timescale 1ns / 1ps
+/*------------------------------------------- Timescale Definition : End --------------------------------------------*/
+
+/*------------------------------------------- Included Files : Begin ------------------------------------------------*/
+`include "protocol_engine_def.vh"
+/*------------------------------------------- Included Files : End --------------------------------------------------*/ 
+
+/*------------------------------------------- Input/Output Definition : Begin ---------------------------------------*/
+module ICMBufferAssoc
+#(
+    parameter               ICM_CACHE_TYPE          =       `CACHE_TYPE_MTT,
+    parameter               ICM_PAGE_NUM            =       `ICM_PAGE_NUM_MTT,
+    parameter               ICM_PAGE_NUM_LOG        =       log2b(ICM_PAGE_NUM - 1),
+    parameter               ICM_ENTRY_NUM           =       `ICM_ENTRY_NUM_MTT,
+    parameter               ICM_ENTRY_NUM_LOG       =       log2b(ICM_ENTRY_NUM - 1),
+    parameter               ICM_SLOT_SIZE           =       `ICM_SLOT_SIZE_MTT,
+    parameter               ICM_ADDR_WIDTH          =       64,
+
+    parameter               CACHE_ADDR_WIDTH        =       log2b(ICM_ENTRY_NUM * ICM_SLOT_SIZE),
+    parameter               CACHE_ENTRY_WIDTH       =       256,
+    parameter               CACHE_SET_NUM           =       1024,
+    parameter               CACHE_SET_NUM_LOG       =       log2b(CACHE_SET_NUM - 1),
+    parameter               CACHE_OFFSET_WIDTH      =       log2b(ICM_SLOT_SIZE - 1),
+    parameter               CACHE_TAG_WIDTH         =       CACHE_ADDR_WIDTH - CACHE_OFFSET_WIDTH - CACHE_SET_NUM_LOG,
+    parameter               CACHE_WAY_NUM           =       `CACHE_WAY_NUM,
+    parameter               CACHE_WAY_NUM_LOG       =       log2b(CACHE_WAY_NUM - 1),
+    parameter               CACHE_REPLACE_POLICY    =       `CACHE_REPLACE_POLICY,
+    parameter               REPLACE_STATE_WIDTH     =       (CACHE_REPLACE_POLICY == `CACHE_REPLACE_RRIP) ? CACHE_WAY_NUM * 2 :
+                                                            (CACHE_WAY_NUM > 1) ? CACHE_WAY_NUM - 1 : 1,
+    parameter               PHYSICAL_ADDR_WIDTH     =       `PHY_SPACE_ADDR_WIDTH,
+    parameter               COUNT_MAX               =       2,
+    parameter               COUNT_MAX_LOG           =       log2b(COUNT_MAX - 1) + 1,
+    parameter               REQ_TAG_NUM             =       32,
+    parameter               REQ_TAG_NUM_LOG         =       log2b(REQ_TAG_NUM - 1),
+    parameter               REORDER_BUFFER_WIDTH    =       (ICM_CACHE_TYPE == `CACHE_TYPE_MTT) ? CACHE_ENTRY_WIDTH * 2 + COUNT_MAX_LOG : CACHE_ENTRY_WIDTH + COUNT_MAX_LOG 
+)
+(
+    input   wire                                                                                                clk,
+    input   wire                                                                                                rst,
+
+//Cache Get Req Interface
+    input   wire                                                                                                get_req_valid,
+    input   wire    [COUNT_MAX_LOG * 2 + `MAX_REQ_TAG_NUM_LOG + PHYSICAL_ADDR_WIDTH + ICM_ADDR_WIDTH - 1 : 0]        get_req_head,
+    output  wire                                                                                                get_req_ready,
+
+//Cache Get Resp Interface
+    output  wire                                                                                                get_rsp_valid,
+    output  wire    [COUNT_MAX_LOG * 2 + `MAX_REQ_TAG_NUM_LOG + PHYSICAL_ADDR_WIDTH + ICM_ADDR_WIDTH + 1 - 1 : 0]    get_rsp_head,
+    output  wire    [CACHE_ENTRY_WIDTH - 1 : 0]                                                                 get_rsp_data,
+    input   wire                                                                                                get_rsp_ready,
+
+//Cache Set Req Interface
+    input   wire                                                                                                set_req_valid,
+    input   wire    [CACHE_ADDR_WIDTH - 1 : 0]                                                                  set_req_head,
+    input   wire    [CACHE_ENTRY_WIDTH - 1 : 0]                                                                 set_req_data,
+    output  wire                                                                                                set_req_ready,
+
+//Cache Del Req Interface
+    input   wire                                                                                                del_req_valid,
+    input   wire    [CACHE_ADDR_WIDTH - 1 : 0]                                                                  del_req_head,
+    output  wire                                                                                                del_req_ready
+);
+/*------------------------------------------- Input/Output Definition : End -----------------------------------------*/
+
+/*------------------------------------------- Local Macros Definition : Begin ---------------------------------------*/
+/*------------------------------------------- Local Macros Definition : End -----------------------------------------*/
+
+/*------------------------------------------- Local Variables Definition : Begin ------------------------------------*/
+wire        [CACHE_WAY_NUM - 1 : 0]                                                         way_get_wen;
+wire        [CACHE_SET_NUM_LOG - 1 : 0]                                                     way_get_addr;
+wire        [CACHE_ENTRY_WIDTH + CACHE_TAG_WIDTH + 1 - 1 : 0]                               way_get_din;
+wire        [CACHE_WAY_NUM * (CACHE_ENTRY_WIDTH + CACHE_TAG_WIDTH + 1) - 1 : 0]             way_get_dout;
+
+wire        [CACHE_WAY_NUM - 1 : 0]                                                         way_set_del_wen;
+wire        [CACHE_SET_NUM_LOG - 1 : 0]                                                     way_set_del_addr;
+wire        [CACHE_ENTRY_WIDTH + CACHE_TAG_WIDTH + 1 - 1 : 0]                               way_set_del_din;
+wire        [CACHE_WAY_NUM * (CACHE_ENTRY_WIDTH + CACHE_TAG_WIDTH + 1) - 1 : 0]             way_set_del_dout;
+
+wire        [0:0]                                       replace_get_wen;
+wire        [CACHE_SET_NUM_LOG - 1 : 0]                 replace_get_addr;
+wire        [REPLACE_STATE_WIDTH - 1 : 0]               replace_get_din;
+wire        [REPLACE_STATE_WIDTH - 1 : 0]               replace_get_dout;
+
+wire        [0:0]                                       replace_set_del_wen;
+wire        [CACHE_SET_NUM_LOG - 1 : 0]                 replace_set_del_addr;
+wire        [REPLACE_STATE_WIDTH - 1 : 0]               replace_set_del_din;
+wire        [REPLACE_STATE_WIDTH - 1 : 0]               replace_set_del_dout;
+
+/*------------------------------------------- Local Variables Definition : End --------------------------------------*/
+
+/*------------------------------------------- Submodules Instatiation : Begin ---------------------------------------*/
+genvar i;
+generate
+    for(i = 0; i < CACHE_WAY_NUM; i = i + 1) begin : GEN_CACHE_WAY
+        SRAM_TDP_Template #(
+            .RAM_WIDTH      (   CACHE_ENTRY_WIDTH + CACHE_TAG_WIDTH + 1 ),
+            .RAM_DEPTH      (   CACHE_SET_NUM                           )
+        )
+        Cache_Way
+        (
+            .clk            (   clk                                     ),
+            .rst            (   rst                                     ),
+
+            .wea            (   way_get_wen[i]                          ),
+            .addra          (   way_get_addr                            ),
+            .dina           (   way_get_din                             ),
+            .douta          (   way_get_dout[i * (CACHE_ENTRY_WIDTH + CACHE_TAG_WIDTH + 1) +: CACHE_ENTRY_WIDTH + CACHE_TAG_WIDTH + 1]    ),
+
+            .web            (   way_set_del_wen[i]                      ),
+            .addrb          (   way_set_del_addr                        ),
+            .dinb           (   way_set_del_din                         ),
+            .doutb          (   way_set_del_dout[i * (CACHE_ENTRY_WIDTH + CACHE_TAG_WIDTH + 1) +: CACHE_ENTRY_WIDTH + CACHE_TAG_WIDTH + 1]    )
+        );
+    end
+endgenerate
+
+SRAM_TDP_Template #(
+    .RAM_WIDTH      (   REPLACE_STATE_WIDTH                     ),
+    .RAM_DEPTH      (   CACHE_SET_NUM                           )
+)
+Replace_Table
+(
+    .clk            (   clk                                     ),
+    .rst            (   rst                                     ),
+
+    .wea            (   replace_get_wen                         ),
+    .addra          (   replace_get_addr                        ),
+    .dina           (   replace_get_din                         ),
+    .douta          (   replace_get_dout                        ),
+
+    .web            (   replace_set_del_wen                     ),
+    .addrb          (   replace_set_del_addr                    ),
+    .dinb           (   replace_set_del_din                     ),
+    .doutb          (   replace_set_del_dout                    )
+);
+
+ICMBufferAssoc_Get_Thread
+#(
+    .ICM_CACHE_TYPE          (  ICM_CACHE_TYPE          ),
+    .CACHE_ADDR_WIDTH        (  CACHE_ADDR_WIDTH        ),
+    .CACHE_ENTRY_WIDTH       (  CACHE_ENTRY_WIDTH       ),
+    .CACHE_OFFSET_WIDTH      (  CACHE_OFFSET_WIDTH      ),
+    .CACHE_TAG_WIDTH         (  CACHE_TAG_WIDTH         ),
+    .CACHE_WAY_NUM           (  CACHE_WAY_NUM           ),
+    .CACHE_WAY_NUM_LOG       (  CACHE_WAY_NUM_LOG       ),
+    .CACHE_REPLACE_POLICY    (  CACHE_REPLACE_POLICY    ),
+    .REPLACE_STATE_WIDTH     (  REPLACE_STATE_WIDTH     ),
+    .CACHE_SET_NUM           (  CACHE_SET_NUM           ),
+    .CACHE_SET_NUM_LOG       (  CACHE_SET_NUM_LOG       ),
+    .PHYSICAL_ADDR_WIDTH     (  PHYSICAL_ADDR_WIDTH     ),
+    .COUNT_MAX               (  COUNT_MAX               ),
+    .COUNT_MAX_LOG           (  COUNT_MAX_LOG           ),
+    .REQ_TAG_NUM             (  REQ_TAG_NUM             ),
+    .REQ_TAG_NUM_LOG         (  REQ_TAG_NUM_LOG         )
+)
+ICMBufferAssoc_Get_Thread_Inst
+(
+    .clk                (   clk                 ),
+    .rst                (   rst                 ),
+
+    .get_req_valid      (   get_req_valid       ),
+    .get_req_head       (   get_req_head        ),
+    .get_req_ready      (   get_req_ready       ),
+
+    .get_rsp_valid      (   get_rsp_valid       ),
+    .get_rsp_head       (   get_rsp_head        ),
+    .get_rsp_data       (   get_rsp_data        ),
+    .get_rsp_ready      (   get_rsp_ready       ),
+
+    .way_wen            (   way_get_wen         ),
+    .way_addr           (   way_get_addr        ),
+    .way_din            (   way_get_din         ),
+    .way_dout           (   way_get_dout        ),
+
+    .replace_wen        (   replace_get_wen     ),
+    .replace_addr       (   replace_get_addr    ),
+    .replace_din        (   replace_get_din     ),
+    .replace_dout       (   replace_get_dout    )
+);
+
+ICMBufferAssoc_Set_Del_Thread
+#(
+    .ICM_CACHE_TYPE          (  ICM_CACHE_TYPE          ),
+    .CACHE_ADDR_WIDTH        (  CACHE_ADDR_WIDTH        ),
+    .CACHE_ENTRY_WIDTH       (  CACHE_ENTRY_WIDTH       ),
+    .CACHE_OFFSET_WIDTH      (  CACHE_OFFSET_WIDTH      ),
+    .CACHE_TAG_WIDTH         (  CACHE_TAG_WIDTH         ),
+    .CACHE_WAY_NUM           (  CACHE_WAY_NUM           ),
+    .CACHE_WAY_NUM_LOG       (  CACHE_WAY_NUM_LOG       ),
+    .CACHE_REPLACE_POLICY    (  CACHE_REPLACE_POLICY    ),
+    .REPLACE_STATE_WIDTH     (  REPLACE_STATE_WIDTH     ),
+    .CACHE_SET_NUM           (  CACHE_SET_NUM           ),
+    .CACHE_SET_NUM_LOG       (  CACHE_SET_NUM_LOG       ),
+    .PHYSICAL_ADDR_WIDTH     (  PHYSICAL_ADDR_WIDTH     ),
+    .COUNT_MAX               (  COUNT_MAX               ),
+    .COUNT_MAX_LOG           (  COUNT_MAX_LOG           ),
+    .REQ_TAG_NUM             (  REQ_TAG_NUM             ),
+    .REQ_TAG_NUM_LOG         (  REQ_TAG_NUM_LOG         )
+)
+ICMBufferAssoc_Set_Del_Thread_Inst
+(
+    .clk                (   clk                 ),
+    .rst                (   rst                 ),
+
+    .set_req_valid      (   set_req_valid       ),
+    .set_req_head       (   set_req_head        ),
+    .set_req_data       (   set_req_data        ),
+    .set_req_ready      (   set_req_ready       ),
+
+    .del_req_valid      (   del_req_valid       ),
+    .del_req_head       (   del_req_head        ),
+    .del_req_ready      (   del_req_ready       ),
+
+    .way_wen            (   way_set_del_wen     ),
+    .way_addr           (   way_set_del_addr    ),
+    .way_din            (   way_set_del_din     ),
+    .way_dout           (   way_set_del_dout    ),
+
+    .replace_wen        (   replace_set_del_wen ),
+    .replace_addr       (   replace_set_del_addr ),
+    .replace_din        (   replace_set_del_din ),
+    .replace_dout       (   replace_set_del_dout )
+);
+/*------------------------------------------- Submodules Instatiation : End -----------------------------------------*/
+
+/*------------------------------------------- State Machine Definition : Begin --------------------------------------*/
+/*------------------------------------------- State Machine Definition : End ----------------------------------------*/
+
+/*------------------------------------------- Variables Decode : Begin ----------------------------------------------*/
+/*------------------------------------------- Variables Decode : Begin ----------------------------------------------*/
+
+`ifdef  ILA_ON
+
+    generate    
+
+        if(ICM_CACHE_TYPE == `CACHE_TYPE_QPC) begin
+            ila_icm_buffer ila_icm_buffer_inst(
+                .clk(clk),
+
+                .probe0(get_req_valid),
+                .probe1(get_req_head),
+                .probe2(get_req_ready),
+
+                .probe3(get_rsp_valid),
+                .probe4(get_rsp_head),
+                .probe5(get_rsp_data),
+                .probe6(get_rsp_ready),
+
+                .probe7(set_req_valid),
+                .probe8(set_req_head),
+                .probe9(set_req_data),
+                .probe10(set_req_ready)
+            );
+    end
+    endgenerate
+`endif
+
+/*------------------------------------------- Local Macros Undef : Begin --------------------------------------------*/
+/*------------------------------------------- Local Macros Undef : End ----------------------------------------------*/
+
+endmodule
\ No newline at end of file
@@ -0,0 +1,131 @@
+/*------------------------------------------- Module Description : Begin ----------------------------------------------
+Name:       ICMBufferAssoc_Replace
+Function:   Replacement state update for one ICMBuffer set. Purely combinational: takes the state read from
+            Replace_Table and returns the state after a hit on hit_way, the way a fill should evict, and the
+            state after that fill.
+            CACHE_REPLACE_PLRU : Tree pseudo-LRU, CACHE_WAY_NUM - 1 node bits. A node bit records the half that
+                                 was used last, the victim walk takes the other half at every level. With two
+                                 ways this is the single MRU bit the 2-way buffer always kept, i.e. true LRU.
+            CACHE_REPLACE_RRIP : Static RRIP, a 2-bit re-reference prediction value per way. A hit sets the way
+                                 to 0, a fill evicts the first way with the largest value, ages the set so that
+                                 value reaches 3 and inserts the new entry at 2.
+--------------------------------------------- Module Decription : End -----------------------------------------------*/
+
+/*------------------------------------------- Timescale Definition : Begin ------------------------------------------*/
+`timescale 1ns / 1ps
+/*------------------------------------------- Timescale Definition : End --------------------------------------------*/
+
+/*------------------------------------------- Included Files : Begin ------------------------------------------------*/
+`include "protocol_engine_def.vh"
+/*------------------------------------------- Included Files : End --------------------------------------------------*/
+
+/*------------------------------------------- Input/Output Definition : Begin ---------------------------------------*/
+module ICMBufferAssoc_Replace
+#(
+    parameter               CACHE_WAY_NUM           =       2,
+    parameter               CACHE_WAY_NUM_LOG       =       log2b(CACHE_WAY_NUM - 1),
+    parameter               CACHE_REPLACE_POLICY    =       `CACHE_REPLACE_PLRU,
+    parameter               REPLACE_STATE_WIDTH     =       (CACHE_REPLACE_POLICY == `CACHE_REPLACE_RRIP) ? CACHE_WAY_NUM * 2 :
+                                                            (CACHE_WAY_NUM > 1) ? CACHE_WAY_NUM - 1 : 1
+)
+(
+    input   wire    [REPLACE_STATE_WIDTH - 1 : 0]                                                               replace_state,
+
+//Update on hit
+    input   wire    [CACHE_WAY_NUM_LOG - 1 : 0]                                                                 hit_way,
+    output  reg     [REPLACE_STATE_WIDTH - 1 : 0]                                                               hit_state,
+
+//Victim selection and update on fill
+    output  reg     [CACHE_WAY_NUM_LOG - 1 : 0]                                                                 victim_way,
+    output  reg     [REPLACE_STATE_WIDTH - 1 : 0]                                                               fill_state
+);
+/*------------------------------------------- Input/Output Definition : End -----------------------------------------*/
+
+/*------------------------------------------- Local Macros Definition : Begin ---------------------------------------*/
+`define     RRPV_DISTANT        2'd3
+`define     RRPV_LONG           2'd2
+`define     RRPV_NEAR           2'd0
+/*------------------------------------------- Local Macros Definition : End -----------------------------------------*/
+
+/*------------------------------------------- Local Variables Definition : Begin ------------------------------------*/
+localparam                  PLRU_LEVEL_NUM          =       (CACHE_WAY_NUM > 1) ? CACHE_WAY_NUM_LOG : 0;
+/*------------------------------------------- Local Variables Definition : End --------------------------------------*/
+
+/*------------------------------------------- Variables Decode : Begin ----------------------------------------------*/
+generate
+    if(CACHE_REPLACE_POLICY == `CACHE_REPLACE_RRIP) begin : GEN_RRIP
+        reg         [1:0]                               rrpv_max;
+        integer                                         max_way;
+        integer                                         victim_search_way;
+        integer                                         age_way;
+
+        //-- hit_state --
+        always @(*) begin
+            hit_state = replace_state;
+            hit_state[hit_way * 2 +: 2] = `RRPV_NEAR;
+        end
+
+        //-- rrpv_max --
+        always @(*) begin
+            rrpv_max = `RRPV_NEAR;
+            for(max_way = 0; max_way < CACHE_WAY_NUM; max_way = max_way + 1) begin
+                if(replace_state[max_way * 2 +: 2] > rrpv_max) begin
+                    rrpv_max = replace_state[max_way * 2 +: 2];
+                end
+            end
+        end
+
+        //-- victim_way --
+        //-- fill_state --
+        always @(*) begin
+            victim_way = 'd0;
+            for(victim_search_way = CACHE_WAY_NUM - 1; victim_search_way >= 0; victim_search_way = victim_search_way - 1) begin
+                if(replace_state[victim_search_way * 2 +: 2] == rrpv_max) begin
+                    victim_way = victim_search_way;
+                end
+            end
+
+            for(age_way = 0; age_way < CACHE_WAY_NUM; age_way = age_way + 1) begin
+                fill_state[age_way * 2 +: 2] = replace_state[age_way * 2 +: 2] + (`RRPV_DISTANT - rrpv_max);
+            end
+            fill_state[victim_way * 2 +: 2] = `RRPV_LONG;
+        end
+    end
+    else begin : GEN_PLRU
+        integer                                         hit_level;
+        integer                                         hit_node;
+        integer                                         fill_level;
+        integer                                         fill_node;
+
+        //-- hit_state -- Point every node on the path to hit_way
+        always @(*) begin
+            hit_state = replace_state;
+            hit_node = 1;
+            for(hit_level = 0; hit_level < PLRU_LEVEL_NUM; hit_level = hit_level + 1) begin
+                hit_state[hit_node - 1] = hit_way[CACHE_WAY_NUM_LOG - 1 - hit_level];
+                hit_node = hit_node * 2 + hit_way[CACHE_WAY_NUM_LOG - 1 - hit_level];
+            end
+        end
+
+        //-- victim_way -- Walk away from the last used half
+        //-- fill_state -- The filled way becomes the last used, so every node on the walk flips
+        always @(*) begin
+            fill_state = replace_state;
+            fill_node = 1;
+            for(fill_level = 0; fill_level < PLRU_LEVEL_NUM; fill_level = fill_level + 1) begin
+                fill_state[fill_node - 1] = !replace_state[fill_node - 1];
+                fill_node = fill_node * 2 + !replace_state[fill_node - 1];
+            end
+            victim_way = fill_node - (1 << PLRU_LEVEL_NUM);
+        end
+    end
+endgenerate
+/*------------------------------------------- Variables Decode : End ------------------------------------------------*/
+
+/*------------------------------------------- Local Macros Undef : Begin --------------------------------------------*/
+`undef              RRPV_DISTANT
+`undef              RRPV_LONG
+`undef              RRPV_NEAR
+/*------------------------------------------- Local Macros Undef : End ----------------------------------------------*/
+
+endmodule
\ No newline at end of file
@@ -1,3 +1,7 @@
 ./ICMBuffer.v
 ./ICMBuffer_Get_Thread.v
 ./ICMBuffer_Set_Del_Thread.v
+./ICMBufferAssoc.v
+./ICMBufferAssoc_Get_Thread.v
+./ICMBufferAssoc_Set_Del_Thread.v
+./ICMBufferAssoc_Replace.v
@@ -29,6 +29,8 @@ module ICMCache
     parameter               CACHE_SET_NUM_LOG       =       log2b(CACHE_SET_NUM - 1),
     parameter               CACHE_OFFSET_WIDTH      =       log2b(ICM_SLOT_SIZE - 1),
     parameter               CACHE_TAG_WIDTH         =       CACHE_ADDR_WIDTH - CACHE_OFFSET_WIDTH - CACHE_SET_NUM_LOG,
+    parameter               CACHE_WAY_NUM           =       `CACHE_WAY_NUM,
+    parameter               CACHE_REPLACE_POLICY    =       `CACHE_REPLACE_POLICY,
     parameter               PHYSICAL_ADDR_WIDTH     =       `PHY_SPACE_ADDR_WIDTH,
     parameter               COUNT_MAX               =       2,
     parameter               COUNT_MAX_LOG           =       log2b(COUNT_MAX - 1) + 1,
@@ -254,6 +256,32 @@ ICMSetDelProc_Inst
     .dma_wr_req_ready       (   dma_wr_req_ready       )
 );
 
+`ifdef ICM_BUFFER_ASSOC
+ICMBufferAssoc
+#(
+    .ICM_CACHE_TYPE          (  ICM_CACHE_TYPE          ),
+    .ICM_PAGE_NUM            (  ICM_PAGE_NUM            ),
+    .ICM_PAGE_NUM_LOG        (  ICM_PAGE_NUM_LOG        ),
+    .ICM_ENTRY_NUM           (  ICM_ENTRY_NUM           ),
+    .ICM_ENTRY_NUM_LOG       (  ICM_ENTRY_NUM_LOG       ),
+    .ICM_SLOT_SIZE           (  ICM_SLOT_SIZE           ),
+    .ICM_ADDR_WIDTH          (  ICM_ADDR_WIDTH          ),
+
+    .CACHE_ADDR_WIDTH        (   CACHE_ADDR_WIDTH        ),
+    .CACHE_ENTRY_WIDTH       (   CACHE_ENTRY_WIDTH       ),
+    .CACHE_SET_NUM           (   CACHE_SET_NUM           ),
+    .CACHE_SET_NUM_LOG       (   CACHE_SET_NUM_LOG       ),
+    .CACHE_OFFSET_WIDTH      (   CACHE_OFFSET_WIDTH      ),
+    .CACHE_TAG_WIDTH         (   CACHE_TAG_WIDTH         ),
+    .CACHE_WAY_NUM           (   CACHE_WAY_NUM           ),
+    .CACHE_REPLACE_POLICY    (   CACHE_REPLACE_POLICY    ),
+    .PHYSICAL_ADDR_WIDTH     (   PHYSICAL_ADDR_WIDTH     ),
+    .COUNT_MAX               (   COUNT_MAX               ),
+    .COUNT_MAX_LOG           (   COUNT_MAX_LOG           ),
+    .REQ_TAG_NUM             (   REQ_TAG_NUM             ),
+    .REQ_TAG_NUM_LOG         (   REQ_TAG_NUM_LOG         )
+)
+`else
 ICMBuffer
 #(
     .ICM_CACHE_TYPE          (  ICM_CACHE_TYPE          ),
@@ -276,6 +304,7 @@ ICMBuffer
     .REQ_TAG_NUM             (   REQ_TAG_NUM             ),
     .REQ_TAG_NUM_LOG         (   REQ_TAG_NUM_LOG         )
 )
+`endif
 ICMBuffer_Inst
 (
     .clk                      (   clk                     ),
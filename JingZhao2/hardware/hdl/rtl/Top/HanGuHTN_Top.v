@@ -117,6 +117,8 @@ wire    [63:0]                                          ceu_hcr_out_param;
 wire    [7:0]                                           ceu_hcr_status;
 wire                                                    ceu_hcr_clear;
 
+wire    [63:0]                                          hca_clock;
+
 wire                                                    CEU_dma_rd_req_valid;
 wire                                                    CEU_dma_rd_req_last;
 wire    [`DMA_HEAD_WIDTH - 1 : 0]                       CEU_dma_rd_req_head;
@@ -648,7 +650,9 @@ ProtocolEngine_Top ProtocolEngine_Top_Inst(
     .mac_rx_last                        (           mac_rx_last                        ),
     .mac_rx_keep                        (           mac_rx_keep                        ),
     .mac_rx_user                        (           mac_rx_user                        ),
-    .mac_rx_data                        (           mac_rx_data                        )
+    .mac_rx_data                        (           mac_rx_data                        ),
+
+    .hca_clock                          (           hca_clock                          )
 );
 
 PCIe_Interface PCIe_Interface_Inst(
@@ -714,6 +718,8 @@ PCIe_Interface PCIe_Interface_Inst(
 
     .cmd_rst                            (                                               ),
 
+    .hca_clock                          (           hca_clock                               ),
+
     .pio_uar_db_valid                   (           db_fifo_wen                         ),
     .pio_uar_db_data                    (           db_fifo_din                         ),
     .pio_uar_db_ready                   (           !db_fifo_prog_full                  ),
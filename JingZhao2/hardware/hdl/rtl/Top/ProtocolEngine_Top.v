@@ -247,7 +247,10 @@ module ProtocolEngine_Top
     input   wire                                                    mac_rx_last,
     input   wire    [`MAC_KEEP_WIDTH - 1 : 0]                       mac_rx_keep,
     input   wire                                                    mac_rx_user,
-    input   wire    [`MAC_DATA_WIDTH - 1 : 0]                       mac_rx_data
+    input   wire    [`MAC_DATA_WIDTH - 1 : 0]                       mac_rx_data,
+
+//HCA clock, for the BAR0 clock registers
+    output  wire    [63:0]                                          hca_clock
 );
 
 /*------------------------------------------- Input/Output Definition : End -----------------------------------------*/
@@ -690,7 +693,9 @@ QueueSubsystem_Inst
      
     .RX_RESP_eq_resp_valid              (           RX_RESP_eq_resp_valid               ),
     .RX_RESP_eq_resp_head               (           RX_RESP_eq_resp_head                ),
-    .RX_RESP_eq_resp_ready              (           RX_RESP_eq_resp_ready               )
+    .RX_RESP_eq_resp_ready              (           RX_RESP_eq_resp_ready               ),
+
+    .hca_clock                          (           hca_clock                           )
 );
 
 ResMgtSubsystem #(
@@ -1205,7 +1210,9 @@ RPCSubsystem_Inst
     .RX_delete_resp_start                   (           RX_delete_resp_start                    ),
     .RX_delete_resp_last                    (           RX_delete_resp_last                     ),
     .RX_delete_resp_data                    (           RX_delete_resp_data                     ),
-    .RX_delete_resp_ready                   (           RX_delete_resp_ready                    )
+    .RX_delete_resp_ready                   (           RX_delete_resp_ready                    ),
+
+    .hca_clock                              (           hca_clock                               )
 );
 
 TransportSubsystem TransportSubsystem_Inst(
@@ -0,0 +1,424 @@
+/*
+ * The hgmodel API on top of the co-simulation shared memory.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "hgcosim.h"
+#include "hgcosim_shm.h"
+
+/* ceu_def_h.vh, as in hgmodel.c */
+#define RTL_MAX_QPS         8
+#define RTL_MAX_CQS         8
+#define RTL_MAX_MPTS        14
+#define RTL_MAX_QP_SZ       13
+#define RTL_MAX_CQ_SZ       13
+#define RTL_DEV_CAP_FLAGS   0x00000007
+#define RTL_HCA_CLOCK_KHZ   50000
+#define RTL_BOARD_ID        0x0123456789abcdefULL
+
+#define HCR_STATUS_OFFSET   0x18
+#define HCR_GO_BIT          23
+#define HCR_CLOCK_LO        0x6000      /* own page, HI is not latched */
+#define HCR_CLOCK_HI        0x6004
+
+#define CQE_SIZE            32
+#define CQE_TS_BITS         40
+
+#define ATTACH_TIMEOUT_MS   10000
+
+struct hgm_dev {
+    struct hgc_shm      *shm;
+    struct hgm_host_ops  ops;
+
+    pthread_mutex_t      lock;          /* serialises mmio producers */
+    pthread_t            dma_thread;
+    int                  dma_stop;
+    struct hgm_stats     stats;
+
+    struct {
+        uint64_t addr;
+        uint64_t size;
+    }                    watch[HGCOSIM_MAX_WATCH];
+    int                  num_watch;     /* published with a release store */
+    pthread_mutex_t      ts_lock;       /* the dma thread never takes lock */
+    struct hgcosim_ts_check ts;
+};
+
+static const char *const stage_name[HGC_STAGE_NUM] = {
+    "hcr", "db_fetch", "fetch_tx", "wire", "rx_write", "db_total"
+};
+
+static int identity_read(void *priv, uint64_t addr, void *buf, size_t len)
+{
+    (void) priv;
+    memcpy(buf, (const void *) (uintptr_t) addr, len);
+    return 0;
+}
+
+static int identity_write(void *priv, uint64_t addr, const void *buf, size_t len)
+{
+    (void) priv;
+    memcpy((void *) (uintptr_t) addr, buf, len);
+    return 0;
+}
+
+const struct hgm_host_ops hgm_identity_ops = {
+    .dma_read  = identity_read,
+    .dma_write = identity_write,
+    .priv      = NULL
+};
+
+void hgm_default_config(struct hgm_config *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->log_num_qps   = RTL_MAX_QPS;
+    cfg->log_num_cqs   = RTL_MAX_CQS;
+    cfg->log_num_mpts  = RTL_MAX_MPTS;
+    cfg->log_max_wqes  = RTL_MAX_QP_SZ;
+    cfg->log_max_cqes  = RTL_MAX_CQ_SZ;
+    cfg->max_mtts      = 1U << 20;
+    cfg->dev_cap_flags = RTL_DEV_CAP_FLAGS;
+    cfg->hca_clock_khz = RTL_HCA_CLOCK_KHZ;
+    cfg->board_id      = RTL_BOARD_ID;
+}
+
+static void ts_sample(struct hgm_dev *dev, uint64_t cycle, const uint8_t *cqe)
+{
+    const uint64_t mask = (1ULL << CQE_TS_BITS) - 1;
+    uint64_t ts;
+    int64_t delta;
+
+    ts = (uint64_t) cqe[4] | (uint64_t) cqe[5] << 8 |
+         (uint64_t) cqe[6] << 16 | (uint64_t) cqe[7] << 24 |
+         (uint64_t) cqe[30] << 32;
+    delta = (int64_t) ((cycle - ts) & mask);
+    if (delta >= (int64_t) 1 << (CQE_TS_BITS - 1))
+        delta -= (int64_t) 1 << CQE_TS_BITS;
+
+    pthread_mutex_lock(&dev->ts_lock);
+    if (!dev->ts.cqes || delta < dev->ts.min_delta)
+        dev->ts.min_delta = delta;
+    if (!dev->ts.cqes || delta > dev->ts.max_delta)
+        dev->ts.max_delta = delta;
+    dev->ts.cqes++;
+    pthread_mutex_unlock(&dev->ts_lock);
+}
+
+/* Check each whole CQE that a write puts into a watched ring. */
+static void ts_check(struct hgm_dev *dev, const struct hgc_dma *d)
+{
+    int n = __atomic_load_n(&dev->num_watch, __ATOMIC_ACQUIRE);
+    uint64_t end = d->addr + d->len;
+    int i;
+
+    for (i = 0; i < n; ++i) {
+        uint64_t base = dev->watch[i].addr;
+        uint64_t top  = base + dev->watch[i].size;
+        uint64_t a;
+
+        if (d->addr >= top || end <= base)
+            continue;
+
+        /* first CQE boundary at or after the start of the write */
+        a = base;
+        if (d->addr > base)
+            a += (d->addr - base + CQE_SIZE - 1) & ~(uint64_t) (CQE_SIZE - 1);
+        for (; a + CQE_SIZE <= end && a + CQE_SIZE <= top; a += CQE_SIZE)
+            ts_sample(dev, d->cycle, d->data + (a - d->addr));
+        return;
+    }
+}
+
+/*
+ * Serve the device's DMA in ring order. Reads leave their data and
+ * status in the slot; the simulation picks them up once dma_tail has
+ * moved past.
+ */
+static void *dma_thread(void *arg)
+{
+    struct hgm_dev *dev = arg;
+    struct hgc_shm *shm = dev->shm;
+    uint64_t tail = shm->dma_tail;
+
+    while (!__atomic_load_n(&dev->dma_stop, __ATOMIC_ACQUIRE)) {
+        struct hgc_dma *d;
+
+        if (tail == hgc_load(&shm->dma_head)) {
+            sched_yield();
+            continue;
+        }
+
+        d = &shm->dma[tail % HGC_DMA_SLOTS];
+        if (d->is_write) {
+            ts_check(dev, d);
+            dev->ops.dma_write(dev->ops.priv, d->addr, d->data, d->len);
+        } else
+            d->status = dev->ops.dma_read(dev->ops.priv, d->addr, d->data, d->len);
+        hgc_store(&shm->dma_tail, ++tail);
+    }
+    return NULL;
+}
+
+static struct hgc_shm *shm_attach(void)
+{
+    const char *name = getenv("HGCOSIM_SHM");
+    struct hgc_shm *shm;
+    int fd, ms;
+
+    if (!name)
+        name = HGC_SHM_DEFAULT_NAME;
+
+    for (ms = 0; ; ms += 10) {
+        fd = shm_open(name, O_RDWR, 0);
+        if (fd >= 0)
+            break;
+        if (errno != ENOENT || ms >= ATTACH_TIMEOUT_MS) {
+            fprintf(stderr, "hgcosim: %s: %s\n", name, strerror(errno));
+            return NULL;
+        }
+        usleep(10000);
+    }
+
+    shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) {
+        fprintf(stderr, "hgcosim: mmap %s: %s\n", name, strerror(errno));
+        return NULL;
+    }
+
+    for (ms = 0; !__atomic_load_n(&shm->sim_ready, __ATOMIC_ACQUIRE); ms += 10) {
+        if (ms >= ATTACH_TIMEOUT_MS) {
+            fprintf(stderr, "hgcosim: %s: simulation not ready\n", name);
+            goto err;
+        }
+        usleep(10000);
+    }
+    if (shm->magic != HGC_SHM_MAGIC || shm->version != HGC_SHM_VERSION) {
+        fprintf(stderr, "hgcosim: %s: bad magic or version\n", name);
+        goto err;
+    }
+    return shm;
+
+err:
+    munmap(shm, sizeof(*shm));
+    return NULL;
+}
+
+struct hgm_dev *hgm_create(const struct hgm_config *cfg,
+                           const struct hgm_host_ops *ops)
+{
+    struct hgm_dev *dev;
+
+    (void) cfg;
+
+    dev = calloc(1, sizeof(*dev));
+    if (!dev)
+        return NULL;
+
+    dev->ops = ops ? *ops : hgm_identity_ops;
+    dev->shm = shm_attach();
+    if (!dev->shm)
+        goto err;
+
+    pthread_mutex_init(&dev->lock, NULL);
+    pthread_mutex_init(&dev->ts_lock, NULL);
+    if (pthread_create(&dev->dma_thread, NULL, dma_thread, dev)) {
+        pthread_mutex_destroy(&dev->ts_lock);
+        pthread_mutex_destroy(&dev->lock);
+        munmap(dev->shm, sizeof(*dev->shm));
+        goto err;
+    }
+    return dev;
+
+err:
+    free(dev);
+    return NULL;
+}
+
+void hgm_destroy(struct hgm_dev *dev)
+{
+    if (!dev)
+        return;
+
+    __atomic_store_n(&dev->shm->stop, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&dev->dma_stop, 1, __ATOMIC_RELEASE);
+    pthread_join(dev->dma_thread, NULL);
+    pthread_mutex_destroy(&dev->ts_lock);
+    pthread_mutex_destroy(&dev->lock);
+    munmap(dev->shm, sizeof(*dev->shm));
+    free(dev);
+}
+
+/*
+ * Queue one MMIO and, for a read, wait for the completion and for the
+ * DMA writes the device issued before it. Called with dev->lock held.
+ */
+static uint64_t mmio(struct hgm_dev *dev, uint8_t bar, int is_read,
+                     uint8_t len, uint64_t offset, uint64_t data)
+{
+    struct hgc_shm *shm = dev->shm;
+    uint64_t head = shm->mmio_head;
+    struct hgc_mmio *m;
+
+    while (head - hgc_load(&shm->mmio_tail) >= HGC_MMIO_SLOTS)
+        sched_yield();
+
+    m = &shm->mmio[head % HGC_MMIO_SLOTS];
+    m->bar     = bar;
+    m->is_read = is_read;
+    m->len     = len;
+    m->offset  = offset;
+    m->data    = data;
+    m->dma_seq = 0;
+    m->done    = 0;
+    hgc_store(&shm->mmio_head, head + 1);
+
+    if (!is_read)
+        return 0;
+
+    while (hgc_load(&m->done) != head + 1)
+        sched_yield();
+    while (hgc_load(&shm->dma_tail) < m->dma_seq)
+        sched_yield();
+    return m->data;
+}
+
+void hgm_hcr_write32(struct hgm_dev *dev, uint32_t offset, uint32_t val)
+{
+    if (offset >= HGM_HCR_SIZE || (offset & 3))
+        return;
+
+    pthread_mutex_lock(&dev->lock);
+    mmio(dev, HGC_BAR_HCR, 0, 4, HGM_HCR_BASE + offset, val);
+    if (offset == HCR_STATUS_OFFSET && (val & (1U << HCR_GO_BIT)))
+        dev->stats.cmds++;
+    pthread_mutex_unlock(&dev->lock);
+}
+
+uint32_t hgm_hcr_read32(struct hgm_dev *dev, uint32_t offset)
+{
+    uint32_t val;
+
+    if (offset >= HGM_HCR_SIZE || (offset & 3))
+        return 0;
+
+    pthread_mutex_lock(&dev->lock);
+    val = (uint32_t) mmio(dev, HGC_BAR_HCR, 1, 4, HGM_HCR_BASE + offset, 0);
+    pthread_mutex_unlock(&dev->lock);
+    return val;
+}
+
+/* The offsets go to the device unchanged. */
+void hgm_uar_write64(struct hgm_dev *dev, uint32_t offset, uint64_t val)
+{
+    pthread_mutex_lock(&dev->lock);
+    mmio(dev, HGC_BAR_UAR, 0, 8, offset, val);
+    if (offset == HGM_SEND_DOORBELL)
+        dev->stats.send_dbs++;
+    pthread_mutex_unlock(&dev->lock);
+}
+
+/* The RTL retries on its own. */
+int hgm_progress(struct hgm_dev *dev)
+{
+    (void) dev;
+    return 0;
+}
+
+void hgm_get_stats(struct hgm_dev *dev, struct hgm_stats *stats)
+{
+    pthread_mutex_lock(&dev->lock);
+    *stats = dev->stats;
+    pthread_mutex_unlock(&dev->lock);
+}
+
+/* The ICMCache lookups happen in the RTL; see the ICMCache bench. */
+void hgm_set_icm_trace(struct hgm_dev *dev, hgm_icm_trace_fn fn, void *priv)
+{
+    (void) dev;
+    (void) fn;
+    (void) priv;
+}
+
+void hgm_icm_trace_file(void *priv, int type, uint32_t index)
+{
+    static const char *const name[] = {
+        [HGM_ICM_QPC] = "qpc", [HGM_ICM_CQC] = "cqc", [HGM_ICM_EQC] = "eqc",
+        [HGM_ICM_MPT] = "mpt", [HGM_ICM_MTT] = "mtt"
+    };
+
+    if (type < HGM_ICM_QPC || type > HGM_ICM_MTT)
+        return;
+    fprintf(priv, "%s %u\n", name[type], index);
+}
+
+uint64_t hgcosim_cycles(struct hgm_dev *dev)
+{
+    return __atomic_load_n(&dev->shm->cycles, __ATOMIC_RELAXED);
+}
+
+uint64_t hgcosim_time_ns(struct hgm_dev *dev)
+{
+    return hgcosim_cycles(dev) * dev->shm->clk_ps / 1000;
+}
+
+int hgcosim_get_stages(struct hgm_dev *dev, struct hgcosim_stage *st, int n)
+{
+    int i;
+
+    for (i = 0; i < n && i < HGC_STAGE_NUM; ++i) {
+        const struct hgc_stage *s = &dev->shm->stage[i];
+
+        st[i].name   = stage_name[i];
+        st[i].count  = __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+        st[i].cycles = __atomic_load_n(&s->cycles, __ATOMIC_RELAXED);
+        st[i].max    = __atomic_load_n(&s->max, __ATOMIC_RELAXED);
+    }
+    return HGC_STAGE_NUM;
+}
+
+int hgcosim_watch_cq(struct hgm_dev *dev, uint64_t addr, uint64_t size)
+{
+    int n;
+
+    pthread_mutex_lock(&dev->lock);
+    n = dev->num_watch;
+    if (n < HGCOSIM_MAX_WATCH) {
+        dev->watch[n].addr = addr;
+        dev->watch[n].size = size;
+        __atomic_store_n(&dev->num_watch, n + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&dev->lock);
+    return n < HGCOSIM_MAX_WATCH ? 0 : -1;
+}
+
+void hgcosim_get_ts_check(struct hgm_dev *dev, struct hgcosim_ts_check *tc)
+{
+    pthread_mutex_lock(&dev->ts_lock);
+    *tc = dev->ts;
+    pthread_mutex_unlock(&dev->ts_lock);
+}
+
+uint64_t hgcosim_read_clock(struct hgm_dev *dev)
+{
+    uint64_t lo, hi, hi2;
+
+    pthread_mutex_lock(&dev->lock);
+    hi2 = mmio(dev, HGC_BAR_HCR, 1, 4, HGM_HCR_BASE + HCR_CLOCK_HI, 0);
+    do {
+        hi = hi2;
+        lo = mmio(dev, HGC_BAR_HCR, 1, 4, HGM_HCR_BASE + HCR_CLOCK_LO, 0);
+        hi2 = mmio(dev, HGC_BAR_HCR, 1, 4, HGM_HCR_BASE + HCR_CLOCK_HI, 0);
+    } while (hi != hi2);
+    pthread_mutex_unlock(&dev->lock);
+    return (hi & 0xffffffff) << 32 | (lo & 0xffffffff);
+}
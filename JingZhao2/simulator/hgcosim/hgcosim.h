@@ -0,0 +1,68 @@
+/*
+ * hgcosim: the hgmodel API backed by the RTL.
+ *
+ * libhgcosim.a implements hgmodel.h by forwarding every MMIO to the
+ * Verilator co-simulation of HanGuHTN_Top (verification/verilator/cosim)
+ * and serving the device's DMA from a host thread through the
+ * hgm_host_ops. A program written against hgmodel links this library
+ * instead of libhgmodel.a to run against the RTL. libhgrnic's
+ * datapath runs on it through hgshim (simulator/hgshim, test/cosim.c);
+ * ib_hgrnic itself needs a PCI device and does not.
+ *
+ * hgm_create() attaches to the shared memory the running simulation
+ * created: $HGCOSIM_SHM, or /hgcosim. The hgm_config is ignored, the
+ * limits are those of the RTL. hgm_destroy() ends the simulation.
+ * hgm_progress() and hgm_set_icm_trace() do nothing, and of the
+ * hgm_stats only cmds and send_dbs are counted.
+ *
+ * MMIO calls block until the simulation has taken the access (writes)
+ * or completed it (reads), so the time they take is wall-clock time.
+ * The functions below report simulated time instead.
+ */
+
+#ifndef HGCOSIM_H
+#define HGCOSIM_H
+
+#include <stdint.h>
+
+#include "hgmodel.h"
+
+/* user_clk cycles since the end of reset, and the same in ns. */
+uint64_t hgcosim_cycles(struct hgm_dev *dev);
+uint64_t hgcosim_time_ns(struct hgm_dev *dev);
+
+/* Latency of one pipeline stage, in cycles. See hgcosim_shm.h. */
+struct hgcosim_stage {
+    const char *name;
+    uint64_t    count;
+    uint64_t    cycles;         /* sum */
+    uint64_t    max;
+};
+
+/* Fills up to n stages, returns the number of stages there are. */
+int hgcosim_get_stages(struct hgm_dev *dev, struct hgcosim_stage *st, int n);
+
+/*
+ * CQE timestamp check. Every whole CQE the device writes into a
+ * watched CQ ring is compared with the simulated time of the write:
+ * delta = cycles when the TLP left the device - timestamp, both mod
+ * 2^40. The delta is the generate-to-PCIe latency plus the constant
+ * gap between HanGuHTN_Top's reset and the start of hgcosim_cycles(),
+ * so max_delta - min_delta bounds the stamping error.
+ */
+#define HGCOSIM_MAX_WATCH   16
+
+struct hgcosim_ts_check {
+    uint64_t cqes;
+    int64_t  min_delta;
+    int64_t  max_delta;
+};
+
+/* Watch size bytes of CQ ring at bus address addr. -1 if full. */
+int hgcosim_watch_cq(struct hgm_dev *dev, uint64_t addr, uint64_t size);
+void hgcosim_get_ts_check(struct hgm_dev *dev, struct hgcosim_ts_check *tc);
+
+/* The HCA clock, read HI, LO, HI through the BAR0 HCA_CLOCK registers. */
+uint64_t hgcosim_read_clock(struct hgm_dev *dev);
+
+#endif /* HGCOSIM_H */
@@ -0,0 +1,124 @@
+/*
+ * hgcosim shared memory layout, used by libhgcosim (the host side) and
+ * by the Verilator co-simulation of HanGuHTN_Top in
+ * verification/verilator/cosim/ (the device side).
+ *
+ * Two single-producer rings carry the traffic across the PCIe boundary:
+ *
+ *   mmio  host -> sim. BAR0 (HCR) and BAR2 (UAR) accesses. The sim turns
+ *         each one into a CQ TLP. A read slot is completed in place from
+ *         the CC TLP: the sim stores the data, then done = its sequence
+ *         number + 1.
+ *   dma   sim -> host. RQ memory writes and reads. The host runs them
+ *         in ring order through its hgm_host_ops, so a read sees every
+ *         write posted before it. The sim waits for a read's slot to be
+ *         consumed (dma_tail past it) and takes the data from the slot.
+ *         Simulated time does not advance while it waits.
+ *
+ * A read completion also carries dma_seq, the dma_head value when the
+ * CC TLP left the device. The host waits for dma_tail to reach it
+ * before returning the value, which keeps PCIe's rule that a read
+ * completion does not pass posted writes: a CQE written before the
+ * driver reads the HCR status is visible when the read returns.
+ *
+ * Indices only grow; a slot is index % the ring size. Producers publish
+ * with a release store, consumers read with an acquire load.
+ */
+
+#ifndef HGCOSIM_SHM_H
+#define HGCOSIM_SHM_H
+
+#include <stdint.h>
+
+#define HGC_SHM_MAGIC           0x48474353u     /* "HGCS" */
+#define HGC_SHM_VERSION         2
+#define HGC_SHM_DEFAULT_NAME    "/hgcosim"
+
+#define HGC_MMIO_SLOTS          64
+#define HGC_DMA_SLOTS           64
+#define HGC_DMA_MAX             4096            /* max_read_req and MPS are both smaller */
+
+#define HGC_BAR_HCR             0
+#define HGC_BAR_UAR             2
+
+struct hgc_mmio {
+    uint8_t  bar;               /* HGC_BAR_* */
+    uint8_t  is_read;
+    uint8_t  len;               /* 4 or 8 bytes */
+    uint8_t  rsvd;
+    uint32_t pad;
+    uint64_t offset;            /* within the BAR */
+    uint64_t data;              /* little endian bus value */
+    uint64_t dma_seq;           /* read: dma_head when the completion left */
+    uint64_t done;              /* read: sequence number + 1 when complete */
+};
+
+struct hgc_dma {
+    uint8_t  is_write;
+    uint8_t  rsvd[3];
+    uint32_t len;
+    uint64_t addr;
+    uint64_t cycle;             /* write: cycles when the TLP left the device */
+    int32_t  status;            /* read: return value of hgm_host_ops */
+    uint32_t pad;
+    uint8_t  data[HGC_DMA_MAX];
+};
+
+/*
+ * Per-stage latency, in user_clk cycles, measured at the PCIe and MAC
+ * ports of HanGuHTN_Top. See verification/verilator/cosim/hgcosim.cpp
+ * for how events are matched to doorbells.
+ */
+enum {
+    HGC_STAGE_HCR,              /* HCR go bit write -> status read with go clear */
+    HGC_STAGE_DB_FETCH,         /* send doorbell -> first DMA read */
+    HGC_STAGE_FETCH_TX,         /* first DMA read -> MAC TX start of packet */
+    HGC_STAGE_WIRE,             /* MAC TX -> MAC RX start of packet (loopback) */
+    HGC_STAGE_RX_WRITE,         /* MAC RX -> first DMA write */
+    HGC_STAGE_DB_TOTAL,         /* send doorbell -> last DMA write before idle */
+    HGC_STAGE_NUM
+};
+
+struct hgc_stage {
+    uint64_t count;
+    uint64_t cycles;            /* sum */
+    uint64_t max;
+};
+
+struct hgc_shm {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sim_ready;         /* set by the sim once reset is done */
+    uint32_t stop;              /* set by the host to end the simulation */
+    uint32_t clk_ps;            /* user_clk period */
+    uint32_t pad;
+
+    uint64_t cycles;            /* user_clk cycles since reset */
+    uint64_t msix;              /* MSI-X messages the device raised */
+    uint64_t cq_tlps;
+    uint64_t rq_reads;
+    uint64_t rq_writes;
+    uint64_t mac_packets;
+
+    uint64_t mmio_head;         /* written by the host */
+    uint64_t mmio_tail;         /* written by the sim */
+    uint64_t dma_head;          /* written by the sim */
+    uint64_t dma_tail;          /* written by the host */
+
+    struct hgc_stage stage[HGC_STAGE_NUM];
+
+    struct hgc_mmio mmio[HGC_MMIO_SLOTS];
+    struct hgc_dma  dma[HGC_DMA_SLOTS];
+};
+
+static inline uint64_t hgc_load(const uint64_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void hgc_store(uint64_t *p, uint64_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+#endif /* HGCOSIM_SHM_H */
@@ -0,0 +1,376 @@
+/*
+ * HCR commands. The model keeps every context in its own tables, so
+ * the ICM the driver maps (MAP_ICM, INIT_HCA bases) is accepted but
+ * never touched.
+ */
+
+#include <string.h>
+
+#include "hgm_int.h"
+
+static void put8(uint8_t *box, int off, uint8_t v)
+{
+    box[off] = v;
+}
+
+static void put16(uint8_t *box, int off, uint16_t v)
+{
+    v = htobe16(v);
+    memcpy(box + off, &v, sizeof(v));
+}
+
+static void put32(uint8_t *box, int off, uint32_t v)
+{
+    v = htobe32(v);
+    memcpy(box + off, &v, sizeof(v));
+}
+
+static void put64(uint8_t *box, int off, uint64_t v)
+{
+    v = htobe64(v);
+    memcpy(box + off, &v, sizeof(v));
+}
+
+/* Same layout as the CEU builds it in acc_local.v. */
+static int query_dev_lim(struct hgm_dev *dev, uint64_t out_param)
+{
+    const struct hgm_config *cfg = &dev->cfg;
+    uint8_t box[QUERY_DEV_LIM_OUT_SIZE];
+
+    memset(box, 0, sizeof(box));
+    put8 (box, 0x00, 1);                    /* 2^1 reserved QPs */
+    put8 (box, 0x04, 0);                    /* 2^0 reserved SRQs */
+    put16(box, 0x08, cfg->log_max_wqes);
+    put16(box, 0x0a, cfg->log_max_cqes);
+    put8 (box, 0x0c, cfg->log_num_qps);
+    put8 (box, 0x0d, cfg->log_num_cqs);
+    put8 (box, 0x0e, 5);                    /* EQs */
+    put8 (box, 0x0f, cfg->log_num_mpts);
+    put8 (box, 0x10, 12);                   /* PDs */
+    put8 (box, 0x11, cfg->log_num_srqs);
+    put8 (box, 0x13, 1);                    /* P_Keys */
+    put8 (box, 0x15, 8);                    /* MTT segment */
+    put16(box, 0x16, sizeof(struct hgm_srq_context));   /* SRQC */
+    put16(box, 0x18, 256);                  /* QPC entry size */
+    put16(box, 0x1a, 128);                  /* CQC */
+    put16(box, 0x1c, 64);                   /* EQC */
+    put16(box, 0x1e, 64);                   /* MPT */
+    put8 (box, 0x21, 5 << 4);               /* 4096 MTU */
+    put8 (box, 0x23, 0xf1);                 /* 15 VLs, 1 port */
+    put8 (box, 0x25, HGM_PAGE_SHIFT);
+    put8 (box, 0x29, 16);                   /* SQ SGEs */
+    put16(box, 0x2a, 512);                  /* SQ WQE size */
+    put8 (box, 0x2d, 16);                   /* RQ SGEs */
+    put16(box, 0x2e, 512);                  /* RQ WQE size */
+    put64(box, 0x30, 0x1234567887650000ULL);
+    put32(box, 0x38, cfg->dev_cap_flags);
+    put32(box, 0x3c, cfg->hca_clock_khz);
+
+    return hgm_dma_write(dev, out_param, box, sizeof(box));
+}
+
+static int query_adapter(struct hgm_dev *dev, uint64_t out_param)
+{
+    uint8_t box[0x20];
+
+    memset(box, 0, sizeof(box));
+    put64(box, QUERY_ADAPTER_ID_OFFSET, dev->cfg.board_id);
+    return hgm_dma_write(dev, out_param, box, sizeof(box));
+}
+
+static int sw2hw_mpt(struct hgm_dev *dev, uint64_t in_param, uint32_t index)
+{
+    struct hgm_mpt_entry e;
+    struct hgm_mpt *mpt = &dev->mpt[index & hgm_mpt_mask(dev)];
+
+    if (hgm_dma_read(dev, in_param, &e, sizeof(e)))
+        return CMD_STAT_INTERNAL_ERR;
+    if (mpt->valid)
+        return CMD_STAT_BAD_RES_STATE;
+
+    mpt->flags   = be32toh(e.flags);
+    mpt->key     = be32toh(e.key);
+    mpt->pd      = be32toh(e.pd);
+    mpt->start   = be64toh(e.start);
+    mpt->length  = be64toh(e.length);
+    mpt->mtt_seg = be64toh(e.mtt_seg);
+    mpt->valid   = 1;
+    return CMD_STAT_OK;
+}
+
+/*
+ * Entry 3 holds the first MTT index; the page addresses follow in
+ * groups of four, each group in reverse order (see __hgrnic_write_mtt).
+ */
+static int write_mtt(struct hgm_dev *dev, uint64_t in_param, uint32_t num)
+{
+    uint64_t box[HGM_MAILBOX_SIZE / 8];
+    uint64_t start;
+    uint32_t i;
+
+    if (hgm_dma_read(dev, in_param, box, sizeof(box)))
+        return CMD_STAT_INTERNAL_ERR;
+
+    /* The driver passes the whole list length; one mailbox is the most. */
+    if (num > HGM_MAILBOX_SIZE / 8 - 4)
+        num = HGM_MAILBOX_SIZE / 8 - 4;
+
+    start = be64toh(box[3]);
+    if (start + num > dev->cfg.max_mtts)
+        return CMD_STAT_BAD_INDEX;
+
+    for (i = 0; i < num; ++i)
+        dev->mtt[start + i] = be64toh(box[4 + (i & ~3U) + 3 - (i & 3)]);
+    return CMD_STAT_OK;
+}
+
+static int sw2hw_cq(struct hgm_dev *dev, uint64_t in_param, uint32_t cqn)
+{
+    struct hgm_cq_context ctx;
+    struct hgm_cq *cq = &dev->cq[cqn & hgm_cq_mask(dev)];
+
+    if (hgm_dma_read(dev, in_param, &ctx, sizeof(ctx)))
+        return CMD_STAT_INTERNAL_ERR;
+    if (cq->valid)
+        return CMD_STAT_BAD_RES_STATE;
+
+    cq->log_size = be32toh(ctx.logsize_usrpage) >> 24;
+    cq->lkey     = be32toh(ctx.lkey);
+    cq->pi       = 0;
+    cq->valid    = 1;
+    return CMD_STAT_OK;
+}
+
+static int resize_cq(struct hgm_dev *dev, uint64_t in_param, uint32_t cqn)
+{
+    struct hgm_cq *cq = &dev->cq[cqn & hgm_cq_mask(dev)];
+    uint8_t box[8];
+    uint32_t lkey;
+
+    if (!cq->valid)
+        return CMD_STAT_BAD_RES_STATE;
+    if (hgm_dma_read(dev, in_param, box, sizeof(box)))
+        return CMD_STAT_INTERNAL_ERR;
+
+    memcpy(&lkey, box + RESIZE_CQ_LKEY_OFFSET, sizeof(lkey));
+    cq->log_size = box[RESIZE_CQ_LOG_SIZE_OFFSET];
+    cq->lkey     = be32toh(lkey);
+    return CMD_STAT_OK;
+}
+
+static int sw2hw_srq(struct hgm_dev *dev, uint64_t in_param, uint32_t srqn)
+{
+    struct hgm_srq_context ctx;
+    struct hgm_srq *srq = &dev->srq[srqn & hgm_srq_mask(dev)];
+
+    if (hgm_dma_read(dev, in_param, &ctx, sizeof(ctx)))
+        return CMD_STAT_INTERNAL_ERR;
+    if (srq->valid)
+        return CMD_STAT_BAD_RES_STATE;
+
+    srq->log_size = ctx.logsize;
+    srq->wqe_log  = ctx.entry_sz_log;
+    srq->limit    = be16toh(ctx.limit_watermark);
+    srq->lkey     = be32toh(ctx.lkey);
+    srq->pd       = be32toh(ctx.pd);
+    srq->ci       = 0;
+    srq->valid    = 1;
+    return CMD_STAT_OK;
+}
+
+static int query_srq(struct hgm_dev *dev, uint64_t out_param, uint32_t srqn)
+{
+    struct hgm_srq *srq = &dev->srq[srqn & hgm_srq_mask(dev)];
+    struct hgm_srq_context ctx;
+
+    if (!srq->valid)
+        return CMD_STAT_BAD_RES_STATE;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.logsize         = srq->log_size;
+    ctx.entry_sz_log    = srq->wqe_log;
+    ctx.limit_watermark = htobe16(srq->limit);
+    ctx.pd              = htobe32(srq->pd);
+    ctx.lkey            = htobe32(srq->lkey);
+    ctx.srqn            = htobe32(srqn & 0xffffff);
+    return hgm_dma_write(dev, out_param, &ctx, sizeof(ctx)) ?
+           CMD_STAT_INTERNAL_ERR : CMD_STAT_OK;
+}
+
+static int srq_cmd(struct hgm_dev *dev, uint16_t op, uint64_t in_param,
+                   uint32_t in_mod, uint64_t out_param)
+{
+    struct hgm_srq *srq = &dev->srq[in_mod & hgm_srq_mask(dev)];
+
+    if (!(dev->cfg.dev_cap_flags & DEV_LIM_FLAG_SRQ))
+        return CMD_STAT_BAD_OP;
+
+    switch (op) {
+    case CMD_SW2HW_SRQ:
+        return sw2hw_srq(dev, in_param, in_mod);
+    case CMD_HW2SW_SRQ:
+        srq->valid = 0;
+        return CMD_STAT_OK;
+    case CMD_QUERY_SRQ:
+        return query_srq(dev, out_param, in_mod);
+    default:                            /* CMD_ARM_SRQ */
+        if (!srq->valid)
+            return CMD_STAT_BAD_RES_STATE;
+        srq->limit = (uint16_t) in_param;
+        return CMD_STAT_OK;
+    }
+}
+
+/* Required current state and new state of each QP transition command. */
+static int qp_transition(uint16_t op, int *from, int *to)
+{
+    static const struct {
+        uint16_t op;
+        int      from;
+        int      to;
+    } t[] = {
+        { CMD_RST2INIT_QPEE,  QP_STATE_RST,  QP_STATE_INIT },
+        { CMD_INIT2INIT_QPEE, QP_STATE_INIT, QP_STATE_INIT },
+        { CMD_INIT2RTR_QPEE,  QP_STATE_INIT, QP_STATE_RTR  },
+        { CMD_RTR2RTS_QPEE,   QP_STATE_RTR,  QP_STATE_RTS  },
+        { CMD_RTS2RTS_QPEE,   QP_STATE_RTS,  QP_STATE_RTS  },
+        { CMD_SQERR2RTS_QPEE, QP_STATE_SQE,  QP_STATE_RTS  },
+        { CMD_RTS2SQD_QPEE,   QP_STATE_RTS,  QP_STATE_SQD  },
+        { CMD_SQD2SQD_QPEE,   QP_STATE_SQD,  QP_STATE_SQD  },
+        { CMD_SQD2RTS_QPEE,   QP_STATE_SQD,  QP_STATE_RTS  },
+        { CMD_2ERR_QPEE,      -1,            QP_STATE_ERR  },
+        { CMD_ERR2RST_QPEE,   -1,            QP_STATE_RST  },
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(t) / sizeof(t[0]); ++i)
+        if (t[i].op == op) {
+            *from = t[i].from;
+            *to   = t[i].to;
+            return 0;
+        }
+    return -1;
+}
+
+static int modify_qp(struct hgm_dev *dev, uint16_t op, uint64_t in_param,
+                     uint32_t qpn)
+{
+    struct hgm_qp *qp = &dev->qp[qpn & hgm_qp_mask(dev)];
+    struct hgm_qp_param param;
+    int from, to;
+
+    if (qp_transition(op, &from, &to))
+        return CMD_STAT_BAD_OP;
+    if (from >= 0 && qp->state != from)
+        return CMD_STAT_BAD_QPEE_STATE;
+
+    memset(&param, 0, sizeof(param));
+    if (to != QP_STATE_ERR && to != QP_STATE_RST &&
+        hgm_dma_read(dev, in_param, &param, sizeof(param)))
+        return CMD_STAT_INTERNAL_ERR;
+
+    qp->qpn = qpn & 0xffffff;
+    hgm_qp_modify(dev, qp, to == QP_STATE_ERR || to == QP_STATE_RST ?
+                  NULL : &param, to);
+    return CMD_STAT_OK;
+}
+
+static int query_qp(struct hgm_dev *dev, uint64_t out_param, uint32_t qpn)
+{
+    struct hgm_qp *qp = &dev->qp[qpn & hgm_qp_mask(dev)];
+    struct hgm_qp_param param = qp->param;
+    uint32_t flags = be32toh(param.context.flags);
+
+    flags = (flags & 0x0fffffff) | ((uint32_t) qp->state << 28);
+    param.context.flags = htobe32(flags);
+    return hgm_dma_write(dev, out_param, &param, sizeof(param)) ?
+           CMD_STAT_INTERNAL_ERR : CMD_STAT_OK;
+}
+
+static int run_cmd(struct hgm_dev *dev, uint16_t op, uint64_t in_param,
+                   uint32_t in_mod, uint64_t out_param)
+{
+    int from, to;
+
+    switch (op) {
+    case CMD_QUERY_DEV_LIM:
+        return query_dev_lim(dev, out_param) ? CMD_STAT_INTERNAL_ERR : CMD_STAT_OK;
+    case CMD_QUERY_ADAPTER:
+        return query_adapter(dev, out_param) ? CMD_STAT_INTERNAL_ERR : CMD_STAT_OK;
+
+    case CMD_INIT_HCA:
+        dev->hca_open = 1;
+        return CMD_STAT_OK;
+    case CMD_CLOSE_HCA:
+        dev->hca_open = 0;
+        return CMD_STAT_OK;
+    case CMD_MAP_ICM:
+    case CMD_UNMAP_ICM:
+        return CMD_STAT_OK;
+    case CMD_NOP:
+        return CMD_STAT_OK;
+    }
+
+    if (!dev->hca_open)
+        return CMD_STAT_BAD_SYS_STATE;
+
+    switch (op) {
+    case CMD_INIT_IB:
+    case CMD_CLOSE_IB:
+    case CMD_SET_IB:
+    case CMD_MAP_EQ:
+    case CMD_SW2HW_EQ:
+    case CMD_HW2SW_EQ:
+    case CMD_MODIFY_CQ:
+    case CMD_CONF_SPECIAL_QP:
+        return CMD_STAT_OK;
+
+    case CMD_SW2HW_MPT:
+        return sw2hw_mpt(dev, in_param, in_mod);
+    case CMD_HW2SW_MPT:
+        dev->mpt[in_mod & hgm_mpt_mask(dev)].valid = 0;
+        return CMD_STAT_OK;
+    case CMD_WRITE_MTT:
+        return write_mtt(dev, in_param, in_mod);
+
+    case CMD_SW2HW_CQ:
+        return sw2hw_cq(dev, in_param, in_mod);
+    case CMD_HW2SW_CQ:
+        dev->cq[in_mod & hgm_cq_mask(dev)].valid = 0;
+        return CMD_STAT_OK;
+    case CMD_RESIZE_CQ:
+        return resize_cq(dev, in_param, in_mod);
+
+    case CMD_QUERY_QPEE:
+        return query_qp(dev, out_param, in_mod);
+
+    case CMD_SW2HW_SRQ:
+    case CMD_HW2SW_SRQ:
+    case CMD_QUERY_SRQ:
+    case CMD_ARM_SRQ:
+        return srq_cmd(dev, op, in_param, in_mod, out_param);
+    }
+
+    if (!qp_transition(op, &from, &to))
+        return modify_qp(dev, op, in_param, in_mod);
+
+    return CMD_STAT_BAD_OP;
+}
+
+void hgm_cmd_exec(struct hgm_dev *dev)
+{
+    uint64_t in_param  = (uint64_t) dev->hcr[0] << 32 | dev->hcr[1];
+    uint32_t in_mod    = dev->hcr[HCR_IN_MODIFIER_OFFSET / 4];
+    uint64_t out_param = (uint64_t) dev->hcr[3] << 32 | dev->hcr[4];
+    uint16_t op        = dev->hcr[HCR_STATUS_OFFSET / 4] & 0xfff;
+    int status;
+
+    status = run_cmd(dev, op, in_param, in_mod, out_param);
+
+    dev->stats.cmds++;
+    if (status)
+        dev->stats.cmd_errors++;
+
+    /* Clears the go bit. */
+    dev->hcr[HCR_STATUS_OFFSET / 4] = (uint32_t) status << 24;
+}
@@ -0,0 +1,506 @@
+/*
+ * hgmodel internals: the host interface formats, copied from
+ * ib_hgrnic/libhgrnic (hgrnic_cmd.c, hgrnic_mr.c, hgrnic_cq.c,
+ * hgrnic_qp.c, hgrnic_wqe.h), and the state the model keeps per
+ * resource. Mailbox and context formats are big endian, WQEs, CQEs
+ * and doorbells little endian.
+ */
+
+#ifndef HGM_INT_H
+#define HGM_INT_H
+
+#include <endian.h>
+#include <pthread.h>
+
+#include "hgmodel.h"
+
+#define HGM_MAILBOX_SIZE        4096
+#define HGM_PAGE_SHIFT          12      /* the RTL translates 4 KiB pages */
+#define HGM_PAGE_SIZE           (1UL << HGM_PAGE_SHIFT)
+#define HGM_MAX_WQES_PER_DB     255
+#define HGM_MAX_WQE_SIZE        (63 * 16)   /* 6-bit size in 16-byte units */
+#define HGM_MAX_SGE             ((HGM_MAX_WQE_SIZE - 16) / 16)
+
+/* HCR */
+enum {
+    HCR_IN_PARAM_OFFSET    = 0x00,
+    HCR_IN_MODIFIER_OFFSET = 0x08,
+    HCR_OUT_PARAM_OFFSET   = 0x0c,
+    HCR_TOKEN_OFFSET       = 0x14,
+    HCR_STATUS_OFFSET      = 0x18,
+    HCR_OPMOD_SHIFT        = 12,
+    HCR_GO_BIT             = 23
+};
+
+enum {
+    CMD_QUERY_DEV_LIM   = 0x3,
+    CMD_QUERY_ADAPTER   = 0x6,
+    CMD_INIT_HCA        = 0x7,
+    CMD_CLOSE_HCA       = 0x8,
+    CMD_INIT_IB         = 0x9,
+    CMD_CLOSE_IB        = 0xa,
+    CMD_SET_IB          = 0xc,
+    CMD_MAP_ICM         = 0xffa,
+    CMD_UNMAP_ICM       = 0xff9,
+    CMD_SW2HW_MPT       = 0xd,
+    CMD_HW2SW_MPT       = 0xf,
+    CMD_WRITE_MTT       = 0x11,
+    CMD_MAP_EQ          = 0x12,
+    CMD_SW2HW_EQ        = 0x13,
+    CMD_HW2SW_EQ        = 0x14,
+    CMD_SW2HW_CQ        = 0x16,
+    CMD_HW2SW_CQ        = 0x17,
+    CMD_RESIZE_CQ       = 0x2c,
+    CMD_MODIFY_CQ       = 0x2e,
+    CMD_RST2INIT_QPEE   = 0x19,
+    CMD_INIT2RTR_QPEE   = 0x1a,
+    CMD_RTR2RTS_QPEE    = 0x1b,
+    CMD_RTS2RTS_QPEE    = 0x1c,
+    CMD_SQERR2RTS_QPEE  = 0x1d,
+    CMD_2ERR_QPEE       = 0x1e,
+    CMD_RTS2SQD_QPEE    = 0x1f,
+    CMD_SQD2RTS_QPEE    = 0x20,
+    CMD_ERR2RST_QPEE    = 0x21,
+    CMD_QUERY_QPEE      = 0x22,
+    CMD_CONF_SPECIAL_QP = 0x23,
+    CMD_MAD_IFC         = 0x24,
+    CMD_INIT2INIT_QPEE  = 0x2d,
+    CMD_NOP             = 0x31,
+    CMD_SQD2SQD_QPEE    = 0x38,
+    CMD_SW2HW_SRQ       = 0x35,
+    CMD_HW2SW_SRQ       = 0x36,
+    CMD_QUERY_SRQ       = 0x37,
+    CMD_ARM_SRQ         = 0x40
+};
+
+enum {
+    CMD_STAT_OK             = 0x00,
+    CMD_STAT_INTERNAL_ERR   = 0x01,
+    CMD_STAT_BAD_OP         = 0x02,
+    CMD_STAT_BAD_PARAM      = 0x03,
+    CMD_STAT_BAD_SYS_STATE  = 0x04,
+    CMD_STAT_BAD_RESOURCE   = 0x05,
+    CMD_STAT_BAD_RES_STATE  = 0x09,
+    CMD_STAT_BAD_INDEX      = 0x0a,
+    CMD_STAT_BAD_QPEE_STATE = 0x10
+};
+
+/* QUERY_DEV_LIM outbox, see hgrnic_QUERY_DEV_LIM() */
+#define QUERY_DEV_LIM_OUT_SIZE  0x40
+
+/* DEV_LIM_FLAG_* the model looks at */
+#define DEV_LIM_FLAG_SRQ        (1U << 6)
+#define QUERY_ADAPTER_ID_OFFSET 0x18
+
+/* struct hgrnic_mpt_entry */
+struct hgm_mpt_entry {
+    uint32_t flags;
+    uint32_t page_size;
+    uint32_t key;
+    uint32_t pd;
+    uint64_t start;
+    uint64_t length;
+    uint32_t lkey;
+    uint32_t window_count;
+    uint32_t window_count_limit;
+    uint64_t mtt_seg;
+    uint32_t mtt_sz;
+    uint32_t reserved[2];
+} __attribute__((packed));
+
+enum {
+    MPT_FLAG_LOCAL_WRITE  = 1 << 0,
+    MPT_FLAG_REMOTE_WRITE = 1 << 1,
+    MPT_FLAG_REMOTE_READ  = 1 << 2,
+    MPT_FLAG_ATOMIC       = 1 << 3,
+    MPT_FLAG_LOCAL_READ   = 1 << 7,
+    MPT_FLAG_PHYSICAL     = 1 << 9
+};
+
+/* struct hgrnic_cq_context */
+struct hgm_cq_context {
+    uint32_t flags;
+    uint64_t start;
+    uint32_t logsize_usrpage;
+    uint32_t comp_eqn;
+    uint32_t pd;
+    uint32_t lkey;
+    uint32_t reserved0[4];
+    uint32_t cqn;
+    uint32_t reserved1[4];
+} __attribute__((packed));
+
+/* struct hgrnic_srq_context */
+struct hgm_srq_context {
+    uint32_t flags;
+    uint8_t  logsize;
+    uint8_t  entry_sz_log;
+    uint16_t limit_watermark;
+    uint32_t pd;
+    uint32_t lkey;
+    uint32_t srqn;
+    uint32_t reserved[3];
+} __attribute__((packed));
+
+#define RESIZE_CQ_LOG_SIZE_OFFSET   0x00
+#define RESIZE_CQ_LKEY_OFFSET       0x04
+
+/* struct hgrnic_qp_param */
+struct hgm_qp_path {
+    uint32_t port_pkey;
+    uint8_t  rnr_retry;
+    uint8_t  g_mylmc;
+    uint16_t rlid;
+    uint8_t  ackto;
+    uint8_t  mgid_index;
+    uint8_t  static_rate;
+    uint8_t  hop_limit;
+    uint32_t sl_tclass_flowlabel;
+    uint8_t  rgid[16];
+} __attribute__((packed));
+
+struct hgm_qp_context {
+    uint32_t flags;
+    uint8_t  mtu_msgmax;
+    uint8_t  rq_entry_sz_log;
+    uint8_t  sq_entry_sz_log;
+    uint8_t  rlkey_sched_queue;
+    uint32_t usr_page;
+    uint32_t local_qpn;
+    uint32_t remote_qpn;
+    struct hgm_qp_path pri_path;
+    uint32_t reserved1[8];
+    uint32_t pd;
+    uint32_t wqe_base;
+    uint32_t wqe_lkey;
+    uint32_t reserved2;
+    uint32_t next_send_psn;
+    uint32_t cqn_snd;
+    uint32_t snd_wqe_base_l;
+    uint32_t snd_wqe_len;
+    uint32_t last_acked_psn;
+    uint32_t ssn;
+    uint32_t rnr_nextrecvpsn;
+    uint32_t ra_buff_indx;
+    uint32_t cqn_rcv;
+    uint32_t rcv_wqe_base_l;
+    uint32_t rcv_wqe_len;
+    uint32_t qkey;
+    uint32_t rmsn;
+    uint16_t rq_wqe_counter;
+    uint16_t sq_wqe_counter;
+} __attribute__((packed));
+
+struct hgm_qp_param {
+    uint32_t opt_param_mask;
+    uint32_t reserved1;
+    struct hgm_qp_context context;
+} __attribute__((packed));
+
+enum {
+    QP_STATE_RST = 0,
+    QP_STATE_INIT,
+    QP_STATE_RTR,
+    QP_STATE_RTS,
+    QP_STATE_SQE,
+    QP_STATE_SQD,
+    QP_STATE_ERR
+};
+
+enum {
+    QP_ST_RC = 0x0,
+    QP_ST_UC = 0x1,
+    QP_ST_UD = 0x3
+};
+
+/* WQE units, struct hgrnic_*_unit */
+enum {
+    NEXT_DBD       = 1 << 7,
+    NEXT_FENCE     = 1 << 6,
+    NEXT_VALID     = 1 << 5,
+    NEXT_CQ_UPDATE = 1 << 3,
+    NEXT_EVENT_GEN = 1 << 2,
+    NEXT_SOLICIT   = 1 << 1
+};
+
+#define INLINE_UNIT     (1U << 31)
+#define INVAL_LKEY      0x100
+
+struct hgm_next_unit {
+    uint32_t nda_nop;   /* [31:6] next WQE in 16-byte units, [4:0] next opcode */
+    uint32_t ee_nds;    /* [7] DBD, [6] fence, [5:0] next WQE size */
+    uint32_t flags;
+    uint32_t imm;
+};
+
+struct hgm_raddr_unit {
+    uint64_t raddr;
+    uint32_t rkey;
+    uint32_t reserved;
+};
+
+struct hgm_atomic_unit {
+    uint64_t swap_add;
+    uint64_t compare;
+};
+
+struct hgm_masked_atomic_unit {
+    uint64_t swap_add;
+    uint64_t compare;
+    uint64_t swap_add_mask;
+    uint64_t compare_mask;
+};
+
+struct hgm_ud_unit {
+    uint32_t port;
+    uint16_t slid;
+    uint16_t dlid;
+    uint32_t smac_h;
+    uint32_t dmac_h;
+    uint32_t rsvd1[4];
+    uint32_t dqpn;
+    uint32_t qkey;
+    uint32_t rsvd2[2];
+};
+
+struct hgm_data_unit {
+    uint32_t byte_count;
+    uint32_t lkey;
+    uint64_t addr;
+};
+
+struct hgm_fastreg_unit {
+    uint32_t flags;
+    uint32_t mem_key;
+    uint32_t page_size;
+    uint32_t pbl_len;
+    uint64_t start;
+    uint64_t length;
+    uint64_t pbl_addr;
+    uint64_t mtt_seg;
+};
+
+struct hgm_local_inv_unit {
+    uint32_t mem_key;
+    uint32_t reserved[3];
+};
+
+enum {
+    OP_NOP            = 0x00,
+    OP_RDMA_WRITE     = 0x08,
+    OP_RDMA_WRITE_IMM = 0x09,
+    OP_SEND           = 0x0a,
+    OP_SEND_IMM       = 0x0b,
+    OP_SEND_INV       = 0x0c,
+    OP_RDMA_READ      = 0x10,
+    OP_ATOMIC_CS      = 0x11,
+    OP_ATOMIC_FA      = 0x12,
+    OP_MASKED_CS      = 0x14,
+    OP_MASKED_FA      = 0x15,
+    OP_BIND_MW        = 0x18,
+    OP_FAST_REG       = 0x19,
+    OP_LOCAL_INV      = 0x1a,
+    OP_RECV_ERR       = 0xfe,
+    OP_SEND_ERR       = 0xff
+};
+
+/* Receive CQEs carry the BTH opcode; the driver masks it with 0x1f. */
+enum {
+    BTH_SEND_ONLY                = 0x04,
+    BTH_SEND_ONLY_WITH_IMM       = 0x05,
+    BTH_RDMA_WRITE_ONLY_WITH_IMM = 0x0b,
+    BTH_SEND_ONLY_WITH_INV       = 0x17
+};
+
+/* struct hgrnic_cqe / hgrnic_err_cqe */
+struct hgm_cqe {
+    uint32_t my_qpn;
+    uint32_t ts_lo;             /* timestamp, 0: the model has no clock */
+    uint32_t rqpn;
+    uint8_t  sl_ipok;
+    uint8_t  g_mlpath;
+    uint16_t rlid;
+    uint32_t imm;
+    uint32_t byte_cnt;
+    uint32_t wqe;
+    uint8_t  opcode;
+    uint8_t  is_send;
+    uint8_t  ts_hi;
+    uint8_t  owner;
+};
+
+struct hgm_err_cqe {
+    uint32_t my_qpn;
+    uint32_t reserved1[3];
+    uint8_t  syndrome;
+    uint8_t  vendor_err;
+    uint16_t db_cnt;
+    uint32_t reserved2;
+    uint32_t wqe;
+    uint8_t  opcode;
+    uint8_t  reserved3[2];
+    uint8_t  owner;
+};
+
+#define CQ_ENTRY_OWNER_HW   0x80
+
+enum {
+    SYNDROME_LOCAL_LENGTH_ERR     = 0x01,
+    SYNDROME_LOCAL_QP_OP_ERR      = 0x02,
+    SYNDROME_LOCAL_PROT_ERR       = 0x04,
+    SYNDROME_WR_FLUSH_ERR         = 0x05,
+    SYNDROME_REMOTE_INVAL_REQ_ERR = 0x12,
+    SYNDROME_REMOTE_ACCESS_ERR    = 0x13,
+    SYNDROME_REMOTE_OP_ERR        = 0x14,
+    SYNDROME_RETRY_EXC_ERR        = 0x15
+};
+
+/* Model state */
+
+struct hgm_mpt {
+    uint8_t  valid;
+    uint32_t flags;
+    uint32_t key;
+    uint32_t pd;
+    uint64_t start;
+    uint64_t length;
+    uint64_t mtt_seg;
+};
+
+struct hgm_cq {
+    uint8_t  valid;
+    uint8_t  log_size;
+    uint32_t lkey;
+    uint32_t pi;                /* next CQE written by the model */
+};
+
+struct hgm_srq {
+    uint8_t  valid;
+    uint8_t  log_size;          /* log2 of the number of WQEs */
+    uint8_t  wqe_log;           /* WQE size, log2 bytes */
+    uint16_t limit;             /* armed by ARM_SRQ; no EQ to report it */
+    uint32_t lkey;
+    uint32_t pd;
+    uint32_t ci;                /* next receive WQE, counts up */
+};
+
+/* A send doorbell not finished yet; the WQE it points to is next. */
+struct hgm_db {
+    uint32_t off;               /* byte offset of the WQE in the SQ */
+    uint32_t size;              /* in 16-byte units */
+    uint32_t op;
+    uint32_t done;              /* WQEs of this doorbell executed */
+};
+
+struct hgm_qp {
+    uint8_t  state;
+    uint8_t  st;
+    uint8_t  sq_log;            /* WQE size, log2 bytes */
+    uint8_t  rq_log;
+    uint32_t qpn;
+    uint32_t remote_qpn;
+    uint32_t pd;
+    uint32_t cqn_snd;
+    uint32_t cqn_rcv;
+    uint32_t sq_lkey;
+    uint32_t sq_len;            /* bytes */
+    uint32_t rq_lkey;
+    uint32_t rq_len;
+    uint32_t rq_ci;             /* next receive WQE, counts up */
+    uint8_t  has_srq;           /* receive WQEs come from srq[srqn] */
+    uint32_t srqn;
+    uint8_t  stalled;           /* head WQE waits for a receive WQE */
+
+    struct hgm_db *db;          /* FIFO of pending doorbells */
+    uint32_t db_head;
+    uint32_t db_count;
+    uint32_t db_max;
+
+    struct hgm_qp_param param;  /* returned by QUERY_QPEE */
+};
+
+struct hgm_dev {
+    struct hgm_config   cfg;
+    struct hgm_host_ops ops;
+    pthread_mutex_t     lock;
+
+    uint32_t            hcr[HGM_HCR_SIZE / 4];
+    int                 hca_open;
+
+    struct hgm_mpt     *mpt;
+    uint64_t           *mtt;
+    struct hgm_cq      *cq;
+    struct hgm_qp      *qp;
+    struct hgm_srq     *srq;
+
+    uint8_t            *bounce;     /* payload of the message in flight */
+    size_t              bounce_size;
+
+    struct hgm_stats    stats;
+
+    hgm_icm_trace_fn    icm_trace;
+    void               *icm_trace_priv;
+};
+
+static inline void hgm_icm_access(struct hgm_dev *dev, int type,
+                                  uint32_t index)
+{
+    if (dev->icm_trace)
+        dev->icm_trace(dev->icm_trace_priv, type, index);
+}
+
+static inline uint32_t hgm_qp_mask(const struct hgm_dev *dev)
+{
+    return (1U << dev->cfg.log_num_qps) - 1;
+}
+
+static inline uint32_t hgm_cq_mask(const struct hgm_dev *dev)
+{
+    return (1U << dev->cfg.log_num_cqs) - 1;
+}
+
+static inline uint32_t hgm_srq_mask(const struct hgm_dev *dev)
+{
+    return (1U << dev->cfg.log_num_srqs) - 1;
+}
+
+static inline uint32_t hgm_mpt_mask(const struct hgm_dev *dev)
+{
+    return (1U << dev->cfg.log_num_mpts) - 1;
+}
+
+static inline int hgm_dma_read(struct hgm_dev *dev, uint64_t addr,
+                               void *buf, size_t len)
+{
+    return dev->ops.dma_read(dev->ops.priv, addr, buf, len);
+}
+
+static inline int hgm_dma_write(struct hgm_dev *dev, uint64_t addr,
+                                const void *buf, size_t len)
+{
+    return dev->ops.dma_write(dev->ops.priv, addr, buf, len);
+}
+
+/* hgm_cmd.c */
+void hgm_cmd_exec(struct hgm_dev *dev);
+
+/* hgm_tpt.c */
+#define HGM_NO_PD   0xffffffffU
+
+int  hgm_tpt_copy(struct hgm_dev *dev, uint32_t key, uint32_t pd,
+                  uint32_t access, uint64_t va, void *buf, size_t len,
+                  int write);
+int  hgm_queue_copy(struct hgm_dev *dev, uint32_t key, uint64_t off,
+                    void *buf, size_t len, int write);
+int  hgm_fast_reg(struct hgm_dev *dev, const struct hgm_fastreg_unit *fr,
+                  uint32_t pd);
+int  hgm_invalidate(struct hgm_dev *dev, uint32_t key, uint32_t pd);
+
+/* hgm_qp.c */
+void hgm_qp_modify(struct hgm_dev *dev, struct hgm_qp *qp,
+                   const struct hgm_qp_param *param, uint8_t state);
+void hgm_qp_reset(struct hgm_qp *qp);
+void hgm_send_doorbell(struct hgm_dev *dev, uint32_t hi, uint32_t lo);
+int  hgm_qp_progress(struct hgm_dev *dev, struct hgm_qp *qp);
+
+#endif /* HGM_INT_H */
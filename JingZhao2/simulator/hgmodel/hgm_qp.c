@@ -0,0 +1,881 @@
+/*
+ * Send doorbells, WQE execution and CQE writes.
+ *
+ * A send doorbell names the first WQE of a batch; each WQE links the
+ * next one through its next unit (DBD set, non-zero size), at most
+ * HGM_MAX_WQES_PER_DB per doorbell. Every WQE is executed to the end
+ * before the next one is looked at, so fences hold trivially.
+ *
+ * Receive WQEs are posted without a doorbell: the model finds the next
+ * one at the receive queue's consumer index and takes it if its next
+ * unit has NEXT_VALID set, then clears that bit. An RC send that finds
+ * no receive WQE stays at the head of the send queue until a later
+ * doorbell or hgm_progress() finds one (RNR retry without a limit);
+ * UC and UD messages are dropped instead.
+ *
+ * The target of every transfer is a QP of the same device: remote_qpn
+ * of the QP context for RC/UC, dqpn of the UD unit for UD.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hgm_int.h"
+
+#define UD_MTU      4096
+
+enum {
+    WQE_DONE,
+    WQE_STALL,
+    WQE_ERROR
+};
+
+struct sge {
+    uint32_t len;
+    uint32_t lkey;
+    uint64_t addr;
+};
+
+/* A send WQE, decoded */
+struct send_wqe {
+    uint32_t off;
+    uint32_t op;
+    uint32_t flags;             /* NEXT_CQ_UPDATE, ... */
+    uint32_t imm;               /* as in the WQE */
+    uint32_t nda_nop;
+    uint32_t ee_nds;
+
+    uint64_t raddr;
+    uint32_t rkey;
+    struct hgm_masked_atomic_unit atomic;   /* plain atomics leave masks 0 */
+    uint32_t dqpn;
+    uint16_t slid;
+    struct hgm_fastreg_unit fastreg;
+    uint32_t inv_key;
+
+    const uint8_t *inl;         /* inline data, in buf */
+    uint32_t inl_len;
+    uint32_t nsge;
+    struct sge sge[HGM_MAX_SGE];
+    uint64_t len;               /* message length */
+
+    uint8_t  buf[HGM_MAX_WQE_SIZE];
+};
+
+struct recv_wqe {
+    uint32_t off;
+    uint32_t nsge;
+    struct sge sge[HGM_MAX_SGE];
+};
+
+/* The ring receive WQEs come from: the QP's own RQ or its SRQ. */
+struct recv_ring {
+    uint32_t  lkey;
+    uint32_t  n;
+    uint8_t   log;
+    uint32_t *ci;
+};
+
+static uint32_t sq_entries(const struct hgm_qp *qp)
+{
+    return qp->sq_len >> qp->sq_log;
+}
+
+static uint32_t rq_entries(const struct hgm_qp *qp)
+{
+    return qp->rq_log ? qp->rq_len >> qp->rq_log : 0;
+}
+
+static void recv_ring(struct hgm_dev *dev, struct hgm_qp *qp,
+                      struct recv_ring *q)
+{
+    struct hgm_srq *srq;
+
+    if (!qp->has_srq) {
+        q->lkey = qp->rq_lkey;
+        q->n    = rq_entries(qp);
+        q->log  = qp->rq_log;
+        q->ci   = &qp->rq_ci;
+        return;
+    }
+
+    srq = &dev->srq[qp->srqn & hgm_srq_mask(dev)];
+    q->lkey = srq->lkey;
+    q->n    = srq->valid ? 1U << srq->log_size : 0;
+    q->log  = srq->wqe_log;
+    q->ci   = &srq->ci;
+}
+
+/* CQEs */
+
+static void write_cqe(struct hgm_dev *dev, uint32_t cqn, void *entry)
+{
+    struct hgm_cq *cq = &dev->cq[cqn & hgm_cq_mask(dev)];
+    uint8_t *cqe = entry;
+    uint64_t off;
+    uint8_t owner;
+
+    hgm_icm_access(dev, HGM_ICM_CQC, cqn & hgm_cq_mask(dev));
+    if (!cq->valid)
+        return;
+
+    off = (uint64_t) (cq->pi & ((1U << cq->log_size) - 1)) * sizeof(struct hgm_cqe);
+
+    /* A slot software has not given back yet means the CQ is full. */
+    if (hgm_queue_copy(dev, cq->lkey, off + 31, &owner, 1, 0) ||
+        !(owner & CQ_ENTRY_OWNER_HW)) {
+        dev->stats.cq_overflows++;
+        return;
+    }
+
+    /* Contents first, then pass ownership to software. */
+    cqe[31] = 0;
+    hgm_queue_copy(dev, cq->lkey, off, cqe, 31, 1);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    hgm_queue_copy(dev, cq->lkey, off + 31, &cqe[31], 1, 1);
+
+    cq->pi++;
+    dev->stats.cqes++;
+}
+
+static void send_cqe(struct hgm_dev *dev, struct hgm_qp *qp,
+                     const struct send_wqe *w, uint32_t byte_cnt)
+{
+    struct hgm_cqe cqe;
+
+    memset(&cqe, 0, sizeof(cqe));
+    cqe.my_qpn   = htole32(qp->qpn);
+    cqe.byte_cnt = htole32(byte_cnt);
+    cqe.wqe      = htole32(w->off);
+    cqe.opcode   = w->op;
+    cqe.is_send  = 1;
+    write_cqe(dev, qp->cqn_snd, &cqe);
+}
+
+static void err_cqe(struct hgm_dev *dev, struct hgm_qp *qp, int is_send,
+                    uint32_t off, uint8_t syndrome)
+{
+    struct hgm_err_cqe cqe;
+
+    memset(&cqe, 0, sizeof(cqe));
+    cqe.my_qpn   = htole32(qp->qpn);
+    cqe.syndrome = syndrome;
+    cqe.wqe      = htole32(off);
+    cqe.opcode   = is_send ? OP_SEND_ERR : OP_RECV_ERR;
+    write_cqe(dev, is_send ? qp->cqn_snd : qp->cqn_rcv, &cqe);
+}
+
+/* WQE parsing */
+
+static int read_send_wqe(struct hgm_dev *dev, struct hgm_qp *qp,
+                         const struct hgm_db *db, struct send_wqe *w)
+{
+    const struct hgm_next_unit *next;
+    const uint8_t *p, *end;
+    uint32_t i;
+
+    w->off = db->off;
+    w->op  = db->op;
+    w->len = 0;
+    w->inl = NULL;
+    w->inl_len = 0;
+    w->nsge = 0;
+
+    if (db->size < 1 || db->size * 16 > (1U << qp->sq_log) ||
+        hgm_queue_copy(dev, qp->sq_lkey, db->off, w->buf, db->size * 16, 0))
+        return -1;
+
+    next       = (const void *) w->buf;
+    w->nda_nop = le32toh(next->nda_nop);
+    w->ee_nds  = le32toh(next->ee_nds);
+    w->flags   = le32toh(next->flags);
+    w->imm     = next->imm;
+
+    p   = w->buf + sizeof(struct hgm_next_unit);
+    end = w->buf + db->size * 16;
+
+    memset(&w->atomic, 0, sizeof(w->atomic));
+
+    if (qp->st == QP_ST_UD) {
+        const struct hgm_ud_unit *ud = (const void *) p;
+
+        if (p + sizeof(*ud) > end)
+            return -1;
+        w->dqpn = le32toh(ud->dqpn);
+        w->slid = le16toh(ud->slid);
+        p += sizeof(*ud);
+    } else {
+        switch (w->op) {
+        case OP_RDMA_WRITE:
+        case OP_RDMA_WRITE_IMM:
+        case OP_RDMA_READ:
+        case OP_ATOMIC_CS:
+        case OP_ATOMIC_FA:
+        case OP_MASKED_CS:
+        case OP_MASKED_FA: {
+            const struct hgm_raddr_unit *r = (const void *) p;
+
+            if (p + sizeof(*r) > end)
+                return -1;
+            w->raddr = le64toh(r->raddr);
+            w->rkey  = le32toh(r->rkey);
+            p += sizeof(*r);
+            break;
+        }
+        case OP_FAST_REG:
+            if (p + sizeof(w->fastreg) > end)
+                return -1;
+            memcpy(&w->fastreg, p, sizeof(w->fastreg));
+            p += sizeof(w->fastreg);
+            break;
+        case OP_LOCAL_INV: {
+            const struct hgm_local_inv_unit *inv = (const void *) p;
+
+            if (p + sizeof(*inv) > end)
+                return -1;
+            w->inv_key = le32toh(inv->mem_key);
+            p += sizeof(*inv);
+            break;
+        }
+        }
+
+        if (w->op == OP_ATOMIC_CS || w->op == OP_ATOMIC_FA) {
+            const struct hgm_atomic_unit *a = (const void *) p;
+
+            if (p + sizeof(*a) > end)
+                return -1;
+            w->atomic.swap_add = le64toh(a->swap_add);
+            w->atomic.compare  = le64toh(a->compare);
+            p += sizeof(*a);
+        } else if (w->op == OP_MASKED_CS || w->op == OP_MASKED_FA) {
+            const struct hgm_masked_atomic_unit *a = (const void *) p;
+
+            if (p + sizeof(*a) > end)
+                return -1;
+            w->atomic.swap_add      = le64toh(a->swap_add);
+            w->atomic.compare       = le64toh(a->compare);
+            w->atomic.swap_add_mask = le64toh(a->swap_add_mask);
+            w->atomic.compare_mask  = le64toh(a->compare_mask);
+            p += sizeof(*a);
+        }
+    }
+
+    if (w->op == OP_SEND_INV)
+        w->inv_key = le32toh(w->imm);
+
+    /* The rest is one inline unit or a gather list. */
+    if (p + 4 <= end && (le32toh(*(const uint32_t *) p) & INLINE_UNIT)) {
+        w->inl_len = le32toh(*(const uint32_t *) p) & ~INLINE_UNIT;
+        w->inl     = p + 4;
+        if (w->inl + w->inl_len > end)
+            return -1;
+        w->len = w->inl_len;
+        return 0;
+    }
+
+    for (i = 0; p + sizeof(struct hgm_data_unit) <= end; ++i) {
+        const struct hgm_data_unit *d = (const void *) p;
+
+        w->sge[i].len  = le32toh(d->byte_count);
+        w->sge[i].lkey = le32toh(d->lkey);
+        w->sge[i].addr = le64toh(d->addr);
+        w->len += w->sge[i].len;
+        p += sizeof(*d);
+    }
+    w->nsge = i;
+    return 0;
+}
+
+/*
+ * Look at the next receive WQE of qp, taken from its SRQ if it has one.
+ * Returns 0 and fills r if one is posted, 1 if the queue is empty.
+ */
+static int peek_recv_wqe(struct hgm_dev *dev, struct hgm_qp *qp,
+                         struct recv_wqe *r)
+{
+    uint8_t buf[HGM_MAX_WQE_SIZE];
+    const struct hgm_next_unit *next = (const void *) buf;
+    struct recv_ring q;
+    uint32_t size, i;
+
+    recv_ring(dev, qp, &q);
+    if (!q.n)
+        return 1;
+
+    size = 1U << q.log;
+    if (size > sizeof(buf))
+        size = sizeof(buf);
+
+    r->off = (*q.ci & (q.n - 1)) << q.log;
+    if (hgm_queue_copy(dev, q.lkey, r->off, buf, size, 0) ||
+        !(le32toh(next->nda_nop) & NEXT_VALID))
+        return 1;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    for (i = 0; 16 * (i + 2) <= size; ++i) {
+        const struct hgm_data_unit *d = (const void *) (buf + 16 * (i + 1));
+
+        if (le32toh(d->lkey) == INVAL_LKEY)
+            break;
+        r->sge[i].len  = le32toh(d->byte_count);
+        r->sge[i].lkey = le32toh(d->lkey);
+        r->sge[i].addr = le64toh(d->addr);
+    }
+    r->nsge = i;
+    return 0;
+}
+
+/* Hand the receive WQE back to software. */
+static void consume_recv_wqe(struct hgm_dev *dev, struct hgm_qp *qp,
+                             const struct recv_wqe *r)
+{
+    struct recv_ring q;
+    uint32_t zero = 0;
+
+    recv_ring(dev, qp, &q);
+    hgm_queue_copy(dev, q.lkey, r->off, &zero, sizeof(zero), 1);
+    (*q.ci)++;
+    dev->stats.recv_wqes++;
+}
+
+/* Data movement */
+
+static uint8_t *bounce(struct hgm_dev *dev, uint64_t len)
+{
+    uint8_t *p;
+
+    if (len <= dev->bounce_size)
+        return dev->bounce;
+    p = realloc(dev->bounce, len);
+    if (!p)
+        return NULL;
+    dev->bounce      = p;
+    dev->bounce_size = len;
+    return p;
+}
+
+static int gather(struct hgm_dev *dev, struct hgm_qp *qp,
+                  const struct send_wqe *w, uint8_t *data)
+{
+    uint32_t i;
+
+    if (w->inl) {
+        memcpy(data, w->inl, w->inl_len);
+        return 0;
+    }
+    for (i = 0; i < w->nsge; ++i) {
+        if (hgm_tpt_copy(dev, w->sge[i].lkey, qp->pd, 0, w->sge[i].addr,
+                         data, w->sge[i].len, 0))
+            return -1;
+        data += w->sge[i].len;
+    }
+    return 0;
+}
+
+/* Returns 0, or the syndrome for the side that owns the list. */
+static int scatter(struct hgm_dev *dev, uint32_t pd, const struct sge *sge,
+                   uint32_t nsge, const uint8_t *data, uint64_t len)
+{
+    uint64_t chunk;
+    uint32_t i;
+
+    for (i = 0; i < nsge && len; ++i) {
+        chunk = len < sge[i].len ? len : sge[i].len;
+        if (hgm_tpt_copy(dev, sge[i].lkey, pd, MPT_FLAG_LOCAL_WRITE,
+                         sge[i].addr, (void *) data, chunk, 1))
+            return SYNDROME_LOCAL_PROT_ERR;
+        data += chunk;
+        len  -= chunk;
+    }
+    return len ? SYNDROME_LOCAL_LENGTH_ERR : 0;
+}
+
+static struct hgm_qp *target_qp(struct hgm_dev *dev, struct hgm_qp *qp,
+                                const struct send_wqe *w)
+{
+    uint32_t qpn = qp->st == QP_ST_UD ? w->dqpn : qp->remote_qpn;
+    struct hgm_qp *d = &dev->qp[qpn & hgm_qp_mask(dev)];
+
+    hgm_icm_access(dev, HGM_ICM_QPC, qpn & hgm_qp_mask(dev));
+    if (d->st != qp->st ||
+        (d->state != QP_STATE_RTR && d->state != QP_STATE_RTS &&
+         d->state != QP_STATE_SQD))
+        return NULL;
+    return d;
+}
+
+static void qp_to_err(struct hgm_dev *dev, struct hgm_qp *qp);
+
+static void recv_cqe(struct hgm_dev *dev, struct hgm_qp *d,
+                     const struct hgm_qp *src, const struct send_wqe *w,
+                     const struct recv_wqe *r, uint8_t bth, uint32_t len)
+{
+    static const uint8_t transport[] = {
+        [QP_ST_RC] = 0x00, [QP_ST_UC] = 0x20, [QP_ST_UD] = 0x60
+    };
+    struct hgm_cqe cqe;
+
+    memset(&cqe, 0, sizeof(cqe));
+    cqe.my_qpn   = htole32(d->qpn);
+    cqe.rqpn     = htole32(src->qpn);
+    cqe.rlid     = htole16(w->slid);
+    cqe.byte_cnt = htole32(len);
+    cqe.wqe      = htole32(r->off);
+    cqe.opcode   = transport[d->st] | bth;
+    if (bth != BTH_SEND_ONLY)
+        cqe.imm = bth == BTH_SEND_ONLY_WITH_INV ? htole32(w->inv_key) : w->imm;
+    write_cqe(dev, d->cqn_rcv, &cqe);
+}
+
+/*
+ * Deliver a SEND or RDMA WRITE with immediate. Returns WQE_DONE,
+ * WQE_STALL, or WQE_ERROR with *syndrome set for the requester.
+ */
+static int deliver(struct hgm_dev *dev, struct hgm_qp *qp, struct hgm_qp *d,
+                   const struct send_wqe *w, const uint8_t *data,
+                   uint8_t *syndrome)
+{
+    struct recv_wqe r;
+    uint8_t bth;
+    int err = 0;
+
+    if (peek_recv_wqe(dev, d, &r)) {
+        if (qp->st != QP_ST_RC) {
+            dev->stats.drops++;
+            return WQE_DONE;
+        }
+        if (!qp->stalled)
+            dev->stats.rnr_stalls++;
+        qp->stalled = 1;
+        return WQE_STALL;
+    }
+
+    switch (w->op) {
+    case OP_RDMA_WRITE_IMM:
+        bth = BTH_RDMA_WRITE_ONLY_WITH_IMM;
+        break;
+    case OP_SEND_IMM:
+        bth = BTH_SEND_ONLY_WITH_IMM;
+        break;
+    case OP_SEND_INV:
+        bth = BTH_SEND_ONLY_WITH_INV;
+        if (hgm_invalidate(dev, w->inv_key, d->pd))
+            err = SYNDROME_REMOTE_INVAL_REQ_ERR;
+        break;
+    default:
+        bth = BTH_SEND_ONLY;
+        break;
+    }
+
+    if (!err && w->op != OP_RDMA_WRITE_IMM)
+        err = scatter(dev, d->pd, r.sge, r.nsge, data, w->len);
+
+    if (err) {
+        err_cqe(dev, d, 0, r.off, err);
+        consume_recv_wqe(dev, d, &r);
+        qp_to_err(dev, d);
+        if (qp->st != QP_ST_RC) {
+            dev->stats.drops++;
+            return WQE_DONE;
+        }
+        *syndrome = SYNDROME_REMOTE_INVAL_REQ_ERR;
+        return WQE_ERROR;
+    }
+
+    consume_recv_wqe(dev, d, &r);
+    recv_cqe(dev, d, qp, w, &r, bth, w->len);
+    return WQE_DONE;
+}
+
+/* Masked fetch-and-add: set bits of mask end a field, carries stop there. */
+static uint64_t masked_add(uint64_t a, uint64_t b, uint64_t mask)
+{
+    uint64_t sum = 0, carry = 0, x, y;
+    int i;
+
+    for (i = 0; i < 64; ++i) {
+        x = (a >> i) & 1;
+        y = (b >> i) & 1;
+        sum  |= (x ^ y ^ carry) << i;
+        carry = (x & y) | (carry & (x ^ y));
+        if ((mask >> i) & 1)
+            carry = 0;
+    }
+    return sum;
+}
+
+static int do_atomic(struct hgm_dev *dev, struct hgm_qp *qp, struct hgm_qp *d,
+                     const struct send_wqe *w, uint8_t *syndrome)
+{
+    const struct hgm_masked_atomic_unit *a = &w->atomic;
+    uint64_t old, val;
+
+    if (w->nsge != 1 || w->sge[0].len != 8 || (w->raddr & 7)) {
+        *syndrome = SYNDROME_REMOTE_INVAL_REQ_ERR;
+        return WQE_ERROR;
+    }
+    if (hgm_tpt_copy(dev, w->rkey, d->pd, MPT_FLAG_ATOMIC, w->raddr,
+                     &old, 8, 0)) {
+        *syndrome = SYNDROME_REMOTE_ACCESS_ERR;
+        return WQE_ERROR;
+    }
+
+    switch (w->op) {
+    case OP_ATOMIC_CS:
+        val = old == a->compare ? a->swap_add : old;
+        break;
+    case OP_ATOMIC_FA:
+        val = old + a->swap_add;
+        break;
+    case OP_MASKED_CS:
+        val = ((old ^ a->compare) & a->compare_mask) ? old :
+              (old & ~a->swap_add_mask) | (a->swap_add & a->swap_add_mask);
+        break;
+    default:
+        val = masked_add(old, a->swap_add, a->swap_add_mask);
+        break;
+    }
+
+    if (hgm_tpt_copy(dev, w->rkey, d->pd, MPT_FLAG_ATOMIC, w->raddr,
+                     &val, 8, 1)) {
+        *syndrome = SYNDROME_REMOTE_ACCESS_ERR;
+        return WQE_ERROR;
+    }
+    if (scatter(dev, qp->pd, w->sge, 1, (uint8_t *) &old, 8)) {
+        *syndrome = SYNDROME_LOCAL_PROT_ERR;
+        return WQE_ERROR;
+    }
+    return WQE_DONE;
+}
+
+static int exec_wqe(struct hgm_dev *dev, struct hgm_qp *qp,
+                    const struct send_wqe *w, uint8_t *syndrome,
+                    uint32_t *byte_cnt)
+{
+    struct hgm_qp *d = NULL;
+    uint8_t *data = NULL;
+    int ret;
+
+    *byte_cnt = 0;
+
+    switch (w->op) {
+    case OP_NOP:
+        return WQE_DONE;
+    case OP_FAST_REG:
+        if (hgm_fast_reg(dev, &w->fastreg, qp->pd))
+            goto local_prot;
+        return WQE_DONE;
+    case OP_LOCAL_INV:
+        if (hgm_invalidate(dev, w->inv_key, qp->pd))
+            goto local_prot;
+        return WQE_DONE;
+
+    case OP_SEND:
+    case OP_SEND_IMM:
+    case OP_SEND_INV:
+    case OP_RDMA_WRITE:
+    case OP_RDMA_WRITE_IMM:
+        if (qp->st == QP_ST_UD && (w->op != OP_SEND && w->op != OP_SEND_IMM))
+            break;
+        if (qp->st == QP_ST_UD && w->len > UD_MTU) {
+            *syndrome = SYNDROME_LOCAL_LENGTH_ERR;
+            return WQE_ERROR;
+        }
+        data = bounce(dev, w->len);
+        if (w->len && !data)
+            goto local_prot;
+        if (gather(dev, qp, w, data))
+            goto local_prot;
+
+        d = target_qp(dev, qp, w);
+        if (!d) {
+            if (qp->st != QP_ST_RC) {
+                dev->stats.drops++;
+                return WQE_DONE;
+            }
+            *syndrome = SYNDROME_RETRY_EXC_ERR;
+            return WQE_ERROR;
+        }
+
+        if (w->op == OP_RDMA_WRITE || w->op == OP_RDMA_WRITE_IMM) {
+            struct recv_wqe r;
+
+            /* Check for the receive WQE first, a stalled WRITE_IMM
+             * must not half happen. */
+            if (w->op == OP_RDMA_WRITE_IMM && peek_recv_wqe(dev, d, &r))
+                return deliver(dev, qp, d, w, data, syndrome);
+
+            if (hgm_tpt_copy(dev, w->rkey, d->pd, MPT_FLAG_REMOTE_WRITE,
+                             w->raddr, data, w->len, 1)) {
+                if (qp->st != QP_ST_RC) {
+                    dev->stats.drops++;
+                    return WQE_DONE;
+                }
+                *syndrome = SYNDROME_REMOTE_ACCESS_ERR;
+                return WQE_ERROR;
+            }
+            if (w->op == OP_RDMA_WRITE)
+                ret = WQE_DONE;
+            else
+                ret = deliver(dev, qp, d, w, data, syndrome);
+        } else {
+            ret = deliver(dev, qp, d, w, data, syndrome);
+        }
+        if (ret == WQE_DONE)
+            dev->stats.bytes += w->len;
+        return ret;
+
+    case OP_RDMA_READ:
+    case OP_ATOMIC_CS:
+    case OP_ATOMIC_FA:
+    case OP_MASKED_CS:
+    case OP_MASKED_FA:
+        if (qp->st != QP_ST_RC)
+            break;
+        d = target_qp(dev, qp, w);
+        if (!d) {
+            *syndrome = SYNDROME_RETRY_EXC_ERR;
+            return WQE_ERROR;
+        }
+        if (w->op != OP_RDMA_READ)
+            return do_atomic(dev, qp, d, w, syndrome);
+
+        data = bounce(dev, w->len);
+        if (w->len && !data)
+            goto local_prot;
+        if (hgm_tpt_copy(dev, w->rkey, d->pd, MPT_FLAG_REMOTE_READ,
+                         w->raddr, data, w->len, 0)) {
+            *syndrome = SYNDROME_REMOTE_ACCESS_ERR;
+            return WQE_ERROR;
+        }
+        if (scatter(dev, qp->pd, w->sge, w->nsge, data, w->len))
+            goto local_prot;
+        *byte_cnt = w->len;
+        dev->stats.bytes += w->len;
+        return WQE_DONE;
+    }
+
+    *syndrome = SYNDROME_LOCAL_QP_OP_ERR;
+    return WQE_ERROR;
+
+local_prot:
+    *syndrome = SYNDROME_LOCAL_PROT_ERR;
+    return WQE_ERROR;
+}
+
+/* Doorbell FIFO */
+
+static int db_push(struct hgm_qp *qp, const struct hgm_db *db)
+{
+    struct hgm_db *p;
+    uint32_t i, max;
+
+    if (qp->db_count == qp->db_max) {
+        max = qp->db_max ? qp->db_max * 2 : 4;
+        p = malloc(max * sizeof(*p));
+        if (!p)
+            return -1;
+        for (i = 0; i < qp->db_count; ++i)
+            p[i] = qp->db[(qp->db_head + i) % qp->db_max];
+        free(qp->db);
+        qp->db      = p;
+        qp->db_head = 0;
+        qp->db_max  = max;
+    }
+    qp->db[(qp->db_head + qp->db_count++) % qp->db_max] = *db;
+    return 0;
+}
+
+/* Move the head doorbell on to the WQE linked from w. */
+static void db_advance(struct hgm_qp *qp, const struct send_wqe *w)
+{
+    struct hgm_db *db = &qp->db[qp->db_head];
+    uint32_t nds = w->ee_nds & 0x3f;
+
+    if (++db->done < HGM_MAX_WQES_PER_DB && (w->ee_nds & NEXT_DBD) && nds) {
+        db->off  = ((w->nda_nop >> 6) << 4) % qp->sq_len;
+        db->size = nds;
+        db->op   = w->nda_nop & 0x1f;
+        return;
+    }
+    qp->db_head = (qp->db_head + 1) % qp->db_max;
+    qp->db_count--;
+}
+
+/* Complete everything still queued on qp with flush errors. */
+static void flush_qp(struct hgm_dev *dev, struct hgm_qp *qp)
+{
+    struct send_wqe *w;
+    struct recv_wqe r;
+    uint32_t n;
+
+    w = malloc(sizeof(*w));
+    while (qp->db_count) {
+        struct hgm_db *db = &qp->db[qp->db_head];
+
+        if (!w || read_send_wqe(dev, qp, db, w)) {
+            /* Unreadable chain: drop the rest of this doorbell. */
+            qp->db_head = (qp->db_head + 1) % qp->db_max;
+            qp->db_count--;
+            continue;
+        }
+        err_cqe(dev, qp, 1, db->off, SYNDROME_WR_FLUSH_ERR);
+        db_advance(qp, w);
+    }
+    free(w);
+    qp->stalled = 0;
+
+    /* WQEs left on an SRQ belong to it, not to this QP. */
+    if (qp->has_srq)
+        return;
+    for (n = rq_entries(qp); n && !peek_recv_wqe(dev, qp, &r); --n) {
+        err_cqe(dev, qp, 0, r.off, SYNDROME_WR_FLUSH_ERR);
+        consume_recv_wqe(dev, qp, &r);
+    }
+}
+
+static void qp_to_err(struct hgm_dev *dev, struct hgm_qp *qp)
+{
+    if (qp->state == QP_STATE_ERR)
+        return;
+    qp->state = QP_STATE_ERR;
+    flush_qp(dev, qp);
+}
+
+int hgm_qp_progress(struct hgm_dev *dev, struct hgm_qp *qp)
+{
+    struct send_wqe *w;
+    uint32_t byte_cnt;
+    uint8_t syndrome;
+    int n = 0, ret;
+
+    if (qp->state != QP_STATE_RTS || !qp->db_count)
+        return 0;
+
+    w = malloc(sizeof(*w));
+    if (!w)
+        return 0;
+
+    while (qp->db_count && qp->state == QP_STATE_RTS) {
+        struct hgm_db *db = &qp->db[qp->db_head];
+
+        hgm_icm_access(dev, HGM_ICM_QPC, (uint32_t) (qp - dev->qp));
+        if (read_send_wqe(dev, qp, db, w)) {
+            err_cqe(dev, qp, 1, db->off, SYNDROME_LOCAL_QP_OP_ERR);
+            qp->db_head = (qp->db_head + 1) % qp->db_max;
+            qp->db_count--;
+            qp_to_err(dev, qp);
+            break;
+        }
+
+        syndrome = 0;
+        ret = exec_wqe(dev, qp, w, &syndrome, &byte_cnt);
+        if (ret == WQE_STALL)
+            break;
+
+        /* A QP sending to itself may have been flushed by the
+         * receive side of this very WQE. */
+        if (qp->state != QP_STATE_RTS)
+            break;
+
+        qp->stalled = 0;
+        dev->stats.wqes++;
+        n++;
+
+        if (ret == WQE_ERROR) {
+            err_cqe(dev, qp, 1, w->off, syndrome);
+            db_advance(qp, w);
+            qp_to_err(dev, qp);
+            break;
+        }
+
+        if (w->flags & NEXT_CQ_UPDATE)
+            send_cqe(dev, qp, w, byte_cnt);
+        db_advance(qp, w);
+    }
+
+    free(w);
+    return n;
+}
+
+void hgm_send_doorbell(struct hgm_dev *dev, uint32_t hi, uint32_t lo)
+{
+    struct hgm_qp *qp = &dev->qp[(hi >> 8) & hgm_qp_mask(dev)];
+    struct hgm_db db;
+
+    dev->stats.send_dbs++;
+
+    /* Doorbells on a QP that cannot send yet are ignored. */
+    if (qp->state != QP_STATE_RTS && qp->state != QP_STATE_SQD &&
+        qp->state != QP_STATE_ERR)
+        return;
+    if (!qp->sq_len || !sq_entries(qp))
+        return;
+
+    db.off  = ((lo >> 8) << 4) % qp->sq_len;
+    db.size = hi & 0x3f;
+    db.op   = lo & 0x1f;
+    db.done = 0;
+    if (db_push(qp, &db))
+        return;
+
+    if (qp->state == QP_STATE_ERR)
+        flush_qp(dev, qp);
+    else
+        hgm_qp_progress(dev, qp);
+}
+
+void hgm_qp_reset(struct hgm_qp *qp)
+{
+    free(qp->db);
+    qp->db       = NULL;
+    qp->db_head  = 0;
+    qp->db_count = 0;
+    qp->db_max   = 0;
+    qp->rq_ci    = 0;
+    qp->stalled  = 0;
+}
+
+void hgm_qp_modify(struct hgm_dev *dev, struct hgm_qp *qp,
+                   const struct hgm_qp_param *param, uint8_t state)
+{
+    const struct hgm_qp_context *c;
+
+    if (param) {
+        c = &param->context;
+        qp->st         = (be32toh(c->flags) >> 16) & 0x7;
+        qp->sq_log     = c->sq_entry_sz_log;
+        qp->rq_log     = c->rq_entry_sz_log;
+        qp->remote_qpn = be32toh(c->remote_qpn) & 0xffffff;
+        qp->pd         = be32toh(c->pd);
+        qp->cqn_snd    = be32toh(c->cqn_snd) & 0xffffff;
+        qp->cqn_rcv    = be32toh(c->cqn_rcv) & 0xffffff;
+        qp->sq_lkey    = be32toh(c->snd_wqe_base_l);
+        qp->sq_len     = be32toh(c->snd_wqe_len);
+        qp->rq_lkey    = be32toh(c->rcv_wqe_base_l);
+        qp->rq_len     = be32toh(c->rcv_wqe_len);
+        qp->has_srq    = (be32toh(c->ra_buff_indx) >> 24) & 1;
+        qp->srqn       = be32toh(c->ra_buff_indx) & 0xffffff;
+        qp->param      = *param;
+    }
+
+    switch (state) {
+    case QP_STATE_RST:
+        hgm_qp_reset(qp);
+        qp->state = state;
+        break;
+    case QP_STATE_INIT:
+        if (qp->state == QP_STATE_RST)
+            hgm_qp_reset(qp);
+        qp->state = state;
+        break;
+    case QP_STATE_ERR:
+        qp_to_err(dev, qp);
+        break;
+    default:
+        qp->state = state;
+        /* Leaving SQD: run what was rung meanwhile. */
+        hgm_qp_progress(dev, qp);
+        break;
+    }
+}
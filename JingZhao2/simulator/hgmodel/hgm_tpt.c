@@ -0,0 +1,139 @@
+/*
+ * Address translation: key -> MPT entry -> MTT page address, in 4 KiB
+ * pages like the RTL regardless of the MR page size. Fast registration
+ * and local invalidation rewrite the same tables.
+ */
+
+#include <string.h>
+
+#include "hgm_int.h"
+
+static struct hgm_mpt *lookup(struct hgm_dev *dev, uint32_t key, uint32_t pd,
+                              uint32_t access, uint64_t va, size_t len)
+{
+    struct hgm_mpt *mpt = &dev->mpt[key & hgm_mpt_mask(dev)];
+
+    hgm_icm_access(dev, HGM_ICM_MPT, key & hgm_mpt_mask(dev));
+    if (!mpt->valid || mpt->key != key)
+        return NULL;
+    if (pd != HGM_NO_PD && mpt->pd != pd)
+        return NULL;
+    if ((mpt->flags & access) != access)
+        return NULL;
+    if (va < mpt->start || len > mpt->length ||
+        va - mpt->start > mpt->length - len)
+        return NULL;
+    return mpt;
+}
+
+/*
+ * Copy len bytes between buf and [va, va + len) of the region named by
+ * key. access lists the MPT_FLAG_* bits the region must grant; pd is
+ * HGM_NO_PD for the queues the driver registers for itself. Returns 0,
+ * or -1 if the key does not cover the range.
+ */
+int hgm_tpt_copy(struct hgm_dev *dev, uint32_t key, uint32_t pd,
+                 uint32_t access, uint64_t va, void *buf, size_t len,
+                 int write)
+{
+    struct hgm_mpt *mpt;
+    uint64_t page, bus, idx;
+    size_t chunk;
+    uint8_t *p = buf;
+
+    if (!len)
+        return 0;
+
+    mpt = lookup(dev, key, pd, access, va, len);
+    if (!mpt)
+        return -1;
+
+    while (len) {
+        chunk = HGM_PAGE_SIZE - (va & (HGM_PAGE_SIZE - 1));
+        if (chunk > len)
+            chunk = len;
+
+        if (mpt->flags & MPT_FLAG_PHYSICAL) {
+            bus = va;
+        } else {
+            idx = mpt->mtt_seg + (va >> HGM_PAGE_SHIFT) -
+                  (mpt->start >> HGM_PAGE_SHIFT);
+            if (idx >= dev->cfg.max_mtts)
+                return -1;
+            hgm_icm_access(dev, HGM_ICM_MTT, (uint32_t) idx);
+            page = dev->mtt[idx] & ~(uint64_t) (HGM_PAGE_SIZE - 1);
+            bus  = page | (va & (HGM_PAGE_SIZE - 1));
+        }
+
+        if (write ? hgm_dma_write(dev, bus, p, chunk) :
+                    hgm_dma_read(dev, bus, p, chunk))
+            return -1;
+
+        va  += chunk;
+        p   += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+/* Access to a work or completion queue at byte offset off of its MR. */
+int hgm_queue_copy(struct hgm_dev *dev, uint32_t key, uint64_t off,
+                   void *buf, size_t len, int write)
+{
+    struct hgm_mpt *mpt = &dev->mpt[key & hgm_mpt_mask(dev)];
+
+    hgm_icm_access(dev, HGM_ICM_MPT, key & hgm_mpt_mask(dev));
+    if (!mpt->valid)
+        return -1;
+    return hgm_tpt_copy(dev, key, HGM_NO_PD, 0, mpt->start + off,
+                        buf, len, write);
+}
+
+/*
+ * IB_WR_REG_MR: copy the page list into the MR's MTT range and rewrite
+ * its MPT entry with the new key, access and range.
+ */
+int hgm_fast_reg(struct hgm_dev *dev, const struct hgm_fastreg_unit *fr,
+                 uint32_t pd)
+{
+    uint32_t key   = le32toh(fr->mem_key);
+    uint32_t npages = le32toh(fr->pbl_len);
+    uint64_t seg   = le64toh(fr->mtt_seg);
+    struct hgm_mpt *mpt = &dev->mpt[key & hgm_mpt_mask(dev)];
+    uint64_t page;
+    uint32_t i;
+
+    /* The entry must be a free fast-reg MR of this PD; the key's low
+     * bits name it, the high bits may change. */
+    if ((mpt->key & hgm_mpt_mask(dev)) != (key & hgm_mpt_mask(dev)) ||
+        mpt->pd != pd || seg + npages > dev->cfg.max_mtts)
+        return -1;
+
+    for (i = 0; i < npages; ++i) {
+        if (hgm_dma_read(dev, le64toh(fr->pbl_addr) + i * 8ULL,
+                         &page, sizeof(page)))
+            return -1;
+        dev->mtt[seg + i] = be64toh(page);
+    }
+
+    mpt->flags   = le32toh(fr->flags);
+    mpt->key     = key;
+    mpt->start   = le64toh(fr->start);
+    mpt->length  = le64toh(fr->length);
+    mpt->mtt_seg = seg;
+    mpt->valid   = 1;
+    return 0;
+}
+
+/* IB_WR_LOCAL_INV and SEND_WITH_INV: the key stops working until the
+ * next fast registration. */
+int hgm_invalidate(struct hgm_dev *dev, uint32_t key, uint32_t pd)
+{
+    struct hgm_mpt *mpt = &dev->mpt[key & hgm_mpt_mask(dev)];
+
+    hgm_icm_access(dev, HGM_ICM_MPT, key & hgm_mpt_mask(dev));
+    if (!mpt->valid || mpt->key != key || mpt->pd != pd)
+        return -1;
+    mpt->valid = 0;
+    return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * Device lifecycle and the MMIO entry points.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hgm_int.h"
+
+/* ceu_def_h.vh */
+#define RTL_MAX_QPS         8
+#define RTL_MAX_CQS         8
+#define RTL_MAX_MPTS        14
+#define RTL_MAX_QP_SZ       13
+#define RTL_MAX_CQ_SZ       13
+#define HGM_LOG_NUM_SRQS    8       /* the RTL has no SRQs */
+#define RTL_DEV_CAP_FLAGS   0x00000007
+#define RTL_HCA_CLOCK_KHZ   50000
+#define RTL_BOARD_ID        0x0123456789abcdefULL
+
+static int identity_read(void *priv, uint64_t addr, void *buf, size_t len)
+{
+    (void) priv;
+    memcpy(buf, (const void *) (uintptr_t) addr, len);
+    return 0;
+}
+
+static int identity_write(void *priv, uint64_t addr, const void *buf, size_t len)
+{
+    (void) priv;
+    memcpy((void *) (uintptr_t) addr, buf, len);
+    return 0;
+}
+
+const struct hgm_host_ops hgm_identity_ops = {
+    .dma_read  = identity_read,
+    .dma_write = identity_write,
+    .priv      = NULL
+};
+
+void hgm_default_config(struct hgm_config *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->log_num_qps   = RTL_MAX_QPS;
+    cfg->log_num_cqs   = RTL_MAX_CQS;
+    cfg->log_num_mpts  = RTL_MAX_MPTS;
+    cfg->log_max_wqes  = RTL_MAX_QP_SZ;
+    cfg->log_max_cqes  = RTL_MAX_CQ_SZ;
+    cfg->log_num_srqs  = HGM_LOG_NUM_SRQS;
+    cfg->max_mtts      = 1U << 20;
+    cfg->dev_cap_flags = RTL_DEV_CAP_FLAGS;
+    cfg->hca_clock_khz = RTL_HCA_CLOCK_KHZ;
+    cfg->board_id      = RTL_BOARD_ID;
+}
+
+struct hgm_dev *hgm_create(const struct hgm_config *cfg,
+                           const struct hgm_host_ops *ops)
+{
+    struct hgm_dev *dev;
+
+    dev = calloc(1, sizeof(*dev));
+    if (!dev)
+        return NULL;
+
+    if (cfg)
+        dev->cfg = *cfg;
+    else
+        hgm_default_config(&dev->cfg);
+    dev->ops = ops ? *ops : hgm_identity_ops;
+
+    if (dev->cfg.log_num_qps > 24 || dev->cfg.log_num_cqs > 24 ||
+        dev->cfg.log_num_mpts > 24 || dev->cfg.log_num_srqs > 24 ||
+        !dev->cfg.max_mtts)
+        goto err;
+
+    dev->mpt = calloc(1UL << dev->cfg.log_num_mpts, sizeof(*dev->mpt));
+    dev->mtt = calloc(dev->cfg.max_mtts, sizeof(*dev->mtt));
+    dev->cq  = calloc(1UL << dev->cfg.log_num_cqs,  sizeof(*dev->cq));
+    dev->qp  = calloc(1UL << dev->cfg.log_num_qps,  sizeof(*dev->qp));
+    dev->srq = calloc(1UL << dev->cfg.log_num_srqs, sizeof(*dev->srq));
+    if (!dev->mpt || !dev->mtt || !dev->cq || !dev->qp || !dev->srq)
+        goto err;
+
+    pthread_mutex_init(&dev->lock, NULL);
+    return dev;
+
+err:
+    free(dev->mpt);
+    free(dev->mtt);
+    free(dev->cq);
+    free(dev->qp);
+    free(dev->srq);
+    free(dev);
+    return NULL;
+}
+
+void hgm_destroy(struct hgm_dev *dev)
+{
+    uint32_t i;
+
+    if (!dev)
+        return;
+
+    for (i = 0; i <= hgm_qp_mask(dev); ++i)
+        free(dev->qp[i].db);
+    pthread_mutex_destroy(&dev->lock);
+    free(dev->bounce);
+    free(dev->mpt);
+    free(dev->mtt);
+    free(dev->cq);
+    free(dev->qp);
+    free(dev->srq);
+    free(dev);
+}
+
+/*
+ * Writing the status word with the go bit set runs the command. It
+ * completes before the write returns, so the driver never sees the go
+ * bit set when it reads the word back.
+ */
+void hgm_hcr_write32(struct hgm_dev *dev, uint32_t offset, uint32_t val)
+{
+    if (offset >= HGM_HCR_SIZE || (offset & 3))
+        return;
+
+    pthread_mutex_lock(&dev->lock);
+    dev->hcr[offset / 4] = val;
+    if (offset == HCR_STATUS_OFFSET && (val & (1U << HCR_GO_BIT)))
+        hgm_cmd_exec(dev);
+    pthread_mutex_unlock(&dev->lock);
+}
+
+uint32_t hgm_hcr_read32(struct hgm_dev *dev, uint32_t offset)
+{
+    uint32_t val;
+
+    if (offset >= HGM_HCR_SIZE || (offset & 3))
+        return 0;
+
+    pthread_mutex_lock(&dev->lock);
+    val = dev->hcr[offset / 4];
+    pthread_mutex_unlock(&dev->lock);
+    return val;
+}
+
+void hgm_uar_write64(struct hgm_dev *dev, uint32_t offset, uint64_t val)
+{
+    pthread_mutex_lock(&dev->lock);
+    switch (offset) {
+    case HGM_SEND_DOORBELL:
+        hgm_send_doorbell(dev, val >> 32, (uint32_t) val);
+        break;
+    case HGM_CQ_DOORBELL:
+    case HGM_EQ_DOORBELL:
+        /* Arming: there are no events. */
+        break;
+    default:
+        break;
+    }
+    pthread_mutex_unlock(&dev->lock);
+}
+
+int hgm_progress(struct hgm_dev *dev)
+{
+    uint32_t i;
+    int n = 0;
+
+    pthread_mutex_lock(&dev->lock);
+    for (i = 0; i <= hgm_qp_mask(dev); ++i)
+        if (dev->qp[i].db_count)
+            n += hgm_qp_progress(dev, &dev->qp[i]);
+    pthread_mutex_unlock(&dev->lock);
+    return n;
+}
+
+void hgm_get_stats(struct hgm_dev *dev, struct hgm_stats *stats)
+{
+    pthread_mutex_lock(&dev->lock);
+    *stats = dev->stats;
+    pthread_mutex_unlock(&dev->lock);
+}
+
+void hgm_set_icm_trace(struct hgm_dev *dev, hgm_icm_trace_fn fn, void *priv)
+{
+    pthread_mutex_lock(&dev->lock);
+    dev->icm_trace      = fn;
+    dev->icm_trace_priv = priv;
+    pthread_mutex_unlock(&dev->lock);
+}
+
+void hgm_icm_trace_file(void *priv, int type, uint32_t index)
+{
+    static const char *const name[] = {
+        [HGM_ICM_QPC] = "qpc", [HGM_ICM_CQC] = "cqc", [HGM_ICM_EQC] = "eqc",
+        [HGM_ICM_MPT] = "mpt", [HGM_ICM_MTT] = "mtt"
+    };
+
+    if (type < HGM_ICM_QPC || type > HGM_ICM_MTT)
+        return;
+    fprintf(priv, "%s %u\n", name[type], index);
+}
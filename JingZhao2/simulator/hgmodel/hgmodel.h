@@ -0,0 +1,132 @@
+/*
+ * hgmodel: a functional software model of the HGRNIC host interface.
+ *
+ * The model implements what ib_hgrnic and libhgrnic see of the HCA:
+ * the HCR command interface in BAR0, the send/CQ doorbells in the UAR
+ * page, SQ/RQ WQE parsing, CQE writes with the owner bit, and RC/UC/UD
+ * transfers between QPs of the same device (loopback). It is driven
+ * by an MMIO frontend, such as hgshim, which runs libhgrnic's datapath
+ * on it, or directly by a test program.
+ *
+ * It is a functional model only: commands complete synchronously in
+ * the HCR write that sets the go bit, WQEs are executed in the
+ * doorbell write, and there are no EQs or interrupts.
+ */
+
+#ifndef HGMODEL_H
+#define HGMODEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* BAR0 */
+#define HGM_HCR_BASE            0x0
+#define HGM_HCR_SIZE            0x1c
+
+/* UAR page, as decoded by rdma_uar.v */
+#define HGM_SEND_DOORBELL       0x00
+#define HGM_CQ_DOORBELL         0x10    /* CQ arm, CQN in the low bits */
+#define HGM_EQ_DOORBELL         0x20    /* EQ arm, EQN in the low bits */
+
+/*
+ * Host memory access. Addresses are bus addresses as the driver puts
+ * them into mailboxes and MTTs. Both return 0 on success.
+ */
+struct hgm_host_ops {
+    int  (*dma_read)(void *priv, uint64_t addr, void *buf, size_t len);
+    int  (*dma_write)(void *priv, uint64_t addr, const void *buf, size_t len);
+    void *priv;
+};
+
+/* Host ops for a model that shares the address space with the driver
+ * under test: bus address == pointer. */
+extern const struct hgm_host_ops hgm_identity_ops;
+
+/*
+ * Device configuration. hgm_default_config() fills in the limits the
+ * RTL reports in QUERY_DEV_LIM (ceu_def_h.vh).
+ */
+struct hgm_config {
+    uint8_t  log_num_qps;
+    uint8_t  log_num_cqs;
+    uint8_t  log_num_mpts;
+    uint8_t  log_max_wqes;      /* per WQ */
+    uint8_t  log_max_cqes;      /* per CQ */
+    uint8_t  log_num_srqs;      /* used if dev_cap_flags has the SRQ bit */
+    uint32_t max_mtts;          /* MTT entries kept by the model */
+    uint32_t dev_cap_flags;     /* DEV_LIM_FLAG_* */
+    uint32_t hca_clock_khz;     /* reported only, the model stamps 0 */
+    uint64_t board_id;
+};
+
+struct hgm_stats {
+    uint64_t cmds;
+    uint64_t cmd_errors;
+    uint64_t send_dbs;
+    uint64_t wqes;              /* send WQEs executed */
+    uint64_t recv_wqes;         /* receive WQEs consumed */
+    uint64_t cqes;
+    uint64_t cq_overflows;      /* CQEs dropped: slot still owned by SW */
+    uint64_t rnr_stalls;        /* RC sends that found no receive WQE */
+    uint64_t drops;             /* UC/UD messages dropped at the target */
+    uint64_t bytes;             /* payload moved */
+};
+
+struct hgm_dev;
+
+void hgm_default_config(struct hgm_config *cfg);
+
+/* ops == NULL selects hgm_identity_ops; cfg == NULL the defaults. */
+struct hgm_dev *hgm_create(const struct hgm_config *cfg,
+                           const struct hgm_host_ops *ops);
+void hgm_destroy(struct hgm_dev *dev);
+
+/*
+ * BAR0 accesses, offset relative to the HCR. Values are the 32-bit
+ * little endian words as they appear on the bus, i.e. what the driver
+ * passes to cpu_to_le32() / gets from le32_to_cpu().
+ */
+void     hgm_hcr_write32(struct hgm_dev *dev, uint32_t offset, uint32_t val);
+uint32_t hgm_hcr_read32(struct hgm_dev *dev, uint32_t offset);
+
+/* 64-bit UAR doorbell write, val = (hi << 32) | lo as in hgrnic_write64(). */
+void hgm_uar_write64(struct hgm_dev *dev, uint32_t offset, uint64_t val);
+
+/*
+ * Retry work that is waiting on host memory: RC sends stalled on an
+ * empty receive queue (receive WQEs are posted without a doorbell).
+ * Returns the number of WQEs completed. Frontends call this from their
+ * polling loop or a timer.
+ */
+int hgm_progress(struct hgm_dev *dev);
+
+void hgm_get_stats(struct hgm_dev *dev, struct hgm_stats *stats);
+
+/*
+ * ICM access trace: the context and translation entries the model
+ * reads, in the order the RTL would look them up in its ICMCache
+ * instances. That is the QPC of the sending QP per WQE and of the
+ * target QP per message, the CQC per CQE, and the MPT plus one MTT
+ * entry per 4 KiB page for every memory access. type uses the RTL's
+ * CACHE_TYPE_* numbering (protocol_engine_def.vh). EQs are not
+ * modelled, so HGM_ICM_EQC never appears.
+ */
+#define HGM_ICM_QPC     1
+#define HGM_ICM_CQC     2
+#define HGM_ICM_EQC     3
+#define HGM_ICM_MPT     4
+#define HGM_ICM_MTT     5
+
+typedef void (*hgm_icm_trace_fn)(void *priv, int type, uint32_t index);
+
+/* fn == NULL turns the trace off. fn runs with the device lock held. */
+void hgm_set_icm_trace(struct hgm_dev *dev, hgm_icm_trace_fn fn, void *priv);
+
+/*
+ * A hgm_icm_trace_fn that appends "<type> <index>" lines ("qpc 12") to
+ * the FILE * passed as priv, the format the Verilator ICMCache bench
+ * replays.
+ */
+void hgm_icm_trace_file(void *priv, int type, uint32_t index);
+
+#endif /* HGMODEL_H */
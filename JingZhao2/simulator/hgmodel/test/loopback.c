@@ -0,0 +1,537 @@
+/*
+ * Loopback regression test of the model, run by "make check".
+ *
+ * Drives the HCR and the UAR page the way ib_hgrnic and libhgrnic do:
+ * QUERY_DEV_LIM/INIT_HCA, MTT and MPT setup, CQs and QPs brought to
+ * RTS with the QPEE commands, send WQEs chained with next units and
+ * rung with one doorbell, receive WQEs marked valid in host memory.
+ * Checks data, CQEs and the error/flush paths for RC, UC and UD.
+ * Host memory is this process' memory (hgm_identity_ops).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hgm_int.h"
+
+#define CHECK(cond) do {                                                \
+        if (!(cond)) {                                                  \
+            fprintf(stderr, "%s:%d: check failed: %s\n",                \
+                    __FILE__, __LINE__, #cond);                         \
+            exit(1);                                                    \
+        }                                                               \
+    } while (0)
+
+#define SQ_ENTRY_LOG    7
+#define RQ_ENTRY_LOG    6
+#define WQ_DEPTH        64
+#define TEST_PD         1
+
+static struct hgm_dev *dev;
+static uint32_t next_mpt = 1;
+static uint32_t next_mtt;
+
+/* One HCR command with polled completion, returns the status. */
+static int cmd(uint16_t op, void *in, uint32_t mod, void *out)
+{
+    uint64_t in_param  = (uintptr_t) in;
+    uint64_t out_param = (uintptr_t) out;
+
+    hgm_hcr_write32(dev, 0x00, in_param >> 32);
+    hgm_hcr_write32(dev, 0x04, (uint32_t) in_param);
+    hgm_hcr_write32(dev, 0x08, mod);
+    hgm_hcr_write32(dev, 0x0c, out_param >> 32);
+    hgm_hcr_write32(dev, 0x10, (uint32_t) out_param);
+    hgm_hcr_write32(dev, 0x14, 0xffffU << 16);
+    hgm_hcr_write32(dev, 0x18, (1U << 23) | op);    /* go */
+
+    CHECK(!(hgm_hcr_read32(dev, 0x18) & (1U << 23)));
+    return hgm_hcr_read32(dev, 0x18) >> 24;
+}
+
+/* WRITE_MTT for the pages of buf, then SW2HW_MPT. Returns the key. */
+static uint32_t reg_mr(void *buf, size_t len, uint32_t flags, uint32_t pd)
+{
+    struct hgm_mpt_entry mpt;
+    uint64_t mailbox[HGM_MAILBOX_SIZE / 8];
+    uint64_t va    = (uintptr_t) buf;
+    uint64_t first = va & ~(HGM_PAGE_SIZE - 1);
+    uint32_t npages = (va + len - first + HGM_PAGE_SIZE - 1) >> HGM_PAGE_SHIFT;
+    uint32_t key = next_mpt++;
+    uint32_t i;
+
+    CHECK(npages <= HGM_MAILBOX_SIZE / 8 - 4);
+
+    /* Mailbox: MTT index at word 3, then the page addresses, each
+     * group of four in reverse order as hgrnic_write_mtt() lays them out */
+    memset(mailbox, 0, sizeof(mailbox));
+    mailbox[3] = htobe64(next_mtt);
+    for (i = 0; i < npages; ++i)
+        mailbox[4 + (i & ~3U) + 3 - (i & 3)] =
+            htobe64(first + ((uint64_t) i << HGM_PAGE_SHIFT));
+    CHECK(cmd(CMD_WRITE_MTT, mailbox, npages, NULL) == CMD_STAT_OK);
+
+    memset(&mpt, 0, sizeof(mpt));
+    mpt.flags   = htobe32(flags | MPT_FLAG_LOCAL_READ);
+    mpt.key     = htobe32(key);
+    mpt.pd      = htobe32(pd);
+    mpt.start   = htobe64(va);
+    mpt.length  = htobe64(len);
+    mpt.mtt_seg = htobe64(next_mtt);
+    CHECK(cmd(CMD_SW2HW_MPT, &mpt, key, NULL) == CMD_STAT_OK);
+
+    next_mtt += npages;
+    return key;
+}
+
+struct test_cq {
+    struct hgm_cqe *buf;
+    uint32_t        nent;
+    uint32_t        ci;
+    uint32_t        cqn;
+};
+
+static void create_cq(struct test_cq *cq, uint32_t cqn, int log_nent)
+{
+    struct hgm_cq_context ctx;
+    size_t len;
+    uint32_t i;
+
+    cq->nent = 1U << log_nent;
+    cq->ci   = 0;
+    cq->cqn  = cqn;
+
+    len = cq->nent * sizeof(struct hgm_cqe);
+    if (len < HGM_PAGE_SIZE)
+        len = HGM_PAGE_SIZE;
+    cq->buf = aligned_alloc(HGM_PAGE_SIZE, len);
+    CHECK(cq->buf);
+    memset(cq->buf, 0, len);
+    for (i = 0; i < cq->nent; ++i)
+        cq->buf[i].owner = CQ_ENTRY_OWNER_HW;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.logsize_usrpage = htobe32(log_nent << 24);
+    ctx.lkey = htobe32(reg_mr(cq->buf, len, MPT_FLAG_LOCAL_WRITE, 0));
+    ctx.cqn  = htobe32(cqn);
+    CHECK(cmd(CMD_SW2HW_CQ, &ctx, cqn, NULL) == CMD_STAT_OK);
+
+    /* Arm it as hgrnic_arm_cq() does: CQN in the low bits at 0x10 */
+    hgm_uar_write64(dev, HGM_CQ_DOORBELL, cqn);
+}
+
+static struct hgm_cqe *peek_cqe(struct test_cq *cq)
+{
+    struct hgm_cqe *cqe = &cq->buf[cq->ci & (cq->nent - 1)];
+
+    return cqe->owner & CQ_ENTRY_OWNER_HW ? NULL : cqe;
+}
+
+static void consume_cqe(struct test_cq *cq)
+{
+    cq->buf[cq->ci & (cq->nent - 1)].owner = CQ_ENTRY_OWNER_HW;
+    cq->ci++;
+}
+
+struct test_qp {
+    uint32_t  qpn;
+    uint32_t  st;
+    uint8_t  *sq;
+    uint8_t  *rq;
+    uint32_t  sq_head;
+    uint32_t  rq_head;
+    void     *last;     /* last send WQE, its next unit links the chain */
+};
+
+static void create_qp(struct test_qp *qp, uint32_t qpn, uint32_t st,
+                      uint32_t remote_qpn, struct test_cq *scq,
+                      struct test_cq *rcq)
+{
+    static const uint16_t ops[] = {
+        CMD_RST2INIT_QPEE, CMD_INIT2RTR_QPEE, CMD_RTR2RTS_QPEE
+    };
+    struct hgm_qp_param param;
+    struct hgm_qp_context *ctx = &param.context;
+    size_t sq_len = WQ_DEPTH << SQ_ENTRY_LOG;
+    size_t rq_len = WQ_DEPTH << RQ_ENTRY_LOG;
+    int i;
+
+    memset(qp, 0, sizeof(*qp));
+    qp->qpn = qpn;
+    qp->st  = st;
+    qp->sq  = aligned_alloc(HGM_PAGE_SIZE, sq_len);
+    qp->rq  = aligned_alloc(HGM_PAGE_SIZE, rq_len);
+    CHECK(qp->sq && qp->rq);
+    memset(qp->sq, 0, sq_len);
+    memset(qp->rq, 0, rq_len);
+
+    memset(&param, 0, sizeof(param));
+    ctx->sq_entry_sz_log = SQ_ENTRY_LOG;
+    ctx->rq_entry_sz_log = RQ_ENTRY_LOG;
+    ctx->local_qpn       = htobe32(qpn);
+    ctx->remote_qpn      = htobe32(remote_qpn);
+    ctx->pd              = htobe32(TEST_PD);
+    ctx->cqn_snd         = htobe32(scq->cqn);
+    ctx->cqn_rcv         = htobe32(rcq->cqn);
+    ctx->snd_wqe_base_l  = htobe32(reg_mr(qp->sq, sq_len, MPT_FLAG_LOCAL_WRITE, TEST_PD));
+    ctx->snd_wqe_len     = htobe32(sq_len);
+    ctx->rcv_wqe_base_l  = htobe32(reg_mr(qp->rq, rq_len, MPT_FLAG_LOCAL_WRITE, TEST_PD));
+    ctx->rcv_wqe_len     = htobe32(rq_len);
+
+    for (i = 0; i < 3; ++i) {
+        ctx->flags = htobe32(((i + 1) << 28) | (st << 16));
+        CHECK(cmd(ops[i], &param, qpn, NULL) == CMD_STAT_OK);
+    }
+}
+
+static void destroy_qp(struct test_qp *qp)
+{
+    free(qp->sq);
+    free(qp->rq);
+}
+
+/* One scatter entry and an invalid-lkey terminator, then mark it valid. */
+static void post_recv(struct test_qp *qp, void *addr, uint32_t len, uint32_t lkey)
+{
+    uint32_t ind = qp->rq_head++ & (WQ_DEPTH - 1);
+    uint8_t *wqe = qp->rq + (ind << RQ_ENTRY_LOG);
+    struct hgm_next_unit *next = (void *) wqe;
+    struct hgm_data_unit *data = (void *) (wqe + sizeof(*next));
+
+    data[0].byte_count = htole32(len);
+    data[0].lkey       = htole32(lkey);
+    data[0].addr       = htole64((uintptr_t) addr);
+    data[1].lkey       = htole32(INVAL_LKEY);
+    next->ee_nds = 0;
+    next->flags  = 0;
+    __atomic_store_n(&next->nda_nop, htole32(NEXT_VALID), __ATOMIC_RELEASE);
+}
+
+struct test_wr {
+    uint32_t  opcode;
+    int       signaled;
+    int       inline_data;
+    void     *addr;
+    uint32_t  len;
+    uint32_t  lkey;
+    uint64_t  raddr;
+    uint32_t  rkey;
+    uint64_t  swap_add;
+    uint64_t  compare;
+    uint32_t  dqpn;
+};
+
+/* Build n send WQEs in the hgrnic_post_send() layout, ring one doorbell. */
+static void post_send(struct test_qp *qp, const struct test_wr *wr, int n)
+{
+    uint32_t first = qp->sq_head & (WQ_DEPTH - 1);
+    uint32_t size0 = 0, op0 = 0, ind, size, hi, lo;
+    struct hgm_next_unit *next, *prev;
+    uint8_t *wqe, *unit;
+    int k;
+
+    for (k = 0; k < n; ++k) {
+        ind  = (qp->sq_head + k) & (WQ_DEPTH - 1);
+        wqe  = qp->sq + (ind << SQ_ENTRY_LOG);
+        next = (void *) wqe;
+        unit = wqe + sizeof(*next);
+
+        next->nda_nop = 0;
+        next->ee_nds  = 0;
+        next->flags   = htole32(wr[k].signaled ? NEXT_CQ_UPDATE : 0);
+        next->imm     = htobe32(0x1234);
+
+        if (qp->st == QP_ST_UD) {
+            struct hgm_ud_unit *ud = (void *) unit;
+
+            memset(ud, 0, sizeof(*ud));
+            ud->dqpn = htole32(wr[k].dqpn);
+            unit += sizeof(*ud);
+        } else if (wr[k].opcode != OP_SEND && wr[k].opcode != OP_SEND_IMM) {
+            struct hgm_raddr_unit *raddr = (void *) unit;
+
+            raddr->raddr    = htole64(wr[k].raddr);
+            raddr->rkey     = htole32(wr[k].rkey);
+            raddr->reserved = 0;
+            unit += sizeof(*raddr);
+
+            if (wr[k].opcode == OP_ATOMIC_CS || wr[k].opcode == OP_ATOMIC_FA) {
+                struct hgm_atomic_unit *atomic = (void *) unit;
+
+                atomic->swap_add = htole64(wr[k].swap_add);
+                atomic->compare  = htole64(wr[k].compare);
+                unit += sizeof(*atomic);
+            }
+        }
+
+        if (wr[k].inline_data) {
+            *(uint32_t *) unit = htole32(wr[k].len | INLINE_UNIT);
+            memcpy(unit + 4, wr[k].addr, wr[k].len);
+            unit += (wr[k].len + 4 + 15) & ~15U;
+        } else {
+            struct hgm_data_unit *data = (void *) unit;
+
+            data->byte_count = htole32(wr[k].len);
+            data->lkey       = htole32(wr[k].lkey);
+            data->addr       = htole64((uintptr_t) wr[k].addr);
+            unit += sizeof(*data);
+        }
+
+        size = (unit - wqe) / 16;
+        if (!k) {
+            size0 = size;
+            op0   = wr[k].opcode;
+        } else {
+            prev = qp->last;
+            prev->nda_nop = htole32(((ind << (SQ_ENTRY_LOG - 4)) << 6) | wr[k].opcode);
+            prev->ee_nds  = htole32(NEXT_DBD | size);
+        }
+        qp->last = wqe;
+    }
+    qp->sq_head += n;
+
+    hi = (qp->qpn << 8) | size0;
+    lo = ((first << (SQ_ENTRY_LOG - 4)) << 8) | op0;
+    hgm_uar_write64(dev, HGM_SEND_DOORBELL, (uint64_t) hi << 32 | lo);
+}
+
+int main(void)
+{
+    struct test_cq scq, rcq;
+    struct test_qp rc[2], uc[2], ud[2];
+    struct hgm_cqe *cqe;
+    struct hgm_err_cqe *err;
+    struct hgm_stats stats;
+    struct hgm_qp_param query;
+    uint8_t dev_lim[QUERY_DEV_LIM_OUT_SIZE];
+    const size_t len = 3 * HGM_PAGE_SIZE + 100;
+    uint8_t *src, *dst;
+    uint64_t *target;
+    uint32_t src_key, dst_key, atomic_key;
+    size_t i;
+
+    dev = hgm_create(NULL, NULL);
+    CHECK(dev);
+
+    CHECK(cmd(CMD_QUERY_DEV_LIM, NULL, 0, dev_lim) == CMD_STAT_OK);
+    CHECK(dev_lim[0x0c] == 8 && dev_lim[0x0f] == 14);
+    CHECK(be32toh(*(uint32_t *) (dev_lim + 0x38)) == 0x7);
+    CHECK(be32toh(*(uint32_t *) (dev_lim + 0x3c)) == 50000);
+    CHECK(cmd(CMD_SW2HW_CQ, NULL, 0, NULL) == CMD_STAT_BAD_SYS_STATE);
+    CHECK(cmd(CMD_INIT_HCA, dev_lim, 0, NULL) == CMD_STAT_OK);
+    CHECK(cmd(CMD_MAD_IFC, NULL, 0, NULL) == CMD_STAT_BAD_OP);
+
+    create_cq(&scq, 1, 5);
+    create_cq(&rcq, 2, 5);
+    create_qp(&rc[0], 2, QP_ST_RC, 3, &scq, &rcq);
+    create_qp(&rc[1], 3, QP_ST_RC, 2, &scq, &rcq);
+
+    src    = malloc(len);
+    dst    = malloc(len);
+    target = aligned_alloc(8, 64);
+    CHECK(src && dst && target);
+    for (i = 0; i < len; ++i)
+        src[i] = i * 7;
+    memset(dst, 0, len);
+    src_key    = reg_mr(src, len, MPT_FLAG_LOCAL_WRITE | MPT_FLAG_REMOTE_READ, TEST_PD);
+    dst_key    = reg_mr(dst, len, MPT_FLAG_LOCAL_WRITE | MPT_FLAG_REMOTE_WRITE, TEST_PD);
+    atomic_key = reg_mr(target, 64, MPT_FLAG_LOCAL_WRITE | MPT_FLAG_ATOMIC, TEST_PD);
+
+    /* RC send with immediate, spanning four pages */
+    {
+        struct test_wr wr = {
+            .opcode = OP_SEND_IMM, .signaled = 1,
+            .addr = src, .len = len, .lkey = src_key
+        };
+
+        post_recv(&rc[1], dst, len, dst_key);
+        post_send(&rc[0], &wr, 1);
+
+        cqe = peek_cqe(&scq);
+        CHECK(cqe && cqe->is_send && cqe->opcode == OP_SEND_IMM);
+        CHECK(le32toh(cqe->wqe) == 0);
+        consume_cqe(&scq);
+
+        cqe = peek_cqe(&rcq);
+        CHECK(cqe && !cqe->is_send && cqe->opcode == BTH_SEND_ONLY_WITH_IMM);
+        CHECK(le32toh(cqe->byte_cnt) == len && le32toh(cqe->my_qpn) == 3);
+        CHECK(le32toh(cqe->rqpn) == 2 && cqe->imm == htobe32(0x1234));
+        consume_cqe(&rcq);
+
+        CHECK(!memcmp(src, dst, len));
+        CHECK(!(le32toh(*(uint32_t *) rc[1].rq) & NEXT_VALID));
+    }
+
+    /* One doorbell: unsignaled write, read, fetch-add, compare-swap */
+    {
+        struct test_wr chain[4] = {
+            { .opcode = OP_RDMA_WRITE, .addr = src, .len = 5000, .lkey = src_key,
+              .raddr = (uintptr_t) dst + 10, .rkey = dst_key },
+            { .opcode = OP_RDMA_READ, .signaled = 1, .addr = dst + 8000, .len = 300,
+              .lkey = dst_key, .raddr = (uintptr_t) src + 4000, .rkey = src_key },
+            { .opcode = OP_ATOMIC_FA, .signaled = 1, .addr = dst + 9000, .len = 8,
+              .lkey = dst_key, .raddr = (uintptr_t) target, .rkey = atomic_key,
+              .swap_add = 2 },
+            { .opcode = OP_ATOMIC_CS, .signaled = 1, .addr = dst + 9008, .len = 8,
+              .lkey = dst_key, .raddr = (uintptr_t) target, .rkey = atomic_key,
+              .swap_add = 99, .compare = 42 },
+        };
+
+        memset(dst, 0, len);
+        *target = 40;
+        post_send(&rc[0], chain, 4);
+
+        CHECK(!memcmp(dst + 10, src, 5000));
+        CHECK(!memcmp(dst + 8000, src + 4000, 300));
+        CHECK(*target == 99);
+        CHECK(*(uint64_t *) (dst + 9000) == 40 && *(uint64_t *) (dst + 9008) == 42);
+
+        cqe = peek_cqe(&scq);
+        CHECK(cqe && cqe->opcode == OP_RDMA_READ && le32toh(cqe->byte_cnt) == 300);
+        CHECK(le32toh(cqe->wqe) == 2 << SQ_ENTRY_LOG);
+        consume_cqe(&scq);
+        cqe = peek_cqe(&scq);
+        CHECK(cqe && cqe->opcode == OP_ATOMIC_FA);
+        consume_cqe(&scq);
+        cqe = peek_cqe(&scq);
+        CHECK(cqe && cqe->opcode == OP_ATOMIC_CS && le32toh(cqe->wqe) == 4 << SQ_ENTRY_LOG);
+        consume_cqe(&scq);
+        CHECK(!peek_cqe(&scq));
+    }
+
+    /* RC send with no receive WQE stalls until hgm_progress() finds one */
+    {
+        struct test_wr wr = {
+            .opcode = OP_SEND, .signaled = 1, .inline_data = 1,
+            .addr = src, .len = 64
+        };
+
+        post_send(&rc[0], &wr, 1);
+        CHECK(!peek_cqe(&scq));
+        hgm_progress(dev);
+        CHECK(!peek_cqe(&scq));
+
+        post_recv(&rc[1], dst, len, dst_key);
+        CHECK(hgm_progress(dev) == 1);
+        cqe = peek_cqe(&scq);
+        CHECK(cqe && cqe->opcode == OP_SEND);
+        consume_cqe(&scq);
+        cqe = peek_cqe(&rcq);
+        CHECK(cqe && cqe->opcode == BTH_SEND_ONLY && le32toh(cqe->byte_cnt) == 64);
+        consume_cqe(&rcq);
+        CHECK(!memcmp(dst, src, 64));
+    }
+
+    /* UC write; a bad rkey drops the message but completes the WQE */
+    create_qp(&uc[0], 4, QP_ST_UC, 5, &scq, &rcq);
+    create_qp(&uc[1], 5, QP_ST_UC, 4, &scq, &rcq);
+    {
+        struct test_wr wr = {
+            .opcode = OP_RDMA_WRITE, .signaled = 1, .addr = src, .len = 100,
+            .lkey = src_key, .raddr = (uintptr_t) dst, .rkey = dst_key
+        };
+
+        memset(dst, 0, len);
+        post_send(&uc[0], &wr, 1);
+        cqe = peek_cqe(&scq);
+        CHECK(cqe && cqe->opcode == OP_RDMA_WRITE);
+        consume_cqe(&scq);
+        CHECK(!memcmp(dst, src, 100));
+
+        wr.rkey = 77;
+        post_send(&uc[0], &wr, 1);
+        cqe = peek_cqe(&scq);
+        CHECK(cqe && cqe->opcode == OP_RDMA_WRITE);
+        consume_cqe(&scq);
+    }
+
+    /* UD send, dropped without a receive WQE */
+    create_qp(&ud[0], 6, QP_ST_UD, 0, &scq, &rcq);
+    create_qp(&ud[1], 7, QP_ST_UD, 0, &scq, &rcq);
+    {
+        struct test_wr wr = {
+            .opcode = OP_SEND, .signaled = 1, .addr = src, .len = 256,
+            .lkey = src_key, .dqpn = 7
+        };
+
+        post_send(&ud[0], &wr, 1);
+        CHECK(peek_cqe(&scq));
+        consume_cqe(&scq);
+        CHECK(!peek_cqe(&rcq));
+
+        post_recv(&ud[1], dst, HGM_PAGE_SIZE, dst_key);
+        post_send(&ud[0], &wr, 1);
+        CHECK(peek_cqe(&scq));
+        consume_cqe(&scq);
+        cqe = peek_cqe(&rcq);
+        CHECK(cqe && cqe->opcode == 0x64 && le32toh(cqe->rqpn) == 6);
+        consume_cqe(&rcq);
+    }
+
+    /* RC bad rkey: error CQE, then everything outstanding is flushed */
+    {
+        struct test_wr wr[2] = {
+            { .opcode = OP_RDMA_WRITE, .addr = src, .len = 8, .lkey = src_key,
+              .raddr = (uintptr_t) dst, .rkey = 999 },
+            { .opcode = OP_RDMA_WRITE, .addr = src, .len = 8, .lkey = src_key,
+              .raddr = (uintptr_t) dst, .rkey = dst_key },
+        };
+
+        post_recv(&rc[0], dst, 10, dst_key);
+        post_send(&rc[0], wr, 2);
+
+        err = (void *) peek_cqe(&scq);
+        CHECK(err && err->opcode == OP_SEND_ERR);
+        CHECK(err->syndrome == SYNDROME_REMOTE_ACCESS_ERR);
+        consume_cqe(&scq);
+        err = (void *) peek_cqe(&scq);
+        CHECK(err && err->opcode == OP_SEND_ERR);
+        CHECK(err->syndrome == SYNDROME_WR_FLUSH_ERR);
+        consume_cqe(&scq);
+        err = (void *) peek_cqe(&rcq);
+        CHECK(err && err->opcode == OP_RECV_ERR);
+        CHECK(err->syndrome == SYNDROME_WR_FLUSH_ERR && le32toh(err->my_qpn) == 2);
+        consume_cqe(&rcq);
+        CHECK(!peek_cqe(&scq) && !peek_cqe(&rcq));
+
+        CHECK(cmd(CMD_QUERY_QPEE, NULL, 2, &query) == CMD_STAT_OK);
+        CHECK(be32toh(query.context.flags) >> 28 == QP_STATE_ERR);
+    }
+
+    /* CQ overflow: 40 signaled WQEs into a 32-entry CQ nobody polls */
+    {
+        struct test_wr wr = {
+            .opcode = OP_RDMA_WRITE, .signaled = 1, .addr = src, .len = 8,
+            .lkey = src_key, .raddr = (uintptr_t) dst, .rkey = dst_key
+        };
+
+        for (i = 0; i < 40; ++i)
+            post_send(&uc[0], &wr, 1);
+    }
+
+    hgm_get_stats(dev, &stats);
+    printf("cmds %llu errors %llu dbs %llu wqes %llu recv_wqes %llu cqes %llu "
+           "overflows %llu rnr %llu drops %llu bytes %llu\n",
+           (unsigned long long) stats.cmds, (unsigned long long) stats.cmd_errors,
+           (unsigned long long) stats.send_dbs, (unsigned long long) stats.wqes,
+           (unsigned long long) stats.recv_wqes, (unsigned long long) stats.cqes,
+           (unsigned long long) stats.cq_overflows, (unsigned long long) stats.rnr_stalls,
+           (unsigned long long) stats.drops, (unsigned long long) stats.bytes);
+    CHECK(stats.cq_overflows == 8);
+
+    hgm_destroy(dev);
+    for (i = 0; i < 2; ++i) {
+        destroy_qp(&rc[i]);
+        destroy_qp(&uc[i]);
+        destroy_qp(&ud[i]);
+    }
+    free(scq.buf);
+    free(rcq.buf);
+    free(src);
+    free(dst);
+    free(target);
+
+    printf("PASS\n");
+    return 0;
+}
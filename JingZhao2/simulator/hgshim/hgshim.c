@@ -0,0 +1,1295 @@
+/*
+ * The parts of ib_hgrnic and of libhgrnic's verbs.c that a program
+ * needs to get libhgrnic's datapath onto a device model. Each function
+ * names the driver code it follows; the HCR commands and mailboxes are
+ * the driver's, the bookkeeping is kept to what the model and the RTL
+ * look at.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hgrnic.h"
+#include "cqe.h"
+#include "hgm_int.h"
+#include "hgshim.h"
+
+#define HGSHIM_CMD_TIMEOUT  60      /* seconds, CMD_TIME_CLASS_* */
+#define HGSHIM_NUM_EQS      32      /* HGRNIC_NUM_EQS */
+#define HGSHIM_ICM_CHUNK    (1UL << (HGM_PAGE_SHIFT + 8))  /* MAP_ICM_MAX_PAGE_NUM_LOG */
+
+/* hgrnic_cmd.h */
+enum {
+    CXT_REGION = 1,
+    TPT_REGION
+};
+
+#define DEV_LIM_FLAG_SRQ        (1U << 6)
+#define DEV_LIM_FLAG_ATOMIC     (1U << 18)
+#define DEV_LIM_FLAG_FAST_REG   (1U << 24)
+
+/* hgrnic_mr.c */
+#define MPT_FLAG_SW_OWNS        (0xfU << 28)
+#define MPT_FLAG_MIO            (1U << 17)
+#define MPT_FLAG_REGION         (1U << 8)
+
+/* hgrnic_cq.c */
+#define CQ_FLAG_TR              (1U << 18)
+
+/* hgrnic_qp.c */
+#define QP_OPTPAR_RNR_TIMEOUT   (1U << 6)
+#define QP_OPTPAR_PORT_NUM      (1U << 11)
+
+enum {
+    RES_QP,
+    RES_CQ,
+    RES_EQ,
+    RES_MPT,
+    RES_MTT,
+    RES_NUM
+};
+
+struct hgshim_icm {
+    uint64_t  virt;             /* ICM address, from the profile */
+    size_t    size;
+    void     *buf;              /* host memory behind it */
+    uint8_t   type_sel;
+    uint8_t   log_num;
+};
+
+struct hgshim_context {
+    struct hgrnic_context   hgctx;
+    struct hgrnic_device    hgdev;
+    struct hgm_dev         *dev;
+    pthread_mutex_t         hcr_mutex;
+    pthread_mutex_t         res_mutex;      /* the maps below */
+    struct hgshim_icm       icm[RES_NUM];
+    uint32_t                flags;          /* DEV_LIM_FLAG_* */
+    int                     num_cqs;
+    int                     num_srqs;       /* 0 without DEV_LIM_FLAG_SRQ */
+    int                     num_mpts;
+    int                     num_mtts;
+    int                     rsvd_qps;
+    int                     rsvd_cqs;
+    int                     rsvd_srqs;
+    uint32_t                next_pdn;
+    uint8_t                *qp_used;
+    uint8_t                *cq_used;
+    uint8_t                *srq_used;
+    uint8_t                *mpt_used;
+    uint8_t                *mtt_used;
+};
+
+struct hgshim_mr {
+    struct hgrnic_mr    hgmr;
+    uint32_t            index;
+    int                 mtt;
+    int                 npages;
+};
+
+struct hgshim_qp {
+    struct hgrnic_qp    hgqp;
+    uint32_t            remote_qpn;
+    uint32_t            psn;
+    uint32_t            epsn;
+    uint32_t            min_rnr_timer;
+    uint8_t             mtu_msgmax;
+    uint8_t             port_num;
+};
+
+static struct hgshim_context *to_shctx(struct ibv_context *ibctx)
+{
+    return (struct hgshim_context *) to_hgctx(ibctx);
+}
+
+static struct hgshim_mr *to_shmr(struct ibv_mr *ibmr)
+{
+    return (struct hgshim_mr *) to_hgmr(ibmr);
+}
+
+static struct hgshim_qp *to_shqp(struct ibv_qp *ibqp)
+{
+    return (struct hgshim_qp *) to_hgqp(ibqp);
+}
+
+/* libhgrnic's doorbell, see doorbell.h */
+void hgrnic_sim_write64(struct hgrnic_context *ctx, int offset, uint64_t val)
+{
+    hgm_uar_write64(((struct hgshim_context *) ctx)->dev, offset, val);
+}
+
+/* ------------------------------------------------------------------ */
+/* HCR                                                                */
+/* ------------------------------------------------------------------ */
+
+/* hgrnic_alloc_mailbox() */
+static void *mailbox_alloc(void)
+{
+    void *box = aligned_alloc(HGM_MAILBOX_SIZE, HGM_MAILBOX_SIZE);
+
+    if (box)
+        memset(box, 0, HGM_MAILBOX_SIZE);
+    else
+        errno = ENOMEM;
+    return box;
+}
+
+/*
+ * hgrnic_cmd_post_hcr() and hgrnic_cmd_poll(). Returns 0, or -1 with
+ * errno set if the go bit stayed up or the status is not CMD_STAT_OK.
+ */
+static int hcr_cmd(struct hgshim_context *sc, void *in, uint32_t in_mod,
+                   uint8_t op_mod, uint16_t op, void *out)
+{
+    uint64_t in_param  = (uintptr_t) in;
+    uint64_t out_param = (uintptr_t) out;
+    time_t deadline = time(NULL) + HGSHIM_CMD_TIMEOUT;
+    uint32_t status;
+
+    pthread_mutex_lock(&sc->hcr_mutex);
+
+    hgm_hcr_write32(sc->dev, 0x00, in_param >> 32);
+    hgm_hcr_write32(sc->dev, 0x04, (uint32_t) in_param);
+    hgm_hcr_write32(sc->dev, HCR_IN_MODIFIER_OFFSET, in_mod);
+    hgm_hcr_write32(sc->dev, HCR_OUT_PARAM_OFFSET, out_param >> 32);
+    hgm_hcr_write32(sc->dev, HCR_OUT_PARAM_OFFSET + 4, (uint32_t) out_param);
+    hgm_hcr_write32(sc->dev, HCR_TOKEN_OFFSET, 0);
+    hgm_hcr_write32(sc->dev, HCR_STATUS_OFFSET, (1U << HCR_GO_BIT) |
+                    ((uint32_t) op_mod << HCR_OPMOD_SHIFT) | op);
+
+    while ((status = hgm_hcr_read32(sc->dev, HCR_STATUS_OFFSET)) &
+           (1U << HCR_GO_BIT)) {
+        if (time(NULL) > deadline) {
+            pthread_mutex_unlock(&sc->hcr_mutex);
+            fprintf(stderr, "hgshim: command 0x%x timed out\n", op);
+            errno = ETIMEDOUT;
+            return -1;
+        }
+    }
+
+    pthread_mutex_unlock(&sc->hcr_mutex);
+
+    if (status >> 24) {
+        fprintf(stderr, "hgshim: command 0x%x returned status 0x%x\n",
+                op, status >> 24);
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+static uint8_t get8(const uint8_t *box, int off)
+{
+    return box[off];
+}
+
+static uint16_t get16(const uint8_t *box, int off)
+{
+    uint16_t v;
+
+    memcpy(&v, box + off, sizeof(v));
+    return be16toh(v);
+}
+
+static uint32_t get32(const uint8_t *box, int off)
+{
+    uint32_t v;
+
+    memcpy(&v, box + off, sizeof(v));
+    return be32toh(v);
+}
+
+static uint64_t get64(const uint8_t *box, int off)
+{
+    uint64_t v;
+
+    memcpy(&v, box + off, sizeof(v));
+    return be64toh(v);
+}
+
+static void put64(uint8_t *box, int off, uint64_t v)
+{
+    v = htobe64(v);
+    memcpy(box + off, &v, sizeof(v));
+}
+
+/* ------------------------------------------------------------------ */
+/* Resource numbers                                                   */
+/* ------------------------------------------------------------------ */
+
+/* First fit of n free entries in used[lo, num), -1 if there are none. */
+static int range_alloc(struct hgshim_context *sc, uint8_t *used,
+                       int lo, int num, int n)
+{
+    int i, run = 0;
+
+    pthread_mutex_lock(&sc->res_mutex);
+    for (i = lo; i < num; ++i) {
+        run = used[i] ? 0 : run + 1;
+        if (run == n) {
+            memset(used + i - n + 1, 1, n);
+            pthread_mutex_unlock(&sc->res_mutex);
+            return i - n + 1;
+        }
+    }
+    pthread_mutex_unlock(&sc->res_mutex);
+    errno = ENOMEM;
+    return -1;
+}
+
+static void range_free(struct hgshim_context *sc, uint8_t *used,
+                       int first, int n)
+{
+    pthread_mutex_lock(&sc->res_mutex);
+    memset(used + first, 0, n);
+    pthread_mutex_unlock(&sc->res_mutex);
+}
+
+/* ------------------------------------------------------------------ */
+/* Open: hgrnic_init_hca()                                            */
+/* ------------------------------------------------------------------ */
+
+struct dev_lim {
+    int      rsvd_qps;
+    int      rsvd_cqs;
+    int      rsvd_srqs;
+    int      rsvd_pds;
+    int      max_qps;
+    int      max_cqs;
+    int      max_srqs;
+    int      max_mpts;
+    int      entry_sz[RES_NUM];
+    uint64_t max_icm_sz;
+    uint32_t flags;
+    uint32_t hca_clock_khz;
+};
+
+/* hgrnic_QUERY_DEV_LIM(), the fields the profile and the shim use */
+static int query_dev_lim(struct hgshim_context *sc, struct dev_lim *lim)
+{
+    uint8_t *box = mailbox_alloc();
+    int err;
+
+    if (!box)
+        return -1;
+    err = hcr_cmd(sc, NULL, 0, 0, CMD_QUERY_DEV_LIM, box);
+    if (!err) {
+        lim->rsvd_qps = 1 << (get8(box, 0x00) & 0xf);
+        lim->rsvd_cqs = 1 << (get8(box, 0x01) & 0xf);
+        lim->rsvd_srqs = 1 << (get8(box, 0x04) & 0xf);
+        lim->rsvd_pds = 1 << (get8(box, 0x05) & 0xf);
+        lim->max_qps  = 1 << (get8(box, 0x0c) & 0x1f);
+        lim->max_cqs  = 1 << (get8(box, 0x0d) & 0x1f);
+        lim->max_srqs = 1 << (get8(box, 0x11) & 0x1f);
+        lim->max_mpts = 1 << (get8(box, 0x0f) & 0x3f);
+        lim->entry_sz[RES_MTT] = get8(box, 0x15);
+        lim->entry_sz[RES_QP]  = get16(box, 0x18);
+        lim->entry_sz[RES_CQ]  = get16(box, 0x1a);
+        lim->entry_sz[RES_EQ]  = get16(box, 0x1c);
+        lim->entry_sz[RES_MPT] = get16(box, 0x1e);
+        lim->max_icm_sz = get64(box, 0x30);
+        lim->flags      = get32(box, 0x38);
+        lim->hca_clock_khz = get32(box, 0x3c);
+    }
+    free(box);
+    return err;
+}
+
+static int min_int(int a, int b)
+{
+    return a < b ? a : b;
+}
+
+/*
+ * hgrnic_make_profile(): every table a power of two, the biggest
+ * first, so that each one is aligned to its size in ICM.
+ */
+static int make_profile(struct hgshim_context *sc, const struct dev_lim *lim)
+{
+    int num[RES_NUM], order[RES_NUM];
+    uint64_t total = 0;
+    int i, j, t;
+
+    num[RES_QP]  = min_int(HGSHIM_NUM_QPS, lim->max_qps);
+    num[RES_CQ]  = min_int(HGSHIM_NUM_CQS, lim->max_cqs);
+    num[RES_EQ]  = HGSHIM_NUM_EQS;
+    num[RES_MPT] = min_int(HGSHIM_NUM_MPTS, lim->max_mpts);
+    num[RES_MTT] = HGSHIM_NUM_MTTS;
+
+    for (i = 0; i < RES_NUM; ++i) {
+        sc->icm[i].size = (size_t) lim->entry_sz[i] * num[i];
+        if (sc->icm[i].size < HGM_PAGE_SIZE)
+            sc->icm[i].size = HGM_PAGE_SIZE;
+        sc->icm[i].log_num  = ffs(num[i]) - 1;
+        sc->icm[i].type_sel = i == RES_MPT || i == RES_MTT ?
+                              TPT_REGION : CXT_REGION;
+        order[i] = i;
+    }
+
+    for (i = 1; i < RES_NUM; ++i)
+        for (j = i; j > 0 && sc->icm[order[j]].size >
+                             sc->icm[order[j - 1]].size; --j) {
+            t = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = t;
+        }
+
+    for (i = 0; i < RES_NUM; ++i) {
+        sc->icm[order[i]].virt = total;
+        total += sc->icm[order[i]].size;
+    }
+    if (total > lim->max_icm_sz) {
+        fprintf(stderr, "hgshim: profile needs 0x%llx bytes of ICM, "
+                "the HCA has 0x%llx\n", (unsigned long long) total,
+                (unsigned long long) lim->max_icm_sz);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    sc->hgctx.num_qps = num[RES_QP];
+    sc->num_cqs  = num[RES_CQ];
+    sc->num_mpts = num[RES_MPT];
+    sc->num_mtts = num[RES_MTT];
+    return 0;
+}
+
+/* hgrnic_INIT_HCA() */
+static int init_hca(struct hgshim_context *sc)
+{
+    uint8_t *box = mailbox_alloc();
+    int err;
+
+    if (!box)
+        return -1;
+    put64(box, 0x08, sc->icm[RES_QP].virt);
+    box[0x0f] = sc->icm[RES_QP].log_num;
+    put64(box, 0x10, sc->icm[RES_CQ].virt);
+    box[0x17] = sc->icm[RES_CQ].log_num;
+    put64(box, 0x18, sc->icm[RES_EQ].virt);
+    box[0x1f] = sc->icm[RES_EQ].log_num;
+    put64(box, 0x30, sc->icm[RES_MPT].virt);
+    box[0x37] = sc->icm[RES_MPT].log_num;
+    put64(box, 0x38, sc->icm[RES_MTT].virt);
+
+    err = hcr_cmd(sc, box, 0, 0, CMD_INIT_HCA, NULL);
+    free(box);
+    return err;
+}
+
+/*
+ * hgrnic_MAP_ICM() for a whole table. The table is one block aligned
+ * to its size, so every mailbox entry covers the most pages one entry
+ * can (2^MAP_ICM_MAX_PAGE_NUM_LOG). Entries go into the mailbox in
+ * the order 1, 0, 3, 2, ...
+ */
+static int map_icm(struct hgshim_context *sc, struct hgshim_icm *icm)
+{
+    uint64_t *box;
+    size_t off, chunk;
+    int nent = 1, err = 0;
+
+    icm->buf = aligned_alloc(icm->size, icm->size);
+    if (!icm->buf) {
+        errno = ENOMEM;
+        return -1;
+    }
+    memset(icm->buf, 0, icm->size);
+
+    box = mailbox_alloc();
+    if (!box)
+        return -1;
+
+    for (off = 0; off < icm->size; off += chunk) {
+        chunk = icm->size - off < HGSHIM_ICM_CHUNK ?
+                icm->size - off : HGSHIM_ICM_CHUNK;
+        box[nent * 2]     = htobe64(icm->virt + off);
+        box[nent * 2 + 1] = htobe64(((uintptr_t) icm->buf + off) |
+                                    (chunk >> HGM_PAGE_SHIFT));
+        nent = nent % 2 == 0 ? nent + 3 : nent - 1;
+
+        if (nent >= HGM_MAILBOX_SIZE / 16) {
+            err = hcr_cmd(sc, box, nent - 1, icm->type_sel, CMD_MAP_ICM, NULL);
+            if (err)
+                goto out;
+            memset(box, 0, HGM_MAILBOX_SIZE);
+            nent = 1;
+        }
+    }
+
+    nent = nent % 2 == 0 ? nent + 1 : nent - 1;
+    if (nent)
+        err = hcr_cmd(sc, box, nent, icm->type_sel, CMD_MAP_ICM, NULL);
+out:
+    free(box);
+    return err;
+}
+
+static void free_icm(struct hgshim_context *sc)
+{
+    int i;
+
+    for (i = 0; i < RES_NUM; ++i) {
+        if (!sc->icm[i].buf)
+            continue;
+        /* hgrnic_UNMAP_ICM(): the ICM address goes in in_param */
+        hcr_cmd(sc, (void *) (uintptr_t) sc->icm[i].virt,
+                sc->icm[i].size >> HGM_PAGE_SHIFT, sc->icm[i].type_sel,
+                CMD_UNMAP_ICM, NULL);
+        free(sc->icm[i].buf);
+        sc->icm[i].buf = NULL;
+    }
+}
+
+static int hgshim_poll_cq(struct ibv_cq *cq, int ne, struct ibv_wc *wc)
+{
+    hgm_progress(to_shctx(cq->context)->dev);
+    return hgrnic_poll_cq(cq, ne, wc);
+}
+
+int hgshim_poll_cq_ts(struct ibv_cq *cq, struct ibv_wc *wc, uint64_t *ts)
+{
+    struct hgrnic_cq *hgcq = to_hgcq(cq);
+    struct hgrnic_cqe *cqe;
+    int n;
+
+    /* hgrnic_poll_one() hands the slot back by its owner byte only */
+    cqe = hgcq->buf.buf + (hgcq->cons_index & hgcq->cqe_mask) *
+          HGRNIC_CQ_ENTRY_SIZE;
+    n = hgshim_poll_cq(cq, 1, wc);
+    if (n == 1)
+        *ts = ((uint64_t) cqe->ts_hi << 32) | cqe->ts_lo;
+    return n;
+}
+
+/* hgrnic_init_hca() in ib_hgrnic, hgrnic_alloc_context() in libhgrnic */
+struct ibv_context *hgshim_open(struct hgm_dev *dev)
+{
+    struct hgshim_context *sc;
+    struct ibv_context *ibctx;
+    struct dev_lim lim;
+    uint8_t *box;
+    int i;
+
+    sc = calloc(1, sizeof(*sc));
+    if (!sc) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    sc->dev = dev;
+    pthread_mutex_init(&sc->hcr_mutex, NULL);
+    pthread_mutex_init(&sc->res_mutex, NULL);
+
+    box = mailbox_alloc();
+    if (!box || hcr_cmd(sc, NULL, 0, 0, CMD_QUERY_ADAPTER, box)) {
+        free(box);
+        goto err;
+    }
+    free(box);
+
+    if (query_dev_lim(sc, &lim) || make_profile(sc, &lim) || init_hca(sc))
+        goto err;
+    for (i = 0; i < RES_NUM; ++i)
+        if (map_icm(sc, &sc->icm[i]))
+            goto err_close;
+
+    sc->flags    = lim.flags;
+    sc->rsvd_qps = lim.rsvd_qps;
+    sc->rsvd_cqs = lim.rsvd_cqs;
+    sc->next_pdn = lim.rsvd_pds;
+    sc->qp_used  = calloc(sc->hgctx.num_qps, 1);
+    sc->cq_used  = calloc(sc->num_cqs, 1);
+    sc->mpt_used = calloc(sc->num_mpts, 1);
+    sc->mtt_used = calloc(sc->num_mtts, 1);
+    if (!sc->qp_used || !sc->cq_used || !sc->mpt_used || !sc->mtt_used)
+        goto err_close;
+
+    /* hgrnic_init_srq_table(): no SRQs unless the HCA has them */
+    if (lim.flags & DEV_LIM_FLAG_SRQ) {
+        sc->num_srqs  = min_int(HGSHIM_NUM_SRQS, lim.max_srqs);
+        sc->rsvd_srqs = lim.rsvd_srqs;
+        sc->srq_used  = calloc(sc->num_srqs, 1);
+        if (!sc->srq_used)
+            goto err_close;
+    }
+
+    sc->hgdev.page_size = sysconf(_SC_PAGESIZE);
+
+    ibctx = hgctx_to_ibv(&sc->hgctx);
+    ibctx->device            = &sc->hgdev.ibv_dev;
+    ibctx->ops.post_send     = hgrnic_post_send;
+    ibctx->ops.post_recv     = hgrnic_post_recv;
+    ibctx->ops.poll_cq       = hgshim_poll_cq;
+    ibctx->ops.req_notify_cq = hgrnic_notify_cq;
+    ibctx->ops.post_srq_recv = hgrnic_post_srq_recv;
+
+    sc->hgctx.qp_table_shift = ffs(sc->hgctx.num_qps) - 1 - HGRNIC_QP_TABLE_BITS;
+    sc->hgctx.qp_table_mask  = (1 << sc->hgctx.qp_table_shift) - 1;
+    sc->hgctx.numa_node      = -1;
+    sc->hgctx.atomic_cap     = !!(lim.flags & DEV_LIM_FLAG_ATOMIC);
+    sc->hgctx.hca_core_clock = lim.hca_clock_khz;
+    pthread_mutex_init(&sc->hgctx.qp_table_mutex, NULL);
+    pthread_spin_init(&sc->hgctx.uar_lock, PTHREAD_PROCESS_PRIVATE);
+
+    sc->hgctx.pd = hgshim_alloc_pd(ibctx);
+    if (!sc->hgctx.pd)
+        goto err_close;
+
+    return ibctx;
+
+err_close:
+    free_icm(sc);
+    hcr_cmd(sc, NULL, 0, 0, CMD_CLOSE_HCA, NULL);
+err:
+    free(sc->qp_used);
+    free(sc->cq_used);
+    free(sc->srq_used);
+    free(sc->mpt_used);
+    free(sc->mtt_used);
+    free(sc);
+    return NULL;
+}
+
+void hgshim_close(struct ibv_context *ibctx)
+{
+    struct hgshim_context *sc = to_shctx(ibctx);
+
+    hgshim_dealloc_pd(sc->hgctx.pd);
+    free_icm(sc);
+    hcr_cmd(sc, NULL, 0, 0, CMD_CLOSE_HCA, NULL);
+    free(sc->qp_used);
+    free(sc->cq_used);
+    free(sc->srq_used);
+    free(sc->mpt_used);
+    free(sc->mtt_used);
+    free(sc);
+}
+
+struct hgm_dev *hgshim_dev(struct ibv_context *ibctx)
+{
+    return to_shctx(ibctx)->dev;
+}
+
+/* ------------------------------------------------------------------ */
+/* PD and MR                                                          */
+/* ------------------------------------------------------------------ */
+
+struct ibv_pd *hgshim_alloc_pd(struct ibv_context *ibctx)
+{
+    struct hgshim_context *sc = to_shctx(ibctx);
+    struct hgrnic_pd *pd;
+
+    pd = calloc(1, sizeof(*pd));
+    if (!pd) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    pthread_mutex_init(&pd->ah_mutex, NULL);
+
+    pthread_mutex_lock(&sc->res_mutex);
+    pd->pdn = sc->next_pdn++;
+    pthread_mutex_unlock(&sc->res_mutex);
+
+    pd->ibv_pd.context = ibctx;
+    pd->ibv_pd.handle  = pd->pdn;
+    return &pd->ibv_pd;
+}
+
+int hgshim_dealloc_pd(struct ibv_pd *ibpd)
+{
+    free(to_hgpd(ibpd));
+    return 0;
+}
+
+/* convert_access() */
+static uint32_t mpt_access(int access)
+{
+    return (access & IBV_ACCESS_REMOTE_ATOMIC ? MPT_FLAG_ATOMIC       : 0) |
+           (access & IBV_ACCESS_REMOTE_WRITE  ? MPT_FLAG_REMOTE_WRITE : 0) |
+           (access & IBV_ACCESS_REMOTE_READ   ? MPT_FLAG_REMOTE_READ  : 0) |
+           (access & IBV_ACCESS_LOCAL_WRITE   ? MPT_FLAG_LOCAL_WRITE  : 0) |
+           MPT_FLAG_LOCAL_READ;
+}
+
+/* __hgrnic_write_mtt(): the pages in groups of four, each reversed */
+static int write_mtt(struct hgshim_context *sc, int first, uint64_t page,
+                     int npages)
+{
+    uint64_t *box = mailbox_alloc();
+    int max = HGM_MAILBOX_SIZE / 8 - 4;
+    int i, n, err = 0;
+
+    if (!box)
+        return -1;
+
+    while (npages > 0 && !err) {
+        n = npages < max ? npages : max;
+        memset(box, 0, HGM_MAILBOX_SIZE);
+        box[3] = htobe64(first);
+        for (i = 0; i < n; ++i)
+            box[4 + (i & ~3) + 3 - (i & 3)] =
+                htobe64(page + ((uint64_t) i << HGM_PAGE_SHIFT));
+        err = hcr_cmd(sc, box, n, 0, CMD_WRITE_MTT, NULL);
+        first  += n;
+        page   += (uint64_t) n << HGM_PAGE_SHIFT;
+        npages -= n;
+    }
+
+    free(box);
+    return err;
+}
+
+/*
+ * hgrnic_reg_user_mr() with hgrnic_mr_alloc(), for __hgrnic_reg_mr().
+ * The pages are this process' pages; nothing needs pinning.
+ */
+static struct ibv_mr *reg_mr(struct ibv_pd *ibpd, void *addr, size_t length,
+                             uint64_t iova, int access)
+{
+    struct hgshim_context *sc = to_shctx(ibpd->context);
+    struct hgm_mpt_entry *mpt;
+    struct hgshim_mr *mr;
+    uint64_t first = (uintptr_t) addr & ~(HGM_PAGE_SIZE - 1);
+    int npages = ((uintptr_t) addr + length - first + HGM_PAGE_SIZE - 1) >>
+                 HGM_PAGE_SHIFT;
+    uint32_t key;
+    int ind;
+
+    mr = calloc(1, sizeof(*mr));
+    if (!mr) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    mr->npages = npages;
+    mr->mtt = range_alloc(sc, sc->mtt_used, 0, sc->num_mtts, npages);
+    if (mr->mtt < 0)
+        goto err_free;
+    if (write_mtt(sc, mr->mtt, first, npages))
+        goto err_mtt;
+
+    /* MPT 0 is reserved */
+    ind = range_alloc(sc, sc->mpt_used, 1, sc->num_mpts, 1);
+    if (ind < 0)
+        goto err_mtt;
+    mr->index = ind;
+    key = sc->flags & DEV_LIM_FLAG_FAST_REG ? (ind >> 24) | (ind << 8) : ind;
+
+    mpt = mailbox_alloc();
+    if (!mpt)
+        goto err_mpt;
+    mpt->flags     = htobe32(MPT_FLAG_SW_OWNS | MPT_FLAG_MIO |
+                             MPT_FLAG_REGION | mpt_access(access));
+    mpt->page_size = htobe32(HGM_PAGE_SIZE);
+    mpt->key       = htobe32(key);
+    mpt->pd        = htobe32(to_hgpd(ibpd)->pdn);
+    mpt->start     = htobe64(iova);
+    mpt->length    = htobe64(length);
+    mpt->mtt_seg   = htobe64(mr->mtt);
+    if (hcr_cmd(sc, mpt, ind & (sc->num_mpts - 1), 0, CMD_SW2HW_MPT, NULL)) {
+        free(mpt);
+        goto err_mpt;
+    }
+    free(mpt);
+
+    mr->hgmr.ibv_mr.context = ibpd->context;
+    mr->hgmr.ibv_mr.pd      = ibpd;
+    mr->hgmr.ibv_mr.addr    = addr;
+    mr->hgmr.ibv_mr.length  = length;
+    mr->hgmr.ibv_mr.handle  = ind;
+    mr->hgmr.ibv_mr.lkey    = key;
+    mr->hgmr.ibv_mr.rkey    = key;
+    return &mr->hgmr.ibv_mr;
+
+err_mpt:
+    range_free(sc, sc->mpt_used, ind, 1);
+err_mtt:
+    range_free(sc, sc->mtt_used, mr->mtt, npages);
+err_free:
+    free(mr);
+    return NULL;
+}
+
+struct ibv_mr *hgshim_reg_mr(struct ibv_pd *pd, void *addr, size_t length,
+                             int access)
+{
+    return reg_mr(pd, addr, length, (uintptr_t) addr, access);
+}
+
+/* hgrnic_dereg_mr(): HW2SW_MPT, then the MTT range is free again */
+int hgshim_dereg_mr(struct ibv_mr *ibmr)
+{
+    struct hgshim_context *sc = to_shctx(ibmr->context);
+    struct hgshim_mr *mr = to_shmr(ibmr);
+
+    if (hcr_cmd(sc, NULL, mr->index & (sc->num_mpts - 1), 0,
+                CMD_HW2SW_MPT, NULL))
+        return errno;
+    range_free(sc, sc->mpt_used, mr->index, 1);
+    range_free(sc, sc->mtt_used, mr->mtt, mr->npages);
+    free(mr);
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* CQ                                                                 */
+/* ------------------------------------------------------------------ */
+
+/* align_cq_size() and align_queue_size() in verbs.c */
+static int align_queue_size(int size)
+{
+    int ret;
+
+    if (!size)
+        return 0;
+    for (ret = 1; ret < size; ret <<= 1)
+        ; /* nothing */
+    return ret;
+}
+
+/* hgrnic_create_cq() in verbs.c, hgrnic_init_cq() in ib_hgrnic */
+struct ibv_cq *hgshim_create_cq(struct ibv_context *ibctx, int cqe)
+{
+    struct hgshim_context *sc = to_shctx(ibctx);
+    struct hgm_cq_context *cqc;
+    struct hgrnic_cq *cq;
+    int nent;
+
+    if (cqe > 0x20000) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    cq = calloc(1, sizeof(*cq));
+    if (!cq) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    pthread_spin_init(&cq->lock, PTHREAD_PROCESS_PRIVATE);
+
+    nent = align_queue_size(cqe);
+    cq->cqe_mask = nent - 1;
+    if (hgrnic_alloc_cq_buf(&sc->hgdev, &cq->buf, nent, sc->hgctx.numa_node))
+        goto err;
+
+    cq->mr = reg_mr(sc->hgctx.pd, cq->buf.buf, nent * HGRNIC_CQ_ENTRY_SIZE,
+                    0, IBV_ACCESS_LOCAL_WRITE);
+    if (!cq->mr)
+        goto err_buf;
+
+    cq->cqn = range_alloc(sc, sc->cq_used, sc->rsvd_cqs, sc->num_cqs, 1);
+    if ((int) cq->cqn < 0)
+        goto err_mr;
+
+    cqc = mailbox_alloc();
+    if (!cqc)
+        goto err_cqn;
+    cqc->flags           = htobe32(CQ_FLAG_TR);
+    cqc->logsize_usrpage = htobe32((ffs(nent) - 1) << 24);
+    cqc->pd              = htobe32(to_hgpd(sc->hgctx.pd)->pdn);
+    cqc->lkey            = htobe32(cq->mr->lkey);
+    cqc->cqn             = htobe32(cq->cqn);
+    if (hcr_cmd(sc, cqc, cq->cqn, 0, CMD_SW2HW_CQ, NULL)) {
+        free(cqc);
+        goto err_cqn;
+    }
+    free(cqc);
+
+    cq->ibv_cq.context = ibctx;
+    cq->ibv_cq.cqe     = nent - 1;
+    cq->ibv_cq.handle  = cq->cqn;
+    return &cq->ibv_cq;
+
+err_cqn:
+    range_free(sc, sc->cq_used, cq->cqn, 1);
+err_mr:
+    hgshim_dereg_mr(cq->mr);
+err_buf:
+    hgrnic_free_buf(&cq->buf);
+err:
+    free(cq);
+    return NULL;
+}
+
+int hgshim_destroy_cq(struct ibv_cq *ibcq)
+{
+    struct hgshim_context *sc = to_shctx(ibcq->context);
+    struct hgrnic_cq *cq = to_hgcq(ibcq);
+
+    if (hcr_cmd(sc, NULL, cq->cqn, 0, CMD_HW2SW_CQ, NULL))
+        return errno;
+    range_free(sc, sc->cq_used, cq->cqn, 1);
+    hgshim_dereg_mr(cq->mr);
+    hgrnic_free_buf(&cq->buf);
+    free(cq);
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* SRQ                                                                */
+/* ------------------------------------------------------------------ */
+
+/* hgrnic_create_srq() in verbs.c and in ib_hgrnic */
+struct ibv_srq *hgshim_create_srq(struct ibv_pd *ibpd,
+                                  struct ibv_srq_init_attr *attr)
+{
+    struct hgshim_context *sc = to_shctx(ibpd->context);
+    struct hgm_srq_context *srqc;
+    struct hgrnic_srq *srq;
+    int srqn;
+
+    if (!sc->num_srqs) {
+        errno = EOPNOTSUPP;
+        return NULL;
+    }
+    if (!attr->attr.max_wr || attr->attr.max_wr > 65536 ||
+        attr->attr.max_sge > 64) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    srq = calloc(1, sizeof(*srq));
+    if (!srq) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    pthread_spin_init(&srq->lock, PTHREAD_PROCESS_PRIVATE);
+
+    if (hgrnic_alloc_srq_buf(ibpd, &attr->attr, srq)) {
+        errno = ENOMEM;
+        goto err;
+    }
+    if (attr->attr.srq_limit > srq->max) {
+        errno = EINVAL;
+        goto err_buf;
+    }
+
+    srq->mr = reg_mr(ibpd, srq->buf.buf, srq->buf_size, 0, 0);
+    if (!srq->mr)
+        goto err_buf;
+
+    srqn = range_alloc(sc, sc->srq_used, sc->rsvd_srqs, sc->num_srqs, 1);
+    if (srqn < 0)
+        goto err_mr;
+    srq->srqn = srqn;
+
+    srqc = mailbox_alloc();
+    if (!srqc)
+        goto err_srqn;
+    srqc->logsize         = ffs(srq->max) - 1;
+    srqc->entry_sz_log    = srq->wqe_shift;
+    srqc->limit_watermark = htobe16(attr->attr.srq_limit);
+    srqc->pd              = htobe32(to_hgpd(ibpd)->pdn);
+    srqc->lkey            = htobe32(srq->mr->lkey);
+    srqc->srqn            = htobe32(srq->srqn);
+    if (hcr_cmd(sc, srqc, srq->srqn, 0, CMD_SW2HW_SRQ, NULL)) {
+        free(srqc);
+        goto err_srqn;
+    }
+    free(srqc);
+
+    attr->attr.max_wr  = srq->max;
+    attr->attr.max_sge = srq->max_gs;
+
+    srq->ibv_srq.context     = ibpd->context;
+    srq->ibv_srq.srq_context = attr->srq_context;
+    srq->ibv_srq.pd          = ibpd;
+    srq->ibv_srq.handle      = srq->srqn;
+    return &srq->ibv_srq;
+
+err_srqn:
+    range_free(sc, sc->srq_used, srq->srqn, 1);
+err_mr:
+    hgshim_dereg_mr(srq->mr);
+err_buf:
+    hgrnic_free_srq_buf(srq);
+err:
+    free(srq);
+    return NULL;
+}
+
+/* hgrnic_modify_srq() in ib_hgrnic: only the limit, through ARM_SRQ */
+int hgshim_modify_srq(struct ibv_srq *ibsrq, struct ibv_srq_attr *attr,
+                      int attr_mask)
+{
+    struct hgshim_context *sc = to_shctx(ibsrq->context);
+    struct hgrnic_srq *srq = to_hgsrq(ibsrq);
+
+    if (attr_mask & IBV_SRQ_MAX_WR)
+        return EINVAL;
+    if (attr_mask & IBV_SRQ_LIMIT) {
+        if (attr->srq_limit > srq->max)
+            return EINVAL;
+        if (hcr_cmd(sc, (void *) (uintptr_t) attr->srq_limit, srq->srqn, 0,
+                    CMD_ARM_SRQ, NULL))
+            return errno;
+    }
+    return 0;
+}
+
+/* hgrnic_query_srq() in ib_hgrnic */
+int hgshim_query_srq(struct ibv_srq *ibsrq, struct ibv_srq_attr *attr)
+{
+    struct hgshim_context *sc = to_shctx(ibsrq->context);
+    struct hgrnic_srq *srq = to_hgsrq(ibsrq);
+    struct hgm_srq_context *srqc;
+
+    srqc = mailbox_alloc();
+    if (!srqc)
+        return ENOMEM;
+    if (hcr_cmd(sc, NULL, srq->srqn, 0, CMD_QUERY_SRQ, srqc)) {
+        free(srqc);
+        return errno;
+    }
+    attr->srq_limit = be16toh(srqc->limit_watermark);
+    attr->max_wr    = srq->max;
+    attr->max_sge   = srq->max_gs;
+    free(srqc);
+    return 0;
+}
+
+/* hgrnic_destroy_srq(); the QPs on it have to be gone */
+int hgshim_destroy_srq(struct ibv_srq *ibsrq)
+{
+    struct hgshim_context *sc = to_shctx(ibsrq->context);
+    struct hgrnic_srq *srq = to_hgsrq(ibsrq);
+
+    if (hcr_cmd(sc, NULL, srq->srqn, 0, CMD_HW2SW_SRQ, NULL))
+        return errno;
+    range_free(sc, sc->srq_used, srq->srqn, 1);
+    hgshim_dereg_mr(srq->mr);
+    hgrnic_free_srq_buf(srq);
+    free(srq);
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* QP                                                                 */
+/* ------------------------------------------------------------------ */
+
+/* hgrnic_create_qp() in verbs.c; ib_hgrnic only allocates the QPN */
+struct ibv_qp *hgshim_create_qp(struct ibv_pd *ibpd,
+                                struct ibv_qp_init_attr *attr)
+{
+    struct hgshim_context *sc = to_shctx(ibpd->context);
+    struct hgshim_qp *sqp;
+    struct hgrnic_qp *qp;
+    int qpn;
+
+    if (attr->cap.max_send_wr > 65536 || attr->cap.max_recv_wr > 65536 ||
+        attr->cap.max_send_sge > 64 || attr->cap.max_recv_sge > 64 ||
+        attr->cap.max_inline_data > 1024) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    /* Receive WQEs come from the SRQ, the QP has no RQ of its own. */
+    if (attr->srq) {
+        attr->cap.max_recv_wr  = 0;
+        attr->cap.max_recv_sge = 0;
+    }
+
+    sqp = calloc(1, sizeof(*sqp));
+    if (!sqp) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    qp = &sqp->hgqp;
+    sqp->port_num = 1;
+
+    qp->sq.max = align_queue_size(attr->cap.max_send_wr);
+    qp->rq.max = align_queue_size(attr->cap.max_recv_wr);
+
+    if (hgrnic_alloc_qp_buf(ibpd, &attr->cap, attr->qp_type, qp))
+        goto err;
+
+    pthread_spin_init(&qp->sq.lock, PTHREAD_PROCESS_PRIVATE);
+    pthread_spin_init(&qp->rq.lock, PTHREAD_PROCESS_PRIVATE);
+
+    qp->sq.mr = reg_mr(ibpd, qp->sq.buf.buf, qp->sq.buf_size, 0, 0);
+    if (!qp->sq.mr)
+        goto err_free;
+    if (qp->rq.buf_size) {
+        qp->rq.mr = reg_mr(ibpd, qp->rq.buf.buf, qp->rq.buf_size, 0, 0);
+        if (!qp->rq.mr)
+            goto err_sq_mr;
+    }
+
+    qpn = range_alloc(sc, sc->qp_used, sc->rsvd_qps, sc->hgctx.num_qps, 1);
+    if (qpn < 0)
+        goto err_rq_mr;
+
+    qp->ibv_qp.context    = ibpd->context;
+    qp->ibv_qp.qp_context = attr->qp_context;
+    qp->ibv_qp.pd         = ibpd;
+    qp->ibv_qp.send_cq    = attr->send_cq;
+    qp->ibv_qp.recv_cq    = attr->recv_cq;
+    qp->ibv_qp.srq        = attr->srq;
+    qp->ibv_qp.handle     = qpn;
+    qp->ibv_qp.qp_num     = qpn;
+    qp->ibv_qp.qp_type    = attr->qp_type;
+    qp->ibv_qp.state      = IBV_QPS_RESET;
+
+    pthread_mutex_lock(&sc->hgctx.qp_table_mutex);
+    if (hgrnic_store_qp(&sc->hgctx, qpn, qp)) {
+        pthread_mutex_unlock(&sc->hgctx.qp_table_mutex);
+        range_free(sc, sc->qp_used, qpn, 1);
+        goto err_rq_mr;
+    }
+    pthread_mutex_unlock(&sc->hgctx.qp_table_mutex);
+
+    qp->max_inline_data = attr->cap.max_inline_data;
+    return &qp->ibv_qp;
+
+err_rq_mr:
+    if (qp->rq.buf_size)
+        hgshim_dereg_mr(qp->rq.mr);
+err_sq_mr:
+    hgshim_dereg_mr(qp->sq.mr);
+err_free:
+    free(qp->sq.wrid);
+    free(qp->rq.wrid);
+    hgrnic_free_buf(&qp->sq.buf);
+    hgrnic_free_buf(&qp->rq.buf);
+err:
+    free(sqp);
+    return NULL;
+}
+
+/* hgrnic_MODIFY_QP(): op[cur][next], 0 where the HCA has no transition */
+static uint16_t modify_op(enum ibv_qp_state cur, enum ibv_qp_state next)
+{
+    static const uint16_t op[IBV_QPS_ERR + 1][IBV_QPS_ERR + 1] = {
+        [IBV_QPS_RESET] = {
+            [IBV_QPS_RESET] = CMD_ERR2RST_QPEE,
+            [IBV_QPS_ERR]   = CMD_2ERR_QPEE,
+            [IBV_QPS_INIT]  = CMD_RST2INIT_QPEE,
+        },
+        [IBV_QPS_INIT] = {
+            [IBV_QPS_RESET] = CMD_ERR2RST_QPEE,
+            [IBV_QPS_ERR]   = CMD_2ERR_QPEE,
+            [IBV_QPS_INIT]  = CMD_INIT2INIT_QPEE,
+            [IBV_QPS_RTR]   = CMD_INIT2RTR_QPEE,
+        },
+        [IBV_QPS_RTR] = {
+            [IBV_QPS_RESET] = CMD_ERR2RST_QPEE,
+            [IBV_QPS_ERR]   = CMD_2ERR_QPEE,
+            [IBV_QPS_RTS]   = CMD_RTR2RTS_QPEE,
+        },
+        [IBV_QPS_RTS] = {
+            [IBV_QPS_RESET] = CMD_ERR2RST_QPEE,
+            [IBV_QPS_ERR]   = CMD_2ERR_QPEE,
+            [IBV_QPS_RTS]   = CMD_RTS2RTS_QPEE,
+            [IBV_QPS_SQD]   = CMD_RTS2SQD_QPEE,
+        },
+        [IBV_QPS_SQD] = {
+            [IBV_QPS_RESET] = CMD_ERR2RST_QPEE,
+            [IBV_QPS_ERR]   = CMD_2ERR_QPEE,
+            [IBV_QPS_RTS]   = CMD_SQD2RTS_QPEE,
+            [IBV_QPS_SQD]   = CMD_SQD2SQD_QPEE,
+        },
+        [IBV_QPS_SQE] = {
+            [IBV_QPS_RESET] = CMD_ERR2RST_QPEE,
+            [IBV_QPS_ERR]   = CMD_2ERR_QPEE,
+            [IBV_QPS_RTS]   = CMD_SQERR2RTS_QPEE,
+        },
+        [IBV_QPS_ERR] = {
+            [IBV_QPS_RESET] = CMD_ERR2RST_QPEE,
+            [IBV_QPS_ERR]   = CMD_2ERR_QPEE,
+        },
+    };
+
+    if (cur > IBV_QPS_ERR || next > IBV_QPS_ERR)
+        return 0;
+    return op[cur][next];
+}
+
+/* to_hgrnic_state(): the HCA numbers SQE before SQD */
+static uint32_t hca_state(enum ibv_qp_state state)
+{
+    switch (state) {
+    case IBV_QPS_SQD:
+        return QP_STATE_SQD;
+    case IBV_QPS_SQE:
+        return QP_STATE_SQE;
+    case IBV_QPS_ERR:
+        return QP_STATE_ERR;
+    default:
+        return state;       /* RESET, INIT, RTR, RTS */
+    }
+}
+
+static uint32_t hca_st(enum ibv_qp_type type)
+{
+    return type == IBV_QPT_UD ? QP_ST_UD :
+           type == IBV_QPT_UC ? QP_ST_UC : QP_ST_RC;
+}
+
+/*
+ * __hgrnic_modify_qp() in ib_hgrnic: the whole context goes with every
+ * transition. Then hgrnic_modify_qp() in verbs.c, which cleans the CQs
+ * on the way to RESET.
+ */
+int hgshim_modify_qp(struct ibv_qp *ibqp, struct ibv_qp_attr *attr,
+                     int attr_mask)
+{
+    struct hgshim_context *sc = to_shctx(ibqp->context);
+    struct hgshim_qp *sqp = to_shqp(ibqp);
+    struct hgrnic_qp *qp = &sqp->hgqp;
+    struct hgm_qp_param *param;
+    struct hgm_qp_context *qpc;
+    enum ibv_qp_state cur, next;
+    uint16_t op;
+    int err;
+
+    cur  = attr_mask & IBV_QP_CUR_STATE ? attr->cur_qp_state : ibqp->state;
+    next = attr_mask & IBV_QP_STATE ? attr->qp_state : cur;
+    op   = modify_op(cur, next);
+    if (!op)
+        return EINVAL;
+
+    param = mailbox_alloc();
+    if (!param)
+        return ENOMEM;
+    qpc = &param->context;
+
+    qpc->flags = htobe32(hca_state(next) << 28 | hca_st(ibqp->qp_type) << 16);
+
+    if (ibqp->qp_type == IBV_QPT_UD) {
+        sqp->mtu_msgmax = (IBV_MTU_4096 << 5) | 11;
+    } else if (attr_mask & IBV_QP_PATH_MTU) {
+        if (attr->path_mtu < IBV_MTU_256 || attr->path_mtu > IBV_MTU_4096) {
+            free(param);
+            return EINVAL;
+        }
+        sqp->mtu_msgmax = (attr->path_mtu << 5) | 31;
+    }
+    qpc->mtu_msgmax      = sqp->mtu_msgmax;
+    qpc->rq_entry_sz_log = qp->rq.wqe_shift;
+    qpc->sq_entry_sz_log = qp->sq.wqe_shift;
+    qpc->local_qpn       = htobe32(ibqp->qp_num & (sc->hgctx.num_qps - 1));
+
+    if (attr_mask & IBV_QP_DEST_QPN)
+        sqp->remote_qpn = attr->dest_qp_num;
+    qpc->remote_qpn = htobe32(sqp->remote_qpn & (sc->hgctx.num_qps - 1));
+
+    if (attr_mask & IBV_QP_PORT) {
+        sqp->port_num = attr->port_num;
+        param->opt_param_mask |= htobe32(QP_OPTPAR_PORT_NUM);
+    }
+    qpc->pri_path.port_pkey = htobe32(sqp->port_num);
+    qpc->pd                 = htobe32(to_hgpd(ibqp->pd)->pdn);
+    qpc->wqe_lkey           = htobe32(qp->sq.mr->lkey);
+
+    if (attr_mask & IBV_QP_SQ_PSN)
+        sqp->psn = attr->sq_psn;
+    qpc->next_send_psn  = htobe32(sqp->psn);
+    qpc->last_acked_psn = htobe32(sqp->psn);
+
+    qpc->cqn_snd        = htobe32(to_hgcq(ibqp->send_cq)->cqn);
+    qpc->snd_wqe_base_l = htobe32(qp->sq.mr->lkey);
+    qpc->snd_wqe_len    = htobe32(qp->sq.mr->length);
+
+    if (attr_mask & IBV_QP_MIN_RNR_TIMER) {
+        sqp->min_rnr_timer = (uint32_t) attr->min_rnr_timer << 24;
+        param->opt_param_mask |= htobe32(QP_OPTPAR_RNR_TIMEOUT);
+    }
+    if (attr_mask & IBV_QP_RQ_PSN)
+        sqp->epsn = attr->rq_psn;
+    qpc->rnr_nextrecvpsn = htobe32(sqp->min_rnr_timer | sqp->epsn);
+
+    qpc->cqn_rcv = htobe32(to_hgcq(ibqp->recv_cq)->cqn);
+    if (ibqp->srq) {
+        qpc->ra_buff_indx = htobe32(1U << 24 | to_hgsrq(ibqp->srq)->srqn);
+    } else if (qp->rq.buf_size) {
+        qpc->rcv_wqe_base_l = htobe32(qp->rq.mr->lkey);
+        qpc->rcv_wqe_len    = htobe32(qp->rq.mr->length);
+    }
+
+    err = hcr_cmd(sc, param, ibqp->qp_num, 0, op, NULL);
+    free(param);
+    if (err)
+        return errno;
+
+    ibqp->state = next;
+    if (next == IBV_QPS_RESET) {
+        hgrnic_cq_clean(to_hgcq(ibqp->recv_cq), ibqp->qp_num,
+                        ibqp->srq ? to_hgsrq(ibqp->srq) : NULL);
+        if (ibqp->send_cq != ibqp->recv_cq)
+            hgrnic_cq_clean(to_hgcq(ibqp->send_cq), ibqp->qp_num, NULL);
+        hgrnic_init_qp_indices(qp);
+    }
+    return 0;
+}
+
+/* hgrnic_destroy_qp() in verbs.c; ib_hgrnic takes the QP to RESET */
+int hgshim_destroy_qp(struct ibv_qp *ibqp)
+{
+    struct hgshim_context *sc = to_shctx(ibqp->context);
+    struct hgrnic_qp *qp = to_hgqp(ibqp);
+    struct hgrnic_cq *send_cq = to_hgcq(ibqp->send_cq);
+    struct hgrnic_cq *recv_cq = to_hgcq(ibqp->recv_cq);
+
+    if (ibqp->state != IBV_QPS_RESET &&
+        hcr_cmd(sc, NULL, ibqp->qp_num, 0, CMD_ERR2RST_QPEE, NULL))
+        return errno;
+
+    pthread_mutex_lock(&sc->hgctx.qp_table_mutex);
+    pthread_spin_lock(&recv_cq->lock);
+    __hgrnic_cq_clean(recv_cq, ibqp->qp_num,
+                      ibqp->srq ? to_hgsrq(ibqp->srq) : NULL);
+    pthread_spin_unlock(&recv_cq->lock);
+    if (send_cq != recv_cq) {
+        pthread_spin_lock(&send_cq->lock);
+        __hgrnic_cq_clean(send_cq, ibqp->qp_num, NULL);
+        pthread_spin_unlock(&send_cq->lock);
+    }
+    hgrnic_clear_qp(&sc->hgctx, ibqp->qp_num);
+    pthread_mutex_unlock(&sc->hgctx.qp_table_mutex);
+
+    range_free(sc, sc->qp_used, ibqp->qp_num, 1);
+    hgshim_dereg_mr(qp->sq.mr);
+    if (qp->rq.buf_size)
+        hgshim_dereg_mr(qp->rq.mr);
+    hgrnic_free_buf(&qp->sq.buf);
+    hgrnic_free_buf(&qp->rq.buf);
+    free(qp->sq.wrid);
+    free(qp->rq.wrid);
+    free(to_shqp(ibqp));
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* AH                                                                 */
+/* ------------------------------------------------------------------ */
+
+struct ibv_ah *hgshim_create_ah(struct ibv_pd *ibpd, struct ibv_ah_attr *attr)
+{
+    struct hgrnic_ah *ah;
+
+    ah = calloc(1, sizeof(*ah));
+    if (!ah) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (hgrnic_alloc_av(to_hgpd(ibpd), attr, ah)) {
+        free(ah);
+        errno = ENOMEM;
+        return NULL;
+    }
+    ah->ibv_ah.context = ibpd->context;
+    ah->ibv_ah.pd      = ibpd;
+    return &ah->ibv_ah;
+}
+
+int hgshim_destroy_ah(struct ibv_ah *ibah)
+{
+    hgrnic_free_av(to_hgah(ibah));
+    free(to_hgah(ibah));
+    return 0;
+}
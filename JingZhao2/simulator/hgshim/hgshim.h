@@ -0,0 +1,83 @@
+/*
+ * hgshim: libhgrnic on top of the hgmodel API.
+ *
+ * libhgshim.a contains libhgrnic's datapath (qp.c, cq.c, srq.c, buf.c,
+ * ah.c), compiled with HGRNIC_SIM_DOORBELL so that hgrnic_write64() hands the
+ * doorbell to hgm_uar_write64() instead of storing to a UAR page, and
+ * a stand-in for ib_hgrnic's control path (hgshim.c) that issues the
+ * HCR commands the kernel driver issues: QUERY_ADAPTER, QUERY_DEV_LIM,
+ * INIT_HCA and MAP_ICM at open, WRITE_MTT/SW2HW_MPT per MR, SW2HW_CQ
+ * per CQ, SW2HW_SRQ and ARM_SRQ per SRQ and the QPEE transitions per
+ * QP, with the same mailbox layouts. Linked with libhgmodel.a it runs against the model, with
+ * libhgcosim.a against the RTL.
+ *
+ * The returned ibv_context has ops.post_send, ops.post_recv,
+ * ops.post_srq_recv and ops.poll_cq set to libhgrnic's, so a program
+ * calls ibv_post_send(), ibv_post_recv(), ibv_post_srq_recv() and
+ * ibv_poll_cq() from <infiniband/verbs.h> as it would on hardware. Resources are created with the hgshim_*() calls
+ * below instead of the ibv_*() ones, which would go to the kernel.
+ * ops.poll_cq runs hgm_progress() before polling, so RC sends stalled
+ * on an empty receive queue complete once the receive is posted.
+ *
+ * Not covered: EQs and interrupts (completions are polled, and an
+ * SRQ reaching its limit raises nothing), resize_cq, and the ICM the kernel maps on demand; all context
+ * tables are mapped in full at open, sized by HGSHIM_NUM_*.
+ * Host memory is this process' memory, bus address == pointer.
+ */
+
+#ifndef HGSHIM_H
+#define HGSHIM_H
+
+#include <infiniband/verbs.h>
+
+#include "hgmodel.h"
+
+/* Context table sizes, capped by what QUERY_DEV_LIM reports. */
+#define HGSHIM_NUM_QPS      256
+#define HGSHIM_NUM_CQS      256
+#define HGSHIM_NUM_SRQS     64
+#define HGSHIM_NUM_MPTS     4096
+#define HGSHIM_NUM_MTTS     16384
+
+/* NULL with errno set on failure, as the ibv_*() calls. */
+struct ibv_context *hgshim_open(struct hgm_dev *dev);
+void hgshim_close(struct ibv_context *context);
+
+struct ibv_pd *hgshim_alloc_pd(struct ibv_context *context);
+int hgshim_dealloc_pd(struct ibv_pd *pd);
+
+struct ibv_mr *hgshim_reg_mr(struct ibv_pd *pd, void *addr, size_t length,
+                             int access);
+int hgshim_dereg_mr(struct ibv_mr *mr);
+
+struct ibv_cq *hgshim_create_cq(struct ibv_context *context, int cqe);
+int hgshim_destroy_cq(struct ibv_cq *cq);
+
+/*
+ * ibv_poll_cq() for one entry, also returning the CQE's completion
+ * timestamp (HGRNIC_CQE_TS_MASK bits of HCA clock cycles), which
+ * libhgrnic only reports through the extended CQ.
+ */
+int hgshim_poll_cq_ts(struct ibv_cq *cq, struct ibv_wc *wc, uint64_t *ts);
+
+/* Fails with EOPNOTSUPP unless QUERY_DEV_LIM reports DEV_LIM_FLAG_SRQ. */
+struct ibv_srq *hgshim_create_srq(struct ibv_pd *pd,
+                                  struct ibv_srq_init_attr *attr);
+int hgshim_modify_srq(struct ibv_srq *srq, struct ibv_srq_attr *attr,
+                      int attr_mask);
+int hgshim_query_srq(struct ibv_srq *srq, struct ibv_srq_attr *attr);
+int hgshim_destroy_srq(struct ibv_srq *srq);
+
+struct ibv_qp *hgshim_create_qp(struct ibv_pd *pd,
+                                struct ibv_qp_init_attr *attr);
+int hgshim_modify_qp(struct ibv_qp *qp, struct ibv_qp_attr *attr,
+                     int attr_mask);
+int hgshim_destroy_qp(struct ibv_qp *qp);
+
+struct ibv_ah *hgshim_create_ah(struct ibv_pd *pd, struct ibv_ah_attr *attr);
+int hgshim_destroy_ah(struct ibv_ah *ah);
+
+/* The device the context was opened on. */
+struct hgm_dev *hgshim_dev(struct ibv_context *context);
+
+#endif /* HGSHIM_H */
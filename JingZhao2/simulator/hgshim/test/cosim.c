@@ -0,0 +1,258 @@
+/*
+ * libhgrnic against the RTL, run by "make cosim-check" while the
+ * co-simulation is up (make run_cosim in verification/verilator).
+ *
+ * The same datapath as test/verbs.c, linked with libhgcosim.a: the
+ * WQEs libhgrnic builds go to HanGuHTN_Top through the send doorbell,
+ * are fetched by DMA and looped back through the MAC, and the work
+ * completions are the CQEs the RTL writes. Only what the RTL
+ * implements is checked: RC send/recv, RDMA write and read, and UD,
+ * and that a CQE's timestamp falls between two reads of the HCA clock
+ * registers in BAR0 taken before the doorbell and after the poll.
+ * Completions arrive in simulated time, so polls wait on a wall-clock
+ * deadline instead of a count.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hgcosim.h"
+#include "hgshim.h"
+
+#define CHECK(cond) do {                                                \
+        if (!(cond)) {                                                  \
+            fprintf(stderr, "%s:%d: check failed: %s\n",                \
+                    __FILE__, __LINE__, #cond);                         \
+            exit(1);                                                    \
+        }                                                               \
+    } while (0)
+
+#define DEPTH           16
+#define BUF_SIZE        8192
+#define QKEY            0x11111111
+#define POLL_TIMEOUT    60          /* s */
+#define TS_MASK         ((1ULL << 40) - 1)
+
+static struct ibv_pd *pd;
+
+static struct ibv_wc poll_ts(struct ibv_cq *cq, uint64_t *ts)
+{
+    struct ibv_wc wc;
+    time_t deadline = time(NULL) + POLL_TIMEOUT;
+    int n;
+
+    while (!(n = hgshim_poll_cq_ts(cq, &wc, ts)) && time(NULL) < deadline)
+        ;
+    CHECK(n == 1);
+    return wc;
+}
+
+static struct ibv_wc poll_one(struct ibv_cq *cq)
+{
+    uint64_t ts;
+
+    return poll_ts(cq, &ts);
+}
+
+static struct ibv_qp *create_qp(enum ibv_qp_type type, struct ibv_cq *cq)
+{
+    struct ibv_qp_init_attr attr;
+    struct ibv_qp *qp;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.send_cq          = cq;
+    attr.recv_cq          = cq;
+    attr.qp_type          = type;
+    attr.cap.max_send_wr  = DEPTH;
+    attr.cap.max_recv_wr  = DEPTH;
+    attr.cap.max_send_sge = 1;
+    attr.cap.max_recv_sge = 1;
+
+    qp = hgshim_create_qp(pd, &attr);
+    CHECK(qp);
+    return qp;
+}
+
+static void connect_qp(struct ibv_qp *qp, uint32_t dest_qpn)
+{
+    struct ibv_qp_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.qp_state        = IBV_QPS_INIT;
+    attr.port_num        = 1;
+    attr.qkey            = QKEY;
+    attr.qp_access_flags = IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ;
+    CHECK(!hgshim_modify_qp(qp, &attr, IBV_QP_STATE | IBV_QP_PORT |
+                            IBV_QP_ACCESS_FLAGS));
+
+    attr.qp_state      = IBV_QPS_RTR;
+    attr.path_mtu      = IBV_MTU_1024;
+    attr.dest_qp_num   = dest_qpn;
+    attr.min_rnr_timer = 12;
+    CHECK(!hgshim_modify_qp(qp, &attr, IBV_QP_STATE | IBV_QP_PATH_MTU |
+                            IBV_QP_DEST_QPN | IBV_QP_RQ_PSN |
+                            IBV_QP_MIN_RNR_TIMER));
+
+    attr.qp_state = IBV_QPS_RTS;
+    CHECK(!hgshim_modify_qp(qp, &attr, IBV_QP_STATE | IBV_QP_SQ_PSN));
+}
+
+static void post_recv(struct ibv_qp *qp, uint64_t wr_id, void *addr,
+                      uint32_t len, struct ibv_mr *mr)
+{
+    struct ibv_sge sge = {
+        .addr = (uintptr_t) addr, .length = len, .lkey = mr->lkey
+    };
+    struct ibv_recv_wr wr = { .wr_id = wr_id, .sg_list = &sge, .num_sge = 1 };
+    struct ibv_recv_wr *bad;
+
+    CHECK(!ibv_post_recv(qp, &wr, &bad));
+}
+
+static void post_send(struct ibv_qp *qp, struct ibv_send_wr *wr)
+{
+    struct ibv_send_wr *bad;
+
+    wr->send_flags |= IBV_SEND_SIGNALED;
+    CHECK(!ibv_post_send(qp, wr, &bad));
+}
+
+int main(void)
+{
+    struct hgm_dev *dev;
+    struct ibv_context *ctx;
+    struct ibv_cq *cq;
+    struct ibv_qp *rc[2], *ud[2];
+    struct ibv_mr *src_mr, *dst_mr;
+    struct ibv_ah_attr ah_attr = { .dlid = 1, .port_num = 1 };
+    struct ibv_ah *ah;
+    struct ibv_send_wr wr;
+    struct ibv_sge sge;
+    struct ibv_wc wc;
+    uint8_t *src, *dst;
+    uint64_t t0, t1, ts;
+    int i;
+
+    dev = hgm_create(NULL, NULL);
+    CHECK(dev);
+    ctx = hgshim_open(dev);
+    CHECK(ctx);
+    pd = hgshim_alloc_pd(ctx);
+    cq = hgshim_create_cq(ctx, 16);
+    CHECK(pd && cq);
+
+    rc[0] = create_qp(IBV_QPT_RC, cq);
+    rc[1] = create_qp(IBV_QPT_RC, cq);
+    connect_qp(rc[0], rc[1]->qp_num);
+    connect_qp(rc[1], rc[0]->qp_num);
+
+    src = aligned_alloc(4096, BUF_SIZE);
+    dst = aligned_alloc(4096, BUF_SIZE);
+    CHECK(src && dst);
+    for (i = 0; i < BUF_SIZE; ++i)
+        src[i] = i * 7;
+    memset(dst, 0, BUF_SIZE);
+    src_mr = hgshim_reg_mr(pd, src, BUF_SIZE, IBV_ACCESS_LOCAL_WRITE |
+                           IBV_ACCESS_REMOTE_READ);
+    dst_mr = hgshim_reg_mr(pd, dst, BUF_SIZE, IBV_ACCESS_LOCAL_WRITE |
+                           IBV_ACCESS_REMOTE_WRITE);
+    CHECK(src_mr && dst_mr);
+
+    /* RC send, two MTUs */
+    post_recv(rc[1], 100, dst, 2048, dst_mr);
+    memset(&wr, 0, sizeof(wr));
+    sge = (struct ibv_sge) { (uintptr_t) src, 2048, src_mr->lkey };
+    wr.wr_id   = 1;
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+    wr.opcode  = IBV_WR_SEND;
+    post_send(rc[0], &wr);
+    for (i = 0; i < 2; ++i) {
+        wc = poll_one(cq);
+        CHECK(wc.status == IBV_WC_SUCCESS);
+        if (wc.wr_id == 1)
+            CHECK(wc.opcode == IBV_WC_SEND && wc.qp_num == rc[0]->qp_num);
+        else
+            CHECK(wc.wr_id == 100 && wc.opcode == IBV_WC_RECV &&
+                  wc.byte_len == 2048 && wc.qp_num == rc[1]->qp_num);
+    }
+    CHECK(!memcmp(src, dst, 2048));
+
+    /* RDMA write, its CQE stamped between two clock reads */
+    memset(&wr, 0, sizeof(wr));
+    sge = (struct ibv_sge) { (uintptr_t) src + 100, 1000, src_mr->lkey };
+    wr.wr_id               = 2;
+    wr.sg_list             = &sge;
+    wr.num_sge             = 1;
+    wr.opcode              = IBV_WR_RDMA_WRITE;
+    wr.wr.rdma.remote_addr = (uintptr_t) dst + 4096;
+    wr.wr.rdma.rkey        = dst_mr->rkey;
+    t0 = hgcosim_read_clock(dev);
+    post_send(rc[0], &wr);
+    wc = poll_ts(cq, &ts);
+    t1 = hgcosim_read_clock(dev);
+    CHECK(wc.status == IBV_WC_SUCCESS && wc.wr_id == 2);
+    CHECK(wc.opcode == IBV_WC_RDMA_WRITE);
+    CHECK(((ts - t0) & TS_MASK) > 0);
+    CHECK(((ts - t0) & TS_MASK) <= ((t1 - t0) & TS_MASK));
+    CHECK(!memcmp(dst + 4096, src + 100, 1000));
+
+    /* RDMA read */
+    memset(&wr, 0, sizeof(wr));
+    sge = (struct ibv_sge) { (uintptr_t) dst + 6000, 500, dst_mr->lkey };
+    wr.wr_id               = 3;
+    wr.sg_list             = &sge;
+    wr.num_sge             = 1;
+    wr.opcode              = IBV_WR_RDMA_READ;
+    wr.wr.rdma.remote_addr = (uintptr_t) src + 3000;
+    wr.wr.rdma.rkey        = src_mr->rkey;
+    post_send(rc[0], &wr);
+    wc = poll_one(cq);
+    CHECK(wc.status == IBV_WC_SUCCESS && wc.wr_id == 3);
+    CHECK(wc.opcode == IBV_WC_RDMA_READ && wc.byte_len == 500);
+    CHECK(!memcmp(dst + 6000, src + 3000, 500));
+
+    /* UD send through an address handle */
+    ud[0] = create_qp(IBV_QPT_UD, cq);
+    ud[1] = create_qp(IBV_QPT_UD, cq);
+    connect_qp(ud[0], 0);
+    connect_qp(ud[1], 0);
+    ah = hgshim_create_ah(pd, &ah_attr);
+    CHECK(ah);
+    memset(dst, 0, BUF_SIZE);
+    post_recv(ud[1], 101, dst, 1024, dst_mr);
+    memset(&wr, 0, sizeof(wr));
+    sge = (struct ibv_sge) { (uintptr_t) src, 256, src_mr->lkey };
+    wr.wr_id             = 4;
+    wr.sg_list           = &sge;
+    wr.num_sge           = 1;
+    wr.opcode            = IBV_WR_SEND;
+    wr.wr.ud.ah          = ah;
+    wr.wr.ud.remote_qpn  = ud[1]->qp_num;
+    wr.wr.ud.remote_qkey = QKEY;
+    post_send(ud[0], &wr);
+    for (i = 0; i < 2; ++i) {
+        wc = poll_one(cq);
+        CHECK(wc.status == IBV_WC_SUCCESS);
+        CHECK(wc.wr_id == 4 || (wc.wr_id == 101 && wc.byte_len == 256));
+    }
+    CHECK(!memcmp(dst, src, 256));
+
+    CHECK(!hgshim_destroy_ah(ah));
+    for (i = 0; i < 2; ++i) {
+        CHECK(!hgshim_destroy_qp(rc[i]));
+        CHECK(!hgshim_destroy_qp(ud[i]));
+    }
+    CHECK(!hgshim_dereg_mr(src_mr) && !hgshim_dereg_mr(dst_mr));
+    CHECK(!hgshim_destroy_cq(cq));
+    CHECK(!hgshim_dealloc_pd(pd));
+    hgshim_close(ctx);
+    hgm_destroy(dev);
+
+    free(src);
+    free(dst);
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,524 @@
+/*
+ * libhgrnic against the model, run by "make check".
+ *
+ * Everything on the datapath is libhgrnic's: ibv_post_send(),
+ * ibv_post_recv() and ibv_poll_cq() go to hgrnic_post_send(),
+ * hgrnic_post_recv() and hgrnic_poll_cq() through the context ops, the
+ * WQEs they build reach the model through the send doorbell, and the
+ * work completions come from the CQEs the model writes. The resources
+ * are set up through hgshim's HCR commands.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hgshim.h"
+
+#define CHECK(cond) do {                                                \
+        if (!(cond)) {                                                  \
+            fprintf(stderr, "%s:%d: check failed: %s\n",                \
+                    __FILE__, __LINE__, #cond);                         \
+            exit(1);                                                    \
+        }                                                               \
+    } while (0)
+
+#define DEPTH       64
+#define BUF_SIZE    (3 * 4096 + 100)
+#define QKEY        0x11111111
+
+static struct ibv_context *ctx;
+static struct ibv_pd *pd;
+
+/* Polls until one completion is there, the model runs in the calls. */
+static struct ibv_wc poll_one(struct ibv_cq *cq)
+{
+    struct ibv_wc wc;
+    int i, n = 0;
+
+    for (i = 0; i < 1000 && !n; ++i)
+        n = ibv_poll_cq(cq, 1, &wc);
+    CHECK(n == 1);
+    return wc;
+}
+
+static int cq_empty(struct ibv_cq *cq)
+{
+    struct ibv_wc wc;
+
+    return ibv_poll_cq(cq, 1, &wc) == 0;
+}
+
+static struct ibv_qp *create_qp(enum ibv_qp_type type, struct ibv_cq *scq,
+                                struct ibv_cq *rcq, int max_inline)
+{
+    struct ibv_qp_init_attr attr;
+    struct ibv_qp *qp;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.send_cq             = scq;
+    attr.recv_cq             = rcq;
+    attr.qp_type             = type;
+    attr.cap.max_send_wr     = DEPTH;
+    attr.cap.max_recv_wr     = DEPTH;
+    attr.cap.max_send_sge    = 4;
+    attr.cap.max_recv_sge    = 4;
+    attr.cap.max_inline_data = max_inline;
+
+    qp = hgshim_create_qp(pd, &attr);
+    CHECK(qp);
+    return qp;
+}
+
+/* RESET -> INIT -> RTR -> RTS, as an application does with ibv_modify_qp() */
+static void connect_qp(struct ibv_qp *qp, uint32_t dest_qpn)
+{
+    struct ibv_qp_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.qp_state        = IBV_QPS_INIT;
+    attr.port_num        = 1;
+    attr.qkey            = QKEY;
+    attr.qp_access_flags = IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ;
+    CHECK(!hgshim_modify_qp(qp, &attr, IBV_QP_STATE | IBV_QP_PORT |
+                            IBV_QP_ACCESS_FLAGS));
+
+    attr.qp_state      = IBV_QPS_RTR;
+    attr.path_mtu      = IBV_MTU_1024;
+    attr.dest_qp_num   = dest_qpn;
+    attr.rq_psn        = 0;
+    attr.min_rnr_timer = 12;
+    CHECK(!hgshim_modify_qp(qp, &attr, IBV_QP_STATE | IBV_QP_PATH_MTU |
+                            IBV_QP_DEST_QPN | IBV_QP_RQ_PSN |
+                            IBV_QP_MIN_RNR_TIMER));
+
+    attr.qp_state = IBV_QPS_RTS;
+    attr.sq_psn   = 0;
+    CHECK(!hgshim_modify_qp(qp, &attr, IBV_QP_STATE | IBV_QP_SQ_PSN));
+    CHECK(qp->state == IBV_QPS_RTS);
+}
+
+static void post_recv(struct ibv_qp *qp, uint64_t wr_id, void *addr,
+                      uint32_t len, struct ibv_mr *mr)
+{
+    struct ibv_sge sge = {
+        .addr = (uintptr_t) addr, .length = len, .lkey = mr->lkey
+    };
+    struct ibv_recv_wr wr = { .wr_id = wr_id, .sg_list = &sge, .num_sge = 1 };
+    struct ibv_recv_wr *bad;
+
+    CHECK(!ibv_post_recv(qp, &wr, &bad));
+}
+
+int main(void)
+{
+    struct hgm_config cfg;
+    struct hgm_dev *dev;
+    struct hgm_stats before, after;
+    struct ibv_cq *scq, *rcq;
+    struct ibv_qp *rc[2], *ud[2];
+    struct ibv_mr *src_mr, *dst_mr;
+    struct ibv_send_wr wr[4], *bad;
+    struct ibv_sge sge[4];
+    struct ibv_wc wc;
+    uint8_t *src, *dst;
+    int i;
+
+    dev = hgm_create(NULL, NULL);
+    CHECK(dev);
+    ctx = hgshim_open(dev);
+    CHECK(ctx);
+    pd = hgshim_alloc_pd(ctx);
+    CHECK(pd);
+
+    scq = hgshim_create_cq(ctx, 32);
+    rcq = hgshim_create_cq(ctx, 32);
+    CHECK(scq && rcq && scq->cqe == 31);
+
+    rc[0] = create_qp(IBV_QPT_RC, scq, rcq, 64);
+    rc[1] = create_qp(IBV_QPT_RC, scq, rcq, 64);
+    connect_qp(rc[0], rc[1]->qp_num);
+    connect_qp(rc[1], rc[0]->qp_num);
+
+    src = malloc(BUF_SIZE);
+    dst = malloc(BUF_SIZE);
+    CHECK(src && dst);
+    for (i = 0; i < BUF_SIZE; ++i)
+        src[i] = i * 7;
+    memset(dst, 0, BUF_SIZE);
+    src_mr = hgshim_reg_mr(pd, src, BUF_SIZE, IBV_ACCESS_LOCAL_WRITE |
+                           IBV_ACCESS_REMOTE_READ);
+    dst_mr = hgshim_reg_mr(pd, dst, BUF_SIZE, IBV_ACCESS_LOCAL_WRITE |
+                           IBV_ACCESS_REMOTE_WRITE);
+    CHECK(src_mr && dst_mr && src_mr->lkey != dst_mr->lkey);
+
+    /* RC send with immediate over four pages */
+    post_recv(rc[1], 100, dst, BUF_SIZE, dst_mr);
+    memset(wr, 0, sizeof(wr));
+    sge[0].addr   = (uintptr_t) src;
+    sge[0].length = BUF_SIZE;
+    sge[0].lkey   = src_mr->lkey;
+    wr[0].wr_id      = 1;
+    wr[0].sg_list    = &sge[0];
+    wr[0].num_sge    = 1;
+    wr[0].opcode     = IBV_WR_SEND_WITH_IMM;
+    wr[0].send_flags = IBV_SEND_SIGNALED;
+    wr[0].imm_data   = htobe32(0x1234);
+    CHECK(!ibv_post_send(rc[0], &wr[0], &bad));
+
+    wc = poll_one(scq);
+    CHECK(wc.status == IBV_WC_SUCCESS && wc.wr_id == 1);
+    CHECK(wc.opcode == IBV_WC_SEND && wc.qp_num == rc[0]->qp_num);
+    wc = poll_one(rcq);
+    CHECK(wc.status == IBV_WC_SUCCESS && wc.wr_id == 100);
+    CHECK(wc.opcode == IBV_WC_RECV && (wc.wc_flags & IBV_WC_WITH_IMM));
+    CHECK(wc.byte_len == BUF_SIZE && wc.qp_num == rc[1]->qp_num);
+    CHECK(wc.imm_data == htobe32(0x1234));
+    CHECK(!memcmp(src, dst, BUF_SIZE));
+    CHECK(cq_empty(scq) && cq_empty(rcq));
+
+    /* A chain of four WRs is one doorbell: write, read, write, inline send */
+    memset(dst, 0, BUF_SIZE);
+    post_recv(rc[1], 101, dst + 10000, 100, dst_mr);
+    memset(wr, 0, sizeof(wr));
+    for (i = 0; i < 4; ++i) {
+        wr[i].wr_id   = 10 + i;
+        wr[i].sg_list = &sge[i];
+        wr[i].num_sge = 1;
+        wr[i].next    = i < 3 ? &wr[i + 1] : NULL;
+    }
+    sge[0] = (struct ibv_sge) { (uintptr_t) src, 5000, src_mr->lkey };
+    wr[0].opcode              = IBV_WR_RDMA_WRITE;
+    wr[0].wr.rdma.remote_addr = (uintptr_t) dst + 10;
+    wr[0].wr.rdma.rkey        = dst_mr->rkey;
+    sge[1] = (struct ibv_sge) { (uintptr_t) dst + 8000, 300, dst_mr->lkey };
+    wr[1].opcode              = IBV_WR_RDMA_READ;
+    wr[1].send_flags          = IBV_SEND_SIGNALED;
+    wr[1].wr.rdma.remote_addr = (uintptr_t) src + 4000;
+    wr[1].wr.rdma.rkey        = src_mr->rkey;
+    sge[2] = (struct ibv_sge) { (uintptr_t) src + 100, 8, src_mr->lkey };
+    wr[2].opcode              = IBV_WR_RDMA_WRITE;
+    wr[2].send_flags          = IBV_SEND_SIGNALED;
+    wr[2].wr.rdma.remote_addr = (uintptr_t) dst + 9000;
+    wr[2].wr.rdma.rkey        = dst_mr->rkey;
+    sge[3] = (struct ibv_sge) { (uintptr_t) src + 200, 48, 0 };
+    wr[3].opcode              = IBV_WR_SEND;
+    wr[3].send_flags          = IBV_SEND_SIGNALED | IBV_SEND_INLINE;
+
+    hgm_get_stats(dev, &before);
+    CHECK(!ibv_post_send(rc[0], &wr[0], &bad));
+    hgm_get_stats(dev, &after);
+    CHECK(after.send_dbs == before.send_dbs + 1);
+    CHECK(after.wqes == before.wqes + 4);
+
+    wc = poll_one(scq);
+    CHECK(wc.status == IBV_WC_SUCCESS && wc.wr_id == 11);
+    CHECK(wc.opcode == IBV_WC_RDMA_READ && wc.byte_len == 300);
+    wc = poll_one(scq);
+    CHECK(wc.status == IBV_WC_SUCCESS && wc.wr_id == 12);
+    CHECK(wc.opcode == IBV_WC_RDMA_WRITE);
+    wc = poll_one(scq);
+    CHECK(wc.status == IBV_WC_SUCCESS && wc.wr_id == 13);
+    CHECK(wc.opcode == IBV_WC_SEND);
+    CHECK(cq_empty(scq));
+    wc = poll_one(rcq);
+    CHECK(wc.status == IBV_WC_SUCCESS && wc.wr_id == 101 && wc.byte_len == 48);
+    CHECK(!memcmp(dst + 10, src, 5000));
+    CHECK(!memcmp(dst + 8000, src + 4000, 300));
+    CHECK(!memcmp(dst + 9000, src + 100, 8));
+    CHECK(!memcmp(dst + 10000, src + 200, 48));
+
+    /* No atomics without DEV_LIM_FLAG_ATOMIC: libhgrnic refuses the WR */
+    memset(wr, 0, sizeof(wr));
+    sge[0] = (struct ibv_sge) { (uintptr_t) dst, 8, dst_mr->lkey };
+    wr[0].sg_list               = &sge[0];
+    wr[0].num_sge               = 1;
+    wr[0].opcode                = IBV_WR_ATOMIC_FETCH_AND_ADD;
+    wr[0].send_flags            = IBV_SEND_SIGNALED;
+    wr[0].wr.atomic.remote_addr = (uintptr_t) dst + 8;
+    wr[0].wr.atomic.rkey        = dst_mr->rkey;
+    wr[0].wr.atomic.compare_add = 1;
+    CHECK(ibv_post_send(rc[0], &wr[0], &bad) && bad == &wr[0]);
+    CHECK(cq_empty(scq));
+
+    /* Nor SRQs without DEV_LIM_FLAG_SRQ, as on the RTL */
+    {
+        struct ibv_srq_init_attr srq_attr = { .attr = { .max_wr = 4 } };
+
+        CHECK(!hgshim_create_srq(pd, &srq_attr) && errno == EOPNOTSUPP);
+    }
+
+    /* RC send without a receive WQE waits for ibv_post_recv() */
+    memset(wr, 0, sizeof(wr));
+    sge[0] = (struct ibv_sge) { (uintptr_t) src, 64, src_mr->lkey };
+    wr[0].wr_id      = 20;
+    wr[0].sg_list    = &sge[0];
+    wr[0].num_sge    = 1;
+    wr[0].opcode     = IBV_WR_SEND;
+    wr[0].send_flags = IBV_SEND_SIGNALED;
+    CHECK(!ibv_post_send(rc[0], &wr[0], &bad));
+    CHECK(cq_empty(scq) && cq_empty(rcq));
+    memset(dst, 0, 64);
+    post_recv(rc[1], 102, dst, 64, dst_mr);
+    wc = poll_one(scq);
+    CHECK(wc.status == IBV_WC_SUCCESS && wc.wr_id == 20);
+    wc = poll_one(rcq);
+    CHECK(wc.status == IBV_WC_SUCCESS && wc.wr_id == 102 && wc.byte_len == 64);
+    CHECK(!memcmp(dst, src, 64));
+
+    /* UD send through an address handle */
+    ud[0] = create_qp(IBV_QPT_UD, scq, rcq, 0);
+    ud[1] = create_qp(IBV_QPT_UD, scq, rcq, 0);
+    connect_qp(ud[0], 0);
+    connect_qp(ud[1], 0);
+    {
+        struct ibv_ah_attr ah_attr = { .dlid = 1, .port_num = 1 };
+        struct ibv_ah *ah = hgshim_create_ah(pd, &ah_attr);
+
+        CHECK(ah);
+        memset(dst, 0, BUF_SIZE);
+        post_recv(ud[1], 103, dst, 4096, dst_mr);
+        memset(wr, 0, sizeof(wr));
+        sge[0] = (struct ibv_sge) { (uintptr_t) src, 256, src_mr->lkey };
+        wr[0].wr_id             = 30;
+        wr[0].sg_list           = &sge[0];
+        wr[0].num_sge           = 1;
+        wr[0].opcode            = IBV_WR_SEND;
+        wr[0].send_flags        = IBV_SEND_SIGNALED;
+        wr[0].wr.ud.ah          = ah;
+        wr[0].wr.ud.remote_qpn  = ud[1]->qp_num;
+        wr[0].wr.ud.remote_qkey = QKEY;
+        CHECK(!ibv_post_send(ud[0], &wr[0], &bad));
+
+        wc = poll_one(scq);
+        CHECK(wc.status == IBV_WC_SUCCESS && wc.wr_id == 30);
+        wc = poll_one(rcq);
+        CHECK(wc.status == IBV_WC_SUCCESS && wc.wr_id == 103);
+        CHECK(wc.qp_num == ud[1]->qp_num && wc.src_qp == ud[0]->qp_num);
+        CHECK(!memcmp(dst, src, 256));
+        CHECK(!hgshim_destroy_ah(ah));
+    }
+
+    /* RC bad rkey: error completion, the rest of the chain is flushed */
+    memset(wr, 0, sizeof(wr));
+    for (i = 0; i < 2; ++i) {
+        sge[i] = (struct ibv_sge) { (uintptr_t) src, 8, src_mr->lkey };
+        wr[i].wr_id               = 40 + i;
+        wr[i].sg_list             = &sge[i];
+        wr[i].num_sge             = 1;
+        wr[i].opcode              = IBV_WR_RDMA_WRITE;
+        wr[i].send_flags          = IBV_SEND_SIGNALED;
+        wr[i].wr.rdma.remote_addr = (uintptr_t) dst;
+        wr[i].wr.rdma.rkey        = i ? dst_mr->rkey : 999;
+        wr[i].next                = i ? NULL : &wr[1];
+    }
+    CHECK(!ibv_post_send(rc[0], &wr[0], &bad));
+    wc = poll_one(scq);
+    CHECK(wc.wr_id == 40 && wc.status == IBV_WC_REM_ACCESS_ERR);
+    wc = poll_one(scq);
+    CHECK(wc.wr_id == 41 && wc.status == IBV_WC_WR_FLUSH_ERR);
+
+    /* Back to RESET and tear down, which cleans the CQs */
+    {
+        struct ibv_qp_attr attr = { .qp_state = IBV_QPS_RESET };
+
+        CHECK(!hgshim_modify_qp(rc[0], &attr, IBV_QP_STATE));
+    }
+    for (i = 0; i < 2; ++i) {
+        CHECK(!hgshim_destroy_qp(rc[i]));
+        CHECK(!hgshim_destroy_qp(ud[i]));
+    }
+    CHECK(!hgshim_dereg_mr(src_mr) && !hgshim_dereg_mr(dst_mr));
+    CHECK(!hgshim_destroy_cq(scq) && !hgshim_destroy_cq(rcq));
+    CHECK(!hgshim_dealloc_pd(pd));
+    hgshim_close(ctx);
+
+    hgm_get_stats(dev, &after);
+    CHECK(after.cmd_errors == 0);
+    hgm_destroy(dev);
+
+    /* With DEV_LIM_FLAG_ATOMIC the same WR goes out and executes */
+    hgm_default_config(&cfg);
+    cfg.dev_cap_flags |= 1U << 18;
+    dev = hgm_create(&cfg, NULL);
+    CHECK(dev);
+    ctx = hgshim_open(dev);
+    CHECK(ctx);
+    pd  = hgshim_alloc_pd(ctx);
+    scq = hgshim_create_cq(ctx, 8);
+    CHECK(pd && scq);
+    rc[0] = create_qp(IBV_QPT_RC, scq, scq, 0);
+    rc[1] = create_qp(IBV_QPT_RC, scq, scq, 0);
+    connect_qp(rc[0], rc[1]->qp_num);
+    connect_qp(rc[1], rc[0]->qp_num);
+    dst_mr = hgshim_reg_mr(pd, dst, 64, IBV_ACCESS_LOCAL_WRITE |
+                           IBV_ACCESS_REMOTE_ATOMIC);
+    CHECK(dst_mr);
+    *(uint64_t *) (dst + 8) = 40;
+    memset(wr, 0, sizeof(wr));
+    sge[0] = (struct ibv_sge) { (uintptr_t) dst, 8, dst_mr->lkey };
+    wr[0].wr_id                 = 50;
+    wr[0].sg_list               = &sge[0];
+    wr[0].num_sge               = 1;
+    wr[0].opcode                = IBV_WR_ATOMIC_FETCH_AND_ADD;
+    wr[0].send_flags            = IBV_SEND_SIGNALED;
+    wr[0].wr.atomic.remote_addr = (uintptr_t) dst + 8;
+    wr[0].wr.atomic.rkey        = dst_mr->rkey;
+    wr[0].wr.atomic.compare_add = 2;
+    CHECK(!ibv_post_send(rc[0], &wr[0], &bad));
+    wc = poll_one(scq);
+    CHECK(wc.status == IBV_WC_SUCCESS && wc.wr_id == 50);
+    CHECK(wc.opcode == IBV_WC_FETCH_ADD && wc.byte_len == 8);
+    CHECK(*(uint64_t *) dst == 40 && *(uint64_t *) (dst + 8) == 42);
+
+    for (i = 0; i < 2; ++i)
+        CHECK(!hgshim_destroy_qp(rc[i]));
+    CHECK(!hgshim_dereg_mr(dst_mr));
+    CHECK(!hgshim_destroy_cq(scq));
+    CHECK(!hgshim_dealloc_pd(pd));
+    hgshim_close(ctx);
+    hgm_destroy(dev);
+
+    /* Two RC QPs receiving from one SRQ, with DEV_LIM_FLAG_SRQ */
+    hgm_default_config(&cfg);
+    cfg.dev_cap_flags |= 1U << 6;
+    dev = hgm_create(&cfg, NULL);
+    CHECK(dev);
+    ctx = hgshim_open(dev);
+    CHECK(ctx);
+    pd  = hgshim_alloc_pd(ctx);
+    scq = hgshim_create_cq(ctx, 16);
+    rcq = hgshim_create_cq(ctx, 16);
+    CHECK(pd && scq && rcq);
+    {
+        struct ibv_srq_init_attr srq_attr = {
+            .attr = { .max_wr = 3, .max_sge = 2, .srq_limit = 1 }
+        };
+        struct ibv_srq_attr qattr;
+        struct ibv_qp_init_attr qp_attr;
+        struct ibv_recv_wr rwr[4], *rbad;
+        struct ibv_qp *srv[2], *cli[2];
+        struct ibv_srq *srq;
+
+        srq = hgshim_create_srq(pd, &srq_attr);
+        CHECK(srq && srq_attr.attr.max_wr == 4);
+
+        memset(&qp_attr, 0, sizeof(qp_attr));
+        qp_attr.send_cq          = scq;
+        qp_attr.recv_cq          = rcq;
+        qp_attr.srq              = srq;
+        qp_attr.qp_type          = IBV_QPT_RC;
+        qp_attr.cap.max_send_wr  = DEPTH;
+        qp_attr.cap.max_send_sge = 1;
+        for (i = 0; i < 2; ++i) {
+            srv[i] = hgshim_create_qp(pd, &qp_attr);
+            CHECK(srv[i] && srv[i]->srq == srq);
+            CHECK(qp_attr.cap.max_recv_wr == 0);
+            cli[i] = create_qp(IBV_QPT_RC, scq, scq, 0);
+            connect_qp(srv[i], cli[i]->qp_num);
+            connect_qp(cli[i], srv[i]->qp_num);
+        }
+
+        src_mr = hgshim_reg_mr(pd, src, BUF_SIZE, 0);
+        dst_mr = hgshim_reg_mr(pd, dst, BUF_SIZE, IBV_ACCESS_LOCAL_WRITE);
+        CHECK(src_mr && dst_mr);
+        memset(dst, 0, BUF_SIZE);
+
+        /* A fifth WQE does not fit the ring of four */
+        memset(rwr, 0, sizeof(rwr));
+        for (i = 0; i < 4; ++i) {
+            sge[i] = (struct ibv_sge) {
+                (uintptr_t) dst + i * 1024, 1024, dst_mr->lkey
+            };
+            rwr[i].wr_id   = 200 + i;
+            rwr[i].sg_list = &sge[i];
+            rwr[i].num_sge = 1;
+            rwr[i].next    = i < 3 ? &rwr[i + 1] : NULL;
+        }
+        CHECK(!ibv_post_srq_recv(srq, rwr, &rbad));
+        rwr[0].next = NULL;
+        CHECK(ibv_post_srq_recv(srq, rwr, &rbad) && rbad == rwr);
+
+        /* Sends to either QP take the SRQ's WQEs in order */
+        for (i = 0; i < 3; ++i) {
+            memset(wr, 0, sizeof(wr));
+            sge[0] = (struct ibv_sge) {
+                (uintptr_t) src + i * 100, 100 + i, src_mr->lkey
+            };
+            wr[0].wr_id      = 60 + i;
+            wr[0].sg_list    = &sge[0];
+            wr[0].num_sge    = 1;
+            wr[0].opcode     = IBV_WR_SEND;
+            wr[0].send_flags = IBV_SEND_SIGNALED;
+            CHECK(!ibv_post_send(cli[i & 1], &wr[0], &bad));
+            wc = poll_one(scq);
+            CHECK(wc.status == IBV_WC_SUCCESS && wc.wr_id == 60 + i);
+            wc = poll_one(rcq);
+            CHECK(wc.status == IBV_WC_SUCCESS && wc.opcode == IBV_WC_RECV);
+            CHECK(wc.wr_id == 200 + i && wc.byte_len == 100 + i);
+            CHECK(wc.qp_num == srv[i & 1]->qp_num);
+            CHECK(!memcmp(dst + i * 1024, src + i * 100, 100 + i));
+        }
+
+        /* The polled WQEs are free again, the ring wraps */
+        memset(rwr, 0, sizeof(rwr));
+        sge[0] = (struct ibv_sge) { (uintptr_t) dst, 1024, dst_mr->lkey };
+        rwr[0].wr_id   = 210;
+        rwr[0].sg_list = &sge[0];
+        rwr[0].num_sge = 1;
+        CHECK(!ibv_post_srq_recv(srq, rwr, &rbad));
+
+        /* The limit goes to the HCA and back */
+        qattr.srq_limit = 3;
+        CHECK(!hgshim_modify_srq(srq, &qattr, IBV_SRQ_LIMIT));
+        qattr.srq_limit = 5;
+        CHECK(hgshim_modify_srq(srq, &qattr, IBV_SRQ_LIMIT) == EINVAL);
+        CHECK(hgshim_modify_srq(srq, &qattr, IBV_SRQ_MAX_WR) == EINVAL);
+        memset(&qattr, 0, sizeof(qattr));
+        CHECK(!hgshim_query_srq(srq, &qattr));
+        CHECK(qattr.srq_limit == 3 && qattr.max_wr == 4);
+
+        /* Resetting one QP leaves the SRQ's WQEs to the other */
+        {
+            struct ibv_qp_attr attr = { .qp_state = IBV_QPS_RESET };
+
+            CHECK(!hgshim_modify_qp(srv[0], &attr, IBV_QP_STATE));
+        }
+        for (i = 0; i < 2; ++i) {
+            memset(wr, 0, sizeof(wr));
+            sge[0] = (struct ibv_sge) { (uintptr_t) src, 8, src_mr->lkey };
+            wr[0].wr_id      = 70 + i;
+            wr[0].sg_list    = &sge[0];
+            wr[0].num_sge    = 1;
+            wr[0].opcode     = IBV_WR_SEND;
+            wr[0].send_flags = IBV_SEND_SIGNALED;
+            CHECK(!ibv_post_send(cli[1], &wr[0], &bad));
+            wc = poll_one(scq);
+            CHECK(wc.status == IBV_WC_SUCCESS && wc.wr_id == 70 + i);
+            wc = poll_one(rcq);
+            CHECK(wc.status == IBV_WC_SUCCESS);
+            CHECK(wc.qp_num == srv[1]->qp_num);
+            CHECK(wc.wr_id == (i ? 210 : 203));
+        }
+        CHECK(cq_empty(rcq));
+
+        for (i = 0; i < 2; ++i) {
+            CHECK(!hgshim_destroy_qp(srv[i]));
+            CHECK(!hgshim_destroy_qp(cli[i]));
+        }
+        CHECK(!hgshim_destroy_srq(srq));
+    }
+    CHECK(!hgshim_dereg_mr(src_mr) && !hgshim_dereg_mr(dst_mr));
+    CHECK(!hgshim_destroy_cq(scq) && !hgshim_destroy_cq(rcq));
+    CHECK(!hgshim_dealloc_pd(pd));
+    hgshim_close(ctx);
+    hgm_get_stats(dev, &after);
+    CHECK(after.cmd_errors == 0);
+    hgm_destroy(dev);
+
+    free(src);
+    free(dst);
+    printf("PASS\n");
+    return 0;
+}
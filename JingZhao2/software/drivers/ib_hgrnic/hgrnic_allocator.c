@@ -7,15 +7,19 @@
 
 #include <linux/errno.h>
 #include <linux/slab.h>
+#include <linux/module.h>
 #include <linux/bitmap.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
 
 #include "hgrnic_dev.h"
 
 /**
- * @description: Allocate one resource element (UAR, PD, MPT, CQ, QP).
- * Trivial bitmap-based allocator
+ * @description: Allocate one resource element from the bitmap.
+ * Trivial bitmap-based allocator, used directly by small tables and
+ * as the backing store of the per-CPU magazines.
  */
-u32 hgrnic_alloc (struct hgrnic_alloc *alloc)
+static u32 __hgrnic_alloc (struct hgrnic_alloc *alloc)
 {
     unsigned long flags;
     u32 obj;
@@ -43,12 +47,149 @@ u32 hgrnic_alloc (struct hgrnic_alloc *alloc)
     return obj;
 }
 
+/**
+ * @note Return released IDs of one magazine to the bitmap.
+ * Called with alloc->lock held.
+ *
+ * top moves one generation per retired ID, as the bitmap path does
+ * per hgrnic_free, so that an ID goes back into use with a prefix at
+ * least as far from its old one as without magazines. A parked ID
+ * is not in the bitmap yet, so it cannot be handed out before its
+ * step has been taken.
+ */
+static void hgrnic_mag_retire (struct hgrnic_alloc *alloc,
+                               struct hgrnic_alloc_mag *mag)
+{
+    while (mag->nr_free) {
+        clear_bit(mag->free_ids[--mag->nr_free], alloc->table);
+        alloc->top = (alloc->top + alloc->max) & alloc->mask;
+    }
+}
+
+/**
+ * @note Reserve a batch of IDs for one magazine. The bitmap cursor
+ * only moves forward, so the batch never contains IDs released
+ * since the last wrap around. Called with mag->lock held.
+ */
+static void hgrnic_mag_refill (struct hgrnic_alloc *alloc,
+                               struct hgrnic_alloc_mag *mag)
+{
+    u32 ids[HGRNIC_ALLOC_MAG_SIZE];
+    u32 obj;
+    int n = 0;
+
+    spin_lock(&alloc->lock);
+
+    hgrnic_mag_retire(alloc, mag);
+
+    while (n < HGRNIC_ALLOC_MAG_SIZE) {
+        obj = find_next_zero_bit(alloc->table, alloc->max, alloc->last);
+        if (obj >= alloc->max) {
+            alloc->top = (alloc->top + alloc->max) & alloc->mask;
+            obj = find_first_zero_bit(alloc->table, alloc->max);
+            if (obj >= alloc->max)
+                break;
+        }
+
+        alloc->last = obj + 1;
+        if (alloc->last == alloc->max)
+            alloc->last = 0;
+
+        set_bit(obj, alloc->table);
+        ids[n++] = obj;
+    }
+
+    spin_unlock(&alloc->lock);
+
+    /* Stack them so that the lowest ID is handed out first. */
+    while (n)
+        mag->alloc_ids[mag->nr_alloc++] = ids[--n];
+}
+
+/**
+ * @note Give every cached ID of every CPU back to the bitmap. Used
+ * when the bitmap runs dry while other CPUs still hold reserved IDs.
+ * A CPU parks at most HGRNIC_ALLOC_MAG_SIZE freed IDs, and keeps
+ * them until its own next refill or full magazine, or until this
+ * drain; so parked IDs delay reuse but never fail an allocation.
+ */
+static void hgrnic_mag_drain (struct hgrnic_alloc *alloc)
+{
+    struct hgrnic_alloc_mag *mag;
+    unsigned long flags;
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        mag = per_cpu_ptr(alloc->mags, cpu);
+
+        spin_lock_irqsave(&mag->lock, flags);
+        spin_lock(&alloc->lock);
+
+        hgrnic_mag_retire(alloc, mag);
+        while (mag->nr_alloc)
+            clear_bit(mag->alloc_ids[--mag->nr_alloc], alloc->table);
+
+        spin_unlock(&alloc->lock);
+        spin_unlock_irqrestore(&mag->lock, flags);
+    }
+}
+
+/**
+ * @description: Allocate one resource element (UAR, PD, MPT, CQ, QP).
+ * IDs come from the per-CPU magazine if the table has one, so that
+ * concurrent allocations on different CPUs do not serialize on
+ * alloc->lock.
+ */
+u32 hgrnic_alloc (struct hgrnic_alloc *alloc)
+{
+    struct hgrnic_alloc_mag *mag;
+    unsigned long flags;
+    u32 obj;
+
+    if (!alloc->mags)
+        return __hgrnic_alloc(alloc);
+
+    mag = raw_cpu_ptr(alloc->mags);
+    spin_lock_irqsave(&mag->lock, flags);
+
+    if (!mag->nr_alloc)
+        hgrnic_mag_refill(alloc, mag);
+
+    if (mag->nr_alloc) {
+        obj = mag->alloc_ids[--mag->nr_alloc] | READ_ONCE(alloc->top);
+        spin_unlock_irqrestore(&mag->lock, flags);
+        return obj;
+    }
+
+    spin_unlock_irqrestore(&mag->lock, flags);
+
+    hgrnic_mag_drain(alloc);
+    return __hgrnic_alloc(alloc);
+}
+EXPORT_SYMBOL_GPL(hgrnic_alloc);
+
 void hgrnic_free (struct hgrnic_alloc *alloc, u32 obj)
 {
+    struct hgrnic_alloc_mag *mag;
     unsigned long flags;
 
     obj &= alloc->max - 1;
 
+    if (alloc->mags) {
+        mag = raw_cpu_ptr(alloc->mags);
+        spin_lock_irqsave(&mag->lock, flags);
+
+        if (mag->nr_free == HGRNIC_ALLOC_MAG_SIZE) {
+            spin_lock(&alloc->lock);
+            hgrnic_mag_retire(alloc, mag);
+            spin_unlock(&alloc->lock);
+        }
+        mag->free_ids[mag->nr_free++] = obj;
+
+        spin_unlock_irqrestore(&mag->lock, flags);
+        return;
+    }
+
     spin_lock_irqsave(&alloc->lock, flags);
 
     clear_bit(obj, alloc->table);
@@ -57,12 +198,15 @@ void hgrnic_free (struct hgrnic_alloc *alloc, u32 obj)
 
     spin_unlock_irqrestore(&alloc->lock, flags);
 }
+EXPORT_SYMBOL_GPL(hgrnic_free);
 
 /**
  * @note Init hgrnic resources number (including PD, UAR, MPT, EQ, CQ, QP).
+ * Tables large enough to give every CPU HGRNIC_ALLOC_MAG_MIN IDs get
+ * per-CPU magazines, smaller ones use the bitmap alone.
  */
 int hgrnic_alloc_init (struct hgrnic_alloc *alloc, u32 num, u32 mask) {
-	// int i;
+	int cpu;
 
 	/* num must be a power of 2 */
 	if (num != 1 << (ffs(num) - 1)) {
@@ -73,6 +217,7 @@ int hgrnic_alloc_init (struct hgrnic_alloc *alloc, u32 num, u32 mask) {
 	alloc->top  = 0;
 	alloc->max  = num;
 	alloc->mask = mask;
+	alloc->mags = NULL;
 	spin_lock_init(&alloc->lock);
 	alloc->table = kmalloc_array(BITS_TO_LONGS(num), sizeof(long),
 				     GFP_KERNEL);
@@ -82,117 +227,140 @@ int hgrnic_alloc_init (struct hgrnic_alloc *alloc, u32 num, u32 mask) {
 
 	bitmap_zero(alloc->table, num);
 
+	if (num / num_possible_cpus() < HGRNIC_ALLOC_MAG_MIN)
+		return 0;
+
+	alloc->mags = alloc_percpu(struct hgrnic_alloc_mag);
+	if (!alloc->mags) /* Fall back to the plain bitmap */
+		return 0;
+
+	for_each_possible_cpu(cpu) {
+		struct hgrnic_alloc_mag *mag = per_cpu_ptr(alloc->mags, cpu);
+
+		spin_lock_init(&mag->lock);
+		mag->nr_alloc = 0;
+		mag->nr_free  = 0;
+	}
+
 	return 0;
 }
+EXPORT_SYMBOL_GPL(hgrnic_alloc_init);
 
 /**
  * @note Init hgrnic resources (including PD, UAR, MPT).
  */
 void hgrnic_alloc_cleanup (struct hgrnic_alloc *alloc) {
+	free_percpu(alloc->mags);
 	kfree(alloc->table);
 }
-
-/*
- * Array of pointers with lazy allocation of leaf pages.  Callers of
- * _get, _set and _clear methods must use a lock or otherwise
- * serialize access to the array.
- */
-
-#define HGRNIC_ARRAY_MASK (PAGE_SIZE / sizeof (void *) - 1)
+EXPORT_SYMBOL_GPL(hgrnic_alloc_cleanup);
 
 /**
- * @note Get Resource (QP, CQ) data struct according to resource id.
- * @param array Resource table
- * @param index Resource id (QPN, CQN)
- * @return Data struct pointer of the resources
+ * @note Print how many IDs of the table are taken and which ones, for
+ * debugfs. IDs parked in per-CPU magazines are still set in the bitmap,
+ * so they are listed as taken and counted separately as "cached".
  */
-void *hgrnic_array_get(struct hgrnic_array *array, int index)
+void hgrnic_alloc_show (struct hgrnic_alloc *alloc, const char *name,
+                        struct seq_file *s)
 {
-    int p = (index * sizeof (void *)) >> PAGE_SHIFT;
+    struct hgrnic_alloc_mag *mag;
+    unsigned long flags;
+    u32 cached = 0;
+    int cpu;
+
+    if (alloc->mags) {
+        for_each_possible_cpu(cpu) {
+            mag = per_cpu_ptr(alloc->mags, cpu);
+            cached += READ_ONCE(mag->nr_alloc) + READ_ONCE(mag->nr_free);
+        }
+    }
 
-    if (array->page_list[p].page)
-        return array->page_list[p].page[index & HGRNIC_ARRAY_MASK];
-    else
-        return NULL;
+    spin_lock_irqsave(&alloc->lock, flags);
+    seq_printf(s, "%s: %u/%u set, %u cached\n\t%*pbl\n", name,
+               bitmap_weight(alloc->table, alloc->max), alloc->max, cached,
+               alloc->max, alloc->table);
+    spin_unlock_irqrestore(&alloc->lock, flags);
 }
 
+static int max_direct_buf = 64 * 1024;
+module_param(max_direct_buf, int, 0444);
+MODULE_PARM_DESC(max_direct_buf,
+                 "Largest kernel queue buffer allocated contiguously (0 = never)");
+
 /**
- * @note Set Resource (QP, CQ) data struct according to resource ID.
- * @param array Resource table
- * @param index Resource ID (QPN, CQN)
- * @param value Data struct pointer of the resources
+ * @note Try to back a queue buffer with one contiguous coherent
+ * allocation. HCA translates in 4 KB pages whatever the MPT page
+ * size is, so the MTT still has one entry per page, but they are
+ * filled without further allocations.
+ * @return 0 on success, -ENOMEM if the caller should fall back to
+ * the paged layout.
  */
-int hgrnic_array_set(struct hgrnic_array *array, int index, void *value)
+static int hgrnic_buf_alloc_direct (struct hgrnic_dev *dev, int size,
+                                    union hgrnic_buf *buf, u64 *dma_list,
+                                    int npages)
 {
-    int p = (index * sizeof (void *)) >> PAGE_SHIFT;
-
-    /* Allocate with GFP_ATOMIC because we'll be called with locks held. */
-    if (!array->page_list[p].page)
-        array->page_list[p].page = (void **) get_zeroed_page(GFP_ATOMIC);
+    dma_addr_t t;
+    int i;
 
-    if (!array->page_list[p].page)
+    buf->direct.buf = dma_alloc_coherent(&dev->pdev->dev, size, &t,
+                                         GFP_KERNEL | __GFP_NOWARN |
+                                         __GFP_NORETRY);
+    if (!buf->direct.buf)
         return -ENOMEM;
 
-    array->page_list[p].page[index & HGRNIC_ARRAY_MASK] = value;
-    ++array->page_list[p].used;
-
-    return 0;
-}
-
-void hgrnic_array_clear(struct hgrnic_array *array, int index)
-{
-    int p = (index * sizeof (void *)) >> PAGE_SHIFT;
+    dma_unmap_addr_set(&buf->direct, mapping, t);
+    memset(buf->direct.buf, 0, size);
 
-    if (--array->page_list[p].used == 0) {
-        free_page((unsigned long) array->page_list[p].page);
-        array->page_list[p].page = NULL;
-    } else
-        array->page_list[p].page[index & HGRNIC_ARRAY_MASK] = NULL;
+    for (i = 0; i < npages; ++i)
+        dma_list[i] = t + (u64) i * PAGE_SIZE;
 
-    if (array->page_list[p].used < 0)
-        pr_debug("Array %p index %d page %d with ref count %d < 0\n",
-                 array, index, p, array->page_list[p].used);
+    return 0;
 }
 
-/**
- * @note The array is used to find resource data struct according 
- * to resource number (QPN, CQN)
- * @param array resource lookup array.
- * @param nent maximum number of resources.
- */
-int hgrnic_array_init (struct hgrnic_array *array, int nent)
+static int hgrnic_buf_alloc_paged (struct hgrnic_dev *dev,
+                                   union hgrnic_buf *buf, u64 *dma_list,
+                                   int npages)
 {
-    int npage = (nent * sizeof (void *) + PAGE_SIZE - 1) / PAGE_SIZE;
+    dma_addr_t t;
     int i;
 
-    array->page_list = kmalloc_array(npage, sizeof(*array->page_list),
-                                     GFP_KERNEL);
-    if (!array->page_list)
+    buf->page_list = kmalloc_array(npages,
+                                   sizeof(*buf->page_list),
+                                   GFP_KERNEL);
+    if (!buf->page_list)
         return -ENOMEM;
 
-    for (i = 0; i < npage; ++i) {
-        array->page_list[i].page = NULL;
-        array->page_list[i].used = 0;
-    }
+    /* dma_alloc_coherent takes pages from the device's NUMA node. */
+    for (i = 0; i < npages; ++i) {
+        buf->page_list[i].buf =
+            dma_alloc_coherent(&dev->pdev->dev, PAGE_SIZE,
+                        &t, GFP_KERNEL);
+        if (!buf->page_list[i].buf)
+            goto err_free;
 
-    return 0;
-}
+        dma_list[i] = t;
+        dma_unmap_addr_set(&buf->page_list[i], mapping, t);
 
-void hgrnic_array_cleanup(struct hgrnic_array *array, int nent)
-{
-	int i;
+        clear_page(buf->page_list[i].buf);
+    }
 
-	for (i = 0; i < (nent * sizeof (void *) + PAGE_SIZE - 1) / PAGE_SIZE; ++i)
-		free_page((unsigned long) array->page_list[i].page);
+    return 0;
 
-	kfree(array->page_list);
+err_free:
+    while (i--)
+        dma_free_coherent(&dev->pdev->dev, PAGE_SIZE,
+                          buf->page_list[i].buf,
+                          dma_unmap_addr(&buf->page_list[i], mapping));
+    kfree(buf->page_list);
+    return -ENOMEM;
 }
 
 /**
  * Handling for queue buffers -- we allocate a bunch of memory and
  * register it in a memory region at HCA virtual address 0.  If the
- * requested size is > max_direct, we split the allocation into
- * multiple pages, so we don't require too much contiguous memory.
+ * requested size is > max_direct_buf, or a contiguous allocation
+ * fails, we split the allocation into multiple pages, so we don't
+ * require too much contiguous memory.
  */
 int hgrnic_buf_alloc(struct hgrnic_dev *dev, int size, 
         union hgrnic_buf *buf, int *is_direct, struct hgrnic_pd *pd,
@@ -201,10 +369,7 @@ int hgrnic_buf_alloc(struct hgrnic_dev *dev, int size,
     int err = -ENOMEM;
     int npages, shift;
     u64 *dma_list = NULL;
-    dma_addr_t t;
-    int i;
 
-    *is_direct = 0;
     npages     = (size + PAGE_SIZE - 1) / PAGE_SIZE;
     shift      = PAGE_SHIFT;
 
@@ -213,29 +378,13 @@ int hgrnic_buf_alloc(struct hgrnic_dev *dev, int size,
     if (!dma_list)
         return -ENOMEM;
 
-    buf->page_list = kmalloc_array(npages,
-                                   sizeof(*buf->page_list),
-                                   GFP_KERNEL);
-    if (!buf->page_list)
+    *is_direct = size <= max_direct_buf &&
+                 !hgrnic_buf_alloc_direct(dev, size, buf, dma_list, npages);
+    if (!*is_direct && hgrnic_buf_alloc_paged(dev, buf, dma_list, npages))
         goto err_out;
 
-    for (i = 0; i < npages; ++i)
-        buf->page_list[i].buf = NULL;
-
-    for (i = 0; i < npages; ++i) {
-        buf->page_list[i].buf =
-            dma_alloc_coherent(&dev->pdev->dev, PAGE_SIZE,
-                        &t, GFP_KERNEL);
-        if (!buf->page_list[i].buf)
-            goto err_free;
-
-        dma_list[i] = t;
-        dma_unmap_addr_set(&buf->page_list[i], mapping, t);
-
-        clear_page(buf->page_list[i].buf);
-    }
-
-    hgrnic_dump("%d", npages);
+    hgrnic_dbg(dev, "%s queue buffer, %d pages\n",
+               *is_direct ? "direct" : "paged", npages);
     err = hgrnic_mr_alloc_phys(dev, pd->pd_num,
                               dma_list, shift, npages,
                               0, size,
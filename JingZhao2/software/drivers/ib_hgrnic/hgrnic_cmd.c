@@ -11,12 +11,16 @@
 #include <linux/sched.h>
 #include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/ktime.h>
 #include <asm/io.h>
 #include <rdma/ib_mad.h>
 
 
 #include "hgrnic_cmd.h"
 
+#define CREATE_TRACE_POINTS
+#include "hgrnic_trace.h"
+
 #define CMD_POLL_TOKEN 0xffff
 
 enum {
@@ -64,6 +68,13 @@ enum {
     CMD_HW2SW_CQ         = 0x17,
     // CMD_QUERY_CQ         = 0x18,
     CMD_RESIZE_CQ       = 0x2c,
+    CMD_MODIFY_CQ       = 0x2e,
+
+    /* SRQ commands */
+    CMD_SW2HW_SRQ       = 0x35,
+    CMD_HW2SW_SRQ       = 0x36,
+    CMD_QUERY_SRQ       = 0x37,
+    CMD_ARM_SRQ         = 0x40,
 
     /* QP/EE commands */
     CMD_RST2INIT_QPEE   = 0x19,
@@ -100,6 +111,69 @@ enum {
 };
 
 
+/* Fold the sparse opcode space into dev->cmd.stats[]. */
+#define HGRNIC_CMD_IDX(op) ((op) < 0x40 ? (op) : 0x40 + ((op) & 0xf))
+
+static const char * const hgrnic_cmd_names[HGRNIC_CMD_NUM_STATS] = {
+    [HGRNIC_CMD_IDX(CMD_QUERY_DEV_LIM)]  = "QUERY_DEV_LIM",
+    [HGRNIC_CMD_IDX(CMD_QUERY_ADAPTER)]  = "QUERY_ADAPTER",
+    [HGRNIC_CMD_IDX(CMD_INIT_HCA)]       = "INIT_HCA",
+    [HGRNIC_CMD_IDX(CMD_CLOSE_HCA)]      = "CLOSE_HCA",
+    [HGRNIC_CMD_IDX(CMD_INIT_IB)]        = "INIT_IB",
+    [HGRNIC_CMD_IDX(CMD_CLOSE_IB)]       = "CLOSE_IB",
+    [HGRNIC_CMD_IDX(CMD_SET_IB)]         = "SET_IB",
+    [HGRNIC_CMD_IDX(CMD_MAP_ICM)]        = "MAP_ICM",
+    [HGRNIC_CMD_IDX(CMD_UNMAP_ICM)]      = "UNMAP_ICM",
+    [HGRNIC_CMD_IDX(CMD_SW2HW_MPT)]      = "SW2HW_MPT",
+    [HGRNIC_CMD_IDX(CMD_HW2SW_MPT)]      = "HW2SW_MPT",
+    [HGRNIC_CMD_IDX(CMD_WRITE_MTT)]      = "WRITE_MTT",
+    [HGRNIC_CMD_IDX(CMD_MAP_EQ)]         = "MAP_EQ",
+    [HGRNIC_CMD_IDX(CMD_SW2HW_EQ)]       = "SW2HW_EQ",
+    [HGRNIC_CMD_IDX(CMD_HW2SW_EQ)]       = "HW2SW_EQ",
+    [HGRNIC_CMD_IDX(CMD_SW2HW_CQ)]       = "SW2HW_CQ",
+    [HGRNIC_CMD_IDX(CMD_HW2SW_CQ)]       = "HW2SW_CQ",
+    [HGRNIC_CMD_IDX(CMD_RESIZE_CQ)]      = "RESIZE_CQ",
+    [HGRNIC_CMD_IDX(CMD_MODIFY_CQ)]      = "MODIFY_CQ",
+    [HGRNIC_CMD_IDX(CMD_SW2HW_SRQ)]      = "SW2HW_SRQ",
+    [HGRNIC_CMD_IDX(CMD_HW2SW_SRQ)]      = "HW2SW_SRQ",
+    [HGRNIC_CMD_IDX(CMD_QUERY_SRQ)]      = "QUERY_SRQ",
+    [HGRNIC_CMD_IDX(CMD_ARM_SRQ)]        = "ARM_SRQ",
+    [HGRNIC_CMD_IDX(CMD_RST2INIT_QPEE)]  = "RST2INIT_QP",
+    [HGRNIC_CMD_IDX(CMD_INIT2RTR_QPEE)]  = "INIT2RTR_QP",
+    [HGRNIC_CMD_IDX(CMD_RTR2RTS_QPEE)]   = "RTR2RTS_QP",
+    [HGRNIC_CMD_IDX(CMD_RTS2RTS_QPEE)]   = "RTS2RTS_QP",
+    [HGRNIC_CMD_IDX(CMD_SQERR2RTS_QPEE)] = "SQERR2RTS_QP",
+    [HGRNIC_CMD_IDX(CMD_2ERR_QPEE)]      = "2ERR_QP",
+    [HGRNIC_CMD_IDX(CMD_RTS2SQD_QPEE)]   = "RTS2SQD_QP",
+    [HGRNIC_CMD_IDX(CMD_SQD2SQD_QPEE)]   = "SQD2SQD_QP",
+    [HGRNIC_CMD_IDX(CMD_SQD2RTS_QPEE)]   = "SQD2RTS_QP",
+    [HGRNIC_CMD_IDX(CMD_ERR2RST_QPEE)]   = "ERR2RST_QP",
+    [HGRNIC_CMD_IDX(CMD_QUERY_QPEE)]     = "QUERY_QP",
+    [HGRNIC_CMD_IDX(CMD_INIT2INIT_QPEE)] = "INIT2INIT_QP",
+    [HGRNIC_CMD_IDX(CMD_SUSPEND_QPEE)]   = "SUSPEND_QP",
+    [HGRNIC_CMD_IDX(CMD_UNSUSPEND_QPEE)] = "UNSUSPEND_QP",
+    [HGRNIC_CMD_IDX(CMD_CONF_SPECIAL_QP)] = "CONF_SPECIAL_QP",
+    [HGRNIC_CMD_IDX(CMD_MAD_IFC)]        = "MAD_IFC",
+    [HGRNIC_CMD_IDX(CMD_READ_MGM)]       = "READ_MGM",
+    [HGRNIC_CMD_IDX(CMD_WRITE_MGM)]      = "WRITE_MGM",
+    [HGRNIC_CMD_IDX(CMD_MGID_HASH)]      = "MGID_HASH",
+    [HGRNIC_CMD_IDX(CMD_DIAG_RPRT)]      = "DIAG_RPRT",
+    [HGRNIC_CMD_IDX(CMD_NOP)]            = "NOP",
+    [HGRNIC_CMD_IDX(CMD_QUERY_DEBUG_MSG)] = "QUERY_DEBUG_MSG",
+    [HGRNIC_CMD_IDX(CMD_SET_DEBUG_MSG)]  = "SET_DEBUG_MSG",
+};
+
+/**
+ * @note Name of the command counted in dev->cmd.stats[idx],
+ * NULL if no opcode maps to that slot.
+ */
+const char *hgrnic_cmd_name (int idx)
+{
+    if (idx < 0 || idx >= HGRNIC_CMD_NUM_STATS)
+        return NULL;
+    return hgrnic_cmd_names[idx];
+}
+
 enum {
     CMD_TIME_CLASS_A = 60 * HZ,
     CMD_TIME_CLASS_B = 60 * HZ,
@@ -161,6 +235,9 @@ static int hgrnic_cmd_post (struct hgrnic_dev *dev, u64 in_param, u64 out_param,
 
     err = hgrnic_cmd_post_hcr(dev, in_param, out_param, in_modifier,
                 op_modifier, op, token);
+    if (!err)
+        trace_hgrnic_cmd_post(dev, op, op_modifier, in_modifier,
+                              token, in_param);
 
     mutex_unlock(&dev->cmd.hcr_mutex);
     return err;
@@ -204,9 +281,13 @@ static int hgrnic_cmd_poll (struct hgrnic_dev *dev, u64 in_param,
 {
     int err = 0;
     unsigned long end;
-    u8 status;
+    u8 status = 0;
+    struct hgrnic_cmd_stat *stat;
+    ktime_t start;
+    u64 ns;
 
     down(&dev->cmd.poll_sem);
+    start = ktime_get();
 
     err = hgrnic_cmd_post(dev, in_param, out_param ? *out_param : 0,
                 in_modifier, op_modifier, op, CMD_POLL_TOKEN);
@@ -244,6 +325,19 @@ static int hgrnic_cmd_poll (struct hgrnic_dev *dev, u64 in_param,
     }
 
 out:
+    ns   = ktime_to_ns(ktime_sub(ktime_get(), start));
+    stat = &dev->cmd.stats[HGRNIC_CMD_IDX(op)];
+    ++stat->count;
+    stat->total_ns += ns;
+    if (ns > stat->max_ns)
+        stat->max_ns = ns;
+    if (err)
+        ++stat->errors;
+    ++stat->hist[min_t(int, fls64(ns >> 10), HGRNIC_CMD_HIST_BUCKETS - 1)];
+
+    trace_hgrnic_cmd_done(dev, op, op_modifier, in_modifier,
+                          CMD_POLL_TOKEN, status, err, ns);
+
     up(&dev->cmd.poll_sem);
     return err;
 }
@@ -335,6 +429,7 @@ int hgrnic_QUERY_DEV_LIM (struct hgrnic_dev *dev, struct hgrnic_dev_lim *dev_lim
     u8 field;
     u16 size;
     u64 entry;
+    u32 flags;
     int err;
 
 #define QUERY_DEV_LIM_OUT_SIZE              0x40
@@ -344,6 +439,7 @@ int hgrnic_QUERY_DEV_LIM (struct hgrnic_dev *dev, struct hgrnic_dev_lim *dev_lim
 #define QUERY_DEV_LIM_RSVD_CQ_OFFSET        0x01
 #define QUERY_DEV_LIM_RSVD_EQ_OFFSET        0x02
 #define QUERY_DEV_LIM_RSVD_MTT_OFFSET       0x03
+#define QUERY_DEV_LIM_RSVD_SRQ_OFFSET       0x04
 #define QUERY_DEV_LIM_RSVD_PD_OFFSET        0x05
 #define QUERY_DEV_LIM_RSVD_LKEY_OFFSET      0x07
 
@@ -357,10 +453,12 @@ int hgrnic_QUERY_DEV_LIM (struct hgrnic_dev *dev, struct hgrnic_dev_lim *dev_lim
 #define QUERY_DEV_LIM_MAX_EQ_OFFSET         0x0e
 #define QUERY_DEV_LIM_MAX_MPT_OFFSET        0x0f
 #define QUERY_DEV_LIM_MAX_PD_OFFSET         0x10
+#define QUERY_DEV_LIM_MAX_SRQ_OFFSET        0x11
 #define QUERY_DEV_LIM_MAX_GID_OFFSET        0x12
 #define QUERY_DEV_LIM_MAX_PKEY_OFFSET       0x13
 
 #define QUERY_DEV_LIM_MAX_MTT_SEG_OFFSET    0x15
+#define QUERY_DEV_LIM_SRQC_ENTRY_SZ_OFFSET  0x16
 
 // size of context
 #define QUERY_DEV_LIM_QPC_ENTRY_SZ_OFFSET   0x18
@@ -383,13 +481,19 @@ int hgrnic_QUERY_DEV_LIM (struct hgrnic_dev *dev, struct hgrnic_dev_lim *dev_lim
 // ICM space size
 #define QUERY_DEV_LIM_MAX_ICM_SZ_OFFSET     0x30
 
+// Capability flags (DEV_LIM_FLAG_*)
+#define QUERY_DEV_LIM_FLAGS_OFFSET          0x38
+
+// Rate of the HCA clock in kHz, 0 from older bitstreams
+#define QUERY_DEV_LIM_HCA_CLOCK_OFFSET      0x3c
+
 
     mailbox = hgrnic_alloc_mailbox(dev, GFP_KERNEL);
     if (IS_ERR(mailbox))
         return PTR_ERR(mailbox);
     outbox = mailbox->buf;
 
-    printk(KERN_INFO PFX "Enter hgrnic_QUERY_DEV_LIM. %lx\n", (long)mailbox->dma);
+    hgrnic_dbg(dev, "Enter hgrnic_QUERY_DEV_LIM. %lx\n", (long)mailbox->dma);
 
     err = hgrnic_cmd_box(dev, 0, mailbox->dma, 0, 0, CMD_QUERY_DEV_LIM,
                 CMD_TIME_CLASS_A);
@@ -397,8 +501,8 @@ int hgrnic_QUERY_DEV_LIM (struct hgrnic_dev *dev, struct hgrnic_dev_lim *dev_lim
         goto out;
     }
     
-    printk(KERN_INFO PFX "Get hgrnic_QUERY_DEV_LIM.\n");
-    printk(KERN_INFO PFX "dev lim outbox: \n0x%x 0x%x 0x%x 0x%x \n"
+    hgrnic_dbg(dev, "Get hgrnic_QUERY_DEV_LIM.\n");
+    hgrnic_dbg(dev, "dev lim outbox: \n0x%x 0x%x 0x%x 0x%x \n"
             "0x%x 0x%x 0x%x 0x%x\n"
             "0x%x 0x%x 0x%x 0x%x\n"
             "0x%x 0x%x 0x%x 0x%x\n", 
@@ -410,123 +514,142 @@ int hgrnic_QUERY_DEV_LIM (struct hgrnic_dev *dev, struct hgrnic_dev_lim *dev_lim
 
     HGRNIC_GET(field, outbox, QUERY_DEV_LIM_RSVD_QP_OFFSET);
     dev_lim->reserved_qps = 1 << (field & 0xf);
-    printk(KERN_INFO PFX "resv_qp: %d", dev_lim->reserved_qps);
+    hgrnic_dbg(dev, "resv_qp: %d\n", dev_lim->reserved_qps);
     
     HGRNIC_GET(field, outbox, QUERY_DEV_LIM_RSVD_CQ_OFFSET);
     dev_lim->reserved_cqs = 1 << (field & 0xf);
-    printk(KERN_INFO PFX "resv_cq: %d", dev_lim->reserved_cqs);
+    hgrnic_dbg(dev, "resv_cq: %d\n", dev_lim->reserved_cqs);
     
     HGRNIC_GET(field, outbox, QUERY_DEV_LIM_RSVD_EQ_OFFSET);
     dev_lim->reserved_eqs = 1 << (field & 0xf);
-    printk(KERN_INFO PFX "resv_eq: %d", dev_lim->reserved_eqs);
+    hgrnic_dbg(dev, "resv_eq: %d\n", dev_lim->reserved_eqs);
     
     HGRNIC_GET(field, outbox, QUERY_DEV_LIM_RSVD_MTT_OFFSET);
     dev_lim->reserved_mtts = 1 << (field & 0xf);
-    printk(KERN_INFO PFX "resv_mtt: %d", dev_lim->reserved_mtts);
+    hgrnic_dbg(dev, "resv_mtt: %d\n", dev_lim->reserved_mtts);
+
+    HGRNIC_GET(field, outbox, QUERY_DEV_LIM_RSVD_SRQ_OFFSET);
+    dev_lim->reserved_srqs = 1 << (field & 0xf);
+    hgrnic_dbg(dev, "resv_srq: %d\n", dev_lim->reserved_srqs);
 
     HGRNIC_GET(field, outbox, QUERY_DEV_LIM_RSVD_PD_OFFSET);
     dev_lim->reserved_pds = 1 << (field & 0xf);
-    printk(KERN_INFO PFX "resv_pd: %d", dev_lim->reserved_pds);
+    hgrnic_dbg(dev, "resv_pd: %d\n", dev_lim->reserved_pds);
     
     HGRNIC_GET(field, outbox, QUERY_DEV_LIM_RSVD_LKEY_OFFSET);
     dev_lim->reserved_lkey = 1 << (field & 0xf);
-    printk(KERN_INFO PFX "resv_lkey: %d", dev_lim->reserved_lkey);
+    hgrnic_dbg(dev, "resv_lkey: %d\n", dev_lim->reserved_lkey);
     
     HGRNIC_GET(size, outbox, QUERY_DEV_LIM_MAX_QP_SZ_OFFSET);
     dev_lim->max_qp_sz = 1 << size;
-    printk(KERN_INFO PFX "max_qp_sz: %d", dev_lim->max_qp_sz);
+    hgrnic_dbg(dev, "max_qp_sz: %d\n", dev_lim->max_qp_sz);
     
     HGRNIC_GET(size, outbox, QUERY_DEV_LIM_MAX_CQ_SZ_OFFSET);
     dev_lim->max_cq_sz = 1 << size;
-    printk(KERN_INFO PFX "max_cq_sz: %d", dev_lim->max_cq_sz);
+    hgrnic_dbg(dev, "max_cq_sz: %d\n", dev_lim->max_cq_sz);
 
     HGRNIC_GET(field, outbox, QUERY_DEV_LIM_MAX_QP_OFFSET);
     dev_lim->max_qps = 1 << (field & 0x1f);
-    printk(KERN_INFO PFX "max_qps: %d", dev_lim->max_qps);
+    hgrnic_dbg(dev, "max_qps: %d\n", dev_lim->max_qps);
     
     HGRNIC_GET(field, outbox, QUERY_DEV_LIM_MAX_CQ_OFFSET);
     dev_lim->max_cqs = 1 << (field & 0x1f);
-    printk(KERN_INFO PFX "max_cqs: %d", dev_lim->max_cqs);
+    hgrnic_dbg(dev, "max_cqs: %d\n", dev_lim->max_cqs);
     
     HGRNIC_GET(field, outbox, QUERY_DEV_LIM_MAX_EQ_OFFSET);
     dev_lim->max_eqs = 1 << (field & 0x7);
-    printk(KERN_INFO PFX "max_eqs: %d", dev_lim->max_eqs);
+    hgrnic_dbg(dev, "max_eqs: %d\n", dev_lim->max_eqs);
     
     HGRNIC_GET(field, outbox, QUERY_DEV_LIM_MAX_MPT_OFFSET);
     dev_lim->max_mpts = 1 << (field & 0x3f);
-    printk(KERN_INFO PFX "max_mpts: %d", dev_lim->max_mpts);
+    hgrnic_dbg(dev, "max_mpts: %d\n", dev_lim->max_mpts);
     
     HGRNIC_GET(field, outbox, QUERY_DEV_LIM_MAX_PD_OFFSET);
     dev_lim->max_pds = 1 << (field & 0x3f);
-    printk(KERN_INFO PFX "max_pds: %d", dev_lim->max_pds);
+    hgrnic_dbg(dev, "max_pds: %d\n", dev_lim->max_pds);
+
+    HGRNIC_GET(field, outbox, QUERY_DEV_LIM_MAX_SRQ_OFFSET);
+    dev_lim->max_srqs = 1 << (field & 0x1f);
+    hgrnic_dbg(dev, "max_srqs: %d\n", dev_lim->max_srqs);
     
     HGRNIC_GET(field, outbox, QUERY_DEV_LIM_MAX_GID_OFFSET);
     dev_lim->max_gids = 1 << (field & 0xf);
-    printk(KERN_INFO PFX "max_gids: %d", dev_lim->max_gids);
+    hgrnic_dbg(dev, "max_gids: %d\n", dev_lim->max_gids);
     
     HGRNIC_GET(field, outbox, QUERY_DEV_LIM_MAX_PKEY_OFFSET);
     dev_lim->max_pkeys = 1 << (field & 0xf);
-    printk(KERN_INFO PFX "max_pkeys: %d", field & 0xf);
+    hgrnic_dbg(dev, "max_pkeys: %d\n", field & 0xf);
 
     HGRNIC_GET(field, outbox, QUERY_DEV_LIM_MAX_MTT_SEG_OFFSET);
     dev_lim->max_mtt_seg = field;
-    printk(KERN_INFO PFX "max_mtt_seg: %d", dev_lim->max_mtt_seg);
+    hgrnic_dbg(dev, "max_mtt_seg: %d\n", dev_lim->max_mtt_seg);
+
+    HGRNIC_GET(size, outbox, QUERY_DEV_LIM_SRQC_ENTRY_SZ_OFFSET);
+    dev_lim->srqc_entry_sz = size;
+    hgrnic_dbg(dev, "srqc_entry_sz: %d\n", dev_lim->srqc_entry_sz);
 
     HGRNIC_GET(size, outbox, QUERY_DEV_LIM_QPC_ENTRY_SZ_OFFSET);
     dev_lim->qpc_entry_sz = size;
-    printk(KERN_INFO PFX "qpc_entry_sz: %d", dev_lim->qpc_entry_sz);
+    hgrnic_dbg(dev, "qpc_entry_sz: %d\n", dev_lim->qpc_entry_sz);
     
     HGRNIC_GET(size, outbox, QUERY_DEV_LIM_CQC_ENTRY_SZ_OFFSET);
     dev_lim->cqc_entry_sz = size;
-    printk(KERN_INFO PFX "cqc_entry_sz: %d", dev_lim->cqc_entry_sz);
+    hgrnic_dbg(dev, "cqc_entry_sz: %d\n", dev_lim->cqc_entry_sz);
     
     HGRNIC_GET(size, outbox, QUERY_DEV_LIM_EQC_ENTRY_SZ_OFFSET);
     dev_lim->eqc_entry_sz = size;
-    printk(KERN_INFO PFX "eqc_entry_sz: %d", dev_lim->eqc_entry_sz);
+    hgrnic_dbg(dev, "eqc_entry_sz: %d\n", dev_lim->eqc_entry_sz);
     
     HGRNIC_GET(size, outbox, QUERY_DEV_LIM_MPT_ENTRY_SZ_OFFSET);
     dev_lim->mpt_entry_sz = size;
-    printk(KERN_INFO PFX "mpt_entry_sz: %d", dev_lim->mpt_entry_sz);
+    hgrnic_dbg(dev, "mpt_entry_sz: %d\n", dev_lim->mpt_entry_sz);
 
     HGRNIC_GET(field, outbox, QUERY_DEV_LIM_ACK_DELAY_OFFSET);
     dev_lim->local_ca_ack_delay = field & 0xf;
-    printk(KERN_INFO PFX "local_ca_ack_delay: %d", dev_lim->local_ca_ack_delay);
+    hgrnic_dbg(dev, "local_ca_ack_delay: %d\n", dev_lim->local_ca_ack_delay);
     
     HGRNIC_GET(field, outbox, QUERY_DEV_LIM_MTU_WIDTH_OFFSET);
     dev_lim->max_mtu        = field >> 4;
     dev_lim->max_port_width = field & 0xf;
-    printk(KERN_INFO PFX "max_mtu: %d", dev_lim->max_mtu);
-    printk(KERN_INFO PFX "max_port_width: %d", dev_lim->max_port_width);
+    hgrnic_dbg(dev, "max_mtu: %d\n", dev_lim->max_mtu);
+    hgrnic_dbg(dev, "max_port_width: %d\n", dev_lim->max_port_width);
     
     HGRNIC_GET(field, outbox, QUERY_DEV_LIM_VL_PORT_OFFSET);
     dev_lim->max_vl    = field >> 4;
     dev_lim->num_ports = field & 0xf;
-    printk(KERN_INFO PFX "max_vl: %d", dev_lim->max_vl);
-    printk(KERN_INFO PFX "num_ports: %d", dev_lim->num_ports);
+    hgrnic_dbg(dev, "max_vl: %d\n", dev_lim->max_vl);
+    hgrnic_dbg(dev, "num_ports: %d\n", dev_lim->num_ports);
 
     HGRNIC_GET(field, outbox, QUERY_DEV_LIM_PAGE_SZ_OFFSET);
     dev_lim->min_page_sz = 1 << field;
-    printk(KERN_INFO PFX "min_page_sz: %d", dev_lim->min_page_sz);
+    hgrnic_dbg(dev, "min_page_sz: %d\n", dev_lim->min_page_sz);
 
     HGRNIC_GET(field, outbox, QUERY_DEV_LIM_MAX_SG_OFFSET);
     dev_lim->max_sg = field;
-    printk(KERN_INFO PFX "max_sg: %d", dev_lim->max_sg);
+    hgrnic_dbg(dev, "max_sg: %d\n", dev_lim->max_sg);
     
     HGRNIC_GET(size, outbox, QUERY_DEV_LIM_MAX_DESC_SZ_OFFSET);
     dev_lim->max_desc_sz = size;
-    printk(KERN_INFO PFX "max_desc_sz: %d", dev_lim->max_desc_sz);
+    hgrnic_dbg(dev, "max_desc_sz: %d\n", dev_lim->max_desc_sz);
     
     HGRNIC_GET(field, outbox, QUERY_DEV_LIM_MAX_SG_RQ_OFFSET);
     dev_lim->max_sg = min_t(int, field, dev_lim->max_sg);
-    printk(KERN_INFO PFX "max_sg_rq: %d", field);
+    hgrnic_dbg(dev, "max_sg_rq: %d\n", field);
     
     HGRNIC_GET(size, outbox, QUERY_DEV_LIM_MAX_DESC_SZ_RQ_OFFSET);
     dev_lim->max_desc_sz = min_t(int, size, dev_lim->max_desc_sz);
-    printk(KERN_INFO PFX "max_desc_sz_rq: %d", size);
+    hgrnic_dbg(dev, "max_desc_sz_rq: %d\n", size);
 
     HGRNIC_GET(entry, outbox, QUERY_DEV_LIM_MAX_ICM_SZ_OFFSET);
     dev_lim->max_icm_sz = entry;
-    printk(KERN_INFO PFX "max_icm_sz: 0x%llx", dev_lim->max_icm_sz);
+    hgrnic_dbg(dev, "max_icm_sz: 0x%llx\n", dev_lim->max_icm_sz);
+
+    HGRNIC_GET(flags, outbox, QUERY_DEV_LIM_FLAGS_OFFSET);
+    dev_lim->flags = flags;
+    hgrnic_dbg(dev, "flags: 0x%08x\n", dev_lim->flags);
+
+    HGRNIC_GET(dev_lim->hca_clock_khz, outbox, QUERY_DEV_LIM_HCA_CLOCK_OFFSET);
+    hgrnic_dbg(dev, "hca_clock_khz: %u\n", dev_lim->hca_clock_khz);
 
 out:
     hgrnic_free_mailbox(dev, mailbox);
@@ -599,6 +722,8 @@ int hgrnic_INIT_HCA (struct hgrnic_dev *mdev, struct hgrnic_init_hca_param *para
 #define  INIT_HCA_LOG_CQ_OFFSET          (INIT_HCA_QPC_OFFSET + 0x0f)
 #define  INIT_HCA_EQC_BASE_OFFSET        (INIT_HCA_QPC_OFFSET + 0x10)
 #define  INIT_HCA_LOG_EQ_OFFSET          (INIT_HCA_QPC_OFFSET + 0x17)
+#define  INIT_HCA_SRQC_BASE_OFFSET       (INIT_HCA_QPC_OFFSET + 0x18)
+#define  INIT_HCA_LOG_SRQ_OFFSET         (INIT_HCA_QPC_OFFSET + 0x1f)
 
 #define  INIT_HCA_TPT_OFFSET              0x030
 #define  INIT_HCA_MPT_BASE_OFFSET        (INIT_HCA_TPT_OFFSET + 0x00)
@@ -612,25 +737,27 @@ int hgrnic_INIT_HCA (struct hgrnic_dev *mdev, struct hgrnic_init_hca_param *para
 
     memset(inbox, 0, INIT_HCA_IN_SIZE);
 
-    /* QPC/CQC/EQC attributes */
+    /* QPC/CQC/EQC/SRQC attributes */
     HGRNIC_PUT(inbox, param->qpc_base,     INIT_HCA_QPC_BASE_OFFSET);
     HGRNIC_PUT(inbox, param->log_num_qps,  INIT_HCA_LOG_QP_OFFSET);
     HGRNIC_PUT(inbox, param->cqc_base,     INIT_HCA_CQC_BASE_OFFSET);
     HGRNIC_PUT(inbox, param->log_num_cqs,  INIT_HCA_LOG_CQ_OFFSET);
     HGRNIC_PUT(inbox, param->eqc_base,     INIT_HCA_EQC_BASE_OFFSET);
     HGRNIC_PUT(inbox, param->log_num_eqs,  INIT_HCA_LOG_EQ_OFFSET);
+    HGRNIC_PUT(inbox, param->srqc_base,    INIT_HCA_SRQC_BASE_OFFSET);
+    HGRNIC_PUT(inbox, param->log_num_srqs, INIT_HCA_LOG_SRQ_OFFSET);
 
     /* TPT attributes */
     HGRNIC_PUT(inbox, param->mpt_base,   INIT_HCA_MPT_BASE_OFFSET);
     HGRNIC_PUT(inbox, param->log_mpt_sz, INIT_HCA_LOG_MPT_SZ_OFFSET);
     HGRNIC_PUT(inbox, param->mtt_base,   INIT_HCA_MTT_BASE_OFFSET);
 
-    printk(KERN_INFO PFX "init hca outbox: 0x%x 0x%x 0x%x 0x%x "
+    hgrnic_dbg(mdev, "init hca inbox: 0x%x 0x%x 0x%x 0x%x "
             "0x%x 0x%x 0x%x 0x%x.\n", 
             *inbox, *(inbox+1), *(inbox+2), *(inbox+3),
             *(inbox+4), *(inbox+5), *(inbox+6), *(inbox+7));
     
-    printk(KERN_INFO PFX "init hca outbox: 0x%x 0x%x 0x%x 0x%x "
+    hgrnic_dbg(mdev, "init hca inbox: 0x%x 0x%x 0x%x 0x%x "
             "0x%x 0x%x 0x%x 0x%x.\n", 
             *(inbox+8), *(inbox+9), *(inbox+10), *(inbox+11),
             *(inbox+12), *(inbox+13), *(inbox+14), *(inbox+15));
@@ -828,7 +955,6 @@ int hgrnic_MAP_ICM (struct hgrnic_dev *dev, struct hgrnic_icm *icm,
                 --nent;
 
             if (nent >= HGRNIC_MAILBOX_SIZE / 16) {
-                printk(KERN_INFO PFX "MAP_ICM filled max the mailbox!\n");
                 err = hgrnic_cmd(dev, mailbox->dma, (nent - 1), type_sel, CMD_MAP_ICM,
                         CMD_TIME_CLASS_B);
                 if (err)
@@ -840,15 +966,11 @@ int hgrnic_MAP_ICM (struct hgrnic_dev *dev, struct hgrnic_icm *icm,
 
     nent = (nent % 2 == 0) ? nent + 1 : nent - 1;
     if (nent) {
-        for (i = 0; i < nent; ++i) {
-            printk(KERN_INFO PFX "MAP_ICM: 0x%llx 0x%llx 0x%llx 0x%llx\n",
-                    *(pages + i), *(pages + i + 1), *(pages + i + 2), *(pages + i + 3));
-        }
         err = hgrnic_cmd(dev, mailbox->dma, nent, type_sel, CMD_MAP_ICM,
                 CMD_TIME_CLASS_B);
     }
     
-    printk(KERN_INFO PFX "Mapped %d chunks/%d KB at %llx for ICM.\n",
+    hgrnic_dbg(dev, "Mapped %d chunks/%d KB at %llx for ICM.\n",
             tc, ts, (unsigned long long) virt - (ts << 10));
 
 out:
@@ -881,15 +1003,12 @@ int hgrnic_MAP_ICM_page (struct hgrnic_dev *dev, u64 dma_addr,
     inbox[2] = cpu_to_be64(virt);
     inbox[3] = cpu_to_be64(dma_addr | 0x01);
 
-    printk(KERN_INFO PFX "MAP_ICM page inbox: 0x%llx 0x%llx 0x%llx 0x%llx.\n", 
-            *inbox, *(inbox+1), *(inbox+2), *(inbox+3));
-
     err = hgrnic_cmd(dev, mailbox->dma, 1, type_sel, CMD_MAP_ICM,
             CMD_TIME_CLASS_B);
 
     hgrnic_free_mailbox(dev, mailbox);
 
-    printk(KERN_INFO PFX "Mapped page at %llx to %llx for ICM.\n",
+    hgrnic_dbg(dev, "Mapped page at %llx to %llx for ICM.\n",
             (unsigned long long) dma_addr, (unsigned long long) virt);
 
     return err;
@@ -1043,6 +1162,88 @@ int hgrnic_RESIZE_CQ (struct hgrnic_dev *dev, int cq_num,
     return err;
 }
 
+/**
+ * @description: 
+ *  Command function.
+ *  Modify CQ event moderation (in CQ context) in HCA hardware.
+ *  An event is generated for an armed CQ once max_count CQEs
+ *  are written or period usecs have elapsed since the first one.
+ */
+int hgrnic_MODIFY_CQ (struct hgrnic_dev *dev, int cq_num,
+                     u16 max_count, u16 period)
+{
+    struct hgrnic_mailbox *mailbox;
+    __be32 *inbox;
+    int err;
+
+#define MODIFY_CQ_IN_SIZE           0x10
+#define MODIFY_CQ_MAX_COUNT_OFFSET  0x00
+#define MODIFY_CQ_PERIOD_OFFSET     0x02
+
+    mailbox = hgrnic_alloc_mailbox(dev, GFP_KERNEL);
+    if (IS_ERR(mailbox))
+        return PTR_ERR(mailbox);
+    inbox = mailbox->buf;
+
+    memset(inbox, 0, MODIFY_CQ_IN_SIZE);
+    HGRNIC_PUT(inbox, max_count, MODIFY_CQ_MAX_COUNT_OFFSET);
+    HGRNIC_PUT(inbox, period,    MODIFY_CQ_PERIOD_OFFSET);
+
+    err = hgrnic_cmd(dev, mailbox->dma, cq_num, 0, CMD_MODIFY_CQ,
+                    CMD_TIME_CLASS_A);
+
+    hgrnic_free_mailbox(dev, mailbox);
+    return err;
+}
+
+/**
+ * @description: 
+ *  Command function.
+ *  Send SRQ context to HCA hardware.
+ */
+int hgrnic_SW2HW_SRQ (struct hgrnic_dev *dev, 
+        struct hgrnic_mailbox *mailbox, int srq_num)
+{
+    return hgrnic_cmd(dev, mailbox->dma, srq_num, 0, CMD_SW2HW_SRQ,
+                     CMD_TIME_CLASS_A);
+}
+
+/**
+ * @description: 
+ *  Command function.
+ *  Cancel SRQ context in HCA hardware.
+ */
+int hgrnic_HW2SW_SRQ (struct hgrnic_dev *dev, int srq_num)
+{
+    return hgrnic_cmd(dev, 0, srq_num, 0, CMD_HW2SW_SRQ,
+                     CMD_TIME_CLASS_A);
+}
+
+/**
+ * @description: 
+ *  Command function.
+ *  Read SRQ context back from HCA hardware.
+ */
+int hgrnic_QUERY_SRQ (struct hgrnic_dev *dev, u32 num,
+                      struct hgrnic_mailbox *mailbox)
+{
+    return hgrnic_cmd_box(dev, 0, mailbox->dma, num, 0,
+                         CMD_QUERY_SRQ, CMD_TIME_CLASS_A);
+}
+
+/**
+ * @description: 
+ *  Command function.
+ *  Arm the SRQ limit event: the HCA raises 
+ *  IB_EVENT_SRQ_LIMIT_REACHED once fewer than limit 
+ *  WQEs are left posted, and disarms.
+ */
+int hgrnic_ARM_SRQ (struct hgrnic_dev *dev, int srq_num, int limit)
+{
+    return hgrnic_cmd(dev, limit, srq_num, 0, CMD_ARM_SRQ,
+                     CMD_TIME_CLASS_B);
+}
+
 /**
  * @description: 
  *  Command function.
@@ -75,6 +75,9 @@ enum {
     DEV_LIM_FLAG_RAW_MULTI          = 1 << 19,
     DEV_LIM_FLAG_UD_AV_PORT_ENFORCE = 1 << 20,
     DEV_LIM_FLAG_UD_MULTI           = 1 << 21,
+    DEV_LIM_FLAG_MASKED_ATOMIC      = 1 << 22,
+    DEV_LIM_FLAG_CQ_MODER           = 1 << 23, /* MODIFY_CQ event moderation */
+    DEV_LIM_FLAG_FAST_REG           = 1 << 24, /* REG_MR/LOCAL_INV WQEs, MPT lookup by key[31:8] */
 };
 
 struct hgrnic_mailbox {
@@ -87,6 +90,7 @@ struct hgrnic_dev_lim {
     int reserved_cqs;
     int reserved_eqs;
     int reserved_mtts;
+    int reserved_srqs;
     int reserved_pds;
     u32 reserved_lkey;
     
@@ -98,6 +102,7 @@ struct hgrnic_dev_lim {
     int max_eqs;
     int max_mpts;
     int max_pds;
+    int max_srqs;
     int max_gids;
     int max_pkeys;
 
@@ -108,6 +113,7 @@ struct hgrnic_dev_lim {
     int cqc_entry_sz;
     int eqc_entry_sz;
     int mpt_entry_sz;
+    int srqc_entry_sz;
 
     int local_ca_ack_delay;
     int max_mtu;
@@ -121,6 +127,9 @@ struct hgrnic_dev_lim {
     int max_desc_sz;
 
     u64 max_icm_sz; // in byte
+
+    u32 flags;      // DEV_LIM_FLAG_*
+    u32 hca_clock_khz; // 0 if not reported
 };
 
 
@@ -129,10 +138,12 @@ struct hgrnic_init_hca_param {
     u8  log_num_cqs;
     u8  log_num_eqs;
     u8  log_mpt_sz;
+    u8  log_num_srqs;
     
     u64 qpc_base;
     u64 cqc_base;
     u64 eqc_base;
+    u64 srqc_base;
     u64 mpt_base;
     u64 mtt_base;
 };
@@ -162,6 +173,7 @@ struct hgrnic_icm;
 
 int hgrnic_cmd_init(struct hgrnic_dev *dev);
 void hgrnic_cmd_cleanup(struct hgrnic_dev *dev);
+const char *hgrnic_cmd_name(int idx);
 
 struct hgrnic_mailbox *hgrnic_alloc_mailbox(struct hgrnic_dev *dev,
                                             gfp_t gfp_mask);
@@ -203,6 +215,14 @@ int hgrnic_SW2HW_CQ (struct hgrnic_dev *dev, struct hgrnic_mailbox *mailbox,
 		   int cq_num);
 int hgrnic_HW2SW_CQ (struct hgrnic_dev *dev, int cq_num);
 int hgrnic_RESIZE_CQ (struct hgrnic_dev *dev, int cq_num, u32 lkey, u8 log_size);
+int hgrnic_MODIFY_CQ (struct hgrnic_dev *dev, int cq_num,
+                      u16 max_count, u16 period);
+int hgrnic_SW2HW_SRQ (struct hgrnic_dev *dev, struct hgrnic_mailbox *mailbox,
+		    int srq_num);
+int hgrnic_HW2SW_SRQ (struct hgrnic_dev *dev, int srq_num);
+int hgrnic_QUERY_SRQ (struct hgrnic_dev *dev, u32 num,
+                      struct hgrnic_mailbox *mailbox);
+int hgrnic_ARM_SRQ (struct hgrnic_dev *dev, int srq_num, int limit);
 int hgrnic_MODIFY_QP (struct hgrnic_dev *dev, enum ib_qp_state cur,
                       enum ib_qp_state next, u32 num, struct hgrnic_mailbox *mailbox);
 int hgrnic_QUERY_QP (struct hgrnic_dev *dev, u32 num, 
@@ -8,6 +8,7 @@
 #include <linux/gfp.h>
 #include <linux/hardirq.h>
 #include <linux/sched.h>
+#include <linux/rcupdate.h>
 
 #include <asm/io.h>
 
@@ -16,6 +17,7 @@
 #include "hgrnic_dev.h"
 #include "hgrnic_cmd.h"
 #include "hgrnic_icm.h"
+#include "hgrnic_iface.h"
 
 enum {
     HGRNIC_ATOMIC_BYTE_LEN = 8
@@ -70,7 +72,7 @@ enum {
 
 struct hgrnic_cqe {
     __le32 my_qpn;
-    __le32 my_ee;
+    __le32 ts_lo; /* completion timestamp, hca_clock bits 31:0 */
     __le32 rqpn;
     u8     sl_ipok;
     u8     g_mlpath;
@@ -80,7 +82,7 @@ struct hgrnic_cqe {
     __le32 wqe; /* wqe offset in WQ */
     u8     opcode;
     u8     is_send;
-    u8     reserved;
+    u8     ts_hi; /* hca_clock bits 39:32 */
     u8     owner;
 };
 
@@ -151,12 +153,24 @@ static inline void dump_cqe(struct hgrnic_dev *dev, void *cqe_ptr)
             le32_to_cpu(cqe[6]), le32_to_cpu(cqe[7]));
 }
 
+static inline int is_recv_cqe(struct hgrnic_cqe *cqe)
+{
+    if (cqe->opcode == HGRNIC_OPCODE_RECV_ERR)
+        return 1;
+    if (cqe->opcode == HGRNIC_OPCODE_SEND_ERR)
+        return 0;
+    return !cqe->is_send;
+}
+
 /**
  * @param qpn QP need to be cleaned
  * @param cq  CQ the qp attached to
- * Clean qpn from cq.
+ * @param srq SRQ the qp receives from, or NULL
+ * Clean qpn from cq. Receive WQEs the removed CQEs completed
+ * are returned to @srq.
  */
-void hgrnic_cq_clean(struct hgrnic_dev *dev, struct hgrnic_cq *cq, u32 qpn)
+void hgrnic_cq_clean(struct hgrnic_dev *dev, struct hgrnic_cq *cq, u32 qpn,
+                     struct hgrnic_srq *srq)
 {
     struct hgrnic_cqe *cqe;
     u32 prod_index;
@@ -186,9 +200,12 @@ void hgrnic_cq_clean(struct hgrnic_dev *dev, struct hgrnic_cq *cq, u32 qpn)
      */
     while ((int) --prod_index - (int) cq->cons_index >= 0) {
         cqe = get_cqe(cq, prod_index & cq->ibcq.cqe);
-        if (cqe->my_qpn == cpu_to_le32(qpn))
+        if (cqe->my_qpn == cpu_to_le32(qpn)) {
+            if (srq && is_recv_cqe(cqe))
+                hgrnic_free_srq_wqe(srq, le32_to_cpu(cqe->wqe) >>
+                                    srq->entry_sz_log);
             ++nfreed;
-        else if (nfreed)
+        } else if (nfreed)
             memcpy(get_cqe(cq, (prod_index + nfreed) & cq->ibcq.cqe),
                     cqe, sizeof(struct hgrnic_cqe));
     }
@@ -344,10 +361,11 @@ static inline int hgrnic_poll_one(struct hgrnic_dev *dev,
     if (!cqe)
         return -EAGAIN;
 
-    hgrnic_dbg(dev, "%x/%d: CQE -> QPN %06x, WQE @ %08x\n",
-              cq->cqn, cq->cons_index, le32_to_cpu(cqe->my_qpn),
-              le32_to_cpu(cqe->wqe));
-    dump_cqe(dev, cqe);
+    /*
+     * Make sure we read CQ entry contents after we've checked the
+     * ownership bit.
+     */
+    rmb();
 
     is_error = (cqe->opcode == HGRNIC_OPCODE_SEND_ERR) ||
                (cqe->opcode == HGRNIC_OPCODE_RECV_ERR);
@@ -356,13 +374,13 @@ static inline int hgrnic_poll_one(struct hgrnic_dev *dev,
 
     if (!*cur_qp || le32_to_cpu(cqe->my_qpn) != (*cur_qp)->qpn) {
         /*
-         * We do not have to take the QP table lock here,
+         * We do not have to take a QP reference here,
          * because CQs will be locked while QPs are removed
          * from the table.
          */
-        *cur_qp = hgrnic_array_get(&dev->qp_table.qp,
-                                  le32_to_cpu(cqe->my_qpn) &
-                                  (dev->limits.num_qps - 1));
+        *cur_qp = xa_load(&dev->qp_table.qp,
+                          le32_to_cpu(cqe->my_qpn) &
+                          (dev->limits.num_qps - 1));
         if (!*cur_qp) {
             hgrnic_warn(dev, "CQ entry for unknown QP %06x\n",
                     le32_to_cpu(cqe->my_qpn) & 0xffffff);
@@ -377,10 +395,17 @@ static inline int hgrnic_poll_one(struct hgrnic_dev *dev,
         wq = &(*cur_qp)->sq;
         wqe_index = le32_to_cpu(cqe->wqe) >> wq->entry_sz_log;
         entry->wr_id = (*cur_qp)->sq.wr_id[wqe_index];
+    } else if ((*cur_qp)->ibqp.srq) {
+        struct hgrnic_srq *srq = to_hgsrq((*cur_qp)->ibqp.srq);
+
+        wq = NULL;
+        wqe_index = le32_to_cpu(cqe->wqe) >> srq->entry_sz_log;
+        entry->wr_id = srq->wr_id[wqe_index];
+        hgrnic_free_srq_wqe(srq, wqe_index);
     } else {
         wq = &(*cur_qp)->rq;
         wqe_index = le32_to_cpu(cqe->wqe) >> wq->entry_sz_log;
-        entry->wr_id = (*cur_qp)->sq.wr_id[wqe_index];
+        entry->wr_id = (*cur_qp)->rq.wr_id[wqe_index];
     }
 
     if (wq) {
@@ -419,6 +444,15 @@ static inline int hgrnic_poll_one(struct hgrnic_dev *dev,
             entry->opcode    = IB_WC_SEND;
             entry->wc_flags |= IB_WC_WITH_IMM;
             break;
+        case HGRNIC_OPCODE_SEND_INV:
+            entry->opcode    = IB_WC_SEND;
+            break;
+        case HGRNIC_OPCODE_FAST_REG:
+            entry->opcode    = IB_WC_REG_MR;
+            break;
+        case HGRNIC_OPCODE_LOCAL_INV:
+            entry->opcode    = IB_WC_LOCAL_INV;
+            break;
         case HGRNIC_OPCODE_RDMA_READ:
             entry->opcode    = IB_WC_RDMA_READ;
             entry->byte_len  = le32_to_cpu(cqe->byte_cnt);
@@ -431,6 +465,14 @@ static inline int hgrnic_poll_one(struct hgrnic_dev *dev,
             entry->opcode    = IB_WC_FETCH_ADD;
             entry->byte_len  = HGRNIC_ATOMIC_BYTE_LEN;
             break;
+        case HGRNIC_OPCODE_MASKED_ATOMIC_CS:
+            entry->opcode    = IB_WC_MASKED_COMP_SWAP;
+            entry->byte_len  = HGRNIC_ATOMIC_BYTE_LEN;
+            break;
+        case HGRNIC_OPCODE_MASKED_ATOMIC_FA:
+            entry->opcode    = IB_WC_MASKED_FETCH_ADD;
+            entry->byte_len  = HGRNIC_ATOMIC_BYTE_LEN;
+            break;
         default:
             entry->opcode    = HGRNIC_OPCODE_NOP;
             break;
@@ -450,6 +492,12 @@ static inline int hgrnic_poll_one(struct hgrnic_dev *dev,
             entry->ex.imm_data = cqe->imm;
             entry->opcode = IB_WC_RECV_RDMA_WITH_IMM;
             break;
+        case IB_OPCODE_SEND_LAST_WITH_INVALIDATE:
+        case IB_OPCODE_SEND_ONLY_WITH_INVALIDATE:
+            entry->wc_flags = IB_WC_WITH_INVALIDATE;
+            entry->ex.invalidate_rkey = le32_to_cpu(cqe->imm);
+            entry->opcode = IB_WC_RECV;
+            break;
         default:
             entry->wc_flags = 0;
             entry->opcode = IB_WC_RECV;
@@ -541,10 +589,73 @@ repoll:
 }
 
 
-int hgrnic_arm_cq(struct ib_cq *ibcq, enum ib_cq_notify_flags flags) {
+/**
+ * @note Request a completion event for the next CQE. The armed CQ
+ * table of the HCA holds one bit per CQ and is written with the CQN
+ * alone, so a solicited-only request arms for any completion.
+ * @return 1 if IB_CQ_REPORT_MISSED_EVENTS is set and the CQ is not
+ * empty, so the caller has to poll again; 0 otherwise.
+ */
+int hgrnic_arm_cq(struct ib_cq *ibcq, enum ib_cq_notify_flags flags)
+{
+    struct hgrnic_dev *dev = to_hgdev(ibcq->device);
+    struct hgrnic_cq *cq = to_hgcq(ibcq);
+    unsigned long irqflags;
+    int ret = 0;
 
-	printk(KERN_INFO PFX "Enter hgrnic_arm_cq! This callback is left empty!\n");
-	return 0;
+    spin_lock_irqsave(&cq->lock, irqflags);
+
+    __raw_writel((__force u32) cpu_to_le32(cq->cqn),
+                 dev->kar + HGRNIC_CQ_DOORBELL);
+
+    if ((flags & IB_CQ_REPORT_MISSED_EVENTS) && next_cqe_sw(cq))
+        ret = 1;
+
+    spin_unlock_irqrestore(&cq->lock, irqflags);
+
+    return ret;
+}
+
+/**
+ * @note Called from EQ interrupt handler. Deliver completion event
+ * to the CQ's consumer (ib_core IB_POLL_* handler, uverbs channel,
+ * or the ULP's own comp_handler).
+ */
+void hgrnic_cq_completion(struct hgrnic_dev *dev, u32 cqn)
+{
+    struct hgrnic_cq *cq;
+
+    cq = hgrnic_cq_get(dev, cqn);
+    if (!cq) {
+        hgrnic_warn(dev, "Completion event for bogus CQ %08x\n", cqn);
+        return;
+    }
+
+    if (cq->ibcq.comp_handler)
+        cq->ibcq.comp_handler(&cq->ibcq, cq->ibcq.cq_context);
+
+    hgrnic_cq_put(cq);
+}
+
+void hgrnic_cq_event(struct hgrnic_dev *dev, u32 cqn,
+                    enum ib_event_type event_type)
+{
+    struct hgrnic_cq *cq;
+    struct ib_event event;
+
+    cq = hgrnic_cq_get(dev, cqn);
+    if (!cq) {
+        hgrnic_warn(dev, "Async event for bogus CQ %08x\n", cqn);
+        return;
+    }
+
+    event.device      = &dev->ib_dev;
+    event.event       = event_type;
+    event.element.cq  = &cq->ibcq;
+    if (cq->ibcq.event_handler)
+        cq->ibcq.event_handler(&event, cq->ibcq.cq_context);
+
+    hgrnic_cq_put(cq);
 }
 
 /** 
@@ -552,10 +663,12 @@ int hgrnic_arm_cq(struct ib_cq *ibcq, enum ib_cq_notify_flags flags) {
  * @param nent : unmber of cqe supported in the CQ. (may get from userspace driver)
  * @param ctx  : ctx cq belonged to, is NULL if the caller is from kernel space.
  * @param pdn  : pd number this cq belonged to. (may get from user space driver)
+ * @param comp_vector : completion vector, selects the EQ reporting this cq.
  * @param cq   : struct hgrnic_cq allocated for this cq.
  */
 int hgrnic_init_cq (struct hgrnic_dev *dev, int nent,
-        struct hgrnic_ucontext *ctx, u32 pdn, struct hgrnic_cq *cq)
+        struct hgrnic_ucontext *ctx, u32 pdn, int comp_vector,
+        struct hgrnic_cq *cq)
 {
     struct hgrnic_mailbox *mailbox;
     struct hgrnic_cq_context *cq_context;
@@ -581,7 +694,7 @@ int hgrnic_init_cq (struct hgrnic_dev *dev, int nent,
     }
 
     spin_lock_init(&cq->lock);
-    cq->refcount = 1;
+    refcount_set(&cq->refcount, 1);
     init_waitqueue_head(&cq->wait);
     mutex_init(&cq->mutex);
 
@@ -595,6 +708,8 @@ int hgrnic_init_cq (struct hgrnic_dev *dev, int nent,
                                     HGRNIC_CQ_STATE_DISARMED |
                                     HGRNIC_CQ_FLAG_TR);
     cq_context->logsize_usrpage = cpu_to_be32((ffs(nent) - 1) << 24); /* TODO: This logsize needs to be checked */
+    if (!(dev->hgrnic_flags & HGRNIC_FLAG_NO_EQ))
+        cq_context->comp_eqn    = cpu_to_be32(dev->eq_table.eq[HGRNIC_EQ_COMP + comp_vector].eqn);
     cq_context->pd              = cpu_to_be32(pdn);
     cq_context->lkey            = cpu_to_be32(cq->buf.mr.ibmr.lkey);
     cq_context->cqn             = cpu_to_be32(cq->cqn);
@@ -616,14 +731,13 @@ int hgrnic_init_cq (struct hgrnic_dev *dev, int nent,
 
     hgrnic_free_mailbox(dev, mailbox);
 
-    spin_lock_irq(&dev->cq_table.lock);
-    if (hgrnic_array_set(&dev->cq_table.cq,
-                cq->cqn & (dev->limits.num_cqs - 1),
-                cq)) {
-        spin_unlock_irq(&dev->cq_table.lock);
+    err = xa_err(xa_store(&dev->cq_table.cq,
+                          cq->cqn & (dev->limits.num_cqs - 1),
+                          cq, GFP_KERNEL));
+    if (err) {
+        hgrnic_HW2SW_CQ(dev, cq->cqn);
         goto err_out_free_mr;
     }
-    spin_unlock_irq(&dev->cq_table.lock);
 
     return 0;
 
@@ -643,15 +757,28 @@ err_out:
     return err;
 }
 
-static inline int get_cq_refcount(struct hgrnic_dev *dev, struct hgrnic_cq *cq)
+/**
+ * @note Look up a CQ for event dispatch and take a reference on it.
+ * Safe in interrupt context, no lock is taken.
+ * @return The CQ, or NULL if it does not exist or is being destroyed.
+ */
+struct hgrnic_cq *hgrnic_cq_get(struct hgrnic_dev *dev, int cqn)
 {
-    int c;
+    struct hgrnic_cq *cq;
 
-    spin_lock_irq(&dev->cq_table.lock);
-    c = cq->refcount;
-    spin_unlock_irq(&dev->cq_table.lock);
+    rcu_read_lock();
+    cq = xa_load(&dev->cq_table.cq, cqn & (dev->limits.num_cqs - 1));
+    if (cq && !refcount_inc_not_zero(&cq->refcount))
+        cq = NULL;
+    rcu_read_unlock();
 
-    return c;
+    return cq;
+}
+
+void hgrnic_cq_put(struct hgrnic_cq *cq)
+{
+    if (refcount_dec_and_test(&cq->refcount))
+        wake_up(&cq->wait);
 }
 
 void hgrnic_free_cq(struct hgrnic_dev *dev,
@@ -664,13 +791,13 @@ void hgrnic_free_cq(struct hgrnic_dev *dev,
         hgrnic_warn(dev, "HW2SW_CQ failed (%d)\n", err);
 
 
-    spin_lock_irq(&dev->cq_table.lock);
-    hgrnic_array_clear(&dev->cq_table.cq,
-                      cq->cqn & (dev->limits.num_cqs - 1));
-    --cq->refcount;
-    spin_unlock_irq(&dev->cq_table.lock);
+    xa_erase(&dev->cq_table.cq, cq->cqn & (dev->limits.num_cqs - 1));
+
+    /* No lookup may still hold the pointer without a reference. */
+    synchronize_rcu();
 
-    wait_event(cq->wait, !get_cq_refcount(dev, cq));
+    hgrnic_cq_put(cq);
+    wait_event(cq->wait, !refcount_read(&cq->refcount));
 
     if (cq->is_kernel)
         hgrnic_free_cq_buf(dev, &cq->buf, cq->ibcq.cqe);
@@ -682,8 +809,6 @@ void hgrnic_free_cq(struct hgrnic_dev *dev,
 int hgrnic_init_cq_table (struct hgrnic_dev *dev) {
 	int err;
 
-	spin_lock_init(&dev->cq_table.lock);
-
 	err = hgrnic_alloc_init(&dev->cq_table.alloc,
 			       dev->limits.num_cqs,
 			       (1 << 24) - 1);
@@ -691,16 +816,13 @@ int hgrnic_init_cq_table (struct hgrnic_dev *dev) {
         return err;
     }
 
-	err = hgrnic_array_init(&dev->cq_table.cq,
-			       dev->limits.num_cqs);
-	if (err) {
-        hgrnic_alloc_cleanup(&dev->cq_table.alloc);
-    }
+	xa_init(&dev->cq_table.cq);
 
-	return err;
+	return 0;
 }
 
 void hgrnic_cleanup_cq_table(struct hgrnic_dev *dev) {
-	hgrnic_array_cleanup(&dev->cq_table.cq, dev->limits.num_cqs);
+	WARN_ON(!xa_empty(&dev->cq_table.cq));
+	xa_destroy(&dev->cq_table.cq);
 	hgrnic_alloc_cleanup(&dev->cq_table.alloc);
 }
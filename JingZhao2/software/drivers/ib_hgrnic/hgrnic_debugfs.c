@@ -0,0 +1,318 @@
+/**************************************************************
+ * @file hgrnic_debugfs.c
+ * @note Functions related to debugfs, under <debugfs>/ib_hgrnic/<pci>/.
+ *************************************************************/
+
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/rcupdate.h>
+#include <linux/module.h>
+
+#include "hgrnic_dev.h"
+#include "hgrnic_cmd.h"
+
+static struct dentry *hgrnic_dbg_root;
+
+/**
+ * @note Dump the event moderation currently programmed in
+ * each CQ, i.e. the profile picked by rdma_dim.
+ */
+static int hgrnic_cq_moder_show (struct seq_file *s, void *unused)
+{
+    struct hgrnic_dev *dev = s->private;
+    struct hgrnic_cq *cq;
+    unsigned long cqn;
+
+    seq_puts(s, "cqn\tcount\tperiod\n");
+
+    /* CQs are freed only after an RCU grace period. */
+    rcu_read_lock();
+    xa_for_each(&dev->cq_table.cq, cqn, cq)
+        seq_printf(s, "%lu\t%u\t%u\n", cqn,
+                   READ_ONCE(cq->moder_count), READ_ONCE(cq->moder_period));
+    rcu_read_unlock();
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(hgrnic_cq_moder);
+
+/**
+ * @note Dump the time spent in each bring-up step, in the order
+ * the steps finished. ICM table setups may overlap.
+ */
+static int hgrnic_init_timing_show (struct seq_file *s, void *unused)
+{
+    struct hgrnic_dev *dev = s->private;
+    struct hgrnic_init_timing *t = &dev->init_timing;
+    int i, num;
+
+    num = min_t(int, atomic_read(&t->num), HGRNIC_MAX_INIT_PHASES);
+    for (i = 0; i < num; ++i)
+        seq_printf(s, "%-16s %10llu us\n", t->phase[i].name,
+                   div_u64(t->phase[i].ns, NSEC_PER_USEC));
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(hgrnic_init_timing);
+
+/**
+ * @note Dump which ICM chunks are mapped in each context table and
+ * how many objects keep each chunk alive.
+ */
+static int hgrnic_icm_show (struct seq_file *s, void *unused)
+{
+    struct hgrnic_dev *dev = s->private;
+
+    hgrnic_icm_table_show(dev->qp_table.qp_table, "qpc", s);
+    hgrnic_icm_table_show(dev->cq_table.table,    "cqc", s);
+    hgrnic_icm_table_show(dev->mr_table.mpt_table, "mpt", s);
+    hgrnic_icm_table_show(dev->mr_table.mtt_table, "mtt", s);
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(hgrnic_icm);
+
+/**
+ * @note Dump free blocks per order of the MTT segment buddy.
+ */
+static int hgrnic_buddy_show (struct seq_file *s, void *unused)
+{
+    struct hgrnic_dev *dev = s->private;
+    struct hgrnic_buddy *buddy = &dev->mr_table.mtt_buddy;
+    int o;
+
+    seq_puts(s, "order\tfree\n");
+
+    spin_lock(&buddy->lock);
+    for (o = 0; o <= buddy->max_order; ++o)
+        seq_printf(s, "%d\t%d\n", o, buddy->num_free[o]);
+    spin_unlock(&buddy->lock);
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(hgrnic_buddy);
+
+/**
+ * @note Dump IDs in use in each resource number allocator.
+ */
+static int hgrnic_alloc_ids_show (struct seq_file *s, void *unused)
+{
+    struct hgrnic_dev *dev = s->private;
+
+    hgrnic_alloc_show(&dev->uar_table.alloc,    "uar", s);
+    hgrnic_alloc_show(&dev->pd_table.alloc,     "pd",  s);
+    hgrnic_alloc_show(&dev->mr_table.mpt_alloc, "mpt", s);
+    if (!(dev->hgrnic_flags & HGRNIC_FLAG_NO_EQ))
+        hgrnic_alloc_show(&dev->eq_table.alloc, "eq", s);
+    hgrnic_alloc_show(&dev->cq_table.alloc,     "cq",  s);
+    hgrnic_alloc_show(&dev->qp_table.alloc,     "qp",  s);
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(hgrnic_alloc_ids);
+
+/**
+ * @note Dump count, failures and latency of each HCR command issued
+ * since the device was probed.
+ */
+static int hgrnic_commands_show (struct seq_file *s, void *unused)
+{
+    struct hgrnic_dev *dev = s->private;
+    struct hgrnic_cmd_stat *stat;
+    u64 count;
+    int i;
+
+    seq_puts(s, "command\t\tcount\terrors\tavg_us\tmax_us\n");
+
+    for (i = 0; i < HGRNIC_CMD_NUM_STATS; ++i) {
+        stat  = &dev->cmd.stats[i];
+        count = READ_ONCE(stat->count);
+        if (!count || !hgrnic_cmd_name(i))
+            continue;
+        seq_printf(s, "%-16s%llu\t%llu\t%llu\t%llu\n", hgrnic_cmd_name(i),
+                   count, READ_ONCE(stat->errors),
+                   div64_u64(READ_ONCE(stat->total_ns), count * NSEC_PER_USEC),
+                   div_u64(READ_ONCE(stat->max_ns), NSEC_PER_USEC));
+    }
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(hgrnic_commands);
+
+/**
+ * @note Dump the log2 latency histogram of each HCR command issued,
+ * one row per non-empty bucket. Writing anything clears the command
+ * statistics, including those shown in "commands".
+ */
+static int hgrnic_cmd_latency_show (struct seq_file *s, void *unused)
+{
+    struct hgrnic_dev *dev = s->private;
+    struct hgrnic_cmd_stat *stat;
+    u64 count;
+    int i, b;
+
+    for (i = 0; i < HGRNIC_CMD_NUM_STATS; ++i) {
+        stat = &dev->cmd.stats[i];
+        if (!READ_ONCE(stat->count) || !hgrnic_cmd_name(i))
+            continue;
+
+        seq_printf(s, "%s:\n", hgrnic_cmd_name(i));
+        for (b = 0; b < HGRNIC_CMD_HIST_BUCKETS; ++b) {
+            count = READ_ONCE(stat->hist[b]);
+            if (!count)
+                continue;
+            if (b == HGRNIC_CMD_HIST_BUCKETS - 1)
+                seq_printf(s, "\t[%llu us, ...)\t%llu\n",
+                           1ULL << (b - 1), count);
+            else
+                seq_printf(s, "\t[%llu us, %llu us)\t%llu\n",
+                           b ? 1ULL << (b - 1) : 0ULL, 1ULL << b, count);
+        }
+    }
+
+    return 0;
+}
+
+static int hgrnic_cmd_latency_open (struct inode *inode, struct file *file)
+{
+    return single_open(file, hgrnic_cmd_latency_show, inode->i_private);
+}
+
+static ssize_t hgrnic_cmd_latency_write (struct file *file,
+                                         const char __user *buf,
+                                         size_t count, loff_t *ppos)
+{
+    struct hgrnic_dev *dev = file_inode(file)->i_private;
+
+    /* Statistics are only updated with poll_sem held. */
+    down(&dev->cmd.poll_sem);
+    memset(dev->cmd.stats, 0, sizeof dev->cmd.stats);
+    up(&dev->cmd.poll_sem);
+
+    return count;
+}
+
+static const struct file_operations hgrnic_cmd_latency_fops = {
+    .owner   = THIS_MODULE,
+    .open    = hgrnic_cmd_latency_open,
+    .read    = seq_read,
+    .write   = hgrnic_cmd_latency_write,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+/**
+ * @note Dump the context of each live QP as the HCA reports it
+ * through QUERY_QP.
+ */
+static int hgrnic_qps_show (struct seq_file *s, void *unused)
+{
+    struct hgrnic_dev *dev = s->private;
+    struct hgrnic_qp *qp;
+    unsigned long qpn;
+
+    seq_puts(s, "qpn\t\ttrans\tstate\tdqpn\t\tmtu\tsq_psn\t\t"
+                "acked_psn\trq_psn\t\tscqn\t\trcqn\t\tsq/rq\n");
+
+    xa_for_each(&dev->qp_table.qp, qpn, qp) {
+        /* QUERY_QP sleeps, so pin the QP instead of holding RCU. */
+        qp = hgrnic_qp_get(dev, qpn);
+        if (!qp)
+            continue;
+        hgrnic_qp_show_context(dev, qp, s);
+        hgrnic_qp_put(qp);
+    }
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(hgrnic_qps);
+
+/**
+ * @note Dump live CQs. HCA has no QUERY_CQ, so this is the driver's
+ * view of each CQ.
+ */
+static int hgrnic_cqs_show (struct seq_file *s, void *unused)
+{
+    struct hgrnic_dev *dev = s->private;
+    struct hgrnic_cq *cq;
+    unsigned long cqn;
+
+    seq_puts(s, "cqn\tentries\tcons_index\towner\n");
+
+    rcu_read_lock();
+    xa_for_each(&dev->cq_table.cq, cqn, cq)
+        seq_printf(s, "%lu\t%d\t0x%x\t%s\n", cqn, cq->ibcq.cqe + 1,
+                   READ_ONCE(cq->cons_index),
+                   cq->is_kernel ? "kernel" : "user");
+    rcu_read_unlock();
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(hgrnic_cqs);
+
+/**
+ * @note Dump live MRs as written to the MPT. HCA has no QUERY_MPT,
+ * so the values are those kept by the driver.
+ */
+static int hgrnic_mrs_show (struct seq_file *s, void *unused)
+{
+    struct hgrnic_dev *dev = s->private;
+    struct hgrnic_mr *mr;
+    unsigned long idx;
+
+    seq_puts(s, "key\t\tpd\tstart\t\t\tsize\t\tmtt_seg\ttype\n");
+
+    xa_lock(&dev->mr_table.mr);
+    xa_for_each(&dev->mr_table.mr, idx, mr)
+        seq_printf(s, "0x%08x\t%u\t0x%016llx\t0x%llx\t%d\t%s\n",
+                   mr->key, mr->pd_num, mr->start, mr->size,
+                   mr->mtt ? (int) mr->mtt->first_index : -1,
+                   mr->pages ? "fast_reg" : mr->umem ? "user" : "kernel");
+    xa_unlock(&dev->mr_table.mr);
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(hgrnic_mrs);
+
+void hgrnic_debugfs_init (struct hgrnic_dev *dev)
+{
+    dev->dbg_root = debugfs_create_dir(pci_name(dev->pdev), hgrnic_dbg_root);
+
+    debugfs_create_file("cq_moderation", 0400, dev->dbg_root, dev,
+                        &hgrnic_cq_moder_fops);
+    debugfs_create_file("init_timing", 0400, dev->dbg_root, dev,
+                        &hgrnic_init_timing_fops);
+    debugfs_create_file("icm", 0400, dev->dbg_root, dev,
+                        &hgrnic_icm_fops);
+    debugfs_create_file("buddy", 0400, dev->dbg_root, dev,
+                        &hgrnic_buddy_fops);
+    debugfs_create_file("alloc_ids", 0400, dev->dbg_root, dev,
+                        &hgrnic_alloc_ids_fops);
+    debugfs_create_file("commands", 0400, dev->dbg_root, dev,
+                        &hgrnic_commands_fops);
+    debugfs_create_file("cmd_latency", 0600, dev->dbg_root, dev,
+                        &hgrnic_cmd_latency_fops);
+    debugfs_create_file("qps", 0400, dev->dbg_root, dev,
+                        &hgrnic_qps_fops);
+    debugfs_create_file("cqs", 0400, dev->dbg_root, dev,
+                        &hgrnic_cqs_fops);
+    debugfs_create_file("mrs", 0400, dev->dbg_root, dev,
+                        &hgrnic_mrs_fops);
+}
+
+void hgrnic_debugfs_cleanup (struct hgrnic_dev *dev)
+{
+    debugfs_remove_recursive(dev->dbg_root);
+    dev->dbg_root = NULL;
+}
+
+void hgrnic_debugfs_register (void)
+{
+    hgrnic_dbg_root = debugfs_create_dir(DRV_NAME, NULL);
+}
+
+void hgrnic_debugfs_unregister (void)
+{
+    debugfs_remove_recursive(hgrnic_dbg_root);
+    hgrnic_dbg_root = NULL;
+}
@@ -16,6 +16,11 @@
 #include <linux/mutex.h>
 #include <linux/list.h>
 #include <linux/semaphore.h>
+#include <linux/percpu.h>
+#include <linux/xarray.h>
+#include <linux/llist.h>
+#include <linux/workqueue.h>
+#include <linux/atomic.h>
 
 #include "hgrnic_provider.h"
 #include "hgrnic_doorbell.h"
@@ -67,7 +72,10 @@
 
 
 enum {
-	HGRNIC_FLAG_PCIE       = 1 << 1
+	HGRNIC_FLAG_MSI_X       = 1 << 0,
+	HGRNIC_FLAG_PCIE        = 1 << 1,
+	HGRNIC_FLAG_NO_EQ       = 1 << 2, /* No event queues, CQs can only be polled */
+	HGRNIC_FLAG_NO_CQ_MODER = 1 << 3  /* No CQ event moderation, DIM stays off */
 };
 
 enum {
@@ -90,8 +98,29 @@ enum {
 enum {
 	HGRNIC_EQ_CMD,
 	HGRNIC_EQ_ASYNC,
-	HGRNIC_EQ_COMP,
-	HGRNIC_NUM_EQ
+	HGRNIC_EQ_COMP  /* First completion EQ, one per completion vector */
+};
+
+enum {
+	/* Page list of a fast-reg MR is read by one DMA */
+	HGRNIC_MAX_FAST_REG_PAGES = PAGE_SIZE / sizeof (u64)
+};
+
+enum {
+	HGRNIC_MAX_CQ_MOD_COUNT  = 0xffff,
+	HGRNIC_MAX_CQ_MOD_PERIOD = 0xfff   /* usecs */
+};
+
+/* CQE timestamps are 40 bits of the HCA clock */
+#define HGRNIC_CQE_TS_MASK	((1ULL << 40) - 1)
+
+enum {
+	HGRNIC_MAX_INIT_PHASES = 24
+};
+
+enum {
+	HGRNIC_MAX_COMP_EQ = 16,
+	HGRNIC_NUM_EQ      = HGRNIC_EQ_COMP + HGRNIC_MAX_COMP_EQ
 };
 
 enum {
@@ -100,10 +129,15 @@ enum {
     HGRNIC_OPCODE_RDMA_WRITE_IMM = 0x09,
     HGRNIC_OPCODE_SEND           = 0x0a,
     HGRNIC_OPCODE_SEND_IMM       = 0x0b,
+    HGRNIC_OPCODE_SEND_INV       = 0x0c,
     HGRNIC_OPCODE_RDMA_READ      = 0x10,
     HGRNIC_OPCODE_ATOMIC_CS      = 0x11,
     HGRNIC_OPCODE_ATOMIC_FA      = 0x12,
+    HGRNIC_OPCODE_MASKED_ATOMIC_CS = 0x14,
+    HGRNIC_OPCODE_MASKED_ATOMIC_FA = 0x15,
     HGRNIC_OPCODE_BIND_MW        = 0x18,
+    HGRNIC_OPCODE_FAST_REG       = 0x19,
+    HGRNIC_OPCODE_LOCAL_INV      = 0x1a,
     HGRNIC_OPCODE_RECV_ERR       = 0xfe,
     HGRNIC_OPCODE_SEND_ERR       = 0xff,
 };
@@ -113,6 +147,23 @@ enum {
 	HGRNIC_CMD_NUM_DBELL_DWORDS = 8
 };
 
+/* Opcodes below 0x40 map to themselves, MAP/UNMAP_ICM fold above. */
+#define HGRNIC_CMD_NUM_STATS 0x50
+
+/*
+ * Latency histogram bucket 0 counts commands under 1024 ns, bucket i
+ * those in [2^(i+9), 2^(i+10)) ns. The last bucket takes the rest.
+ */
+#define HGRNIC_CMD_HIST_BUCKETS 28
+
+struct hgrnic_cmd_stat {
+	u64 count;
+	u64 errors;
+	u64 total_ns;
+	u64 max_ns;
+	u64 hist[HGRNIC_CMD_HIST_BUCKETS];
+};
+
 struct hgrnic_cmd {
 	struct dma_pool          *pool;
 	struct mutex              hcr_mutex;
@@ -126,6 +177,8 @@ struct hgrnic_cmd {
 	// u32                       flags;
 	void __iomem             *dbell_map;
 	u16                       dbell_offsets[HGRNIC_CMD_NUM_DBELL_DWORDS];
+	/* updated with poll_sem held */
+	struct hgrnic_cmd_stat    stats[HGRNIC_CMD_NUM_STATS];
 };
 
 struct hgrnic_limits {
@@ -144,6 +197,8 @@ struct hgrnic_limits {
     int      num_cqs;
     int      max_cqes;      /* maximum number of cqe in one CQ */
     int      reserved_cqs;
+    int      num_srqs;      /* 0 if the HCA has no SRQs */
+    int      reserved_srqs;
     int      num_eqs;
     int      reserved_eqs;
     int      num_mpts;
@@ -159,6 +214,27 @@ struct hgrnic_limits {
     u32      page_size_cap;
     u16      stat_rate_support;
     u8       port_width_cap;
+    u32      flags;     /* DEV_LIM_FLAG_* */
+};
+
+enum {
+    HGRNIC_ALLOC_MAG_SIZE = 16, /* IDs cached per CPU in each direction */
+    HGRNIC_ALLOC_MAG_MIN  = 64  /* per-CPU share of IDs needed to enable magazines */
+};
+
+/**
+ * Per-CPU magazine on top of the bitmap allocator.
+ * alloc_ids hold IDs already reserved in the bitmap, handed out without
+ * touching alloc->lock. free_ids hold released IDs which are retired
+ * into the bitmap in batches. Released IDs never go back to alloc_ids
+ * directly, so they are not reused before the cursor wraps around.
+ */
+struct hgrnic_alloc_mag {
+    spinlock_t     lock;
+    u32            nr_alloc;
+    u32            nr_free;
+    u32            alloc_ids[HGRNIC_ALLOC_MAG_SIZE];
+    u32            free_ids[HGRNIC_ALLOC_MAG_SIZE];
 };
 
 struct hgrnic_alloc {
@@ -169,15 +245,7 @@ struct hgrnic_alloc {
                           * Mask may be bigger than max. */
     spinlock_t     lock;
     unsigned long *table; /* bitmap table */
-};
-
-/* This struct is used to fnd resource 
- * pointer based on resource ID */
-struct hgrnic_array {
-    struct {
-        void    **page;
-        int       used;
-    } *page_list;
+    struct hgrnic_alloc_mag __percpu *mags; /* NULL for small tables */
 };
 
 struct hgrnic_uar_table {
@@ -214,6 +282,12 @@ struct hgrnic_mr_table {
     u64                     mpt_base;
     struct hgrnic_icm_table *mtt_table;
     struct hgrnic_icm_table *mpt_table;
+    struct xarray            mr; /* live MRs by MPT index, for debugfs */
+
+    /* MRs invalidated in HCA, waiting for ICM/MTT/key release */
+    struct llist_head        dereg_list;
+    struct work_struct       dereg_work;
+    struct workqueue_struct *dereg_wq;
 };
 
 struct hgrnic_eq_table {
@@ -221,6 +295,7 @@ struct hgrnic_eq_table {
     void __iomem      *clr_int;
     u32                clr_mask;
     u32                arm_mask;
+    int                num_comp_eqs; /* completion vectors in use */
     struct hgrnic_eq    eq[HGRNIC_NUM_EQ];
     u64                icm_virt;
     struct page       *icm_page;
@@ -229,24 +304,37 @@ struct hgrnic_eq_table {
 
 struct hgrnic_cq_table {
     struct hgrnic_alloc  alloc; /* rescource number allocation */
-    spinlock_t          lock ;
-    struct hgrnic_array  cq   ;
+    struct xarray        cq   ; /* CQN -> CQ, RCU lookup */
     struct hgrnic_icm_table *table; /* ICM space allocation */
 };
 
+struct hgrnic_srq_table {
+    struct hgrnic_alloc      alloc;
+    struct xarray            srq; /* SRQN -> SRQ, RCU lookup */
+    struct hgrnic_icm_table *table;
+};
+
 struct hgrnic_qp_table {
     struct hgrnic_alloc     alloc;
     u32                     rdb_base;
     int                     rdb_shift;
     int                     sqp_start; // start qpn of special qp
-    spinlock_t              lock;
-    struct hgrnic_array     qp; // Used to find qp struct based on QPN
+    struct xarray           qp; // Used to find qp struct based on QPN, RCU lookup
     struct hgrnic_icm_table *qp_table;
 };
 
 // defined in hgrnic_main.c
 extern struct mutex hgrnic_device_mutex;
 
+/* Wall time spent in each step of device bring-up. */
+struct hgrnic_init_timing {
+    atomic_t         num;
+    struct {
+        const char  *name;
+        u64          ns;
+    }                phase[HGRNIC_MAX_INIT_PHASES];
+};
+
 
 
 
@@ -260,6 +348,7 @@ struct hgrnic_dev {
 
     u32              rev_id;
     u64              board_id;
+    u32              hca_clock_khz; /* rate of the CQE timestamps, from QUERY_DEV_LIM */
 
     HGRNIC_DECLARE_DOORBELL_LOCK(doorbell_lock)
     struct mutex cap_mask_mutex;
@@ -275,6 +364,7 @@ struct hgrnic_dev {
     struct hgrnic_mr_table  mr_table;
     struct hgrnic_eq_table  eq_table;
     struct hgrnic_cq_table  cq_table;
+    struct hgrnic_srq_table srq_table;
     struct hgrnic_qp_table  qp_table;
 
     // Resources reserved for driver uses.
@@ -285,6 +375,9 @@ struct hgrnic_dev {
     u8                    gid[HG_GID_SIZE];
     u8                    rate[HGRNIC_MAX_PORTS];
     bool                  active;
+
+    struct hgrnic_init_timing init_timing;
+    struct dentry        *dbg_root; /* debugfs dir of this device */
 };
 
 
@@ -316,15 +409,14 @@ extern void __buggy_use_of_HGRNIC_PUT(void);
     } while (0)
 
 
+struct seq_file;
+
 u32 hgrnic_alloc(struct hgrnic_alloc *alloc);
 void hgrnic_free(struct hgrnic_alloc *alloc, u32 obj);
 int hgrnic_alloc_init(struct hgrnic_alloc *alloc, u32 num, u32 mask);
 void hgrnic_alloc_cleanup(struct hgrnic_alloc *alloc);
-void *hgrnic_array_get(struct hgrnic_array *array, int index);
-int hgrnic_array_set(struct hgrnic_array *array, int index, void *value);
-void hgrnic_array_clear(struct hgrnic_array *array, int index);
-int hgrnic_array_init(struct hgrnic_array *array, int nent);
-void hgrnic_array_cleanup(struct hgrnic_array *array, int nent);
+void hgrnic_alloc_show(struct hgrnic_alloc *alloc, const char *name,
+                       struct seq_file *s);
 int hgrnic_buf_alloc(struct hgrnic_dev *dev, int size,
 		    union hgrnic_buf *buf, int *is_direct, struct hgrnic_pd *pd,
 		    int hca_write, struct hgrnic_mr *mr);
@@ -334,20 +426,29 @@ void hgrnic_buf_free(struct hgrnic_dev *dev, int size, union hgrnic_buf *buf,
 int hgrnic_init_uar_table(struct hgrnic_dev *dev);
 int hgrnic_init_pd_table(struct hgrnic_dev *dev);
 int hgrnic_init_mr_table(struct hgrnic_dev *dev);
+int hgrnic_init_eq_table(struct hgrnic_dev *dev);
 int hgrnic_init_cq_table(struct hgrnic_dev *dev);
+int hgrnic_init_srq_table(struct hgrnic_dev *dev);
 int hgrnic_init_qp_table(struct hgrnic_dev *dev);
 // int hgrnic_init_mcg_table(struct hgrnic_dev *dev);
 
 void hgrnic_cleanup_uar_table(struct hgrnic_dev *dev);
 void hgrnic_cleanup_pd_table(struct hgrnic_dev *dev);
 void hgrnic_cleanup_mr_table(struct hgrnic_dev *dev);
+void hgrnic_cleanup_eq_table(struct hgrnic_dev *dev);
 void hgrnic_cleanup_cq_table(struct hgrnic_dev *dev);
+void hgrnic_cleanup_srq_table(struct hgrnic_dev *dev);
 void hgrnic_cleanup_qp_table(struct hgrnic_dev *dev);
 // void hgrnic_cleanup_mcg_table(struct hgrnic_dev *dev);
 
 int hgrnic_register_device(struct hgrnic_dev *dev);
 void hgrnic_unregister_device(struct hgrnic_dev *dev);
 
+void hgrnic_debugfs_register(void);
+void hgrnic_debugfs_unregister(void);
+void hgrnic_debugfs_init(struct hgrnic_dev *dev);
+void hgrnic_debugfs_cleanup(struct hgrnic_dev *dev);
+
 int __hgrnic_restart_one(struct pci_dev *pdev);
 
 int hgrnic_uar_alloc(struct hgrnic_dev *dev, struct hgrnic_uar *uar);
@@ -368,11 +469,14 @@ int hgrnic_mr_alloc(struct hgrnic_dev *dev, u32 pd, int buffer_size_shift,
 		   u64 iova, u64 total_size, u32 access, struct hgrnic_mr *mr);
 int hgrnic_mr_alloc_notrans(struct hgrnic_dev *dev, u32 pd,
 			   u32 access, struct hgrnic_mr *mr);
+int hgrnic_mr_alloc_fast_reg(struct hgrnic_dev *dev, u32 pd,
+                             u32 max_pages, struct hgrnic_mr *mr);
 int hgrnic_mr_alloc_phys(struct hgrnic_dev *dev, u32 pd,
 			u64 *buffer_list, int buffer_size_shift,
 			int list_len, u64 iova, u64 total_size,
 			u32 access, struct hgrnic_mr *mr);
 void hgrnic_free_mr(struct hgrnic_dev *dev,  struct hgrnic_mr *mr);
+void hgrnic_dereg_mr_deferred(struct hgrnic_dev *dev, struct hgrnic_mr *mr);
 
 int hgrnic_map_eq_icm(struct hgrnic_dev *dev, u64 icm_virt);
 void hgrnic_unmap_eq_icm(struct hgrnic_dev *dev);
@@ -383,14 +487,32 @@ int hgrnic_poll_cq(struct ib_cq *ibcq, int num_entries,
 		  struct ib_wc *entry);
 int hgrnic_arm_cq(struct ib_cq *cq, enum ib_cq_notify_flags flags);
 int hgrnic_init_cq(struct hgrnic_dev *dev, int nent, 
-        struct hgrnic_ucontext *ctx, u32 pdn, struct hgrnic_cq *cq);
+        struct hgrnic_ucontext *ctx, u32 pdn, int comp_vector,
+        struct hgrnic_cq *cq);
 void hgrnic_free_cq(struct hgrnic_dev *dev,
                    struct hgrnic_cq *cq);
-void hgrnic_cq_clean(struct hgrnic_dev *dev, struct hgrnic_cq *cq, u32 qpn);
+struct hgrnic_cq *hgrnic_cq_get(struct hgrnic_dev *dev, int cqn);
+void hgrnic_cq_put(struct hgrnic_cq *cq);
+void hgrnic_cq_completion(struct hgrnic_dev *dev, u32 cqn);
+void hgrnic_cq_event(struct hgrnic_dev *dev, u32 cqn,
+                    enum ib_event_type event_type);
+void hgrnic_cq_clean(struct hgrnic_dev *dev, struct hgrnic_cq *cq, u32 qpn,
+                    struct hgrnic_srq *srq);
 void hgrnic_cq_resize_copy_cqes(struct hgrnic_cq *cq);
 int hgrnic_alloc_cq_buf(struct hgrnic_dev *dev, struct hgrnic_cq_buf *buf, int nent);
 void hgrnic_free_cq_buf(struct hgrnic_dev *dev, struct hgrnic_cq_buf *buf, int cqe);
 
+int hgrnic_create_srq(struct ib_srq *ibsrq, struct ib_srq_init_attr *init_attr,
+                     struct ib_udata *udata);
+void hgrnic_destroy_srq(struct ib_srq *ibsrq, struct ib_udata *udata);
+int hgrnic_modify_srq(struct ib_srq *ibsrq, struct ib_srq_attr *attr,
+                     enum ib_srq_attr_mask attr_mask, struct ib_udata *udata);
+int hgrnic_query_srq(struct ib_srq *ibsrq, struct ib_srq_attr *srq_attr);
+int hgrnic_post_srq_recv(struct ib_srq *ibsrq, const struct ib_recv_wr *wr,
+                        const struct ib_recv_wr **bad_wr);
+void hgrnic_free_srq_wqe(struct hgrnic_srq *srq, int wqe_index);
+void hgrnic_srq_event(struct hgrnic_dev *dev, u32 srqn,
+                     enum ib_event_type event_type);
 
 int hgrnic_query_qp(struct ib_qp *ibqp, struct ib_qp_attr *qp_attr, int qp_attr_mask,
 		   struct ib_qp_init_attr *qp_init_attr);
@@ -406,11 +528,18 @@ int hgrnic_alloc_qp(struct hgrnic_dev *dev,
 		   struct hgrnic_pd *pd,
 		   struct hgrnic_cq *send_cq,
 		   struct hgrnic_cq *recv_cq,
+		   struct hgrnic_srq *srq,
 		   enum ib_qp_type type,
 		   struct ib_qp_cap *cap,
 		   struct hgrnic_qp *qp,
 		   struct ib_udata *udata);
 void hgrnic_free_qp(struct hgrnic_dev *dev, struct hgrnic_qp *qp);
+struct hgrnic_qp *hgrnic_qp_get(struct hgrnic_dev *dev, u32 qpn);
+void hgrnic_qp_put(struct hgrnic_qp *qp);
+int hgrnic_qp_show_context(struct hgrnic_dev *dev, struct hgrnic_qp *qp,
+                           struct seq_file *s);
+void hgrnic_qp_event(struct hgrnic_dev *dev, u32 qpn,
+                    enum ib_event_type event_type);
 
 
 static inline struct hgrnic_dev *to_hgdev(struct ib_device *ibdev) {
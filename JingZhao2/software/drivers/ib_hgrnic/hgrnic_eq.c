@@ -83,10 +83,51 @@ enum {
 				(1ULL << HGRNIC_EVENT_TYPE_SRQ_LIMIT))
 #define HGRNIC_CMD_EVENT_MASK    (1ULL << HGRNIC_EVENT_TYPE_CMD)
 
+/* SRQ events are only mapped if the HCA has SRQs. */
+static u64 hgrnic_async_event_mask(struct hgrnic_dev *dev)
+{
+	return HGRNIC_ASYNC_EVENT_MASK |
+	       (dev->limits.flags & DEV_LIM_FLAG_SRQ ? HGRNIC_SRQ_EVENT_MASK : 0);
+}
+
 
 #define  HGRNIC_EQ_ENTRY_OWNER_SW      (0 << 7)
 #define  HGRNIC_EQ_ENTRY_OWNER_HW      (1 << 7)
 
+#define  HGRNIC_PORT_CHANGE_SUBTYPE_ACTIVE  0x4
+
+struct hgrnic_eqe {
+	u8 reserved1;
+	u8 type;
+	u8 reserved2;
+	u8 subtype;
+	union {
+		u32 raw[6];
+		struct {
+			__le32 cqn;
+		} __packed comp;
+		struct {
+			u32    reserved1[3];
+			__le32 qpn;
+		} __packed qp;
+		struct {
+			__le32 srqn;
+		} __packed srq;
+		struct {
+			__le32 cqn;
+			u32    reserved1;
+			u8     reserved2[3];
+			u8     syndrome;
+		} __packed cq_err;
+		struct {
+			u32    reserved1[2];
+			__le32 port;
+		} __packed port_change;
+	} event;
+	u8 reserved3[3];
+	u8 owner;
+} __packed;
+
 
 
 
@@ -104,7 +145,8 @@ int hgrnic_map_eq_icm (struct hgrnic_dev *dev, u64 icm_virt) {
      * of EQ.
 	 */
 	dev->eq_table.icm_virt = icm_virt;
-	dev->eq_table.icm_page = alloc_page(GFP_HIGHUSER); // allocate only one page
+	dev->eq_table.icm_page = alloc_pages_node(dev_to_node(&dev->pdev->dev),
+	                                          GFP_HIGHUSER, 0); // allocate only one page
 	if (!dev->eq_table.icm_page) {
         return -ENOMEM;
     }
@@ -119,7 +161,6 @@ int hgrnic_map_eq_icm (struct hgrnic_dev *dev, u64 icm_virt) {
 
     // Write allocated ICM addr (bus addr, and its attached 
     // ICM virtual Addr) for EQ to Hardware.
-    printk(KERN_INFO PFX "Start hgrnic_MAP_ICM_page for EQ.\n");
 	ret = hgrnic_MAP_ICM_page(dev, dev->eq_table.icm_dma, 
             CXT_REGION, icm_virt);
 	if (ret) {
@@ -138,3 +179,393 @@ void hgrnic_unmap_eq_icm (struct hgrnic_dev *dev) {
 		       PCI_DMA_BIDIRECTIONAL);
 	__free_page(dev->eq_table.icm_page);
 }
+
+static inline struct hgrnic_eqe *get_eqe(struct hgrnic_eq *eq, u32 entry)
+{
+	unsigned long off = (entry & (eq->nent - 1)) * HGRNIC_EQ_ENTRY_SIZE;
+
+	if (eq->is_direct)
+		return eq->queue.direct.buf + off;
+	else
+		return eq->queue.page_list[off / PAGE_SIZE].buf + off % PAGE_SIZE;
+}
+
+static inline struct hgrnic_eqe *next_eqe_sw(struct hgrnic_eq *eq)
+{
+	struct hgrnic_eqe *eqe;
+
+	eqe = get_eqe(eq, eq->cons_index);
+	return (HGRNIC_EQ_ENTRY_OWNER_HW & eqe->owner) ? NULL : eqe;
+}
+
+static inline void set_eqe_hw(struct hgrnic_eqe *eqe)
+{
+	eqe->owner = HGRNIC_EQ_ENTRY_OWNER_HW;
+}
+
+/**
+ * @note Arm the EQ through the doorbell in kernel access region. The
+ * HCA keeps an armed bit per EQ and no consumer index, every write
+ * to the EQ doorbell arms the EQN held in its low bits.
+ */
+static inline void hgrnic_eq_arm (struct hgrnic_dev *dev, struct hgrnic_eq *eq)
+{
+	__raw_writel((__force u32) cpu_to_le32(eq->eqn),
+	             dev->kar + HGRNIC_EQ_DOORBELL);
+}
+
+static void port_change (struct hgrnic_dev *dev, int port, int active)
+{
+	struct ib_event record;
+
+	hgrnic_dbg(dev, "Port change to %s for port %d\n",
+	           active ? "active" : "down", port);
+
+	record.device = &dev->ib_dev;
+	record.event  = active ? IB_EVENT_PORT_ACTIVE : IB_EVENT_PORT_ERR;
+	record.element.port_num = port;
+
+	ib_dispatch_event(&record);
+}
+
+/**
+ * @note Consume all EQEs owned by software, and dispatch them to
+ * the CQ/QP they belong to. Lookup is lockless (see hgrnic_cq_get).
+ * @return Non-zero if any EQE has been consumed.
+ */
+static int hgrnic_eq_int (struct hgrnic_dev *dev, struct hgrnic_eq *eq)
+{
+	struct hgrnic_eqe *eqe;
+	int disarm_cqn;
+	int eqes_found = 0;
+
+	while ((eqe = next_eqe_sw(eq))) {
+		/*
+		 * Make sure we read EQ entry contents after we've
+		 * checked the ownership bit.
+		 */
+		rmb();
+
+		switch (eqe->type) {
+		case HGRNIC_EVENT_TYPE_COMP:
+			disarm_cqn = le32_to_cpu(eqe->event.comp.cqn) & 0xffffff;
+			hgrnic_cq_completion(dev, disarm_cqn);
+			break;
+
+		case HGRNIC_EVENT_TYPE_PATH_MIG:
+			hgrnic_qp_event(dev, le32_to_cpu(eqe->event.qp.qpn) & 0xffffff,
+			                IB_EVENT_PATH_MIG);
+			break;
+
+		case HGRNIC_EVENT_TYPE_COMM_EST:
+			hgrnic_qp_event(dev, le32_to_cpu(eqe->event.qp.qpn) & 0xffffff,
+			                IB_EVENT_COMM_EST);
+			break;
+
+		case HGRNIC_EVENT_TYPE_SQ_DRAINED:
+			hgrnic_qp_event(dev, le32_to_cpu(eqe->event.qp.qpn) & 0xffffff,
+			                IB_EVENT_SQ_DRAINED);
+			break;
+
+		case HGRNIC_EVENT_TYPE_WQ_CATAS_ERROR:
+			hgrnic_qp_event(dev, le32_to_cpu(eqe->event.qp.qpn) & 0xffffff,
+			                IB_EVENT_QP_FATAL);
+			break;
+
+		case HGRNIC_EVENT_TYPE_PATH_MIG_FAILED:
+			hgrnic_qp_event(dev, le32_to_cpu(eqe->event.qp.qpn) & 0xffffff,
+			                IB_EVENT_PATH_MIG_ERR);
+			break;
+
+		case HGRNIC_EVENT_TYPE_WQ_INVAL_REQ_ERROR:
+			hgrnic_qp_event(dev, le32_to_cpu(eqe->event.qp.qpn) & 0xffffff,
+			                IB_EVENT_QP_REQ_ERR);
+			break;
+
+		case HGRNIC_EVENT_TYPE_WQ_ACCESS_ERROR:
+			hgrnic_qp_event(dev, le32_to_cpu(eqe->event.qp.qpn) & 0xffffff,
+			                IB_EVENT_QP_ACCESS_ERR);
+			break;
+
+		case HGRNIC_EVENT_TYPE_SRQ_LIMIT:
+			hgrnic_srq_event(dev, le32_to_cpu(eqe->event.srq.srqn) & 0xffffff,
+			                 IB_EVENT_SRQ_LIMIT_REACHED);
+			break;
+
+		case HGRNIC_EVENT_TYPE_SRQ_CATAS_ERROR:
+			hgrnic_srq_event(dev, le32_to_cpu(eqe->event.srq.srqn) & 0xffffff,
+			                 IB_EVENT_SRQ_ERR);
+			break;
+
+		case HGRNIC_EVENT_TYPE_SRQ_QP_LAST_WQE:
+			hgrnic_qp_event(dev, le32_to_cpu(eqe->event.qp.qpn) & 0xffffff,
+			                IB_EVENT_QP_LAST_WQE_REACHED);
+			break;
+
+		case HGRNIC_EVENT_TYPE_PORT_CHANGE:
+			port_change(dev,
+			            (le32_to_cpu(eqe->event.port_change.port) >> 28) & 3,
+			            eqe->subtype == HGRNIC_PORT_CHANGE_SUBTYPE_ACTIVE);
+			break;
+
+		case HGRNIC_EVENT_TYPE_CQ_ERROR:
+			hgrnic_warn(dev, "CQ %s on CQN %06x\n",
+			            eqe->event.cq_err.syndrome == 1 ?
+			            "overrun" : "access violation",
+			            le32_to_cpu(eqe->event.cq_err.cqn) & 0xffffff);
+			hgrnic_cq_event(dev, le32_to_cpu(eqe->event.cq_err.cqn) & 0xffffff,
+			                IB_EVENT_CQ_ERR);
+			break;
+
+		case HGRNIC_EVENT_TYPE_EQ_OVERFLOW:
+			hgrnic_warn(dev, "EQ overrun on EQN %d\n", eq->eqn);
+			break;
+
+		case HGRNIC_EVENT_TYPE_LOCAL_CATAS_ERROR:
+			hgrnic_err(dev, "Catastrophic error reported on EQN %d\n", eq->eqn);
+			break;
+
+		case HGRNIC_EVENT_TYPE_EEC_CATAS_ERROR:
+		case HGRNIC_EVENT_TYPE_ECC_DETECT:
+		case HGRNIC_EVENT_TYPE_CMD:
+		default:
+			hgrnic_warn(dev, "Unhandled event %02x(%02x) on EQ %d\n",
+			            eqe->type, eqe->subtype, eq->eqn);
+			break;
+		}
+
+		set_eqe_hw(eqe);
+		++eq->cons_index;
+		eqes_found = 1;
+	}
+
+	return eqes_found;
+}
+
+static irqreturn_t hgrnic_msi_x_interrupt (int irq, void *eq_ptr)
+{
+	struct hgrnic_eq  *eq  = eq_ptr;
+	struct hgrnic_dev *dev = eq->dev;
+
+	hgrnic_eq_int(dev, eq);
+
+	/* EQEs are handed back through the owner bit, only rearm. */
+	wmb();
+	hgrnic_eq_arm(dev, eq);
+
+	/* MSI-X vectors always belong to us */
+	return IRQ_HANDLED;
+}
+
+/**
+ * @note Allocate EQ buffer, register it in a MR and pass the
+ * EQ context to hardware.
+ * @param nent Minimum number of EQEs, rounded up to power of 2.
+ * @param intr MSI-X entry this EQ reports to.
+ */
+static int hgrnic_create_eq (struct hgrnic_dev *dev, int nent,
+                             u8 intr, struct hgrnic_eq *eq)
+{
+	struct hgrnic_mailbox *mailbox;
+	struct hgrnic_eq_context *eq_context;
+	int err;
+	u32 i;
+
+	eq->dev  = dev;
+	eq->nent = roundup_pow_of_two(max(nent, 2));
+	eq->cons_index = 0;
+
+	err = hgrnic_buf_alloc(dev, eq->nent * HGRNIC_EQ_ENTRY_SIZE,
+	                       &eq->queue, &eq->is_direct,
+	                       &dev->driver_pd, 1, &eq->mr);
+	if (err)
+		return err;
+
+	for (i = 0; i < eq->nent; ++i)
+		set_eqe_hw(get_eqe(eq, i));
+
+	eq->eqn = hgrnic_alloc(&dev->eq_table.alloc);
+	if (eq->eqn == -1) {
+		err = -ENOMEM;
+		goto err_out_free_buf;
+	}
+
+	mailbox = hgrnic_alloc_mailbox(dev, GFP_KERNEL);
+	if (IS_ERR(mailbox)) {
+		err = PTR_ERR(mailbox);
+		goto err_out_free_eq;
+	}
+
+	eq_context = mailbox->buf;
+	memset(eq_context, 0, sizeof *eq_context);
+	eq_context->flags   = cpu_to_be32(HGRNIC_EQ_STATUS_OK  |
+	                                  HGRNIC_EQ_OWNER_HW   |
+	                                  HGRNIC_EQ_STATE_ARMED |
+	                                  HGRNIC_EQ_FLAG_TR);
+	eq_context->logsize = cpu_to_be32((ffs(eq->nent) - 1) << 24);
+	eq_context->intr    = intr;
+	eq_context->pd      = cpu_to_be32(dev->driver_pd.pd_num);
+	eq_context->lkey    = cpu_to_be32(eq->mr.ibmr.lkey);
+
+	err = hgrnic_SW2HW_EQ(dev, mailbox, eq->eqn);
+	hgrnic_free_mailbox(dev, mailbox);
+	if (err) {
+		hgrnic_warn(dev, "SW2HW_EQ returned %d\n", err);
+		goto err_out_free_eq;
+	}
+
+	eq->msi_x_entry = intr;
+
+	hgrnic_dbg(dev, "Allocated EQ %d with %d entries\n",
+	           eq->eqn, eq->nent);
+
+	return 0;
+
+err_out_free_eq:
+	hgrnic_free(&dev->eq_table.alloc, eq->eqn);
+
+err_out_free_buf:
+	hgrnic_buf_free(dev, eq->nent * HGRNIC_EQ_ENTRY_SIZE,
+	                &eq->queue, eq->is_direct, &eq->mr);
+
+	return err;
+}
+
+static void hgrnic_free_eq (struct hgrnic_dev *dev,
+                            struct hgrnic_eq *eq)
+{
+	int err;
+
+	err = hgrnic_HW2SW_EQ(dev, eq->eqn);
+	if (err)
+		hgrnic_warn(dev, "HW2SW_EQ returned %d\n", err);
+
+	hgrnic_free(&dev->eq_table.alloc, eq->eqn);
+	hgrnic_buf_free(dev, eq->nent * HGRNIC_EQ_ENTRY_SIZE,
+	                &eq->queue, eq->is_direct, &eq->mr);
+}
+
+static void hgrnic_free_irqs (struct hgrnic_dev *dev)
+{
+	int i;
+
+	for (i = 0; i < HGRNIC_NUM_EQ; ++i)
+		if (dev->eq_table.eq[i].have_irq) {
+			irq_set_affinity_hint(dev->eq_table.eq[i].msi_x_vector, NULL);
+			free_irq(dev->eq_table.eq[i].msi_x_vector,
+			         dev->eq_table.eq + i);
+			dev->eq_table.eq[i].have_irq = 0;
+		}
+}
+
+/**
+ * @note Create the async EQ and one completion EQ per completion
+ * vector, and hook them to MSI-X vectors. Completion vector i is
+ * hinted to the i-th CPU local to the device, so CQs created with
+ * different comp_vector are served on different cores.
+ * Command EQ is not used, HCR is polled.
+ */
+int hgrnic_init_eq_table (struct hgrnic_dev *dev)
+{
+	int num_eqs;
+	int err;
+	int i;
+
+	err = hgrnic_alloc_init(&dev->eq_table.alloc,
+	                        dev->limits.num_eqs,
+	                        dev->limits.num_eqs - 1);
+	if (err)
+		return err;
+
+	for (i = 0; i < dev->limits.reserved_eqs; ++i)
+		hgrnic_alloc(&dev->eq_table.alloc);
+
+	if (!(dev->hgrnic_flags & HGRNIC_FLAG_MSI_X)) {
+		err = -ENODEV;
+		goto err_out_free;
+	}
+
+	/* Async EQ and completion EQs share the EQNs left by hardware. */
+	dev->eq_table.num_comp_eqs = min(dev->eq_table.num_comp_eqs,
+	                                 dev->limits.num_eqs -
+	                                 dev->limits.reserved_eqs - 1);
+	if (dev->eq_table.num_comp_eqs < 1) {
+		err = -ENOSPC;
+		goto err_out_free;
+	}
+	num_eqs = HGRNIC_EQ_COMP + dev->eq_table.num_comp_eqs;
+
+	err = hgrnic_create_eq(dev, HGRNIC_NUM_ASYNC_EQE + HGRNIC_NUM_SPARE_EQE,
+	                       HGRNIC_EQ_ASYNC, &dev->eq_table.eq[HGRNIC_EQ_ASYNC]);
+	if (err)
+		goto err_out_free;
+
+	/* Any CQ may be bound to any vector, size each EQ for all CQs. */
+	for (i = HGRNIC_EQ_COMP; i < num_eqs; ++i) {
+		err = hgrnic_create_eq(dev, dev->limits.num_cqs + HGRNIC_NUM_SPARE_EQE,
+		                       i, &dev->eq_table.eq[i]);
+		if (err)
+			goto err_out_comp;
+	}
+
+	for (i = HGRNIC_EQ_ASYNC; i < num_eqs; ++i) {
+		struct hgrnic_eq *eq = &dev->eq_table.eq[i];
+
+		if (i == HGRNIC_EQ_ASYNC)
+			snprintf(eq->irq_name, IB_DEVICE_NAME_MAX, "%s-async",
+			         pci_name(dev->pdev));
+		else
+			snprintf(eq->irq_name, IB_DEVICE_NAME_MAX, "%s-comp%d",
+			         pci_name(dev->pdev), i - HGRNIC_EQ_COMP);
+		eq->msi_x_vector = pci_irq_vector(dev->pdev, eq->msi_x_entry);
+		err = request_irq(eq->msi_x_vector, hgrnic_msi_x_interrupt, 0,
+		                  eq->irq_name, eq);
+		if (err)
+			goto err_out_irq;
+		eq->have_irq = 1;
+
+		if (i >= HGRNIC_EQ_COMP)
+			irq_set_affinity_hint(eq->msi_x_vector,
+			        cpumask_of(cpumask_local_spread(i - HGRNIC_EQ_COMP,
+			                                        dev_to_node(&dev->pdev->dev))));
+	}
+
+	err = hgrnic_MAP_EQ(dev, hgrnic_async_event_mask(dev),
+	                    0, dev->eq_table.eq[HGRNIC_EQ_ASYNC].eqn);
+	if (err)
+		hgrnic_warn(dev, "MAP_EQ for async EQ %d failed (%d)\n",
+		            dev->eq_table.eq[HGRNIC_EQ_ASYNC].eqn, err);
+
+	for (i = HGRNIC_EQ_ASYNC; i < num_eqs; ++i)
+		hgrnic_eq_arm(dev, &dev->eq_table.eq[i]);
+
+	return 0;
+
+err_out_irq:
+	hgrnic_free_irqs(dev);
+	i = num_eqs;
+
+err_out_comp:
+	while (--i >= HGRNIC_EQ_COMP)
+		hgrnic_free_eq(dev, &dev->eq_table.eq[i]);
+	hgrnic_free_eq(dev, &dev->eq_table.eq[HGRNIC_EQ_ASYNC]);
+
+err_out_free:
+	hgrnic_alloc_cleanup(&dev->eq_table.alloc);
+	return err;
+}
+
+void hgrnic_cleanup_eq_table (struct hgrnic_dev *dev)
+{
+	int i;
+
+	hgrnic_free_irqs(dev);
+
+	hgrnic_MAP_EQ(dev, hgrnic_async_event_mask(dev),
+	              1, dev->eq_table.eq[HGRNIC_EQ_ASYNC].eqn);
+
+	for (i = HGRNIC_EQ_ASYNC; i < HGRNIC_EQ_COMP + dev->eq_table.num_comp_eqs; ++i)
+		hgrnic_free_eq(dev, &dev->eq_table.eq[i]);
+
+	hgrnic_alloc_cleanup(&dev->eq_table.alloc);
+}
@@ -14,6 +14,7 @@
 #include <linux/module.h>
 #include <linux/moduleparam.h>
 #include <linux/string.h>
+#include <linux/seq_file.h>
 #include <asm/page.h>
 
 #include "hgrnic_dev.h"
@@ -26,6 +27,7 @@ enum {
     HGRNIC_RES_EQ,
     HGRNIC_RES_MPT,
     HGRNIC_RES_MTT,
+    HGRNIC_RES_SRQ,
     HGRNIC_RES_NUM
 };
 
@@ -35,14 +37,28 @@ enum {
 };
 
 /*
- * We allocate in as big chunks as we can, up to a maximum of 256 KB
- * per chunk.
+ * We allocate in as big chunks as we can, up to a maximum of 1 MB
+ * per chunk. 1 MB is also the largest block one MAP_ICM entry can
+ * describe (MAP_ICM_MAX_PAGE_NUM_LOG), so a fully populated chunk
+ * is mapped with a single mailbox entry.
  */
 enum {
-    HGRNIC_ICM_ALLOC_SIZE   = 1 << 18,
-    HGRNIC_TABLE_CHUNK_SIZE = 1 << 18
+    HGRNIC_ICM_ALLOC_SIZE   = 1 << 20,
+    HGRNIC_TABLE_CHUNK_SIZE = 1 << 20
 };
 
+/*
+ * Size of chunk i of the table. The last chunk is cut at the end
+ * of the table, so that it does not cover ICM space of the next
+ * resource.
+ */
+static inline int hgrnic_table_chunk_size (struct hgrnic_icm_table *table, int i)
+{
+    return min_t(u64, HGRNIC_TABLE_CHUNK_SIZE,
+                 (u64) table->num_obj * table->obj_size -
+                 (u64) i * HGRNIC_TABLE_CHUNK_SIZE);
+}
+
 static void hgrnic_free_icm_pages (struct hgrnic_dev *dev, 
                                    struct hgrnic_icm_chunk *chunk)
 {
@@ -91,14 +107,18 @@ void hgrnic_free_icm (struct hgrnic_dev *dev,
 }
 
 static int hgrnic_alloc_icm_pages (struct scatterlist *mem, 
-        int order, gfp_t gfp_mask) {
+        int order, gfp_t gfp_mask, int node) {
     struct page *page;
 
     /*
      * Use __GFP_ZERO because buggy firmware assumes ICM pages are
      * cleared, and subtle failures are seen if they aren't.
+     * Don't reclaim/compact hard for large orders, falling back to
+     * a smaller order is much cheaper.
      */
-    page = alloc_pages(gfp_mask | __GFP_ZERO, order);
+    if (order > PAGE_ALLOC_COSTLY_ORDER)
+        gfp_mask |= __GFP_NORETRY;
+    page = alloc_pages_node(node, gfp_mask | __GFP_ZERO, order);
     if (!page) {
         return -ENOMEM;
     }
@@ -114,7 +134,11 @@ static int hgrnic_alloc_icm_pages (struct scatterlist *mem,
  */
 static int hgrnic_alloc_icm_coherent (struct device *dev, 
         struct scatterlist *mem, int order, gfp_t gfp_mask) {
-    void *buf = dma_alloc_coherent(dev, PAGE_SIZE << order, &sg_dma_address(mem),
+    void *buf;
+
+    if (order > PAGE_ALLOC_COSTLY_ORDER)
+        gfp_mask |= __GFP_NORETRY;
+    buf = dma_alloc_coherent(dev, PAGE_SIZE << order, &sg_dma_address(mem),
                        gfp_mask);
     if (!buf) {
         return -ENOMEM;
@@ -138,13 +162,16 @@ struct hgrnic_icm *hgrnic_alloc_icm (struct hgrnic_dev *dev, int npages,
         gfp_t gfp_mask, int coherent) {
     struct hgrnic_icm *icm;
     struct hgrnic_icm_chunk *chunk = NULL;
+    /* Keep ICM, which HCA reads on every cache miss, next to it. */
+    int node = dev_to_node(&dev->pdev->dev);
     int cur_order;
     int ret;
 
     /* We use sg_set_buf for coherent allocs, which assumes low memory */
     BUG_ON(coherent && (gfp_mask & __GFP_HIGHMEM));
 
-    icm = kmalloc(sizeof *icm, gfp_mask & ~(__GFP_HIGHMEM | __GFP_NOWARN));
+    icm = kmalloc_node(sizeof *icm,
+                       gfp_mask & ~(__GFP_HIGHMEM | __GFP_NOWARN), node);
     if (!icm)
         return icm;
 
@@ -155,8 +182,8 @@ struct hgrnic_icm *hgrnic_alloc_icm (struct hgrnic_dev *dev, int npages,
 
     while (npages > 0) {
         if (!chunk) {
-            chunk = kmalloc(sizeof *chunk,
-                    gfp_mask & ~(__GFP_HIGHMEM | __GFP_NOWARN));
+            chunk = kmalloc_node(sizeof *chunk,
+                    gfp_mask & ~(__GFP_HIGHMEM | __GFP_NOWARN), node);
             if (!chunk)
                 goto fail;
 
@@ -175,7 +202,7 @@ struct hgrnic_icm *hgrnic_alloc_icm (struct hgrnic_dev *dev, int npages,
                     cur_order, gfp_mask);
         } else {
             ret = hgrnic_alloc_icm_pages(&chunk->mem[chunk->npages],
-                    cur_order, gfp_mask);
+                    cur_order, gfp_mask, node);
         }
 
         if (!ret) {
@@ -246,7 +273,7 @@ int hgrnic_reg_icm (struct hgrnic_dev *dev,
     }
 
     /* Get ICM memory from kernel */
-    table->icm[i] = hgrnic_alloc_icm(dev, HGRNIC_TABLE_CHUNK_SIZE >> PAGE_SHIFT,
+    table->icm[i] = hgrnic_alloc_icm(dev, hgrnic_table_chunk_size(table, i) >> PAGE_SHIFT,
                     (table->lowmem ? GFP_KERNEL : GFP_HIGHUSER) |
                     __GFP_NOWARN, table->coherent);
     if (!table->icm[i]) {
@@ -285,7 +312,7 @@ void hgrnic_unreg_icm (struct hgrnic_dev *dev,
 
     if (--table->icm[i]->refcount == 0) {
         hgrnic_UNMAP_ICM(dev, table->virt + i * HGRNIC_TABLE_CHUNK_SIZE,
-                HGRNIC_TABLE_CHUNK_SIZE / HGRNIC_ICM_PAGE_SIZE, type_sel);
+                hgrnic_table_chunk_size(table, i) / HGRNIC_ICM_PAGE_SIZE, type_sel);
         hgrnic_free_icm(dev, table->icm[i], table->coherent);
         table->icm[i] = NULL;
     }
@@ -294,6 +321,36 @@ void hgrnic_unreg_icm (struct hgrnic_dev *dev,
 }
 
 
+/**
+ * @note Print the mapped chunks of an ICM table and how many objects
+ * hold each of them, for debugfs.
+ */
+void hgrnic_icm_table_show (struct hgrnic_icm_table *table,
+                            const char *name, struct seq_file *s)
+{
+    u64 bytes = 0;
+    int i, mapped = 0;
+
+    mutex_lock(&table->mutex);
+
+    for (i = 0; i < table->num_icm; ++i) {
+        if (!table->icm[i])
+            continue;
+        ++mapped;
+        bytes += hgrnic_table_chunk_size(table, i);
+    }
+
+    seq_printf(s, "%s: virt 0x%llx, %d x %d B objs, %d/%d chunks, %llu KB\n",
+               name, table->virt, table->num_obj, table->obj_size,
+               mapped, table->num_icm, bytes >> 10);
+    for (i = 0; i < table->num_icm; ++i)
+        if (table->icm[i])
+            seq_printf(s, "\tchunk %4d refcount %d\n",
+                       i, table->icm[i]->refcount);
+
+    mutex_unlock(&table->mutex);
+}
+
 /**
  * @note This function does the following things: 
  * 1. Allocate a range of ICM space, and
@@ -389,7 +446,6 @@ struct hgrnic_icm_table *hgrnic_alloc_icm_table (struct hgrnic_dev *dev,
 		if (!table->icm[i]) {
             goto err;
         }
-        printk(KERN_INFO PFX "Start hgrnic_MAP_ICM.\n");
 		if (hgrnic_MAP_ICM(dev, table->icm[i], type_sel, 
 				    virt + i * HGRNIC_TABLE_CHUNK_SIZE)) {
 			hgrnic_free_icm(dev, table->icm[i], table->coherent);
@@ -411,7 +467,7 @@ err:
 	for (i = 0; i < num_icm; ++i) {
         if (table->icm[i]) {
 			hgrnic_UNMAP_ICM(dev, virt + i * HGRNIC_TABLE_CHUNK_SIZE,
-					HGRNIC_TABLE_CHUNK_SIZE / HGRNIC_ICM_PAGE_SIZE, type_sel);
+					hgrnic_table_chunk_size(table, i) / HGRNIC_ICM_PAGE_SIZE, type_sel);
 			hgrnic_free_icm(dev, table->icm[i], table->coherent);
 		}
     }
@@ -429,7 +485,7 @@ void hgrnic_free_icm_table (struct hgrnic_dev *dev,
         if (table->icm[i]) {
 			hgrnic_UNMAP_ICM(dev,
 					table->virt + i * HGRNIC_TABLE_CHUNK_SIZE,
-					HGRNIC_TABLE_CHUNK_SIZE / HGRNIC_ICM_PAGE_SIZE, type_sel);
+					hgrnic_table_chunk_size(table, i) / HGRNIC_ICM_PAGE_SIZE, type_sel);
 			hgrnic_free_icm(dev, table->icm[i], table->coherent);
 		}
     }
@@ -465,18 +521,23 @@ s64 hgrnic_make_profile (struct hgrnic_dev *dev,
 	profile[HGRNIC_RES_EQ].size   = dev_lim->eqc_entry_sz;
 	profile[HGRNIC_RES_MPT].size  = dev_lim->mpt_entry_sz;
 	profile[HGRNIC_RES_MTT].size  = dev_lim->max_mtt_seg ;
+	profile[HGRNIC_RES_SRQ].size  = dev_lim->srqc_entry_sz;
 	
 	profile[HGRNIC_RES_QP].num    = request->num_qp;
 	profile[HGRNIC_RES_CQ].num    = request->num_cq;
 	profile[HGRNIC_RES_EQ].num    = HGRNIC_NUM_EQS;
 	profile[HGRNIC_RES_MPT].num   = request->num_mpt;
 	profile[HGRNIC_RES_MTT].num   = request->num_mtt;
+	profile[HGRNIC_RES_SRQ].num   = dev_lim->flags & DEV_LIM_FLAG_SRQ ?
+	                                min(request->num_srq, dev_lim->max_srqs) : 0;
 	
 	for (i = 0; i < HGRNIC_RES_NUM; ++i) {
 		profile[i].type     = i;
 		profile[i].log_num  = max(ffs(profile[i].num) - 1, 0);
 		profile[i].size    *= profile[i].num;
-		profile[i].size = max(profile[i].size, (u64) PAGE_SIZE);
+		/* A resource the HCA lacks (num 0) takes no ICM. */
+		if (profile[i].num)
+			profile[i].size = max(profile[i].size, (u64) PAGE_SIZE);
 	}
     
     mem_base  = 0;
@@ -509,7 +570,7 @@ s64 hgrnic_make_profile (struct hgrnic_dev *dev,
 		}
 
 		if (profile[i].size)
-			printk(KERN_INFO PFX "profile[%2d]--%2d/%2d @ 0x%16llx "
+			hgrnic_dbg(dev, "profile[%2d]--%2d/%2d @ 0x%16llx "
 				  "(size 0x%8llx)\n",
 				  i, profile[i].type, profile[i].log_num,
 				  (unsigned long long) profile[i].start,
@@ -547,6 +608,11 @@ s64 hgrnic_make_profile (struct hgrnic_dev *dev,
 			dev->mr_table.mtt_base   = profile[i].start;
 			init_hca->mtt_base       = profile[i].start;
 			break;
+		case HGRNIC_RES_SRQ:
+			dev->limits.num_srqs   = profile[i].num;
+			init_hca->srqc_base    = profile[i].start;
+			init_hca->log_num_srqs = profile[i].log_num;
+			break;
 		default:
 			break;
 		}
@@ -29,6 +29,7 @@ struct hgrnic_profile {
     int num_cq;
     int num_mpt;
     int num_mtt;
+    int num_srq;
 };
 
 struct hgrnic_icm_chunk {
@@ -87,6 +88,9 @@ int hgrnic_reg_icm_range(struct hgrnic_dev *dev,
         struct hgrnic_icm_table *table, int start, int end, u8 type_sel);
 void hgrnic_unreg_icm_range(struct hgrnic_dev *dev, 
         struct hgrnic_icm_table *table, int start, int end, u8 type_sel);
+struct seq_file;
+void hgrnic_icm_table_show(struct hgrnic_icm_table *table,
+        const char *name, struct seq_file *s);
 
 static inline void hgrnic_icm_first (struct hgrnic_icm *icm,
 				   struct hgrnic_icm_iter *iter) {
@@ -13,6 +13,9 @@
 // --------------- BAR 0-1 ---------------//
 #define HGRNIC_HCR_BASE         0x00000
 #define HGRNIC_HCR_SIZE         0x01000
+#define HGRNIC_CLOCK_LO         0x06000 // free-running HCA clock, alone in its page
+#define HGRNIC_CLOCK_HI         0x06004 // not latched, read HI, LO, HI
+#define HGRNIC_CLOCK_PAGE_SIZE  0x01000
 #define HGRNIC_EN_REG_BASE      0x01000
 #define HGRNIC_EN_REG_SIZE      0x00400
 #define HGRNIC_MSIX_TAB_BASE    0x20000
@@ -23,6 +26,8 @@
 
 // --------------- BAR 2-3 ---------------//
 #define HGRNIC_SEND_DOORBELL    0x00 // Temporary set as 0.
+#define HGRNIC_CQ_DOORBELL      0x10 // CQ arm, CQN in the low bits (ARM_CQ_BASE)
+#define HGRNIC_EQ_DOORBELL      0x20 // EQ arm, EQN in the low bits (ARM_EQ_BASE)
 /* --------RDMA BAR Space Interface{end}------- */
 
 #endif /* __HGRNIC_IFACE_H__ */
@@ -11,6 +11,8 @@
 #include <linux/pci.h>
 #include <linux/interrupt.h>
 #include <linux/gfp.h>
+#include <linux/async.h>
+#include <linux/ktime.h>
 
 // Used to delay a given time to wait the finishes of data transmission
 #include <linux/delay.h>
@@ -30,6 +32,21 @@ static int config_rdma = 1;
 module_param(config_rdma, int, 0444);
 MODULE_PARM_DESC(config_rdma, "Active RDMA function if non-zero.");
 
+static int msi_x = 1;
+module_param(msi_x, int, 0444);
+MODULE_PARM_DESC(msi_x, "attempt to use MSI-X if nonzero");
+
+static int parallel_init = 1;
+module_param(parallel_init, int, 0444);
+MODULE_PARM_DESC(parallel_init, "set up ICM tables concurrently if nonzero");
+
+static int cq_dim = 1;
+module_param(cq_dim, int, 0444);
+MODULE_PARM_DESC(cq_dim, "adapt CQ event moderation with rdma_dim if nonzero and supported");
+
+/* ICM table setups of all devices being probed. */
+static ASYNC_DOMAIN_EXCLUSIVE(hgrnic_init_domain);
+
 // Protect multi devices from executing 
 // the code at the same time.
 DEFINE_MUTEX(hgrnic_device_mutex);
@@ -37,6 +54,7 @@ DEFINE_MUTEX(hgrnic_device_mutex);
 #define HGRNIC_DEFAULT_NUM_QP            (1 << 16)
 #define HGRNIC_DEFAULT_RDB_PER_QP        (1 << 2)
 #define HGRNIC_DEFAULT_NUM_CQ            (1 << 16)
+#define HGRNIC_DEFAULT_NUM_SRQ           (1 << 10)
 #define HGRNIC_DEFAULT_NUM_MCG           (1 << 13)
 #define HGRNIC_DEFAULT_NUM_MPT           (1 << 17)
 #define HGRNIC_DEFAULT_NUM_MTT           (1 << 20)
@@ -47,6 +65,7 @@ DEFINE_MUTEX(hgrnic_device_mutex);
 static struct hgrnic_profile hca_profile = {
     .num_qp             = HGRNIC_DEFAULT_NUM_QP,
     .num_cq             = HGRNIC_DEFAULT_NUM_CQ,
+    .num_srq            = HGRNIC_DEFAULT_NUM_SRQ,
     .num_mpt            = HGRNIC_DEFAULT_NUM_MPT,
     .num_mtt            = HGRNIC_DEFAULT_NUM_MTT,
 };
@@ -57,6 +76,9 @@ MODULE_PARM_DESC(num_qp, "maximum number of QPs per HCA");
 module_param_named(num_cq, hca_profile.num_cq, int, 0444);
 MODULE_PARM_DESC(num_cq, "maximum number of CQs per HCA");
 
+module_param_named(num_srq, hca_profile.num_srq, int, 0444);
+MODULE_PARM_DESC(num_srq, "maximum number of SRQs per HCA, if the HCA has SRQs");
+
 module_param_named(num_mpt, hca_profile.num_mpt, int, 0444);
 MODULE_PARM_DESC(num_mpt,
 		"maximum number of memory protection table entries per HCA");
@@ -93,6 +115,32 @@ static int hgrnic_tune_pci (struct hgrnic_dev *hgdev) {
 	return 0;
 }
 
+/**
+ * @note Record the time elapsed since start as bring-up phase name.
+ * May be called concurrently by the ICM table setups.
+ */
+static void hgrnic_record_phase (struct hgrnic_dev *hgdev, const char *name,
+                                 ktime_t start) {
+    struct hgrnic_init_timing *t = &hgdev->init_timing;
+    int i = atomic_inc_return(&t->num) - 1;
+
+    if (i >= HGRNIC_MAX_INIT_PHASES)
+        return;
+
+    t->phase[i].name = name;
+    t->phase[i].ns   = ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static void hgrnic_report_phases (struct hgrnic_dev *hgdev) {
+    struct hgrnic_init_timing *t = &hgdev->init_timing;
+    int i, num;
+
+    num = min_t(int, atomic_read(&t->num), HGRNIC_MAX_INIT_PHASES);
+    for (i = 0; i < num; ++i)
+        hgrnic_info(hgdev, "bring-up: %-16s %8llu us\n", t->phase[i].name,
+                    div_u64(t->phase[i].ns, NSEC_PER_USEC));
+}
+
 static int hgrnic_dev_lim (struct hgrnic_dev *hgdev, struct hgrnic_dev_lim *dev_lim) {
 	int err;
 
@@ -119,6 +167,7 @@ static int hgrnic_dev_lim (struct hgrnic_dev *hgdev, struct hgrnic_dev_lim *dev_
 
     hgdev->limits.reserved_qps       = dev_lim->reserved_qps;
 	hgdev->limits.reserved_cqs       = dev_lim->reserved_cqs;
+	hgdev->limits.reserved_srqs      = dev_lim->reserved_srqs;
 	hgdev->limits.reserved_eqs       = dev_lim->reserved_eqs;
 	hgdev->limits.reserved_mtts      = dev_lim->reserved_mtts;
 	hgdev->limits.reserved_mrws      = 0;
@@ -149,6 +198,8 @@ static int hgrnic_dev_lim (struct hgrnic_dev *hgdev, struct hgrnic_dev_lim *dev_
 	
     hgdev->limits.port_width_cap     = dev_lim->max_port_width;
 	hgdev->limits.page_size_cap      = ~(u32) (dev_lim->min_page_sz - 1);
+    hgdev->limits.flags              = dev_lim->flags;
+    hgdev->hca_clock_khz             = dev_lim->hca_clock_khz;
 
     hgdev->limits.num_uars   = 0x1000;
 
@@ -156,76 +207,104 @@ static int hgrnic_dev_lim (struct hgrnic_dev *hgdev, struct hgrnic_dev_lim *dev_
 }
 
 
+/**
+ * @note Setup of one ICM table. The tables are independent of each
+ * other, so their (zeroed, DMA mapped) memory is allocated in
+ * parallel; only the MAP_ICM commands serialize on the HCR.
+ */
+struct hgrnic_icm_job {
+    struct hgrnic_dev        *hgdev;
+    struct hgrnic_icm_table **table;
+    const char               *name;     /* bring-up phase */
+    const char               *res;      /* for error messages */
+    u64                       virt;
+    int                       obj_size;
+    int                       nobj;
+    int                       reserved;
+    int                       use_lowmem;
+    int                       use_coherent;
+    u8                        type_sel;
+};
+
+static void hgrnic_icm_job_run (void *data, async_cookie_t cookie) {
+    struct hgrnic_icm_job *job = data;
+    ktime_t start = ktime_get();
+
+    *job->table = hgrnic_alloc_icm_table(job->hgdev, job->virt,
+                job->obj_size, job->nobj, job->reserved,
+                job->use_lowmem, job->use_coherent, job->type_sel);
+    hgrnic_record_phase(job->hgdev, job->name, start);
+}
+
 static int hgrnic_init_icm (struct hgrnic_dev *hgdev, struct hgrnic_dev_lim *dev_lim,
 		struct hgrnic_init_hca_param *init_hca) {
-	int err;
+	struct hgrnic_icm_job jobs[] = {
+		{ hgdev, &hgdev->qp_table.qp_table, "map_qp_icm", "QP",
+		  init_hca->qpc_base, dev_lim->qpc_entry_sz,
+		  hgdev->limits.num_qps, hgdev->limits.reserved_qps, 0, 0, CXT_REGION },
+		{ hgdev, &hgdev->cq_table.table, "map_cq_icm", "CQ",
+		  init_hca->cqc_base, dev_lim->cqc_entry_sz,
+		  hgdev->limits.num_cqs, hgdev->limits.reserved_cqs, 0, 0, CXT_REGION },
+		{ hgdev, &hgdev->mr_table.mtt_table, "map_mtt_icm", "MTT",
+		  init_hca->mtt_base, hgdev->limits.mtt_seg_size,
+		  hgdev->limits.num_mtt_segs, 1, 1, 0, TPT_REGION },
+		{ hgdev, &hgdev->mr_table.mpt_table, "map_mpt_icm", "MPT",
+		  init_hca->mpt_base, dev_lim->mpt_entry_sz,
+		  hgdev->limits.num_mpts, 1, 1, 1, TPT_REGION },
+		/* Last: left out if the HCA has no SRQs. */
+		{ hgdev, &hgdev->srq_table.table, "map_srq_icm", "SRQ",
+		  init_hca->srqc_base, dev_lim->srqc_entry_sz,
+		  hgdev->limits.num_srqs, hgdev->limits.reserved_srqs, 0, 0, CXT_REGION },
+	};
+	int njobs = ARRAY_SIZE(jobs) - !hgdev->limits.num_srqs;
+	ktime_t start;
+	int err, eq_err, i;
+
+	hgdev->limits.reserved_mtts = 0;
+
+	for (i = 0; i < njobs; ++i) {
+		if (parallel_init)
+			async_schedule_domain(hgrnic_icm_job_run, &jobs[i],
+					      &hgrnic_init_domain);
+		else
+			hgrnic_icm_job_run(&jobs[i], 0);
+	}
 
-    printk(KERN_INFO PFX "Start map_eq_icm.\n");
-	err = hgrnic_map_eq_icm(hgdev, init_hca->eqc_base);
-	if (err) {
+	start = ktime_get();
+	err = eq_err = hgrnic_map_eq_icm(hgdev, init_hca->eqc_base);
+	hgrnic_record_phase(hgdev, "map_eq_icm", start);
+	if (eq_err)
 		hgrnic_err(hgdev, "Failed to map EQ context memory, aborting.\n");
-		return err;
-	}
 
-    printk(KERN_INFO PFX "Start map_qp_icm. resved_qps: %d\n", hgdev->limits.reserved_qps);
-    hgdev->qp_table.qp_table = hgrnic_alloc_icm_table(hgdev, init_hca->qpc_base,
-                dev_lim->qpc_entry_sz, hgdev->limits.num_qps, 
-                hgdev->limits.reserved_qps, 0, 0, CXT_REGION);
-	if (!hgdev->qp_table.qp_table) {
-		hgrnic_err(hgdev, "Failed to map QP context memory, aborting.\n");
-		err = -ENOMEM;
-		goto err_unmap_eq;
-	}
+	async_synchronize_full_domain(&hgrnic_init_domain);
 
-    printk(KERN_INFO PFX "Start map_cq_icm. resved_cqs: %d\n", hgdev->limits.reserved_cqs);
-	hgdev->cq_table.table = hgrnic_alloc_icm_table(hgdev, init_hca->cqc_base,
-                dev_lim->cqc_entry_sz, hgdev->limits.num_cqs,
-                hgdev->limits.reserved_cqs, 0, 0, CXT_REGION);
-	if (!hgdev->cq_table.table) {
-		hgrnic_err(hgdev, "Failed to map CQ context memory, aborting.\n");
-		err = -ENOMEM;
-		goto err_unmap_qp;
+	for (i = 0; i < njobs; ++i) {
+		if (!*jobs[i].table) {
+			hgrnic_err(hgdev, "Failed to map %s context memory, aborting.\n",
+				   jobs[i].res);
+			err = -ENOMEM;
+		}
 	}
 
-	printk(KERN_INFO PFX "Start map_mtt_icm. resved_mtts: %d\n", hgdev->limits.reserved_mtts);
-    hgdev->limits.reserved_mtts = 0;
-	hgdev->mr_table.mtt_table = hgrnic_alloc_icm_table(hgdev, init_hca->mtt_base,
-                hgdev->limits.mtt_seg_size, hgdev->limits.num_mtt_segs,
-                1, 1, 0, TPT_REGION);
-	if (!hgdev->mr_table.mtt_table) {
-		hgrnic_err(hgdev, "Failed to map MTT context memory, aborting.\n");
-		err = -ENOMEM;
-		goto err_unmap_cq;
-	}
+	if (!err)
+		return 0;
 
-    printk(KERN_INFO PFX "Start map_mpt_icm. resved_mpt: %d\n", hgdev->limits.reserved_mrws);
-	hgdev->mr_table.mpt_table = hgrnic_alloc_icm_table(hgdev, init_hca->mpt_base,
-                dev_lim->mpt_entry_sz, hgdev->limits.num_mpts,
-                1, 1, 1, TPT_REGION);
-	if (!hgdev->mr_table.mpt_table) {
-		hgrnic_err(hgdev, "Failed to map MPT context memory, aborting.\n");
-		err = -ENOMEM;
-		goto err_unmap_mtt;
+	for (i = 0; i < njobs; ++i) {
+		if (*jobs[i].table) {
+			hgrnic_free_icm_table(hgdev, *jobs[i].table, jobs[i].type_sel);
+			*jobs[i].table = NULL;
+		}
 	}
+	if (!eq_err)
+		hgrnic_unmap_eq_icm(hgdev);
 
-	return 0;
-
-err_unmap_mtt:
-	hgrnic_free_icm_table(hgdev, hgdev->mr_table.mtt_table, TPT_REGION);
-
-err_unmap_cq:
-    hgrnic_free_icm_table(hgdev, hgdev->cq_table.table, CXT_REGION);
-
-err_unmap_qp:
-	hgrnic_free_icm_table(hgdev, hgdev->qp_table.qp_table, CXT_REGION);
-
-err_unmap_eq:
-	hgrnic_unmap_eq_icm(hgdev);
 	return err;
 }
 
 static void hgrnic_free_icms (struct hgrnic_dev *hgdev) {
 
+	if (hgdev->srq_table.table)
+		hgrnic_free_icm_table(hgdev, hgdev->srq_table.table, CXT_REGION);
 	hgrnic_free_icm_table(hgdev, hgdev->mr_table.mpt_table, TPT_REGION);
 	hgrnic_free_icm_table(hgdev, hgdev->mr_table.mtt_table, TPT_REGION);
 	hgrnic_free_icm_table(hgdev, hgdev->cq_table.table, CXT_REGION);
@@ -245,18 +324,19 @@ static int hgrnic_init_hca (struct hgrnic_dev *hgdev) {
 	struct hgrnic_dev_lim        dev_lim;
 	struct hgrnic_init_hca_param init_hca;
 	s64 icm_size;
+	ktime_t start;
 
-    printk(KERN_INFO PFX "Start QUERY ADAPTER.\n");
-    
-
+    start = ktime_get();
     err = hgrnic_QUERY_ADAPTER(hgdev, &hgdev->board_id);
+    hgrnic_record_phase(hgdev, "query_adapter", start);
 	if (err) {
 		hgrnic_err(hgdev, "QUERY_ADAPTER command returned %d, aborting.\n", err);
 		return err;
 	}
 
-    printk(KERN_INFO PFX "Start dev lim.\n");
+    start = ktime_get();
 	err = hgrnic_dev_lim(hgdev, &dev_lim);
+    hgrnic_record_phase(hgdev, "query_dev_lim", start);
 	if (err) {
 		hgrnic_err(hgdev, "QUERY_DEV_LIM returned %d, aborting.\n", err);
 		return err;
@@ -267,15 +347,17 @@ static int hgrnic_init_hca (struct hgrnic_dev *hgdev) {
 		err = icm_size;
 		return err;
 	}
-    printk(KERN_INFO PFX "Start Init_HCA.\n");
+    start = ktime_get();
     err = hgrnic_INIT_HCA(hgdev, &init_hca);
+    hgrnic_record_phase(hgdev, "init_hca", start);
 	if (err) {
 		hgrnic_err(hgdev, "INIT_HCA command returned %d, aborting.\n", err);
 		return err;
 	}
 
-    printk(KERN_INFO PFX "Start init_icm.\n");
+    start = ktime_get();
     err = hgrnic_init_icm(hgdev, &dev_lim, &init_hca);
+    hgrnic_record_phase(hgdev, "init_icm", start);
 	if (err) {
         goto err_close;
     }
@@ -288,6 +370,7 @@ err_close:
 }
 
 static int hgrnic_setup_hca (struct hgrnic_dev *dev) {
+	ktime_t start;
 	int err;
 
 	HGRNIC_INIT_DOORBELL_LOCK(&dev->doorbell_lock);
@@ -295,14 +378,13 @@ static int hgrnic_setup_hca (struct hgrnic_dev *dev) {
     /**
      * Initialize UAR Space (PIO BAR2 space) allocator.
      */
-    printk(KERN_INFO PFX "Start hgrnic_init_uar_table.\n");
+    start = ktime_get();
 	err = hgrnic_init_uar_table(dev);
 	if (err) {
 		hgrnic_err(dev, "Failed to initialize "
 			  "user access region table, aborting.\n");
 		return err;
 	}
-    printk(KERN_INFO PFX "Start hgrnic_uar_alloc.\n");
 	err = hgrnic_uar_alloc(dev, &dev->driver_uar);
 	if (err) {
 		hgrnic_err(dev, "Failed to allocate driver access region, "
@@ -311,7 +393,6 @@ static int hgrnic_setup_hca (struct hgrnic_dev *dev) {
 	}
 
     // Get Kernel Access Region in BAR2.
-    printk(KERN_INFO PFX "Start ioremap.\n");
 	dev->kar = ioremap((phys_addr_t) dev->driver_uar.pfn << PAGE_SHIFT, PAGE_SIZE);
 	if (!dev->kar) {
 		hgrnic_err(dev, "Couldn't map kernel access region, "
@@ -320,7 +401,6 @@ static int hgrnic_setup_hca (struct hgrnic_dev *dev) {
 		goto err_uar_free;
 	}
 
-    printk(KERN_INFO PFX "Start hgrnic_init_pd_table.\n");
 	err = hgrnic_init_pd_table(dev);
 	if (err) {
 		hgrnic_err(dev, "Failed to initialize "
@@ -328,7 +408,6 @@ static int hgrnic_setup_hca (struct hgrnic_dev *dev) {
 		goto err_kar_unmap;
 	}
 
-    printk(KERN_INFO PFX "Start hgrnic_init_mr_table.\n");
 	err = hgrnic_init_mr_table(dev);
 	if (err) {
 		hgrnic_err(dev, "Failed to initialize "
@@ -340,7 +419,6 @@ static int hgrnic_setup_hca (struct hgrnic_dev *dev) {
      * PD allocation need MR table, so this function must be 
      * called after init_mr_table.
      */
-    printk(KERN_INFO PFX "Start hgrnic_pd_alloc.\n");
 	err = hgrnic_pd_alloc(dev, 1, &dev->driver_pd);
     (dev->driver_pd).ibpd.device = &(dev->ib_dev);
 	if (err) {
@@ -348,29 +426,67 @@ static int hgrnic_setup_hca (struct hgrnic_dev *dev) {
 			  "aborting.\n");
 		goto err_mr_table_free;
 	}
+	hgrnic_record_phase(dev, "uar_pd_mr_table", start);
 
-    printk(KERN_INFO PFX "Start hgrnic_init_cq_table.\n");
+    /**
+     * CQ context carries the completion EQN, so EQs must be ready
+     * before any CQ is created. Without EQs the device still works,
+     * but CQs can only be polled.
+     */
+    start = ktime_get();
+	err = hgrnic_init_eq_table(dev);
+	hgrnic_record_phase(dev, "eq_table", start);
+	if (err) {
+		hgrnic_warn(dev, "Failed to initialize event queue table (%d), "
+			   "CQ notification disabled.\n", err);
+		dev->hgrnic_flags |= HGRNIC_FLAG_NO_EQ;
+	}
+
+	/* Event moderation needs both EQs and MODIFY_CQ in the HCA. */
+	if (!cq_dim || (dev->hgrnic_flags & HGRNIC_FLAG_NO_EQ) ||
+	    !(dev->limits.flags & DEV_LIM_FLAG_CQ_MODER))
+		dev->hgrnic_flags |= HGRNIC_FLAG_NO_CQ_MODER;
+
+    start = ktime_get();
 	err = hgrnic_init_cq_table(dev);
+	hgrnic_record_phase(dev, "cq_table", start);
 	if (err) {
 		hgrnic_err(dev, "Failed to initialize "
 			  "completion queue table, aborting.\n");
-		goto err_pd_free;
+		goto err_eq_table_free;
+	}
+
+    start = ktime_get();
+	err = hgrnic_init_srq_table(dev);
+	hgrnic_record_phase(dev, "srq_table", start);
+	if (err) {
+		hgrnic_err(dev, "Failed to initialize "
+			  "shared receive queue table, aborting.\n");
+		goto err_cq_table_free;
 	}
 
-    printk(KERN_INFO PFX "Start hgrnic_init_qp_table.\n");
+    start = ktime_get();
 	err = hgrnic_init_qp_table(dev);
+	hgrnic_record_phase(dev, "qp_table", start);
 	if (err) {
 		hgrnic_err(dev, "Failed to initialize "
 			  "queue pair table, aborting.\n");
-		goto err_cq_table_free;
+		goto err_srq_table_free;
 	}
 
 	return 0;
 
 
+err_srq_table_free:
+	hgrnic_cleanup_srq_table(dev);
+
 err_cq_table_free:
 	hgrnic_cleanup_cq_table(dev);
 
+err_eq_table_free:
+	if (!(dev->hgrnic_flags & HGRNIC_FLAG_NO_EQ))
+		hgrnic_cleanup_eq_table(dev);
+
 err_pd_free:
 	hgrnic_pd_free(dev, &dev->driver_pd);
 
@@ -408,9 +524,11 @@ static struct {
 static int __hgrnic_init_one (struct pci_dev *pdev, int hca_type) {
     int err;
     struct hgrnic_dev *hgdev;
-    struct hgrnic_cq cq;
+    ktime_t probe_start, start;
     u8 i;
 
+    probe_start = ktime_get();
+
 	printk(KERN_INFO PFX "Initializing %s\n",
 	       pci_name(pdev));
 
@@ -510,33 +628,45 @@ static int __hgrnic_init_one (struct pci_dev *pdev, int hca_type) {
 
     hgrnic_init_en_register(hgdev);
 
+    /**
+     * One vector per EQ, vector index is the EQ index. Ask for one
+     * completion vector per online CPU, but make do with one.
+     */
+    if (msi_x) {
+        int nvec = pci_alloc_irq_vectors(pdev, HGRNIC_EQ_COMP + 1,
+                HGRNIC_EQ_COMP + min_t(int, num_online_cpus(), HGRNIC_MAX_COMP_EQ),
+                PCI_IRQ_MSIX);
+
+        if (nvec > 0) {
+            hgdev->hgrnic_flags |= HGRNIC_FLAG_MSI_X;
+            hgdev->eq_table.num_comp_eqs = nvec - HGRNIC_EQ_COMP;
+        }
+    }
+
     if (config_rdma) {
 
-        printk(KERN_INFO PFX "Start hgrnic_init_hca.\n");
         err = hgrnic_init_hca(hgdev);
         if (err) {
             goto err_cmd;
         }
 
-        printk(KERN_INFO PFX "Start hgrnic_setup_hca.\n");
         err = hgrnic_setup_hca(hgdev);
         if (err) {
             goto err_close;
         }
 
-        /* allocate cq0 in kernel space */
-        hgrnic_init_cq(hgdev, 32, NULL, hgdev->driver_pd.pd_num, &cq);
-
-        printk(KERN_INFO PFX "Start hgrnic_register_device.\n");
+        start = ktime_get();
         err = hgrnic_register_device(hgdev);
+        hgrnic_record_phase(hgdev, "register_device", start);
         if (err) {
             goto err_cleanup;
         }
+
+        hgrnic_debugfs_init(hgdev);
     } else {
         printk(KERN_INFO PFX "RDMA function unconfigured.\n");
     }
 
-    printk(KERN_INFO PFX "Start pci_set_drvdata.\n");
     pci_set_drvdata(pdev, hgdev);
 
     hgdev->hca_type = hca_type;
@@ -545,11 +675,17 @@ static int __hgrnic_init_one (struct pci_dev *pdev, int hca_type) {
         hgdev->gid[i] = i;
     }
 
+    hgrnic_record_phase(hgdev, "probe", probe_start);
+    hgrnic_report_phases(hgdev);
+
     return 0;
 
 err_cleanup:
     hgrnic_cleanup_qp_table(hgdev);
+    hgrnic_cleanup_srq_table(hgdev);
     hgrnic_cleanup_cq_table(hgdev);
+    if (!(hgdev->hgrnic_flags & HGRNIC_FLAG_NO_EQ))
+        hgrnic_cleanup_eq_table(hgdev);
 
     hgrnic_pd_free(hgdev, &hgdev->driver_pd);
 
@@ -562,6 +698,8 @@ err_close:
     hgrnic_CLOSE_HCA(hgdev);
 
 err_cmd:
+	if (hgdev->hgrnic_flags & HGRNIC_FLAG_MSI_X)
+		pci_free_irq_vectors(pdev);
 	hgrnic_cmd_cleanup(hgdev);
 
 err_free_dev:
@@ -587,10 +725,14 @@ static void __hgrnic_remove_one (struct pci_dev *pdev) {
         if (config_rdma) {
             printk(KERN_INFO PFX "HGRNIC (IB) driver has been removed. Bye Bye!\n");
 
+            hgrnic_debugfs_cleanup(hgdev);
             ib_unregister_device(&hgdev->ib_dev);
 
             hgrnic_cleanup_qp_table(hgdev);
+            hgrnic_cleanup_srq_table(hgdev);
             hgrnic_cleanup_cq_table(hgdev);
+            if (!(hgdev->hgrnic_flags & HGRNIC_FLAG_NO_EQ))
+                hgrnic_cleanup_eq_table(hgdev);
             hgrnic_pd_free(hgdev, &hgdev->driver_pd);
             hgrnic_cleanup_mr_table(hgdev);
             hgrnic_cleanup_pd_table(hgdev);
@@ -602,6 +744,8 @@ static void __hgrnic_remove_one (struct pci_dev *pdev) {
             printk(KERN_INFO PFX "HGRNIC (Base) driver has been removed. Bye Bye!\n");
         }
 
+        if (hgdev->hgrnic_flags & HGRNIC_FLAG_MSI_X)
+            pci_free_irq_vectors(pdev);
         hgrnic_cmd_cleanup(hgdev);
         
         ib_dealloc_device(&hgdev->ib_dev);
@@ -703,6 +847,7 @@ static void __init __hgrnic_check_profile_val (const char *name,
 static void __init hgrnic_validate_profile (void) {
     hgrnic_check_profile_val(num_qp , HGRNIC_DEFAULT_NUM_QP);
     hgrnic_check_profile_val(num_cq , HGRNIC_DEFAULT_NUM_CQ);
+    hgrnic_check_profile_val(num_srq, HGRNIC_DEFAULT_NUM_SRQ);
     hgrnic_check_profile_val(num_mpt, HGRNIC_DEFAULT_NUM_MPT);
     hgrnic_check_profile_val(num_mtt, HGRNIC_DEFAULT_NUM_MTT);
 
@@ -718,15 +863,20 @@ static int __init hgrnic_init (void) {
 
     hgrnic_validate_profile();
 
+    hgrnic_debugfs_register();
+
     ret = pci_register_driver(&hgrnic_driver);
-    if (ret < 0)
+    if (ret < 0) {
+        hgrnic_debugfs_unregister();
         return ret;
+    }
 
     return 0;
 }
 
 static void __exit hgrnic_cleanup (void) {
     pci_unregister_driver(&hgrnic_driver);
+    hgrnic_debugfs_unregister();
 }
 
 module_init(hgrnic_init);
@@ -7,6 +7,10 @@
 
 #include <linux/slab.h>
 #include <linux/errno.h>
+#include <linux/llist.h>
+#include <linux/workqueue.h>
+
+#include <rdma/ib_umem.h>
 
 #include "hgrnic_dev.h"
 #include "hgrnic_cmd.h"
@@ -32,6 +36,7 @@ struct hgrnic_mpt_entry {
 
 #define HGRNIC_MPT_FLAG_SW_OWNS       (0xfUL << 28)
 #define HGRNIC_MPT_FLAG_MIO           (1 << 17)
+#define HGRNIC_MPT_FLAG_FAST_REG      (1 << 16)
 #define HGRNIC_MPT_FLAG_BIND_ENABLE   (1 << 15)
 #define HGRNIC_MPT_FLAG_PHYSICAL      (1 <<  9)
 #define HGRNIC_MPT_FLAG_REGION        (1 <<  8)
@@ -321,6 +326,25 @@ int hgrnic_write_mtt (struct hgrnic_dev *dev, struct hgrnic_mtt *mtt,
 }
 
 
+/*
+ * HCAs with DEV_LIM_FLAG_FAST_REG look MPTs up by key[31:8], so that
+ * the low byte is left to the consumer (ib_update_fast_reg_key()).
+ * Older ones take the key as MPT index directly.
+ */
+static inline u32 hw_index_to_key (struct hgrnic_dev *dev, u32 ind)
+{
+    if (dev->limits.flags & DEV_LIM_FLAG_FAST_REG)
+        return (ind >> 24) | (ind << 8);
+    return ind;
+}
+
+static inline u32 key_to_hw_index (struct hgrnic_dev *dev, u32 key)
+{
+    if (dev->limits.flags & DEV_LIM_FLAG_FAST_REG)
+        return (key << 24) | (key >> 8);
+    return key;
+}
+
 /**
  * @note Allocate memory region.
  * 1. Allocate MPT and write ICM mapping to HCA;
@@ -336,20 +360,21 @@ int hgrnic_mr_alloc (struct hgrnic_dev *dev, u32 pd, int buffer_size_shift,
 {
     struct hgrnic_mailbox *mailbox;
     struct hgrnic_mpt_entry *mpt_entry;
-    u32 key;
+    u32 key, ind;
     int err;
 
 
     WARN_ON(buffer_size_shift >= 32);
 
-    key = hgrnic_alloc(&dev->mr_table.mpt_alloc);
-    if (key == -1)
+    ind = hgrnic_alloc(&dev->mr_table.mpt_alloc);
+    if (ind == -1)
         return -ENOMEM;
 
-    mr->ibmr.rkey = mr->ibmr.lkey = key;
+    key = hw_index_to_key(dev, ind);
+    mr->ibmr.rkey = mr->ibmr.lkey = mr->key = key;
 
     err = hgrnic_reg_icm(dev, dev->mr_table.mpt_table, 
-                        key, TPT_REGION);
+                        ind, TPT_REGION);
     if (err)
         goto err_out_mpt_free;
 
@@ -379,7 +404,7 @@ int hgrnic_mr_alloc (struct hgrnic_dev *dev, u32 pd, int buffer_size_shift,
         mpt_entry->mtt_seg = cpu_to_be64(mr->mtt->first_index);
 
     err = hgrnic_SW2HW_MPT(dev, mailbox,
-                          key & (dev->limits.num_mpts - 1));
+                          ind & (dev->limits.num_mpts - 1));
     if (err) {
         hgrnic_warn(dev, "SW2HW_MPT failed (%d)\n", err);
         goto err_out_mailbox;
@@ -393,16 +418,23 @@ int hgrnic_mr_alloc (struct hgrnic_dev *dev, u32 pd, int buffer_size_shift,
     hgrnic_dump("0x%llx", be64_to_cpu(mpt_entry->mtt_seg  ));
 
     hgrnic_free_mailbox(dev, mailbox);
+
+    mr->pd_num = pd;
+    mr->start  = iova;
+    mr->size   = total_size;
+    /* Only read by debugfs, so a failed store is not fatal. */
+    xa_store(&dev->mr_table.mr, ind & (dev->limits.num_mpts - 1),
+             mr, GFP_KERNEL);
     return err;
 
 err_out_mailbox:
     hgrnic_free_mailbox(dev, mailbox);
 
 err_out_table:
-    hgrnic_unreg_icm(dev, dev->mr_table.mpt_table, key, TPT_REGION);
+    hgrnic_unreg_icm(dev, dev->mr_table.mpt_table, ind, TPT_REGION);
 
 err_out_mpt_free:
-    hgrnic_free(&dev->mr_table.mpt_alloc, key);
+    hgrnic_free(&dev->mr_table.mpt_alloc, ind);
     return err;
 }
 
@@ -417,6 +449,32 @@ int hgrnic_mr_alloc_notrans (struct hgrnic_dev *dev,
     return hgrnic_mr_alloc(dev, pd, 12, 0, ~0ULL, access, mr);
 }
 
+/**
+ * @note Allocate a fast-reg MR. MTT entries for max_pages are reserved
+ * and the MPT is written with zero length, so the MR is unusable until
+ * an IB_WR_REG_MR fills in the translation from the send queue.
+ */
+int hgrnic_mr_alloc_fast_reg (struct hgrnic_dev *dev, u32 pd,
+                              u32 max_pages, struct hgrnic_mr *mr)
+{
+    int err;
+
+    mr->mtt = hgrnic_alloc_mtt(dev, max_pages);
+    if (IS_ERR(mr->mtt))
+        return PTR_ERR(mr->mtt);
+
+    err = hgrnic_mr_alloc(dev, pd, PAGE_SHIFT, 0, 0,
+                          HGRNIC_MPT_FLAG_FAST_REG, mr);
+    if (err)
+        goto free_mtt;
+
+    return 0;
+
+free_mtt:
+    hgrnic_free_mtt(dev, mr->mtt);
+    return err;
+}
+
 /**
  * @note Allocate Memory (With mtt).
  * 
@@ -457,10 +515,12 @@ free_mtt:
 /* Free mr id and its ICM space */
 static void hgrnic_free_region (struct hgrnic_dev *dev, u32 lkey)
 {
+    u32 ind = key_to_hw_index(dev, lkey);
+
     hgrnic_unreg_icm(dev, dev->mr_table.mpt_table,
-                    lkey, TPT_REGION);
+                    ind, TPT_REGION);
 
-    hgrnic_free(&dev->mr_table.mpt_alloc, lkey);
+    hgrnic_free(&dev->mr_table.mpt_alloc, ind);
 }
 
 /**
@@ -471,17 +531,80 @@ static void hgrnic_free_region (struct hgrnic_dev *dev, u32 lkey)
  */
 void hgrnic_free_mr(struct hgrnic_dev *dev, struct hgrnic_mr *mr)
 {
+    u32 ind = key_to_hw_index(dev, mr->key) & (dev->limits.num_mpts - 1);
     int err;
 
-    err = hgrnic_HW2SW_MPT(dev, 
-                          mr->ibmr.lkey & (dev->limits.num_mpts - 1));
+    xa_erase(&dev->mr_table.mr, ind);
+
+    err = hgrnic_HW2SW_MPT(dev, ind);
     if (err)
         hgrnic_warn(dev, "HW2SW_MPT failed (%d)\n", err);
 
-    hgrnic_free_region(dev, mr->ibmr.lkey);
+    hgrnic_free_region(dev, mr->key);
     hgrnic_free_mtt(dev, mr->mtt);
 }
 
+/**
+ * @note Release everything of a deregistered MR except its MPT entry,
+ * which has been handed back to SW already, and its umem, which
+ * dereg_mr has released. The key is freed last, so it cannot be
+ * reused before the teardown is complete.
+ */
+static void hgrnic_mr_release (struct hgrnic_dev *dev, struct hgrnic_mr *mr)
+{
+    hgrnic_free_mtt(dev, mr->mtt);
+    hgrnic_free_region(dev, mr->key);
+
+    if (mr->pages)
+        dma_free_coherent(&dev->pdev->dev,
+                          mr->max_pages * sizeof *mr->pages,
+                          mr->pages, mr->page_map);
+    kfree(mr);
+}
+
+static void hgrnic_dereg_work (struct work_struct *work)
+{
+    struct hgrnic_mr_table *mr_table =
+        container_of(work, struct hgrnic_mr_table, dereg_work);
+    struct hgrnic_dev *dev =
+        container_of(mr_table, struct hgrnic_dev, mr_table);
+    struct hgrnic_mr *mr, *tmp;
+    struct llist_node *list;
+
+    list = llist_del_all(&mr_table->dereg_list);
+    llist_for_each_entry_safe(mr, tmp, list, dereg_node) {
+        hgrnic_mr_release(dev, mr);
+        cond_resched();
+    }
+}
+
+/**
+ * @note Deregister an MR allocated by the verbs layer.
+ * HW2SW_MPT is issued before return, so the key is invalid in HCA
+ * once the caller sees success. The umem is released here as well:
+ * ib_umem_release() uses the owning ib_ucontext, which uverbs frees
+ * right after the MR cleanup when the process exits. Unmapping ICM
+ * and freeing the MTTs and the key are batched in the dereg
+ * workqueue.
+ */
+void hgrnic_dereg_mr_deferred (struct hgrnic_dev *dev, struct hgrnic_mr *mr)
+{
+    u32 ind = key_to_hw_index(dev, mr->key) & (dev->limits.num_mpts - 1);
+    int err;
+
+    xa_erase(&dev->mr_table.mr, ind);
+
+    err = hgrnic_HW2SW_MPT(dev, ind);
+    if (err)
+        hgrnic_warn(dev, "HW2SW_MPT failed (%d)\n", err);
+
+    ib_umem_release(mr->umem);
+    mr->umem = NULL;
+
+    if (llist_add(&mr->dereg_node, &dev->mr_table.dereg_list))
+        queue_work(dev->mr_table.dereg_wq, &dev->mr_table.dereg_work);
+}
+
 /**
  * @note Initialize Memory region resources (MPT & MTT).
  * 1. Init resource table.
@@ -501,8 +624,21 @@ int hgrnic_init_mr_table (struct hgrnic_dev *dev)
     if (err)
         goto err_mtt_buddy;
 
+    xa_init(&dev->mr_table.mr);
+    init_llist_head(&dev->mr_table.dereg_list);
+    INIT_WORK(&dev->mr_table.dereg_work, hgrnic_dereg_work);
+    dev->mr_table.dereg_wq = alloc_ordered_workqueue("hgrnic_dereg/%s", 0,
+                                                     pci_name(dev->pdev));
+    if (!dev->mr_table.dereg_wq) {
+        err = -ENOMEM;
+        goto err_dereg_wq;
+    }
+
     return 0;
 
+err_dereg_wq:
+    hgrnic_buddy_cleanup(&dev->mr_table.mtt_buddy);
+
 err_mtt_buddy:
     hgrnic_alloc_cleanup(&dev->mr_table.mpt_alloc);
 
@@ -511,6 +647,12 @@ err_mtt_buddy:
 
 void hgrnic_cleanup_mr_table(struct hgrnic_dev *dev)
 {
+    /* Finish teardown of MRs deregistered during unregister. */
+    destroy_workqueue(dev->mr_table.dereg_wq);
+
+    WARN_ON(!xa_empty(&dev->mr_table.mr));
+    xa_destroy(&dev->mr_table.mr);
+
     hgrnic_buddy_cleanup(&dev->mr_table.mtt_buddy);
     hgrnic_alloc_cleanup(&dev->mr_table.mpt_alloc);
 }
@@ -51,24 +51,43 @@ static int hgrnic_query_device (struct ib_device *ibdev,
     props->max_pd              = mdev->limits.num_pds - mdev->limits.reserved_pds;
     props->local_ca_ack_delay  = mdev->limits.local_ca_ack_delay;
     props->max_pkeys           = mdev->limits.pkey_table_len;
-    props->atomic_cap          = IB_ATOMIC_NONE;
+    /* Atomics are serialized within the responder HCA only, not
+     * against CPU accesses to the same memory. */
+    props->atomic_cap          = (mdev->limits.flags & DEV_LIM_FLAG_ATOMIC) ?
+                                 IB_ATOMIC_HCA : IB_ATOMIC_NONE;
+    props->masked_atomic_cap   = (mdev->limits.flags & DEV_LIM_FLAG_MASKED_ATOMIC) ?
+                                 props->atomic_cap : IB_ATOMIC_NONE;
 
     /* reserved */
     props->fw_ver              = 0;
-    props->device_cap_flags    = 0;
+    props->device_cap_flags    = (mdev->limits.flags & DEV_LIM_FLAG_FAST_REG) ?
+                                 IB_DEVICE_MEM_MGT_EXTENSIONS : 0;
     props->hw_ver              = 1; // Not involved in design
     props->sys_image_guid      = 0; // Not involved in design
     props->max_sge_rd          = 0;
     props->max_qp_rd_atom      = 0;
     props->max_qp_init_rd_atom = 0;
     props->max_res_rd_atom     = 0;
-    props->max_srq             = 0;
-    props->max_srq_wr          = 0;
-    props->max_srq_sge         = 0;
+    if (mdev->limits.flags & DEV_LIM_FLAG_SRQ) {
+        props->max_srq         = mdev->limits.num_srqs - mdev->limits.reserved_srqs;
+        props->max_srq_wr      = mdev->limits.max_wqes;
+        props->max_srq_sge     = mdev->limits.max_sg;
+    }
     props->max_mcast_grp       = 0;
     props->max_mcast_qp_attach = 0;
     props->max_total_mcast_qp_attach = 0;
     props->max_map_per_fmr = 0;
+    props->max_fast_reg_page_list_len = (mdev->limits.flags & DEV_LIM_FLAG_FAST_REG) ?
+                                        HGRNIC_MAX_FAST_REG_PAGES : 0;
+
+    /* CQEs carry bits 39:0 of the HCA clock */
+    props->hca_core_clock      = mdev->hca_clock_khz;
+    props->timestamp_mask      = HGRNIC_CQE_TS_MASK;
+
+    if (!(mdev->hgrnic_flags & HGRNIC_FLAG_NO_CQ_MODER)) {
+        props->cq_caps.max_cq_moderation_count  = HGRNIC_MAX_CQ_MOD_COUNT;
+        props->cq_caps.max_cq_moderation_period = HGRNIC_MAX_CQ_MOD_PERIOD;
+    }
 
     return 0;
 }
@@ -248,6 +267,7 @@ struct ib_qp *hgrnic_create_qp (struct ib_pd *pd,
         err = hgrnic_alloc_qp(to_hgdev(pd->device), to_hgpd(pd),
                 to_hgcq(init_attr->send_cq),
                 to_hgcq(init_attr->recv_cq),
+                init_attr->srq ? to_hgsrq(init_attr->srq) : NULL,
                 init_attr->qp_type, 
                 &init_attr->cap, qp, udata);
         qp->rq.mr.ibmr.length = qp->rq.que_size;
@@ -297,12 +317,16 @@ static int hgrnic_alloc_ucontext(struct ib_ucontext *uctx,
         return -EAGAIN;
 
     uresp.qp_tab_size = to_hgdev(ibdev)->limits.num_qps;
+    uresp.numa_node   = dev_to_node(&to_hgdev(ibdev)->pdev->dev);
+    uresp.hca_core_clock = to_hgdev(ibdev)->hca_clock_khz;
+    uresp.clock_offset   = HGRNIC_CLOCK_LO & ~PAGE_MASK;
 
     err = hgrnic_uar_alloc(to_hgdev(ibdev), &context->uar);
     if (err)
         return err;
 
-    if (ib_copy_to_udata(udata, &uresp, sizeof(uresp))) {
+    /* Older libraries do not know the clock fields. */
+    if (ib_copy_to_udata(udata, &uresp, min(sizeof(uresp), udata->outlen))) {
         hgrnic_uar_free(to_hgdev(ibdev), &context->uar);
         return -EFAULT;
     }
@@ -315,16 +339,41 @@ static void hgrnic_dealloc_ucontext(struct ib_ucontext *context)
     hgrnic_uar_free(to_hgdev(context->device), &to_hgucontext(context)->uar);
 }
 
+/**
+ * @description: 
+ * Offset 0 maps the context's UAR. HGRNIC_MMAP_CLOCK_PAGE maps, read
+ * only, the BAR0 page holding the HCA clock registers. The device gives
+ * the clock a 4 KB page of its own, a larger CPU page would take the
+ * HCR with it, so the clock is not mapped then.
+ */
 static int hgrnic_mmap_uar(struct ib_ucontext *context,
                           struct vm_area_struct *vma)
 {
+    unsigned long pfn;
+
     if (vma->vm_end - vma->vm_start != PAGE_SIZE)
         return -EINVAL;
 
+    switch (vma->vm_pgoff) {
+    case 0:
+        pfn = to_hgucontext(context)->uar.pfn;
+        break;
+    case HGRNIC_MMAP_CLOCK_PAGE:
+        if (PAGE_SIZE > HGRNIC_CLOCK_PAGE_SIZE)
+            return -EINVAL;
+        if (vma->vm_flags & VM_WRITE)
+            return -EPERM;
+        vma->vm_flags &= ~VM_MAYWRITE;
+        pfn = (pci_resource_start(to_hgdev(context->device)->pdev, 0) +
+               (HGRNIC_CLOCK_LO & PAGE_MASK)) >> PAGE_SHIFT;
+        break;
+    default:
+        return -EINVAL;
+    }
+
     vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
 
-    if (io_remap_pfn_range(vma, vma->vm_start,
-                           to_hgucontext(context)->uar.pfn,
+    if (io_remap_pfn_range(vma, vma->vm_start, pfn,
                            PAGE_SIZE, vma->vm_page_prot))
         return -EAGAIN;
 
@@ -363,6 +412,9 @@ int hgrnic_create_cq(struct ib_cq *ibcq,
     if (entries < 1 || entries > to_hgdev(ibdev)->limits.max_cqes)
         return -EINVAL;
 
+    if (attr->comp_vector >= ibdev->num_comp_vectors)
+        return -EINVAL;
+
     cq = to_hgcq(ibcq);
 
     if (udata) {
@@ -376,7 +428,7 @@ int hgrnic_create_cq(struct ib_cq *ibcq,
 
     err = hgrnic_init_cq(to_hgdev(ibdev), nent, context,
                 udata ? ucmd.pdn : to_hgdev(ibdev)->driver_pd.pd_num,
-                cq);
+                attr->comp_vector, cq);
     if (err)
         return err;
 
@@ -403,7 +455,7 @@ static struct ib_mr *hgrnic_get_dma_mr(struct ib_pd *pd, int acc)
     int err;
 
     printk(KERN_INFO PFX "Enter hgrnic_get_dma_mr\n");
-    mr = kmalloc(sizeof *mr, GFP_KERNEL);
+    mr = kzalloc(sizeof *mr, GFP_KERNEL);
     if (!mr)
         return ERR_PTR(-ENOMEM);
 
@@ -440,7 +492,7 @@ struct ib_mr *hgrnic_reg_user_mr(struct ib_pd *pd, u64 start,
         ib_copy_from_udata(&ucmd, udata, sizeof(ucmd)))
         return ERR_PTR(-EFAULT);
 
-    mr = kmalloc(sizeof *mr, GFP_KERNEL);
+    mr = kzalloc(sizeof *mr, GFP_KERNEL);
     if (!mr)
         return ERR_PTR(-ENOMEM);
 
@@ -515,14 +567,79 @@ err:
     return ERR_PTR(err);
 }
 
+/**
+ * @note Allocate a fast-reg MR for in-kernel ULPs. Its translation is
+ * set by ib_map_mr_sg() followed by an IB_WR_REG_MR work request.
+ */
+static struct ib_mr *hgrnic_alloc_mr(struct ib_pd *pd, enum ib_mr_type mr_type,
+                                     u32 max_num_sg, struct ib_udata *udata)
+{
+    struct hgrnic_dev *dev = to_hgdev(pd->device);
+    struct hgrnic_mr *mr;
+    int err;
+
+    if (!(dev->limits.flags & DEV_LIM_FLAG_FAST_REG))
+        return ERR_PTR(-EOPNOTSUPP);
+
+    if (mr_type != IB_MR_TYPE_MEM_REG ||
+        max_num_sg > HGRNIC_MAX_FAST_REG_PAGES)
+        return ERR_PTR(-EINVAL);
+
+    mr = kzalloc(sizeof *mr, GFP_KERNEL);
+    if (!mr)
+        return ERR_PTR(-ENOMEM);
+
+    mr->max_pages = max_num_sg;
+    mr->pages = dma_alloc_coherent(&dev->pdev->dev,
+                                   mr->max_pages * sizeof *mr->pages,
+                                   &mr->page_map, GFP_KERNEL);
+    if (!mr->pages) {
+        err = -ENOMEM;
+        goto err_free;
+    }
+
+    err = hgrnic_mr_alloc_fast_reg(dev, to_hgpd(pd)->pd_num,
+                                   mr->max_pages, mr);
+    if (err)
+        goto err_free_pages;
+
+    return &mr->ibmr;
+
+err_free_pages:
+    dma_free_coherent(&dev->pdev->dev, mr->max_pages * sizeof *mr->pages,
+                      mr->pages, mr->page_map);
+
+err_free:
+    kfree(mr);
+    return ERR_PTR(err);
+}
+
+static int hgrnic_set_page(struct ib_mr *ibmr, u64 addr)
+{
+    struct hgrnic_mr *mr = to_hgmr(ibmr);
+
+    if (unlikely(mr->npages == mr->max_pages))
+        return -ENOMEM;
+
+    mr->pages[mr->npages++] = cpu_to_be64(addr);
+    return 0;
+}
+
+static int hgrnic_map_mr_sg(struct ib_mr *ibmr, struct scatterlist *sg,
+                            int sg_nents, unsigned int *sg_offset)
+{
+    struct hgrnic_mr *mr = to_hgmr(ibmr);
+
+    mr->npages = 0;
+    return ib_sg_to_pages(ibmr, sg, sg_nents, sg_offset, hgrnic_set_page);
+}
+
 static int hgrnic_dereg_mr(struct ib_mr *mr, struct ib_udata *udata)
 {
     struct hgrnic_mr *hgmr = to_hgmr(mr);
 
     printk(KERN_INFO PFX "Enter hgrnic_dereg_mr\n");
-    hgrnic_free_mr(to_hgdev(mr->device), hgmr);
-    ib_umem_release(hgmr->umem);
-    kfree(hgmr);
+    hgrnic_dereg_mr_deferred(to_hgdev(mr->device), hgmr);
 
     printk(KERN_INFO PFX "Exit hgrnic_dereg_mr\n");
     return 0;
@@ -737,6 +854,48 @@ out:
 	return ret;
 }
 
+/**
+ * @note Set CQ event moderation. Called by ib_core's rdma_dim for
+ * kernel CQs polled from softirq/workqueue, and by ULPs directly.
+ */
+static int hgrnic_modify_cq(struct ib_cq *ibcq, u16 cq_count, u16 cq_period)
+{
+    struct hgrnic_dev *dev = to_hgdev(ibcq->device);
+    struct hgrnic_cq *cq = to_hgcq(ibcq);
+    int ret = 0;
+
+    if (dev->hgrnic_flags & HGRNIC_FLAG_NO_CQ_MODER)
+        return -EOPNOTSUPP;
+
+    if (cq_count > HGRNIC_MAX_CQ_MOD_COUNT ||
+        cq_period > HGRNIC_MAX_CQ_MOD_PERIOD)
+        return -EINVAL;
+
+    mutex_lock(&cq->mutex);
+
+    /* DIM re-applies the current profile often, skip the HCR round trip. */
+    if (cq_count == cq->moder_count && cq_period == cq->moder_period)
+        goto out;
+
+    ret = hgrnic_MODIFY_CQ(dev, cq->cqn, cq_count, cq_period);
+    if (ret) {
+        /*
+         * DIM keeps calling for every CQ. One failure means the HCA
+         * does not take it, don't pay an HCR round trip each time.
+         */
+        hgrnic_warn(dev, "MODIFY_CQ failed (%d), CQ moderation disabled.\n", ret);
+        dev->hgrnic_flags |= HGRNIC_FLAG_NO_CQ_MODER;
+        goto out;
+    }
+
+    cq->moder_count  = cq_count;
+    cq->moder_period = cq_period;
+
+out:
+    mutex_unlock(&cq->mutex);
+    return ret;
+}
+
 /**
  * @note The following is the mandatory API.
  * query_device,
@@ -789,12 +948,15 @@ static const struct ib_device_ops hgrnic_dev_ops = {
     .create_cq  = hgrnic_create_cq , /* done */
     .destroy_cq = hgrnic_destroy_cq, /* done */
     .poll_cq    = hgrnic_poll_cq   , /* done */
-    .req_notify_cq = hgrnic_arm_cq , /* half done */
+    .req_notify_cq = hgrnic_arm_cq , /* done */
     .resize_cq  = hgrnic_resize_cq , /* done */
+    .modify_cq  = hgrnic_modify_cq , /* done */
 
     .get_dma_mr  = hgrnic_get_dma_mr ,  /* done */
     .reg_user_mr = hgrnic_reg_user_mr,  /* done */
     .dereg_mr    = hgrnic_dereg_mr   ,  /* done */
+    .alloc_mr    = hgrnic_alloc_mr   ,  /* done */
+    .map_mr_sg   = hgrnic_map_mr_sg  ,  /* done */
 
     /* tell ib_core size of driver data struct */
     INIT_RDMA_OBJ_SIZE(ib_ah, hgrnic_ah, ibah),
@@ -803,6 +965,16 @@ static const struct ib_device_ops hgrnic_dev_ops = {
     INIT_RDMA_OBJ_SIZE(ib_ucontext, hgrnic_ucontext, ibucontext),
 };
 
+static const struct ib_device_ops hgrnic_dev_srq_ops = {
+    .create_srq    = hgrnic_create_srq   ,
+    .modify_srq    = hgrnic_modify_srq   ,
+    .query_srq     = hgrnic_query_srq    ,
+    .destroy_srq   = hgrnic_destroy_srq  ,
+    .post_srq_recv = hgrnic_post_srq_recv,
+
+    INIT_RDMA_OBJ_SIZE(ib_srq, hgrnic_srq, ibsrq),
+};
+
 
 
 /**
@@ -829,11 +1001,22 @@ int hgrnic_register_device (struct hgrnic_dev *dev) {
 		(1ull << IB_USER_VERBS_CMD_DESTROY_QP);
 	dev->ib_dev.node_type            = RDMA_NODE_IB_CA;
 	dev->ib_dev.phys_port_cnt        = dev->limits.num_ports;
-	dev->ib_dev.num_comp_vectors     = 1;
+	dev->ib_dev.num_comp_vectors     = (dev->hgrnic_flags & HGRNIC_FLAG_NO_EQ) ?
+	                                   1 : dev->eq_table.num_comp_eqs;
 	dev->ib_dev.dev.parent           = &dev->pdev->dev;
+	dev->ib_dev.use_cq_dim           = !(dev->hgrnic_flags & HGRNIC_FLAG_NO_CQ_MODER);
 
 
 	ib_set_device_ops(&dev->ib_dev, &hgrnic_dev_ops);
+
+	if (dev->limits.flags & DEV_LIM_FLAG_SRQ) {
+		dev->ib_dev.uverbs_cmd_mask |=
+			(1ull << IB_USER_VERBS_CMD_CREATE_SRQ)		|
+			(1ull << IB_USER_VERBS_CMD_MODIFY_SRQ)		|
+			(1ull << IB_USER_VERBS_CMD_QUERY_SRQ)		|
+			(1ull << IB_USER_VERBS_CMD_DESTROY_SRQ);
+		ib_set_device_ops(&dev->ib_dev, &hgrnic_dev_srq_ops);
+	}
 	
 	mutex_init(&dev->cap_mask_mutex);
 
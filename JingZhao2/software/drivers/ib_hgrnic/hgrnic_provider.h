@@ -8,6 +8,8 @@
 #ifndef HGRNIC_PROVIDER_H
 #define HGRNIC_PROVIDER_H
 
+#include <linux/refcount.h>
+
 #include <rdma/ib_verbs.h>
 #include <rdma/ib_pack.h>
 
@@ -47,6 +49,17 @@ struct hgrnic_mr {
     struct ib_mr      ibmr;
     struct ib_umem   *umem;
     struct hgrnic_mtt *mtt;
+    u32               key; /* MPT index, fixed for the MR's lifetime */
+    u32               pd_num; /* pd, start and size as written to the MPT */
+    u64               start;
+    u64               size;
+    struct llist_node dereg_node;
+
+    /* Fast-reg only: page list read by HCA on IB_WR_REG_MR */
+    __be64           *pages;
+    dma_addr_t        page_map;
+    u32               npages;
+    u32               max_pages;
 };
 
 struct hgrnic_pd {
@@ -63,8 +76,9 @@ struct hgrnic_eq {
 	u16                    msi_x_vector;
 	u16                    msi_x_entry;
 	int                    have_irq;
-	int                    nent; // Number of EQs in this device (the n-th power of 2)
-	struct hgrnic_buf_list *page_list; // Allocated memory for Event Queue
+	int                    nent; // Number of EQEs in this EQ (the n-th power of 2)
+	union hgrnic_buf        queue; // Allocated memory for Event Queue
+	int                    is_direct;
 	struct hgrnic_mr        mr;
 	char		       irq_name[IB_DEVICE_NAME_MAX];
 };
@@ -80,18 +94,22 @@ struct hgrnic_ah {
 /*
  * Quick description of our CQ/QP locking scheme:
  *
- * We have one global lock that protects dev->cq/qp_table.  Each
- * struct hgrnic_cq/qp also has its own lock.  An individual qp lock
- * may be taken inside of an individual cq lock.  Both cqs attached to
- * a qp may be locked, with the cq with the lower cqn locked first.
- * No other nesting should be done.
+ * dev->cq/qp_table map CQN/QPN to the struct through an xarray.
+ * Writers (create/destroy) serialize on the xarray's internal lock;
+ * lookups only take rcu_read_lock(), so event dispatch never takes
+ * a spinlock or disables interrupts.  Each struct hgrnic_cq/qp also
+ * has its own lock.  An individual qp lock may be taken inside of an
+ * individual cq lock.  Both cqs attached to a qp may be locked, with
+ * the cq with the lower cqn locked first.  No other nesting should
+ * be done.
  *
- * Each struct hgrnic_cq/qp also has an ref count, protected by the
- * corresponding table lock.  The pointer from the cq/qp_table to the
- * struct counts as one reference.  This reference also is good for
- * access through the consumer API, so modifying the CQ/QP etc doesn't
- * need to take another reference.  Access to a QP because of a
- * completion being polled does not need a reference either.
+ * Each struct hgrnic_cq/qp also has a refcount_t.  The pointer from
+ * the cq/qp_table to the struct counts as one reference.  This
+ * reference also is good for access through the consumer API, so
+ * modifying the CQ/QP etc doesn't need to take another reference.
+ * Access to a QP because of a completion being polled does not need
+ * a reference either, as the QP is removed from the table with its
+ * CQs locked.
  *
  * Finally, each struct hgrnic_cq/qp has a wait_queue_head_t for the
  * destroy function to sleep on.
@@ -99,17 +117,18 @@ struct hgrnic_ah {
  * This means that access from the consumer API requires nothing but
  * taking the struct's lock.
  *
- * Access because of a completion event should go as follows:
- * - lock cq/qp_table and look up struct
- * - increment ref count in struct
- * - drop cq/qp_table lock
+ * Access because of a completion event should go as follows
+ * (hgrnic_cq_get/put, hgrnic_qp_get/put):
+ * - rcu_read_lock and look up struct
+ * - refcount_inc_not_zero, skip the event if it fails
+ * - rcu_read_unlock
  * - lock struct, do your thing, and unlock struct
- * - decrement ref count; if zero, wake up waiters
+ * - refcount_dec_and_test; if zero, wake up waiters
  *
  * To destroy a CQ/QP, we can do the following:
- * - lock cq/qp_table
- * - remove pointer and decrement ref count
- * - unlock cq/qp_table lock
+ * - xa_erase the pointer
+ * - synchronize_rcu, so no lookup can still see the old pointer
+ * - drop the table reference
  * - wait_event until ref count is zero
  *
  * It is the consumer's responsibilty to make sure that no QP
@@ -121,8 +140,6 @@ struct hgrnic_ah {
  *
  * Possible optimizations (wait for profile data to see if/where we
  * have locks bouncing between CPUs):
- * - split cq/qp table lock into n separate (cache-aligned) locks,
- *   indexed (say) by the page in the table
  * - split QP struct lock into three (one for common info, one for the
  *   send queue and one for the receive queue)
  */
@@ -148,7 +165,7 @@ struct hgrnic_cq {
     struct ib_cq ibcq; /* we actual allocate one 
                         * element larger than ibcq->cqe */
     spinlock_t   lock;
-    int          refcount;
+    refcount_t   refcount;
     int          cqn;
     u32          cons_index; /* consumer index, point 
                               * to first unpolled cqe.
@@ -156,6 +173,8 @@ struct hgrnic_cq {
     struct hgrnic_cq_buf     buf;
     struct hgrnic_cq_resize *resize_buf;
     int                     is_kernel;
+    u16                     moder_count ; /* CQEs per event, 0 is off */
+    u16                     moder_period; /* usecs per event, 0 is off */
 
     wait_queue_head_t wait;
     struct mutex      mutex;
@@ -176,13 +195,39 @@ struct hgrnic_wq {
     struct hgrnic_mr       mr   ; /* memory region allocated for work queue */
     u64                   *wr_id; /* work request id, used when pooling cqc */
     union hgrnic_buf       queue; /* work queue */
+    int                    is_direct; /* queue is one contiguous buffer */
+};
+
+/*
+ * The HCA takes SRQ WQEs in ring order, whichever QP receives. A WQE
+ * is busy from post until its CQE is polled; completions through
+ * different CQs can free slots out of order, so posting stops at the
+ * first busy slot and the posted WQEs stay contiguous.
+ */
+struct hgrnic_srq {
+    struct ib_srq          ibsrq;
+    spinlock_t             lock;
+    refcount_t             refcount;
+    int                    srqn;
+    int                    max;      /* WQEs in the ring, power of 2 */
+    int                    max_gs;
+    int                    entry_sz_log;
+    int                    que_size; /* que_size = max << entry_sz_log */
+    unsigned               head;     /* never roll back */
+
+    struct hgrnic_mr       mr;
+    u64                   *wr_id;
+    unsigned long         *busy;     /* bitmap, kernel SRQs only */
+    union hgrnic_buf       queue;
+    int                    is_direct;
+
+    wait_queue_head_t      wait;
 };
 
 struct hgrnic_qp {
     struct ib_qp           ibqp;
-    int                    refcount;
+    refcount_t             refcount;
     u32                    qpn;
-    int                    is_direct;
     u8                     port; /* for SQP and memfree use only */
     u8                     transport; /* transport type: RC, UD, UC */
     u8                     state;
@@ -249,5 +294,9 @@ static inline struct hgrnic_qp *to_hgqp(struct ib_qp *ibqp) {
     return container_of(ibqp, struct hgrnic_qp, ibqp);
 }
 
+static inline struct hgrnic_srq *to_hgsrq(struct ib_srq *ibsrq) {
+    return container_of(ibsrq, struct hgrnic_srq, ibsrq);
+}
+
 
 #endif /* HGRNIC_PROVIDER_H */
@@ -8,6 +8,8 @@
 #include <linux/string.h>
 #include <linux/slab.h>
 #include <linux/sched.h>
+#include <linux/rcupdate.h>
+#include <linux/seq_file.h>
 
 #include <asm/io.h>
 
@@ -132,11 +134,31 @@ static const u8 hgrnic_opcode[] = {
     [IB_WR_RDMA_READ]            = HGRNIC_OPCODE_RDMA_READ,
     [IB_WR_ATOMIC_CMP_AND_SWP]   = HGRNIC_OPCODE_ATOMIC_CS,
     [IB_WR_ATOMIC_FETCH_AND_ADD] = HGRNIC_OPCODE_ATOMIC_FA,
+    [IB_WR_MASKED_ATOMIC_CMP_AND_SWP]   = HGRNIC_OPCODE_MASKED_ATOMIC_CS,
+    [IB_WR_MASKED_ATOMIC_FETCH_AND_ADD] = HGRNIC_OPCODE_MASKED_ATOMIC_FA,
+    [IB_WR_SEND_WITH_INV]        = HGRNIC_OPCODE_SEND_INV,
+    [IB_WR_LOCAL_INV]            = HGRNIC_OPCODE_LOCAL_INV,
+    [IB_WR_REG_MR]               = HGRNIC_OPCODE_FAST_REG,
 };
 
-static void *get_wqe (struct hgrnic_wq wq, int n) {
-    return wq.queue.page_list[(n << wq.entry_sz_log) >> PAGE_SHIFT].buf +
-        ((n << wq.entry_sz_log) & (PAGE_SIZE - 1));
+/* QUERY_DEV_LIM flags the HCA must report before an opcode is posted */
+static const u32 hgrnic_opcode_cap[ARRAY_SIZE(hgrnic_opcode)] = {
+    [IB_WR_ATOMIC_CMP_AND_SWP]   = DEV_LIM_FLAG_ATOMIC,
+    [IB_WR_ATOMIC_FETCH_AND_ADD] = DEV_LIM_FLAG_ATOMIC,
+    [IB_WR_MASKED_ATOMIC_CMP_AND_SWP]   = DEV_LIM_FLAG_MASKED_ATOMIC,
+    [IB_WR_MASKED_ATOMIC_FETCH_AND_ADD] = DEV_LIM_FLAG_MASKED_ATOMIC,
+    [IB_WR_SEND_WITH_INV]        = DEV_LIM_FLAG_FAST_REG,
+    [IB_WR_LOCAL_INV]            = DEV_LIM_FLAG_FAST_REG,
+    [IB_WR_REG_MR]               = DEV_LIM_FLAG_FAST_REG,
+};
+
+static void *get_wqe (struct hgrnic_wq *wq, int n) {
+    int off = n << wq->entry_sz_log;
+
+    if (wq->is_direct)
+        return wq->queue.direct.buf + off;
+    return wq->queue.page_list[off >> PAGE_SHIFT].buf +
+        (off & (PAGE_SIZE - 1));
 }
 
 static void hgrnic_wq_reset(struct hgrnic_wq *wq)
@@ -338,6 +360,58 @@ out:
     return err;
 }
 
+/**
+ * @note Print one line of the QP context as read back by QUERY_QP,
+ * for debugfs. Caller holds a reference on qp. May sleep.
+ */
+int hgrnic_qp_show_context (struct hgrnic_dev *dev, struct hgrnic_qp *qp,
+                            struct seq_file *s)
+{
+    struct hgrnic_mailbox *mailbox;
+    struct hgrnic_qp_context *context;
+    int err = 0;
+
+    mutex_lock(&qp->mutex);
+
+    if (qp->state == IB_QPS_RESET) {
+        seq_printf(s, "0x%06x\t%u\tRESET\n", qp->qpn, qp->transport);
+        goto out;
+    }
+
+    mailbox = hgrnic_alloc_mailbox(dev, GFP_KERNEL);
+    if (IS_ERR(mailbox)) {
+        err = PTR_ERR(mailbox);
+        goto out;
+    }
+
+    err = hgrnic_QUERY_QP(dev, qp->qpn, mailbox);
+    if (err) {
+        seq_printf(s, "0x%06x\t%u\tQUERY_QP failed (%d)\n",
+                   qp->qpn, qp->transport, err);
+        goto out_mailbox;
+    }
+
+    context = &((struct hgrnic_qp_param *) mailbox->buf)->context;
+    seq_printf(s, "0x%06x\t%u\t%u\t0x%06x\t%u\t0x%06x\t0x%06x\t"
+               "0x%06x\t0x%06x\t0x%06x\t%d/%d\n",
+               qp->qpn, qp->transport,
+               be32_to_cpu(context->flags) >> 28,
+               be32_to_cpu(context->remote_qpn) & 0xffffff,
+               context->mtu_msgmax >> 5,
+               be32_to_cpu(context->next_send_psn)   & 0xffffff,
+               be32_to_cpu(context->last_acked_psn)  & 0xffffff,
+               be32_to_cpu(context->rnr_nextrecvpsn) & 0xffffff,
+               be32_to_cpu(context->cqn_snd) & 0xffffff,
+               be32_to_cpu(context->cqn_rcv) & 0xffffff,
+               qp->sq.max, qp->rq.max);
+
+out_mailbox:
+    hgrnic_free_mailbox(dev, mailbox);
+out:
+    mutex_unlock(&qp->mutex);
+    return err;
+}
+
 static int __hgrnic_modify_qp (struct ib_qp *ibqp,
         const struct ib_qp_attr *attr, int attr_mask,
         enum ib_qp_state cur_state, enum ib_qp_state new_state,
@@ -436,8 +510,14 @@ static int __hgrnic_modify_qp (struct ib_qp *ibqp,
     qp_context->rnr_nextrecvpsn |= cpu_to_be32(qp->epsn);
     
     qp_context->cqn_rcv = cpu_to_be32(to_hgcq(ibqp->recv_cq)->cqn);
-    qp_context->rcv_wqe_base_l = cpu_to_be32(qp->rq.mr.ibmr.lkey);
-    qp_context->rcv_wqe_len   = cpu_to_be32(qp->rq.mr.ibmr.length);
+    if (ibqp->srq) {
+        /* Receive WQEs come from the SRQ, the QP has no RQ. */
+        qp_context->ra_buff_indx = cpu_to_be32(1 << 24 |
+                                               to_hgsrq(ibqp->srq)->srqn);
+    } else {
+        qp_context->rcv_wqe_base_l = cpu_to_be32(qp->rq.mr.ibmr.lkey);
+        qp_context->rcv_wqe_len    = cpu_to_be32(qp->rq.mr.ibmr.length);
+    }
 
     err = hgrnic_MODIFY_QP(dev, cur_state, new_state, qp->qpn, mailbox);
     if (err) {
@@ -486,15 +566,17 @@ static int __hgrnic_modify_qp (struct ib_qp *ibqp,
      * entries and reinitialize the QP.
      */
     if (new_state == IB_QPS_RESET && !qp->ibqp.uobject) {
-        hgrnic_cq_clean(dev, to_hgcq(qp->ibqp.recv_cq), qp->qpn);
+        hgrnic_cq_clean(dev, to_hgcq(qp->ibqp.recv_cq), qp->qpn,
+                        qp->ibqp.srq ? to_hgsrq(qp->ibqp.srq) : NULL);
         if (qp->ibqp.send_cq != qp->ibqp.recv_cq)
-            hgrnic_cq_clean(dev, to_hgcq(qp->ibqp.send_cq), qp->qpn);
+            hgrnic_cq_clean(dev, to_hgcq(qp->ibqp.send_cq), qp->qpn, NULL);
 
         hgrnic_wq_reset(&qp->sq);
-        qp->sq.last = get_wqe(qp->sq, qp->sq.max - 1);
+        qp->sq.last = get_wqe(&qp->sq, qp->sq.max - 1);
 
         hgrnic_wq_reset(&qp->rq);
-        qp->rq.last = get_wqe(qp->rq, qp->rq.max - 1);
+        if (qp->rq.max)
+            qp->rq.last = get_wqe(&qp->rq, qp->rq.max - 1);
     }
 
 out_mailbox:
@@ -583,12 +665,11 @@ static int hgrnic_max_data_size (struct hgrnic_dev *dev,
 /*
  * Allocate and register buffer for WQEs.  qp->rq.max, sq.max,
  * rq.max_gs and sq.max_gs must all be assigned.
- * hgrnic_alloc_wqe_buf will calculate is_direct, and
+ * hgrnic_alloc_wqe_buf will calculate wq->is_direct, and
  * queue
  */
 static int hgrnic_alloc_wqe_buf(struct hgrnic_dev *dev,
                                struct hgrnic_pd *pd,
-                               int *is_direct,
                                struct hgrnic_wq *wq,
                                struct ib_udata *udata)
 {
@@ -600,7 +681,7 @@ static int hgrnic_alloc_wqe_buf(struct hgrnic_dev *dev,
 
     printk(KERN_INFO PFX "Start hgrnic_alloc_wqe_buf: hgrnic_buf_alloc");
     err = hgrnic_buf_alloc(dev, PAGE_ALIGN(wq->que_size),
-                          &wq->queue, is_direct, pd, 0, &wq->mr);
+                          &wq->queue, &wq->is_direct, pd, 0, &wq->mr);
     if (err) {
         kfree(wq->wr_id);
         return err;
@@ -610,11 +691,10 @@ static int hgrnic_alloc_wqe_buf(struct hgrnic_dev *dev,
 }
 
 static void hgrnic_free_wqe_buf(struct hgrnic_dev *dev,
-                               int is_direct,
                                struct hgrnic_wq *wq)
 {
     hgrnic_buf_free(dev, PAGE_ALIGN(wq->que_size),
-                   &wq->queue, is_direct, &wq->mr);
+                   &wq->queue, wq->is_direct, &wq->mr);
     kfree(wq->wr_id);
 }
 
@@ -632,7 +712,7 @@ static int hgrnic_alloc_qp_buf (struct hgrnic_dev *dev,
     struct hgrnic_data_unit *scatter;
     int size;
 
-    qp->refcount = 1;
+    refcount_set(&qp->refcount, 1);
     init_waitqueue_head(&qp->wait);
     mutex_init(&qp->mutex);
     qp->state    	 = IB_QPS_RESET;
@@ -660,16 +740,27 @@ static int hgrnic_alloc_qp_buf (struct hgrnic_dev *dev,
     printk(KERN_INFO PFX "Start kernel qp processing!\n");
 
     /* Allocate queue space for SQ. */
-    ret = hgrnic_alloc_wqe_buf(dev, pd, &qp->is_direct, &qp->sq, udata);
+    ret = hgrnic_alloc_wqe_buf(dev, pd, &qp->sq, udata);
     if (ret) {
         hgrnic_unreg_icm(dev, dev->qp_table.qp_table, qp->qpn, CXT_REGION);
         return ret;
     }
 
+    qp->sq.last = get_wqe(&qp->sq, qp->sq.max - 1);
+    for (i = 0; i < qp->sq.max; ++i) {
+        next = get_wqe(&qp->sq, i);
+        next->nda_nop = cpu_to_be32((((i + 1) & (qp->sq.max - 1)) <<
+                        qp->sq.entry_sz_log));
+    }
+
+    /* A QP attached to an SRQ has no RQ. */
+    if (!qp->rq.max)
+        return 0;
+
     /* Allocate queue space for RQ. */
-    ret = hgrnic_alloc_wqe_buf(dev, pd, &qp->is_direct, &qp->rq, udata);
+    ret = hgrnic_alloc_wqe_buf(dev, pd, &qp->rq, udata);
     if (ret) {
-        hgrnic_free_wqe_buf(dev, qp->is_direct, &qp->sq);
+        hgrnic_free_wqe_buf(dev, &qp->sq);
         hgrnic_unreg_icm(dev, dev->qp_table.qp_table, qp->qpn, CXT_REGION);
         return ret;
     }
@@ -678,7 +769,7 @@ static int hgrnic_alloc_qp_buf (struct hgrnic_dev *dev,
             qp->rq.max_gs * sizeof (struct hgrnic_data_unit)) / 16;
 
     for (i = 0; i < qp->rq.max; ++i) {
-        next = get_wqe(qp->rq, i);
+        next = get_wqe(&qp->rq, i);
         next->nda_nop = cpu_to_le32(((i + 1) & (qp->rq.max - 1)) <<
                         qp->rq.entry_sz_log);
         next->ee_nds = cpu_to_le32(size);
@@ -689,14 +780,7 @@ static int hgrnic_alloc_qp_buf (struct hgrnic_dev *dev,
             scatter->lkey = cpu_to_le32(HGRNIC_INVAL_LKEY);
     }
 
-    for (i = 0; i < qp->sq.max; ++i) {
-        next = get_wqe(qp->sq, i);
-        next->nda_nop = cpu_to_be32((((i + 1) & (qp->sq.max - 1)) <<
-                        qp->sq.entry_sz_log));
-    }
-
-    qp->sq.last = get_wqe(qp->sq, qp->sq.max - 1);
-    qp->rq.last = get_wqe(qp->rq, qp->rq.max - 1);
+    qp->rq.last = get_wqe(&qp->rq, qp->rq.max - 1);
 
     return 0;
 }
@@ -725,6 +809,7 @@ static int hgrnic_set_qp_entry_sz (struct hgrnic_dev *dev, struct hgrnic_qp *qp)
         break;
     case UC:
         size += sizeof (struct hgrnic_raddr_unit);
+        size = max_t(int, size, sizeof (struct hgrnic_fastreg_unit));
         break;
     case RC:
         size += sizeof (struct hgrnic_raddr_unit);
@@ -733,14 +818,21 @@ static int hgrnic_set_qp_entry_sz (struct hgrnic_dev *dev, struct hgrnic_qp *qp)
          * remote address segment and one scatter entry.
          */
         size = max_t(int, size,
-                     sizeof (struct hgrnic_atomic_unit) +
+                     sizeof (struct hgrnic_masked_atomic_unit) +
                      sizeof (struct hgrnic_raddr_unit) +
                      sizeof (struct hgrnic_data_unit));
+        size = max_t(int, size, sizeof (struct hgrnic_fastreg_unit));
         break;
     default:
         break;
     }
 
+    size = max_t(int, size,
+                 (qp->transport == UD ? sizeof (struct hgrnic_ud_unit) :
+                                        sizeof (struct hgrnic_raddr_unit)) +
+                 ALIGN(qp->max_inline_data +
+                       sizeof (struct hgrnic_inline_unit), 16));
+
     size += sizeof (struct hgrnic_next_unit);
 
     if (size > dev->limits.max_desc_sz)
@@ -794,9 +886,9 @@ static int hgrnic_set_qp_size (struct hgrnic_dev *dev,
 
 int hgrnic_alloc_qp (struct hgrnic_dev *dev,
                     struct hgrnic_pd *pd, struct hgrnic_cq *send_cq,
-                    struct hgrnic_cq *recv_cq, enum ib_qp_type type,
-                    struct ib_qp_cap *cap, struct hgrnic_qp *qp, 
-                    struct ib_udata *udata)
+                    struct hgrnic_cq *recv_cq, struct hgrnic_srq *srq,
+                    enum ib_qp_type type, struct ib_qp_cap *cap,
+                    struct hgrnic_qp *qp, struct ib_udata *udata)
 {
     int err;
 
@@ -807,6 +899,12 @@ int hgrnic_alloc_qp (struct hgrnic_dev *dev,
     default: return -EINVAL;
     }
 
+    /* Receive WQEs are posted to the SRQ, no RQ is allocated. */
+    if (srq) {
+        cap->max_recv_wr  = 0;
+        cap->max_recv_sge = 0;
+    }
+
     err = hgrnic_set_qp_size(dev, cap, pd, qp);
     if (err)
         return err;
@@ -823,10 +921,19 @@ int hgrnic_alloc_qp (struct hgrnic_dev *dev,
         return err;
     }
 
-    spin_lock_irq(&dev->qp_table.lock);
-    hgrnic_array_set(&dev->qp_table.qp,
-                    qp->qpn & (dev->limits.num_qps - 1), qp);
-    spin_unlock_irq(&dev->qp_table.lock);
+    err = xa_err(xa_store(&dev->qp_table.qp,
+                          qp->qpn & (dev->limits.num_qps - 1),
+                          qp, GFP_KERNEL));
+    if (err) {
+        if (!udata) {
+            hgrnic_free_wqe_buf(dev, &qp->sq);
+            if (qp->rq.max)
+                hgrnic_free_wqe_buf(dev, &qp->rq);
+        }
+        hgrnic_unreg_icm(dev, dev->qp_table.qp_table, qp->qpn, CXT_REGION);
+        hgrnic_free(&dev->qp_table.alloc, qp->qpn);
+        return err;
+    }
 
     return 0;
 }
@@ -863,15 +970,53 @@ static void hgrnic_unlock_cqs(struct hgrnic_cq *send_cq, struct hgrnic_cq *recv_
 
 
 
-static inline int get_qp_refcount(struct hgrnic_dev *dev, struct hgrnic_qp *qp)
+/**
+ * @note Look up a QP for event dispatch and take a reference on it.
+ * Safe in interrupt context, no lock is taken.
+ * @return The QP, or NULL if it does not exist or is being destroyed.
+ */
+struct hgrnic_qp *hgrnic_qp_get(struct hgrnic_dev *dev, u32 qpn)
 {
-	int c;
+	struct hgrnic_qp *qp;
+
+	rcu_read_lock();
+	qp = xa_load(&dev->qp_table.qp, qpn & (dev->limits.num_qps - 1));
+	if (qp && !refcount_inc_not_zero(&qp->refcount))
+		qp = NULL;
+	rcu_read_unlock();
+
+	return qp;
+}
+
+void hgrnic_qp_put(struct hgrnic_qp *qp)
+{
+	if (refcount_dec_and_test(&qp->refcount))
+		wake_up(&qp->wait);
+}
+
+/**
+ * @note Called from async EQ interrupt handler.
+ */
+void hgrnic_qp_event(struct hgrnic_dev *dev, u32 qpn,
+		    enum ib_event_type event_type)
+{
+	struct hgrnic_qp *qp;
+	struct ib_event event;
+
+	qp = hgrnic_qp_get(dev, qpn);
+	if (!qp) {
+		hgrnic_warn(dev, "Async event %d for bogus QP %08x\n",
+			   (int) event_type, qpn);
+		return;
+	}
 
-	spin_lock_irq(&dev->qp_table.lock);
-	c = qp->refcount;
-	spin_unlock_irq(&dev->qp_table.lock);
+	event.device      = &dev->ib_dev;
+	event.event       = event_type;
+	event.element.qp  = &qp->ibqp;
+	if (qp->ibqp.event_handler)
+		qp->ibqp.event_handler(&event, qp->ibqp.qp_context);
 
-	return c;
+	hgrnic_qp_put(qp);
 }
 
 void hgrnic_free_qp(struct hgrnic_dev *dev,
@@ -890,16 +1035,14 @@ void hgrnic_free_qp(struct hgrnic_dev *dev,
      * without taking a lock.
      */
     hgrnic_lock_cqs(send_cq, recv_cq);
-
-    spin_lock(&dev->qp_table.lock);
-    hgrnic_array_clear(&dev->qp_table.qp,
-                      qp->qpn & (dev->limits.num_qps - 1));
-    --qp->refcount;
-    spin_unlock(&dev->qp_table.lock);
-
+    xa_erase(&dev->qp_table.qp, qp->qpn & (dev->limits.num_qps - 1));
     hgrnic_unlock_cqs(send_cq, recv_cq);
 
-    wait_event(qp->wait, !get_qp_refcount(dev, qp));
+    /* No lookup may still hold the pointer without a reference. */
+    synchronize_rcu();
+
+    hgrnic_qp_put(qp);
+    wait_event(qp->wait, !refcount_read(&qp->refcount));
 
     if (qp->state != IB_QPS_RESET) {
         mailbox = hgrnic_alloc_mailbox(dev, GFP_KERNEL);
@@ -917,12 +1060,14 @@ void hgrnic_free_qp(struct hgrnic_dev *dev,
      * unref the mem-free tables and free the QPN in our table.
      */
     if (!qp->ibqp.uobject) {
-        hgrnic_cq_clean(dev, recv_cq, qp->qpn);
+        hgrnic_cq_clean(dev, recv_cq, qp->qpn,
+                        qp->ibqp.srq ? to_hgsrq(qp->ibqp.srq) : NULL);
         if (send_cq != recv_cq)
-            hgrnic_cq_clean(dev, send_cq, qp->qpn);
+            hgrnic_cq_clean(dev, send_cq, qp->qpn, NULL);
 
-        hgrnic_free_wqe_buf(dev, qp->is_direct, &qp->sq);
-        hgrnic_free_wqe_buf(dev, qp->is_direct, &qp->rq);
+        hgrnic_free_wqe_buf(dev, &qp->sq);
+        if (qp->rq.max)
+            hgrnic_free_wqe_buf(dev, &qp->rq);
     }
 
     hgrnic_unreg_icm(dev, dev->qp_table.qp_table, qp->qpn, CXT_REGION);
@@ -948,13 +1093,44 @@ static inline int hgrnic_wq_overflow (struct hgrnic_wq *wq, int nreq,
     return cur + nreq >= wq->max;
 }
 
+/**
+ * @note The consumer rotates the key with ib_update_fast_reg_key()
+ * and passes it in wr->key, the WQE only programs it. mr->key keeps
+ * the key of the allocation, which names the MPT.
+ */
+static int hgrnic_check_reg_wr (const struct ib_reg_wr *wr)
+{
+    struct hgrnic_mr *mr = to_hgmr(wr->mr);
+
+    /* MPTs are looked up by key[31:8], the low byte is the consumer's */
+    if (unlikely(!mr->pages || (wr->key ^ mr->key) & ~0xffu ||
+                 mr->ibmr.page_size != PAGE_SIZE))
+        return -EINVAL;
+
+    return 0;
+}
+
+/*
+ * Atomics return the original 8 bytes of remote memory into exactly
+ * one naturally aligned local buffer.
+ */
+static int hgrnic_check_atomic_wr (const struct ib_send_wr *wr)
+{
+    if (unlikely(wr->num_sge != 1 || wr->send_flags & IB_SEND_INLINE ||
+                 wr->sg_list[0].length != sizeof (u64) ||
+                 !IS_ALIGNED(wr->sg_list[0].addr, sizeof (u64)) ||
+                 !IS_ALIGNED(atomic_wr(wr)->remote_addr, sizeof (u64))))
+        return -EINVAL;
+
+    return 0;
+}
+
 int hgrnic_post_send (struct ib_qp *ibqp, const struct ib_send_wr *wr, 
                      const struct ib_send_wr **bad_wr) {
     
     struct hgrnic_dev *dev = to_hgdev(ibqp->device);
     struct hgrnic_qp *qp = to_hgqp(ibqp);
     
-    void *cur_wqe ; /* point to current processing wqe */
     void *cur_unit; /* point to current prcessing unit in current wqe */
     void *prev_wqe;
     unsigned long flags;
@@ -981,31 +1157,42 @@ int hgrnic_post_send (struct ib_qp *ibqp, const struct ib_send_wr *wr,
     for (nreq = 0; wr; ++nreq, wr = wr->next) {
         if (unlikely(nreq == HGRNIC_MAX_WQES_PER_SEND_DB)) {
             hgrnic_send_dbell(dev, qp, nreq, size0, f0, op0);
-            
             nreq = 0;
-            qp->sq.head += HGRNIC_MAX_WQES_PER_SEND_DB;
         }
 
-        if (hgrnic_wq_overflow(&qp->sq, nreq, qp->ibqp.send_cq)) {
-            hgrnic_err(dev, "SQ %06x full (%u head, %u tail,"
-                      " %d max, %d nreq)\n", qp->qpn,
-                      qp->sq.head, qp->sq.tail,
-                      qp->sq.max, nreq);
+        if (unlikely(hgrnic_wq_overflow(&qp->sq, nreq, qp->ibqp.send_cq))) {
             err = -ENOMEM;
             *bad_wr = wr;
             goto out;
         }
 
-        cur_unit = get_wqe(qp->sq, ind);
-        cur_wqe = cur_unit;
+        if (unlikely(wr->opcode >= ARRAY_SIZE(hgrnic_opcode) ||
+                     !hgrnic_opcode[wr->opcode] ||
+                     (dev->limits.flags & hgrnic_opcode_cap[wr->opcode]) !=
+                     hgrnic_opcode_cap[wr->opcode] ||
+                     wr->num_sge > qp->sq.max_gs)) {
+            err = -EINVAL;
+            *bad_wr = wr;
+            goto out;
+        }
+
+        cur_unit = get_wqe(&qp->sq, ind);
         prev_wqe = qp->sq.last;
         qp->sq.last = cur_unit;
-        printk(KERN_INFO PFX "hgrnic_post_send: wqe addr is 0x%llx\n", (u64)cur_wqe);
 
-        memset(cur_unit, 0, sizeof(struct hgrnic_next_unit));
+        ((struct hgrnic_next_unit *) cur_unit)->nda_nop = 0;
+        ((struct hgrnic_next_unit *) cur_unit)->ee_nds  = 0;
+        ((struct hgrnic_next_unit *) cur_unit)->flags =
+            cpu_to_le32(((wr->send_flags & IB_SEND_SIGNALED) ?
+                         HGRNIC_NEXT_CQ_UPDATE : 0) |
+                        ((wr->send_flags & IB_SEND_SOLICITED) ?
+                         HGRNIC_NEXT_SOLICIT : 0));
         if (wr->opcode == IB_WR_SEND_WITH_IMM ||
                 wr->opcode == IB_WR_RDMA_WRITE_WITH_IMM)
             ((struct hgrnic_next_unit *) cur_unit)->imm = wr->ex.imm_data;
+        else if (wr->opcode == IB_WR_SEND_WITH_INV)
+            ((struct hgrnic_next_unit *) cur_unit)->imm =
+                cpu_to_le32(wr->ex.invalidate_rkey);
         else
             ((struct hgrnic_next_unit *) cur_unit)->imm = 0;
 
@@ -1024,6 +1211,55 @@ int hgrnic_post_send (struct ib_qp *ibqp, const struct ib_send_wr *wr,
                 size     += sizeof (struct hgrnic_raddr_unit) / 16;
                 break;
 
+              case IB_WR_ATOMIC_CMP_AND_SWP:
+              case IB_WR_ATOMIC_FETCH_AND_ADD:
+                err = hgrnic_check_atomic_wr(wr);
+                if (unlikely(err)) {
+                    *bad_wr = wr;
+                    goto out;
+                }
+                set_raddr_unit(cur_unit, atomic_wr(wr)->remote_addr,
+                              atomic_wr(wr)->rkey);
+                cur_unit += sizeof (struct hgrnic_raddr_unit);
+                set_atomic_seg(cur_unit, atomic_wr(wr));
+                cur_unit += sizeof (struct hgrnic_atomic_unit);
+                size     += (sizeof (struct hgrnic_raddr_unit) +
+                             sizeof (struct hgrnic_atomic_unit)) / 16;
+                break;
+
+              case IB_WR_MASKED_ATOMIC_CMP_AND_SWP:
+              case IB_WR_MASKED_ATOMIC_FETCH_AND_ADD:
+                err = hgrnic_check_atomic_wr(wr);
+                if (unlikely(err)) {
+                    *bad_wr = wr;
+                    goto out;
+                }
+                set_raddr_unit(cur_unit, atomic_wr(wr)->remote_addr,
+                              atomic_wr(wr)->rkey);
+                cur_unit += sizeof (struct hgrnic_raddr_unit);
+                set_masked_atomic_seg(cur_unit, atomic_wr(wr));
+                cur_unit += sizeof (struct hgrnic_masked_atomic_unit);
+                size     += (sizeof (struct hgrnic_raddr_unit) +
+                             sizeof (struct hgrnic_masked_atomic_unit)) / 16;
+                break;
+
+              case IB_WR_REG_MR:
+                err = hgrnic_check_reg_wr(reg_wr(wr));
+                if (unlikely(err)) {
+                    *bad_wr = wr;
+                    goto out;
+                }
+                set_fastreg_unit(cur_unit, reg_wr(wr));
+                cur_unit += sizeof (struct hgrnic_fastreg_unit);
+                size     += sizeof (struct hgrnic_fastreg_unit) / 16;
+                break;
+
+              case IB_WR_LOCAL_INV:
+                set_local_inv_unit(cur_unit, wr->ex.invalidate_rkey);
+                cur_unit += sizeof (struct hgrnic_local_inv_unit);
+                size     += sizeof (struct hgrnic_local_inv_unit) / 16;
+                break;
+
               default:
                 /* No extra segments required for RC sends */
                 break;
@@ -1040,6 +1276,23 @@ int hgrnic_post_send (struct ib_qp *ibqp, const struct ib_send_wr *wr,
                 size     += sizeof (struct hgrnic_raddr_unit) / 16;
                 break;
 
+              case IB_WR_REG_MR:
+                err = hgrnic_check_reg_wr(reg_wr(wr));
+                if (unlikely(err)) {
+                    *bad_wr = wr;
+                    goto out;
+                }
+                set_fastreg_unit(cur_unit, reg_wr(wr));
+                cur_unit += sizeof (struct hgrnic_fastreg_unit);
+                size     += sizeof (struct hgrnic_fastreg_unit) / 16;
+                break;
+
+              case IB_WR_LOCAL_INV:
+                set_local_inv_unit(cur_unit, wr->ex.invalidate_rkey);
+                cur_unit += sizeof (struct hgrnic_local_inv_unit);
+                size     += sizeof (struct hgrnic_local_inv_unit) / 16;
+                break;
+
               default:
                 /* No extra segments required for UC sends */
                 break;
@@ -1047,57 +1300,67 @@ int hgrnic_post_send (struct ib_qp *ibqp, const struct ib_send_wr *wr,
             break;
 
           case UD:
+            if (unlikely(wr->opcode != IB_WR_SEND &&
+                         wr->opcode != IB_WR_SEND_WITH_IMM)) {
+                err = -EINVAL;
+                *bad_wr = wr;
+                goto out;
+            }
             set_ud_unit(cur_unit, ud_wr(wr));
             cur_unit += sizeof (struct hgrnic_ud_unit);
             size     += sizeof (struct hgrnic_ud_unit) / 16;
             break;
         }
 
-        if (wr->num_sge > qp->sq.max_gs) {
-            hgrnic_err(dev, "too many gathers\n");
-            err = -EINVAL;
-            *bad_wr = wr;
-            goto out;
-        }
-
-        for (i = 0; i < wr->num_sge; ++i) {
-            hgrnic_set_data_unit(cur_unit, wr->sg_list + i);
-            cur_unit += sizeof (struct hgrnic_data_unit);
-            size     += sizeof (struct hgrnic_data_unit) / 16;
+        if (wr->send_flags & IB_SEND_INLINE) {
+            if (wr->num_sge) {
+                int len = hgrnic_set_inline_unit(cur_unit, wr,
+                                                 qp->max_inline_data);
+
+                if (unlikely(len < 0)) {
+                    err = -EINVAL;
+                    *bad_wr = wr;
+                    goto out;
+                }
+                size += ALIGN(len + sizeof (struct hgrnic_inline_unit), 16) / 16;
+            }
+        } else {
+            for (i = 0; i < wr->num_sge; ++i) {
+                hgrnic_set_data_unit(cur_unit, wr->sg_list + i);
+                cur_unit += sizeof (struct hgrnic_data_unit);
+            }
+            size += wr->num_sge * (sizeof (struct hgrnic_data_unit) / 16);
         }
 
         qp->sq.wr_id[ind] = wr->wr_id;
 
-        if (wr->opcode >= ARRAY_SIZE(hgrnic_opcode)) {
-            hgrnic_err(dev, "opcode invalid\n");
-            err = -EINVAL;
-            *bad_wr = wr;
-            goto out;
-        }
-
-        ((struct hgrnic_next_unit *) prev_wqe)->nda_nop =
-            cpu_to_le32(((ind << qp->sq.entry_sz_log)) |
-                    hgrnic_opcode[wr->opcode]);
-        ((struct hgrnic_next_unit *) prev_wqe)->ee_nds =
-            cpu_to_le32(HGRNIC_NEXT_DBD | size |
-                    ((wr->send_flags & IB_SEND_FENCE) ?
-                        HGRNIC_NEXT_FENCE : 0));
+        /* WQEParser takes a WQE's own size and opcode from its next unit */
+        ((struct hgrnic_next_unit *) qp->sq.last)->flags |=
+            cpu_to_le32((size << HGRNIC_NEXT_CUR_SIZE_SHIFT) |
+                        (hgrnic_opcode[wr->opcode] << HGRNIC_NEXT_CUR_OPCODE_SHIFT));
 
+        /*
+         * The first WQE of a doorbell is described by the doorbell
+         * itself, the following ones are linked from their predecessor.
+         */
         if (!nreq) {
             size0 = size;
             op0   = hgrnic_opcode[wr->opcode];
             f0    = wr->send_flags & IB_SEND_FENCE ?
                 HGRNIC_SEND_DOORBELL_FENCE : 0;
+        } else {
+            ((struct hgrnic_next_unit *) prev_wqe)->nda_nop =
+                cpu_to_le32(((ind << (qp->sq.entry_sz_log - 4)) << 6) |
+                            hgrnic_opcode[wr->opcode]);
+            ((struct hgrnic_next_unit *) prev_wqe)->ee_nds =
+                cpu_to_le32(HGRNIC_NEXT_DBD | size |
+                            ((wr->send_flags & IB_SEND_FENCE) ?
+                             HGRNIC_NEXT_FENCE : 0));
         }
 
         ++ind;
         if (unlikely(ind >= qp->sq.max))
             ind -= qp->sq.max;
-
-        /* print one wqe entry, which may be removed later
-         * !TODO */
-        for (i = 0; i < (size * 16); ++i)
-            printk(KERN_INFO PFX "hgrnic_post_send: wqe[%d]: 0x%x", i, ((u8*)cur_wqe)[i]);
     }
 
 out:
@@ -1111,8 +1374,8 @@ out:
 int hgrnic_post_receive(struct ib_qp *ibqp, const struct ib_recv_wr *wr,
                              const struct ib_recv_wr **bad_wr)
 {
-    struct hgrnic_dev *dev = to_hgdev(ibqp->device);
     struct hgrnic_qp *qp = to_hgqp(ibqp);
+    struct hgrnic_next_unit *prev = NULL; /* next unit of previous wqe */
     unsigned long flags;
     int err = 0;
     int nreq;
@@ -1125,28 +1388,35 @@ int hgrnic_post_receive(struct ib_qp *ibqp, const struct ib_recv_wr *wr,
     ind = qp->rq.head & (qp->rq.max - 1);
 
     for (nreq = 0; wr; ++nreq, wr = wr->next) {
-        if (hgrnic_wq_overflow(&qp->rq, nreq, qp->ibqp.recv_cq)) {
-            hgrnic_err(dev, "RQ %06x full (%u head, %u tail,"
-                    " %d max, %d nreq)\n", qp->qpn,
-                    qp->rq.head, qp->rq.tail,
-                    qp->rq.max, nreq);
+        if (unlikely(hgrnic_wq_overflow(&qp->rq, nreq, qp->ibqp.recv_cq))) {
             err = -ENOMEM;
             *bad_wr = wr;
             goto out;
         }
 
-        wqe = get_wqe(qp->rq, ind);
-
-        ((struct hgrnic_next_unit *) wqe)->flags = 0;
-
-        wqe += sizeof (struct hgrnic_next_unit);
-
         if (unlikely(wr->num_sge > qp->rq.max_gs)) {
             err = -EINVAL;
             *bad_wr = wr;
             goto out;
         }
 
+        /* Link previous WQE, nda in 16-byte units, same as libhgrnic. */
+        if (prev) {
+            prev->nda_nop = cpu_to_le32((ind << (qp->rq.entry_sz_log - 4 + 6)) |
+                                        HGRNIC_NEXT_VALID);
+            prev->ee_nds  = cpu_to_le32((wr->num_sge + 1) *
+                                        sizeof (struct hgrnic_data_unit) / 16);
+        }
+
+        wqe  = get_wqe(&qp->rq, ind);
+        prev = wqe;
+
+        prev->nda_nop = cpu_to_le32(HGRNIC_NEXT_VALID);
+        prev->ee_nds  = 0;
+        prev->flags   = 0;
+
+        wqe += sizeof (struct hgrnic_next_unit);
+
         for (i = 0; i < wr->num_sge; ++i) {
             hgrnic_set_data_unit(wqe, wr->sg_list + i);
             wqe += sizeof (struct hgrnic_data_unit);
@@ -1175,8 +1445,6 @@ int hgrnic_init_qp_table (struct hgrnic_dev *dev) {
 	int err;
 	// int i;
 
-	spin_lock_init(&dev->qp_table.lock);
-
 	/*
 	 * We reserve 2 extra QPs per port for the special QPs.  The
 	 * special QP for port 1 has to be even, so round up.
@@ -1189,12 +1457,7 @@ int hgrnic_init_qp_table (struct hgrnic_dev *dev) {
         return err;
     }
 
-	err = hgrnic_array_init(&dev->qp_table.qp,
-			       dev->limits.num_qps);
-	if (err) {
-		hgrnic_alloc_cleanup(&dev->qp_table.alloc);
-		return err;
-	}
+	xa_init(&dev->qp_table.qp);
 
 	return 0;
 
@@ -1207,6 +1470,7 @@ void hgrnic_cleanup_qp_table(struct hgrnic_dev *dev)
 	// for (i = 0; i < 2; ++i)
 	// 	hgrnic_CONF_SPECIAL_QP(dev, i, 0);
 
-	hgrnic_array_cleanup(&dev->qp_table.qp, dev->limits.num_qps);
+	WARN_ON(!xa_empty(&dev->qp_table.qp));
+	xa_destroy(&dev->qp_table.qp);
 	hgrnic_alloc_cleanup(&dev->qp_table.alloc);
 }
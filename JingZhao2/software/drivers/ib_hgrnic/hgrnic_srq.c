@@ -0,0 +1,419 @@
+/**************************************************************
+ * @file hgrnic_srq.c
+ * @note Data structs & functions related to SRQ
+ *************************************************************/
+
+#include <linux/bitmap.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/rcupdate.h>
+
+#include <rdma/ib_verbs.h>
+#include <rdma/uverbs_ioctl.h>
+#include <rdma/hgrnic-abi.h>
+
+#include "hgrnic_dev.h"
+#include "hgrnic_cmd.h"
+#include "hgrnic_icm.h"
+#include "hgrnic_wqe.h"
+
+enum {
+    HGRNIC_SRQ_STATE_OK  = 0 << 28,
+    HGRNIC_SRQ_STATE_ERR = 1 << 28
+};
+
+struct hgrnic_srq_context {
+    __be32 flags;           /* [31:28] state */
+    u8     logsize;         /* log2 of the number of WQEs */
+    u8     entry_sz_log;    /* size of one WQE in log format */
+    __be16 limit_watermark;
+    __be32 pd;
+    __be32 lkey;            /* of the WQE buffer */
+    __be32 srqn;
+    __be32 reserved[3];
+} __packed;
+
+static void *get_srq_wqe(struct hgrnic_srq *srq, int n)
+{
+    int off = n << srq->entry_sz_log;
+
+    if (srq->is_direct)
+        return srq->queue.direct.buf + off;
+    return srq->queue.page_list[off >> PAGE_SHIFT].buf +
+        (off & (PAGE_SIZE - 1));
+}
+
+static int hgrnic_set_srq_size(struct hgrnic_dev *dev,
+                               struct ib_srq_attr *attr,
+                               struct hgrnic_srq *srq)
+{
+    int size;
+
+    if (!attr->max_wr || attr->max_wr > dev->limits.max_wqes ||
+        attr->max_sge > dev->limits.max_sg)
+        return -EINVAL;
+
+    srq->max    = roundup_pow_of_two(attr->max_wr);
+    srq->max_gs = attr->max_sge;
+
+    size = sizeof (struct hgrnic_next_unit) +
+        srq->max_gs * sizeof (struct hgrnic_data_unit);
+    if (size > dev->limits.max_desc_sz)
+        return -EINVAL;
+
+    for (srq->entry_sz_log = 7; 1 << srq->entry_sz_log < size;
+         srq->entry_sz_log++);
+    srq->que_size = srq->max << srq->entry_sz_log;
+
+    return 0;
+}
+
+/**
+ * @note Allocate and register the WQE ring of a kernel SRQ.
+ */
+static int hgrnic_alloc_srq_buf(struct hgrnic_dev *dev, struct hgrnic_pd *pd,
+                                struct hgrnic_srq *srq)
+{
+    int err;
+
+    srq->wr_id = kmalloc_array(srq->max, sizeof(u64), GFP_KERNEL);
+    if (!srq->wr_id)
+        return -ENOMEM;
+
+    srq->busy = bitmap_zalloc(srq->max, GFP_KERNEL);
+    if (!srq->busy) {
+        kfree(srq->wr_id);
+        return -ENOMEM;
+    }
+
+    err = hgrnic_buf_alloc(dev, PAGE_ALIGN(srq->que_size), &srq->queue,
+                           &srq->is_direct, pd, 0, &srq->mr);
+    if (err) {
+        bitmap_free(srq->busy);
+        kfree(srq->wr_id);
+        return err;
+    }
+
+    return 0;
+}
+
+static void hgrnic_free_srq_buf(struct hgrnic_dev *dev, struct hgrnic_srq *srq)
+{
+    hgrnic_buf_free(dev, PAGE_ALIGN(srq->que_size), &srq->queue,
+                    srq->is_direct, &srq->mr);
+    bitmap_free(srq->busy);
+    kfree(srq->wr_id);
+}
+
+/**
+ * @note If kernel space calls this function, it will allocate
+ * the WQE ring. A userspace SRQ brings its own, registered by
+ * libhgrnic, and passes its lkey.
+ */
+int hgrnic_create_srq(struct ib_srq *ibsrq, struct ib_srq_init_attr *init_attr,
+                      struct ib_udata *udata)
+{
+    struct hgrnic_dev *dev = to_hgdev(ibsrq->device);
+    struct hgrnic_pd *pd = to_hgpd(ibsrq->pd);
+    struct hgrnic_srq *srq = to_hgsrq(ibsrq);
+    struct hgrnic_create_srq ucmd;
+    struct hgrnic_create_srq_resp uresp = {};
+    struct hgrnic_mailbox *mailbox;
+    struct hgrnic_srq_context *context;
+    int err;
+
+    if (init_attr->srq_type != IB_SRQT_BASIC)
+        return -EOPNOTSUPP;
+
+    err = hgrnic_set_srq_size(dev, &init_attr->attr, srq);
+    if (err)
+        return err;
+
+    if (udata) {
+        if (ib_copy_from_udata(&ucmd, udata, sizeof ucmd))
+            return -EFAULT;
+        srq->mr.ibmr.lkey = ucmd.lkey;
+    }
+
+    srq->srqn = hgrnic_alloc(&dev->srq_table.alloc);
+    if (srq->srqn == -1)
+        return -ENOMEM;
+
+    err = hgrnic_reg_icm(dev, dev->srq_table.table, srq->srqn, CXT_REGION);
+    if (err)
+        goto err_out;
+
+    if (!udata) {
+        err = hgrnic_alloc_srq_buf(dev, pd, srq);
+        if (err)
+            goto err_out_icm;
+    }
+
+    spin_lock_init(&srq->lock);
+    refcount_set(&srq->refcount, 1);
+    init_waitqueue_head(&srq->wait);
+    srq->head = 0;
+
+    mailbox = hgrnic_alloc_mailbox(dev, GFP_KERNEL);
+    if (IS_ERR(mailbox)) {
+        err = PTR_ERR(mailbox);
+        goto err_out_free_buf;
+    }
+
+    context = mailbox->buf;
+    memset(context, 0, sizeof *context);
+    context->flags           = cpu_to_be32(HGRNIC_SRQ_STATE_OK);
+    context->logsize         = ffs(srq->max) - 1;
+    context->entry_sz_log    = srq->entry_sz_log;
+    context->limit_watermark = cpu_to_be16(init_attr->attr.srq_limit);
+    context->pd              = cpu_to_be32(pd->pd_num);
+    context->lkey            = cpu_to_be32(srq->mr.ibmr.lkey);
+    context->srqn            = cpu_to_be32(srq->srqn);
+
+    err = hgrnic_SW2HW_SRQ(dev, mailbox, srq->srqn);
+    hgrnic_free_mailbox(dev, mailbox);
+    if (err) {
+        hgrnic_warn(dev, "SW2HW_SRQ failed (%d)\n", err);
+        goto err_out_free_buf;
+    }
+
+    err = xa_err(xa_store(&dev->srq_table.srq,
+                          srq->srqn & (dev->limits.num_srqs - 1),
+                          srq, GFP_KERNEL));
+    if (err)
+        goto err_out_hw;
+
+    uresp.srqn = srq->srqn;
+    if (udata && ib_copy_to_udata(udata, &uresp, sizeof uresp)) {
+        err = -EFAULT;
+        goto err_out_xa;
+    }
+
+    init_attr->attr.max_wr  = srq->max;
+    init_attr->attr.max_sge = srq->max_gs;
+
+    return 0;
+
+err_out_xa:
+    xa_erase(&dev->srq_table.srq, srq->srqn & (dev->limits.num_srqs - 1));
+    synchronize_rcu();
+
+err_out_hw:
+    hgrnic_HW2SW_SRQ(dev, srq->srqn);
+
+err_out_free_buf:
+    if (!udata)
+        hgrnic_free_srq_buf(dev, srq);
+
+err_out_icm:
+    hgrnic_unreg_icm(dev, dev->srq_table.table, srq->srqn, CXT_REGION);
+
+err_out:
+    hgrnic_free(&dev->srq_table.alloc, srq->srqn);
+
+    return err;
+}
+
+void hgrnic_destroy_srq(struct ib_srq *ibsrq, struct ib_udata *udata)
+{
+    struct hgrnic_dev *dev = to_hgdev(ibsrq->device);
+    struct hgrnic_srq *srq = to_hgsrq(ibsrq);
+    int err;
+
+    err = hgrnic_HW2SW_SRQ(dev, srq->srqn);
+    if (err)
+        hgrnic_warn(dev, "HW2SW_SRQ failed (%d)\n", err);
+
+    xa_erase(&dev->srq_table.srq, srq->srqn & (dev->limits.num_srqs - 1));
+
+    /* No lookup may still hold the pointer without a reference. */
+    synchronize_rcu();
+
+    if (refcount_dec_and_test(&srq->refcount))
+        wake_up(&srq->wait);
+    wait_event(srq->wait, !refcount_read(&srq->refcount));
+
+    if (!udata)
+        hgrnic_free_srq_buf(dev, srq);
+
+    hgrnic_unreg_icm(dev, dev->srq_table.table, srq->srqn, CXT_REGION);
+    hgrnic_free(&dev->srq_table.alloc, srq->srqn);
+}
+
+/**
+ * @note Only the limit can be changed, the ring is not resized.
+ * Setting it arms the SRQ limit event.
+ */
+int hgrnic_modify_srq(struct ib_srq *ibsrq, struct ib_srq_attr *attr,
+                      enum ib_srq_attr_mask attr_mask, struct ib_udata *udata)
+{
+    struct hgrnic_dev *dev = to_hgdev(ibsrq->device);
+    struct hgrnic_srq *srq = to_hgsrq(ibsrq);
+    int err;
+
+    if (attr_mask & IB_SRQ_MAX_WR)
+        return -EINVAL;
+
+    if (attr_mask & IB_SRQ_LIMIT) {
+        if (attr->srq_limit > srq->max)
+            return -EINVAL;
+
+        err = hgrnic_ARM_SRQ(dev, srq->srqn, attr->srq_limit);
+        if (err)
+            return err;
+    }
+
+    return 0;
+}
+
+int hgrnic_query_srq(struct ib_srq *ibsrq, struct ib_srq_attr *srq_attr)
+{
+    struct hgrnic_dev *dev = to_hgdev(ibsrq->device);
+    struct hgrnic_srq *srq = to_hgsrq(ibsrq);
+    struct hgrnic_mailbox *mailbox;
+    struct hgrnic_srq_context *context;
+    int err;
+
+    mailbox = hgrnic_alloc_mailbox(dev, GFP_KERNEL);
+    if (IS_ERR(mailbox))
+        return PTR_ERR(mailbox);
+
+    err = hgrnic_QUERY_SRQ(dev, srq->srqn, mailbox);
+    if (err)
+        goto out;
+
+    context = mailbox->buf;
+    srq_attr->srq_limit = be16_to_cpu(context->limit_watermark);
+    srq_attr->max_wr    = srq->max;
+    srq_attr->max_sge   = srq->max_gs;
+
+out:
+    hgrnic_free_mailbox(dev, mailbox);
+    return err;
+}
+
+/**
+ * @note Post receive WQEs to a kernel SRQ. Each WQE is marked valid
+ * by itself, the HCA takes them in ring order and zeroes the first
+ * word once it has taken one.
+ */
+int hgrnic_post_srq_recv(struct ib_srq *ibsrq, const struct ib_recv_wr *wr,
+                         const struct ib_recv_wr **bad_wr)
+{
+    struct hgrnic_srq *srq = to_hgsrq(ibsrq);
+    struct hgrnic_next_unit *next;
+    unsigned long flags;
+    int err = 0;
+    int ind;
+    int i;
+    void *wqe;
+
+    spin_lock_irqsave(&srq->lock, flags);
+
+    for (; wr; wr = wr->next) {
+        ind = srq->head & (srq->max - 1);
+
+        if (unlikely(test_bit(ind, srq->busy))) {
+            err = -ENOMEM;
+            *bad_wr = wr;
+            break;
+        }
+
+        if (unlikely(wr->num_sge > srq->max_gs)) {
+            err = -EINVAL;
+            *bad_wr = wr;
+            break;
+        }
+
+        next = get_srq_wqe(srq, ind);
+        next->ee_nds = 0;
+        next->flags  = 0;
+
+        wqe = next + 1;
+        for (i = 0; i < wr->num_sge; ++i) {
+            hgrnic_set_data_unit(wqe, wr->sg_list + i);
+            wqe += sizeof (struct hgrnic_data_unit);
+        }
+
+        /* end of data unit */
+        if (i < srq->max_gs)
+            hgrnic_set_data_unit_inval(wqe);
+
+        srq->wr_id[ind] = wr->wr_id;
+        set_bit(ind, srq->busy);
+
+        /* The HCA must not see the WQE valid before its data units. */
+        wmb();
+        next->nda_nop = cpu_to_le32(HGRNIC_NEXT_VALID);
+
+        ++srq->head;
+    }
+
+    spin_unlock_irqrestore(&srq->lock, flags);
+    return err;
+}
+
+/**
+ * @note Give a polled (or cleaned) receive WQE back to the ring.
+ * Called with the CQ lock held, possibly of different CQs.
+ */
+void hgrnic_free_srq_wqe(struct hgrnic_srq *srq, int wqe_index)
+{
+    if (srq->busy)
+        clear_bit(wqe_index, srq->busy);
+}
+
+void hgrnic_srq_event(struct hgrnic_dev *dev, u32 srqn,
+                      enum ib_event_type event_type)
+{
+    struct hgrnic_srq *srq;
+    struct ib_event event;
+
+    rcu_read_lock();
+    srq = xa_load(&dev->srq_table.srq, srqn & (dev->limits.num_srqs - 1));
+    if (srq && !refcount_inc_not_zero(&srq->refcount))
+        srq = NULL;
+    rcu_read_unlock();
+
+    if (!srq) {
+        hgrnic_warn(dev, "Async event for bogus SRQ %08x\n", srqn);
+        return;
+    }
+
+    event.device      = &dev->ib_dev;
+    event.event       = event_type;
+    event.element.srq = &srq->ibsrq;
+    if (srq->ibsrq.event_handler)
+        srq->ibsrq.event_handler(&event, srq->ibsrq.srq_context);
+
+    if (refcount_dec_and_test(&srq->refcount))
+        wake_up(&srq->wait);
+}
+
+int hgrnic_init_srq_table(struct hgrnic_dev *dev)
+{
+    int err;
+
+    if (!dev->limits.num_srqs)
+        return 0;
+
+    err = hgrnic_alloc_init(&dev->srq_table.alloc,
+                            dev->limits.num_srqs,
+                            (1 << 24) - 1);
+    if (err)
+        return err;
+
+    xa_init(&dev->srq_table.srq);
+
+    return 0;
+}
+
+void hgrnic_cleanup_srq_table(struct hgrnic_dev *dev)
+{
+    if (!dev->limits.num_srqs)
+        return;
+
+    WARN_ON(!xa_empty(&dev->srq_table.srq));
+    xa_destroy(&dev->srq_table.srq);
+    hgrnic_alloc_cleanup(&dev->srq_table.alloc);
+}
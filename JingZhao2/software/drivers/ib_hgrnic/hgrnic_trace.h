@@ -0,0 +1,91 @@
+/**************************************************************
+ * @file hgrnic_trace.h
+ * @note Tracepoints of ib_hgrnic, under events/hgrnic/.
+ * Instantiated in hgrnic_cmd.c.
+ *************************************************************/
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM hgrnic
+
+#if !defined(_HGRNIC_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _HGRNIC_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/pci.h>
+
+#include "hgrnic_dev.h"
+
+/* An HCR command is written to the HCA with the go bit set. */
+TRACE_EVENT(hgrnic_cmd_post,
+    TP_PROTO(struct hgrnic_dev *dev, u16 op, u8 op_modifier,
+             u32 in_modifier, u16 token, u64 in_param),
+    TP_ARGS(dev, op, op_modifier, in_modifier, token, in_param),
+
+    TP_STRUCT__entry(
+        __string(dev, pci_name(dev->pdev))
+        __field(u16, op)
+        __field(u8,  op_modifier)
+        __field(u32, in_modifier)
+        __field(u16, token)
+        __field(u64, in_param)
+    ),
+
+    TP_fast_assign(
+        __assign_str(dev, pci_name(dev->pdev));
+        __entry->op          = op;
+        __entry->op_modifier = op_modifier;
+        __entry->in_modifier = in_modifier;
+        __entry->token       = token;
+        __entry->in_param    = in_param;
+    ),
+
+    TP_printk("%s op=0x%03x opmod=%u in_mod=0x%x token=0x%04x in_param=0x%llx",
+              __get_str(dev), __entry->op, __entry->op_modifier,
+              __entry->in_modifier, __entry->token, __entry->in_param)
+);
+
+/*
+ * The command finished, failed to post or timed out. status is the
+ * HCR status byte (0 unless the HCA completed it), err the errno
+ * returned to the caller, latency_ns the time since poll_sem was taken.
+ */
+TRACE_EVENT(hgrnic_cmd_done,
+    TP_PROTO(struct hgrnic_dev *dev, u16 op, u8 op_modifier,
+             u32 in_modifier, u16 token, u8 status, int err, u64 latency_ns),
+    TP_ARGS(dev, op, op_modifier, in_modifier, token, status, err, latency_ns),
+
+    TP_STRUCT__entry(
+        __string(dev, pci_name(dev->pdev))
+        __field(u16, op)
+        __field(u8,  op_modifier)
+        __field(u32, in_modifier)
+        __field(u16, token)
+        __field(u8,  status)
+        __field(int, err)
+        __field(u64, latency_ns)
+    ),
+
+    TP_fast_assign(
+        __assign_str(dev, pci_name(dev->pdev));
+        __entry->op          = op;
+        __entry->op_modifier = op_modifier;
+        __entry->in_modifier = in_modifier;
+        __entry->token       = token;
+        __entry->status      = status;
+        __entry->err         = err;
+        __entry->latency_ns  = latency_ns;
+    ),
+
+    TP_printk("%s op=0x%03x opmod=%u in_mod=0x%x token=0x%04x status=0x%02x err=%d latency=%lluns",
+              __get_str(dev), __entry->op, __entry->op_modifier,
+              __entry->in_modifier, __entry->token, __entry->status,
+              __entry->err, __entry->latency_ns)
+);
+
+#endif /* _HGRNIC_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE hgrnic_trace
+#include <trace/define_trace.h>
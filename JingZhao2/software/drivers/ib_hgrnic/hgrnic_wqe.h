@@ -13,11 +13,22 @@
 enum {
     HGRNIC_NEXT_DBD          = 1 << 7,
     HGRNIC_NEXT_FENCE        = 1 << 6,
+    HGRNIC_NEXT_VALID        = 1 << 5, /* next unit points to a valid WQE */
     HGRNIC_NEXT_CQ_UPDATE    = 1 << 3,
     HGRNIC_NEXT_EVENT_GEN    = 1 << 2,
     HGRNIC_NEXT_SOLICIT      = 1 << 1
 };
 
+/* Fields of next unit flags describing the WQE the unit belongs to */
+enum {
+    HGRNIC_NEXT_CUR_SIZE_SHIFT   = 6,  /* [13:6] WQE size, 16-byte units */
+    HGRNIC_NEXT_CUR_OPCODE_SHIFT = 14  /* [21:14] WQE opcode */
+};
+
+enum {
+    HGRNIC_INLINE_UNIT = 1 << 31
+};
+
 enum {
     HGRNIC_INVAL_LKEY           = 0x100,
     HGRNIC_MAX_WQES_PER_SEND_DB = 255
@@ -26,7 +37,7 @@ enum {
 struct hgrnic_next_unit {
     __le32 nda_nop;      /* [31:6] next WQE [4:0] next opcode */
     __le32 ee_nds;      /* [31:8] next EE  [7] DBD [6] F [5:0] next WQE size */
-    __le32 flags;       /* [3] CQ [2] Event [1] Solicit */
+    __le32 flags;       /* [21:14] opcode [13:6] size [3] CQ [2] Event [1] Solicit */
     __le32 imm;         /* immediate data */
 };
 
@@ -53,6 +64,15 @@ struct hgrnic_atomic_unit {
     __le64 compare;
 };
 
+/* Masked CS/FA. For FA, compare_mask marks the bit after the end of
+ * each field: carries are not propagated across it. */
+struct hgrnic_masked_atomic_unit {
+    __le64 swap_add;
+    __le64 compare;
+    __le64 swap_add_mask;
+    __le64 compare_mask;
+};
+
 struct hgrnic_inline_unit {
     __le32 length;
 };
@@ -63,6 +83,25 @@ struct hgrnic_data_unit {
     __le64 addr;
 };
 
+/* IB_WR_REG_MR, MRMgt copies the page list into the MR's MTT range
+ * and rewrites the MPT entry. */
+struct hgrnic_fastreg_unit {
+    __le32 flags;       /* MPT access flags */
+    __le32 mem_key;
+    __le32 page_size;
+    __le32 pbl_len;     /* number of entries in page list */
+    __le64 start;       /* iova */
+    __le64 length;
+    __le64 pbl_addr;    /* bus addr of page list (be64 entries) */
+    __le64 mtt_seg;     /* first MTT index of this MR */
+};
+
+/* IB_WR_LOCAL_INV */
+struct hgrnic_local_inv_unit {
+    __le32 mem_key;
+    u32    reserved[3];
+};
+
 static __always_inline void set_raddr_unit(struct hgrnic_raddr_unit *runit,
                                            u64 remote_addr, u32 rkey)
 {
@@ -75,14 +114,54 @@ static __always_inline void set_atomic_seg(struct hgrnic_atomic_unit *aseg,
                                            const struct ib_atomic_wr *wr)
 {
     if (wr->wr.opcode == IB_WR_ATOMIC_CMP_AND_SWP) {
-        aseg->swap_add = cpu_to_be64(wr->swap);
-        aseg->compare  = cpu_to_be64(wr->compare_add);
+        aseg->swap_add = cpu_to_le64(wr->swap);
+        aseg->compare  = cpu_to_le64(wr->compare_add);
     } else {
-        aseg->swap_add = cpu_to_be64(wr->compare_add);
+        aseg->swap_add = cpu_to_le64(wr->compare_add);
         aseg->compare  = 0;
     }
 }
 
+static __always_inline void set_masked_atomic_seg(struct hgrnic_masked_atomic_unit *aseg,
+                                                  const struct ib_atomic_wr *wr)
+{
+    if (wr->wr.opcode == IB_WR_MASKED_ATOMIC_CMP_AND_SWP) {
+        aseg->swap_add      = cpu_to_le64(wr->swap);
+        aseg->swap_add_mask = cpu_to_le64(wr->swap_mask);
+        aseg->compare       = cpu_to_le64(wr->compare_add);
+        aseg->compare_mask  = cpu_to_le64(wr->compare_add_mask);
+    } else {
+        aseg->swap_add      = cpu_to_le64(wr->compare_add);
+        aseg->swap_add_mask = cpu_to_le64(wr->compare_add_mask);
+        aseg->compare       = 0;
+        aseg->compare_mask  = 0;
+    }
+}
+
+static __always_inline void set_fastreg_unit(struct hgrnic_fastreg_unit *funit,
+                                             const struct ib_reg_wr *wr)
+{
+    struct hgrnic_mr *mr = to_hgmr(wr->mr);
+
+    funit->flags     = cpu_to_le32(convert_access(wr->access));
+    funit->mem_key   = cpu_to_le32(wr->key);
+    funit->page_size = cpu_to_le32(mr->ibmr.page_size);
+    funit->pbl_len   = cpu_to_le32(mr->npages);
+    funit->start     = cpu_to_le64(mr->ibmr.iova);
+    funit->length    = cpu_to_le64(mr->ibmr.length);
+    funit->pbl_addr  = cpu_to_le64(mr->page_map);
+    funit->mtt_seg   = cpu_to_le64(mr->mtt->first_index);
+}
+
+static __always_inline void set_local_inv_unit(struct hgrnic_local_inv_unit *iunit,
+                                               u32 key)
+{
+    iunit->mem_key     = cpu_to_le32(key);
+    iunit->reserved[0] = 0;
+    iunit->reserved[1] = 0;
+    iunit->reserved[2] = 0;
+}
+
 static __always_inline void set_ud_unit(struct hgrnic_ud_unit *uunit,
                                         const struct ib_ud_wr *wr)
 {
@@ -92,6 +171,8 @@ static __always_inline void set_ud_unit(struct hgrnic_ud_unit *uunit,
     uunit->smac_h = cpu_to_le32((hgah->slid >> 16) & 0xffffffff);
     uunit->dlid   = cpu_to_le16(hgah->dlid & 0xffff);
     uunit->dmac_h = cpu_to_le32((hgah->dlid >> 16) & 0xffffffff);
+    uunit->dqpn   = cpu_to_le32(wr->remote_qpn);
+    uunit->qkey   = cpu_to_le32(wr->remote_qkey);
 }
 
 static __always_inline void hgrnic_send_dbell(struct hgrnic_dev *dev, struct hgrnic_qp *qp, 
@@ -99,24 +180,44 @@ static __always_inline void hgrnic_send_dbell(struct hgrnic_dev *dev, struct hgr
 {
     u32 dbhi, dblo;
 
+    /* Same layout as libhgrnic: first WQE offset in 16-byte units. */
     dbhi = (qp->qpn << 8) | size0;
-    dblo = ((qp->sq.head & 0xffff) << 8) | f0 | op0;
+    dblo = (((qp->sq.head & (qp->sq.max - 1)) <<
+             (qp->sq.entry_sz_log - 4)) << 8) | f0 | op0;
 
     qp->sq.head += nreq;
 
     wmb();
     hgrnic_write64(dbhi, dblo, dev->kar + HGRNIC_SEND_DOORBELL,
                 HGRNIC_GET_DOORBELL_LOCK(&dev->doorbell_lock));
-    hgrnic_dump("0x%x", dbhi);
-    hgrnic_dump("0x%x", dblo);
 }
 
-static __always_inline void hgrnic_set_inline_unit (struct hgrnic_inline_unit *unit,
-                                                    u32 length, u8 *data)
+/**
+ * @note Copy the gather list of an IB_SEND_INLINE request into the WQE.
+ * sge->addr is a kernel virtual address for inline sends.
+ * @return Number of bytes copied, or -EINVAL if more than max_inline.
+ */
+static __always_inline int hgrnic_set_inline_unit (struct hgrnic_inline_unit *unit,
+                                                   const struct ib_send_wr *wr,
+                                                   int max_inline)
 {
-    unit->length = (1 << 31) | length;
-    unit += sizeof(struct hgrnic_inline_unit);
-    memcpy(unit, data, length);
+    void *data = unit + 1;
+    int len = 0;
+    int i;
+
+    for (i = 0; i < wr->num_sge; ++i) {
+        len += wr->sg_list[i].length;
+        if (unlikely(len > max_inline))
+            return -EINVAL;
+
+        memcpy(data, (void *) (uintptr_t) wr->sg_list[i].addr,
+               wr->sg_list[i].length);
+        data += wr->sg_list[i].length;
+    }
+
+    unit->length = cpu_to_le32(HGRNIC_INLINE_UNIT | len);
+
+    return len;
 }
 
 static __always_inline void hgrnic_set_data_unit (struct hgrnic_data_unit *dunit,
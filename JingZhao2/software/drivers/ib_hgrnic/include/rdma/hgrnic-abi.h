@@ -41,9 +41,14 @@
  * In particular do not use pointer types -- pass pointers in __u64
  * instead.
  */
+/* mmap offset, in pages, of the read-only HCA clock page */
+#define HGRNIC_MMAP_CLOCK_PAGE 1
+
 struct hgrnic_alloc_ucontext_resp {
     __u32 qp_tab_size;
-    __u32 reserved;
+    __s32 numa_node; /* NUMA node of the HCA, -1 if unknown */
+    __u32 hca_core_clock; /* kHz */
+    __u32 clock_offset; /* of HCA_CLOCK_LO in the clock page */
 };
 
 struct hgrnic_alloc_pd_resp {
@@ -81,4 +86,14 @@ struct hgrnic_create_qp {
     __u32 rq_lkey;
     __u32 sq_lkey;
 };
+
+struct hgrnic_create_srq {
+    __u32 lkey;
+    __u32 reserved;
+};
+
+struct hgrnic_create_srq_resp {
+    __u32 srqn;
+    __u32 reserved;
+};
 #endif /* HGRNIC_ABI_USER_H */
@@ -0,0 +1,224 @@
+/**************************************************************
+ * @file hgrnic_alloc_stress.c
+ * @note Stress test of the hgrnic resource ID allocator.
+ * Runs 1, 2, 4 ... max_threads kthreads, each allocating and
+ * freeing IDs in a loop, once with the per-CPU magazines and once
+ * with the plain bitmap, and prints allocations per second. Every
+ * ID handed out is checked against a shared ownership bitmap, so a
+ * duplicate ID fails the test. Needs no hgrnic device, only the
+ * symbols exported by ib_hgrnic.
+ *
+ *   insmod hgrnic_alloc_stress.ko max_threads=64 duration_ms=1000
+ *   dmesg | grep hgrnic_alloc_stress
+ *************************************************************/
+
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/bitmap.h>
+#include <linux/percpu.h>
+#include <linux/ktime.h>
+#include <linux/delay.h>
+#include <linux/slab.h>
+
+#include "hgrnic_dev.h"
+
+#define PFX_STRESS "hgrnic_alloc_stress: "
+
+#define STRESS_BATCH 8 /* IDs held by one thread at a time */
+
+static int max_threads = 64;
+module_param(max_threads, int, 0444);
+MODULE_PARM_DESC(max_threads, "Largest thread count of the sweep (default 64)");
+
+static int duration_ms = 1000;
+module_param(duration_ms, int, 0444);
+MODULE_PARM_DESC(duration_ms, "Run time of every point of the sweep (default 1000)");
+
+static int table_size = 1 << 16;
+module_param(table_size, int, 0444);
+MODULE_PARM_DESC(table_size, "Number of IDs in the table, power of 2 (default 65536)");
+
+struct stress_ctx {
+    struct hgrnic_alloc alloc;
+    unsigned long      *owned;  /* IDs currently held by a thread */
+    atomic_t            ready;
+    struct completion   start;
+    bool                stop;
+    atomic_t            dups;
+    atomic_t            fails;
+};
+
+struct stress_thread {
+    struct stress_ctx  *ctx;
+    struct completion   done;
+    u64                 ops;
+};
+
+static int stress_fn (void *arg)
+{
+    struct stress_thread *t = arg;
+    struct stress_ctx *ctx = t->ctx;
+    u32 ids[STRESS_BATCH];
+    u32 idx;
+    int i, n;
+
+    atomic_inc(&ctx->ready);
+    wait_for_completion(&ctx->start);
+
+    while (!READ_ONCE(ctx->stop)) {
+        for (n = 0; n < STRESS_BATCH; ++n) {
+            ids[n] = hgrnic_alloc(&ctx->alloc);
+            if (ids[n] == -1) {
+                atomic_inc(&ctx->fails);
+                break;
+            }
+
+            idx = ids[n] & (ctx->alloc.max - 1);
+            if (test_and_set_bit(idx, ctx->owned))
+                atomic_inc(&ctx->dups);
+        }
+
+        for (i = 0; i < n; ++i) {
+            clear_bit(ids[i] & (ctx->alloc.max - 1), ctx->owned);
+            hgrnic_free(&ctx->alloc, ids[i]);
+        }
+
+        t->ops += n;
+        cond_resched();
+    }
+
+    complete(&t->done);
+    return 0;
+}
+
+/**
+ * @note Run one point of the sweep. Returns allocations per second,
+ * or a negative errno.
+ */
+static s64 stress_run (int nr_threads, bool use_mags)
+{
+    struct stress_thread *threads;
+    struct task_struct *task;
+    struct stress_ctx *ctx;
+    ktime_t begin;
+    s64 elapsed_ns, rate = 0;
+    u64 ops = 0;
+    int i, err;
+
+    ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+    threads = kcalloc(nr_threads, sizeof(*threads), GFP_KERNEL);
+    if (!ctx || !threads) {
+        err = -ENOMEM;
+        goto err_free;
+    }
+
+    err = hgrnic_alloc_init(&ctx->alloc, table_size, (1 << 24) - 1);
+    if (err)
+        goto err_free;
+
+    /* Bitmap baseline: drop the magazines, as for small tables */
+    if (!use_mags && ctx->alloc.mags) {
+        free_percpu(ctx->alloc.mags);
+        ctx->alloc.mags = NULL;
+    }
+    if (use_mags && !ctx->alloc.mags) {
+        pr_info(PFX_STRESS "table of %d IDs too small for magazines on %u CPUs\n",
+                table_size, num_possible_cpus());
+        err = -EINVAL;
+        goto err_cleanup;
+    }
+
+    ctx->owned = bitmap_zalloc(table_size, GFP_KERNEL);
+    if (!ctx->owned) {
+        err = -ENOMEM;
+        goto err_cleanup;
+    }
+    init_completion(&ctx->start);
+
+    for (i = 0; i < nr_threads; ++i) {
+        threads[i].ctx = ctx;
+        init_completion(&threads[i].done);
+
+        task = kthread_create(stress_fn, &threads[i], "hgalloc_stress/%d", i);
+        if (IS_ERR(task)) {
+            /* Let the threads already created run out */
+            WRITE_ONCE(ctx->stop, true);
+            complete_all(&ctx->start);
+            while (i--)
+                wait_for_completion(&threads[i].done);
+            err = PTR_ERR(task);
+            goto err_owned;
+        }
+        kthread_bind(task, cpumask_local_spread(i, NUMA_NO_NODE));
+        wake_up_process(task);
+    }
+
+    while (atomic_read(&ctx->ready) < nr_threads)
+        msleep(1);
+
+    begin = ktime_get();
+    complete_all(&ctx->start);
+    msleep(duration_ms);
+    WRITE_ONCE(ctx->stop, true);
+
+    for (i = 0; i < nr_threads; ++i) {
+        wait_for_completion(&threads[i].done);
+        ops += threads[i].ops;
+    }
+    elapsed_ns = ktime_to_ns(ktime_sub(ktime_get(), begin));
+
+    rate = div64_s64(ops * NSEC_PER_SEC, elapsed_ns);
+    pr_info(PFX_STRESS "%-6s threads %2d: %12lld allocs/s, %d dup, %d failed\n",
+            use_mags ? "mag" : "bitmap", nr_threads, rate,
+            atomic_read(&ctx->dups), atomic_read(&ctx->fails));
+    err = atomic_read(&ctx->dups) ? -EIO : 0;
+
+err_owned:
+    bitmap_free(ctx->owned);
+err_cleanup:
+    hgrnic_alloc_cleanup(&ctx->alloc);
+err_free:
+    kfree(threads);
+    kfree(ctx);
+    return err ? err : rate;
+}
+
+static int __init hgrnic_alloc_stress_init (void)
+{
+    s64 mag, bitmap;
+    int nr;
+
+    if (table_size <= 0 || !is_power_of_2(table_size) ||
+        max_threads <= 0 || duration_ms <= 0)
+        return -EINVAL;
+
+    pr_info(PFX_STRESS "%d IDs, %d ms per point, %u online CPUs\n",
+            table_size, duration_ms, num_online_cpus());
+
+    for (nr = 1; nr <= max_threads; nr *= 2) {
+        bitmap = stress_run(nr, false);
+        if (bitmap < 0)
+            return bitmap;
+
+        mag = stress_run(nr, true);
+        if (mag < 0)
+            return mag;
+
+        if (bitmap)
+            pr_info(PFX_STRESS "threads %2d: mag/bitmap %lld.%02lld\n", nr,
+                    div64_s64(mag, bitmap), div64_s64(mag * 100, bitmap) % 100);
+    }
+
+    return 0;
+}
+
+static void __exit hgrnic_alloc_stress_exit (void)
+{
+}
+
+module_init(hgrnic_alloc_stress_init);
+module_exit(hgrnic_alloc_stress_exit);
+
+MODULE_DESCRIPTION("Stress test of the hgrnic resource ID allocator");
+MODULE_LICENSE("Dual BSD/GPL");
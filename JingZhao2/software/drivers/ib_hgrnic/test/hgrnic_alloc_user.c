@@ -0,0 +1,407 @@
+/**************************************************************
+ * @file hgrnic_alloc_user.c
+ * @note Userspace build of the hgrnic resource ID allocator.
+ * Compiles ../hgrnic_allocator.c against the few kernel interfaces
+ * it uses, with one pthread per "CPU", and checks
+ *  - no ID is handed out twice (the hgrnic_alloc_stress.ko sweep),
+ *  - top moves one generation per freed ID, with magazines too,
+ *  - IDs parked in another CPU's magazine are given back when the
+ *    bitmap runs dry.
+ * Runs where no kernel headers are installed:
+ *
+ *   make -C test check
+ *************************************************************/
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef uint64_t dma_addr_t;
+
+/* ------------------------- kernel shims ------------------------- */
+
+#define NR_CPUS 8
+
+static __thread int this_cpu;
+
+#define PAGE_SIZE  4096
+#define PAGE_SHIFT 12
+#define GFP_KERNEL 0
+#define __GFP_NOWARN 0
+#define __GFP_NORETRY 0
+#define __percpu
+#define EXPORT_SYMBOL_GPL(sym)
+#define module_param(name, type, perm)
+#define MODULE_PARM_DESC(name, desc)
+
+#define READ_ONCE(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define WRITE_ONCE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+
+#define BITS_PER_LONG (8 * sizeof(long))
+#define BITS_TO_LONGS(n) (((n) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+
+static inline void set_bit (u32 nr, unsigned long *map)
+{
+    __atomic_fetch_or(&map[nr / BITS_PER_LONG], 1UL << (nr % BITS_PER_LONG),
+                      __ATOMIC_RELAXED);
+}
+
+static inline void clear_bit (u32 nr, unsigned long *map)
+{
+    __atomic_fetch_and(&map[nr / BITS_PER_LONG], ~(1UL << (nr % BITS_PER_LONG)),
+                       __ATOMIC_RELAXED);
+}
+
+static inline int test_and_set_bit (u32 nr, unsigned long *map)
+{
+    unsigned long bit = 1UL << (nr % BITS_PER_LONG);
+
+    return !!(__atomic_fetch_or(&map[nr / BITS_PER_LONG], bit,
+                                __ATOMIC_RELAXED) & bit);
+}
+
+static inline u32 find_next_zero_bit (const unsigned long *map, u32 size,
+                                      u32 start)
+{
+    for (; start < size; ++start)
+        if (!(map[start / BITS_PER_LONG] & (1UL << (start % BITS_PER_LONG))))
+            break;
+    return start < size ? start : size;
+}
+
+#define find_first_zero_bit(map, size) find_next_zero_bit(map, size, 0)
+
+static inline void bitmap_zero (unsigned long *map, u32 n)
+{
+    memset(map, 0, BITS_TO_LONGS(n) * sizeof(long));
+}
+
+static inline u32 bitmap_weight (const unsigned long *map, u32 n)
+{
+    u32 i, w = 0;
+
+    for (i = 0; i < n; ++i)
+        w += !!(map[i / BITS_PER_LONG] & (1UL << (i % BITS_PER_LONG)));
+    return w;
+}
+
+typedef pthread_spinlock_t spinlock_t;
+#define spin_lock_init(l) pthread_spin_init(l, PTHREAD_PROCESS_PRIVATE)
+#define spin_lock(l) pthread_spin_lock(l)
+#define spin_unlock(l) pthread_spin_unlock(l)
+#define spin_lock_irqsave(l, f) do { (f) = 0; pthread_spin_lock(l); } while (0)
+#define spin_unlock_irqrestore(l, f) do { (void) (f); pthread_spin_unlock(l); } while (0)
+
+#define kmalloc_array(n, size, gfp) malloc((n) * (size))
+#define kfree(p) free(p)
+
+#define alloc_percpu(type) ((type *) calloc(NR_CPUS, sizeof(type)))
+#define free_percpu(p) free(p)
+#define per_cpu_ptr(p, cpu) (&(p)[cpu])
+#define raw_cpu_ptr(p) (&(p)[this_cpu])
+#define num_possible_cpus() NR_CPUS
+#define for_each_possible_cpu(cpu) for ((cpu) = 0; (cpu) < NR_CPUS; ++(cpu))
+
+struct seq_file;
+#define seq_printf(s, fmt, ...) ((void) (s))
+
+/* Queue buffer half of hgrnic_allocator.c, compiled but not run */
+struct device { int unused; };
+struct pci_dev { struct device dev; };
+struct hgrnic_dev { struct pci_dev *pdev; };
+struct hgrnic_pd { u32 pd_num; };
+struct hgrnic_mr { int unused; };
+struct hgrnic_buf_list { void *buf; dma_addr_t mapping; };
+union hgrnic_buf {
+    struct hgrnic_buf_list  direct;
+    struct hgrnic_buf_list *page_list;
+};
+
+#define HGRNIC_MPT_FLAG_LOCAL_READ  (1 << 10)
+#define HGRNIC_MPT_FLAG_LOCAL_WRITE (1 << 11)
+#define hgrnic_dbg(mdev, format, arg...) do { (void) mdev; } while (0)
+#define dma_unmap_addr(p, field) ((p)->field)
+#define dma_unmap_addr_set(p, field, v) ((p)->field = (v))
+#define dma_alloc_coherent(dev, size, handle, gfp) ((void) (dev), (void *) 0)
+#define dma_free_coherent(dev, size, cpu, handle) ((void) (dev))
+#define clear_page(p) memset(p, 0, PAGE_SIZE)
+
+static int hgrnic_mr_alloc_phys (struct hgrnic_dev *dev, u32 pd,
+                                 u64 *buffer_list, int buffer_size_shift,
+                                 int list_len, u64 iova, u64 total_size,
+                                 u32 access, struct hgrnic_mr *mr)
+{
+    return -ENOMEM;
+}
+
+static void hgrnic_free_mr (struct hgrnic_dev *dev, struct hgrnic_mr *mr)
+{
+}
+
+/* Keep in sync with hgrnic_dev.h */
+enum {
+    HGRNIC_ALLOC_MAG_SIZE = 16,
+    HGRNIC_ALLOC_MAG_MIN  = 64
+};
+
+struct hgrnic_alloc_mag {
+    spinlock_t     lock;
+    u32            nr_alloc;
+    u32            nr_free;
+    u32            alloc_ids[HGRNIC_ALLOC_MAG_SIZE];
+    u32            free_ids[HGRNIC_ALLOC_MAG_SIZE];
+};
+
+struct hgrnic_alloc {
+    u32            last;
+    u32            top;
+    u32            max;
+    u32            mask;
+    spinlock_t     lock;
+    unsigned long *table;
+    struct hgrnic_alloc_mag __percpu *mags;
+};
+
+u32 hgrnic_alloc (struct hgrnic_alloc *alloc);
+void hgrnic_free (struct hgrnic_alloc *alloc, u32 obj);
+int hgrnic_alloc_init (struct hgrnic_alloc *alloc, u32 num, u32 mask);
+void hgrnic_alloc_cleanup (struct hgrnic_alloc *alloc);
+void hgrnic_alloc_show (struct hgrnic_alloc *alloc, const char *name,
+                        struct seq_file *s);
+int hgrnic_buf_alloc (struct hgrnic_dev *dev, int size,
+                      union hgrnic_buf *buf, int *is_direct,
+                      struct hgrnic_pd *pd, int hca_write,
+                      struct hgrnic_mr *mr);
+void hgrnic_buf_free (struct hgrnic_dev *dev, int size, union hgrnic_buf *buf,
+                      int is_direct, struct hgrnic_mr *mr);
+
+/* Keep the real header out, the shims above stand in for it */
+#define HGRNIC_DEV_H
+#include "../hgrnic_allocator.c"
+
+/* ---------------------------- tests ----------------------------- */
+
+#define STRESS_BATCH 8
+#define MASK ((1 << 24) - 1)
+
+static int failures;
+
+#define CHECK(cond, fmt, ...)                                        \
+    do {                                                             \
+        if (!(cond)) {                                               \
+            printf("FAIL %s: " fmt "\n", __func__, ## __VA_ARGS__);  \
+            ++failures;                                              \
+        }                                                            \
+    } while (0)
+
+struct stress_ctx {
+    struct hgrnic_alloc alloc;
+    unsigned long      *owned;
+    int                 ready;
+    bool                start;
+    bool                stop;
+    int                 dups;
+    int                 fails;
+};
+
+struct stress_thread {
+    struct stress_ctx *ctx;
+    pthread_t          tid;
+    int                cpu;
+    u64                ops;
+};
+
+static void *stress_fn (void *arg)
+{
+    struct stress_thread *t = arg;
+    struct stress_ctx *ctx = t->ctx;
+    u32 ids[STRESS_BATCH];
+    int i, n;
+
+    this_cpu = t->cpu;
+    __atomic_fetch_add(&ctx->ready, 1, __ATOMIC_RELAXED);
+    while (!READ_ONCE(ctx->start))
+        ;
+
+    while (!READ_ONCE(ctx->stop)) {
+        for (n = 0; n < STRESS_BATCH; ++n) {
+            ids[n] = hgrnic_alloc(&ctx->alloc);
+            if (ids[n] == -1) {
+                __atomic_fetch_add(&ctx->fails, 1, __ATOMIC_RELAXED);
+                break;
+            }
+            if (test_and_set_bit(ids[n] & (ctx->alloc.max - 1), ctx->owned))
+                __atomic_fetch_add(&ctx->dups, 1, __ATOMIC_RELAXED);
+        }
+
+        for (i = 0; i < n; ++i) {
+            clear_bit(ids[i] & (ctx->alloc.max - 1), ctx->owned);
+            hgrnic_free(&ctx->alloc, ids[i]);
+        }
+        t->ops += n;
+    }
+
+    return NULL;
+}
+
+static double now_sec (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @note One point of the hgrnic_alloc_stress.ko sweep. Returns
+ * allocations per second.
+ */
+static double stress_run (int nr_threads, bool use_mags, u32 table_size,
+                          int duration_ms)
+{
+    struct stress_thread threads[NR_CPUS];
+    struct stress_ctx ctx = { 0 };
+    struct timespec ts = { duration_ms / 1000, (duration_ms % 1000) * 1000000L };
+    double begin, elapsed;
+    u64 ops = 0;
+    int i;
+
+    CHECK(!hgrnic_alloc_init(&ctx.alloc, table_size, MASK), "init");
+    if (!use_mags) {
+        free_percpu(ctx.alloc.mags);
+        ctx.alloc.mags = NULL;
+    }
+    ctx.owned = calloc(BITS_TO_LONGS(table_size), sizeof(long));
+
+    for (i = 0; i < nr_threads; ++i) {
+        threads[i] = (struct stress_thread) { .ctx = &ctx, .cpu = i };
+        pthread_create(&threads[i].tid, NULL, stress_fn, &threads[i]);
+    }
+    while (READ_ONCE(ctx.ready) < nr_threads)
+        ;
+
+    begin = now_sec();
+    WRITE_ONCE(ctx.start, true);
+    nanosleep(&ts, NULL);
+    WRITE_ONCE(ctx.stop, true);
+
+    for (i = 0; i < nr_threads; ++i) {
+        pthread_join(threads[i].tid, NULL);
+        ops += threads[i].ops;
+    }
+    elapsed = now_sec() - begin;
+
+    printf("%-6s threads %d: %12.0f allocs/s, %d dup, %d failed\n",
+           use_mags ? "mag" : "bitmap", nr_threads, ops / elapsed,
+           ctx.dups, ctx.fails);
+    CHECK(!ctx.dups && !ctx.fails, "%d dup, %d failed", ctx.dups, ctx.fails);
+
+    free(ctx.owned);
+    hgrnic_alloc_cleanup(&ctx.alloc);
+    return ops / elapsed;
+}
+
+/**
+ * @note Free n IDs one by one and check that top moved n
+ * generations, with and without magazines.
+ */
+static void test_top_per_free (bool use_mags)
+{
+    struct hgrnic_alloc alloc;
+    u32 ids[100], top0;
+    int i, n = 100;
+
+    this_cpu = 0;
+    CHECK(!hgrnic_alloc_init(&alloc, 1024, MASK), "init");
+    CHECK(alloc.mags, "table of 1024 IDs has no magazines");
+    if (!use_mags) {
+        free_percpu(alloc.mags);
+        alloc.mags = NULL;
+    }
+
+    for (i = 0; i < n; ++i)
+        ids[i] = hgrnic_alloc(&alloc);
+
+    top0 = alloc.top;
+    for (i = 0; i < n; ++i)
+        hgrnic_free(&alloc, ids[i]);
+    if (use_mags)
+        hgrnic_mag_drain(&alloc); /* retire the IDs still parked */
+
+    CHECK(alloc.top == ((top0 + n * alloc.max) & MASK),
+          "top moved %u generations for %d frees",
+          ((alloc.top - top0) & MASK) / alloc.max, n);
+
+    /* A reused ID carries a prefix n generations past its old one */
+    for (i = 0; i < n; ++i) {
+        u32 id = hgrnic_alloc(&alloc);
+        u32 idx = id & (alloc.max - 1);
+        int j;
+
+        for (j = 0; j < n; ++j)
+            if ((ids[j] & (alloc.max - 1)) == idx)
+                CHECK(((id - ids[j]) & MASK) / alloc.max >= n,
+                      "ID %u reused %u generations after %u", id,
+                      ((id - ids[j]) & MASK) / alloc.max, ids[j]);
+    }
+
+    hgrnic_alloc_cleanup(&alloc);
+}
+
+/**
+ * @note CPU 0 takes every ID and frees them all, leaving some parked
+ * in its magazine; CPU 1 must still get every ID.
+ */
+static void test_parked_ids (void)
+{
+    struct hgrnic_alloc alloc;
+    u32 n = NR_CPUS * HGRNIC_ALLOC_MAG_MIN, id, i;
+
+    CHECK(!hgrnic_alloc_init(&alloc, n, MASK), "init");
+    CHECK(alloc.mags, "table of %u IDs has no magazines", n);
+
+    this_cpu = 0;
+    for (i = 0; i < n; ++i)
+        CHECK(hgrnic_alloc(&alloc) != -1, "CPU 0 allocation %u failed", i);
+    for (i = 0; i < n; ++i)
+        hgrnic_free(&alloc, i);
+    CHECK(per_cpu_ptr(alloc.mags, 0)->nr_free, "no ID parked on CPU 0");
+
+    this_cpu = 1;
+    for (i = 0; i < n; ++i) {
+        id = hgrnic_alloc(&alloc);
+        CHECK(id != -1, "CPU 1 allocation %u of %u failed", i, n);
+    }
+    CHECK(hgrnic_alloc(&alloc) == -1, "more than %u IDs handed out", n);
+
+    hgrnic_alloc_cleanup(&alloc);
+}
+
+int main (int argc, char *argv[])
+{
+    int duration_ms = argc > 1 ? atoi(argv[1]) : 200;
+    double mag, bitmap;
+    int nr;
+
+    test_top_per_free(false);
+    test_top_per_free(true);
+    test_parked_ids();
+
+    for (nr = 1; nr <= NR_CPUS; nr *= 2) {
+        bitmap = stress_run(nr, false, 1 << 16, duration_ms);
+        mag    = stress_run(nr, true,  1 << 16, duration_ms);
+        printf("threads %d: mag/bitmap %.2f\n", nr, bitmap ? mag / bitmap : 0);
+    }
+
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,390 @@
+/**************************************************************
+ * @file hgrnic_cq_moder.c
+ * @note Latency/CPU load generator for CQ event moderation. For every
+ * hgrnic device, sends msg_size byte SENDs between two RC QPs of the
+ * same port at a fixed rate for duration_ms. The receive CQ is polled
+ * from softirq, as ULPs do, so it runs under rdma_dim when ib_hgrnic
+ * enables it. Prints the achieved rate, the send-to-receive-callback
+ * latency (mean, p50, p99) and the irq+softirq CPU time per second.
+ * Compare ib_hgrnic loaded with cq_dim=1 and cq_dim=0 at a few rates:
+ *
+ *   insmod hgrnic_cq_moder.ko rate=200000 duration_ms=2000
+ *   dmesg | grep hgrnic_cq_moder
+ *************************************************************/
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include <linux/kernel_stat.h>
+#include <linux/log2.h>
+#include <rdma/ib_verbs.h>
+
+#include "hgrnic_test.h"
+
+#define PFX_CM "hgrnic_cq_moder: "
+
+#define CM_HIST_BUCKETS 64 /* log2(ns) */
+
+static int rate = 100000;
+module_param(rate, int, 0444);
+MODULE_PARM_DESC(rate, "Offered load in messages/sec (default 100000)");
+
+static int duration_ms = 2000;
+module_param(duration_ms, int, 0444);
+MODULE_PARM_DESC(duration_ms, "Run time (default 2000)");
+
+static int msg_size = 64;
+module_param(msg_size, int, 0444);
+MODULE_PARM_DESC(msg_size, "Message size in bytes, at least 8 (default 64)");
+
+static int depth = 256;
+module_param(depth, int, 0444);
+MODULE_PARM_DESC(depth, "Send and receive queue depth (default 256)");
+
+struct cm_ctx;
+
+struct cm_rx {
+    struct ib_cqe   cqe;
+    struct cm_ctx  *ctx;
+    int             slot;
+};
+
+struct cm_ctx {
+    struct ib_device *dev;
+    struct ib_pd     *pd;
+    struct ib_cq     *scq;
+    struct ib_cq     *rcq;
+    struct ib_qp     *qp[2]; /* qp[0] sends to qp[1] */
+    void             *buf[2];
+    u64               dma[2];
+    struct cm_rx     *rx;
+
+    /* Written by the receive completion handler only */
+    int               recvd;
+    int               errors;
+    u64               lat_sum;
+    u32               hist[CM_HIST_BUCKETS];
+};
+
+static int cm_post_recv (struct cm_ctx *ctx, int slot)
+{
+    const struct ib_recv_wr *bad_wr;
+    struct ib_recv_wr wr = {};
+    struct ib_sge sge;
+
+    sge.addr   = ctx->dma[1] + (u64) slot * msg_size;
+    sge.length = msg_size;
+    sge.lkey   = ctx->pd->local_dma_lkey;
+
+    wr.wr_cqe  = &ctx->rx[slot].cqe;
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+
+    return ib_post_recv(ctx->qp[1], &wr, &bad_wr);
+}
+
+static void cm_recv_done (struct ib_cq *cq, struct ib_wc *wc)
+{
+    struct cm_rx *rx = container_of(wc->wr_cqe, struct cm_rx, cqe);
+    struct cm_ctx *ctx = rx->ctx;
+    u64 off = (u64) rx->slot * msg_size;
+    u64 now = ktime_get_ns();
+    u64 sent_ns, lat;
+
+    if (wc->status != IB_WC_SUCCESS) {
+        if (wc->status != IB_WC_WR_FLUSH_ERR)
+            ++ctx->errors;
+        return;
+    }
+
+    ib_dma_sync_single_for_cpu(ctx->dev, ctx->dma[1] + off, sizeof(u64),
+                               DMA_BIDIRECTIONAL);
+    sent_ns = *(u64 *) (ctx->buf[1] + off);
+    lat = now > sent_ns ? now - sent_ns : 0;
+
+    ctx->lat_sum += lat;
+    ++ctx->hist[lat ? ilog2(lat) : 0];
+    WRITE_ONCE(ctx->recvd, ctx->recvd + 1);
+
+    if (cm_post_recv(ctx, rx->slot))
+        ++ctx->errors;
+}
+
+static int cm_post_send (struct cm_ctx *ctx, int slot)
+{
+    const struct ib_send_wr *bad_wr;
+    struct ib_send_wr wr = {};
+    struct ib_sge sge;
+    u64 off = (u64) slot * msg_size;
+
+    *(u64 *) (ctx->buf[0] + off) = ktime_get_ns();
+    ib_dma_sync_single_for_device(ctx->dev, ctx->dma[0] + off, sizeof(u64),
+                                  DMA_BIDIRECTIONAL);
+
+    sge.addr   = ctx->dma[0] + off;
+    sge.length = msg_size;
+    sge.lkey   = ctx->pd->local_dma_lkey;
+
+    wr.wr_id      = slot;
+    wr.sg_list    = &sge;
+    wr.num_sge    = 1;
+    wr.opcode     = IB_WR_SEND;
+    wr.send_flags = IB_SEND_SIGNALED;
+
+    return ib_post_send(ctx->qp[0], &wr, &bad_wr);
+}
+
+static u64 cm_irq_cpu_ns (void)
+{
+    u64 sum = 0;
+    int cpu;
+
+    for_each_online_cpu(cpu)
+        sum += kcpustat_cpu(cpu).cpustat[CPUTIME_IRQ] +
+               kcpustat_cpu(cpu).cpustat[CPUTIME_SOFTIRQ];
+    return sum;
+}
+
+/**
+ * @note Latency bucket below which pct percent of the samples fall,
+ * as the upper bound of a log2 bucket.
+ */
+static u64 cm_percentile (struct cm_ctx *ctx, int pct)
+{
+    u64 target = div_u64((u64) ctx->recvd * pct + 99, 100);
+    u64 seen = 0;
+    int i;
+
+    for (i = 0; i < CM_HIST_BUCKETS; ++i) {
+        seen += ctx->hist[i];
+        if (seen >= target)
+            return 2ULL << i;
+    }
+    return U64_MAX;
+}
+
+static int cm_load (struct cm_ctx *ctx)
+{
+    u64 period = div_u64(NSEC_PER_SEC, rate);
+    u64 begin, end, next, now, cpu_ns, elapsed;
+    struct ib_wc wc[16];
+    int posted = 0, sent = 0;
+    int i, n, err;
+
+    for (i = 0; i < depth; ++i) {
+        err = cm_post_recv(ctx, i);
+        if (err)
+            return err;
+    }
+
+    cpu_ns = cm_irq_cpu_ns();
+    begin  = ktime_get_ns();
+    end    = begin + (u64) duration_ms * NSEC_PER_MSEC;
+    next   = begin;
+
+    while ((now = ktime_get_ns()) < end) {
+        /* Never burst to catch up, an overloaded point just runs slower */
+        if (now >= next && posted - sent < depth &&
+            posted - READ_ONCE(ctx->recvd) < depth) {
+            err = cm_post_send(ctx, posted % depth);
+            if (err)
+                return err;
+            ++posted;
+            next = max(next + period, now - period);
+        }
+
+        n = ib_poll_cq(ctx->scq, ARRAY_SIZE(wc), wc);
+        for (i = 0; i < n; ++i) {
+            if (wc[i].status != IB_WC_SUCCESS) {
+                pr_err(PFX_CM "send completion %d: %s\n", sent,
+                       ib_wc_status_msg(wc[i].status));
+                return -EIO;
+            }
+            ++sent;
+        }
+
+        if (need_resched())
+            cond_resched();
+    }
+
+    /* Let the last messages arrive */
+    while (READ_ONCE(ctx->recvd) < posted &&
+           ktime_get_ns() < end + NSEC_PER_SEC)
+        cond_resched();
+
+    elapsed = ktime_get_ns() - begin;
+    cpu_ns  = cm_irq_cpu_ns() - cpu_ns;
+
+    if (!ctx->recvd || ctx->errors) {
+        pr_err(PFX_CM "%d posted, %d received, %d errors\n",
+               posted, ctx->recvd, ctx->errors);
+        return -EIO;
+    }
+
+    pr_info(PFX_CM "%s offered %d msg/s, got %llu msg/s, latency mean %llu ns "
+            "p50 <%llu ns p99 <%llu ns, irq+softirq %llu ms/s\n",
+            dev_name(&ctx->dev->dev), rate,
+            div64_u64((u64) ctx->recvd * NSEC_PER_SEC, elapsed),
+            div_u64(ctx->lat_sum, ctx->recvd),
+            cm_percentile(ctx, 50), cm_percentile(ctx, 99),
+            div64_u64(cpu_ns * MSEC_PER_SEC, elapsed));
+    return 0;
+}
+
+static int cm_run (struct ib_device *dev)
+{
+    struct ib_qp_init_attr init_attr;
+    struct ib_port_attr port_attr;
+    struct cm_ctx *ctx;
+    size_t len = (size_t) msg_size * depth;
+    int i, err;
+
+    err = ib_query_port(dev, 1, &port_attr);
+    if (err)
+        return err;
+
+    ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+    if (!ctx)
+        return -ENOMEM;
+    ctx->dev = dev;
+
+    ctx->rx = kcalloc(depth, sizeof(*ctx->rx), GFP_KERNEL);
+    if (!ctx->rx) {
+        err = -ENOMEM;
+        goto out_ctx;
+    }
+    for (i = 0; i < depth; ++i) {
+        ctx->rx[i].cqe.done = cm_recv_done;
+        ctx->rx[i].ctx      = ctx;
+        ctx->rx[i].slot     = i;
+    }
+
+    ctx->pd = ib_alloc_pd(dev, 0);
+    if (IS_ERR(ctx->pd)) {
+        err = PTR_ERR(ctx->pd);
+        goto out_rx;
+    }
+
+    ctx->scq = ib_alloc_cq(dev, NULL, depth, 0, IB_POLL_DIRECT);
+    if (IS_ERR(ctx->scq)) {
+        err = PTR_ERR(ctx->scq);
+        goto out_pd;
+    }
+    ctx->rcq = ib_alloc_cq(dev, ctx, depth, 0, IB_POLL_SOFTIRQ);
+    if (IS_ERR(ctx->rcq)) {
+        err = PTR_ERR(ctx->rcq);
+        goto out_scq;
+    }
+
+    memset(&init_attr, 0, sizeof(init_attr));
+    init_attr.send_cq          = ctx->scq;
+    init_attr.recv_cq          = ctx->rcq;
+    init_attr.cap.max_send_wr  = depth;
+    init_attr.cap.max_recv_wr  = depth;
+    init_attr.cap.max_send_sge = 1;
+    init_attr.cap.max_recv_sge = 1;
+    init_attr.sq_sig_type      = IB_SIGNAL_REQ_WR;
+    init_attr.qp_type          = IB_QPT_RC;
+
+    for (i = 0; i < 2; ++i) {
+        ctx->qp[i] = ib_create_qp(ctx->pd, &init_attr);
+        if (IS_ERR(ctx->qp[i])) {
+            err = PTR_ERR(ctx->qp[i]);
+            goto out_qp;
+        }
+    }
+
+    for (i = 0; i < 2; ++i) {
+        ctx->buf[i] = kzalloc(len, GFP_KERNEL);
+        if (!ctx->buf[i]) {
+            err = -ENOMEM;
+            goto out_buf;
+        }
+        ctx->dma[i] = ib_dma_map_single(dev, ctx->buf[i], len, DMA_BIDIRECTIONAL);
+        if (ib_dma_mapping_error(dev, ctx->dma[i])) {
+            kfree(ctx->buf[i]);
+            ctx->buf[i] = NULL;
+            err = -ENOMEM;
+            goto out_buf;
+        }
+    }
+
+    err = hgrnic_test_connect(ctx->qp, 1, port_attr.lid);
+    if (err) {
+        pr_err(PFX_CM "%s: connecting QPs failed (%d)\n", dev_name(&dev->dev), err);
+        goto out_buf;
+    }
+
+    err = cm_load(ctx);
+
+out_buf:
+    /* Destroy the QPs first, no receive callback may touch the buffers */
+    for (i = 0; i < 2; ++i) {
+        if (!IS_ERR_OR_NULL(ctx->qp[i]))
+            ib_destroy_qp(ctx->qp[i]);
+        ctx->qp[i] = NULL;
+    }
+    for (i = 0; i < 2; ++i) {
+        if (!ctx->buf[i])
+            continue;
+        ib_dma_unmap_single(dev, ctx->dma[i], len, DMA_BIDIRECTIONAL);
+        kfree(ctx->buf[i]);
+    }
+out_qp:
+    for (i = 0; i < 2; ++i) {
+        if (!IS_ERR_OR_NULL(ctx->qp[i]))
+            ib_destroy_qp(ctx->qp[i]);
+    }
+    ib_free_cq(ctx->rcq);
+out_scq:
+    ib_free_cq(ctx->scq);
+out_pd:
+    ib_dealloc_pd(ctx->pd);
+out_rx:
+    kfree(ctx->rx);
+out_ctx:
+    kfree(ctx);
+    return err;
+}
+
+static void cm_add_one (struct ib_device *dev)
+{
+    int err;
+
+    if (dev->ops.driver_id != RDMA_DRIVER_HGRNIC)
+        return;
+
+    err = cm_run(dev);
+    if (err)
+        pr_err(PFX_CM "%s: test failed (%d)\n", dev_name(&dev->dev), err);
+}
+
+static void cm_remove_one (struct ib_device *dev, void *client_data)
+{
+}
+
+static struct ib_client cm_client = {
+    .name   = "hgrnic_cq_moder",
+    .add    = cm_add_one,
+    .remove = cm_remove_one
+};
+
+static int __init hgrnic_cq_moder_init (void)
+{
+    if (rate <= 0 || duration_ms <= 0 || depth <= 0 || msg_size < (int) sizeof(u64))
+        return -EINVAL;
+
+    return ib_register_client(&cm_client);
+}
+
+static void __exit hgrnic_cq_moder_exit (void)
+{
+    ib_unregister_client(&cm_client);
+}
+
+module_init(hgrnic_cq_moder_init);
+module_exit(hgrnic_cq_moder_exit);
+
+MODULE_DESCRIPTION("CQ event moderation latency/CPU load generator for ib_hgrnic");
+MODULE_LICENSE("Dual BSD/GPL");
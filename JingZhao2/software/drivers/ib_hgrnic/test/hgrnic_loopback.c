@@ -0,0 +1,307 @@
+/**************************************************************
+ * @file hgrnic_loopback.c
+ * @note In-kernel loopback throughput test of the hgrnic verbs
+ * datapath. For every hgrnic device, connects two RC QPs of the
+ * same port to each other, streams iters messages of msg_size bytes
+ * from one to the other with SEND or RDMA WRITE, keeping tx_depth
+ * WRs in flight, and prints messages/sec and MB/s. Only the ib_core
+ * kernel verbs are used, as an in-kernel ULP would.
+ *
+ *   insmod hgrnic_loopback.ko op=send msg_size=4096 iters=100000
+ *   dmesg | grep hgrnic_loopback
+ *************************************************************/
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include <rdma/ib_verbs.h>
+
+#include "hgrnic_test.h"
+
+#define PFX_LB "hgrnic_loopback: "
+
+static char *op = "send";
+module_param(op, charp, 0444);
+MODULE_PARM_DESC(op, "send or write (default send)");
+
+static int msg_size = 4096;
+module_param(msg_size, int, 0444);
+MODULE_PARM_DESC(msg_size, "Message size in bytes (default 4096)");
+
+static int iters = 100000;
+module_param(iters, int, 0444);
+MODULE_PARM_DESC(iters, "Number of messages (default 100000)");
+
+static int tx_depth = 64;
+module_param(tx_depth, int, 0444);
+MODULE_PARM_DESC(tx_depth, "Send WRs in flight, also the RQ depth (default 64)");
+
+static int timeout_ms = 10000;
+module_param(timeout_ms, int, 0444);
+MODULE_PARM_DESC(timeout_ms, "Give up if no completion arrives for this long (default 10000)");
+
+struct lb_ctx {
+    struct ib_device *dev;
+    struct ib_pd     *pd;
+    struct ib_cq     *scq;
+    struct ib_cq     *rcq;
+    struct ib_qp     *qp[2]; /* qp[0] sends to qp[1] */
+    void             *buf[2];
+    u64               dma[2];
+    bool              write;
+};
+
+static int lb_post_recv (struct lb_ctx *ctx, int slot)
+{
+    const struct ib_recv_wr *bad_wr;
+    struct ib_recv_wr wr = {};
+    struct ib_sge sge;
+
+    sge.addr   = ctx->dma[1] + (u64) slot * msg_size;
+    sge.length = msg_size;
+    sge.lkey   = ctx->pd->local_dma_lkey;
+
+    wr.wr_id   = slot;
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+
+    return ib_post_recv(ctx->qp[1], &wr, &bad_wr);
+}
+
+static int lb_post_send (struct lb_ctx *ctx, int slot)
+{
+    const struct ib_send_wr *bad_wr;
+    struct ib_rdma_wr wr = {};
+    struct ib_sge sge;
+
+    sge.addr   = ctx->dma[0] + (u64) slot * msg_size;
+    sge.length = msg_size;
+    sge.lkey   = ctx->pd->local_dma_lkey;
+
+    wr.wr.wr_id      = slot;
+    wr.wr.sg_list    = &sge;
+    wr.wr.num_sge    = 1;
+    wr.wr.send_flags = IB_SEND_SIGNALED;
+    if (ctx->write) {
+        wr.wr.opcode = IB_WR_RDMA_WRITE;
+        wr.remote_addr = ctx->dma[1] + (u64) slot * msg_size;
+        wr.rkey        = ctx->pd->unsafe_global_rkey;
+    } else {
+        wr.wr.opcode = IB_WR_SEND;
+    }
+
+    return ib_post_send(ctx->qp[0], &wr.wr, &bad_wr);
+}
+
+/**
+ * @note Stream iters messages with tx_depth of them in flight. SEND
+ * is complete when the receive side has seen it, RDMA WRITE when the
+ * send completion is back.
+ */
+static int lb_stream (struct lb_ctx *ctx)
+{
+    struct ib_wc wc[16];
+    unsigned long last_progress = jiffies;
+    int posted = 0, sent = 0, recvd = 0;
+    int i, n, err;
+    ktime_t begin;
+    s64 ns;
+
+    if (!ctx->write) {
+        for (i = 0; i < tx_depth; ++i) {
+            err = lb_post_recv(ctx, i);
+            if (err)
+                return err;
+        }
+    }
+
+    begin = ktime_get();
+    while (sent < iters || (!ctx->write && recvd < iters)) {
+        while (posted < iters && posted - sent < tx_depth) {
+            err = lb_post_send(ctx, posted % tx_depth);
+            if (err)
+                return err;
+            ++posted;
+        }
+
+        n = ib_poll_cq(ctx->scq, ARRAY_SIZE(wc), wc);
+        for (i = 0; i < n; ++i) {
+            if (wc[i].status != IB_WC_SUCCESS) {
+                pr_err(PFX_LB "send completion %d: %s\n", sent,
+                       ib_wc_status_msg(wc[i].status));
+                return -EIO;
+            }
+            ++sent;
+        }
+        if (n > 0)
+            last_progress = jiffies;
+
+        if (!ctx->write) {
+            n = ib_poll_cq(ctx->rcq, ARRAY_SIZE(wc), wc);
+            for (i = 0; i < n; ++i) {
+                if (wc[i].status != IB_WC_SUCCESS) {
+                    pr_err(PFX_LB "recv completion %d: %s\n", recvd,
+                           ib_wc_status_msg(wc[i].status));
+                    return -EIO;
+                }
+                if (++recvd + tx_depth <= iters) {
+                    err = lb_post_recv(ctx, wc[i].wr_id);
+                    if (err)
+                        return err;
+                }
+            }
+            if (n > 0)
+                last_progress = jiffies;
+        }
+
+        if (time_after(jiffies, last_progress + msecs_to_jiffies(timeout_ms))) {
+            pr_err(PFX_LB "stalled: %d posted, %d sent, %d received\n",
+                   posted, sent, recvd);
+            return -ETIMEDOUT;
+        }
+        cond_resched();
+    }
+    ns = ktime_to_ns(ktime_sub(ktime_get(), begin));
+
+    pr_info(PFX_LB "%s %s %d x %d B: %lld msg/s, %lld MB/s\n",
+            dev_name(&ctx->dev->dev), ctx->write ? "write" : "send",
+            iters, msg_size,
+            div64_s64((s64) iters * NSEC_PER_SEC, ns),
+            div64_s64((s64) iters * msg_size * (NSEC_PER_SEC / 1000000), ns));
+    return 0;
+}
+
+static int lb_run (struct ib_device *dev)
+{
+    struct ib_qp_init_attr init_attr;
+    struct ib_port_attr port_attr;
+    struct lb_ctx ctx = { .dev = dev };
+    size_t len = (size_t) msg_size * tx_depth;
+    int i, err;
+
+    ctx.write = !strcmp(op, "write");
+
+    err = ib_query_port(dev, 1, &port_attr);
+    if (err)
+        return err;
+
+    ctx.pd = ib_alloc_pd(dev, ctx.write ? IB_PD_UNSAFE_GLOBAL_RKEY : 0);
+    if (IS_ERR(ctx.pd))
+        return PTR_ERR(ctx.pd);
+
+    ctx.scq = ib_alloc_cq(dev, NULL, tx_depth, 0, IB_POLL_DIRECT);
+    if (IS_ERR(ctx.scq)) {
+        err = PTR_ERR(ctx.scq);
+        goto out_pd;
+    }
+    ctx.rcq = ib_alloc_cq(dev, NULL, tx_depth, 0, IB_POLL_DIRECT);
+    if (IS_ERR(ctx.rcq)) {
+        err = PTR_ERR(ctx.rcq);
+        goto out_scq;
+    }
+
+    memset(&init_attr, 0, sizeof(init_attr));
+    init_attr.send_cq          = ctx.scq;
+    init_attr.recv_cq          = ctx.rcq;
+    init_attr.cap.max_send_wr  = tx_depth;
+    init_attr.cap.max_recv_wr  = tx_depth;
+    init_attr.cap.max_send_sge = 1;
+    init_attr.cap.max_recv_sge = 1;
+    init_attr.sq_sig_type      = IB_SIGNAL_REQ_WR;
+    init_attr.qp_type          = IB_QPT_RC;
+
+    for (i = 0; i < 2; ++i) {
+        ctx.qp[i] = ib_create_qp(ctx.pd, &init_attr);
+        if (IS_ERR(ctx.qp[i])) {
+            err = PTR_ERR(ctx.qp[i]);
+            goto out_qp;
+        }
+    }
+
+    for (i = 0; i < 2; ++i) {
+        ctx.buf[i] = kzalloc(len, GFP_KERNEL);
+        if (!ctx.buf[i]) {
+            err = -ENOMEM;
+            goto out_buf;
+        }
+        if (i == 0)
+            memset(ctx.buf[0], 0xa5, len);
+        ctx.dma[i] = ib_dma_map_single(dev, ctx.buf[i], len, DMA_BIDIRECTIONAL);
+        if (ib_dma_mapping_error(dev, ctx.dma[i])) {
+            kfree(ctx.buf[i]);
+            ctx.buf[i] = NULL;
+            err = -ENOMEM;
+            goto out_buf;
+        }
+    }
+
+    err = hgrnic_test_connect(ctx.qp, 1, port_attr.lid);
+    if (err) {
+        pr_err(PFX_LB "%s: connecting QPs failed (%d)\n", dev_name(&dev->dev), err);
+        goto out_buf;
+    }
+
+    err = lb_stream(&ctx);
+
+out_buf:
+    for (i = 0; i < 2; ++i) {
+        if (!ctx.buf[i])
+            continue;
+        ib_dma_unmap_single(dev, ctx.dma[i], len, DMA_BIDIRECTIONAL);
+        kfree(ctx.buf[i]);
+    }
+out_qp:
+    for (i = 0; i < 2; ++i) {
+        if (!IS_ERR_OR_NULL(ctx.qp[i]))
+            ib_destroy_qp(ctx.qp[i]);
+    }
+    ib_free_cq(ctx.rcq);
+out_scq:
+    ib_free_cq(ctx.scq);
+out_pd:
+    ib_dealloc_pd(ctx.pd);
+    return err;
+}
+
+static void lb_add_one (struct ib_device *dev)
+{
+    int err;
+
+    if (dev->ops.driver_id != RDMA_DRIVER_HGRNIC)
+        return;
+
+    err = lb_run(dev);
+    if (err)
+        pr_err(PFX_LB "%s: test failed (%d)\n", dev_name(&dev->dev), err);
+}
+
+static void lb_remove_one (struct ib_device *dev, void *client_data)
+{
+}
+
+static struct ib_client lb_client = {
+    .name   = "hgrnic_loopback",
+    .add    = lb_add_one,
+    .remove = lb_remove_one
+};
+
+static int __init hgrnic_loopback_init (void)
+{
+    if (msg_size <= 0 || iters <= 0 || tx_depth <= 0 || timeout_ms <= 0 ||
+        (strcmp(op, "send") && strcmp(op, "write")))
+        return -EINVAL;
+
+    return ib_register_client(&lb_client);
+}
+
+static void __exit hgrnic_loopback_exit (void)
+{
+    ib_unregister_client(&lb_client);
+}
+
+module_init(hgrnic_loopback_init);
+module_exit(hgrnic_loopback_exit);
+
+MODULE_DESCRIPTION("In-kernel loopback throughput test of ib_hgrnic");
+MODULE_LICENSE("Dual BSD/GPL");
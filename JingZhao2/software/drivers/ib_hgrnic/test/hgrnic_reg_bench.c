@@ -0,0 +1,277 @@
+/**************************************************************
+ * @file hgrnic_reg_bench.c
+ * @note Memory registrations per second on an hgrnic device, the way
+ * an in-kernel storage ULP registers per-I/O buffers:
+ *
+ *   frwr : rotate the key, post IB_WR_REG_MR and IB_WR_LOCAL_INV on
+ *          the send queue, wait for both completions.
+ *   hcr  : ib_alloc_mr() + ib_dereg_mr(), i.e. SW2HW_MPT/HW2SW_MPT
+ *          through the HCR, the only path without fast registration.
+ *
+ * The frwr mode needs IB_DEVICE_MEM_MGT_EXTENSIONS, which ib_hgrnic
+ * only reports when the HCA sets DEV_LIM_FLAG_FAST_REG.
+ *
+ *   insmod hgrnic_reg_bench.ko pages=8 iters=100000
+ *   dmesg | grep hgrnic_reg_bench
+ *************************************************************/
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include <linux/scatterlist.h>
+#include <rdma/ib_verbs.h>
+
+#include "hgrnic_test.h"
+
+#define PFX_RB "hgrnic_reg_bench: "
+
+static int pages = 8;
+module_param(pages, int, 0444);
+MODULE_PARM_DESC(pages, "Pages per registration (default 8)");
+
+static int iters = 100000;
+module_param(iters, int, 0444);
+MODULE_PARM_DESC(iters, "Registrations per mode (default 100000)");
+
+static int timeout_ms = 10000;
+module_param(timeout_ms, int, 0444);
+MODULE_PARM_DESC(timeout_ms, "Give up if no completion arrives for this long (default 10000)");
+
+static void rb_report (struct ib_device *dev, const char *mode, ktime_t begin)
+{
+    s64 ns = ktime_to_ns(ktime_sub(ktime_get(), begin));
+
+    pr_info(PFX_RB "%s %-4s %d pages: %lld reg/s, %lld ns/reg\n",
+            dev_name(&dev->dev), mode, pages,
+            div64_s64((s64) iters * NSEC_PER_SEC, ns), div64_s64(ns, iters));
+}
+
+/* Wait for n successful completions on a directly polled CQ */
+static int rb_wait (struct ib_cq *cq, int n)
+{
+    unsigned long deadline = jiffies + msecs_to_jiffies(timeout_ms);
+    struct ib_wc wc[4];
+    int i, got;
+
+    while (n > 0) {
+        got = ib_poll_cq(cq, min_t(int, n, ARRAY_SIZE(wc)), wc);
+        for (i = 0; i < got; ++i) {
+            if (wc[i].status != IB_WC_SUCCESS) {
+                pr_err(PFX_RB "completion opcode %d: %s\n", wc[i].opcode,
+                       ib_wc_status_msg(wc[i].status));
+                return -EIO;
+            }
+        }
+        n -= got;
+
+        if (!got && time_after(jiffies, deadline))
+            return -ETIMEDOUT;
+        if (need_resched())
+            cond_resched();
+    }
+
+    return 0;
+}
+
+static int rb_frwr (struct ib_device *dev, struct ib_pd *pd, struct ib_qp *qp,
+                    struct ib_cq *cq, struct scatterlist *sgl, int nents)
+{
+    const struct ib_send_wr *bad_wr;
+    struct ib_reg_wr reg = {};
+    struct ib_send_wr inv = {};
+    struct ib_mr *mr;
+    ktime_t begin;
+    int i, n, err = 0;
+
+    mr = ib_alloc_mr(pd, IB_MR_TYPE_MEM_REG, pages);
+    if (IS_ERR(mr))
+        return PTR_ERR(mr);
+
+    reg.wr.opcode     = IB_WR_REG_MR;
+    reg.wr.send_flags = IB_SEND_SIGNALED;
+    reg.wr.next       = &inv;
+    reg.mr            = mr;
+    reg.access        = IB_ACCESS_LOCAL_WRITE | IB_ACCESS_REMOTE_WRITE;
+
+    inv.opcode        = IB_WR_LOCAL_INV;
+    inv.send_flags    = IB_SEND_SIGNALED;
+
+    begin = ktime_get();
+    for (i = 0; i < iters; ++i) {
+        n = ib_map_mr_sg(mr, sgl, nents, NULL, PAGE_SIZE);
+        if (n != nents) {
+            err = n < 0 ? n : -EINVAL;
+            goto out;
+        }
+
+        ib_update_fast_reg_key(mr, ib_inc_rkey(mr->rkey));
+        reg.key                = mr->rkey;
+        inv.ex.invalidate_rkey = mr->rkey;
+
+        err = ib_post_send(qp, &reg.wr, &bad_wr);
+        if (err)
+            goto out;
+
+        err = rb_wait(cq, 2);
+        if (err)
+            goto out;
+    }
+    rb_report(dev, "frwr", begin);
+
+out:
+    ib_dereg_mr(mr);
+    return err;
+}
+
+static int rb_hcr (struct ib_device *dev, struct ib_pd *pd)
+{
+    struct ib_mr *mr;
+    ktime_t begin;
+    int i, err;
+
+    begin = ktime_get();
+    for (i = 0; i < iters; ++i) {
+        mr = ib_alloc_mr(pd, IB_MR_TYPE_MEM_REG, pages);
+        if (IS_ERR(mr))
+            return PTR_ERR(mr);
+
+        err = ib_dereg_mr(mr);
+        if (err)
+            return err;
+
+        if (need_resched())
+            cond_resched();
+    }
+    rb_report(dev, "hcr", begin);
+
+    return 0;
+}
+
+static int rb_run (struct ib_device *dev)
+{
+    struct ib_qp_init_attr init_attr;
+    struct ib_port_attr port_attr;
+    struct scatterlist *sgl = NULL;
+    struct ib_qp *qp[2] = {};
+    struct ib_pd *pd;
+    struct ib_cq *cq;
+    void *buf = NULL;
+    int i, nents = 0, err;
+
+    if (!(dev->attrs.device_cap_flags & IB_DEVICE_MEM_MGT_EXTENSIONS)) {
+        pr_info(PFX_RB "%s: no fast registration, skipped\n", dev_name(&dev->dev));
+        return 0;
+    }
+
+    err = ib_query_port(dev, 1, &port_attr);
+    if (err)
+        return err;
+
+    pd = ib_alloc_pd(dev, 0);
+    if (IS_ERR(pd))
+        return PTR_ERR(pd);
+
+    cq = ib_alloc_cq(dev, NULL, 16, 0, IB_POLL_DIRECT);
+    if (IS_ERR(cq)) {
+        err = PTR_ERR(cq);
+        goto out_pd;
+    }
+
+    memset(&init_attr, 0, sizeof(init_attr));
+    init_attr.send_cq          = cq;
+    init_attr.recv_cq          = cq;
+    init_attr.cap.max_send_wr  = 8;
+    init_attr.cap.max_recv_wr  = 1;
+    init_attr.cap.max_send_sge = 1;
+    init_attr.cap.max_recv_sge = 1;
+    init_attr.sq_sig_type      = IB_SIGNAL_REQ_WR;
+    init_attr.qp_type          = IB_QPT_RC;
+
+    for (i = 0; i < 2; ++i) {
+        qp[i] = ib_create_qp(pd, &init_attr);
+        if (IS_ERR(qp[i])) {
+            err = PTR_ERR(qp[i]);
+            goto out_qp;
+        }
+    }
+
+    err = hgrnic_test_connect(qp, 1, port_attr.lid);
+    if (err)
+        goto out_qp;
+
+    buf = kzalloc((size_t) pages * PAGE_SIZE, GFP_KERNEL);
+    sgl = kcalloc(pages, sizeof(*sgl), GFP_KERNEL);
+    if (!buf || !sgl) {
+        err = -ENOMEM;
+        goto out_buf;
+    }
+    sg_init_table(sgl, pages);
+    for (i = 0; i < pages; ++i)
+        sg_set_buf(&sgl[i], buf + (size_t) i * PAGE_SIZE, PAGE_SIZE);
+
+    nents = ib_dma_map_sg(dev, sgl, pages, DMA_BIDIRECTIONAL);
+    if (!nents) {
+        err = -ENOMEM;
+        goto out_buf;
+    }
+
+    err = rb_frwr(dev, pd, qp[0], cq, sgl, nents);
+    if (!err)
+        err = rb_hcr(dev, pd);
+
+    ib_dma_unmap_sg(dev, sgl, pages, DMA_BIDIRECTIONAL);
+out_buf:
+    kfree(sgl);
+    kfree(buf);
+out_qp:
+    for (i = 0; i < 2; ++i) {
+        if (!IS_ERR_OR_NULL(qp[i]))
+            ib_destroy_qp(qp[i]);
+    }
+    ib_free_cq(cq);
+out_pd:
+    ib_dealloc_pd(pd);
+    return err;
+}
+
+static void rb_add_one (struct ib_device *dev)
+{
+    int err;
+
+    if (dev->ops.driver_id != RDMA_DRIVER_HGRNIC)
+        return;
+
+    err = rb_run(dev);
+    if (err)
+        pr_err(PFX_RB "%s: test failed (%d)\n", dev_name(&dev->dev), err);
+}
+
+static void rb_remove_one (struct ib_device *dev, void *client_data)
+{
+}
+
+static struct ib_client rb_client = {
+    .name   = "hgrnic_reg_bench",
+    .add    = rb_add_one,
+    .remove = rb_remove_one
+};
+
+static int __init hgrnic_reg_bench_init (void)
+{
+    if (pages <= 0 || iters <= 0 || timeout_ms <= 0)
+        return -EINVAL;
+
+    return ib_register_client(&rb_client);
+}
+
+static void __exit hgrnic_reg_bench_exit (void)
+{
+    ib_unregister_client(&rb_client);
+}
+
+module_init(hgrnic_reg_bench_init);
+module_exit(hgrnic_reg_bench_exit);
+
+MODULE_DESCRIPTION("Memory registration rate benchmark for ib_hgrnic");
+MODULE_LICENSE("Dual BSD/GPL");
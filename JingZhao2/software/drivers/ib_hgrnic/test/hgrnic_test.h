@@ -0,0 +1,63 @@
+/**************************************************************
+ * @file hgrnic_test.h
+ * @note Helpers shared by the ib_hgrnic test modules.
+ *************************************************************/
+#ifndef __HGRNIC_TEST_H__
+#define __HGRNIC_TEST_H__
+
+#include <rdma/ib_verbs.h>
+
+/**
+ * @note Bring two RC QPs of the same port to RTS, each one connected
+ * to the other.
+ */
+static inline int hgrnic_test_connect (struct ib_qp *qp[2], u8 port, u16 lid)
+{
+    struct ib_qp_attr attr;
+    int i, err;
+
+    for (i = 0; i < 2; ++i) {
+        memset(&attr, 0, sizeof(attr));
+        attr.qp_state        = IB_QPS_INIT;
+        attr.pkey_index      = 0;
+        attr.port_num        = port;
+        attr.qp_access_flags = IB_ACCESS_LOCAL_WRITE | IB_ACCESS_REMOTE_WRITE;
+        err = ib_modify_qp(qp[i], &attr, IB_QP_STATE | IB_QP_PKEY_INDEX |
+                           IB_QP_PORT | IB_QP_ACCESS_FLAGS);
+        if (err)
+            return err;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.qp_state           = IB_QPS_RTR;
+        attr.path_mtu           = IB_MTU_4096;
+        attr.dest_qp_num        = qp[!i]->qp_num;
+        attr.rq_psn             = 0;
+        attr.max_dest_rd_atomic = 1;
+        attr.min_rnr_timer      = 12;
+        attr.ah_attr.type       = RDMA_AH_ATTR_TYPE_IB;
+        rdma_ah_set_port_num(&attr.ah_attr, port);
+        rdma_ah_set_dlid(&attr.ah_attr, lid);
+        err = ib_modify_qp(qp[i], &attr, IB_QP_STATE | IB_QP_AV |
+                           IB_QP_PATH_MTU | IB_QP_DEST_QPN | IB_QP_RQ_PSN |
+                           IB_QP_MAX_DEST_RD_ATOMIC | IB_QP_MIN_RNR_TIMER);
+        if (err)
+            return err;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.qp_state      = IB_QPS_RTS;
+        attr.sq_psn        = 0;
+        attr.timeout       = 14;
+        attr.retry_cnt     = 7;
+        attr.rnr_retry     = 7;
+        attr.max_rd_atomic = 1;
+        err = ib_modify_qp(qp[i], &attr, IB_QP_STATE | IB_QP_SQ_PSN |
+                           IB_QP_TIMEOUT | IB_QP_RETRY_CNT |
+                           IB_QP_RNR_RETRY | IB_QP_MAX_QP_RD_ATOMIC);
+        if (err)
+            return err;
+    }
+
+    return 0;
+}
+
+#endif /* __HGRNIC_TEST_H__ */
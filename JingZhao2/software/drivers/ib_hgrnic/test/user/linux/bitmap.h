@@ -0,0 +1 @@
+/* Stand-in for <linux/bitmap.h>, see hgrnic_alloc_user.c */
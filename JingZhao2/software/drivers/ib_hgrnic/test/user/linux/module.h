@@ -0,0 +1 @@
+/* Stand-in for <linux/module.h>, see hgrnic_alloc_user.c */
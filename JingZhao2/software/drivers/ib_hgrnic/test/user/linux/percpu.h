@@ -0,0 +1 @@
+/* Stand-in for <linux/percpu.h>, see hgrnic_alloc_user.c */
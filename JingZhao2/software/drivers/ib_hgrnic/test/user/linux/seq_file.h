@@ -0,0 +1 @@
+/* Stand-in for <linux/seq_file.h>, see hgrnic_alloc_user.c */
@@ -0,0 +1 @@
+/* Stand-in for <linux/slab.h>, see hgrnic_alloc_user.c */
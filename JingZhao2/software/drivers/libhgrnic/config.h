@@ -4,6 +4,9 @@
 /* Define to 1 if you have the <dlfcn.h> header file. */
 #define HAVE_DLFCN_H 1
 
+/* Define to 1 if libibverbs has extended CQs and ibv_query_rt_values_ex. */
+/* #undef HAVE_IBV_CQ_EX */
+
 /* Define to 1 if you have the `ibv_dofork_range' function. */
 #define HAVE_IBV_DOFORK_RANGE 1
 
@@ -35,7 +35,10 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <stdlib.h>
+#include <unistd.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
 #include <errno.h>
 
 #include "hgrnic.h"
@@ -59,7 +62,31 @@ static int ibv_dofork_range(void *base, size_t size)
 
 #endif /* HAVE_IBV_DONTFORK_RANGE && HAVE_IBV_DOFORK_RANGE */
 
-int hgrnic_alloc_buf(struct hgrnic_buf *buf, size_t size, int page_size)
+#define HGRNIC_MAX_NUMA_NODES 1024
+
+/*
+ * Prefer pages from the given node for a ring that has not been
+ * touched yet. Best effort: on kernels without NUMA support, or if
+ * the node has no free memory, pages come from anywhere.
+ */
+static void hgrnic_bind_buf(void *addr, size_t len, int node)
+{
+    unsigned long mask[HGRNIC_MAX_NUMA_NODES / (8 * sizeof (unsigned long))] = { 0 };
+    const int bits = 8 * sizeof (unsigned long);
+
+    if (node < 0 || node >= HGRNIC_MAX_NUMA_NODES)
+        return;
+
+    mask[node / bits] = 1UL << (node % bits);
+    /* maxnode counts one past the last bit, as in libnuma. */
+    syscall(__NR_mbind, addr, len, MPOL_PREFERRED, mask,
+            HGRNIC_MAX_NUMA_NODES + 1, 0);
+}
+
+/**
+ * @param node NUMA node the ring is placed on, -1 for no preference.
+ */
+int hgrnic_alloc_buf(struct hgrnic_buf *buf, size_t size, int page_size, int node)
 {
     int ret;
 
@@ -69,6 +96,8 @@ int hgrnic_alloc_buf(struct hgrnic_buf *buf, size_t size, int page_size)
     if (buf->buf == MAP_FAILED)
         return errno;
 
+    hgrnic_bind_buf(buf->buf, buf->length, node);
+
     ret = ibv_dontfork_range(buf->buf, size);
     if (ret)
         munmap(buf->buf, buf->length);
@@ -7,11 +7,13 @@
 #include <pthread.h>
 #include <netinet/in.h>
 #include <string.h>
+#include <errno.h>
 
 #include <infiniband/opcode.h>
 
 #include "hgrnic.h"
 #include "wqe.h"
+#include "cqe.h"
 
 
 enum {
@@ -21,9 +23,8 @@ enum {
 };
 
 enum {
-	HGRNIC_CQ_ENTRY_OWNER_SW     = 0x00,
-	HGRNIC_CQ_ENTRY_OWNER_HW     = 0x80,
-	HGRNIC_ERROR_CQE_OPCODE_MASK = 0xfe
+	HGRNIC_ERROR_CQE_OPCODE_MASK = 0xfe,
+	HGRNIC_ATOMIC_BYTE_LEN       = 8
 };
 
 enum {
@@ -47,35 +48,6 @@ enum {
     SYNDROME_INVAL_EEC_STATE_ERR     = 0x24
 };
 
-struct hgrnic_cqe {
-    uint32_t    my_qpn;
-    uint32_t    my_ee;
-    uint32_t    rqpn;
-    uint8_t     sl_ipok;
-    uint8_t     g_mlpath;
-    uint16_t    rlid;
-    uint32_t    imm;
-    uint32_t    byte_cnt;
-    uint32_t    wqe; // addr offset of completed wqe
-    uint8_t     opcode;
-    uint8_t     is_send;
-    uint8_t     reserved;
-    uint8_t     owner;
-};
-
-struct hgrnic_err_cqe {
-    uint32_t    my_qpn;
-    uint32_t    reserved1[3];
-    uint8_t     syndrome;
-    uint8_t     vendor_err;
-    uint16_t    db_cnt;
-    uint32_t    reserved2;
-    uint32_t    wqe;
-    uint8_t     opcode;
-    uint8_t     reserved3[2];
-    uint8_t     owner;
-};
-
 static inline struct hgrnic_cqe *get_cqe(struct hgrnic_cq *cq, int entry)
 {
     return cq->buf.buf + entry * HGRNIC_CQ_ENTRY_SIZE;
@@ -92,6 +64,11 @@ static inline struct hgrnic_cqe *next_cqe_sw(struct hgrnic_cq *cq)
     return cqe_sw(cq, cq->cons_index & cq->cqe_mask);
 }
 
+static inline uint64_t cqe_timestamp(struct hgrnic_cqe *cqe)
+{
+    return ((uint64_t) cqe->ts_hi << 32) | cqe->ts_lo;
+}
+
 static inline void set_cqe_hw(struct hgrnic_cqe *cqe)
 {
     VALGRIND_MAKE_MEM_UNDEFINED(cqe, sizeof *cqe);
@@ -189,9 +166,12 @@ static int handle_error_cqe(struct hgrnic_cq *cq,
     return 0;
 }
 
+/**
+ * @note ts, if not NULL, receives the completion timestamp.
+ */
 static inline int hgrnic_poll_one(struct hgrnic_cq *cq,
                                   struct hgrnic_qp **cur_qp,
-                                  struct ibv_wc *wc)
+                                  struct ibv_wc *wc, uint64_t *ts)
 {
     struct hgrnic_cqe *cqe;
     struct hgrnic_wq *wq;
@@ -264,6 +244,16 @@ static inline int hgrnic_poll_one(struct hgrnic_cq *cq,
         wq = &(*cur_qp)->sq;
         wqe_index = cqe->wqe >> wq->wqe_shift;
         wc->wr_id = (*cur_qp)->sq.wrid[wqe_index];
+    } else if ((*cur_qp)->ibv_qp.srq) {
+        struct hgrnic_srq *srq = to_hgsrq((*cur_qp)->ibv_qp.srq);
+
+        wq = NULL;
+        wqe_index = cqe->wqe >> srq->wqe_shift;
+        wc->wr_id = srq->wrid[wqe_index];
+
+        /* clear valid bit in next_unit */
+        memset(srq->buf.buf + cqe->wqe, 0, sizeof(struct hgrnic_next_unit));
+        hgrnic_free_srq_wqe(srq, wqe_index);
     } else {
         wq = &(*cur_qp)->rq;
         wqe_index = cqe->wqe >> wq->wqe_shift;
@@ -319,11 +309,11 @@ static inline int hgrnic_poll_one(struct hgrnic_cq *cq,
             break;
         case HGRNIC_OPCODE_ATOMIC_CS:
             wc->opcode    = IBV_WC_COMP_SWAP;
-            wc->byte_len  = cqe->byte_cnt;
+            wc->byte_len  = HGRNIC_ATOMIC_BYTE_LEN;
             break;
         case HGRNIC_OPCODE_ATOMIC_FA:
             wc->opcode    = IBV_WC_FETCH_ADD;
-            wc->byte_len  = cqe->byte_cnt;
+            wc->byte_len  = HGRNIC_ATOMIC_BYTE_LEN;
             break;
         case HGRNIC_OPCODE_BIND_MW:
             wc->opcode    = IBV_WC_BIND_MW;
@@ -364,6 +354,8 @@ static inline int hgrnic_poll_one(struct hgrnic_cq *cq,
     wc->status = IBV_WC_SUCCESS;
 
 out:
+    if (ts)
+        *ts = cqe_timestamp(cqe);
     set_cqe_hw(cqe);
     ++cq->cons_index;
 
@@ -384,7 +376,7 @@ int hgrnic_poll_cq(struct ibv_cq *ibcq, int ne, struct ibv_wc *wc)
     pthread_spin_lock(&cq->lock);
 
     for (npolled = 0; npolled < ne; ++npolled) {
-        err = hgrnic_poll_one(cq, &qp, wc + npolled);
+        err = hgrnic_poll_one(cq, &qp, wc + npolled, NULL);
         if (err != CQ_OK)
             break;
     }
@@ -394,16 +386,156 @@ int hgrnic_poll_cq(struct ibv_cq *ibcq, int ne, struct ibv_wc *wc)
     return err == CQ_POLL_ERR ? err : npolled;
 }
 
+#ifdef HAVE_IBV_CQ_EX
+/*
+ * Extended CQ polling. Each CQE is parsed into cq->ex_wc, as
+ * hgrnic_poll_cq() would, and the read_* ops return its fields. The
+ * CQ lock is held from start_poll to end_poll.
+ */
+static inline struct hgrnic_cq *ex_to_hgcq(struct ibv_cq_ex *ibcq)
+{
+    return to_hgcq(ibv_cq_ex_to_cq(ibcq));
+}
+
+static int hgrnic_next_poll(struct ibv_cq_ex *ibcq)
+{
+    struct hgrnic_cq *cq = ex_to_hgcq(ibcq);
+    struct hgrnic_qp *qp = NULL;
+    int err;
+
+    err = hgrnic_poll_one(cq, &qp, &cq->ex_wc, &cq->ex_ts);
+    if (err == CQ_EMPTY)
+        return ENOENT;
+    if (err == CQ_POLL_ERR)
+        return EINVAL;
+
+    ibcq->wr_id  = cq->ex_wc.wr_id;
+    ibcq->status = cq->ex_wc.status;
+    return 0;
+}
+
+static int hgrnic_start_poll(struct ibv_cq_ex *ibcq,
+                             struct ibv_poll_cq_attr *attr)
+{
+    struct hgrnic_cq *cq = ex_to_hgcq(ibcq);
+    int err;
+
+    if (attr->comp_mask)
+        return EINVAL;
+
+    pthread_spin_lock(&cq->lock);
+    err = hgrnic_next_poll(ibcq);
+    if (err)
+        pthread_spin_unlock(&cq->lock);
+    return err;
+}
+
+static void hgrnic_end_poll(struct ibv_cq_ex *ibcq)
+{
+    pthread_spin_unlock(&ex_to_hgcq(ibcq)->lock);
+}
+
+static enum ibv_wc_opcode hgrnic_read_opcode(struct ibv_cq_ex *ibcq)
+{
+    return ex_to_hgcq(ibcq)->ex_wc.opcode;
+}
+
+static uint32_t hgrnic_read_vendor_err(struct ibv_cq_ex *ibcq)
+{
+    return ex_to_hgcq(ibcq)->ex_wc.vendor_err;
+}
+
+static unsigned int hgrnic_read_wc_flags(struct ibv_cq_ex *ibcq)
+{
+    return ex_to_hgcq(ibcq)->ex_wc.wc_flags;
+}
+
+static uint32_t hgrnic_read_byte_len(struct ibv_cq_ex *ibcq)
+{
+    return ex_to_hgcq(ibcq)->ex_wc.byte_len;
+}
+
+static uint32_t hgrnic_read_imm_data(struct ibv_cq_ex *ibcq)
+{
+    return ex_to_hgcq(ibcq)->ex_wc.imm_data;
+}
+
+static uint32_t hgrnic_read_qp_num(struct ibv_cq_ex *ibcq)
+{
+    return ex_to_hgcq(ibcq)->ex_wc.qp_num;
+}
+
+static uint32_t hgrnic_read_src_qp(struct ibv_cq_ex *ibcq)
+{
+    return ex_to_hgcq(ibcq)->ex_wc.src_qp;
+}
+
+static uint32_t hgrnic_read_slid(struct ibv_cq_ex *ibcq)
+{
+    return ex_to_hgcq(ibcq)->ex_wc.slid;
+}
+
+static uint8_t hgrnic_read_sl(struct ibv_cq_ex *ibcq)
+{
+    return ex_to_hgcq(ibcq)->ex_wc.sl;
+}
+
+static uint8_t hgrnic_read_dlid_path_bits(struct ibv_cq_ex *ibcq)
+{
+    return ex_to_hgcq(ibcq)->ex_wc.dlid_path_bits;
+}
+
+/* Raw HCA clock cycles, see hgrnic_query_rt_values() */
+static uint64_t hgrnic_read_completion_ts(struct ibv_cq_ex *ibcq)
+{
+    return ex_to_hgcq(ibcq)->ex_ts;
+}
+
+/**
+ * @note Only the read ops asked for in wc_flags are set, as in other
+ * providers; the caller has checked wc_flags.
+ */
+void hgrnic_cq_fill_ex_ops(struct hgrnic_cq *cq, uint64_t wc_flags)
+{
+    struct ibv_cq_ex *ibcq = &cq->ibv_cq_ex;
+
+    ibcq->start_poll      = hgrnic_start_poll;
+    ibcq->next_poll       = hgrnic_next_poll;
+    ibcq->end_poll        = hgrnic_end_poll;
+    ibcq->read_opcode     = hgrnic_read_opcode;
+    ibcq->read_vendor_err = hgrnic_read_vendor_err;
+    ibcq->read_wc_flags   = hgrnic_read_wc_flags;
+
+    if (wc_flags & IBV_WC_EX_WITH_BYTE_LEN)
+        ibcq->read_byte_len = hgrnic_read_byte_len;
+    if (wc_flags & IBV_WC_EX_WITH_IMM)
+        ibcq->read_imm_data = hgrnic_read_imm_data;
+    if (wc_flags & IBV_WC_EX_WITH_QP_NUM)
+        ibcq->read_qp_num = hgrnic_read_qp_num;
+    if (wc_flags & IBV_WC_EX_WITH_SRC_QP)
+        ibcq->read_src_qp = hgrnic_read_src_qp;
+    if (wc_flags & IBV_WC_EX_WITH_SLID)
+        ibcq->read_slid = hgrnic_read_slid;
+    if (wc_flags & IBV_WC_EX_WITH_SL)
+        ibcq->read_sl = hgrnic_read_sl;
+    if (wc_flags & IBV_WC_EX_WITH_DLID_PATH_BITS)
+        ibcq->read_dlid_path_bits = hgrnic_read_dlid_path_bits;
+    if (wc_flags & IBV_WC_EX_WITH_COMPLETION_TIMESTAMP)
+        ibcq->read_completion_ts = hgrnic_read_completion_ts;
+}
+#endif /* HAVE_IBV_CQ_EX */
+
 static inline int is_recv_cqe(struct hgrnic_cqe *cqe)
 {
 	if ((cqe->opcode & HGRNIC_ERROR_CQE_OPCODE_MASK) ==
 	    HGRNIC_ERROR_CQE_OPCODE_MASK)
 		return !(cqe->opcode & 0x01);
 	else
-		return !(cqe->is_send & 0x80);
+		return !cqe->is_send;
 }
 
-void __hgrnic_cq_clean(struct hgrnic_cq *cq, uint32_t qpn)
+void __hgrnic_cq_clean(struct hgrnic_cq *cq, uint32_t qpn,
+                       struct hgrnic_srq *srq)
 {
     struct hgrnic_cqe *cqe;
     uint32_t prod_index;
@@ -429,9 +561,11 @@ void __hgrnic_cq_clean(struct hgrnic_cq *cq, uint32_t qpn)
     while ((int) --prod_index - (int) cq->cons_index >= 0) {
         cqe = get_cqe(cq, prod_index & cq->ibv_cq.cqe);
         //printf("[__hgrnic_cq_clean] my_qpn is 0x%x, qpn is 0x%x\n", cqe->my_qpn, qpn);
-        if (cqe->my_qpn == qpn) // !TODO: The order need to notice
+        if (cqe->my_qpn == qpn) { // !TODO: The order need to notice
+            if (srq && is_recv_cqe(cqe))
+                hgrnic_free_srq_wqe(srq, cqe->wqe >> srq->wqe_shift);
             ++nfreed;
-        else if (nfreed)
+        } else if (nfreed)
             memcpy(get_cqe(cq, (prod_index + nfreed) & cq->ibv_cq.cqe),
                    cqe, HGRNIC_CQ_ENTRY_SIZE);
     }
@@ -444,10 +578,11 @@ void __hgrnic_cq_clean(struct hgrnic_cq *cq, uint32_t qpn)
     }
 }
 
-void hgrnic_cq_clean(struct hgrnic_cq *cq, uint32_t qpn)
+void hgrnic_cq_clean(struct hgrnic_cq *cq, uint32_t qpn,
+                     struct hgrnic_srq *srq)
 {
     pthread_spin_lock(&cq->lock);
-    __hgrnic_cq_clean(cq, qpn);
+    __hgrnic_cq_clean(cq, qpn, srq);
     pthread_spin_unlock(&cq->lock);
 }
 
@@ -460,12 +595,13 @@ void hgrnic_cq_resize_copy_cqes(struct hgrnic_cq *cq, void *buf, int old_cqe)
                 get_cqe(cq, i & old_cqe), HGRNIC_CQ_ENTRY_SIZE);
 }
 
-int hgrnic_alloc_cq_buf(struct hgrnic_device *dev, struct hgrnic_buf *buf, int nent)
+int hgrnic_alloc_cq_buf(struct hgrnic_device *dev, struct hgrnic_buf *buf, int nent,
+                        int node)
 {
     int i;
 
     if (hgrnic_alloc_buf(buf, align(nent * HGRNIC_CQ_ENTRY_SIZE, dev->page_size),
-            dev->page_size))
+            dev->page_size, node))
         return -1;
 
     for (i = 0; i < nent; ++i)
@@ -0,0 +1,45 @@
+/*
+ * CQE layout written by the HCA. Shared with the tools that produce
+ * or parse CQEs outside libhgrnic (benchmark/datapath).
+ */
+
+#ifndef CQE_H
+#define CQE_H
+
+#include <stdint.h>
+
+enum {
+	HGRNIC_CQ_ENTRY_OWNER_SW     = 0x00,
+	HGRNIC_CQ_ENTRY_OWNER_HW     = 0x80
+};
+
+struct hgrnic_cqe {
+    uint32_t    my_qpn;
+    uint32_t    ts_lo; // completion timestamp, HCA clock bits 31:0
+    uint32_t    rqpn;
+    uint8_t     sl_ipok;
+    uint8_t     g_mlpath;
+    uint16_t    rlid;
+    uint32_t    imm;
+    uint32_t    byte_cnt;
+    uint32_t    wqe; // addr offset of completed wqe
+    uint8_t     opcode;
+    uint8_t     is_send;
+    uint8_t     ts_hi; // HCA clock bits 39:32
+    uint8_t     owner;
+};
+
+struct hgrnic_err_cqe {
+    uint32_t    my_qpn;
+    uint32_t    reserved1[3];
+    uint8_t     syndrome;
+    uint8_t     vendor_err;
+    uint16_t    db_cnt;
+    uint32_t    reserved2;
+    uint32_t    wqe;
+    uint8_t     opcode;
+    uint8_t     reserved3[2];
+    uint8_t     owner;
+};
+
+#endif /* CQE_H */
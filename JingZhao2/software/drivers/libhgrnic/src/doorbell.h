@@ -33,7 +33,20 @@
 #ifndef DOORBELL_H
 #define DOORBELL_H
 
-#ifdef __i386__
+#if defined(HGRNIC_SIM_DOORBELL)
+
+/*
+ * Built into simulator/hgshim: there is no UAR page, the doorbell goes
+ * to the device model. Same 64-bit value as the SIZEOF_LONG == 8 case.
+ */
+void hgrnic_sim_write64(struct hgrnic_context *ctx, int offset, uint64_t val);
+
+static inline void hgrnic_write64(uint32_t val[2], struct hgrnic_context *ctx, int offset)
+{
+	hgrnic_sim_write64(ctx, offset, (uint64_t) val[1] << 32 | val[0]);
+}
+
+#elif defined(__i386__)
 
 static inline void hgrnic_write64(uint32_t val[2], struct hgrnic_context *ctx, int offset)
 {
@@ -26,10 +26,15 @@
 
 #define HGRNIC_UVERBS_ABI_VERSION	1
 
+/* mmap offset, in pages, of the read-only HCA clock page */
+#define HGRNIC_MMAP_CLOCK_PAGE	1
+
 struct hgrnic_alloc_ucontext_resp {
     struct ibv_get_context_resp ibv_resp;
     __u32                       qp_tab_size;
-    __u32                       reserved;
+    __s32                       numa_node; /* NUMA node of the HCA, -1 if unknown */
+    __u32                       hca_core_clock; /* kHz, 0 from older kernels */
+    __u32                       clock_offset; /* of HCA_CLOCK_LO in the clock page */
 };
 
 struct hgrnic_alloc_pd_resp {
@@ -75,4 +80,16 @@ struct hgrnic_create_qp {
     __u32                   sq_lkey;
 };
 
+struct hgrnic_create_srq {
+    struct ibv_create_srq   ibv_cmd;
+    __u32                   lkey;
+    __u32                   reserved;
+};
+
+struct hgrnic_create_srq_resp {
+    struct ibv_create_srq_resp  ibv_resp;
+    __u32                       srqn;
+    __u32                       reserved;
+};
+
 #endif /* HGRNIC_ABI_USER_H */
\ No newline at end of file
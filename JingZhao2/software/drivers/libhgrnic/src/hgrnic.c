@@ -65,24 +65,64 @@ static struct ibv_context_ops hgrnic_ctx_ops = {
     .destroy_srq   = hgrnic_destroy_srq  
 };
 
+/**
+ * @note Node rings are bound to: the HCA's node reported by the
+ * kernel, unless HGRNIC_NUMA_NODE gives another one (-1 disables
+ * binding).
+ */
+static int hgrnic_ring_node(int dev_node)
+{
+    char *env = getenv("HGRNIC_NUMA_NODE");
+
+    if (env && *env)
+        return atoi(env);
+
+    return dev_node;
+}
+
+/**
+ * @note The clock page is optional, without it ibv_query_rt_values_ex
+ * fails but completions still carry timestamps.
+ */
+static void hgrnic_map_clock(struct hgrnic_context *context, int page_size,
+                             int cmd_fd, uint32_t clock_offset)
+{
+    void *page;
+
+    page = mmap(NULL, page_size, PROT_READ, MAP_SHARED, cmd_fd,
+                (off_t) HGRNIC_MMAP_CLOCK_PAGE * page_size);
+    if (page == MAP_FAILED)
+        return;
+
+    context->clock_page = page;
+    context->clock      = page + clock_offset;
+}
+
 static struct ibv_context *hgrnic_alloc_context(struct ibv_device *ibdev, int cmd_fd)
 {
     struct hgrnic_context            *context;
+    struct ibv_context               *ibctx;
     struct ibv_get_context           cmd;
     struct hgrnic_alloc_ucontext_resp resp;
+    struct ibv_device_attr           dev_attr;
     int                              i;
 
     context = calloc(1, sizeof *context);
     if (!context)
         return NULL;
 
-    context->ibv_ctx.cmd_fd = cmd_fd;
+    ibctx = hgctx_to_ibv(context);
+    ibctx->cmd_fd = cmd_fd;
 
-    if (ibv_cmd_get_context(&context->ibv_ctx, &cmd, sizeof cmd,
+    /* Older kernels do not fill in the clock fields */
+    memset(&resp, 0, sizeof resp);
+    if (ibv_cmd_get_context(ibctx, &cmd, sizeof cmd,
                 &resp.ibv_resp, sizeof resp))
         goto err_free;
 
     context->num_qps        = resp.qp_tab_size;
+    context->numa_node      = hgrnic_ring_node(resp.numa_node);
+    context->hca_core_clock = resp.hca_core_clock;
     context->qp_table_shift = ffs(context->num_qps) - 1 - HGRNIC_QP_TABLE_BITS;
     context->qp_table_mask  = (1 << context->qp_table_shift) - 1;
 
@@ -99,15 +139,35 @@ static struct ibv_context *hgrnic_alloc_context(struct ibv_device *ibdev, int cm
 
     pthread_spin_init(&context->uar_lock, PTHREAD_PROCESS_PRIVATE);
 
-    context->pd = hgrnic_alloc_pd(&context->ibv_ctx);
+    context->pd = hgrnic_alloc_pd(ibctx);
     if (!context->pd)
         goto err_unmap;
 
-    context->pd->context = &context->ibv_ctx;
+    context->pd->context = ibctx;
+
+    ibctx->ops = hgrnic_ctx_ops;
+
+#ifdef HAVE_IBV_CQ_EX
+    /* Old-style drivers set up the extended verbs themselves. */
+    context->ibv_vctx.sz              = sizeof context->ibv_vctx;
+    context->ibv_vctx.query_device_ex = hgrnic_query_device_ex;
+    context->ibv_vctx.query_rt_values = hgrnic_query_rt_values;
+    context->ibv_vctx.create_cq_ex    = hgrnic_create_cq_ex;
+    ibctx->abi_compat                 = __VERBS_ABI_IS_EXTENDED;
+#endif
+
+    /* ib_hgrnic reports atomic_cap only when the HCA implements it */
+    if (!hgrnic_query_device(ibctx, &dev_attr))
+        context->atomic_cap = dev_attr.atomic_cap != IBV_ATOMIC_NONE;
+
+    if (context->hca_core_clock)
+        hgrnic_map_clock(context, to_hgdev(ibdev)->page_size, cmd_fd,
+                         resp.clock_offset);
 
-    context->ibv_ctx.ops = hgrnic_ctx_ops;
+    /* Opt-in, the context works the same without it. */
+    context->mr_cache = hgrnic_mr_cache_create(to_hgdev(ibdev)->page_size);
 
-    return &context->ibv_ctx;
+    return ibctx;
 
 err_unmap:
     munmap(context->uar, to_hgdev(ibdev)->page_size);
@@ -121,7 +181,11 @@ static void hgrnic_free_context(struct ibv_context *ibctx)
 {
     struct hgrnic_context *context = to_hgctx(ibctx);
 
+    if (context->mr_cache)
+        hgrnic_mr_cache_destroy(context->mr_cache);
     hgrnic_free_pd(context->pd);
+    if (context->clock_page)
+        munmap(context->clock_page, to_hgdev(ibctx->device)->page_size);
     munmap(context->uar, to_hgdev(ibctx->device)->page_size);
     free(context);
 }
@@ -75,6 +75,9 @@ enum {
     HGRNIC_CQ_ENTRY_SIZE = 0x20
 };
 
+/* CQE timestamps are 40 bits of the HCA clock */
+#define HGRNIC_CQE_TS_MASK	((1ULL << 40) - 1)
+
 enum {
     HGRNIC_QP_TABLE_BITS = 8,
     HGRNIC_QP_TABLE_SIZE = 1 << HGRNIC_QP_TABLE_BITS,
@@ -116,9 +119,15 @@ struct hgrnic_device {
 };
 
 struct hgrnic_db_table;
+struct hgrnic_mr_cache;
+struct hgrnic_mr_cache_ent;
 
 struct hgrnic_context {
+#ifdef HAVE_IBV_CQ_EX
+    struct verbs_context    ibv_vctx; // extended ops, ends with the ibv_context
+#else
     struct ibv_context      ibv_ctx;
+#endif
     void                    *uar;
     pthread_spinlock_t      uar_lock;
     struct hgrnic_db_table  *db_tab;
@@ -131,6 +140,12 @@ struct hgrnic_context {
     int                    num_qps;
     int                    qp_table_shift; // Number of elem in one qp table in log
     int                    qp_table_mask ; // number of elem in one QP table
+    struct hgrnic_mr_cache *mr_cache; // NULL unless HGRNIC_MR_CACHE is set
+    int                    numa_node; // rings are placed here, -1 for anywhere
+    volatile uint32_t      *clock; // HCA_CLOCK_LO, NULL if not mapped
+    void                   *clock_page;
+    uint32_t               hca_core_clock; // kHz, 0 if unknown
+    int                    atomic_cap; // CS/FA WQEs are posted only if set
 };
 
 struct hgrnic_buf {
@@ -144,14 +159,28 @@ struct hgrnic_pd {
     uint32_t              pdn;
 };
 
+struct hgrnic_mr {
+    struct ibv_mr               ibv_mr;
+    struct hgrnic_mr_cache_ent *ent; // cached registration, or NULL
+};
+
 struct hgrnic_cq {
-    struct ibv_cq       ibv_cq;
+    union {
+        struct ibv_cq       ibv_cq;
+#ifdef HAVE_IBV_CQ_EX
+        struct ibv_cq_ex    ibv_cq_ex; // CQs from ibv_create_cq_ex
+#endif
+    };
     struct hgrnic_buf   buf   ; /* queue buffer */
     pthread_spinlock_t  lock  ;
     struct ibv_mr      *mr    ;
     uint32_t            cqn   ;
     uint32_t            cons_index; /* comsumer index, point to next consuming cqe, never go down */
     uint32_t            cqe_mask  ; /* cqe num - 1 */
+#ifdef HAVE_IBV_CQ_EX
+    struct ibv_wc       ex_wc; /* completion the ibv_cq_ex is at */
+    uint64_t            ex_ts;
+#endif
 };
 
 struct hgrnic_wq {
@@ -179,6 +208,28 @@ struct hgrnic_qp {
     struct hgrnic_wq  rq;
 };
 
+/*
+ * The HCA takes SRQ WQEs in ring order, whichever QP receives. A WQE
+ * is busy from post until its CQE is polled; posting stops at the
+ * first busy slot, so the posted WQEs stay contiguous.
+ */
+struct hgrnic_srq {
+    struct ibv_srq      ibv_srq;
+    pthread_spinlock_t  lock;
+    uint32_t            srqn;
+    int                 max;
+    int                 max_gs;
+    int                 wqe_shift;
+    unsigned            head; /* never go down */
+
+    int                 buf_size;
+    struct hgrnic_buf   buf;
+    struct ibv_mr      *mr;
+
+    uint64_t           *wrid;
+    uint8_t            *busy; /* one per WQE */
+};
+
 struct hgrnic_av {
     uint32_t port_pd;
     uint8_t  reserved1;
@@ -214,7 +265,21 @@ static inline struct hgrnic_device *to_hgdev(struct ibv_device *ibdev)
 
 static inline struct hgrnic_context *to_hgctx(struct ibv_context *ibctx)
 {
+#ifdef HAVE_IBV_CQ_EX
+    return (struct hgrnic_context *)
+        ((void *) ibctx - offsetof(struct hgrnic_context, ibv_vctx.context));
+#else
     return to_hgxxx(ctx, context);
+#endif
+}
+
+static inline struct ibv_context *hgctx_to_ibv(struct hgrnic_context *ctx)
+{
+#ifdef HAVE_IBV_CQ_EX
+    return &ctx->ibv_vctx.context;
+#else
+    return &ctx->ibv_ctx;
+#endif
 }
 
 static inline struct hgrnic_pd *to_hgpd(struct ibv_pd *ibpd)
@@ -222,6 +287,11 @@ static inline struct hgrnic_pd *to_hgpd(struct ibv_pd *ibpd)
     return to_hgxxx(pd, pd);
 }
 
+static inline struct hgrnic_mr *to_hgmr(struct ibv_mr *ibmr)
+{
+    return to_hgxxx(mr, mr);
+}
+
 static inline struct hgrnic_cq *to_hgcq(struct ibv_cq *ibcq)
 {
     return to_hgxxx(cq, cq);
@@ -232,18 +302,30 @@ static inline struct hgrnic_qp *to_hgqp(struct ibv_qp *ibqp)
     return to_hgxxx(qp, qp);
 }
 
+static inline struct hgrnic_srq *to_hgsrq(struct ibv_srq *ibsrq)
+{
+    return to_hgxxx(srq, srq);
+}
+
 static inline struct hgrnic_ah *to_hgah(struct ibv_ah *ibah)
 {
     return to_hgxxx(ah, ah);
 }
 
-int hgrnic_alloc_buf(struct hgrnic_buf *buf, size_t size, int page_size);
+int hgrnic_alloc_buf(struct hgrnic_buf *buf, size_t size, int page_size, int node);
 void hgrnic_free_buf(struct hgrnic_buf *buf);
 
 int hgrnic_query_device(struct ibv_context *context,
                         struct ibv_device_attr *attr);
 int hgrnic_query_port(struct ibv_context *context, uint8_t port,
                       struct ibv_port_attr *attr);
+#ifdef HAVE_IBV_CQ_EX
+int hgrnic_query_device_ex(struct ibv_context *context,
+                           const struct ibv_query_device_ex_input *input,
+                           struct ibv_device_attr_ex *attr, size_t attr_size);
+int hgrnic_query_rt_values(struct ibv_context *context,
+                           struct ibv_values_ex *values);
+#endif
 
 struct ibv_pd *hgrnic_alloc_pd(struct ibv_context *context);
 int hgrnic_free_pd(struct ibv_pd *pd);
@@ -251,6 +333,16 @@ int hgrnic_free_pd(struct ibv_pd *pd);
 struct ibv_mr *hgrnic_reg_mr(struct ibv_pd *pd, void *addr,
                              size_t length, enum ibv_access_flags access);
 int hgrnic_dereg_mr(struct ibv_mr *mr);
+struct ibv_mr *hgrnic_reg_mr_nocache(struct ibv_pd *pd, void *addr,
+                                     size_t length, int access);
+
+struct hgrnic_mr_cache *hgrnic_mr_cache_create(int page_size);
+void hgrnic_mr_cache_destroy(struct hgrnic_mr_cache *cache);
+struct ibv_mr *hgrnic_mr_cache_reg(struct hgrnic_mr_cache *cache,
+                                   struct ibv_pd *pd, void *addr,
+                                   size_t length, int access);
+void hgrnic_mr_cache_put(struct hgrnic_mr_cache *cache,
+                         struct hgrnic_mr_cache_ent *ent);
 
 struct ibv_cq *hgrnic_create_cq(struct ibv_context *context, int cqe,
                                 struct ibv_comp_channel *channel,
@@ -259,10 +351,16 @@ int hgrnic_resize_cq(struct ibv_cq *cq, int cqe);
 int hgrnic_destroy_cq(struct ibv_cq *cq);
 int hgrnic_notify_cq(struct ibv_cq *cq, int solicited_only);
 int hgrnic_poll_cq(struct ibv_cq *cq, int ne, struct ibv_wc *wc);
-void __hgrnic_cq_clean(struct hgrnic_cq *cq, uint32_t qpn);
-void hgrnic_cq_clean(struct hgrnic_cq *cq, uint32_t qpn);
+#ifdef HAVE_IBV_CQ_EX
+struct ibv_cq_ex *hgrnic_create_cq_ex(struct ibv_context *context,
+                                      struct ibv_cq_init_attr_ex *attr);
+void hgrnic_cq_fill_ex_ops(struct hgrnic_cq *cq, uint64_t wc_flags);
+#endif
+void __hgrnic_cq_clean(struct hgrnic_cq *cq, uint32_t qpn, struct hgrnic_srq *srq);
+void hgrnic_cq_clean(struct hgrnic_cq *cq, uint32_t qpn, struct hgrnic_srq *srq);
 void hgrnic_cq_resize_copy_cqes(struct hgrnic_cq *cq, void *buf, int new_cqe);
-int hgrnic_alloc_cq_buf(struct hgrnic_device *dev, struct hgrnic_buf *buf, int nent);
+int hgrnic_alloc_cq_buf(struct hgrnic_device *dev, struct hgrnic_buf *buf, int nent,
+                        int node);
 
 struct ibv_qp *hgrnic_create_qp(struct ibv_pd *pd, struct ibv_qp_init_attr *attr);
 int hgrnic_query_qp(struct ibv_qp *qp, struct ibv_qp_attr *attr,
@@ -288,6 +386,10 @@ int hgrnic_modify_srq(struct ibv_srq *srq, struct ibv_srq_attr *srq_attr, enum i
 int hgrnic_query_srq(struct ibv_srq *srq, struct ibv_srq_attr *srq_attr);
 int hgrnic_destroy_srq(struct ibv_srq *srq);
 int hgrnic_post_srq_recv(struct ibv_srq *srq, struct ibv_recv_wr *recv_wr, struct ibv_recv_wr **bad_recv_wr);
+int hgrnic_alloc_srq_buf(struct ibv_pd *pd, struct ibv_srq_attr *attr,
+                         struct hgrnic_srq *srq);
+void hgrnic_free_srq_buf(struct hgrnic_srq *srq);
+void hgrnic_free_srq_wqe(struct hgrnic_srq *srq, int ind);
 
 struct ibv_ah *hgrnic_create_ah(struct ibv_pd *pd, struct ibv_ah_attr *attr);
 int hgrnic_destroy_ah(struct ibv_ah *ah);
@@ -0,0 +1,659 @@
+/*
+ * Memory registration (pin-down) cache.
+ *
+ * Applications such as MPI register and deregister the same buffers
+ * over and over. When the cache is enabled (HGRNIC_MR_CACHE=1),
+ * hgrnic_reg_mr() first looks for a live registration covering
+ * [addr, addr + length) with the same PD and access flags, and
+ * hgrnic_dereg_mr() only drops a reference. Unreferenced
+ * registrations stay pinned on an LRU list until the pinned bytes
+ * exceed HGRNIC_MR_CACHE_MAX_BYTES.
+ *
+ * Cached ranges are registered to a userfaultfd, so munmap(),
+ * mremap(), brk() shrinking and madvise(MADV_DONTNEED/REMOVE) on
+ * them are reported to a monitor thread, which drops the stale
+ * registrations before the unmapping call returns. Memory that
+ * userfaultfd does not support (e.g. file-backed mappings) is
+ * registered uncached.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/userfaultfd.h>
+
+#include "hgrnic.h"
+
+enum {
+    HGRNIC_MR_CACHE_DEFAULT_MAX_BYTES = 1 << 30
+};
+
+struct hgrnic_mr_cache_ent {
+    /* interval tree (treap ordered by start, augmented by max_end) */
+    struct hgrnic_mr_cache_ent  *left, *right;
+    uintptr_t                    start, end; /* page aligned, [start, end) */
+    uintptr_t                    max_end;
+    uint32_t                     prio;
+
+    /* LRU of unreferenced entries, or list of dead entries */
+    struct hgrnic_mr_cache_ent  *prev, *next;
+    /* temporary link used while walking the tree */
+    struct hgrnic_mr_cache_ent  *hit;
+
+    struct ibv_pd               *pd;
+    int                          access;
+    struct ibv_mr               *mr; /* the real registration */
+    int                          refcnt;
+    int                          in_tree;
+};
+
+struct hgrnic_mr_cache {
+    pthread_mutex_t              lock;
+    struct hgrnic_mr_cache_ent  *root;
+    struct hgrnic_mr_cache_ent   lru;  /* list head, LRU first */
+    struct hgrnic_mr_cache_ent  *dead; /* entries waiting for free() */
+    size_t                       pinned;
+    size_t                       max_pinned;
+    uintptr_t                    page_mask;
+    uint32_t                     seed;
+
+    int                          uffd;
+    int                          stop_fd;
+    pthread_t                    monitor;
+
+    /* statistics */
+    unsigned long                hits;
+    unsigned long                misses;
+    unsigned long                evictions;
+    unsigned long                invalidations;
+    unsigned long                uncached;
+};
+
+/*****************************************************************
+ * Interval tree
+ *****************************************************************/
+
+static inline uintptr_t max_end(struct hgrnic_mr_cache_ent *n)
+{
+    return n ? n->max_end : 0;
+}
+
+static void ent_update(struct hgrnic_mr_cache_ent *n)
+{
+    n->max_end = n->end;
+    if (max_end(n->left) > n->max_end)
+        n->max_end = max_end(n->left);
+    if (max_end(n->right) > n->max_end)
+        n->max_end = max_end(n->right);
+}
+
+static struct hgrnic_mr_cache_ent *rotate_right(struct hgrnic_mr_cache_ent *n)
+{
+    struct hgrnic_mr_cache_ent *l = n->left;
+
+    n->left  = l->right;
+    l->right = n;
+    ent_update(n);
+    ent_update(l);
+    return l;
+}
+
+static struct hgrnic_mr_cache_ent *rotate_left(struct hgrnic_mr_cache_ent *n)
+{
+    struct hgrnic_mr_cache_ent *r = n->right;
+
+    n->right = r->left;
+    r->left  = n;
+    ent_update(n);
+    ent_update(r);
+    return r;
+}
+
+/* Order by start address, ties broken by entry address. */
+static inline int ent_before(struct hgrnic_mr_cache_ent *a,
+                             struct hgrnic_mr_cache_ent *b)
+{
+    return a->start < b->start ||
+           (a->start == b->start && (uintptr_t) a < (uintptr_t) b);
+}
+
+static struct hgrnic_mr_cache_ent *tree_insert(struct hgrnic_mr_cache_ent *root,
+                                               struct hgrnic_mr_cache_ent *n)
+{
+    if (!root) {
+        n->left = n->right = NULL;
+        ent_update(n);
+        return n;
+    }
+
+    if (ent_before(n, root)) {
+        root->left = tree_insert(root->left, n);
+        if (root->left->prio > root->prio)
+            return rotate_right(root);
+    } else {
+        root->right = tree_insert(root->right, n);
+        if (root->right->prio > root->prio)
+            return rotate_left(root);
+    }
+
+    ent_update(root);
+    return root;
+}
+
+static struct hgrnic_mr_cache_ent *tree_remove(struct hgrnic_mr_cache_ent *root,
+                                               struct hgrnic_mr_cache_ent *n)
+{
+    if (!root)
+        return NULL;
+
+    if (root == n) {
+        if (!root->left)
+            return root->right;
+        if (!root->right)
+            return root->left;
+
+        if (root->left->prio > root->right->prio) {
+            root = rotate_right(root);
+            root->right = tree_remove(root->right, n);
+        } else {
+            root = rotate_left(root);
+            root->left = tree_remove(root->left, n);
+        }
+    } else if (ent_before(n, root)) {
+        root->left = tree_remove(root->left, n);
+    } else {
+        root->right = tree_remove(root->right, n);
+    }
+
+    ent_update(root);
+    return root;
+}
+
+/**
+ * @note Link every entry overlapping [start, end) in front of *list
+ * through its hit pointer.
+ */
+static void tree_overlap(struct hgrnic_mr_cache_ent *n, uintptr_t start,
+                         uintptr_t end, struct hgrnic_mr_cache_ent **list)
+{
+    while (n && n->max_end > start) {
+        tree_overlap(n->left, start, end, list);
+        if (n->start >= end)
+            return;
+        if (n->end > start) {
+            n->hit = *list;
+            *list  = n;
+        }
+        n = n->right;
+    }
+}
+
+/*****************************************************************
+ * Cache entries
+ *****************************************************************/
+
+static inline void lru_del(struct hgrnic_mr_cache_ent *ent)
+{
+    ent->prev->next = ent->next;
+    ent->next->prev = ent->prev;
+    ent->prev = ent->next = NULL;
+}
+
+static inline void lru_add_tail(struct hgrnic_mr_cache *cache,
+                                struct hgrnic_mr_cache_ent *ent)
+{
+    ent->prev = cache->lru.prev;
+    ent->next = &cache->lru;
+    cache->lru.prev->next = ent;
+    cache->lru.prev = ent;
+}
+
+static void uffd_unregister(struct hgrnic_mr_cache *cache,
+                            uintptr_t start, uintptr_t end)
+{
+    struct uffdio_range range = {
+        .start = start,
+        .len   = end - start
+    };
+
+    ioctl(cache->uffd, UFFDIO_UNREGISTER, &range);
+    /* Let any thread that faulted in the range retry the access. */
+    ioctl(cache->uffd, UFFDIO_WAKE, &range);
+}
+
+/**
+ * @note Take ent out of the tree, so no new lookup can find it.
+ * Called with cache->lock held.
+ */
+static void ent_unlink(struct hgrnic_mr_cache *cache,
+                       struct hgrnic_mr_cache_ent *ent)
+{
+    if (!ent->in_tree)
+        return;
+
+    cache->root = tree_remove(cache->root, ent);
+    ent->in_tree = 0;
+    if (!ent->refcnt)
+        lru_del(ent);
+}
+
+/**
+ * @note Release the registration of an unlinked, unreferenced entry.
+ * The entry itself is only queued here: freeing memory may unmap
+ * part of a watched range, which must not happen under cache->lock
+ * or in the monitor thread.
+ */
+static void ent_destroy(struct hgrnic_mr_cache *cache,
+                        struct hgrnic_mr_cache_ent *ent)
+{
+    if (ibv_cmd_dereg_mr(ent->mr))
+        fprintf(stderr, PFX "mr_cache: failed to deregister [%p, %p)\n",
+                (void *) ent->start, (void *) ent->end);
+    cache->pinned -= ent->end - ent->start;
+
+    ent->next   = cache->dead;
+    cache->dead = ent;
+}
+
+/**
+ * @note Free entries queued by ent_destroy. Must be called without
+ * cache->lock held.
+ */
+static void cache_reap(struct hgrnic_mr_cache *cache)
+{
+    struct hgrnic_mr_cache_ent *ent, *next;
+
+    pthread_mutex_lock(&cache->lock);
+    ent = cache->dead;
+    cache->dead = NULL;
+    pthread_mutex_unlock(&cache->lock);
+
+    for (; ent; ent = next) {
+        next = ent->next;
+        free(to_hgmr(ent->mr));
+        free(ent);
+    }
+}
+
+/**
+ * @note Drop every registration overlapping [start, end).
+ * Called with cache->lock held.
+ */
+static void cache_invalidate(struct hgrnic_mr_cache *cache,
+                             uintptr_t start, uintptr_t end)
+{
+    struct hgrnic_mr_cache_ent *list = NULL, *ent;
+
+    tree_overlap(cache->root, start, end, &list);
+    for (ent = list; ent; ent = list) {
+        list = ent->hit;
+        ent_unlink(cache, ent);
+        ++cache->invalidations;
+        /* Entries still in use are destroyed by their last put. */
+        if (!ent->refcnt)
+            ent_destroy(cache, ent);
+    }
+}
+
+/**
+ * @note Evict unreferenced entries, LRU first, until the pinned
+ * bytes fit the limit. Called with cache->lock held.
+ */
+static void cache_evict(struct hgrnic_mr_cache *cache)
+{
+    struct hgrnic_mr_cache_ent *ent, *list;
+
+    while (cache->pinned > cache->max_pinned &&
+           cache->lru.next != &cache->lru) {
+        ent = cache->lru.next;
+        ent_unlink(cache, ent);
+
+        /* Keep watching the range if another entry still covers it. */
+        list = NULL;
+        tree_overlap(cache->root, ent->start, ent->end, &list);
+        if (!list)
+            uffd_unregister(cache, ent->start, ent->end);
+
+        ++cache->evictions;
+        ent_destroy(cache, ent);
+    }
+}
+
+/*****************************************************************
+ * Monitor thread
+ *****************************************************************/
+
+/**
+ * @note Handle all queued userfaultfd events.
+ * Called with cache->lock held. Holding the lock while reading
+ * matters: the unmapping thread is released as soon as its event
+ * is read, and no lookup may observe the range before it is
+ * invalidated.
+ */
+static void cache_drain_events(struct hgrnic_mr_cache *cache)
+{
+    struct uffd_msg msg;
+    uintptr_t start, end;
+
+    while (read(cache->uffd, &msg, sizeof msg) == sizeof msg) {
+        switch (msg.event) {
+        case UFFD_EVENT_UNMAP:
+        case UFFD_EVENT_REMOVE:
+            start = msg.arg.remove.start;
+            end   = msg.arg.remove.end;
+            cache_invalidate(cache, start, end);
+            if (msg.event == UFFD_EVENT_REMOVE)
+                uffd_unregister(cache, start, end);
+            break;
+
+        case UFFD_EVENT_REMAP:
+            start = msg.arg.remap.from;
+            end   = start + msg.arg.remap.len;
+            cache_invalidate(cache, start, end);
+            break;
+
+        case UFFD_EVENT_PAGEFAULT:
+            /*
+             * A page of a watched range went missing without an
+             * event we understand. Drop its registrations and stop
+             * watching the page, which wakes up the faulting thread.
+             */
+            start = msg.arg.pagefault.address & ~cache->page_mask;
+            end   = start + cache->page_mask + 1;
+            cache_invalidate(cache, start, end);
+            uffd_unregister(cache, start, end);
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+static void *cache_monitor(void *arg)
+{
+    struct hgrnic_mr_cache *cache = arg;
+    struct pollfd fds[2] = {
+        { .fd = cache->uffd,    .events = POLLIN },
+        { .fd = cache->stop_fd, .events = POLLIN }
+    };
+
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (fds[1].revents)
+            break;
+
+        if (fds[0].revents & POLLIN) {
+            pthread_mutex_lock(&cache->lock);
+            cache_drain_events(cache);
+            pthread_mutex_unlock(&cache->lock);
+        }
+    }
+
+    return NULL;
+}
+
+static int uffd_open(void)
+{
+    struct uffdio_api api = {
+        .api      = UFFD_API,
+        .features = UFFD_FEATURE_EVENT_UNMAP  |
+                    UFFD_FEATURE_EVENT_REMOVE |
+                    UFFD_FEATURE_EVENT_REMAP
+    };
+    int fd = -1;
+
+#ifdef UFFD_USER_MODE_ONLY
+    /* Unprivileged processes may only handle user-mode faults. */
+    fd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+#endif
+    if (fd < 0)
+        fd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0)
+        return -1;
+
+    if (ioctl(fd, UFFDIO_API, &api)) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/*****************************************************************
+ * Interface
+ *****************************************************************/
+
+struct hgrnic_mr_cache *hgrnic_mr_cache_create(int page_size)
+{
+    struct hgrnic_mr_cache *cache;
+    const char *env;
+
+    env = getenv("HGRNIC_MR_CACHE");
+    if (!env || !atoi(env))
+        return NULL;
+
+    cache = calloc(1, sizeof *cache);
+    if (!cache)
+        return NULL;
+
+    cache->lru.prev = cache->lru.next = &cache->lru;
+    cache->page_mask  = page_size - 1;
+    cache->seed       = (uint32_t) getpid() | 1;
+    cache->max_pinned = HGRNIC_MR_CACHE_DEFAULT_MAX_BYTES;
+    env = getenv("HGRNIC_MR_CACHE_MAX_BYTES");
+    if (env)
+        cache->max_pinned = strtoull(env, NULL, 0);
+
+    cache->uffd = uffd_open();
+    if (cache->uffd < 0) {
+        fprintf(stderr, PFX "mr_cache: userfaultfd unavailable (%s), "
+                "registration cache disabled\n", strerror(errno));
+        goto err_free;
+    }
+
+    cache->stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (cache->stop_fd < 0)
+        goto err_uffd;
+
+    pthread_mutex_init(&cache->lock, NULL);
+    if (pthread_create(&cache->monitor, NULL, cache_monitor, cache))
+        goto err_stop;
+
+    return cache;
+
+err_stop:
+    pthread_mutex_destroy(&cache->lock);
+    close(cache->stop_fd);
+
+err_uffd:
+    close(cache->uffd);
+
+err_free:
+    free(cache);
+    return NULL;
+}
+
+void hgrnic_mr_cache_destroy(struct hgrnic_mr_cache *cache)
+{
+    struct hgrnic_mr_cache_ent *list = NULL, *ent;
+    uint64_t one = 1;
+
+    if (write(cache->stop_fd, &one, sizeof one) == sizeof one)
+        pthread_join(cache->monitor, NULL);
+
+    if (getenv("HGRNIC_MR_CACHE_STATS"))
+        fprintf(stderr, PFX "mr_cache: %lu hits, %lu misses, %lu uncached, "
+                "%lu evictions, %lu invalidations, %zu bytes pinned\n",
+                cache->hits, cache->misses, cache->uncached,
+                cache->evictions, cache->invalidations, cache->pinned);
+
+    /* MRs still held by the application are released here as well. */
+    pthread_mutex_lock(&cache->lock);
+    tree_overlap(cache->root, 0, UINTPTR_MAX, &list);
+    for (ent = list; ent; ent = list) {
+        list = ent->hit;
+        ent_unlink(cache, ent);
+        ent_destroy(cache, ent);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    cache_reap(cache);
+
+    close(cache->stop_fd);
+    close(cache->uffd);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+/**
+ * @note Find or create a registration covering [addr, addr + length).
+ * Returns an MR handle owned by the caller, or NULL with errno set.
+ */
+struct ibv_mr *hgrnic_mr_cache_reg(struct hgrnic_mr_cache *cache,
+                                   struct ibv_pd *pd, void *addr,
+                                   size_t length, int access)
+{
+    struct hgrnic_mr_cache_ent *list = NULL, *ent;
+    struct uffdio_register reg;
+    struct hgrnic_mr *hgmr;
+    struct ibv_mr *mr;
+    uintptr_t start, end;
+
+    if (!length) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    start = (uintptr_t) addr & ~cache->page_mask;
+    end   = ((uintptr_t) addr + length + cache->page_mask) & ~cache->page_mask;
+
+    hgmr = malloc(sizeof *hgmr);
+    if (!hgmr)
+        return NULL;
+
+    pthread_mutex_lock(&cache->lock);
+    cache_drain_events(cache);
+
+    tree_overlap(cache->root, start, end, &list);
+    for (ent = list; ent; ent = ent->hit)
+        if (ent->pd == pd && ent->access == access &&
+            ent->start <= start && ent->end >= end)
+            break;
+
+    if (ent) {
+        ++cache->hits;
+        if (!ent->refcnt++)
+            lru_del(ent);
+        pthread_mutex_unlock(&cache->lock);
+        goto out;
+    }
+    ++cache->misses;
+    pthread_mutex_unlock(&cache->lock);
+
+    /* Register outside the lock, it pins and writes MTTs. */
+    ent = calloc(1, sizeof *ent);
+    if (!ent)
+        goto err_free;
+
+    ent->mr = hgrnic_reg_mr_nocache(pd, (void *) start, end - start, access);
+    if (!ent->mr)
+        goto err_free_ent;
+    ent->mr->context = pd->context;
+    ent->mr->pd      = pd;
+    ent->mr->addr    = (void *) start;
+    ent->mr->length  = end - start;
+
+    memset(&reg, 0, sizeof reg);
+    reg.range.start = start;
+    reg.range.len   = end - start;
+    reg.mode        = UFFDIO_REGISTER_MODE_MISSING;
+    if (ioctl(cache->uffd, UFFDIO_REGISTER, &reg)) {
+        /*
+         * Not watchable (file mapping, owned by another uffd ...),
+         * hand out the registration uncached.
+         */
+        pthread_mutex_lock(&cache->lock);
+        ++cache->uncached;
+        pthread_mutex_unlock(&cache->lock);
+        mr = ent->mr;
+        free(hgmr);
+        free(ent);
+        return mr;
+    }
+
+    ent->start  = start;
+    ent->end    = end;
+    ent->pd     = pd;
+    ent->access = access;
+    ent->refcnt = 1;
+
+    pthread_mutex_lock(&cache->lock);
+    /*
+     * Events queued while registering may concern the new range;
+     * handle them before the entry becomes visible.
+     */
+    cache_drain_events(cache);
+    cache->seed ^= cache->seed << 13;
+    cache->seed ^= cache->seed >> 17;
+    cache->seed ^= cache->seed << 5;
+    ent->prio    = cache->seed;
+    ent->in_tree = 1;
+    cache->root  = tree_insert(cache->root, ent);
+    cache->pinned += end - start;
+    cache_evict(cache);
+    pthread_mutex_unlock(&cache->lock);
+    cache_reap(cache);
+
+out:
+    mr = &hgmr->ibv_mr;
+    *mr = *ent->mr;
+    mr->addr   = addr;
+    mr->length = length;
+    hgmr->ent  = ent;
+    return mr;
+
+err_free_ent:
+    free(ent);
+
+err_free:
+    free(hgmr);
+    return NULL;
+}
+
+/**
+ * @note Drop the reference taken by hgrnic_mr_cache_reg. The
+ * registration stays cached unless it was invalidated meanwhile.
+ */
+void hgrnic_mr_cache_put(struct hgrnic_mr_cache *cache,
+                         struct hgrnic_mr_cache_ent *ent)
+{
+    pthread_mutex_lock(&cache->lock);
+    if (!--ent->refcnt) {
+        if (ent->in_tree) {
+            lru_add_tail(cache, ent);
+            cache_evict(cache);
+        } else {
+            ent_destroy(cache, ent);
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    cache_reap(cache);
+}
@@ -119,6 +119,18 @@ static inline void set_raddr_unit(struct hgrnic_raddr_unit *runit,
     runit->reserved = 0;
 }
 
+static inline void set_atomic_seg(struct hgrnic_atomic_seg *aseg,
+                                  struct ibv_send_wr *wr)
+{
+    if (wr->opcode == IBV_WR_ATOMIC_CMP_AND_SWP) {
+        aseg->swap_add = wr->wr.atomic.swap;
+        aseg->compare  = wr->wr.atomic.compare_add;
+    } else {
+        aseg->swap_add = wr->wr.atomic.compare_add;
+        aseg->compare  = 0;
+    }
+}
+
 static inline void set_ud_unit(struct hgrnic_ud_unit *uunit,
                                struct hgrnic_av *av, 
                                uint32_t dst_qpn, uint32_t dst_qkey)
@@ -136,7 +148,7 @@ static inline void hgrnic_send_db(struct hgrnic_qp *qp, int nreq,
     uint32_t db[2];
 
     db[1] = (qp->ibv_qp.qp_num << 8) | size0;
-    db[0] = ((qp->sq.head << (qp->sq.wqe_shift-4)) << 8) | f0 | op0;
+    db[0] = (((qp->sq.head & (qp->sq.max - 1)) << (qp->sq.wqe_shift-4)) << 8) | f0 | op0;
 
     wmb();
     hgrnic_write64(db, to_hgctx(qp->ibv_qp.context), HGRNIC_SEND_DOORBELL);
@@ -200,6 +212,9 @@ int hgrnic_post_send(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
         prev_wqe = qp->sq.last;
         qp->sq.last = cur_wqe;
 
+        /* The slot may still hold the link of its previous use. */
+        ((struct hgrnic_next_unit *) cur_unit)->nda_nop = 0;
+        ((struct hgrnic_next_unit *) cur_unit)->ee_nds  = 0;
         ((struct hgrnic_next_unit *) cur_unit)->flags =
             ((wr->send_flags & IBV_SEND_SIGNALED)  ? HGRNIC_NEXT_CQ_UPDATE : 0) |
             ((wr->send_flags & IBV_SEND_SOLICITED) ? HGRNIC_NEXT_SOLICIT : 0)   |
@@ -207,6 +222,8 @@ int hgrnic_post_send(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
         if (wr->opcode == IBV_WR_SEND_WITH_IMM ||
             wr->opcode == IBV_WR_RDMA_WRITE_WITH_IMM)
             ((struct hgrnic_next_unit *) cur_unit)->imm = wr->imm_data;
+        else
+            ((struct hgrnic_next_unit *) cur_unit)->imm = 0;
 
         cur_unit += sizeof (struct hgrnic_next_unit);
         size = sizeof (struct hgrnic_next_unit) / 16;
@@ -224,6 +241,29 @@ int hgrnic_post_send(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
                 size     += sizeof (struct hgrnic_raddr_unit) / 16;
                 break;
 
+            case IBV_WR_ATOMIC_CMP_AND_SWP:
+            case IBV_WR_ATOMIC_FETCH_AND_ADD:
+                /* The original value comes back into one aligned
+                 * 8-byte buffer. */
+                if (!to_hgctx(ibqp->context)->atomic_cap ||
+                    wr->num_sge != 1 || wr->send_flags & IBV_SEND_INLINE ||
+                    wr->sg_list[0].length != sizeof (uint64_t) ||
+                    (wr->sg_list[0].addr | wr->wr.atomic.remote_addr) &
+                    (sizeof (uint64_t) - 1)) {
+                    ret = -1;
+                    *bad_wr = wr;
+                    goto out;
+                }
+                set_raddr_unit((struct hgrnic_raddr_unit *)cur_unit,
+                                wr->wr.atomic.remote_addr,
+                                wr->wr.atomic.rkey);
+                cur_unit += sizeof (struct hgrnic_raddr_unit);
+                set_atomic_seg((struct hgrnic_atomic_seg *)cur_unit, wr);
+                cur_unit += sizeof (struct hgrnic_atomic_seg);
+                size     += (sizeof (struct hgrnic_raddr_unit) +
+                             sizeof (struct hgrnic_atomic_seg)) / 16;
+                break;
+
             default:
                 break;
             }
@@ -311,6 +351,11 @@ int hgrnic_post_send(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
             goto out;
         }
 
+        /* WQEParser takes a WQE's own size and opcode from its next unit */
+        ((struct hgrnic_next_unit *) cur_wqe)->flags |=
+                (size << HGRNIC_NEXT_CUR_SIZE_SHIFT) |
+                (hgrnic_opcode[wr->opcode] << HGRNIC_NEXT_CUR_OPCODE_SHIFT);
+
         if (!nreq) {
             size0 = size;
             op0   = hgrnic_opcode[wr->opcode];
@@ -492,7 +537,8 @@ int hgrnic_alloc_qp_buf(struct ibv_pd *pd, struct ibv_qp_cap *cap,
     /* Allocate queue space for SQ. */
     if (hgrnic_alloc_buf(&qp->sq.buf,
                 align(qp->sq.buf_size, to_hgdev(pd->context->device)->page_size),
-                to_hgdev(pd->context->device)->page_size)) {
+                to_hgdev(pd->context->device)->page_size,
+                to_hgctx(pd->context)->numa_node)) {
         free(qp->sq.wrid);
         free(qp->rq.wrid);
         return -1;
@@ -504,7 +550,8 @@ int hgrnic_alloc_qp_buf(struct ibv_pd *pd, struct ibv_qp_cap *cap,
     if (qp->rq.buf_size) { // if srq is used, rq buffer size is 0
         if (hgrnic_alloc_buf(&qp->rq.buf,
                     align(qp->rq.buf_size, to_hgdev(pd->context->device)->page_size),
-                    to_hgdev(pd->context->device)->page_size)) {
+                    to_hgdev(pd->context->device)->page_size,
+                    to_hgctx(pd->context)->numa_node)) {
             hgrnic_free_buf(&qp->sq.buf);
             free(qp->rq.wrid);
             free(qp->sq.wrid);
@@ -5,34 +5,131 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "hgrnic.h"
 #include "doorbell.h"
 #include "wqe.h"
 
-struct ibv_srq *hgrnic_create_srq(struct ibv_pd *pd, struct ibv_srq_init_attr *srq_init_attr) {
-    struct ibv_srq *srq;
+static void *get_srq_wqe(struct hgrnic_srq *srq, int n)
+{
+    return srq->buf.buf + (n << srq->wqe_shift);
+}
 
-    srq = malloc(sizeof *srq);
-    if (!srq)
-        return NULL;
+/*
+ * Size the ring the way ib_hgrnic does (hgrnic_set_srq_size), so the
+ * WQE size and count in the SRQ context match this buffer.
+ */
+int hgrnic_alloc_srq_buf(struct ibv_pd *pd, struct ibv_srq_attr *attr,
+                         struct hgrnic_srq *srq)
+{
+    int page_size = to_hgdev(pd->context->device)->page_size;
+    int size;
 
-    return srq;
-}
+    for (srq->max = 1; srq->max < attr->max_wr; srq->max <<= 1)
+        ; /* nothing */
+    srq->max_gs = attr->max_sge;
+
+    size = sizeof (struct hgrnic_next_unit) +
+        srq->max_gs * sizeof (struct hgrnic_data_unit);
+    for (srq->wqe_shift = 7; 1 << srq->wqe_shift < size; srq->wqe_shift++)
+        ; /* nothing */
+
+    srq->buf_size = srq->max << srq->wqe_shift;
+
+    srq->wrid = malloc(srq->max * sizeof (uint64_t));
+    if (!srq->wrid)
+        return -1;
+
+    srq->busy = calloc(srq->max, 1);
+    if (!srq->busy) {
+        free(srq->wrid);
+        return -1;
+    }
 
-int hgrnic_modify_srq(struct ibv_srq *srq, struct ibv_srq_attr *srq_attr, enum ibv_srq_attr_mask srq_attr_mask) {
-    return 1; // not support modify srq
+    if (hgrnic_alloc_buf(&srq->buf, align(srq->buf_size, page_size),
+                         page_size, to_hgctx(pd->context)->numa_node)) {
+        free(srq->busy);
+        free(srq->wrid);
+        return -1;
+    }
+
+    memset(srq->buf.buf, 0, srq->buf_size);
+    srq->head = 0;
+
+    return 0;
 }
 
-int hgrnic_query_srq(struct ibv_srq *srq, struct ibv_srq_attr *srq_attr) {
-    return 1;
+void hgrnic_free_srq_buf(struct hgrnic_srq *srq)
+{
+    hgrnic_free_buf(&srq->buf);
+    free(srq->busy);
+    free(srq->wrid);
 }
 
-int hgrnic_destroy_srq(struct ibv_srq *srq) {
-    free(srq);
-    return 0;
+/* Called with the CQ lock held, possibly of different CQs. */
+void hgrnic_free_srq_wqe(struct hgrnic_srq *srq, int ind)
+{
+    pthread_spin_lock(&srq->lock);
+    srq->busy[ind] = 0;
+    pthread_spin_unlock(&srq->lock);
 }
 
-int hgrnic_post_srq_recv(struct ibv_srq *srq, struct ibv_recv_wr *recv_wr, struct ibv_recv_wr **bad_recv_wr) {
-    return 0;
-}
\ No newline at end of file
+int hgrnic_post_srq_recv(struct ibv_srq *ibsrq, struct ibv_recv_wr *wr,
+                         struct ibv_recv_wr **bad_wr)
+{
+    struct hgrnic_srq *srq = to_hgsrq(ibsrq);
+    struct hgrnic_next_unit *next;
+    struct hgrnic_data_unit *dunit;
+    int ret = 0;
+    int ind;
+    int i;
+
+    pthread_spin_lock(&srq->lock);
+
+    for (; wr; wr = wr->next) {
+        ind = srq->head & (srq->max - 1);
+
+        if (srq->busy[ind]) {
+            ret = -1;
+            *bad_wr = wr;
+            break;
+        }
+
+        if (wr->num_sge > srq->max_gs) {
+            ret = -1;
+            *bad_wr = wr;
+            break;
+        }
+
+        next = get_srq_wqe(srq, ind);
+        next->ee_nds = 0;
+        next->flags  = 0;
+
+        dunit = (struct hgrnic_data_unit *) (next + 1);
+        for (i = 0; i < wr->num_sge; ++i, ++dunit) {
+            dunit->byte_count = wr->sg_list[i].length;
+            dunit->lkey       = wr->sg_list[i].lkey;
+            dunit->addr       = wr->sg_list[i].addr;
+        }
+
+        /* end of data unit */
+        if (i < srq->max_gs) {
+            dunit->byte_count = 0;
+            dunit->lkey       = HGRNIC_INVAL_LKEY;
+            dunit->addr       = 0;
+        }
+
+        srq->wrid[ind] = wr->wr_id;
+        srq->busy[ind] = 1;
+
+        /* The HCA takes the WQE once it is valid, data units first. */
+        wmb();
+        next->nda_nop = HGRNIC_NEXT_VALID;
+
+        ++srq->head;
+    }
+
+    pthread_spin_unlock(&srq->lock);
+    return ret;
+}
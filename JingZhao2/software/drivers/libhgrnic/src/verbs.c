@@ -83,6 +83,68 @@ int hgrnic_query_device(struct ibv_context *context, struct ibv_device_attr *att
     return 0;
 }
 
+#ifdef HAVE_IBV_CQ_EX
+int hgrnic_query_device_ex(struct ibv_context *context,
+                           const struct ibv_query_device_ex_input *input,
+                           struct ibv_device_attr_ex *attr, size_t attr_size)
+{
+    struct hgrnic_context *ctx = to_hgctx(context);
+    int ret;
+
+    if (input && input->comp_mask)
+        return EINVAL;
+    if (attr_size < offsetof(struct ibv_device_attr_ex, hca_core_clock) +
+                    sizeof attr->hca_core_clock)
+        return EINVAL;
+
+    memset(attr, 0, attr_size);
+    ret = hgrnic_query_device(context, &attr->orig_attr);
+    if (ret)
+        return ret;
+
+    /* A kernel that does not report the clock rate predates timestamps */
+    if (ctx->hca_core_clock) {
+        attr->completion_timestamp_mask = HGRNIC_CQE_TS_MASK;
+        attr->hca_core_clock            = ctx->hca_core_clock;
+    }
+
+    return 0;
+}
+
+/**
+ * @note The raw clock is in HCA clock cycles, tv_nsec holds the count
+ * as in other providers. The device does not latch HCA_CLOCK_HI, so it
+ * is read before and after HCA_CLOCK_LO, and again if LO carried into
+ * it in between.
+ */
+int hgrnic_query_rt_values(struct ibv_context *context,
+                           struct ibv_values_ex *values)
+{
+    struct hgrnic_context *ctx = to_hgctx(context);
+    uint32_t comp_mask = 0;
+    uint32_t lo, hi, hi2;
+
+    if (values->comp_mask & IBV_VALUES_MASK_RAW_CLOCK) {
+        if (!ctx->clock)
+            return EOPNOTSUPP;
+
+        hi2 = ctx->clock[1];
+        do {
+            hi = hi2;
+            lo = ctx->clock[0];
+            hi2 = ctx->clock[1];
+        } while (hi != hi2);
+        values->raw_clock.tv_sec  = 0;
+        values->raw_clock.tv_nsec = ((uint64_t) hi << 32) | lo;
+        comp_mask |= IBV_VALUES_MASK_RAW_CLOCK;
+    }
+
+    values->comp_mask = comp_mask;
+
+    return 0;
+}
+#endif /* HAVE_IBV_CQ_EX */
+
 int hgrnic_query_port(struct ibv_context *context, uint8_t port,
                       struct ibv_port_attr *attr)
 {
@@ -137,7 +199,7 @@ static struct ibv_mr *__hgrnic_reg_mr(struct ibv_pd *pd, void *addr,
 {
     struct ibv_reg_mr_resp resp;
     struct hgrnic_reg_mr cmd;
-    struct ibv_mr *mr;
+    struct hgrnic_mr *mr;
     int ret;
 
     /*
@@ -152,8 +214,9 @@ static struct ibv_mr *__hgrnic_reg_mr(struct ibv_pd *pd, void *addr,
     mr = malloc(sizeof *mr);
     if (!mr)
         return NULL;
+    mr->ent = NULL;
 
-    ret = ibv_cmd_reg_mr(pd, addr, length, hca_va, access, mr,
+    ret = ibv_cmd_reg_mr(pd, addr, length, hca_va, access, &mr->ibv_mr,
                          &cmd.ibv_cmd, sizeof cmd, &resp, sizeof resp);
     if (ret)
     {
@@ -161,24 +224,42 @@ static struct ibv_mr *__hgrnic_reg_mr(struct ibv_pd *pd, void *addr,
         return NULL;
     }
 
-    return mr;
+    return &mr->ibv_mr;
+}
+
+struct ibv_mr *hgrnic_reg_mr_nocache(struct ibv_pd *pd, void *addr,
+                                     size_t length, int access)
+{
+    return __hgrnic_reg_mr(pd, addr, length, (uintptr_t)addr, access, 0);
 }
 
 struct ibv_mr *hgrnic_reg_mr(struct ibv_pd *pd, void *addr,
                              size_t length, enum ibv_access_flags access)
 {
-    return __hgrnic_reg_mr(pd, addr, length, (uintptr_t)addr, (int)access, 0);
+    struct hgrnic_context *ctx = to_hgctx(pd->context);
+
+    if (ctx->mr_cache)
+        return hgrnic_mr_cache_reg(ctx->mr_cache, pd, addr, length, (int)access);
+
+    return hgrnic_reg_mr_nocache(pd, addr, length, (int)access);
 }
 
 int hgrnic_dereg_mr(struct ibv_mr *mr)
 {
+    struct hgrnic_mr *hgmr = to_hgmr(mr);
     int ret;
 
+    if (hgmr->ent) {
+        hgrnic_mr_cache_put(to_hgctx(mr->context)->mr_cache, hgmr->ent);
+        free(hgmr);
+        return 0;
+    }
+
     ret = ibv_cmd_dereg_mr(mr);
     if (ret)
         return ret;
 
-    free(mr);
+    free(hgmr);
     return 0;
 }
 
@@ -205,7 +286,7 @@ struct ibv_cq *hgrnic_create_cq(struct ibv_context *context, int cqe,
     if (cqe > 0x20000)
         return NULL;
 
-    cq = malloc(sizeof *cq);
+    cq = calloc(1, sizeof *cq);
     if (!cq)
         return NULL;
 
@@ -216,7 +297,8 @@ struct ibv_cq *hgrnic_create_cq(struct ibv_context *context, int cqe,
 
     cqe = align_cq_size(cqe);
     cq->cqe_mask = cqe - 1; // cqe is in log size, so (cqe - 1) could be the mask
-    if (hgrnic_alloc_cq_buf(to_hgdev(context->device), &cq->buf, cqe))
+    if (hgrnic_alloc_cq_buf(to_hgdev(context->device), &cq->buf, cqe,
+                            to_hgctx(context)->numa_node))
         goto err;
 
     cq->mr = __hgrnic_reg_mr(to_hgctx(context)->pd, cq->buf.buf,
@@ -290,6 +372,59 @@ err:
     return NULL;
 }
 
+#ifdef HAVE_IBV_CQ_EX
+enum {
+    HGRNIC_CQ_EX_WC_FLAGS = IBV_WC_EX_WITH_BYTE_LEN  | IBV_WC_EX_WITH_IMM |
+                            IBV_WC_EX_WITH_QP_NUM    | IBV_WC_EX_WITH_SRC_QP |
+                            IBV_WC_EX_WITH_SLID      | IBV_WC_EX_WITH_SL |
+                            IBV_WC_EX_WITH_DLID_PATH_BITS |
+                            IBV_WC_EX_WITH_COMPLETION_TIMESTAMP
+};
+
+/**
+ * @note libibverbs leaves all of the CQ to the provider here, so the
+ * fields ibv_create_cq() sets on top of hgrnic_create_cq() are set
+ * below.
+ */
+struct ibv_cq_ex *hgrnic_create_cq_ex(struct ibv_context *context,
+                                      struct ibv_cq_init_attr_ex *attr)
+{
+    struct ibv_cq *ibcq;
+    struct hgrnic_cq *cq;
+
+    if (attr->comp_mask || (attr->wc_flags & ~HGRNIC_CQ_EX_WC_FLAGS) ||
+        ((attr->wc_flags & IBV_WC_EX_WITH_COMPLETION_TIMESTAMP) &&
+         !to_hgctx(context)->hca_core_clock)) {
+        errno = EOPNOTSUPP;
+        return NULL;
+    }
+
+    ibcq = hgrnic_create_cq(context, attr->cqe, attr->channel,
+                            attr->comp_vector);
+    if (!ibcq)
+        return NULL;
+
+    ibcq->context                = context;
+    ibcq->channel                = attr->channel;
+    ibcq->cq_context             = attr->cq_context;
+    ibcq->comp_events_completed  = 0;
+    ibcq->async_events_completed = 0;
+    pthread_mutex_init(&ibcq->mutex, NULL);
+    pthread_cond_init(&ibcq->cond, NULL);
+
+    if (attr->channel) {
+        pthread_mutex_lock(&context->mutex);
+        ++attr->channel->refcnt;
+        pthread_mutex_unlock(&context->mutex);
+    }
+
+    cq = to_hgcq(ibcq);
+    hgrnic_cq_fill_ex_ops(cq, attr->wc_flags);
+
+    return &cq->ibv_cq_ex;
+}
+#endif /* HAVE_IBV_CQ_EX */
+
 int hgrnic_resize_cq(struct ibv_cq *ibcq, int cqe)
 {
     struct hgrnic_cq *cq = to_hgcq(ibcq);
@@ -314,7 +449,8 @@ int hgrnic_resize_cq(struct ibv_cq *ibcq, int cqe)
         goto out;
     }
 
-    ret = hgrnic_alloc_cq_buf(to_hgdev(ibcq->context->device), &buf, cqe);
+    ret = hgrnic_alloc_cq_buf(to_hgdev(ibcq->context->device), &buf, cqe,
+                              to_hgctx(ibcq->context)->numa_node);
     if (ret)
         goto out;
 
@@ -372,6 +508,88 @@ int hgrnic_destroy_cq(struct ibv_cq *cq)
     return 0;
 }
 
+struct ibv_srq *hgrnic_create_srq(struct ibv_pd *pd,
+                                  struct ibv_srq_init_attr *attr)
+{
+    struct hgrnic_create_srq      cmd;
+    struct hgrnic_create_srq_resp resp;
+    struct hgrnic_srq *srq;
+    int ret;
+
+    /* Sanity check SRQ size before proceeding */
+    if (!attr->attr.max_wr || attr->attr.max_wr > 65536 ||
+        attr->attr.max_sge > 64)
+        return NULL;
+
+    srq = malloc(sizeof *srq);
+    if (!srq)
+        return NULL;
+
+    if (pthread_spin_init(&srq->lock, PTHREAD_PROCESS_PRIVATE))
+        goto err;
+
+    if (hgrnic_alloc_srq_buf(pd, &attr->attr, srq))
+        goto err;
+
+    srq->mr = __hgrnic_reg_mr(pd, srq->buf.buf, srq->buf_size, 0, 0, 0);
+    if (!srq->mr)
+        goto err_free;
+
+    srq->mr->context = pd->context;
+    cmd.lkey     = srq->mr->lkey;
+    cmd.reserved = 0;
+
+    ret = ibv_cmd_create_srq(pd, &srq->ibv_srq, attr, &cmd.ibv_cmd,
+                             sizeof cmd, &resp.ibv_resp, sizeof resp);
+    if (ret)
+        goto err_unreg;
+
+    srq->srqn = resp.srqn;
+
+    return &srq->ibv_srq;
+
+err_unreg:
+    hgrnic_dereg_mr(srq->mr);
+
+err_free:
+    hgrnic_free_srq_buf(srq);
+
+err:
+    free(srq);
+
+    return NULL;
+}
+
+int hgrnic_modify_srq(struct ibv_srq *srq, struct ibv_srq_attr *attr,
+                      enum ibv_srq_attr_mask attr_mask)
+{
+    struct ibv_modify_srq cmd;
+
+    return ibv_cmd_modify_srq(srq, attr, attr_mask, &cmd, sizeof cmd);
+}
+
+int hgrnic_query_srq(struct ibv_srq *srq, struct ibv_srq_attr *attr)
+{
+    struct ibv_query_srq cmd;
+
+    return ibv_cmd_query_srq(srq, attr, &cmd, sizeof cmd);
+}
+
+int hgrnic_destroy_srq(struct ibv_srq *srq)
+{
+    int ret;
+
+    ret = ibv_cmd_destroy_srq(srq);
+    if (ret)
+        return ret;
+
+    hgrnic_dereg_mr(to_hgsrq(srq)->mr);
+    hgrnic_free_srq_buf(to_hgsrq(srq));
+    free(to_hgsrq(srq));
+
+    return 0;
+}
+
 static int align_queue_size(struct ibv_context *context, int size, int spare)
 {
     int ret;
@@ -415,8 +633,15 @@ struct ibv_qp *hgrnic_create_qp(struct ibv_pd *pd, struct ibv_qp_init_attr *attr
 //    printf("max_send_wr %d, max_recv_wr %d, max_send_sge %d, max_recv_sge %d\n",
 //           attr->cap.max_send_wr, attr->cap.max_recv_wr, attr->cap.max_send_sge, attr->cap.max_recv_sge);
 //
+    /* Receives go to the SRQ, the QP gets no RQ. */
+    if (attr->srq) {
+        attr->cap.max_recv_wr  = 0;
+        attr->cap.max_recv_sge = 0;
+    }
+
     qp->sq.max = align_queue_size(pd->context, attr->cap.max_send_wr, 0);
     qp->rq.max = align_queue_size(pd->context, attr->cap.max_recv_wr, 0);
+    qp->rq.mr  = NULL;
 
     if (hgrnic_alloc_qp_buf(pd, &attr->cap, attr->qp_type, qp))
         goto err;
@@ -431,11 +656,12 @@ struct ibv_qp *hgrnic_create_qp(struct ibv_pd *pd, struct ibv_qp_init_attr *attr
 
     qp->sq.mr->context = pd->context;
     cmd.sq_lkey = qp->sq.mr->lkey;
+    cmd.rq_lkey = 0;
 
     if (qp->rq.buf_size)
     {
         qp->rq.mr = __hgrnic_reg_mr(pd, qp->rq.buf.buf, qp->rq.buf_size, 0, 0, 0);
-        if (!qp->sq.mr)
+        if (!qp->rq.mr)
             goto err_sq_mr_unreg;
 
         qp->rq.mr->context = pd->context;
@@ -484,7 +710,8 @@ err_free:
     free(qp->sq.wrid);
     free(qp->rq.wrid);
     hgrnic_free_buf(&qp->sq.buf);
-    hgrnic_free_buf(&qp->rq.buf);
+    if (qp->rq.buf_size)
+        hgrnic_free_buf(&qp->rq.buf);
 
 err:
 	//fprintf(stderr, "\033[31m libhgrnic : err! \033[0m\n");
@@ -515,9 +742,10 @@ int hgrnic_modify_qp(struct ibv_qp *qp, struct ibv_qp_attr *attr,
         (attr_mask & IBV_QP_STATE) &&
         attr->qp_state == IBV_QPS_RESET)
     {
-        hgrnic_cq_clean(to_hgcq(qp->recv_cq), qp->qp_num);
+        hgrnic_cq_clean(to_hgcq(qp->recv_cq), qp->qp_num,
+                        qp->srq ? to_hgsrq(qp->srq) : NULL);
         if (qp->send_cq != qp->recv_cq)
-            hgrnic_cq_clean(to_hgcq(qp->send_cq), qp->qp_num);
+            hgrnic_cq_clean(to_hgcq(qp->send_cq), qp->qp_num, NULL);
 
         hgrnic_init_qp_indices(to_hgqp(qp));
     }
@@ -577,9 +805,10 @@ int hgrnic_destroy_qp(struct ibv_qp *qp)
 
     hgrnic_lock_cqs(qp);
 
-    __hgrnic_cq_clean(to_hgcq(qp->recv_cq), qp->qp_num);
+    __hgrnic_cq_clean(to_hgcq(qp->recv_cq), qp->qp_num,
+                      qp->srq ? to_hgsrq(qp->srq) : NULL);
     if (qp->send_cq != qp->recv_cq)
-        __hgrnic_cq_clean(to_hgcq(qp->send_cq), qp->qp_num);
+        __hgrnic_cq_clean(to_hgcq(qp->send_cq), qp->qp_num, NULL);
 
     hgrnic_clear_qp(to_hgctx(qp->context), qp->qp_num);
 
@@ -587,9 +816,11 @@ int hgrnic_destroy_qp(struct ibv_qp *qp)
     pthread_mutex_unlock(&to_hgctx(qp->context)->qp_table_mutex);
 
     hgrnic_dereg_mr(to_hgqp(qp)->sq.mr);
-    hgrnic_dereg_mr(to_hgqp(qp)->rq.mr);
     hgrnic_free_buf(&to_hgqp(qp)->sq.buf);
-    hgrnic_free_buf(&to_hgqp(qp)->rq.buf);
+    if (to_hgqp(qp)->rq.buf_size) {
+        hgrnic_dereg_mr(to_hgqp(qp)->rq.mr);
+        hgrnic_free_buf(&to_hgqp(qp)->rq.buf);
+    }
     free(to_hgqp(qp)->sq.wrid);
     free(to_hgqp(qp)->rq.wrid);
     free(to_hgqp(qp));
@@ -48,6 +48,12 @@ enum {
 	HGRNIC_NEXT_SOLICIT   = 1 << 1,
 };
 
+/* Fields of next unit flags describing the WQE the unit belongs to */
+enum {
+    HGRNIC_NEXT_CUR_SIZE_SHIFT   = 6,  /* [13:6] WQE size, 16-byte units */
+    HGRNIC_NEXT_CUR_OPCODE_SHIFT = 14  /* [21:14] WQE opcode */
+};
+
 enum {
 	HGRNIC_INLINE_UNIT = 1 << 31
 };
@@ -60,7 +66,7 @@ enum {
 struct hgrnic_next_unit {
     uint32_t    nda_nop; /* [31:6] next WQE [4:0] next opcode */
     uint32_t    ee_nds; /* [31:8] next EE  [7] DBD [6] F [5:0] next WQE size */
-    uint32_t    flags;  /* [3] CQ [2] Event [1] Solicit */
+    uint32_t    flags;  /* [21:14] opcode [13:6] size [3] CQ [2] Event [1] Solicit */
     uint32_t    imm;    /* immediate data */
 };
 
@@ -0,0 +1,35 @@
+-F ../../../hardware/hdl/include/include.f
+../sim_lib/SRAM_SDP_Template.v
+../sim_lib/SRAM_TDP_Template.v
+../sim_lib/SyncFIFO_Template.v
+../sim_lib/pcieifc_sync_fifo.v
+../sim_lib/pcieifc_async_fifo_2psram.v
+../sim_lib/pcieifc_sd_sram.v
+../sim_lib/pcieifc_td_sram.v
+../sim_lib/AsyncFIFO_577w_128d.v
+../../../hardware/hdl/rtl/Common/SyncFIFO_2Port_SRAM.v
+../../../hardware/hdl/rtl/Common/SyncFIFO_2Port_Ctrl_SRAM.v
+../../../hardware/hdl/rtl/Common/SRAM_SDP_Model.v
+../../../hardware/hdl/rtl/Common/stream_fifo.v
+../../../hardware/hdl/rtl/Common/stream_reg.v
+../../../hardware/hdl/rtl/Common/AXISArbiter.v
+../../../hardware/hdl/rtl/Common/st_reg.v
+../../../hardware/hdl/rtl/Common/st_mux.v
+../../../hardware/hdl/rtl/Common/st_demux.v
+../../../hardware/hdl/rtl/Common/slice/gp_slice_ml.v
+../../../hardware/hdl/rtl/Common/slice/gp_slice.v
+../../../hardware/hdl/lib/pciei_lib/async_fifo/pcieifc_async_fifo.v
+../../../hardware/hdl/lib/pciei_lib/cdc/cdc_syncff.v
+../../../hardware/hdl/lib/pciei_lib/cell/sim/cell_sync2ffr.v
+../../../hardware/hdl/lib/pciei_lib/cell/sim/cell_sync3ffr.v
+../../../hardware/hdl/lib/pciei_lib/cell/sim/cell_sync2ffs.v
+../../../hardware/hdl/lib/pciei_lib/cell/sim/cell_sync3ffs.v
+../../../hardware/hdl/rtl/Top/HanGuHTN_Top.v
+../../../hardware/hdl/rtl/Top/ProtocolEngine_Top.v
+../../../hardware/hdl/rtl/Top/DMA_Channel_Top.v
+-F ../../../hardware/hdl/rtl/PCIeInterface/pcie_interface.f
+-F ../../../hardware/hdl/rtl/Peripherals/peripherals.f
+-F ../../../hardware/hdl/rtl/QueueSubsystem/queue_subsystem.f
+-F ../../../hardware/hdl/rtl/ResMgtSubsystem/res_mgt_subsystem.f
+-F ../../../hardware/hdl/rtl/RPCSubsystem/rpc_subsystem.f
+-F ../../../hardware/hdl/rtl/TransportSubsystem/transport_subsystem.f
@@ -0,0 +1,844 @@
+/*
+ * Co-simulation of HanGuHTN_Top under Verilator.
+ *
+ * The model plays the PCIe hard block and the Ethernet MAC around the
+ * RTL. Host traffic arrives through the shared memory rings of
+ * simulator/hgcosim/hgcosim_shm.h, which libhgcosim fills from the
+ * hgmodel API. A program written against hgmodel can therefore run
+ * against the RTL. ib_hgrnic/libhgrnic cannot until an MMIO frontend
+ * presents the model as a device.
+ *
+ *   MMIO  each ring entry becomes a CQ TLP (BAR0 = HCR, BAR2 = UAR). A
+ *         read completes from the matching CC TLP.
+ *   DMA   RQ memory writes go to the host through the dma ring. RQ
+ *         reads go through the ring too, and the data comes back as RC
+ *         completions after -L cycles, split at -R byte boundaries.
+ *   MAC   TX is looped back to RX after -W cycles.
+ *
+ * All clocks are one clock of -p picoseconds. MSI-X messages are
+ * acknowledged and counted; there is no interrupt path to the host.
+ *
+ * Simulated time is published in the shared memory, along with the
+ * latency of each pipeline stage as seen at the PCIe and MAC ports.
+ * Events are matched to send doorbells in order: the first DMA read
+ * after a doorbell starts its fetch, the first MAC TX packet after that
+ * read is its packet, and so on. The match is exact when doorbells do
+ * not overlap, and by order otherwise. A doorbell closes once the ports
+ * have been idle for -Q cycles; its total runs to the last DMA write.
+ *
+ * usage: hgcosim [options]
+ *   -s name   shared memory name, default /hgcosim (or $HGCOSIM_SHM)
+ *   -p ps     clock period, default 4000 (250 MHz)
+ *   -L cycles host memory read latency, default 200
+ *   -R bytes  read completion boundary, default 256
+ *   -W cycles MAC loopback latency, default 20
+ *   -Q cycles idle cycles that close the open doorbells, default 2000
+ *   -t cycles stop after this many cycles, default 0 (run until the
+ *             host detaches)
+ *   -e file   write every port event to file
+ *   -v        print each event to stderr as well
+ *
+ * On exit it prints the stage latencies and event counts as JSON.
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "verilated.h"
+#include "VHanGuHTN_Top.h"
+
+#include "qs_models.h"
+#include "hgcosim_shm.h"
+
+using qs::wide_clear;
+using qs::wide_get;
+using qs::wide_set;
+
+namespace {
+
+enum {
+    PCIE_DW             = 8,                    /* DWs per 256-bit beat */
+    MAC_WORDS           = 16,                   /* 512-bit MAC beat */
+    RESET_CYCLES        = 64,
+    MAC_QUEUE           = 256,                  /* beats in flight on the wire */
+
+    /* Xilinx request types (cq_parser.v, req_converter.v) */
+    REQ_MEM_READ        = 0x0,
+    REQ_MEM_WRITE       = 0x1,
+
+    /* cfg_max_payload 256 B, cfg_max_read_req 512 B, bus 1 device 0 */
+    CFG_MAX_PAYLOAD     = 1,
+    CFG_MAX_READ_REQ    = 2,
+    CFG_BUSDEV          = 0x20,
+
+    HCR_STATUS_OFFSET   = 0x18,
+    HCR_GO_BIT          = 23,
+    UAR_SEND_DOORBELL   = 0x00
+};
+
+const char *const STAGE_NAME[HGC_STAGE_NUM] = {
+    "hcr", "db_fetch", "fetch_tx", "wire", "rx_write", "db_total"
+};
+
+struct Config {
+    std::string shm_name    = HGC_SHM_DEFAULT_NAME;
+    unsigned    clk_ps      = 4000;
+    unsigned    dma_lat     = 200;
+    unsigned    rcb         = 256;
+    unsigned    wire_lat    = 20;
+    unsigned    quiesce     = 2000;
+    uint64_t    max_cycles  = 0;
+    std::string event_file;
+    bool        verbose     = false;
+};
+
+/* One 256-bit AXI-Stream beat of the PCIe interface. */
+struct PcieBeat {
+    std::array<uint32_t, PCIE_DW> data;
+    uint8_t  keep;
+    bool     last;
+    uint64_t tuser;                             /* low 64 bits */
+};
+
+struct MacBeat {
+    std::array<uint32_t, MAC_WORDS> data;
+    uint64_t keep;
+    bool     start;
+    bool     last;
+    bool     user;
+};
+
+/* A CQ read waiting for its CC completion. */
+struct MmioRead {
+    bool     valid;
+    uint64_t seq;
+    uint8_t  bar;
+    uint64_t offset;
+};
+
+/* An RQ read waiting for the host memory latency. */
+struct DmaRead {
+    uint64_t due;
+    uint8_t  tag;
+    uint64_t addr;                              /* first byte */
+    uint32_t len;                               /* bytes */
+};
+
+/* Stage timestamps of one send doorbell. */
+struct Doorbell {
+    uint64_t db, rd, tx, rx, wr;
+};
+
+class Cosim {
+public:
+    Cosim(const Config &cfg, hgc_shm *shm);
+    ~Cosim();
+
+    void reset();
+    void tick();
+    bool stopped() const;
+    uint64_t now() const { return now_; }
+    void report();
+
+private:
+    void post_mmio();
+    void post_rc();
+    void drive();
+    void sample();
+
+    void cc_tlp(const std::vector<uint32_t> &dw);
+    void rq_tlp(const std::vector<uint32_t> &dw, uint64_t tuser);
+    void mac_tx(const MacBeat &b);
+    void mac_rx(const MacBeat &b);
+
+    bool dma_write(uint64_t addr, const uint8_t *buf, uint32_t len);
+    bool dma_read(uint64_t addr, uint8_t *buf, uint32_t len);
+
+    void stage(int s, uint64_t cycles);
+    void quiesce();
+    void event(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+    Config cfg_;
+    hgc_shm *shm_;
+    std::unique_ptr<VerilatedContext> ctx_;
+    std::unique_ptr<VHanGuHTN_Top>    top_;
+    FILE *log_ = nullptr;
+    uint64_t now_ = 0;
+
+    std::deque<PcieBeat> cq_;                   /* beats of queued CQ TLPs */
+    std::deque<PcieBeat> rc_;
+    std::vector<uint32_t> cc_dw_, rq_dw_;
+    uint64_t rq_tuser_ = 0;
+    bool rq_sop_ = true;
+    MmioRead reads_[256] = {};
+    uint8_t next_tag_ = 0;
+    std::deque<DmaRead> dma_reads_;
+    std::deque<std::pair<uint64_t, MacBeat>> wire_;
+    bool msix_pending_ = false;
+    bool msix_sent_ = false;
+
+    std::deque<Doorbell> dbs_;
+    uint64_t hcr_go_ = 0;                       /* cycle + 1 of the pending go write */
+    uint64_t last_active_ = 0;
+    uint64_t last_write_ = 0;
+    std::vector<uint32_t> lat_[HGC_STAGE_NUM];
+    bool detached_ = false;
+};
+
+Cosim::Cosim(const Config &cfg, hgc_shm *shm)
+    : cfg_(cfg), shm_(shm), ctx_(new VerilatedContext)
+{
+    top_.reset(new VHanGuHTN_Top(ctx_.get()));
+    if (!cfg_.event_file.empty()) {
+        log_ = fopen(cfg_.event_file.c_str(), "w");
+        if (!log_)
+            perror(cfg_.event_file.c_str());
+    }
+}
+
+Cosim::~Cosim()
+{
+    top_->final();
+    if (log_)
+        fclose(log_);
+}
+
+void Cosim::event(const char *fmt, ...)
+{
+    char buf[256];
+    va_list ap;
+
+    if (!log_ && !cfg_.verbose)
+        return;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (log_)
+        fprintf(log_, "%llu %s\n", (unsigned long long) now_, buf);
+    if (cfg_.verbose)
+        fprintf(stderr, "# %llu %s\n", (unsigned long long) now_, buf);
+}
+
+void Cosim::reset()
+{
+    top_->cfg_max_payload  = CFG_MAX_PAYLOAD;
+    top_->cfg_max_read_req = CFG_MAX_READ_REQ;
+    top_->tl_cfg_busdev    = CFG_BUSDEV;
+    top_->cfg_interrupt_msix_enable = 1;
+    top_->cfg_interrupt_msix_mask   = 0;
+    top_->s_axis_rq_tready = 0xf;
+    top_->s_axis_cc_tready = 0xf;
+
+    for (unsigned i = 0; i < RESET_CYCLES; ++i) {
+        top_->pcie_rst = top_->user_rst = 1;
+        top_->mac_tx_rst = top_->mac_rx_rst = 1;
+        tick();
+    }
+    top_->pcie_rst = top_->user_rst = 0;
+    top_->mac_tx_rst = top_->mac_rx_rst = 0;
+    for (unsigned i = 0; i < RESET_CYCLES; ++i)
+        tick();
+
+    now_ = 0;
+    __atomic_store_n(&shm_->sim_ready, 1, __ATOMIC_RELEASE);
+}
+
+bool Cosim::stopped() const
+{
+    return detached_ || __atomic_load_n(&shm_->stop, __ATOMIC_ACQUIRE) ||
+           (cfg_.max_cycles && now_ >= cfg_.max_cycles);
+}
+
+void Cosim::tick()
+{
+    post_mmio();
+    post_rc();
+    drive();
+    top_->pcie_clk = top_->user_clk = top_->mac_tx_clk = top_->mac_rx_clk = 0;
+    top_->eval();
+    sample();
+    top_->pcie_clk = top_->user_clk = top_->mac_tx_clk = top_->mac_rx_clk = 1;
+    top_->eval();
+    ++now_;
+    quiesce();
+    __atomic_store_n(&shm_->cycles, now_, __ATOMIC_RELAXED);
+}
+
+/*
+ * Turn the next host MMIO into a CQ TLP. The descriptor is the first
+ * four DWs of beat 0 and the data follows it (cq_parser.v). The driver
+ * only does 32-bit HCR accesses and 64-bit doorbells, so one beat is
+ * always enough.
+ */
+void Cosim::post_mmio()
+{
+    uint64_t tail = shm_->mmio_tail;
+    PcieBeat b = {};
+    uint32_t dws;
+
+    if (!cq_.empty() || tail == hgc_load(&shm_->mmio_head))
+        return;
+    if (reads_[next_tag_].valid)                /* 256 reads in flight */
+        return;
+
+    const hgc_mmio &m = shm_->mmio[tail % HGC_MMIO_SLOTS];
+
+    dws = m.len == 8 ? 2 : 1;
+    b.data[0] = (uint32_t) m.offset & ~3u;
+    b.data[1] = (uint32_t) (m.offset >> 32);
+    b.data[2] = dws | ((m.is_read ? REQ_MEM_READ : REQ_MEM_WRITE) << 11);
+    b.data[3] = (uint32_t) m.bar << 16;         /* [114:112] BAR id */
+    if (m.is_read) {
+        b.data[3] |= next_tag_;                 /* [103:96] tag */
+        reads_[next_tag_] = MmioRead{true, tail, m.bar, m.offset};
+        ++next_tag_;
+        b.keep = 0x0f;
+    } else {
+        b.data[4] = (uint32_t) m.data;
+        b.data[5] = (uint32_t) (m.data >> 32);
+        b.keep = dws == 2 ? 0x3f : 0x1f;
+    }
+    b.tuser = 0xf | (dws == 2 ? 0xf0 : 0) | (1ull << 40);   /* first_be, last_be, sop */
+    b.last = true;
+    cq_.push_back(b);
+
+    event("cq bar%u %s %#llx %#llx", m.bar, m.is_read ? "rd" : "wr",
+          (unsigned long long) m.offset, (unsigned long long) m.data);
+    if (!m.is_read && m.bar == HGC_BAR_HCR && m.offset == HCR_STATUS_OFFSET &&
+        (m.data >> HCR_GO_BIT & 1))
+        hcr_go_ = now_ + 1;
+    if (!m.is_read && m.bar == HGC_BAR_UAR && (m.offset & 0xfff) == UAR_SEND_DOORBELL)
+        dbs_.push_back(Doorbell{now_, 0, 0, 0, 0});
+
+    ++shm_->cq_tlps;
+    hgc_store(&shm_->mmio_tail, tail + 1);
+}
+
+/*
+ * Answer the oldest RQ read whose latency has passed: fetch the bytes
+ * from the host and queue RC completions. Each completion holds at
+ * most the bytes up to the next -R boundary; rsp_converter.v takes the
+ * lower address, byte count, request-completed bit, DW count and tag
+ * from the three descriptor DWs and the data starts at DW 3.
+ */
+void Cosim::post_rc()
+{
+    if (dma_reads_.empty() || dma_reads_.front().due > now_)
+        return;
+
+    DmaRead r = dma_reads_.front();
+    std::vector<uint8_t> buf(r.len);
+    uint64_t addr = r.addr;
+    uint32_t left = r.len;
+
+    dma_reads_.pop_front();
+    if (!dma_read(r.addr, buf.data(), r.len))
+        return;
+
+    while (left) {
+        uint64_t end = std::min<uint64_t>(addr + left, (addr / cfg_.rcb + 1) * cfg_.rcb);
+        uint32_t n = (uint32_t) (end - addr);
+        uint64_t dw_start = addr & ~3ull;
+        uint32_t ndw = (uint32_t) ((end + 3 - dw_start) / 4);
+        std::vector<uint32_t> dw(3 + ndw, 0);
+
+        dw[0] = ((uint32_t) addr & 0xfff) | ((left & 0x1fff) << 16) |
+                ((n == left ? 1u : 0u) << 30);
+        dw[1] = ndw & 0x7ff;
+        dw[2] = r.tag;
+        memcpy((uint8_t *) &dw[3] + (addr - dw_start),
+               buf.data() + (addr - r.addr), n);
+
+        for (size_t i = 0; i < dw.size(); i += PCIE_DW) {
+            PcieBeat b = {};
+            size_t k;
+
+            for (k = 0; k < PCIE_DW && i + k < dw.size(); ++k)
+                b.data[k] = dw[i + k];
+            b.keep = (uint8_t) ((1u << k) - 1);
+            b.last = i + PCIE_DW >= dw.size();
+            b.tuser = i == 0 ? 1ull << 32 : 0;  /* is_sof_0 */
+            rc_.push_back(b);
+        }
+        addr += n;
+        left -= n;
+    }
+}
+
+void Cosim::drive()
+{
+    /* CQ */
+    top_->m_axis_cq_tvalid = !cq_.empty();
+    if (!cq_.empty()) {
+        const PcieBeat &b = cq_.front();
+
+        for (unsigned i = 0; i < PCIE_DW; ++i)
+            top_->m_axis_cq_tdata[i] = b.data[i];
+        top_->m_axis_cq_tkeep = b.keep;
+        top_->m_axis_cq_tlast = b.last;
+        wide_clear(top_->m_axis_cq_tuser, 85);
+        wide_set(top_->m_axis_cq_tuser, 0, 64, b.tuser);
+    }
+
+    /* RC */
+    top_->m_axis_rc_tvalid = !rc_.empty();
+    if (!rc_.empty()) {
+        const PcieBeat &b = rc_.front();
+
+        for (unsigned i = 0; i < PCIE_DW; ++i)
+            top_->m_axis_rc_tdata[i] = b.data[i];
+        top_->m_axis_rc_tkeep = b.keep;
+        top_->m_axis_rc_tlast = b.last;
+        wide_clear(top_->m_axis_rc_tuser, 75);
+        wide_set(top_->m_axis_rc_tuser, 0, 64, b.tuser);
+    }
+
+    /* MAC RX */
+    bool rx = !wire_.empty() && wire_.front().first <= now_;
+
+    top_->mac_rx_valid = rx;
+    if (rx) {
+        const MacBeat &b = wire_.front().second;
+
+        for (unsigned i = 0; i < MAC_WORDS; ++i)
+            top_->mac_rx_data[i] = b.data[i];
+        top_->mac_rx_keep  = b.keep;
+        top_->mac_rx_start = b.start;
+        top_->mac_rx_last  = b.last;
+        top_->mac_rx_user  = b.user;
+    }
+    top_->mac_tx_ready = wire_.size() < MAC_QUEUE;
+
+    /* MSI-X: acknowledge the cycle after the request */
+    top_->cfg_interrupt_msix_sent = msix_pending_ && !msix_sent_;
+    top_->cfg_interrupt_msix_fail = 0;
+}
+
+void Cosim::sample()
+{
+    if (top_->m_axis_cq_tvalid && top_->m_axis_cq_tready) {
+        cq_.pop_front();
+        last_active_ = now_;
+    }
+
+    if (top_->m_axis_rc_tvalid && top_->m_axis_rc_tready)
+        rc_.pop_front();
+
+    if (top_->s_axis_cc_tvalid && (top_->s_axis_cc_tready & 1)) {
+        for (unsigned i = 0; i < PCIE_DW; ++i)
+            if (top_->s_axis_cc_tkeep >> i & 1)
+                cc_dw_.push_back(top_->s_axis_cc_tdata[i]);
+        if (top_->s_axis_cc_tlast) {
+            cc_tlp(cc_dw_);
+            cc_dw_.clear();
+        }
+    }
+
+    if (top_->s_axis_rq_tvalid && (top_->s_axis_rq_tready & 1)) {
+        if (rq_sop_)
+            rq_tuser_ = top_->s_axis_rq_tuser;
+        rq_sop_ = false;
+        for (unsigned i = 0; i < PCIE_DW; ++i)
+            if (top_->s_axis_rq_tkeep >> i & 1)
+                rq_dw_.push_back(top_->s_axis_rq_tdata[i]);
+        if (top_->s_axis_rq_tlast) {
+            rq_tlp(rq_dw_, rq_tuser_);
+            rq_dw_.clear();
+            rq_sop_ = true;
+        }
+    }
+
+    if (top_->mac_tx_valid && top_->mac_tx_ready) {
+        MacBeat b;
+
+        for (unsigned i = 0; i < MAC_WORDS; ++i)
+            b.data[i] = top_->mac_tx_data[i];
+        b.keep  = top_->mac_tx_keep;
+        b.start = top_->mac_tx_start;
+        b.last  = top_->mac_tx_last;
+        b.user  = top_->mac_tx_user;
+        mac_tx(b);
+    }
+
+    if (top_->mac_rx_valid && top_->mac_rx_ready) {
+        mac_rx(wire_.front().second);
+        wire_.pop_front();
+    }
+
+    if (msix_pending_ && msix_sent_) {
+        msix_pending_ = false;
+        msix_sent_ = false;
+    } else if (msix_pending_) {
+        msix_sent_ = true;
+    } else if (top_->cfg_interrupt_msix_int) {
+        msix_pending_ = true;
+        ++shm_->msix;
+        event("msix addr %#llx data %#x",
+              (unsigned long long) top_->cfg_interrupt_msix_address,
+              top_->cfg_interrupt_msix_data);
+    }
+}
+
+/* A CC TLP: a 3-DW descriptor, then the read data. */
+void Cosim::cc_tlp(const std::vector<uint32_t> &dw)
+{
+    uint8_t tag;
+
+    last_active_ = now_;
+    if (dw.size() < 4) {
+        event("cc short %zu", dw.size());
+        return;
+    }
+    tag = (uint8_t) dw[2];
+    MmioRead &r = reads_[tag];
+    if (!r.valid) {
+        event("cc spurious tag %u", tag);
+        return;
+    }
+
+    hgc_mmio &m = shm_->mmio[r.seq % HGC_MMIO_SLOTS];
+
+    m.data = dw[3] | (dw.size() > 4 && m.len == 8 ? (uint64_t) dw[4] << 32 : 0);
+    m.dma_seq = shm_->dma_head;
+    hgc_store(&m.done, r.seq + 1);
+    r.valid = false;
+    event("cc tag %u data %#llx", tag, (unsigned long long) m.data);
+
+    if (hcr_go_ && r.bar == HGC_BAR_HCR && r.offset == HCR_STATUS_OFFSET &&
+        !(m.data >> HCR_GO_BIT & 1)) {
+        stage(HGC_STAGE_HCR, now_ - (hcr_go_ - 1));
+        hcr_go_ = 0;
+    }
+}
+
+/*
+ * An RQ TLP (req_converter.v): the 4-DW descriptor, then the payload.
+ * tuser[3:0] is the first and tuser[7:4] the last byte enable.
+ */
+void Cosim::rq_tlp(const std::vector<uint32_t> &dw, uint64_t tuser)
+{
+    uint64_t addr;
+    uint32_t ndw, type, lead, trail, len;
+    uint8_t tag, first_be, last_be;
+
+    last_active_ = now_;
+    if (dw.size() < 4) {
+        event("rq short %zu", dw.size());
+        return;
+    }
+    addr     = ((uint64_t) dw[1] << 32 | dw[0]) & ~3ull;
+    ndw      = dw[2] & 0x7ff;
+    type     = dw[2] >> 11 & 0xf;
+    tag      = (uint8_t) dw[3];
+    first_be = tuser & 0xf;
+    last_be  = tuser >> 4 & 0xf;
+    if (ndw == 1)
+        last_be = first_be;
+    lead  = first_be ? __builtin_ctz(first_be) : 0;
+    trail = last_be ? 3 - (31 - __builtin_clz(last_be)) : 0;
+    len   = ndw * 4 - lead - trail;
+
+    if (type == REQ_MEM_WRITE) {
+        const uint8_t *p = (const uint8_t *) &dw[4];
+
+        if (dw.size() < 4 + ndw) {
+            event("rq write short %zu/%u", dw.size() - 4, ndw);
+            return;
+        }
+        event("rq wr %#llx %u", (unsigned long long) (addr + lead), len);
+        ++shm_->rq_writes;
+        dma_write(addr + lead, p + lead, len);
+
+        last_write_ = now_;
+        for (Doorbell &d : dbs_) {
+            if (d.rx && !d.wr) {
+                d.wr = now_;
+                stage(HGC_STAGE_RX_WRITE, d.wr - d.rx);
+                break;
+            }
+        }
+    } else if (type == REQ_MEM_READ) {
+        event("rq rd %#llx %u tag %u", (unsigned long long) (addr + lead), len, tag);
+        ++shm_->rq_reads;
+        dma_reads_.push_back(DmaRead{now_ + cfg_.dma_lat, tag, addr + lead, len});
+
+        for (Doorbell &d : dbs_) {
+            if (!d.rd) {
+                d.rd = now_;
+                stage(HGC_STAGE_DB_FETCH, d.rd - d.db);
+                break;
+            }
+        }
+    } else {
+        event("rq type %u ignored", type);
+    }
+}
+
+void Cosim::mac_tx(const MacBeat &b)
+{
+    last_active_ = now_;
+    wire_.push_back(std::make_pair(now_ + cfg_.wire_lat, b));
+    if (!b.start)
+        return;
+
+    event("mac tx");
+    ++shm_->mac_packets;
+    for (Doorbell &d : dbs_) {
+        if (d.rd && !d.tx) {
+            d.tx = now_;
+            stage(HGC_STAGE_FETCH_TX, d.tx - d.rd);
+            break;
+        }
+    }
+}
+
+void Cosim::mac_rx(const MacBeat &b)
+{
+    last_active_ = now_;
+    if (!b.start)
+        return;
+
+    event("mac rx");
+    for (Doorbell &d : dbs_) {
+        if (d.tx && !d.rx) {
+            d.rx = now_;
+            stage(HGC_STAGE_WIRE, d.rx - d.tx);
+            break;
+        }
+    }
+}
+
+void Cosim::stage(int s, uint64_t cycles)
+{
+    hgc_stage &st = shm_->stage[s];
+
+    st.count++;
+    st.cycles += cycles;
+    st.max = std::max(st.max, cycles);
+    lat_[s].push_back((uint32_t) std::min<uint64_t>(cycles, UINT32_MAX));
+}
+
+/* Close the open doorbells once the ports have gone quiet. */
+void Cosim::quiesce()
+{
+    if (dbs_.empty() || now_ - last_active_ < cfg_.quiesce ||
+        !dma_reads_.empty() || !rc_.empty() || !wire_.empty())
+        return;
+
+    for (const Doorbell &d : dbs_)
+        if (last_write_ > d.db)
+            stage(HGC_STAGE_DB_TOTAL, last_write_ - d.db);
+    dbs_.clear();
+}
+
+/* Post a write to the host. Waits while the ring is full. */
+bool Cosim::dma_write(uint64_t addr, const uint8_t *buf, uint32_t len)
+{
+    while (len) {
+        uint32_t n = std::min<uint32_t>(len, HGC_DMA_MAX);
+        uint64_t head = shm_->dma_head;
+
+        while (head - hgc_load(&shm_->dma_tail) >= HGC_DMA_SLOTS) {
+            if (__atomic_load_n(&shm_->stop, __ATOMIC_ACQUIRE)) {
+                detached_ = true;
+                return false;
+            }
+            sched_yield();
+        }
+
+        hgc_dma &d = shm_->dma[head % HGC_DMA_SLOTS];
+
+        d.is_write = 1;
+        d.addr = addr;
+        d.cycle = now_;
+        d.len = n;
+        memcpy(d.data, buf, n);
+        hgc_store(&shm_->dma_head, head + 1);
+        addr += n;
+        buf  += n;
+        len  -= n;
+    }
+    return true;
+}
+
+/*
+ * Read host memory. The host runs the ring in order, so the read sees
+ * every write posted before it. Simulated time stands still meanwhile.
+ */
+bool Cosim::dma_read(uint64_t addr, uint8_t *buf, uint32_t len)
+{
+    while (len) {
+        uint32_t n = std::min<uint32_t>(len, HGC_DMA_MAX);
+        uint64_t head = shm_->dma_head;
+
+        while (head - hgc_load(&shm_->dma_tail) >= HGC_DMA_SLOTS)
+            sched_yield();
+
+        hgc_dma &d = shm_->dma[head % HGC_DMA_SLOTS];
+
+        d.is_write = 0;
+        d.addr = addr;
+        d.len = n;
+        hgc_store(&shm_->dma_head, head + 1);
+
+        while (hgc_load(&shm_->dma_tail) <= head) {
+            if (__atomic_load_n(&shm_->stop, __ATOMIC_ACQUIRE)) {
+                detached_ = true;
+                return false;
+            }
+            sched_yield();
+        }
+        if (d.status)
+            event("dma rd %#llx %u failed %d", (unsigned long long) addr, n, d.status);
+        memcpy(buf, d.data, n);
+        addr += n;
+        buf  += n;
+        len  -= n;
+    }
+    return true;
+}
+
+double percentile(const std::vector<uint32_t> &v, double p)
+{
+    if (v.empty())
+        return 0;
+    return v[std::min(v.size() - 1, (size_t) (p * (v.size() - 1) + 0.5))];
+}
+
+void Cosim::report()
+{
+    printf("{ \"benchmark\": \"cosim\", \"cycles\": %llu, \"clk_ps\": %u, "
+           "\"dma_latency\": %u, \"wire_latency\": %u,\n"
+           "  \"cq_tlps\": %llu, \"rq_reads\": %llu, \"rq_writes\": %llu, "
+           "\"mac_packets\": %llu, \"msix\": %llu,\n  \"stages\": {",
+           (unsigned long long) now_, cfg_.clk_ps, cfg_.dma_lat, cfg_.wire_lat,
+           (unsigned long long) shm_->cq_tlps, (unsigned long long) shm_->rq_reads,
+           (unsigned long long) shm_->rq_writes,
+           (unsigned long long) shm_->mac_packets, (unsigned long long) shm_->msix);
+    for (int s = 0; s < HGC_STAGE_NUM; ++s) {
+        std::vector<uint32_t> &lat = lat_[s];
+        double sum = 0;
+
+        std::sort(lat.begin(), lat.end());
+        for (uint32_t l : lat)
+            sum += l;
+        printf("%s\n    \"%s\": { \"count\": %zu, \"mean\": %.1f, \"p50\": %.0f, "
+               "\"p99\": %.0f, \"max\": %.0f, \"mean_ns\": %.1f }",
+               s ? "," : "", STAGE_NAME[s], lat.size(),
+               lat.empty() ? 0.0 : sum / lat.size(), percentile(lat, 0.5),
+               percentile(lat, 0.99), percentile(lat, 1),
+               lat.empty() ? 0.0 : sum / lat.size() * cfg_.clk_ps / 1000);
+    }
+    printf("\n  }\n}\n");
+}
+
+hgc_shm *shm_create(const std::string &name, unsigned clk_ps)
+{
+    hgc_shm *shm;
+    int fd;
+
+    shm_unlink(name.c_str());
+    fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        perror(name.c_str());
+        return nullptr;
+    }
+    if (ftruncate(fd, sizeof(hgc_shm))) {
+        perror("ftruncate");
+        close(fd);
+        return nullptr;
+    }
+    shm = (hgc_shm *) mmap(NULL, sizeof(hgc_shm), PROT_READ | PROT_WRITE,
+                           MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) {
+        perror("mmap");
+        return nullptr;
+    }
+
+    memset(shm, 0, sizeof(*shm));
+    shm->version = HGC_SHM_VERSION;
+    shm->clk_ps = clk_ps;
+    __atomic_store_n(&shm->magic, HGC_SHM_MAGIC, __ATOMIC_RELEASE);
+    return shm;
+}
+
+void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-s shm] [-p clk_ps] [-L dma_lat] [-R rcb] "
+            "[-W wire_lat] [-Q quiesce] [-t cycles] [-e event_file] [-v]\n",
+            argv0);
+}
+
+} /* namespace */
+
+int main(int argc, char **argv)
+{
+    Config cfg;
+    hgc_shm *shm;
+    const char *env;
+    int op;
+
+    Verilated::commandArgs(argc, argv);
+
+    env = getenv("HGCOSIM_SHM");
+    if (env)
+        cfg.shm_name = env;
+
+    while ((op = getopt(argc, argv, "s:p:L:R:W:Q:t:e:v")) != -1) {
+        switch (op) {
+        case 's': cfg.shm_name   = optarg;                              break;
+        case 'p': cfg.clk_ps     = (unsigned) strtoul(optarg, NULL, 0); break;
+        case 'L': cfg.dma_lat    = (unsigned) strtoul(optarg, NULL, 0); break;
+        case 'R': cfg.rcb        = (unsigned) strtoul(optarg, NULL, 0); break;
+        case 'W': cfg.wire_lat   = (unsigned) strtoul(optarg, NULL, 0); break;
+        case 'Q': cfg.quiesce    = (unsigned) strtoul(optarg, NULL, 0); break;
+        case 't': cfg.max_cycles = strtoull(optarg, NULL, 0);           break;
+        case 'e': cfg.event_file = optarg;                              break;
+        case 'v': cfg.verbose    = true;                                break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    /* Completions split at a DW multiple that is a power of two. */
+    if (cfg.rcb < 64 || cfg.rcb > HGC_DMA_MAX || (cfg.rcb & (cfg.rcb - 1)) ||
+        !cfg.clk_ps) {
+        fprintf(stderr, "hgcosim: need a power-of-two -R in [64, %d] and -p > 0\n",
+                HGC_DMA_MAX);
+        return 2;
+    }
+
+    shm = shm_create(cfg.shm_name, cfg.clk_ps);
+    if (!shm)
+        return 1;
+
+    {
+        Cosim sim(cfg, shm);
+
+        sim.reset();
+        fprintf(stderr, "hgcosim: %s ready\n", cfg.shm_name.c_str());
+        while (!sim.stopped())
+            sim.tick();
+        sim.report();
+    }
+
+    munmap(shm, sizeof(*shm));
+    shm_unlink(cfg.shm_name.c_str());
+    return 0;
+}
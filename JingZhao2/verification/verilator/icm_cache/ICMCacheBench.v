@@ -0,0 +1,182 @@
+/*------------------------------------------- Module Description : Begin ----------------------------------------------
+Name:       ICMCacheBench
+Function:   Verilator top for the ICMCache bench. Instantiates one ICMCache of type ICM_CACHE_TYPE with
+            CACHE_SET_NUM sets, exposes the get and DMA read interfaces to icm_bench.cpp,
+            ties off the set/del/mapping ports, and brings out the ICMBuffer lookup result. Port widths do not
+            depend on the cache type so one C++ driver serves every configuration; it reads the cfg_* outputs.
+            ICM_ENTRY_NUM may be raised above the type's ICM size to model more QPs than the RTL ships with.
+            CACHE_WAY_NUM and CACHE_REPLACE_POLICY only apply with ICM_BUFFER_ASSOC; without it the cache
+            is the 2-way LRU ICMBuffer, reported as policy 2.
+--------------------------------------------- Module Decription : End -----------------------------------------------*/
+
+/*------------------------------------------- Timescale Definition : Begin ------------------------------------------*/
+`timescale 1ns / 1ps
+/*------------------------------------------- Timescale Definition : End --------------------------------------------*/
+
+/*------------------------------------------- Included Files : Begin ------------------------------------------------*/
+`include "protocol_engine_def.vh"
+/*------------------------------------------- Included Files : End --------------------------------------------------*/
+
+/*------------------------------------------- Input/Output Definition : Begin ---------------------------------------*/
+module ICMCacheBench
+#(
+    parameter               ICM_CACHE_TYPE          =       `CACHE_TYPE_QPC,
+    parameter               CACHE_SET_NUM           =       256,                //Normal Mode value, not the shipped 2
+    parameter               CACHE_WAY_NUM           =       `CACHE_WAY_NUM,
+    parameter               CACHE_REPLACE_POLICY    =       `CACHE_REPLACE_POLICY,
+
+    parameter               CACHE_ENTRY_WIDTH       =       (ICM_CACHE_TYPE == `CACHE_TYPE_QPC) ? `CACHE_ENTRY_WIDTH_QPC :
+                                                            (ICM_CACHE_TYPE == `CACHE_TYPE_CQC) ? `CACHE_ENTRY_WIDTH_CQC :
+                                                            (ICM_CACHE_TYPE == `CACHE_TYPE_EQC) ? `CACHE_ENTRY_WIDTH_EQC :
+                                                            (ICM_CACHE_TYPE == `CACHE_TYPE_MPT) ? `CACHE_ENTRY_WIDTH_MPT : `CACHE_ENTRY_WIDTH_MTT,
+    parameter               ICM_SLOT_SIZE           =       (ICM_CACHE_TYPE == `CACHE_TYPE_QPC) ? `ICM_SLOT_SIZE_QPC :
+                                                            (ICM_CACHE_TYPE == `CACHE_TYPE_CQC) ? `ICM_SLOT_SIZE_CQC :
+                                                            (ICM_CACHE_TYPE == `CACHE_TYPE_EQC) ? `ICM_SLOT_SIZE_EQC :
+                                                            (ICM_CACHE_TYPE == `CACHE_TYPE_MPT) ? `ICM_SLOT_SIZE_MPT : `ICM_SLOT_SIZE_MTT,
+    parameter               ICM_ENTRY_NUM           =       (ICM_CACHE_TYPE == `CACHE_TYPE_QPC) ? `ICM_ENTRY_NUM_QPC :
+                                                            (ICM_CACHE_TYPE == `CACHE_TYPE_CQC) ? `ICM_ENTRY_NUM_CQC :
+                                                            (ICM_CACHE_TYPE == `CACHE_TYPE_EQC) ? `ICM_ENTRY_NUM_EQC :
+                                                            (ICM_CACHE_TYPE == `CACHE_TYPE_MPT) ? `ICM_ENTRY_NUM_MPT : `ICM_ENTRY_NUM_MTT,
+    parameter               ICM_PAGE_NUM            =       ICM_SLOT_SIZE * ICM_ENTRY_NUM / `PAGE_SIZE
+)
+(
+    input   wire                                                            clk,
+    input   wire                                                            rst,
+
+//Requester (OoOStation side of CxtMgt/MRMgt)
+    input   wire                                                            icm_get_req_valid,
+    input   wire            [139:0]                                         icm_get_req_head,   //{count_max, count_index, req_tag, phy_addr, icm_addr}
+    output  wire                                                            icm_get_req_ready,
+
+    output  wire                                                            icm_get_rsp_valid,
+    output  wire            [139:0]                                         icm_get_rsp_head,
+    output  wire            [511:0]                                         icm_get_rsp_data,   //Entry in the low CACHE_ENTRY_WIDTH bits
+    input   wire                                                            icm_get_rsp_ready,
+
+//DMA Read Channel
+    output  wire                                                            dma_rd_req_valid,
+    output  wire    [`DMA_HEAD_WIDTH - 1 : 0]                               dma_rd_req_head,
+    input   wire                                                            dma_rd_req_ready,
+
+    input   wire                                                            dma_rd_rsp_valid,
+    input   wire    [`DMA_HEAD_WIDTH - 1 : 0]                               dma_rd_rsp_head,
+    input   wire    [`DMA_DATA_WIDTH - 1 : 0]                               dma_rd_rsp_data,
+    input   wire                                                            dma_rd_rsp_last,
+    output  wire                                                            dma_rd_rsp_ready,
+
+//Configuration
+    output  wire            [7:0]                                           cfg_cache_type,
+    output  wire            [31:0]                                          cfg_set_num,
+    output  wire            [7:0]                                           cfg_way_num,
+    output  wire            [7:0]                                           cfg_replace_policy,
+    output  wire            [15:0]                                          cfg_entry_width,
+    output  wire            [15:0]                                          cfg_slot_size,
+    output  wire            [31:0]                                          cfg_entry_num,
+
+//Probes
+    output  wire                                                            lookup_valid,
+    output  wire                                                            lookup_hit,
+    output  wire            [7:0]                                           lookup_tag
+);
+/*------------------------------------------- Input/Output Definition : End -----------------------------------------*/
+
+/*------------------------------------------- Local Variables Definition : Begin ------------------------------------*/
+wire    [CACHE_ENTRY_WIDTH - 1 : 0]                             icm_get_rsp_entry;
+/*------------------------------------------- Local Variables Definition : End --------------------------------------*/
+
+/*------------------------------------------- Submodules Instatiation : Begin ---------------------------------------*/
+ICMCache #(
+   .ICM_CACHE_TYPE                  (     ICM_CACHE_TYPE            ),
+   .ICM_PAGE_NUM                    (     ICM_PAGE_NUM              ),
+
+   .ICM_ENTRY_NUM                   (     ICM_ENTRY_NUM             ),
+
+   .ICM_SLOT_SIZE                   (     ICM_SLOT_SIZE             ),
+   .ICM_ADDR_WIDTH                  (     `ICM_SPACE_ADDR_WIDTH     ),
+
+   .CACHE_ENTRY_WIDTH               (     CACHE_ENTRY_WIDTH         ),
+   .CACHE_SET_NUM                   (     CACHE_SET_NUM             ),
+   .CACHE_WAY_NUM                   (     CACHE_WAY_NUM             ),
+   .CACHE_REPLACE_POLICY            (     CACHE_REPLACE_POLICY      )
+)
+ICMCache_Inst
+(
+    .clk                            (           clk                         ),
+    .rst                            (           rst                         ),
+
+    .icm_get_req_valid              (           icm_get_req_valid           ),
+    .icm_get_req_head               (           icm_get_req_head            ),
+    .icm_get_req_ready              (           icm_get_req_ready           ),
+
+    .icm_get_rsp_valid              (           icm_get_rsp_valid           ),
+    .icm_get_rsp_head               (           icm_get_rsp_head            ),
+    .icm_get_rsp_data               (           icm_get_rsp_entry           ),
+    .icm_get_rsp_ready              (           icm_get_rsp_ready           ),
+
+    .icm_set_req_valid              (           'd0                         ),
+    .icm_set_req_head               (           'd0                         ),
+    .icm_set_req_data               (           'd0                         ),
+    .icm_set_req_ready              (                                       ),
+
+    .icm_del_req_valid              (           'd0                         ),
+    .icm_del_req_head               (           'd0                         ),
+    .icm_del_req_ready              (                                       ),
+
+    .dma_rd_req_valid               (           dma_rd_req_valid            ),
+    .dma_rd_req_head                (           dma_rd_req_head             ),
+    .dma_rd_req_data                (                                       ),
+    .dma_rd_req_last                (                                       ),
+    .dma_rd_req_ready               (           dma_rd_req_ready            ),
+
+    .dma_rd_rsp_valid               (           dma_rd_rsp_valid            ),
+    .dma_rd_rsp_head                (           dma_rd_rsp_head             ),
+    .dma_rd_rsp_data                (           dma_rd_rsp_data             ),
+    .dma_rd_rsp_last                (           dma_rd_rsp_last             ),
+    .dma_rd_rsp_ready               (           dma_rd_rsp_ready            ),
+
+    .dma_wr_req_valid               (                                       ),
+    .dma_wr_req_head                (                                       ),
+    .dma_wr_req_data                (                                       ),
+    .dma_wr_req_last                (                                       ),
+    .dma_wr_req_ready               (           'd1                         ),
+
+    .icm_mapping_set_valid          (           'd0                         ),
+    .icm_mapping_set_head           (           'd0                         ),
+    .icm_mapping_set_data           (           'd0                         ),
+
+    .icm_mapping_lookup_valid       (           'd0                         ),
+    .icm_mapping_lookup_head        (           'd0                         ),
+
+    .icm_mapping_rsp_valid          (                                       ),
+    .icm_mapping_rsp_icm_addr       (                                       ),
+    .icm_mapping_rsp_phy_addr       (                                       ),
+
+    .icm_base                       (           'd0                         )
+);
+/*------------------------------------------- Submodules Instatiation : End -----------------------------------------*/
+
+/*------------------------------------------- Variables Decode : Begin ----------------------------------------------*/
+assign icm_get_rsp_data = {{(512 - CACHE_ENTRY_WIDTH){1'b0}}, icm_get_rsp_entry};
+
+assign cfg_cache_type = ICM_CACHE_TYPE;
+assign cfg_set_num = CACHE_SET_NUM;
+`ifdef ICM_BUFFER_ASSOC
+assign cfg_way_num = CACHE_WAY_NUM;
+assign cfg_replace_policy = CACHE_REPLACE_POLICY;
+`else
+assign cfg_way_num = 'd2;
+assign cfg_replace_policy = 'd2;
+`endif
+assign cfg_entry_width = CACHE_ENTRY_WIDTH;
+assign cfg_slot_size = ICM_SLOT_SIZE;
+assign cfg_entry_num = ICM_ENTRY_NUM;
+
+//-- lookup_valid -- ICMBuffer answers one get per request; ICMGetProc Thread_3 takes it in IDLE_s
+//-- lookup_hit -- ICMBuffer prepends the hit flag: cache_get_rsp_head = {hit, get_req_head}
+//-- lookup_tag --
+assign lookup_valid = ICMCache_Inst.cache_get_rsp_valid && ICMCache_Inst.cache_get_rsp_ready;
+assign lookup_hit = lookup_valid && ICMCache_Inst.cache_get_rsp_head[140];
+assign lookup_tag = ICMCache_Inst.cache_get_rsp_head[135:128];
+/*------------------------------------------- Variables Decode : End ------------------------------------------------*/
+
+endmodule
@@ -0,0 +1,650 @@
+/*
+ * Trace-driven bench for ICMCache under Verilator.
+ *
+ * The bench stands in for the OoOStation and the CxtMgt/MRMgt request
+ * FSM in front of one ICMCache: it owns a pool of request tags, issues
+ * at most one get per -i cycles while a tag is free, and retires the
+ * responses by tag. Host memory holds the ICM image, so every response
+ * is checked against the entry it names. Entry indices come from a
+ * uniform or Zipf distribution over a working set, or from a recorded
+ * trace, or taken round robin like the QPCs of connections served in
+ * turn. Per working set it reports the hit rate, the latency of hits
+ * and misses, and how full the tag pool was.
+ *
+ * usage: icm_bench [options]
+ *   -W list   working-set sizes in entries, default 16,64,256,1024,4096,16384
+ *             (capped at ICM_ENTRY_NUM)
+ *   -d uniform|zipf|rr  index distribution, default zipf; rr cycles
+ *             through the working set in index order
+ *   -z alpha  Zipf exponent, default 0.99
+ *   -t file   replay a trace of "<type> <index>" lines (hgm_icm_trace_file);
+ *             records of other cache types are skipped, -W/-d/-z ignored
+ *   -n num    requests per run after warm-up, default 20000; 0 replays
+ *             the whole trace
+ *   -w num    warm-up requests, default 2000
+ *   -o num    request tags, default 32 (OoOStation TAG_NUM)
+ *   -i cycles cycles between requests, default 4 (HWAccCMCtl issues a get
+ *             every four cycles: IDLE, ADDR_REQ, ADDR_RSP, *_GET)
+ *   -L cycles DMA read latency, default 100
+ *   -D num    outstanding DMA reads the host accepts, default 16
+ *   -s seed   random seed, default 1
+ *   -v        print a line per request and per response
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "verilated.h"
+#include "VICMCacheBench.h"
+
+#include "qs_models.h"
+
+using namespace qs;
+
+namespace {
+
+/* protocol_engine_def.vh */
+enum {
+    CACHE_TYPE_QPC      = 1,
+    CACHE_TYPE_CQC      = 2,
+    CACHE_TYPE_EQC      = 3,
+    CACHE_TYPE_MPT      = 4,
+    CACHE_TYPE_MTT      = 5,
+    CACHE_REPLACE_PLRU  = 0,
+    CACHE_REPLACE_RRIP  = 1,
+    CACHE_REPLACE_LRU   = 2,        /* ICMBuffer, no ICM_BUFFER_ASSOC */
+
+    DIST_UNIFORM        = 0,
+    DIST_ZIPF,
+    DIST_RR,
+    MAX_TAGS            = 256,      /* MAX_REQ_TAG_NUM */
+
+    /* icm_get_req_head: {count_max, count_index, req_tag, phy_addr, icm_addr} */
+    HEAD_ICM_ADDR_LSB   = 0,
+    HEAD_PHY_ADDR_LSB   = 64,
+    HEAD_TAG_LSB        = 128,
+    HEAD_COUNT_IDX_LSB  = 136,
+    HEAD_COUNT_MAX_LSB  = 138,
+    HEAD_WIDTH          = 140,
+
+    RESET_CYCLES        = 16
+};
+
+const uint64_t HOST_BASE = 0x100000000ull;
+
+const char *const type_name[] = { "", "qpc", "cqc", "eqc", "mpt", "mtt" };
+const char *const policy_name[] = { "plru", "rrip", "lru" };
+
+struct Config {
+    std::vector<unsigned> working_sets = {16, 64, 256, 1024, 4096, 16384};
+    int         dist        = DIST_ZIPF;
+    double      alpha       = 0.99;
+    std::string trace;
+    uint64_t    reqs        = 20000;
+    uint64_t    warmup      = 2000;
+    unsigned    tags        = 32;
+    unsigned    gap         = 4;
+    unsigned    dma_lat     = 100;
+    unsigned    dma_depth   = 16;
+    unsigned    seed        = 1;
+    bool        verbose     = false;
+    uint64_t    stall       = 100000;
+};
+
+/* A request holding one of the OoOStation tags. */
+struct Tag {
+    bool     busy = false;
+    bool     measured = false;
+    int      hit = -1;          /* set by the ICMBuffer lookup probe */
+    uint32_t index = 0;
+    uint64_t issue = 0;
+};
+
+struct Result {
+    uint64_t              working_set = 0;
+    uint64_t              reqs = 0;
+    uint64_t              cycles = 0;
+    uint64_t              lookups = 0;
+    uint64_t              hits = 0;
+    uint64_t              dma_reqs = 0;
+    uint64_t              occ_sum = 0;
+    uint64_t              occ_full = 0;
+    unsigned              occ_max = 0;
+    uint64_t              mismatches = 0;
+    uint64_t              spurious = 0;
+    bool                  stalled = false;
+    std::vector<uint32_t> hit_lat;
+    std::vector<uint32_t> miss_lat;
+};
+
+class Bench {
+public:
+    explicit Bench(const Config &cfg) : cfg_(cfg)
+    {
+        ctx_.reset(new VerilatedContext);
+        top_.reset(new VICMCacheBench(ctx_.get()));
+        top_->eval();
+
+        type_ = top_->cfg_cache_type;
+        set_num_ = top_->cfg_set_num;
+        way_num_ = top_->cfg_way_num;
+        policy_ = top_->cfg_replace_policy;
+        entry_bytes_ = top_->cfg_entry_width / 8;
+        slot_ = top_->cfg_slot_size;
+        entry_num_ = top_->cfg_entry_num;
+
+        mem_.reset(new HostMem(HOST_BASE, (size_t) entry_num_ * slot_));
+        for (uint32_t i = 0; i < entry_num_; ++i)
+            for (unsigned b = 0; b < slot_; ++b)
+                *mem_->at(address(i) + b) = pattern(i, b);
+        dma_.reset(new DmaModel(*mem_));
+        dma_->configure(cfg.dma_lat, cfg.dma_depth);
+    }
+
+    ~Bench() { top_->final(); }
+
+    int type() const { return type_; }
+    uint32_t set_num() const { return set_num_; }
+    unsigned way_num() const { return way_num_; }
+    int policy() const { return policy_; }
+    uint32_t entry_num() const { return entry_num_; }
+
+    Result run(const std::vector<uint32_t> &trace, uint64_t working_set);
+
+private:
+    uint64_t address(uint32_t index) const
+    {
+        return HOST_BASE + (uint64_t) index * slot_;
+    }
+
+    static uint8_t pattern(uint32_t index, unsigned byte)
+    {
+        return (uint8_t) (index * 0x9e3779b1u >> 24) ^ (uint8_t) index ^
+               (uint8_t) (byte * 37);
+    }
+
+    void reset();
+    void issue();
+    void drive();
+    void sample();
+    void retire();
+    void tick();
+
+    const Config                     &cfg_;
+    std::unique_ptr<VerilatedContext> ctx_;
+    std::unique_ptr<VICMCacheBench>   top_;
+    std::unique_ptr<HostMem>          mem_;
+    std::unique_ptr<DmaModel>         dma_;
+
+    int                               type_ = 0;
+    uint32_t                          set_num_ = 0;
+    unsigned                          way_num_ = 0;
+    int                               policy_ = CACHE_REPLACE_PLRU;
+    unsigned                          entry_bytes_ = 0;
+    unsigned                          slot_ = 0;
+    uint32_t                          entry_num_ = 0;
+
+    const std::vector<uint32_t>      *trace_ = nullptr;
+    std::vector<Tag>                  tags_;
+    std::deque<unsigned>              free_tags_;
+    unsigned                          busy_ = 0;
+    int                               offer_ = -1;    /* tag on icm_get_req */
+    uint64_t                          next_ = 0;      /* next trace record */
+    uint64_t                          now_ = 0;
+    uint64_t                          last_issue_ = 0;
+    uint64_t                          last_progress_ = 0;
+    uint64_t                          start_ = 0;
+    bool                              measuring_ = false;
+    uint64_t                          done_ = 0;      /* measured responses */
+    Result                            res_;
+};
+
+void Bench::reset()
+{
+    now_ = 0;
+    next_ = 0;
+    last_issue_ = 0;
+    last_progress_ = 0;
+    start_ = 0;
+    measuring_ = false;
+    done_ = 0;
+    busy_ = 0;
+    offer_ = -1;
+    dma_->clear();
+
+    tags_.assign(cfg_.tags, Tag());
+    free_tags_.clear();
+    for (unsigned t = 0; t < cfg_.tags; ++t)
+        free_tags_.push_back(t);
+
+    /* Cache ways and the replacement table are SRAMs that survive rst. */
+    top_->final();
+    top_.reset();
+    top_.reset(new VICMCacheBench(ctx_.get()));
+    top_->rst = 1;
+    top_->icm_get_req_valid = 0;
+    top_->icm_get_rsp_ready = 0;
+    top_->dma_rd_rsp_valid = 0;
+    for (unsigned i = 0; i < RESET_CYCLES; ++i) {
+        top_->clk = 0;
+        top_->eval();
+        top_->clk = 1;
+        top_->eval();
+    }
+    top_->rst = 0;
+}
+
+/* Take a free tag for the next record, as the OoOStation does per request. */
+void Bench::issue()
+{
+    if (offer_ >= 0 || next_ >= trace_->size() || free_tags_.empty())
+        return;
+    if (next_ && now_ - last_issue_ < cfg_.gap)
+        return;
+
+    offer_ = (int) free_tags_.front();
+    free_tags_.pop_front();
+
+    Tag &t = tags_[offer_];
+    t.busy = true;
+    t.measured = next_ >= cfg_.warmup;
+    t.hit = -1;
+    t.index = (*trace_)[next_++];
+    ++busy_;
+    if (t.measured && !measuring_) {
+        measuring_ = true;
+        start_ = now_;
+    }
+}
+
+void Bench::drive()
+{
+    top_->icm_get_req_valid = offer_ >= 0;
+    wide_clear(top_->icm_get_req_head, HEAD_WIDTH);
+    if (offer_ >= 0) {
+        const Tag &t = tags_[offer_];
+
+        wide_set(top_->icm_get_req_head, HEAD_COUNT_MAX_LSB, 2, 1);
+        wide_set(top_->icm_get_req_head, HEAD_COUNT_IDX_LSB, 2, 0);
+        wide_set(top_->icm_get_req_head, HEAD_TAG_LSB, 8, (uint64_t) offer_);
+        wide_set(top_->icm_get_req_head, HEAD_PHY_ADDR_LSB, 64, address(t.index));
+        wide_set(top_->icm_get_req_head, HEAD_ICM_ADDR_LSB, 64,
+                 (uint64_t) t.index * slot_);
+    }
+    top_->icm_get_rsp_ready = 1;
+
+    top_->dma_rd_req_ready = dma_->req_ready();
+    top_->dma_rd_rsp_valid = dma_->rsp_valid(now_);
+    top_->dma_rd_rsp_last = top_->dma_rd_rsp_valid &&
+        dma_->rsp_beat(top_->dma_rd_rsp_head, top_->dma_rd_rsp_data);
+}
+
+/* Check one response against host memory and free its tag. */
+void Bench::retire()
+{
+    const auto &head = top_->icm_get_rsp_head;
+    const auto &data = top_->icm_get_rsp_data;
+    unsigned tag = (unsigned) wide_get(head, HEAD_TAG_LSB, 8);
+    uint64_t icm_addr = wide_get(head, HEAD_ICM_ADDR_LSB, 64);
+
+    if (tag >= tags_.size() || !tags_[tag].busy) {
+        ++res_.spurious;
+        return;
+    }
+
+    Tag &t = tags_[tag];
+    uint32_t lat = (uint32_t) (now_ - t.issue);
+
+    if (cfg_.verbose)
+        printf("# %llu rsp tag %u index %u %s %u\n", (unsigned long long) now_,
+               tag, t.index, t.hit > 0 ? "hit" : "miss", lat);
+
+    bool bad = icm_addr != (uint64_t) t.index * slot_;
+    for (unsigned b = 0; b < entry_bytes_ && !bad; ++b)
+        bad = (uint8_t) (data[b / 4] >> (8 * (b % 4))) != pattern(t.index, b);
+    if (bad)
+        ++res_.mismatches;
+
+    if (t.measured) {
+        (t.hit > 0 ? res_.hit_lat : res_.miss_lat).push_back(lat);
+        ++done_;
+    }
+    t.busy = false;
+    free_tags_.push_back(tag);
+    --busy_;
+    last_progress_ = now_;
+}
+
+/* Handshakes are sampled after the inputs settle, before the edge. */
+void Bench::sample()
+{
+    if (top_->icm_get_req_valid && top_->icm_get_req_ready) {
+        Tag &t = tags_[offer_];
+
+        t.issue = now_;
+        last_issue_ = now_;
+        if (cfg_.verbose)
+            printf("# %llu req tag %d index %u\n", (unsigned long long) now_,
+                   offer_, t.index);
+        offer_ = -1;
+    }
+
+    if (top_->lookup_valid) {
+        unsigned tag = top_->lookup_tag;
+
+        if (tag < tags_.size() && tags_[tag].busy) {
+            tags_[tag].hit = top_->lookup_hit;
+            if (tags_[tag].measured) {
+                ++res_.lookups;
+                res_.hits += top_->lookup_hit;
+            }
+        } else {
+            ++res_.spurious;
+        }
+    }
+
+    if (top_->dma_rd_req_valid && top_->dma_rd_req_ready) {
+        dma_->accept(now_, top_->dma_rd_req_head);
+        res_.dma_reqs += measuring_;
+    }
+    if (top_->dma_rd_rsp_valid && top_->dma_rd_rsp_ready)
+        dma_->rsp_fire();
+
+    if (top_->icm_get_rsp_valid && top_->icm_get_rsp_ready)
+        retire();
+
+    if (measuring_) {
+        res_.occ_sum += busy_;
+        res_.occ_max = std::max(res_.occ_max, busy_);
+        res_.occ_full += busy_ == cfg_.tags;
+    }
+}
+
+void Bench::tick()
+{
+    issue();
+    drive();
+    top_->clk = 0;
+    top_->eval();
+    sample();
+    top_->clk = 1;
+    top_->eval();
+    ++now_;
+}
+
+Result Bench::run(const std::vector<uint32_t> &trace, uint64_t working_set)
+{
+    uint64_t measured = trace.size() - std::min<uint64_t>(trace.size(), cfg_.warmup);
+
+    res_ = Result();
+    res_.working_set = working_set;
+    trace_ = &trace;
+    reset();
+
+    while (done_ < measured) {
+        if (now_ - last_progress_ > cfg_.stall) {
+            res_.stalled = true;
+            break;
+        }
+        tick();
+    }
+
+    res_.reqs = done_;
+    res_.cycles = measuring_ ? now_ - start_ : 0;
+    return res_;
+}
+
+/* Indices 0..ws-1 with popularity ranks shuffled across them, or in
+ * order for rr. */
+std::vector<uint32_t> synthesize(const Config &cfg, uint32_t ws,
+                                 std::mt19937_64 &rng)
+{
+    std::vector<uint32_t> perm(ws), trace;
+    std::vector<double> cdf;
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    uint64_t n = cfg.warmup + cfg.reqs;
+
+    for (uint32_t i = 0; i < ws; ++i)
+        perm[i] = i;
+    std::shuffle(perm.begin(), perm.end(), rng);
+
+    if (cfg.dist == DIST_ZIPF) {
+        double sum = 0;
+
+        cdf.resize(ws);
+        for (uint32_t r = 0; r < ws; ++r)
+            cdf[r] = sum += 1.0 / std::pow((double) r + 1, cfg.alpha);
+        for (double &c : cdf)
+            c /= sum;
+    }
+
+    trace.reserve(n);
+    for (uint64_t k = 0; k < n; ++k) {
+        uint32_t r;
+
+        if (cfg.dist == DIST_RR) {
+            trace.push_back((uint32_t) (k % ws));
+            continue;
+        }
+        if (cfg.dist == DIST_ZIPF)
+            r = (uint32_t) (std::lower_bound(cdf.begin(), cdf.end(), u(rng)) -
+                            cdf.begin());
+        else
+            r = (uint32_t) (rng() % ws);
+        trace.push_back(perm[std::min(r, ws - 1)]);
+    }
+    return trace;
+}
+
+/* Records of the built cache type; '#' starts a comment. */
+bool load_trace(const Config &cfg, int type, uint32_t entry_num,
+                std::vector<uint32_t> &trace)
+{
+    FILE *f = fopen(cfg.trace.c_str(), "r");
+    char line[256], name[16];
+    unsigned long index;
+
+    if (!f) {
+        perror(cfg.trace.c_str());
+        return false;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || sscanf(line, "%15s %lu", name, &index) != 2)
+            continue;
+        if (strcmp(name, type_name[type]))
+            continue;
+        trace.push_back((uint32_t) (index % entry_num));
+        if (cfg.reqs && trace.size() >= cfg.warmup + cfg.reqs)
+            break;
+    }
+    fclose(f);
+    return true;
+}
+
+double percentile(const std::vector<uint32_t> &v, double p)
+{
+    if (v.empty())
+        return 0;
+    return v[std::min(v.size() - 1, (size_t) (p * (v.size() - 1) + 0.5))];
+}
+
+void print_latency(const char *name, std::vector<uint32_t> &lat)
+{
+    double sum = 0;
+
+    std::sort(lat.begin(), lat.end());
+    for (uint32_t l : lat)
+        sum += l;
+    printf("\"%s\": { \"count\": %zu, \"min\": %.0f, \"mean\": %.1f, "
+           "\"p50\": %.0f, \"p90\": %.0f, \"p99\": %.0f, \"max\": %.0f }",
+           name, lat.size(), percentile(lat, 0),
+           lat.empty() ? 0.0 : sum / lat.size(), percentile(lat, 0.5),
+           percentile(lat, 0.9), percentile(lat, 0.99), percentile(lat, 1));
+}
+
+void report(Result &r, bool first)
+{
+    std::vector<uint32_t> all(r.hit_lat);
+
+    all.insert(all.end(), r.miss_lat.begin(), r.miss_lat.end());
+    printf("%s\n    { \"working_set\": %llu, \"requests\": %llu, "
+           "\"cycles\": %llu, \"req_per_cycle\": %.4f,\n"
+           "      \"lookups\": %llu, \"hits\": %llu, \"hit_rate\": %.4f, "
+           "\"dma_rd_reqs\": %llu,\n      ",
+           first ? "" : ",", (unsigned long long) r.working_set,
+           (unsigned long long) r.reqs, (unsigned long long) r.cycles,
+           r.cycles ? (double) r.reqs / r.cycles : 0.0,
+           (unsigned long long) r.lookups, (unsigned long long) r.hits,
+           r.lookups ? (double) r.hits / r.lookups : 0.0,
+           (unsigned long long) r.dma_reqs);
+    print_latency("latency", all);
+    printf(",\n      ");
+    print_latency("hit_latency", r.hit_lat);
+    printf(",\n      ");
+    print_latency("miss_latency", r.miss_lat);
+    printf(",\n      \"ooo_tags\": { \"mean\": %.2f, \"max\": %u, "
+           "\"full_frac\": %.4f },\n"
+           "      \"mismatches\": %llu, \"spurious\": %llu, \"stalled\": %s }",
+           r.cycles ? (double) r.occ_sum / r.cycles : 0.0, r.occ_max,
+           r.cycles ? (double) r.occ_full / r.cycles : 0.0,
+           (unsigned long long) r.mismatches, (unsigned long long) r.spurious,
+           r.stalled ? "true" : "false");
+}
+
+std::vector<unsigned> parse_list(const char *s)
+{
+    std::vector<unsigned> v;
+    std::string str(s);
+    size_t pos = 0;
+
+    while (pos < str.size()) {
+        size_t end = str.find(',', pos);
+
+        if (end == std::string::npos)
+            end = str.size();
+        v.push_back((unsigned) strtoul(str.substr(pos, end - pos).c_str(), NULL, 0));
+        pos = end + 1;
+    }
+    return v;
+}
+
+void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-W sizes,...] [-d uniform|zipf|rr] [-z alpha] "
+            "[-t trace] [-n reqs] [-w warmup] [-o tags] [-i gap] "
+            "[-L dma_lat] [-D dma_depth] [-s seed] [-v]\n", argv0);
+}
+
+} /* namespace */
+
+int main(int argc, char **argv)
+{
+    Config cfg;
+    int op, bad = 0;
+
+    Verilated::commandArgs(argc, argv);
+
+    while ((op = getopt(argc, argv, "W:d:z:t:n:w:o:i:L:D:s:v")) != -1) {
+        switch (op) {
+        case 'W': cfg.working_sets = parse_list(optarg);                break;
+        case 'd':
+            if (!strcmp(optarg, "uniform"))
+                cfg.dist = DIST_UNIFORM;
+            else if (!strcmp(optarg, "zipf"))
+                cfg.dist = DIST_ZIPF;
+            else if (!strcmp(optarg, "rr"))
+                cfg.dist = DIST_RR;
+            else {
+                fprintf(stderr, "icm_bench: unknown distribution %s\n", optarg);
+                return 2;
+            }
+            break;
+        case 'z': cfg.alpha     = strtod(optarg, NULL);                 break;
+        case 't': cfg.trace     = optarg;                               break;
+        case 'n': cfg.reqs      = strtoull(optarg, NULL, 0);            break;
+        case 'w': cfg.warmup    = strtoull(optarg, NULL, 0);            break;
+        case 'o': cfg.tags      = (unsigned) strtoul(optarg, NULL, 0);  break;
+        case 'i': cfg.gap       = (unsigned) strtoul(optarg, NULL, 0);  break;
+        case 'L': cfg.dma_lat   = (unsigned) strtoul(optarg, NULL, 0);  break;
+        case 'D': cfg.dma_depth = (unsigned) strtoul(optarg, NULL, 0);  break;
+        case 's': cfg.seed      = (unsigned) strtoul(optarg, NULL, 0);  break;
+        case 'v': cfg.verbose   = true;                                 break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (cfg.tags < 1 || cfg.tags > MAX_TAGS || cfg.dma_depth < 1) {
+        fprintf(stderr, "icm_bench: need 1 <= tags <= %d and a DMA depth\n",
+                MAX_TAGS);
+        return 2;
+    }
+    if (cfg.trace.empty() && !cfg.reqs) {
+        fprintf(stderr, "icm_bench: -n 0 needs a trace\n");
+        return 2;
+    }
+
+    Bench bench(cfg);
+    std::mt19937_64 rng(cfg.seed);
+    std::vector<std::pair<std::vector<uint32_t>, uint64_t>> runs;
+
+    if (!cfg.trace.empty()) {
+        std::vector<uint32_t> trace;
+
+        if (!load_trace(cfg, bench.type(), bench.entry_num(), trace))
+            return 2;
+        if (trace.size() <= cfg.warmup) {
+            fprintf(stderr, "icm_bench: %s has %zu %s records, need more "
+                    "than the %llu warm-up requests\n", cfg.trace.c_str(),
+                    trace.size(), type_name[bench.type()],
+                    (unsigned long long) cfg.warmup);
+            return 2;
+        }
+        std::unordered_set<uint32_t> ws(trace.begin(), trace.end());
+        runs.emplace_back(std::move(trace), ws.size());
+    } else {
+        for (unsigned ws : cfg.working_sets)
+            if (ws >= 1 && ws <= bench.entry_num())
+                runs.emplace_back(synthesize(cfg, ws, rng), ws);
+    }
+
+    printf("{ \"benchmark\": \"icm_cache\", \"cache_type\": \"%s\", "
+           "\"set_num\": %u, \"ways\": %u, \"policy\": \"%s\", "
+           "\"entry_num\": %u, \"tags\": %u,\n  \"issue_gap\": %u, "
+           "\"dma_latency\": %u, \"workload\": ",
+           type_name[bench.type()], bench.set_num(), bench.way_num(),
+           policy_name[bench.policy()],
+           bench.entry_num(), cfg.tags, cfg.gap, cfg.dma_lat);
+    if (!cfg.trace.empty())
+        printf("{ \"trace\": \"%s\" }", cfg.trace.c_str());
+    else if (cfg.dist == DIST_ZIPF)
+        printf("{ \"dist\": \"zipf\", \"alpha\": %.2f }", cfg.alpha);
+    else if (cfg.dist == DIST_RR)
+        printf("{ \"dist\": \"rr\" }");
+    else
+        printf("{ \"dist\": \"uniform\" }");
+    printf(",\n  \"results\": [");
+
+    for (size_t i = 0; i < runs.size(); ++i) {
+        Result r = bench.run(runs[i].first, runs[i].second);
+
+        report(r, i == 0);
+        if (r.stalled || r.mismatches || r.spurious)
+            bad = 1;
+    }
+    printf("\n  ]\n}\n");
+
+    return bad;
+}
@@ -0,0 +1,8 @@
+../sim_lib/SRAM_SDP_Template.v
+../sim_lib/SRAM_TDP_Template.v
+../sim_lib/SyncFIFO_Template.v
+../../../hardware/hdl/rtl/Common/SyncFIFO_2Port_SRAM.v
+../../../hardware/hdl/rtl/Common/SyncFIFO_2Port_Ctrl_SRAM.v
+../../../hardware/hdl/rtl/Common/SRAM_SDP_Model.v
+-F ../../../hardware/hdl/rtl/ResMgtSubsystem/ICMMgt/ICMCache/icm_cache.f
+./ICMCacheBench.v
@@ -0,0 +1,264 @@
+/*------------------------------------------- Module Description : Begin ----------------------------------------------
+Name:       QueueSubsystemBench
+Function:   Verilator top for the SQ throughput bench. Exposes the SQ-side interfaces of QueueSubsystem to the
+            C++ models in qs_bench.cpp, ties off RQ/CQ/EQ, and brings out the WQEFetch cache lookup so the
+            bench can count WQECache hits without touching the RTL. cfg_fixed_prefetch reports whether the
+            build fetches fixed SQ_PREFETCH_LENGTH WQE blocks or the adaptive window (SQ_ADAPTIVE_PREFETCH).
+--------------------------------------------- Module Decription : End -----------------------------------------------*/
+
+/*------------------------------------------- Timescale Definition : Begin ------------------------------------------*/
+`timescale 1ns / 1ps
+/*------------------------------------------- Timescale Definition : End --------------------------------------------*/
+
+/*------------------------------------------- Included Files : Begin ------------------------------------------------*/
+`include "protocol_engine_def.vh"
+/*------------------------------------------- Included Files : End --------------------------------------------------*/
+
+/*------------------------------------------- Input/Output Definition : Begin ---------------------------------------*/
+module QueueSubsystemBench
+(
+    input   wire                                                            clk,
+    input   wire                                                            rst,
+
+//Doorbell FIFO
+    input   wire                                                            db_fifo_empty,
+    input   wire            [63:0]                                          db_fifo_dout,
+    output  wire                                                            db_fifo_rd_en,
+
+//CxtMgt
+    output  wire                                                            SQ_fetch_cxt_ingress_valid,
+    output  wire    [`SQ_OOO_CXT_INGRESS_HEAD_WIDTH - 1 : 0]                SQ_fetch_cxt_ingress_head,
+    input   wire                                                            SQ_fetch_cxt_ingress_ready,
+
+    input   wire                                                            SQ_fetch_cxt_egress_valid,
+    input   wire    [`SQ_OOO_CXT_EGRESS_HEAD_WIDTH - 1 : 0]                 SQ_fetch_cxt_egress_head,
+    output  wire                                                            SQ_fetch_cxt_egress_ready,
+
+//MRMgt
+    output  wire                                                            SQ_fetch_mr_ingress_valid,
+    output  wire    [`SQ_OOO_MR_INGRESS_HEAD_WIDTH - 1 : 0]                 SQ_fetch_mr_ingress_head,
+    output  wire    [`SQ_OOO_MR_INGRESS_DATA_WIDTH - 1 : 0]                 SQ_fetch_mr_ingress_data,
+    input   wire                                                            SQ_fetch_mr_ingress_ready,
+
+    input   wire                                                            SQ_fetch_mr_egress_valid,
+    input   wire    [`SQ_OOO_MR_EGRESS_HEAD_WIDTH - 1 : 0]                  SQ_fetch_mr_egress_head,
+    input   wire    [`SQ_OOO_MR_EGRESS_DATA_WIDTH - 1 : 0]                  SQ_fetch_mr_egress_data,
+    output  wire                                                            SQ_fetch_mr_egress_ready,
+
+//DMA Read Channel
+    output  wire                                                            SQ_dma_rd_req_valid,
+    output  wire    [`DMA_HEAD_WIDTH - 1 : 0]                               SQ_dma_rd_req_head,
+    input   wire                                                            SQ_dma_rd_req_ready,
+
+    input   wire                                                            SQ_dma_rd_rsp_valid,
+    input   wire    [`DMA_HEAD_WIDTH - 1 : 0]                               SQ_dma_rd_rsp_head,
+    input   wire    [`DMA_DATA_WIDTH - 1 : 0]                               SQ_dma_rd_rsp_data,
+    input   wire                                                            SQ_dma_rd_rsp_last,
+    output  wire                                                            SQ_dma_rd_rsp_ready,
+
+//RDMACore
+    output  wire                                                            sub_wqe_valid,
+    output  wire    [`WQE_META_WIDTH - 1 : 0]                               sub_wqe_meta,
+    input   wire                                                            sub_wqe_ready,
+
+//Inline payload buffer
+    output  wire                                                            insert_req_valid,
+    output  wire                                                            insert_req_start,
+    output  wire                                                            insert_req_last,
+    output  wire    [`INLINE_PAYLOAD_BUFFER_SLOT_NUM_LOG - 1 : 0]           insert_req_head,
+    input   wire                                                            insert_req_ready,
+
+    input   wire                                                            insert_resp_valid,
+    input   wire    [`INLINE_PAYLOAD_BUFFER_SLOT_WIDTH - 1 : 0]             insert_resp_data,
+
+//Probes
+    output  wire                                                            wqe_fetch_judge,
+    output  wire                                                            wqe_fetch_hit,
+    output  wire                                                            cfg_fixed_prefetch
+);
+/*------------------------------------------- Input/Output Definition : End -----------------------------------------*/
+
+/*------------------------------------------- Local Variables Definition : Begin ------------------------------------*/
+wire    [`INLINE_PAYLOAD_BUFFER_SLOT_WIDTH - 1 : 0]             insert_req_data;
+/*------------------------------------------- Local Variables Definition : End --------------------------------------*/
+
+/*------------------------------------------- Submodules Instatiation : Begin ---------------------------------------*/
+QueueSubsystem QueueSubsystem_Inst
+(
+    .clk                                (       clk                                 ),
+    .rst                                (       rst                                 ),
+
+    .db_fifo_empty                      (       db_fifo_empty                       ),
+    .db_fifo_dout                       (       db_fifo_dout                        ),
+    .db_fifo_rd_en                      (       db_fifo_rd_en                       ),
+
+    .SQ_fetch_cxt_ingress_valid         (       SQ_fetch_cxt_ingress_valid          ),
+    .SQ_fetch_cxt_ingress_head          (       SQ_fetch_cxt_ingress_head           ),
+    .SQ_fetch_cxt_ingress_data          (                                           ),
+    .SQ_fetch_cxt_ingress_start         (                                           ),
+    .SQ_fetch_cxt_ingress_last          (                                           ),
+    .SQ_fetch_cxt_ingress_ready         (       SQ_fetch_cxt_ingress_ready          ),
+
+    .SQ_fetch_cxt_egress_valid          (       SQ_fetch_cxt_egress_valid           ),
+    .SQ_fetch_cxt_egress_head           (       SQ_fetch_cxt_egress_head            ),
+    .SQ_fetch_cxt_egress_data           (       'd0                                 ),
+    .SQ_fetch_cxt_egress_start          (       SQ_fetch_cxt_egress_valid           ),
+    .SQ_fetch_cxt_egress_last           (       SQ_fetch_cxt_egress_valid           ),
+    .SQ_fetch_cxt_egress_ready          (       SQ_fetch_cxt_egress_ready           ),
+
+    .SQ_fetch_mr_ingress_valid          (       SQ_fetch_mr_ingress_valid           ),
+    .SQ_fetch_mr_ingress_head           (       SQ_fetch_mr_ingress_head            ),
+    .SQ_fetch_mr_ingress_data           (       SQ_fetch_mr_ingress_data            ),
+    .SQ_fetch_mr_ingress_start          (                                           ),
+    .SQ_fetch_mr_ingress_last           (                                           ),
+    .SQ_fetch_mr_ingress_ready          (       SQ_fetch_mr_ingress_ready           ),
+
+    .SQ_fetch_mr_egress_valid           (       SQ_fetch_mr_egress_valid            ),
+    .SQ_fetch_mr_egress_head            (       SQ_fetch_mr_egress_head             ),
+    .SQ_fetch_mr_egress_data            (       SQ_fetch_mr_egress_data             ),
+    .SQ_fetch_mr_egress_start           (       SQ_fetch_mr_egress_valid            ),
+    .SQ_fetch_mr_egress_last            (       SQ_fetch_mr_egress_valid            ),
+    .SQ_fetch_mr_egress_ready           (       SQ_fetch_mr_egress_ready            ),
+
+    .SQ_dma_rd_req_valid                (       SQ_dma_rd_req_valid                 ),
+    .SQ_dma_rd_req_head                 (       SQ_dma_rd_req_head                  ),
+    .SQ_dma_rd_req_data                 (                                           ),
+    .SQ_dma_rd_req_last                 (                                           ),
+    .SQ_dma_rd_req_ready                (       SQ_dma_rd_req_ready                 ),
+
+    .SQ_dma_rd_rsp_valid                (       SQ_dma_rd_rsp_valid                 ),
+    .SQ_dma_rd_rsp_head                 (       SQ_dma_rd_rsp_head                  ),
+    .SQ_dma_rd_rsp_data                 (       SQ_dma_rd_rsp_data                  ),
+    .SQ_dma_rd_rsp_last                 (       SQ_dma_rd_rsp_last                  ),
+    .SQ_dma_rd_rsp_ready                (       SQ_dma_rd_rsp_ready                 ),
+
+    .sub_wqe_valid                      (       sub_wqe_valid                       ),
+    .sub_wqe_meta                       (       sub_wqe_meta                        ),
+    .sub_wqe_ready                      (       sub_wqe_ready                       ),
+
+    .insert_req_valid                   (       insert_req_valid                    ),
+    .insert_req_start                   (       insert_req_start                    ),
+    .insert_req_last                    (       insert_req_last                     ),
+    .insert_req_head                    (       insert_req_head                     ),
+    .insert_req_data                    (       insert_req_data                     ),
+    .insert_req_ready                   (       insert_req_ready                    ),
+
+    .insert_resp_valid                  (       insert_resp_valid                   ),
+    .insert_resp_data                   (       insert_resp_data                    ),
+
+    //The RQ, CQ and EQ paths are idle in this bench
+    .RQ_wqe_req_valid                   (       'd0                                 ),
+    .RQ_wqe_req_head                    (       'd0                                 ),
+    .RQ_wqe_req_start                   (       'd0                                 ),
+    .RQ_wqe_req_last                    (       'd0                                 ),
+    .RQ_wqe_req_ready                   (                                           ),
+
+    .RQ_wqe_resp_valid                  (                                           ),
+    .RQ_wqe_resp_head                   (                                           ),
+    .RQ_wqe_resp_data                   (                                           ),
+    .RQ_wqe_resp_start                  (                                           ),
+    .RQ_wqe_resp_last                   (                                           ),
+    .RQ_wqe_resp_ready                  (       'd1                                 ),
+
+    .RQ_cache_offset_wen                (       'd0                                 ),
+    .RQ_cache_offset_addr               (       'd0                                 ),
+    .RQ_cache_offset_din                (       'd0                                 ),
+    .RQ_cache_offset_dout               (                                           ),
+
+    .RQ_offset_wen                      (       'd0                                 ),
+    .RQ_offset_addr                     (       'd0                                 ),
+    .RQ_offset_din                      (       'd0                                 ),
+    .RQ_offset_dout                     (                                           ),
+
+    .RQ_cache_owned_wen                 (       'd0                                 ),
+    .RQ_cache_owned_addr                (       'd0                                 ),
+    .RQ_cache_owned_din                 (       'd0                                 ),
+    .RQ_cache_owned_dout                (                                           ),
+
+    .RQ_fetch_mr_ingress_valid          (                                           ),
+    .RQ_fetch_mr_ingress_head           (                                           ),
+    .RQ_fetch_mr_ingress_data           (                                           ),
+    .RQ_fetch_mr_ingress_start          (                                           ),
+    .RQ_fetch_mr_ingress_last           (                                           ),
+    .RQ_fetch_mr_ingress_ready          (       'd1                                 ),
+
+    .RQ_fetch_mr_egress_valid           (       'd0                                 ),
+    .RQ_fetch_mr_egress_head            (       'd0                                 ),
+    .RQ_fetch_mr_egress_data            (       'd0                                 ),
+    .RQ_fetch_mr_egress_start           (       'd0                                 ),
+    .RQ_fetch_mr_egress_last            (       'd0                                 ),
+    .RQ_fetch_mr_egress_ready           (                                           ),
+
+    .RQ_dma_rd_req_valid                (                                           ),
+    .RQ_dma_rd_req_head                 (                                           ),
+    .RQ_dma_rd_req_data                 (                                           ),
+    .RQ_dma_rd_req_last                 (                                           ),
+    .RQ_dma_rd_req_ready                (       'd1                                 ),
+
+    .RQ_dma_rd_rsp_valid                (       'd0                                 ),
+    .RQ_dma_rd_rsp_head                 (       'd0                                 ),
+    .RQ_dma_rd_rsp_data                 (       'd0                                 ),
+    .RQ_dma_rd_rsp_last                 (       'd0                                 ),
+    .RQ_dma_rd_rsp_ready                (                                           ),
+
+    .TX_REQ_cq_req_valid                (       'd0                                 ),
+    .TX_REQ_cq_req_head                 (       'd0                                 ),
+    .TX_REQ_cq_req_ready                (                                           ),
+    .TX_REQ_cq_resp_valid               (                                           ),
+    .TX_REQ_cq_resp_head                (                                           ),
+    .TX_REQ_cq_resp_ready               (       'd1                                 ),
+
+    .RX_REQ_cq_req_valid                (       'd0                                 ),
+    .RX_REQ_cq_req_head                 (       'd0                                 ),
+    .RX_REQ_cq_req_ready                (                                           ),
+    .RX_REQ_cq_resp_valid               (                                           ),
+    .RX_REQ_cq_resp_head                (                                           ),
+    .RX_REQ_cq_resp_ready               (       'd1                                 ),
+
+    .RX_RESP_cq_req_valid               (       'd0                                 ),
+    .RX_RESP_cq_req_head                (       'd0                                 ),
+    .RX_RESP_cq_req_ready               (                                           ),
+    .RX_RESP_cq_resp_valid              (                                           ),
+    .RX_RESP_cq_resp_head               (                                           ),
+    .RX_RESP_cq_resp_ready              (       'd1                                 ),
+
+    .TX_REQ_eq_req_valid                (       'd0                                 ),
+    .TX_REQ_eq_req_head                 (       'd0                                 ),
+    .TX_REQ_eq_req_ready                (                                           ),
+    .TX_REQ_eq_resp_valid               (                                           ),
+    .TX_REQ_eq_resp_head                (                                           ),
+    .TX_REQ_eq_resp_ready               (       'd1                                 ),
+
+    .RX_REQ_eq_req_valid                (       'd0                                 ),
+    .RX_REQ_eq_req_head                 (       'd0                                 ),
+    .RX_REQ_eq_req_ready                (                                           ),
+    .RX_REQ_eq_resp_valid               (                                           ),
+    .RX_REQ_eq_resp_head                (                                           ),
+    .RX_REQ_eq_resp_ready               (       'd1                                 ),
+
+    .RX_RESP_eq_req_valid               (       'd0                                 ),
+    .RX_RESP_eq_req_head                (       'd0                                 ),
+    .RX_RESP_eq_req_ready               (                                           ),
+    .RX_RESP_eq_resp_valid              (                                           ),
+    .RX_RESP_eq_resp_head               (                                           ),
+    .RX_RESP_eq_resp_ready              (       'd1                                 ),
+
+    .hca_clock                          (                                           )
+);
+/*------------------------------------------- Submodules Instatiation : End -----------------------------------------*/
+
+/*------------------------------------------- Variables Decode : Begin ----------------------------------------------*/
+//-- wqe_fetch_judge -- WQEFetch resolves the cache lookup in the second JUDGE_s cycle (JUDGE_s = 3'd2)
+//-- wqe_fetch_hit --
+assign wqe_fetch_judge = (QueueSubsystem_Inst.SQMgt_Inst.WQEFetch_Inst.cur_state == 3'd2) && QueueSubsystem_Inst.SQMgt_Inst.WQEFetch_Inst.judge_count;
+assign wqe_fetch_hit = wqe_fetch_judge && QueueSubsystem_Inst.SQMgt_Inst.WQEFetch_Inst.cache_valid;
+
+//-- cfg_fixed_prefetch --
+`ifdef SQ_ADAPTIVE_PREFETCH
+assign cfg_fixed_prefetch = 'd0;
+`else
+assign cfg_fixed_prefetch = 'd1;
+`endif
+/*------------------------------------------- Variables Decode : End ------------------------------------------------*/
+
+endmodule
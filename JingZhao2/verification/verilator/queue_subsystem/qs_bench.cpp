@@ -0,0 +1,624 @@
+/*
+ * Throughput bench for QueueSubsystem (SQMgt, WQECache, WQEFetch,
+ * WQEParser) under Verilator.
+ *
+ * A host model posts RC SEND WQEs into per-QP send queues in host memory
+ * and rings doorbells; the models in qs_models.h answer the context, MR
+ * and DMA requests. Every sub-WQE the parser emits is matched against
+ * the WQE that produced it. Per QP count it reports WQEs per cycle, the
+ * WQECache hit rate and the doorbell-to-issue latency distribution.
+ * The header names the WQE prefetch window the RTL was built with
+ * (SQ_ADAPTIVE_PREFETCH, see the makefile's QS_PREFETCH).
+ *
+ * usage: qs_bench [options]
+ *   -q list   QP counts to sweep, default 1,4,16,64,256,1024,4096,16384
+ *   -n num    WQEs per run after warm-up, default 20000
+ *   -w num    warm-up WQEs per run, default 2000
+ *   -b num    WQEs per doorbell (linked like libhgrnic), default 1
+ *   -o num    outstanding WQEs per QP, default 8
+ *   -p rr|rand  doorbell order across QPs, default rr
+ *   -g num    cycles between doorbells, default 1
+ *   -L cycles DMA read latency, default 100
+ *   -C cycles context read latency, default 4
+ *   -M cycles MR translation latency, default 4
+ *   -r pct    downstream sub_wqe_ready duty cycle, default 100
+ *   -s seed   random seed, default 1
+ *   -v        print a line per doorbell and per sub-WQE
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "verilated.h"
+#include "VQueueSubsystemBench.h"
+
+#include "qs_models.h"
+
+using namespace qs;
+
+namespace {
+
+enum {
+    SQ_DEPTH        = 256,                  /* WQEs per SQ */
+    WQE_SIZE_LOG    = 6,
+    WQE_SIZE        = 1 << WQE_SIZE_LOG,
+    SQ_BYTES        = SQ_DEPTH * WQE_SIZE,
+    DB_FIFO_DEPTH   = 128,
+    MSG_LEN         = 64,
+    RESET_CYCLES    = 16
+};
+
+const uint64_t HOST_BASE = 0x10000000ull;
+
+struct Config {
+    std::vector<unsigned> qps = {1, 4, 16, 64, 256, 1024, 4096, 16384};
+    uint64_t wqes       = 20000;
+    uint64_t warmup     = 2000;
+    unsigned batch      = 1;
+    unsigned window     = 8;
+    bool     random     = false;
+    unsigned db_gap     = 1;
+    unsigned dma_lat    = 100;
+    unsigned cxt_lat    = 4;
+    unsigned mr_lat     = 4;
+    unsigned ready_pct  = 100;
+    unsigned seed       = 1;
+    bool     verbose    = false;
+    uint64_t stall      = 100000;
+};
+
+/* A posted WQE not yet seen at the parser output. */
+struct Pending {
+    uint64_t db_cycle;
+    uint32_t qp;
+    uint32_t offset;        /* in 16 B units, as sub_wqe_meta reports it */
+    uint64_t tag;
+};
+
+/*
+ * QueueSubsystem keeps per-QP state for QP_NUM hardware QPs and uses
+ * QPN[QP_NUM_LOG-1:0] everywhere, so logical QP L runs on slot
+ * L % QP_NUM. A slot belongs to one logical QP until all of that QP's
+ * posted WQEs have been issued; other QPs mapped to it wait.
+ */
+struct Slot {
+    int                 owner = -1;
+    int                 last_owner = -1;
+    uint32_t            prod = 0;
+    std::deque<Pending> pending;
+};
+
+struct Result {
+    unsigned              qps;
+    uint64_t              cycles = 0;
+    uint64_t              issued = 0;
+    uint64_t              doorbells = 0;
+    uint64_t              lookups = 0;
+    uint64_t              hits = 0;
+    uint64_t              dma_bytes = 0;
+    uint64_t              dma_reqs = 0;
+    uint64_t              handovers = 0;
+    uint64_t              mismatches = 0;
+    uint64_t              reordered = 0;
+    uint64_t              spurious = 0;
+    uint64_t              mr_faults = 0;
+    bool                  stalled = false;
+    std::vector<uint32_t> latency;
+};
+
+class Bench {
+public:
+    explicit Bench(const Config &cfg) :
+        cfg_(cfg), rng_(cfg.seed), mem_(HOST_BASE, (size_t) QP_NUM * SQ_BYTES),
+        slot_cxt_(QP_NUM), dma_(mem_), cxt_(slot_cxt_), mr_(slot_cxt_)
+    {
+        ctx_.reset(new VerilatedContext);
+        top_.reset(new VQueueSubsystemBench(ctx_.get()));
+        dma_.configure(cfg.dma_lat, 16);
+        cxt_.configure(cfg.cxt_lat);
+        mr_.configure(cfg.mr_lat);
+    }
+
+    ~Bench() { top_->final(); }
+
+    Result run(unsigned nqp);
+
+    bool fixed_prefetch()
+    {
+        top_->eval();
+        return top_->cfg_fixed_prefetch;
+    }
+
+private:
+    void reset(unsigned nqp);
+    void drive();
+    void sample();
+    void post();
+    bool post_qp(uint32_t qp);
+    void write_wqe(uint32_t slot, uint32_t idx, bool link, uint64_t tag);
+    void retire();
+    void tick();
+
+    const Config                          &cfg_;
+    std::mt19937_64                        rng_;
+    std::unique_ptr<VerilatedContext>      ctx_;
+    std::unique_ptr<VQueueSubsystemBench>  top_;
+
+    HostMem                                mem_;
+    std::vector<SlotCxt>                   slot_cxt_;
+    DmaModel                               dma_;
+    CxtModel                               cxt_;
+    MrModel                                mr_;
+    PayloadModel                           payload_;
+
+    std::deque<uint64_t>                   db_fifo_;
+    std::vector<Slot>                      slots_;
+    std::vector<uint32_t>                  qp_outstanding_;
+    std::vector<uint32_t>                  qp_seq_;
+    unsigned                               nqp_ = 0;
+    uint32_t                               cursor_ = 0;
+    uint64_t                               now_ = 0;
+    uint64_t                               posted_ = 0;
+    uint64_t                               target_ = 0;
+    uint64_t                               last_db_ = 0;
+    uint64_t                               last_progress_ = 0;
+    bool                                   sink_ready_ = true;
+    bool                                   measuring_ = false;
+    Result                                 res_;
+};
+
+void Bench::reset(unsigned nqp)
+{
+    nqp_ = nqp;
+    now_ = 0;
+    posted_ = 0;
+    cursor_ = 0;
+    last_db_ = 0;
+    last_progress_ = 0;
+    measuring_ = false;
+    target_ = cfg_.warmup + cfg_.wqes;
+
+    mem_.clear();
+    dma_.clear();
+    cxt_.clear();
+    mr_.clear();
+    payload_.clear();
+    db_fifo_.clear();
+    slots_.assign(QP_NUM, Slot());
+    qp_outstanding_.assign(nqp, 0);
+    qp_seq_.assign(nqp, 0);
+
+    for (uint32_t s = 0; s < QP_NUM; ++s) {
+        SlotCxt &c = slot_cxt_[s];
+
+        c.dst_qpn = 0;
+        c.pd = 1;
+        c.sq_lkey = (s << 8) | 0x5a;
+        c.sq_length = SQ_BYTES;
+        c.sq_entry_sz_log = WQE_SIZE_LOG;
+        c.pmtu = 5;         /* 4096 */
+        c.sq_base = HOST_BASE + (uint64_t) s * SQ_BYTES;
+    }
+
+    /* State in SRAMs survives rst; a fresh model clears it too. */
+    top_->final();
+    top_.reset();
+    top_.reset(new VQueueSubsystemBench(ctx_.get()));
+    top_->rst = 1;
+    top_->db_fifo_empty = 1;
+    for (unsigned i = 0; i < RESET_CYCLES; ++i) {
+        top_->clk = 0;
+        top_->eval();
+        top_->clk = 1;
+        top_->eval();
+    }
+    top_->rst = 0;
+}
+
+/*
+ * WQE as WQEParser reads it: a 16 B next unit followed by one 16 B data
+ * unit, padded to the 64 B SQ stride.
+ *
+ *   next unit [4:0]    next opcode      [31:6]  next address (16 B units)
+ *             [37:32]  next size        [38]    fence
+ *             [77:70]  this WQE's size  [85:78] this WQE's opcode
+ *             [127:96] immediate
+ *   data unit [30:0]   byte count       [63:32] lkey    [127:64] laddr
+ *
+ * The current size/opcode fields are filled as libhgrnic and ib_hgrnic
+ * fill them (HGRNIC_NEXT_CUR_SIZE_SHIFT/HGRNIC_NEXT_CUR_OPCODE_SHIFT).
+ */
+void Bench::write_wqe(uint32_t slot, uint32_t idx, bool link, uint64_t tag)
+{
+    uint8_t *w = mem_.at(slot_cxt_[slot].sq_base + (uint64_t) idx * WQE_SIZE);
+    uint32_t next = ((idx + 1) % SQ_DEPTH) * (WQE_SIZE / 16);
+    uint32_t word[8] = {0};
+
+    if (link) {
+        word[0] = (next << 6) | VERBS_SEND;
+        word[1] = 2;                            /* next size, 16 B units */
+    }
+    word[2] = (2 << 6) | (VERBS_SEND << 14);
+    word[4] = MSG_LEN;
+    word[5] = 0x1000 | slot;                    /* payload lkey */
+    word[6] = (uint32_t) tag;
+    word[7] = (uint32_t) (tag >> 32);
+
+    memset(w, 0, WQE_SIZE);
+    for (unsigned i = 0; i < 8; ++i) {
+        w[4 * i]     = (uint8_t) word[i];
+        w[4 * i + 1] = (uint8_t) (word[i] >> 8);
+        w[4 * i + 2] = (uint8_t) (word[i] >> 16);
+        w[4 * i + 3] = (uint8_t) (word[i] >> 24);
+    }
+}
+
+bool Bench::post_qp(uint32_t qp)
+{
+    Slot &s = slots_[qp % QP_NUM];
+    uint32_t slot = qp % QP_NUM;
+    unsigned n = (unsigned) std::min<uint64_t>(cfg_.batch, target_ - posted_);
+    uint64_t db;
+
+    if (s.owner >= 0 && (uint32_t) s.owner != qp)
+        return false;
+    if (qp_outstanding_[qp] + n > cfg_.window)
+        return false;
+
+    if (s.owner < 0) {
+        if (s.last_owner >= 0 && (uint32_t) s.last_owner != qp)
+            ++res_.handovers;
+        s.owner = s.last_owner = (int) qp;
+        slot_cxt_[slot].dst_qpn = qp;
+    }
+
+    for (unsigned k = 0; k < n; ++k) {
+        uint32_t idx = (s.prod + k) % SQ_DEPTH;
+        uint64_t tag = ((uint64_t) qp << 32) | qp_seq_[qp]++;
+
+        write_wqe(slot, idx, k + 1 < n, tag);
+        s.pending.push_back(Pending{now_, qp, idx * (WQE_SIZE / 16), tag});
+    }
+    s.prod = (s.prod + n) % SQ_DEPTH;
+    qp_outstanding_[qp] += n;
+    posted_ += n;
+
+    /* {QPN[63:40], SQ producer index in 16 B units [31:8]} */
+    db = ((uint64_t) qp << 40) | ((uint64_t) (s.prod * (WQE_SIZE / 16)) << 8);
+    db_fifo_.push_back(db);
+    ++res_.doorbells;
+    last_db_ = now_;
+    if (cfg_.verbose)
+        printf("# %llu db qp %u slot %u n %u head %u\n",
+               (unsigned long long) now_, qp, slot, n, s.prod);
+    return true;
+}
+
+/* Ring at most one doorbell per db_gap cycles, scanning a few QPs. */
+void Bench::post()
+{
+    if (posted_ >= target_ || db_fifo_.size() >= DB_FIFO_DEPTH)
+        return;
+    if (res_.doorbells && now_ - last_db_ < cfg_.db_gap)
+        return;
+
+    for (unsigned tries = 0; tries < std::min(nqp_, 16u); ++tries) {
+        uint32_t qp;
+
+        if (cfg_.random) {
+            qp = (uint32_t) (rng_() % nqp_);
+        } else {
+            qp = cursor_;
+            cursor_ = (cursor_ + 1) % nqp_;
+        }
+        if (post_qp(qp))
+            return;
+    }
+}
+
+void Bench::drive()
+{
+    if (db_fifo_.empty()) {
+        top_->db_fifo_empty = 1;
+        top_->db_fifo_dout = 0;
+    } else {
+        top_->db_fifo_empty = 0;
+        top_->db_fifo_dout = db_fifo_.front();
+    }
+
+    top_->SQ_fetch_cxt_ingress_ready = cxt_.in_ready();
+    top_->SQ_fetch_cxt_egress_valid = cxt_.out_valid(now_);
+    if (top_->SQ_fetch_cxt_egress_valid)
+        cxt_.out_head(top_->SQ_fetch_cxt_egress_head);
+
+    /*
+     * WQEFetch writes its meta FIFO on valid alone; only offer a reply
+     * when SQMetaProc is ready so that nothing is written twice.
+     */
+    top_->SQ_fetch_mr_ingress_ready = mr_.in_ready();
+    top_->SQ_fetch_mr_egress_valid = mr_.out_valid(now_) &&
+                                     top_->SQ_fetch_mr_egress_ready;
+    if (top_->SQ_fetch_mr_egress_valid)
+        mr_.out(top_->SQ_fetch_mr_egress_head, top_->SQ_fetch_mr_egress_data);
+
+    top_->SQ_dma_rd_req_ready = dma_.req_ready();
+    top_->SQ_dma_rd_rsp_valid = dma_.rsp_valid(now_);
+    top_->SQ_dma_rd_rsp_last = top_->SQ_dma_rd_rsp_valid &&
+        dma_.rsp_beat(top_->SQ_dma_rd_rsp_head, top_->SQ_dma_rd_rsp_data);
+
+    sink_ready_ = cfg_.ready_pct >= 100 ||
+                  (unsigned) (rng_() % 100) < cfg_.ready_pct;
+    top_->sub_wqe_ready = sink_ready_;
+
+    top_->insert_req_ready = 1;
+    top_->insert_resp_valid = 1;
+    wide_clear(top_->insert_resp_data, 128);
+    wide_set(top_->insert_resp_data, 0, 32, payload_.next_slot());
+}
+
+/* Match one sub-WQE against the WQEs posted on its slot. */
+void Bench::retire()
+{
+    const auto &meta = top_->sub_wqe_meta;
+    uint32_t slot = (uint32_t) wide_get(meta, SUB_LOCAL_QPN_LSB, 24) % QP_NUM;
+    uint32_t offset = (uint32_t) wide_get(meta, SUB_ORI_OFFSET_LSB, 24);
+    uint64_t tag = wide_get(meta, SUB_LADDR_LSB, 64);
+    Slot &s = slots_[slot];
+    std::deque<Pending>::iterator it;
+
+    if (cfg_.verbose)
+        printf("# %llu wqe slot %u offset %u tag %016llx\n",
+               (unsigned long long) now_, slot, offset,
+               (unsigned long long) tag);
+
+    /* Messages are shorter than the PMTU: one sub-WQE per WQE. */
+    if (!wide_get(meta, SUB_WQE_HEAD_BIT, 1))
+        return;
+
+    for (it = s.pending.begin(); it != s.pending.end(); ++it)
+        if (it->tag == tag)
+            break;
+    if (it == s.pending.end()) {
+        ++res_.spurious;
+        return;
+    }
+    if (it != s.pending.begin())
+        ++res_.reordered;
+    if (it->offset != offset)
+        ++res_.mismatches;
+
+    if (!measuring_ && res_.issued >= cfg_.warmup) {
+        measuring_ = true;
+        res_.cycles = now_;
+        res_.issued = 0;
+        res_.lookups = 0;
+        res_.hits = 0;
+        res_.latency.clear();
+    }
+    if (measuring_)
+        res_.latency.push_back((uint32_t) (now_ - it->db_cycle));
+    ++res_.issued;
+    last_progress_ = now_;
+
+    if (--qp_outstanding_[it->qp] == 0 && s.pending.size() == 1)
+        s.owner = -1;
+    s.pending.erase(it);
+}
+
+/* Handshakes are sampled after the inputs settle, before the edge. */
+void Bench::sample()
+{
+    if (top_->db_fifo_rd_en && !db_fifo_.empty())
+        db_fifo_.pop_front();
+
+    if (top_->SQ_fetch_cxt_ingress_valid && top_->SQ_fetch_cxt_ingress_ready)
+        cxt_.accept(now_, top_->SQ_fetch_cxt_ingress_head);
+    if (top_->SQ_fetch_cxt_egress_valid && top_->SQ_fetch_cxt_egress_ready)
+        cxt_.out_fire();
+
+    if (top_->SQ_fetch_mr_ingress_valid && top_->SQ_fetch_mr_ingress_ready)
+        mr_.accept(now_, top_->SQ_fetch_mr_ingress_head,
+                   top_->SQ_fetch_mr_ingress_data);
+    if (top_->SQ_fetch_mr_egress_valid && top_->SQ_fetch_mr_egress_ready)
+        mr_.out_fire();
+
+    if (top_->SQ_dma_rd_req_valid && top_->SQ_dma_rd_req_ready)
+        dma_.accept(now_, top_->SQ_dma_rd_req_head);
+    if (top_->SQ_dma_rd_rsp_valid && top_->SQ_dma_rd_rsp_ready)
+        dma_.rsp_fire();
+
+    if (top_->insert_req_valid && top_->insert_req_start && top_->insert_req_ready)
+        payload_.fire();
+
+    if (top_->wqe_fetch_judge) {
+        ++res_.lookups;
+        res_.hits += top_->wqe_fetch_hit;
+    }
+
+    if (top_->sub_wqe_valid && sink_ready_)
+        retire();
+}
+
+void Bench::tick()
+{
+    post();
+    drive();
+    top_->clk = 0;
+    top_->eval();
+    sample();
+    top_->clk = 1;
+    top_->eval();
+    ++now_;
+}
+
+Result Bench::run(unsigned nqp)
+{
+    uint64_t dma_bytes0 = 0, dma_reqs0 = 0;
+    bool measuring = false;
+
+    res_ = Result();
+    res_.qps = nqp;
+    reset(nqp);
+
+    while (measuring_ ? res_.issued < cfg_.wqes : true) {
+        if (measuring_ && !measuring) {
+            measuring = true;
+            dma_bytes0 = dma_.bytes();
+            dma_reqs0 = dma_.reqs();
+        }
+        if (now_ - last_progress_ > cfg_.stall) {
+            res_.stalled = true;
+            break;
+        }
+        tick();
+    }
+
+    res_.cycles = measuring_ ? now_ - res_.cycles : now_;
+    res_.dma_bytes = dma_.bytes() - dma_bytes0;
+    res_.dma_reqs = dma_.reqs() - dma_reqs0;
+    res_.mr_faults = mr_.faults();
+    return res_;
+}
+
+double percentile(const std::vector<uint32_t> &v, double p)
+{
+    if (v.empty())
+        return 0;
+    return v[std::min(v.size() - 1, (size_t) (p * (v.size() - 1) + 0.5))];
+}
+
+void report(Result &r, bool first)
+{
+    std::vector<uint32_t> &lat = r.latency;
+    double sum = 0;
+
+    std::sort(lat.begin(), lat.end());
+    for (uint32_t l : lat)
+        sum += l;
+
+    printf("%s\n    { \"qps\": %u, \"hw_qps\": %u, \"wqes\": %llu, "
+           "\"cycles\": %llu, \"wqe_per_cycle\": %.4f,\n"
+           "      \"wqe_cache\": { \"lookups\": %llu, \"hits\": %llu, "
+           "\"hit_rate\": %.4f },\n"
+           "      \"latency\": { \"min\": %.0f, \"mean\": %.1f, \"p50\": %.0f, "
+           "\"p90\": %.0f, \"p99\": %.0f, \"p999\": %.0f, \"max\": %.0f },\n"
+           "      \"doorbells\": %llu, \"dma_rd_reqs\": %llu, "
+           "\"dma_rd_bytes\": %llu, \"slot_handovers\": %llu,\n"
+           "      \"mismatches\": %llu, \"reordered\": %llu, "
+           "\"spurious\": %llu, \"mr_faults\": %llu, \"stalled\": %s }",
+           first ? "" : ",", r.qps, std::min<unsigned>(r.qps, QP_NUM),
+           (unsigned long long) r.issued, (unsigned long long) r.cycles,
+           r.cycles ? (double) r.issued / r.cycles : 0.0,
+           (unsigned long long) r.lookups, (unsigned long long) r.hits,
+           r.lookups ? (double) r.hits / r.lookups : 0.0,
+           percentile(lat, 0), lat.empty() ? 0.0 : sum / lat.size(),
+           percentile(lat, 0.5), percentile(lat, 0.9), percentile(lat, 0.99),
+           percentile(lat, 0.999), percentile(lat, 1),
+           (unsigned long long) r.doorbells, (unsigned long long) r.dma_reqs,
+           (unsigned long long) r.dma_bytes, (unsigned long long) r.handovers,
+           (unsigned long long) r.mismatches, (unsigned long long) r.reordered,
+           (unsigned long long) r.spurious, (unsigned long long) r.mr_faults,
+           r.stalled ? "true" : "false");
+}
+
+std::vector<unsigned> parse_list(const char *s)
+{
+    std::vector<unsigned> v;
+    std::string str(s);
+    size_t pos = 0;
+
+    while (pos < str.size()) {
+        size_t end = str.find(',', pos);
+
+        if (end == std::string::npos)
+            end = str.size();
+        v.push_back((unsigned) strtoul(str.substr(pos, end - pos).c_str(), NULL, 0));
+        pos = end + 1;
+    }
+    return v;
+}
+
+void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-q qps,...] [-n wqes] [-w warmup] [-b batch] "
+            "[-o outstanding] [-p rr|rand] [-g gap] [-L dma_lat] [-C cxt_lat] "
+            "[-M mr_lat] [-r ready_pct] [-s seed] [-v]\n", argv0);
+}
+
+} /* namespace */
+
+int main(int argc, char **argv)
+{
+    Config cfg;
+    int op, bad = 0;
+
+    Verilated::commandArgs(argc, argv);
+
+    while ((op = getopt(argc, argv, "q:n:w:b:o:p:g:L:C:M:r:s:v")) != -1) {
+        switch (op) {
+        case 'q': cfg.qps       = parse_list(optarg);                   break;
+        case 'n': cfg.wqes      = strtoull(optarg, NULL, 0);            break;
+        case 'w': cfg.warmup    = strtoull(optarg, NULL, 0);            break;
+        case 'b': cfg.batch     = (unsigned) strtoul(optarg, NULL, 0);  break;
+        case 'o': cfg.window    = (unsigned) strtoul(optarg, NULL, 0);  break;
+        case 'p':
+            if (strcmp(optarg, "rr") && strcmp(optarg, "rand")) {
+                fprintf(stderr, "qs_bench: unknown doorbell order %s\n", optarg);
+                return 2;
+            }
+            cfg.random = !strcmp(optarg, "rand");
+            break;
+        case 'g': cfg.db_gap    = (unsigned) strtoul(optarg, NULL, 0);  break;
+        case 'L': cfg.dma_lat   = (unsigned) strtoul(optarg, NULL, 0);  break;
+        case 'C': cfg.cxt_lat   = (unsigned) strtoul(optarg, NULL, 0);  break;
+        case 'M': cfg.mr_lat    = (unsigned) strtoul(optarg, NULL, 0);  break;
+        case 'r': cfg.ready_pct = (unsigned) strtoul(optarg, NULL, 0);  break;
+        case 's': cfg.seed      = (unsigned) strtoul(optarg, NULL, 0);  break;
+        case 'v': cfg.verbose   = true;                                 break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    /* The window must fit in the SQ and a batch must fit in the window. */
+    if (cfg.batch < 1 || cfg.window < cfg.batch || cfg.window >= SQ_DEPTH) {
+        fprintf(stderr, "qs_bench: need 1 <= batch <= outstanding < %d\n",
+                SQ_DEPTH);
+        return 2;
+    }
+    for (unsigned q : cfg.qps) {
+        if (q < 1 || q > (1u << 16)) {
+            fprintf(stderr, "qs_bench: QP count %u out of range\n", q);
+            return 2;
+        }
+    }
+
+    Bench bench(cfg);
+
+    printf("{ \"benchmark\": \"queue_subsystem\", \"batch\": %u, "
+           "\"outstanding\": %u, \"pattern\": \"%s\", \"dma_latency\": %u, "
+           "\"sq_depth\": %d, \"msg_len\": %d, \"prefetch\": \"%s\",\n"
+           "  \"results\": [",
+           cfg.batch, cfg.window, cfg.random ? "rand" : "rr", cfg.dma_lat,
+           SQ_DEPTH, MSG_LEN, bench.fixed_prefetch() ? "fixed" : "adaptive");
+    for (size_t i = 0; i < cfg.qps.size(); ++i) {
+        Result r = bench.run(cfg.qps[i]);
+
+        report(r, i == 0);
+        if (r.stalled || r.mismatches || r.spurious || r.mr_faults)
+            bad = 1;
+    }
+    printf("\n  ]\n}\n");
+
+    return bad;
+}
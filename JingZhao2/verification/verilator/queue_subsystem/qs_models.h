@@ -0,0 +1,405 @@
+/*
+ * Behavioural models for the QueueSubsystem bench: host memory behind
+ * the DMA read channel, the CxtMgt and MRMgt responders, and the inline
+ * payload buffer. Field positions follow include/Top/protocol_engine_def.vh.
+ */
+
+#ifndef QS_MODELS_H
+#define QS_MODELS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+namespace qs {
+
+/* protocol_engine_def.vh */
+enum {
+    QP_NUM                  = 256,
+    PAGE_SIZE               = 4096,
+
+    CACHE_ENTRY_WIDTH_QPC   = 416,
+    COMMON_HEAD_WIDTH       = 32,
+    CXT_INGRESS_HEAD_WIDTH  = 128 + COMMON_HEAD_WIDTH,
+    CXT_EGRESS_HEAD_WIDTH   = 416 + 128 + 96 + COMMON_HEAD_WIDTH,
+    MR_INGRESS_HEAD_WIDTH   = 192 + COMMON_HEAD_WIDTH,
+    MR_RESP_DATA_WIDTH      = 224,
+    MR_EGRESS_HEAD_WIDTH    = MR_RESP_DATA_WIDTH + COMMON_HEAD_WIDTH,
+    OOO_DATA_WIDTH          = 512,
+    DMA_HEAD_WIDTH          = 128,
+    DMA_DATA_WIDTH          = 512,
+    DMA_BEAT_BYTES          = DMA_DATA_WIDTH / 8,
+    WQE_META_WIDTH          = 576,
+    INLINE_SLOT_NUM         = 4096,
+
+    PAGE_VALID              = 0xf,
+    SERVICE_RC              = 0,
+    VERBS_SEND              = 0x0a
+};
+
+/* QP context fields (QP_CXT_*_OFFSET) */
+enum {
+    QPC_SERVICE_TYPE_LSB    = 0,
+    QPC_PMTU_LSB            = 13,
+    QPC_SQ_ENTRY_SZ_LOG_LSB = 16,
+    QPC_DST_QPN_LSB         = 32,
+    QPC_PD_LSB              = 96,
+    QPC_SQ_LKEY_LSB         = 128,
+    QPC_SQ_LENGTH_LSB       = 160
+};
+
+/* Sub-WQE metadata, WQEParser sub_wqe_meta */
+enum {
+    SUB_LOCAL_QPN_LSB       = 0,
+    SUB_WQE_HEAD_BIT        = 66,
+    SUB_WQE_TAIL_BIT        = 67,
+    SUB_ORI_OFFSET_LSB      = 72,
+    SUB_LADDR_LSB           = 320
+};
+
+/*
+ * Bit fields of Verilator wide signals. W is VlWide<N> or the plain
+ * WData array older Verilators generate; both index by 32-bit word.
+ */
+template <class W>
+static inline void wide_clear(W &w, unsigned width)
+{
+    for (unsigned i = 0; i < (width + 31) / 32; ++i)
+        w[i] = 0;
+}
+
+template <class W>
+static inline void wide_set(W &w, unsigned lsb, unsigned width, uint64_t v)
+{
+    while (width) {
+        unsigned word = lsb >> 5;
+        unsigned sh   = lsb & 31;
+        unsigned n    = std::min(width, 32 - sh);
+        uint32_t mask = (n == 32 ? 0xffffffffu : ((1u << n) - 1)) << sh;
+
+        w[word] = (w[word] & ~mask) | (((uint32_t) v << sh) & mask);
+        v     >>= n;
+        lsb    += n;
+        width  -= n;
+    }
+}
+
+template <class W>
+static inline uint64_t wide_get(const W &w, unsigned lsb, unsigned width)
+{
+    uint64_t v = 0;
+    unsigned got = 0;
+
+    while (got < width) {
+        unsigned word = lsb >> 5;
+        unsigned sh   = lsb & 31;
+        unsigned n    = std::min(width - got, 32 - sh);
+        uint64_t bits = ((uint64_t) w[word] >> sh) &
+                        (n == 32 ? 0xffffffffull : ((1ull << n) - 1));
+
+        v   |= bits << got;
+        got += n;
+        lsb += n;
+    }
+    return v;
+}
+
+/*
+ * Flat host memory at [base, base + size). The SQ buffers live here.
+ * Addresses stay below 4 GiB: SQMetaProc only forwards the low 32 bits
+ * of the second page address to WQEFetch.
+ */
+class HostMem {
+public:
+    HostMem(uint64_t base, size_t size) : base_(base), mem_(size) {}
+
+    void clear() { std::fill(mem_.begin(), mem_.end(), 0); }
+
+    uint8_t *at(uint64_t addr) { return &mem_[addr - base_]; }
+
+    void read(uint64_t addr, uint8_t *buf, size_t len) const
+    {
+        for (size_t i = 0; i < len; ++i) {
+            uint64_t a = addr + i;
+            buf[i] = (a >= base_ && a - base_ < mem_.size()) ?
+                     mem_[a - base_] : 0;
+        }
+    }
+
+private:
+    uint64_t             base_;
+    std::vector<uint8_t> mem_;
+};
+
+/* Fixed-latency, in-order request/response pipe shared by the models. */
+template <class T>
+class Pipe {
+public:
+    explicit Pipe(unsigned latency = 0, unsigned depth = 16) :
+        latency_(latency), depth_(depth) {}
+
+    void configure(unsigned latency, unsigned depth)
+    {
+        latency_ = latency;
+        depth_   = depth;
+    }
+
+    void clear() { q_.clear(); }
+    bool can_accept() const { return q_.size() < depth_; }
+    void push(uint64_t now, const T &v) { q_.push_back(Entry{now + latency_, v}); }
+    bool ready(uint64_t now) const { return !q_.empty() && q_.front().due <= now; }
+    T &front() { return q_.front().v; }
+    void pop() { q_.pop_front(); }
+    size_t size() const { return q_.size(); }
+
+private:
+    struct Entry {
+        uint64_t due;
+        T        v;
+    };
+
+    unsigned          latency_;
+    unsigned          depth_;
+    std::deque<Entry> q_;
+};
+
+/*
+ * DMA read channel. A request head carries {addr[95:32], len[31:0]}; the
+ * response is ceil(len / 64) beats of little-endian data starting at addr,
+ * one beat per cycle once the latency has elapsed.
+ */
+class DmaModel {
+public:
+    struct Job {
+        uint64_t addr;
+        uint32_t len;
+        uint32_t beat;
+        uint32_t head[DMA_HEAD_WIDTH / 32];
+    };
+
+    explicit DmaModel(const HostMem &mem) : mem_(mem) {}
+
+    void configure(unsigned latency, unsigned outstanding)
+    {
+        jobs_.configure(latency, outstanding);
+    }
+
+    void clear()
+    {
+        jobs_.clear();
+        bytes_ = 0;
+        reqs_  = 0;
+    }
+
+    bool req_ready() const { return jobs_.can_accept(); }
+
+    template <class W>
+    void accept(uint64_t now, const W &head)
+    {
+        Job j;
+
+        j.len  = (uint32_t) wide_get(head, 0, 32);
+        j.addr = wide_get(head, 32, 64);
+        j.beat = 0;
+        for (unsigned i = 0; i < DMA_HEAD_WIDTH / 32; ++i)
+            j.head[i] = head[i];
+        jobs_.push(now, j);
+        bytes_ += j.len;
+        ++reqs_;
+    }
+
+    bool rsp_valid(uint64_t now) const { return jobs_.ready(now); }
+
+    /* Drives the current beat; returns last. */
+    template <class H, class D>
+    bool rsp_beat(H &head, D &data)
+    {
+        Job &j = jobs_.front();
+        uint8_t buf[DMA_BEAT_BYTES];
+
+        for (unsigned i = 0; i < DMA_HEAD_WIDTH / 32; ++i)
+            head[i] = j.head[i];
+        mem_.read(j.addr + (uint64_t) j.beat * DMA_BEAT_BYTES, buf, sizeof(buf));
+        for (unsigned i = 0; i < DMA_DATA_WIDTH / 32; ++i)
+            data[i] = (uint32_t) buf[4 * i] | (uint32_t) buf[4 * i + 1] << 8 |
+                      (uint32_t) buf[4 * i + 2] << 16 |
+                      (uint32_t) buf[4 * i + 3] << 24;
+        return (j.beat + 1) * DMA_BEAT_BYTES >= j.len;
+    }
+
+    void rsp_fire()
+    {
+        Job &j = jobs_.front();
+
+        if (++j.beat * DMA_BEAT_BYTES >= j.len)
+            jobs_.pop();
+    }
+
+    uint64_t bytes() const { return bytes_; }
+    uint64_t reqs() const { return reqs_; }
+
+private:
+    const HostMem &mem_;
+    Pipe<Job>      jobs_;
+    uint64_t       bytes_ = 0;
+    uint64_t       reqs_  = 0;
+};
+
+/* What the responders need to know about the QP owning a hardware slot. */
+struct SlotCxt {
+    uint32_t dst_qpn;
+    uint32_t pd;
+    uint32_t sq_lkey;
+    uint32_t sq_length;
+    uint32_t sq_entry_sz_log;
+    uint32_t pmtu;          /* encoded: 128 << pmtu bytes */
+    uint64_t sq_base;
+};
+
+/*
+ * CxtMgt read port. SQMetaProc only sends QPN[QP_NUM_LOG-1:0] in the
+ * common head, so contexts are looked up by hardware slot.
+ */
+class CxtModel {
+public:
+    explicit CxtModel(const std::vector<SlotCxt> &slots) : slots_(slots) {}
+
+    void configure(unsigned latency) { reqs_.configure(latency, 64); }
+    void clear() { reqs_.clear(); }
+
+    bool in_ready() const { return reqs_.can_accept(); }
+
+    template <class W>
+    void accept(uint64_t now, const W &head)
+    {
+        reqs_.push(now, (uint32_t) wide_get(head, 0, 16) % QP_NUM);
+    }
+
+    bool out_valid(uint64_t now) const { return reqs_.ready(now); }
+
+    template <class W>
+    void out_head(W &head)
+    {
+        uint32_t slot = reqs_.front();
+        const SlotCxt &c = slots_[slot];
+        unsigned q = COMMON_HEAD_WIDTH;
+
+        wide_clear(head, CXT_EGRESS_HEAD_WIDTH);
+        wide_set(head, 0, 16, slot);
+        wide_set(head, q + QPC_SERVICE_TYPE_LSB, 3, SERVICE_RC);
+        wide_set(head, q + QPC_PMTU_LSB, 3, c.pmtu);
+        wide_set(head, q + QPC_SQ_ENTRY_SZ_LOG_LSB, 8, c.sq_entry_sz_log);
+        wide_set(head, q + QPC_DST_QPN_LSB, 16, c.dst_qpn);
+        wide_set(head, q + QPC_PD_LSB, 32, c.pd);
+        wide_set(head, q + QPC_SQ_LKEY_LSB, 32, c.sq_lkey);
+        wide_set(head, q + QPC_SQ_LENGTH_LSB, 32, c.sq_length);
+    }
+
+    void out_fire() { reqs_.pop(); }
+
+private:
+    const std::vector<SlotCxt> &slots_;
+    Pipe<uint32_t>              reqs_;
+};
+
+/*
+ * MRMgt translation port. The request is {len, laddr (relative to the
+ * SQ), lkey, pd, flags, common head}; the reply carries up to two
+ * physically contiguous pieces split at the 4 KiB page boundary, and
+ * echoes the request data (the QP context) back for SQMetaProc.
+ */
+class MrModel {
+public:
+    struct Req {
+        uint32_t slot;
+        uint32_t len;
+        uint64_t laddr;
+        uint32_t lkey;
+        uint32_t data[OOO_DATA_WIDTH / 32];
+    };
+
+    explicit MrModel(const std::vector<SlotCxt> &slots) : slots_(slots) {}
+
+    void configure(unsigned latency) { reqs_.configure(latency, 64); }
+
+    void clear()
+    {
+        reqs_.clear();
+        faults_ = 0;
+    }
+
+    bool in_ready() const { return reqs_.can_accept(); }
+
+    template <class H, class D>
+    void accept(uint64_t now, const H &head, const D &data)
+    {
+        Req r;
+
+        r.slot  = (uint32_t) wide_get(head, 0, 16) % QP_NUM;
+        r.lkey  = (uint32_t) wide_get(head, 96, 32);
+        r.laddr = wide_get(head, 128, 64);
+        r.len   = (uint32_t) wide_get(head, 192, 32);
+        for (unsigned i = 0; i < OOO_DATA_WIDTH / 32; ++i)
+            r.data[i] = data[i];
+        reqs_.push(now, r);
+    }
+
+    bool out_valid(uint64_t now) const { return reqs_.ready(now); }
+
+    template <class H, class D>
+    void out(H &head, D &data)
+    {
+        const Req &r = reqs_.front();
+        const SlotCxt &c = slots_[r.slot];
+        unsigned q = COMMON_HEAD_WIDTH;
+        uint64_t pa = c.sq_base + r.laddr;
+        uint32_t size0 = std::min<uint32_t>(r.len, PAGE_SIZE - (pa & (PAGE_SIZE - 1)));
+        uint32_t size1 = r.len - size0;
+
+        if (r.lkey != c.sq_lkey || r.laddr + r.len > c.sq_length)
+            ++faults_;
+
+        wide_clear(head, MR_EGRESS_HEAD_WIDTH);
+        wide_set(head, 0, 16, r.slot);
+        wide_set(head, q + 0, 4, PAGE_VALID);
+        wide_set(head, q + 4, 4, size1 ? PAGE_VALID : 0);
+        wide_set(head, q + 32, 32, size0);
+        wide_set(head, q + 64, 32, size1);
+        wide_set(head, q + 96, 64, pa);
+        wide_set(head, q + 160, 64, size1 ? pa + size0 : 0);
+        for (unsigned i = 0; i < OOO_DATA_WIDTH / 32; ++i)
+            data[i] = r.data[i];
+    }
+
+    void out_fire() { reqs_.pop(); }
+
+    uint64_t faults() const { return faults_; }
+
+private:
+    const std::vector<SlotCxt> &slots_;
+    Pipe<Req>                   reqs_;
+    uint64_t                    faults_ = 0;
+};
+
+/*
+ * Inline payload buffer. WQEParser takes the slot address of the first
+ * flit in the same cycle it writes it, so the response is always valid
+ * and names the next free slot. Slots are never reclaimed: nothing
+ * downstream of the parser is modelled.
+ */
+class PayloadModel {
+public:
+    void clear() { next_ = 0; }
+    uint32_t next_slot() const { return next_; }
+    void fire() { next_ = (next_ + 1) % INLINE_SLOT_NUM; }
+
+private:
+    uint32_t next_ = 0;
+};
+
+} /* namespace qs */
+
+#endif /* QS_MODELS_H */
@@ -0,0 +1,13 @@
+../sim_lib/SRAM_SDP_Template.v
+../sim_lib/SRAM_TDP_Template.v
+../sim_lib/SyncFIFO_Template.v
+../../../hardware/hdl/rtl/Common/SyncFIFO_2Port_SRAM.v
+../../../hardware/hdl/rtl/Common/SyncFIFO_2Port_Ctrl_SRAM.v
+../../../hardware/hdl/rtl/Common/SRAM_SDP_Model.v
+../../../hardware/hdl/rtl/Common/AXISArbiter.v
+../../../hardware/hdl/rtl/Common/stream_reg.v
+../../../hardware/hdl/rtl/Common/slice/gp_slice_ml.v
+../../../hardware/hdl/rtl/Common/slice/gp_slice.v
+../../../hardware/hdl/rtl/Peripherals/GatherData.v
+-F ../../../hardware/hdl/rtl/QueueSubsystem/queue_subsystem.f
+./QueueSubsystemBench.v
@@ -0,0 +1,66 @@
+/*------------------------------------------- Module Description : Begin ----------------------------------------------
+Name:       AsyncFIFO_577w_128d
+Function:   Behavioural stand-in for the Xilinx FIFO core of the same name that TransportSubsystem puts on the MAC
+            TX/RX clock crossings. First-word-fall-through with 128 entries and prog_full at 127, as the core
+            is generated. The pointers cross clocks without synchronisers, which is exact when user_clk and
+            the MAC clocks are the same, as in the co-simulation harness.
+--------------------------------------------- Module Decription : End -----------------------------------------------*/
+`timescale  1ns / 1ps
+
+module AsyncFIFO_577w_128d
+(
+    input   wire                    wr_clk,
+    input   wire                    wr_rst,
+    input   wire                    rd_clk,
+    input   wire                    rd_rst,
+
+    input   wire    [576 : 0]       din,
+    input   wire                    wr_en,
+    input   wire                    rd_en,
+    output  wire    [576 : 0]       dout,
+    output  wire                    full,
+    output  wire                    empty,
+    output  wire                    prog_full
+);
+
+localparam  ADDR_WIDTH = 7;
+localparam  PROG_FULL_THRESH = 127;
+
+reg     [576 : 0]               mem [0 : (1 << ADDR_WIDTH) - 1];
+reg     [ADDR_WIDTH : 0]        wptr;
+reg     [ADDR_WIDTH : 0]        rptr;
+
+wire    [ADDR_WIDTH : 0]        count;
+
+always @(posedge wr_clk) begin
+    if(wr_en && !full) begin
+        mem[wptr[ADDR_WIDTH - 1 : 0]] <= din;
+    end
+end
+
+always @(posedge wr_clk or posedge wr_rst) begin
+    if(wr_rst) begin
+        wptr <= 'd0;
+    end
+    else if(wr_en && !full) begin
+        wptr <= wptr + 'd1;
+    end
+end
+
+always @(posedge rd_clk or posedge rd_rst) begin
+    if(rd_rst) begin
+        rptr <= 'd0;
+    end
+    else if(rd_en && !empty) begin
+        rptr <= rptr + 'd1;
+    end
+end
+
+assign count = wptr - rptr;
+
+assign dout = mem[rptr[ADDR_WIDTH - 1 : 0]];
+assign empty = (wptr == rptr);
+assign full = (count == (1 << ADDR_WIDTH));
+assign prog_full = (count >= PROG_FULL_THRESH);
+
+endmodule
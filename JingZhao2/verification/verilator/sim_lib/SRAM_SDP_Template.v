@@ -0,0 +1,71 @@
+/*------------------------------------------- Module Description : Begin ----------------------------------------------
+Name:       SRAM_SDP_Template
+Function:   Behavioural stand-in for rtl/Common/SRAM_SDP_Template.v used by the Verilator harnesses.
+            Same one-cycle read latency and write-to-read forwarding as the BRAM-backed template.
+--------------------------------------------- Module Decription : End -----------------------------------------------*/
+`timescale  1ns / 1ps
+
+`include "common_function_def.vh"
+
+module SRAM_SDP_Template #(
+    parameter       RAM_WIDTH = 32,
+    parameter       RAM_DEPTH = 32,
+    parameter       ADDR_WIDTH = log2b(RAM_DEPTH - 1)
+)
+(
+    input   wire                                clk,
+    input   wire                                rst,
+
+    input   wire                                wea,
+    input   wire    [ADDR_WIDTH - 1 : 0]        addra,
+    input   wire    [RAM_WIDTH - 1 : 0]         dina,
+
+    input   wire    [ADDR_WIDTH - 1 : 0]        addrb,
+    output  wire    [RAM_WIDTH - 1 : 0]         doutb
+);
+
+reg     [RAM_WIDTH - 1 : 0]         mem [0 : RAM_DEPTH - 1];
+reg     [RAM_WIDTH - 1 : 0]         doutb_fake;
+
+integer i;
+
+initial begin
+    for(i = 0; i < RAM_DEPTH; i = i + 1) begin
+        mem[i] = 'd0;
+    end
+end
+
+always @(posedge clk) begin
+    if(wea) begin
+        mem[addra] <= dina;
+    end
+    doutb_fake <= mem[addrb];
+end
+
+//Resolve read-write collisions
+reg                                wea_diff;
+reg    [ADDR_WIDTH - 1 : 0]        addra_diff;
+reg    [RAM_WIDTH - 1 : 0]         dina_diff;
+
+reg    [ADDR_WIDTH - 1 : 0]        addrb_diff;
+
+always @(posedge clk or posedge rst) begin
+    if(rst) begin
+        wea_diff <= 'd0;
+        addra_diff <= 'd0;
+        dina_diff <= 'd0;
+
+        addrb_diff <= 'd0;
+    end
+    else begin
+        wea_diff <= wea;
+        addra_diff <= addra;
+        dina_diff <= dina;
+
+        addrb_diff <= addrb;
+    end
+end
+
+assign doutb = (wea_diff && (addra_diff == addrb_diff)) ? dina_diff : doutb_fake;
+
+endmodule
@@ -0,0 +1,98 @@
+/*------------------------------------------- Module Description : Begin ----------------------------------------------
+Name:       SRAM_TDP_Template
+Function:   Behavioural stand-in for rtl/Common/SRAM_TDP_Template.v used by the Verilator harnesses.
+            The RTL template picks a Xilinx BRAM core by width and depth; here every shape is a plain
+            array with the same one-cycle read latency and the same write-to-read forwarding.
+--------------------------------------------- Module Decription : End -----------------------------------------------*/
+`timescale  1ns / 1ps
+
+`include "common_function_def.vh"
+
+module SRAM_TDP_Template #(
+    parameter       RAM_WIDTH = 32,
+    parameter       RAM_DEPTH = 32,
+    parameter       ADDR_WIDTH = log2b(RAM_DEPTH - 1)
+)
+(
+    input   wire                                clk,
+    input   wire                                rst,
+
+    input   wire                                wea,
+    input   wire    [ADDR_WIDTH - 1 : 0]        addra,
+    input   wire    [RAM_WIDTH - 1 : 0]         dina,
+    output  wire    [RAM_WIDTH - 1 : 0]         douta,
+
+    input   wire                                web,
+    input   wire    [ADDR_WIDTH - 1 : 0]        addrb,
+    input   wire    [RAM_WIDTH - 1 : 0]         dinb,
+    output  wire    [RAM_WIDTH - 1 : 0]         doutb
+);
+
+reg     [RAM_WIDTH - 1 : 0]         mem [0 : RAM_DEPTH - 1];
+reg     [RAM_WIDTH - 1 : 0]         douta_fake;
+reg     [RAM_WIDTH - 1 : 0]         doutb_fake;
+
+integer i;
+
+//BRAM without an init file powers up as zeros; the valid bits in the cache tables rely on that.
+initial begin
+    for(i = 0; i < RAM_DEPTH; i = i + 1) begin
+        mem[i] = 'd0;
+    end
+end
+
+//Read-first on both ports, as the BRAM cores are configured.
+always @(posedge clk) begin
+    if(wea) begin
+        mem[addra] <= dina;
+    end
+    if(web) begin
+        mem[addrb] <= dinb;
+    end
+    douta_fake <= mem[addra];
+    doutb_fake <= mem[addrb];
+end
+
+reg                                wea_diff;
+reg    [ADDR_WIDTH - 1 : 0]        addra_diff;
+reg    [RAM_WIDTH - 1 : 0]         dina_diff;
+
+reg                                web_diff;
+reg    [ADDR_WIDTH - 1 : 0]        addrb_diff;
+reg    [RAM_WIDTH - 1 : 0]         dinb_diff;
+
+always @(posedge clk or posedge rst) begin
+    if(rst) begin
+        wea_diff <= 'd0;
+        addra_diff <= 'd0;
+        dina_diff <= 'd0;
+    end
+    else begin
+        wea_diff <= wea;
+        addra_diff <= addra;
+        dina_diff <= dina;
+    end
+end
+
+assign douta = (addra_diff == addrb_diff) && wea_diff && !web_diff ? dina_diff :
+                (addra_diff == addrb_diff) && !wea_diff && web_diff ? dinb_diff :
+                (addra_diff != addrb_diff) && wea_diff ? dina_diff : douta_fake;
+
+always @(posedge clk or posedge rst) begin
+    if(rst) begin
+        web_diff <= 'd0;
+        addrb_diff <= 'd0;
+        dinb_diff <= 'd0;
+    end
+    else begin
+        web_diff <= web;
+        addrb_diff <= addrb;
+        dinb_diff <= dinb;
+    end
+end
+
+assign doutb = (addra_diff == addrb_diff) && wea_diff && !web_diff ? dina_diff :
+                (addra_diff == addrb_diff) && !wea_diff && web_diff ? dinb_diff :
+                (addra_diff != addrb_diff) && web_diff ? dinb_diff : doutb_fake;
+
+endmodule
@@ -0,0 +1,50 @@
+/*------------------------------------------- Module Description : Begin ----------------------------------------------
+Name:       SyncFIFO_Template
+Function:   Behavioural stand-in for rtl/Common/SyncFIFO_Template.v used by the Verilator harnesses.
+            Every FIFO_TYPE maps to the register-file FIFO the RTL already uses for FIFO_TYPE 1, which is
+            first-word-fall-through like the Xilinx cores. prog_full asserts with fewer than 3 free
+            entries rather than at the per-core thresholds.
+--------------------------------------------- Module Decription : End -----------------------------------------------*/
+`timescale  1ns / 1ps
+
+`include "common_function_def.vh"
+
+module SyncFIFO_Template #(
+    parameter       FIFO_TYPE   = 0,    //Ignored, always RegFiles
+    parameter       FIFO_WIDTH  = 32,
+    parameter       FIFO_DEPTH  = 32,
+    parameter       COUNT_WIDTH = log2b(FIFO_DEPTH)
+)
+(
+    input   wire                                clk,
+    input   wire                                rst,
+
+    input   wire                                wr_en,
+    input   wire    [FIFO_WIDTH - 1 : 0]        din,
+    output  wire                                prog_full,
+    input   wire                                rd_en,
+    output  wire    [FIFO_WIDTH - 1 : 0]        dout,
+    output  wire                                empty,
+    output  wire    [COUNT_WIDTH - 1 : 0]       data_count
+);
+
+SyncFIFO_2Port_SRAM #(
+    .DATA_WIDTH(FIFO_WIDTH),
+    .FIFO_DEPTH(FIFO_DEPTH)
+)
+SyncFIFO_RegFile_Inst
+(
+    .clk(clk),
+    .rst(rst),
+
+    .wr_en(wr_en),
+    .din(din),
+    .prog_full(prog_full),
+
+    .rd_en(rd_en),
+    .dout(dout),
+    .empty(empty),
+    .data_count(data_count)
+);
+
+endmodule
@@ -0,0 +1,71 @@
+/*------------------------------------------- Module Description : Begin ----------------------------------------------
+Name:       pcieifc_async_fifo_2psram
+Function:   Behavioural stand-in for lib/pciei_lib/async_fifo/pcieifc_async_fifo_2psram.v used by the Verilator
+            harnesses. The library version picks a Xilinx async FIFO core by width and depth. This one is
+            first-word-fall-through like those cores, but the pointers cross between wr_clk and rd_clk without
+            synchronisers, so full and empty update one cycle after the other side moves. Exact when both
+            clocks are the same, as in the co-simulation harness.
+--------------------------------------------- Module Decription : End -----------------------------------------------*/
+`timescale 1ns / 100ps
+
+module pcieifc_async_fifo_2psram #(
+    parameter DATA_WIDTH  = 192,
+    parameter ADDR_WIDTH  = 3,
+
+    parameter FIFO_DEPTH  = (1 << ADDR_WIDTH)
+) (
+    input                   wr_clk,
+    input                   rd_clk,
+    input                   wrst_n,
+    input                   rrst_n,
+
+    input                   wr_en,
+    input  [DATA_WIDTH-1:0] din  ,
+    output                  full ,
+
+    input                   rd_en,
+    output [DATA_WIDTH-1:0] dout ,
+    output                  empty
+
+`ifdef PCIEI_APB_DBG
+    ,input wire  [1:0]  rtsel
+    ,input wire  [1:0]  wtsel
+    ,input wire  [1:0]  ptsel
+    ,input wire         vg
+    ,input wire         vs
+`endif
+);
+
+reg [DATA_WIDTH-1:0] mem [0:FIFO_DEPTH-1];
+reg [ADDR_WIDTH:0]   wptr;
+reg [ADDR_WIDTH:0]   rptr;
+
+always @(posedge wr_clk) begin
+    if (wr_en & !full) begin
+        mem[wptr[ADDR_WIDTH-1:0]] <= `TD din;
+    end
+end
+
+always @(posedge wr_clk or negedge wrst_n) begin
+    if (!wrst_n) begin
+        wptr <= `TD {(ADDR_WIDTH+1){1'b0}};
+    end
+    else if (wr_en & !full) begin
+        wptr <= `TD wptr + 1;
+    end
+end
+
+always @(posedge rd_clk or negedge rrst_n) begin
+    if (!rrst_n) begin
+        rptr <= `TD {(ADDR_WIDTH+1){1'b0}};
+    end
+    else if (rd_en & !empty) begin
+        rptr <= `TD rptr + 1;
+    end
+end
+
+assign dout  = mem[rptr[ADDR_WIDTH-1:0]];
+assign empty = (rptr == wptr);
+assign full  = (rptr[ADDR_WIDTH-1:0] == wptr[ADDR_WIDTH-1:0]) & (rptr[ADDR_WIDTH] != wptr[ADDR_WIDTH]);
+
+endmodule
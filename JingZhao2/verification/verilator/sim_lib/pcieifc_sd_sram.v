@@ -0,0 +1,69 @@
+/*------------------------------------------- Module Description : Begin ----------------------------------------------
+Name:       pcieifc_sd_sram
+Function:   Behavioural stand-in for lib/pciei_lib/ram/pcieifc_sd_sram.v used by the Verilator harnesses.
+            The library version picks a Xilinx block memory by width and depth. Those cores read every cycle
+            (reb is not connected) with one cycle of latency; this model does the same and forwards a write
+            to a read of the same address, like SRAM_SDP_Template.
+--------------------------------------------- Module Decription : End -----------------------------------------------*/
+`timescale 1ns / 100ps
+
+module pcieifc_sd_sram #(
+    parameter DATAWIDTH  = 8, // Memory data word width
+    parameter ADDRWIDTH  = 4, // Number of mem address bits
+    parameter DEPTH      = 1 << ADDRWIDTH
+) (
+    input  wire clk  , // i, 1
+    input  wire rst_n, // i, 1
+
+    input  wire                 wea  , // i, 1
+    input  wire [ADDRWIDTH-1:0] addra, // i, ADDRWIDTH
+    input  wire [DATAWIDTH-1:0] dina , // i, DATAWIDTH
+
+    input  wire                 reb  , // i, 1
+    input  wire [ADDRWIDTH-1:0] addrb, // i, ADDRWIDTH
+    output  wire [DATAWIDTH-1:0] doutb  // o, DATAWIDTH
+
+`ifdef PCIEI_APB_DBG
+    ,input wire  [1:0]  rtsel
+    ,input wire  [1:0]  wtsel
+    ,input wire  [1:0]  ptsel
+    ,input wire         vg
+    ,input wire         vs
+`endif
+);
+
+reg [DATAWIDTH-1:0] mem [0:DEPTH-1];
+reg [DATAWIDTH-1:0] doutb_fake;
+
+reg                 fwd_valid;
+reg [DATAWIDTH-1:0] fwd_data;
+
+integer i;
+
+initial begin
+    for (i = 0; i < DEPTH; i = i + 1) begin
+        mem[i] = {DATAWIDTH{1'b0}};
+    end
+end
+
+always @(posedge clk) begin
+    if (wea) begin
+        mem[addra] <= `TD dina;
+    end
+    doutb_fake <= `TD mem[addrb];
+end
+
+always @(posedge clk or negedge rst_n) begin
+    if (!rst_n) begin
+        fwd_valid <= `TD 1'b0;
+        fwd_data  <= `TD {DATAWIDTH{1'b0}};
+    end
+    else begin
+        fwd_valid <= `TD wea & (addra == addrb);
+        fwd_data  <= `TD dina;
+    end
+end
+
+assign doutb = fwd_valid ? fwd_data : doutb_fake;
+
+endmodule
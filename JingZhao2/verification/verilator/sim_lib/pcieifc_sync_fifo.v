@@ -0,0 +1,75 @@
+/*------------------------------------------- Module Description : Begin ----------------------------------------------
+Name:       pcieifc_sync_fifo
+Function:   Behavioural stand-in for lib/pciei_lib/sync_fifo/pcieifc_sync_fifo.v used by the Verilator harnesses.
+            The library version wraps a Xilinx FIFO core between two st_reg stages for most shapes; here every
+            shape is the register-file FIFO the library already uses for its DEFAULT0 shapes: first-word-fall-
+            through, `clr` empties it, and a write into a full FIFO is taken when the same cycle reads.
+--------------------------------------------- Module Decription : End -----------------------------------------------*/
+`timescale 1ns / 100ps
+
+module pcieifc_sync_fifo #(
+    parameter DSIZE = 8,
+    parameter ASIZE = 4
+) (
+    input  wire             clk  ,
+    input  wire             rst_n,
+    input  wire             clr  ,
+    input  wire             wen  ,
+    input  wire             ren  ,
+    input  wire [DSIZE-1:0] din  ,
+    output wire [DSIZE-1:0] dout ,
+    output wire             full ,
+    output wire             empty
+
+`ifdef PCIEI_APB_DBG
+    ,input wire  [1:0]  rtsel
+    ,input wire  [1:0]  wtsel
+    ,input wire  [1:0]  ptsel
+    ,input wire         vg
+    ,input wire         vs
+`endif
+);
+
+reg [DSIZE-1:0] mem [0:(1<<ASIZE)-1];
+reg [ASIZE:0]   waddr;
+reg [ASIZE:0]   raddr;
+
+wire            wr_dis;
+
+assign wr_dis = full & (~ren);
+
+always @(posedge clk) begin
+    if (wen & !wr_dis) begin
+        mem[waddr[ASIZE-1:0]] <= `TD din;
+    end
+end
+
+always @(posedge clk or negedge rst_n) begin
+    if (!rst_n) begin
+        waddr <= `TD {(ASIZE+1){1'b0}};
+    end
+    else if (clr) begin
+        waddr <= `TD {(ASIZE+1){1'b0}};
+    end
+    else if (wen & !wr_dis) begin
+        waddr <= `TD waddr + 1;
+    end
+end
+
+always @(posedge clk or negedge rst_n) begin
+    if (!rst_n) begin
+        raddr <= `TD {(ASIZE+1){1'b0}};
+    end
+    else if (clr) begin
+        raddr <= `TD {(ASIZE+1){1'b0}};
+    end
+    else if (ren & !empty) begin
+        raddr <= `TD raddr + 1;
+    end
+end
+
+assign dout  = mem[raddr[ASIZE-1:0]];
+assign empty = (raddr == waddr);
+assign full  = (raddr[ASIZE-1:0] == waddr[ASIZE-1:0]) & (raddr[ASIZE] != waddr[ASIZE]);
+
+endmodule
@@ -0,0 +1,71 @@
+/*------------------------------------------- Module Description : Begin ----------------------------------------------
+Name:       pcieifc_td_sram
+Function:   Behavioural stand-in for lib/pciei_lib/ram/pcieifc_td_sram.v used by the Verilator harnesses.
+            The library version is a Xilinx block memory (FPGA_VERSION) or a TSMC macro. Both ports read with
+            one cycle of latency and are write-first, as the Xilinx core is configured.
+--------------------------------------------- Module Decription : End -----------------------------------------------*/
+`timescale 1ns / 100ps
+
+module pcieifc_td_sram #(
+    parameter DATAWIDTH  = 8, // Memory data word width
+    parameter ADDRWIDTH  = 4, // Number of mem address bits
+    parameter DEPTH      = 1 << ADDRWIDTH
+) (
+    input  wire clk  , // i, 1
+    input  wire rst_n, // i, 1
+
+    input  wire                 wea  , // i, 1
+    input  wire [ADDRWIDTH-1:0] addra, // i, ADDRWIDTH
+    input  wire [DATAWIDTH-1:0] dina , // i, DATAWIDTH
+    output wire [DATAWIDTH-1:0] douta, // o, DATAWIDTH
+
+    input  wire                 web  , // i, 1
+    input  wire [ADDRWIDTH-1:0] addrb, // i, ADDRWIDTH
+    input  wire [DATAWIDTH-1:0] dinb , // i, DATAWIDTH
+    output wire [DATAWIDTH-1:0] doutb  // o, DATAWIDTH
+
+`ifdef PCIEI_APB_DBG
+    ,input wire  [1:0]  rtsel
+    ,input wire  [1:0]  wtsel
+    ,input wire  [1:0]  ptsel
+    ,input wire         vg
+    ,input wire         vs
+`endif
+);
+
+reg [DATAWIDTH-1:0] mem [0:DEPTH-1];
+reg [DATAWIDTH-1:0] douta_reg;
+reg [DATAWIDTH-1:0] doutb_reg;
+
+integer i;
+
+initial begin
+    for (i = 0; i < DEPTH; i = i + 1) begin
+        mem[i] = {DATAWIDTH{1'b0}};
+    end
+end
+
+always @(posedge clk) begin
+    if (wea) begin
+        mem[addra] <= `TD dina;
+        douta_reg  <= `TD dina;
+    end
+    else begin
+        douta_reg  <= `TD mem[addra];
+    end
+end
+
+always @(posedge clk) begin
+    if (web) begin
+        mem[addrb] <= `TD dinb;
+        doutb_reg  <= `TD dinb;
+    end
+    else begin
+        doutb_reg  <= `TD mem[addrb];
+    end
+end
+
+assign douta = douta_reg;
+assign doutb = doutb_reg;
+
+endmodule